@@ -0,0 +1,197 @@
+//
+//  AccountCacheScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Clock.hpp"
+#include "cft/File.hpp"
+#include "cft/RefreshingCache.hpp"
+#include "Scenarios.hpp"
+#include "WorkerPool.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+constexpr std::int64_t kStartMillis = 1546300800000;
+
+// Counts callbacks so the scenario can wait for asynchronous deliveries.
+class Deliveries {
+public:
+    void record(ErrorCode error, CacheFreshness freshness) {
+        std::lock_guard<std::mutex> guard(_lock);
+        ++_count;
+        _failures += error != ErrorCode::None;
+        _stale += freshness == CacheFreshness::Stale;
+        _changed.notify_all();
+    }
+
+    void waitFor(std::uint64_t count) {
+        std::unique_lock<std::mutex> lock(_lock);
+        _changed.wait(lock, [&] { return _count >= count; });
+    }
+
+    std::uint64_t failures() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _failures;
+    }
+
+    std::uint64_t stale() {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _stale;
+    }
+
+private:
+    std::mutex _lock;
+    std::condition_variable _changed;
+    std::uint64_t _count = 0;
+    std::uint64_t _failures = 0;
+    std::uint64_t _stale = 0;
+};
+
+} // namespace
+
+bool runAccountCacheScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t callers,
+                             unsigned concurrency) {
+    const std::string path = workDirectory + "/account-cache-scenario.snapshot";
+    ::unlink(path.c_str());
+
+    RefreshingCacheConfig config;
+    config.ttlMillis = 60000;
+    config.prefetchLeadMillis = 10000;
+    config.maxStaleMillis = 600000;
+    config.retryMillis = 5000;
+
+    WorkerPool pool(concurrency);
+    std::atomic<std::int64_t> now{kStartMillis};
+    std::atomic<bool> failFetches{false};
+    std::atomic<std::uint64_t> gatewayFetches{0};
+    RefreshingCache *cachePointer = nullptr;
+
+    // Every fetch is a gateway round trip on a pool thread, like fetchWithMerchantAccount:.
+    RefreshingCache cache(config, [&](const std::string &key) {
+        pool.post([&, key] {
+            gateway.fetchMerchantAccount(1);
+            const std::uint64_t fetch = ++gatewayFetches;
+            const ErrorCode error = failFetches ? ErrorCode::IOFailure : ErrorCode::None;
+            cachePointer->complete(key, error, key + "#" + std::to_string(fetch), now);
+        });
+    });
+    cachePointer = &cache;
+    bool passed = true;
+
+    // Cold start: every caller asks at once and they share one fetch per account.
+    const std::uint64_t accounts = 4;
+    Deliveries cold;
+    const Nanos coldStart = monotonicNanos();
+    for (std::uint64_t i = 0; i < callers; ++i) {
+        pool.post([&, i] {
+            cache.get("acct_" + std::to_string(i % accounts), now,
+                      [&](ErrorCode error, const std::string &, CacheFreshness freshness) { cold.record(error, freshness); });
+        });
+    }
+    cold.waitFor(callers);
+    const Nanos coldElapsed = monotonicNanos() - coldStart;
+    const std::uint64_t coldFetches = cache.fetchCount();
+    passed &= coldFetches == accounts && cold.failures() == 0;
+
+    // Warm reads are served synchronously without touching the network.
+    Deliveries warm;
+    const Nanos warmStart = monotonicNanos();
+    for (std::uint64_t i = 0; i < callers; ++i) {
+        cache.get("acct_0", now, [&](ErrorCode error, const std::string &, CacheFreshness freshness) { warm.record(error, freshness); });
+    }
+    warm.waitFor(callers);
+    const Nanos warmElapsed = monotonicNanos() - warmStart;
+    std::string value;
+    passed &= cache.tryGet("acct_2", now, value) == CacheFreshness::Fresh && value.compare(0, 7, "acct_2#") == 0;
+    passed &= cache.fetchCount() == coldFetches;
+
+    // Inside the prefetch window reads still hit, and one background refresh per account goes out.
+    now += config.ttlMillis - config.prefetchLeadMillis / 2;
+    passed &= cache.nextPrefetchMillis(now) <= now;
+    const std::size_t prefetched = cache.prefetchDue(now);
+    passed &= prefetched == accounts;
+    passed &= cache.prefetchDue(now) == 0;
+    while (gatewayFetches < coldFetches + accounts) {
+        ::usleep(100);
+    }
+
+    // Past the TTL with the gateway down: stale values are served at once, a single refresh
+    // is attempted, and after it fails no retry goes out before retryMillis.
+    now += config.ttlMillis + 1000;
+    failFetches = true;
+    Deliveries stale;
+    for (std::uint64_t i = 0; i < callers; ++i) {
+        cache.get("acct_1", now, [&](ErrorCode error, const std::string &, CacheFreshness freshness) { stale.record(error, freshness); });
+    }
+    stale.waitFor(callers);
+    passed &= stale.stale() == callers && stale.failures() == 0;
+    const std::uint64_t fetchesBeforeRetry = coldFetches + accounts + 1;
+    while (gatewayFetches < fetchesBeforeRetry) {
+        ::usleep(100);
+    }
+    passed &= cache.fetchCount() == fetchesBeforeRetry;
+    cache.get("acct_1", now, nullptr);
+    passed &= cache.fetchCount() == fetchesBeforeRetry;
+
+    // A missing account with the gateway down reports the error to every waiter.
+    Deliveries missing;
+    const std::uint64_t missingCallers = 16;
+    for (std::uint64_t i = 0; i < missingCallers; ++i) {
+        pool.post([&] {
+            cache.get("acct_missing", now, [&](ErrorCode error, const std::string &, CacheFreshness freshness) {
+                missing.record(error, freshness);
+            });
+        });
+    }
+    missing.waitFor(missingCallers);
+    passed &= missing.failures() == missingCallers;
+    failFetches = false;
+
+    // The snapshot survives a restart with its age, and a damaged one is rejected.
+    passed &= cache.save(path) == ErrorCode::None;
+    RefreshingCache restored(config, [](const std::string &) {});
+    passed &= restored.load(path) == ErrorCode::None && restored.size() == accounts;
+    passed &= restored.peek("acct_0", now, value) == CacheFreshness::Stale && value.compare(0, 7, "acct_0#") == 0;
+    passed &= restored.peek("acct_missing", now, value) == CacheFreshness::Missing;
+
+    std::vector<std::uint8_t> bytes;
+    {
+        File file;
+        passed &= File::openForRead(path, file) == ErrorCode::None && file.readAll(bytes) == ErrorCode::None;
+    }
+    bytes[bytes.size() / 2] ^= 0x40;
+    passed &= File::replace(path, bytes.data(), bytes.size()) == ErrorCode::None;
+    RefreshingCache damaged(config, [](const std::string &) {});
+    passed &= damaged.load(path) == ErrorCode::InvalidArgument && damaged.size() == 0;
+    passed &= damaged.load(workDirectory + "/account-cache-scenario.none") == ErrorCode::NotFound;
+
+    std::printf("account cache %llu callers, %llu accounts, %llu fetches (%llu coalesced), cold %.3f ms, "
+                "warm %.3f us/get, %llu stale hits, %s\n",
+                static_cast<unsigned long long>(callers),
+                static_cast<unsigned long long>(accounts),
+                static_cast<unsigned long long>(cache.fetchCount()),
+                static_cast<unsigned long long>(cache.coalescedCount()),
+                static_cast<double>(coldElapsed) / 1e6,
+                static_cast<double>(warmElapsed) / 1e3 / static_cast<double>(callers),
+                static_cast<unsigned long long>(cache.staleHitCount()),
+                passed ? "ok" : "FAILED");
+    ::unlink(path.c_str());
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
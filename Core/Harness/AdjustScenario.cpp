@@ -0,0 +1,216 @@
+//
+//  AdjustScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Amount.hpp"
+#include "cft/BatchScheduler.hpp"
+#include "cft/Clock.hpp"
+#include "cft/SettlementLedger.hpp"
+#include "cft/TipAdjustmentBatch.hpp"
+#include "cft/TransactionRecordStore.hpp"
+#include "HttpGateway.hpp"
+#include "Scenarios.hpp"
+#include "WorkerPool.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const std::int64_t kNowMillis = 1546387200000;
+
+// A night of restaurant sales; every tenth record is a refund, which takes no tip.
+StoredTransactionRecord closedOutRecord(std::uint64_t index) {
+    const std::uint64_t roll = mix64(index ^ 0x71b5);
+    StoredTransactionRecord record{};
+    record.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Approved);
+    record.result = static_cast<std::uint8_t>(TransactionResult::Approved);
+    record.transactionType = static_cast<std::uint8_t>(index % 10 == 9 ? TransactionType::Refund : TransactionType::Sale);
+    record.createdAtMillis = kNowMillis - static_cast<std::int64_t>(index) * 60000;
+    record.transactedAtMillis = record.createdAtMillis + 1500;
+    record.amountMinor = static_cast<std::int64_t>(1500 + roll % 20000);
+    record.updatedAtMillis = record.createdAtMillis;
+    record.cardBrand = static_cast<std::uint8_t>((roll >> 24) % kCardBrandCount);
+    record.networkType = static_cast<std::uint8_t>(NetworkType::Credit);
+    record.cardInputMethod = static_cast<std::uint8_t>(CardInputMethod::Dip);
+
+    char text[kStoredTextCapacity];
+    std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(index + 1));
+    StoredTransactionRecord::assign(record.transactionId, text);
+    return record;
+}
+
+std::vector<TipAdjustment> tipsFor(const std::vector<StoredTransactionRecord> &records) {
+    std::vector<TipAdjustment> tips;
+    for (const StoredTransactionRecord &record : records) {
+        Amount tip;
+        Amount(record.amountMinor, Amount::kUsdExponent)
+            .percentage(1500 + static_cast<std::int64_t>(mix64(record.amountMinor) % 1000), tip);
+        tips.push_back(TipAdjustment{StoredTransactionRecord::text(record.transactionId), tip.minorUnits()});
+    }
+    return tips;
+}
+
+struct AdjustRun {
+    Nanos optimisticNanos = 0;
+    Nanos elapsedNanos = 0;
+    std::size_t peakInFlight = 0;
+    std::int64_t optimisticTipsMinor = 0;
+};
+
+/*!
+ * @brief Apply every tip locally, then send them with up to window requests in flight
+ */
+bool adjust(TransactionRecordStore &store, SettlementLedger &ledger, std::uint64_t &cursor, HttpConnectionPool &connections,
+            std::vector<TipAdjustment> tips, unsigned window, AdjustRun &run) {
+    bool passed = true;
+    auto catchUp = [&]() {
+        for (std::vector<StoredTransactionRecord> page = store.changesSince(cursor, 256, cursor); !page.empty();
+             page = store.changesSince(cursor, 256, cursor)) {
+            for (const StoredTransactionRecord &record : page) {
+                passed &= ledger.apply(record) == ErrorCode::None;
+            }
+        }
+    };
+
+    const Nanos start = monotonicNanos();
+    TipAdjustmentBatch batch(store, std::move(tips));
+    batch.applyOptimistically(kNowMillis);
+    catchUp();
+    run.optimisticNanos = monotonicNanos() - start;
+    run.optimisticTipsMinor = ledger.totals().total.tipsMinor;
+
+    std::vector<std::size_t> applied;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (batch.state(i) == TipAdjustmentState::Applied) {
+            applied.push_back(i);
+        }
+    }
+
+    WorkerPool workers(window);
+    BatchScheduler scheduler(applied.size(), window);
+    std::mutex lock;
+    scheduler.run(
+        [&](std::size_t item) {
+            workers.post([&, item] {
+                const std::size_t index = applied[item];
+                GatewayRequest request;
+                request.operation = GatewayOperation::Adjust;
+                request.transactionId = std::strtoull(batch.adjustment(index).transactionId.c_str(), nullptr, 10);
+                request.amountMinor = batch.adjustment(index).tipMinor;
+                HttpGatewayClient client(connections);
+                const GatewayResponse response = client.authorize(request);
+                const ErrorCode outcome = response.result == TransactionResult::Approved ? ErrorCode::None
+                                          : response.result == TransactionResult::Declined ? ErrorCode::Declined
+                                                                                           : ErrorCode::IOFailure;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    passed &= batch.complete(index, outcome, kNowMillis) == ErrorCode::None;
+                }
+                scheduler.complete(item, outcome);
+            });
+        },
+        nullptr);
+    scheduler.wait();
+    run.elapsedNanos = monotonicNanos() - start;
+    run.peakInFlight = scheduler.peakInFlight();
+    catchUp();
+
+    // Confirmed tips stay, refused ones are back to what they were, refunds were never sent.
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        StoredTransactionRecord record;
+        passed &= store.get(batch.adjustment(i).transactionId, record);
+        switch (batch.state(i)) {
+            case TipAdjustmentState::Confirmed:
+                passed &= record.tipMinor == batch.adjustment(i).tipMinor;
+                break;
+            case TipAdjustmentState::Reverted:
+                passed &= record.tipMinor == 0;
+                break;
+            case TipAdjustmentState::Rejected:
+                passed &= batch.error(i) == ErrorCode::IllegalTransition &&
+                          static_cast<TransactionType>(record.transactionType) == TransactionType::Refund;
+                break;
+            default:
+                passed = false;
+                break;
+        }
+    }
+    return passed && batch.outstandingCount() == 0;
+}
+
+} // namespace
+
+bool runAdjustScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t tips, unsigned window) {
+    HttpGatewayServer server(gateway);
+    if (server.start() != ErrorCode::None) {
+        std::printf("adjust        could not start the loopback gateway\n");
+        return false;
+    }
+    HttpConnectionPool connections(server.port(), 0);
+
+    // The same night closed out twice: one tip at a time, then pipelined.
+    const unsigned windows[] = {1, window == 0 ? 1 : window};
+    AdjustRun runs[2];
+    bool passed = true;
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        const std::string path = workDirectory + "/adjust-scenario.store";
+        ::unlink(path.c_str());
+        std::unique_ptr<TransactionRecordStore> store;
+        if (TransactionRecordStore::open(path, TransactionRecordStoreConfig(), store) != ErrorCode::None) {
+            std::printf("adjust        could not open %s\n", path.c_str());
+            return false;
+        }
+        std::vector<StoredTransactionRecord> records;
+        for (std::uint64_t i = 0; i < tips; ++i) {
+            records.push_back(closedOutRecord(i));
+            passed &= store->put(records.back()) == ErrorCode::None;
+        }
+
+        SettlementLedger ledger(SettlementScheme::BroadPosManual);
+        std::uint64_t cursor = 0;
+        passed &= adjust(*store, ledger, cursor, connections, tipsFor(records), windows[pass], runs[pass]);
+
+        // The optimistic totals counted every tip that was sent; the final ones match the records.
+        std::int64_t sent = 0;
+        for (const TipAdjustment &tip : tipsFor(records)) {
+            StoredTransactionRecord record;
+            store->get(tip.transactionId, record);
+            sent += TipAdjustmentBatch::isAdjustable(record) || record.tipMinor != 0 ? tip.tipMinor : 0;
+        }
+        SettlementLedger recomputed(SettlementScheme::BroadPosManual);
+        for (const StoredTransactionRecord &record : store->query(TransactionRecordQuery())) {
+            recomputed.apply(record);
+        }
+        passed &= runs[pass].optimisticTipsMinor == sent && ledger.totals() == recomputed.totals();
+
+        store.reset();
+        ::unlink(path.c_str());
+    }
+    server.stop();
+
+    const double sequentialMs = static_cast<double>(runs[0].elapsedNanos) / 1e6;
+    const double pipelinedMs = static_cast<double>(runs[1].elapsedNanos) / 1e6;
+    passed &= runs[1].peakInFlight <= windows[1];
+    std::printf("adjust        %llu tips, totals updated in %.3f ms; one at a time %.1f ms, x%u %.1f ms "
+                "(peak %zu in flight, %.1fx), %s\n",
+                static_cast<unsigned long long>(tips), static_cast<double>(runs[1].optimisticNanos) / 1e6,
+                sequentialMs, windows[1], pipelinedMs, runs[1].peakInFlight,
+                pipelinedMs > 0 ? sequentialMs / pipelinedMs : 0.0,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
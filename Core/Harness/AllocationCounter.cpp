@@ -0,0 +1,64 @@
+//
+//  AllocationCounter.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "AllocationCounter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local std::uint64_t allocationCount = 0;
+thread_local std::uint64_t allocatedBytes = 0;
+
+void *countedAllocate(std::size_t size) {
+    ++allocationCount;
+    allocatedBytes += size;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+} // namespace
+
+// The standard library's array forms forward to these. Over-aligned allocations use their own
+// operators and are not counted; nothing in the harness asks for them.
+void *operator new(std::size_t size) {
+    void *pointer = countedAllocate(size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+    std::free(pointer);
+}
+
+namespace cft {
+namespace harness {
+
+std::uint64_t threadAllocationCount() {
+    return allocationCount;
+}
+
+std::uint64_t threadAllocatedBytes() {
+    return allocatedBytes;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,30 @@
+/*!
+ * @header AllocationCounter.hpp
+ *
+ * @brief Per-thread heap allocation counts for the benchmark runner.
+ * Linking this replaces the global operator new and delete of the whole executable with
+ * versions that count into thread-local totals before going to malloc and free, so the cost
+ * of the counting is one thread-local increment.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace cft {
+namespace harness {
+
+/*!
+ * @brief operator new calls made on the calling thread so far
+ */
+std::uint64_t threadAllocationCount();
+
+/*!
+ * @brief Bytes requested through operator new on the calling thread so far
+ */
+std::uint64_t threadAllocatedBytes();
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,167 @@
+//
+//  AmountScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "cft/Amount.hpp"
+#include "cft/Clock.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const std::int64_t kMax = std::numeric_limits<std::int64_t>::max();
+const std::int64_t kMin = std::numeric_limits<std::int64_t>::min();
+
+// What summing without the block trick costs: one overflow check per value.
+bool checkedSum(const std::vector<std::int64_t> &values, std::int64_t &total) {
+    total = 0;
+    for (std::int64_t value : values) {
+        if (__builtin_add_overflow(total, value, &total)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameSum(const std::int64_t *values, std::size_t count) {
+    __int128 exact = 0;
+    std::int64_t minimum = count == 0 ? 0 : values[0];
+    std::int64_t maximum = minimum;
+    for (std::size_t i = 0; i < count; ++i) {
+        exact += values[i];
+        minimum = values[i] < minimum ? values[i] : minimum;
+        maximum = values[i] > maximum ? values[i] : maximum;
+    }
+    AmountAggregate aggregate;
+    const ErrorCode code = aggregateMinorUnits(values, count, aggregate);
+    if (exact < kMin || exact > kMax) {
+        return code == ErrorCode::InvalidArgument;
+    }
+    return code == ErrorCode::None && aggregate.total == static_cast<std::int64_t>(exact) &&
+           aggregate.minimum == minimum && aggregate.maximum == maximum && aggregate.count == count;
+}
+
+bool checkRounding() {
+    struct DecimalCase {
+        std::uint64_t mantissa;
+        std::int32_t decimalExponent;
+        bool negative;
+        std::int64_t minorUnits;
+    };
+    // Half to even at the cent: .125 and .135 go to the even cent either side.
+    static const DecimalCase kDecimals[] = {
+        {1234, -2, false, 1234}, {125, -3, false, 12}, {135, -3, false, 14}, {1251, -4, false, 13},
+        {125, -3, true, -12}, {5, 0, false, 500}, {12, 1, false, 12000}, {1, -25, false, 0},
+        {0, 40, false, 0}, {5, -3, false, 0}, {15, -3, false, 2},
+    };
+    bool passed = true;
+    for (const DecimalCase &decimal : kDecimals) {
+        Amount amount;
+        passed &= Amount::fromDecimal(decimal.mantissa, decimal.decimalExponent, decimal.negative,
+                                      Amount::kUsdExponent, amount) == ErrorCode::None &&
+                  amount.minorUnits() == decimal.minorUnits;
+    }
+    Amount unused;
+    passed &= Amount::fromDecimal(1, 20, false, Amount::kUsdExponent, unused) == ErrorCode::InvalidArgument;
+    passed &= Amount::fromDecimal(~0ull, 0, false, Amount::kUsdExponent, unused) == ErrorCode::InvalidArgument;
+    passed &= Amount::fromDecimal(~0ull, 17, true, Amount::kUsdExponent, unused) == ErrorCode::InvalidArgument;
+    passed &= Amount::fromDecimal(std::uint64_t(1) << 63, 0, true, 0, unused) == ErrorCode::None &&
+              unused.minorUnits() == std::numeric_limits<std::int64_t>::min();
+    passed &= Amount::fromDecimal(1, 0, false, Amount::kMaxExponent + 1, unused) == ErrorCode::InvalidArgument;
+
+    // 15%, 18% and 20% tips on amounts that land on half cents.
+    struct TipCase {
+        std::int64_t minorUnits;
+        std::int64_t basisPoints;
+        std::int64_t tip;
+    };
+    static const TipCase kTips[] = {
+        {1250, 1500, 188}, {1150, 1500, 172}, {1000, 1800, 180}, {-1250, 1500, -188}, {4999, 2000, 1000},
+    };
+    for (const TipCase &tip : kTips) {
+        Amount result;
+        passed &= Amount(tip.minorUnits, Amount::kUsdExponent).percentage(tip.basisPoints, result) == ErrorCode::None &&
+                  result.minorUnits() == tip.tip;
+    }
+
+    Amount result;
+    passed &= Amount(250, 2).rescaled(0, result) == ErrorCode::None && result == Amount(2, 0);
+    passed &= Amount(350, 2).rescaled(0, result) == ErrorCode::None && result == Amount(4, 0);
+    passed &= Amount(12, 0).rescaled(3, result) == ErrorCode::None && result == Amount(12000, 3);
+    passed &= Amount(kMax, 2).rescaled(3, result) == ErrorCode::InvalidArgument;
+    passed &= Amount(100, 2).added(Amount(100, 3), result) == ErrorCode::InvalidArgument;
+    passed &= Amount(kMax, 2).added(Amount(1, 2), result) == ErrorCode::InvalidArgument;
+    passed &= Amount(kMin, 2).subtracted(Amount(1, 2), result) == ErrorCode::InvalidArgument;
+    passed &= Amount(kMax / 2 + 1, 2).multiplied(2, result) == ErrorCode::InvalidArgument;
+    passed &= Amount(1999, 2).multiplied(3, result) == ErrorCode::None && result == Amount(5997, 2);
+    return passed;
+}
+
+} // namespace
+
+bool runAmountScenario(std::uint64_t amounts) {
+    // Sales, tips and refunds up to $1,000.
+    std::vector<std::int64_t> values(amounts);
+    for (std::uint64_t i = 0; i < amounts; ++i) {
+        const std::uint64_t roll = mix64(i);
+        const std::int64_t value = static_cast<std::int64_t>(roll % 100000);
+        values[i] = (roll >> 32) % 10 == 0 ? -value : value;
+    }
+
+    // Every length across a block boundary, then overflow and extremes that force the exact path.
+    bool passed = checkRounding();
+    const std::size_t lengths = values.size() < 2100 ? values.size() : 2100;
+    for (std::size_t length = 0; length <= lengths; length += length < 40 ? 1 : 97) {
+        passed &= sameSum(values.data(), length);
+    }
+    const std::int64_t extremes[][4] = {
+        {kMax, 1, 0, 0}, {kMax, -1, 1, 0}, {1, kMax, -1, 0}, {kMin, -1, 0, 0}, {kMin, kMax, 1, 0}, {kMax, kMax, kMin, kMin},
+    };
+    for (const auto &extreme : extremes) {
+        passed &= sameSum(extreme, 4);
+    }
+    std::vector<std::int64_t> large(values);
+    if (!large.empty()) {
+        large[large.size() / 2] = kMax - 1;
+    }
+    passed &= sameSum(large.data(), large.size());
+
+    // Time both over the whole array, several rounds each.
+    const int rounds = 20;
+    std::int64_t sink = 0;
+    Nanos start = monotonicNanos();
+    for (int round = 0; round < rounds; ++round) {
+        std::int64_t total = 0;
+        passed &= checkedSum(values, total);
+        sink += total;
+    }
+    const Nanos checkedNanos = monotonicNanos() - start;
+    start = monotonicNanos();
+    for (int round = 0; round < rounds; ++round) {
+        std::int64_t total = 0;
+        passed &= sumMinorUnits(values.data(), values.size(), total) == ErrorCode::None;
+        sink -= total;
+    }
+    const Nanos blockedNanos = monotonicNanos() - start;
+    passed &= sink == 0;
+
+    const double perAmount = static_cast<double>(rounds) * static_cast<double>(amounts == 0 ? 1 : amounts);
+    std::printf("amounts       %llu amounts, sum %.3f ns per amount checked, %.3f ns per amount blocked, %s\n",
+                static_cast<unsigned long long>(amounts),
+                static_cast<double>(checkedNanos) / perAmount,
+                static_cast<double>(blockedNanos) / perAmount,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
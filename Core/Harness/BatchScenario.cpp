@@ -0,0 +1,69 @@
+//
+//  BatchScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <vector>
+
+#include "cft/BatchScheduler.hpp"
+#include "cft/Clock.hpp"
+#include "Scenarios.hpp"
+#include "WorkerPool.hpp"
+
+namespace cft {
+namespace harness {
+
+bool runBatchScenario(MockGateway &gateway, std::uint64_t items, unsigned concurrency) {
+    static const GatewayOperation kOperations[] = {
+        GatewayOperation::Void, GatewayOperation::Capture, GatewayOperation::Refund,
+    };
+
+    WorkerPool pool(concurrency);
+    BatchScheduler scheduler(items, concurrency);
+    std::vector<char> reported(items, 0);
+
+    const Nanos start = monotonicNanos();
+    scheduler.run(
+        [&](std::size_t index) {
+            pool.post([&, index] {
+                GatewayRequest request;
+                request.operation = kOperations[index % 3];
+                request.amountMinor = 100 + static_cast<std::int64_t>(index % 5000);
+                const GatewayResponse response = gateway.authorize(request);
+                const bool succeeded = response.result == TransactionResult::Approved ||
+                                       response.result == TransactionResult::Voided;
+                scheduler.complete(index, succeeded ? ErrorCode::None : ErrorCode::Declined);
+            });
+        },
+        [&](std::size_t index, ErrorCode) { reported[index] = 1; });
+    scheduler.wait();
+    const Nanos elapsed = monotonicNanos() - start;
+
+    // A second report, or one for an item not yet started, must not free another slot.
+    bool refused = items == 0 || scheduler.complete(0, ErrorCode::None) == ErrorCode::IllegalTransition;
+    BatchScheduler pending(2, 1);
+    pending.run([](std::size_t) {}, nullptr);
+    refused &= pending.complete(1, ErrorCode::None) == ErrorCode::InvalidArgument;
+    refused &= pending.complete(0, ErrorCode::None) == ErrorCode::None;
+    refused &= pending.complete(0, ErrorCode::None) == ErrorCode::IllegalTransition;
+
+    std::uint64_t missing = 0;
+    for (char flag : reported) {
+        missing += flag == 0;
+    }
+    std::printf("batch x%-3u    %llu items, %zu ok, %zu failed, peak %zu in flight, %.3f ms, %.0f items/s\n",
+                concurrency,
+                static_cast<unsigned long long>(items),
+                scheduler.succeededCount(),
+                scheduler.failedCount(),
+                scheduler.peakInFlight(),
+                static_cast<double>(elapsed) / 1e6,
+                elapsed == 0 ? 0.0 : static_cast<double>(items) * 1e9 / static_cast<double>(elapsed));
+    return missing == 0 && scheduler.peakInFlight() <= concurrency && refused;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,318 @@
+//
+//  BenchScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/TransactionTrace.hpp"
+#include "AllocationCounter.hpp"
+#include "HttpGateway.hpp"
+#include "Scenarios.hpp"
+#include "SimulatedReader.hpp"
+#include "TransactionDriver.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+struct BenchCase {
+    const char *name;
+    GatewayOperation operation;
+    TransactionType type;
+    CardInputMethod cardInputMethod;
+    std::uint8_t applications;
+    bool pinEntry;
+};
+
+// Card-present cases authorize through v1; follow-ups on an existing record go through v2.
+const BenchCase kCases[] = {
+    {"sale-swipe", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Swipe, 1, false},
+    {"sale-dip", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Dip, 1, false},
+    {"sale-dip-pin", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Dip, 1, true},
+    {"sale-dip-aid", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Dip, 2, false},
+    {"sale-quick-chip", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::QuickChip, 1, false},
+    {"sale-tap", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Tap, 1, false},
+    {"sale-fallback", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::SwipeFallback, 1, false},
+    {"sale-keyed", GatewayOperation::Authorize, TransactionType::Sale, CardInputMethod::Key, 1, false},
+    {"authorization-dip", GatewayOperation::Authorize, TransactionType::Authorization, CardInputMethod::Dip, 1, false},
+    {"refund-keyed", GatewayOperation::Authorize, TransactionType::Refund, CardInputMethod::Key, 1, false},
+    {"capture", GatewayOperation::Capture, TransactionType::Authorization, CardInputMethod::Unknown, 1, false},
+    {"void", GatewayOperation::Void, TransactionType::Sale, CardInputMethod::Unknown, 1, false},
+    {"refund", GatewayOperation::Refund, TransactionType::Sale, CardInputMethod::Unknown, 1, false},
+};
+
+struct BenchResult {
+    LatencyHistogram latency;
+    std::uint64_t transactions = 0;
+    std::uint64_t failures = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t allocatedBytes = 0;
+    Nanos elapsed = 0;
+
+    double allocationsPerTransaction() const {
+        return transactions == 0 ? 0.0 : static_cast<double>(allocations) / static_cast<double>(transactions);
+    }
+};
+
+struct BaselineEntry {
+    std::string name;
+    double allocationsPerTransaction = 0;
+    Nanos p50 = 0;
+};
+
+TransactionPlan planFor(const BenchCase &bench, std::uint64_t index, Nanos readerStepDelay) {
+    TransactionPlan plan;
+    plan.type = bench.type;
+    plan.cardInputMethod = bench.cardInputMethod;
+    plan.amountMinor = 100 + static_cast<std::int64_t>(mix64(index) % 50000);
+    plan.applications = bench.applications;
+    plan.pinEntry = bench.pinEntry;
+    plan.readerStepDelay = readerStepDelay;
+    return plan;
+}
+
+void runWorker(const BenchCase &bench, CardReaderModel model, std::uint16_t port, std::uint64_t first,
+               std::uint64_t count, Nanos readerStepDelay, BenchResult &result) {
+    SimulatedReader reader(model);
+    HttpGatewayClient client(port);
+    TransactionDriver driver(reader, client, nullptr);
+
+    // One untimed transaction first, so connecting and growing the client's buffers is not measured.
+    for (std::uint64_t i = 0; i <= count; ++i) {
+        const bool measured = i > 0;
+        const std::uint64_t allocationsBefore = threadAllocationCount();
+        const std::uint64_t bytesBefore = threadAllocatedBytes();
+        const Nanos start = monotonicNanos();
+
+        bool succeeded;
+        if (bench.operation == GatewayOperation::Authorize) {
+            const TransactionOutcome outcome = driver.run(planFor(bench, first + i, readerStepDelay));
+            succeeded = outcome.error == ErrorCode::None && outcome.finalState == TransactionState::Completed &&
+                        outcome.result != TransactionResult::Errored;
+        } else {
+            GatewayRequest request;
+            request.operation = bench.operation;
+            request.type = bench.type;
+            request.transactionId = first + i + 1;
+            request.amountMinor = 100 + static_cast<std::int64_t>(mix64(first + i) % 50000);
+            succeeded = client.authorize(request).result != TransactionResult::Errored;
+        }
+
+        if (measured) {
+            result.latency.record(monotonicNanos() - start);
+            result.allocations += threadAllocationCount() - allocationsBefore;
+            result.allocatedBytes += threadAllocatedBytes() - bytesBefore;
+            ++result.transactions;
+            result.failures += !succeeded;
+        }
+    }
+}
+
+/*!
+ * @brief Every model against every input method, with connection, application selection and PIN
+ * @return std::uint64_t - Combinations whose outcome or reader events did not match the model
+ */
+std::uint64_t sweepModels(MockGateway &gateway) {
+    static const CardInputMethod kMethods[] = {
+        CardInputMethod::Key, CardInputMethod::Swipe, CardInputMethod::Dip, CardInputMethod::Tap,
+        CardInputMethod::SwipeFallback, CardInputMethod::QuickChip,
+    };
+
+    std::uint64_t mismatches = 0;
+    for (std::size_t m = 1; m < kCardReaderModelCount; ++m) {
+        const auto model = static_cast<CardReaderModel>(m);
+        SimulatedReader reader(model);
+        TransactionDriver driver(reader, gateway, nullptr);
+        TransactionTrace trace;
+        driver.setTrace(&trace);
+
+        for (CardInputMethod method : kMethods) {
+            TransactionPlan plan;
+            plan.cardInputMethod = method;
+            plan.amountMinor = 1000;
+            plan.connectReader = true;
+            plan.applications = 2;
+            plan.pinEntry = true;
+            const TransactionOutcome outcome = driver.run(plan);
+
+            ReaderScriptOptions options;
+            options.connect = true;
+            options.applications = 2;
+            options.pinEntry = true;
+            std::size_t expectedEvents = 0;
+            for (const ReaderStep &step : SimulatedReader::script(model, method, options)) {
+                expectedEvents += step.action == ReaderAction::Event;
+            }
+            std::size_t readerEvents = 0;
+            for (std::size_t i = 0; i < trace.size(); ++i) {
+                readerEvents += trace.events()[i].kind == TraceEventKind::ReaderEvent;
+            }
+
+            const bool supported = SimulatedReader::supports(model, method);
+            const bool expected = outcome.error == ErrorCode::None &&
+                                  outcome.finalState == TransactionState::Completed &&
+                                  (supported ? outcome.result == TransactionResult::Approved ||
+                                                   outcome.result == TransactionResult::Declined
+                                             : outcome.result == TransactionResult::Canceled) &&
+                                  readerEvents == expectedEvents &&
+                                  (supported && method != CardInputMethod::Key) == (expectedEvents > 0);
+            if (!expected) {
+                ++mismatches;
+                std::fprintf(stderr, "model %zu method %d: %s, result %d, %zu of %zu reader events\n",
+                             m, static_cast<int>(method), transactionStateName(outcome.finalState),
+                             static_cast<int>(outcome.result), readerEvents, expectedEvents);
+            }
+        }
+    }
+    return mismatches;
+}
+
+bool readBaseline(const std::string &path, std::vector<BaselineEntry> &entries) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        char name[64];
+        double allocations = 0;
+        unsigned long long p50 = 0;
+        if (std::sscanf(line.c_str(), "%63s %lf %llu", name, &allocations, &p50) == 3) {
+            entries.push_back({name, allocations, static_cast<Nanos>(p50)});
+        }
+    }
+    return true;
+}
+
+bool writeBaseline(const std::string &path, const std::vector<const BenchCase *> &cases,
+                   const std::vector<BenchResult> &results) {
+    std::ofstream file(path, std::ios::trunc);
+    file << "# cft_replay --bench baseline: case, allocations per transaction, p50 nanoseconds\n";
+    for (std::size_t i = 0; i < cases.size(); ++i) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%s %.2f %llu\n", cases[i]->name, results[i].allocationsPerTransaction(),
+                      static_cast<unsigned long long>(results[i].latency.percentile(50)));
+        file << line;
+    }
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+bool runBenchScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions, unsigned threads,
+                      Nanos readerStepDelay, const std::string &baselinePath, double tolerance) {
+    const std::uint64_t mismatches = sweepModels(gateway);
+
+    HttpGatewayServer server(gateway);
+    if (server.start() != ErrorCode::None) {
+        std::printf("bench         could not listen on loopback, FAILED\n");
+        return false;
+    }
+
+    std::vector<const BenchCase *> cases;
+    std::vector<BenchResult> results;
+    for (const BenchCase &bench : kCases) {
+        if (bench.operation == GatewayOperation::Authorize && !SimulatedReader::supports(model, bench.cardInputMethod)) {
+            continue;
+        }
+        std::vector<BenchResult> perThread(threads);
+        std::vector<std::thread> workers;
+        const Nanos start = monotonicNanos();
+        for (unsigned t = 0; t < threads; ++t) {
+            const std::uint64_t first = transactions * t / threads;
+            const std::uint64_t count = transactions * (t + 1) / threads - first;
+            workers.emplace_back(runWorker, std::cref(bench), model, server.port(), first, count, readerStepDelay,
+                                 std::ref(perThread[t]));
+        }
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+
+        BenchResult total;
+        total.elapsed = monotonicNanos() - start;
+        for (const BenchResult &result : perThread) {
+            total.latency.merge(result.latency);
+            total.transactions += result.transactions;
+            total.failures += result.failures;
+            total.allocations += result.allocations;
+            total.allocatedBytes += result.allocatedBytes;
+        }
+        cases.push_back(&bench);
+        results.push_back(total);
+    }
+    const std::uint64_t requests = server.requestCount();
+    const std::uint64_t connections = server.connectionCount();
+    server.stop();
+
+    std::vector<BaselineEntry> baseline;
+    const bool compare = !baselinePath.empty() && readBaseline(baselinePath, baseline);
+    std::uint64_t failures = 0;
+    std::uint64_t regressions = 0;
+    std::vector<std::string> notes(cases.size());
+    for (std::size_t i = 0; i < cases.size(); ++i) {
+        failures += results[i].failures;
+        for (const BaselineEntry &entry : baseline) {
+            if (entry.name != cases[i]->name) {
+                continue;
+            }
+            // Allocation counts are deterministic; latency gets the tolerance.
+            if (results[i].allocationsPerTransaction() > entry.allocationsPerTransaction + 0.5) {
+                notes[i] += " allocations regressed";
+                ++regressions;
+            }
+            if (static_cast<double>(results[i].latency.percentile(50)) >
+                static_cast<double>(entry.p50) * (1.0 + tolerance)) {
+                notes[i] += " p50 regressed";
+                ++regressions;
+            }
+        }
+    }
+    const bool wroteBaseline = !baselinePath.empty() && !compare && writeBaseline(baselinePath, cases, results);
+
+    const bool passed = mismatches == 0 && failures == 0 && regressions == 0 &&
+                        (baselinePath.empty() || compare || wroteBaseline);
+    std::printf("bench         model %d over loopback http, %llu requests on %llu connections, %llu transactions per case, "
+                "%llu model mismatches, %llu regressions, %s\n",
+                static_cast<int>(model),
+                static_cast<unsigned long long>(requests),
+                static_cast<unsigned long long>(connections),
+                static_cast<unsigned long long>(transactions),
+                static_cast<unsigned long long>(mismatches),
+                static_cast<unsigned long long>(regressions),
+                passed ? "ok" : "FAILED");
+    std::printf("  %-20s %10s %12s %12s %12s %12s\n", "case", "tx/s", "p50(us)", "p99(us)", "allocs/tx", "bytes/tx");
+    for (std::size_t i = 0; i < cases.size(); ++i) {
+        const BenchResult &result = results[i];
+        std::printf("  %-20s %10.0f %12.2f %12.2f %12.2f %12.0f%s\n",
+                    cases[i]->name,
+                    result.elapsed == 0 ? 0.0
+                                        : static_cast<double>(result.transactions) * 1e9 / static_cast<double>(result.elapsed),
+                    static_cast<double>(result.latency.percentile(50)) / 1000.0,
+                    static_cast<double>(result.latency.percentile(99)) / 1000.0,
+                    result.allocationsPerTransaction(),
+                    result.transactions == 0 ? 0.0
+                                             : static_cast<double>(result.allocatedBytes) / static_cast<double>(result.transactions),
+                    notes[i].c_str());
+    }
+    if (wroteBaseline) {
+        std::printf("  baseline written to %s\n", baselinePath.c_str());
+    }
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,356 @@
+//
+//  BinTableScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "cft/BinTable.hpp"
+#include "cft/CardValidation.hpp"
+#include "cft/Clock.hpp"
+#include "cft/File.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const std::uint32_t kPowersOfTen[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+BinRange prefixRange(std::uint32_t first, std::uint32_t last, std::size_t digits, CardBrand brand,
+                     std::uint8_t minPanLength, std::uint8_t maxPanLength) {
+    BinRange range;
+    range.low = first * kPowersOfTen[kBinDigits - digits];
+    range.high = (last + 1) * kPowersOfTen[kBinDigits - digits] - 1;
+    range.brand = brand;
+    range.minPanLength = minPanLength;
+    range.maxPanLength = maxPanLength;
+    return range;
+}
+
+// The ranges CFTCardBrand documents, with the brand only.
+std::vector<BinRange> brandRanges() {
+    return {
+        prefixRange(4, 4, 1, CardBrand::Visa, 13, 19),
+        prefixRange(34, 34, 2, CardBrand::AmericanExpress, 15, 15),
+        prefixRange(37, 37, 2, CardBrand::AmericanExpress, 15, 15),
+        prefixRange(2221, 2720, 4, CardBrand::Mastercard, 16, 16),
+        prefixRange(51, 55, 2, CardBrand::Mastercard, 16, 16),
+        prefixRange(6011, 6011, 4, CardBrand::DiscoverCard, 16, 19),
+        prefixRange(622126, 622925, 6, CardBrand::DiscoverCard, 16, 19),
+        prefixRange(644, 649, 3, CardBrand::DiscoverCard, 16, 19),
+        prefixRange(65, 65, 2, CardBrand::DiscoverCard, 16, 19),
+        prefixRange(300, 305, 3, CardBrand::DinersClub, 14, 19),
+        prefixRange(309, 309, 3, CardBrand::DinersClub, 14, 19),
+        prefixRange(36, 36, 2, CardBrand::DinersClub, 14, 19),
+        prefixRange(38, 39, 2, CardBrand::DinersClub, 14, 19),
+        prefixRange(3528, 3589, 4, CardBrand::JCB, 16, 19),
+    };
+}
+
+// An issuer's BINs inside a brand range: mostly one six-digit BIN, some runs of them, some eight-digit.
+BinRange issuerRange(const std::vector<BinRange> &brands, std::uint64_t seed, bool regulatedDebit) {
+    const std::uint64_t roll = mix64(seed);
+    const BinRange &brand = brands[roll % brands.size()];
+    BinRange range = brand;
+    const std::uint32_t span = brand.high - brand.low + 1;
+    const std::uint32_t key = brand.low + static_cast<std::uint32_t>((roll >> 8) % span);
+    const std::uint64_t shape = (roll >> 40) % 10;
+    if (shape < 3) {
+        range.low = range.high = key;
+    } else {
+        range.low = key / 100 * 100;
+        range.high = range.low + 100 * static_cast<std::uint32_t>(shape < 8 ? 1 : 1 + (roll >> 48) % 20) - 1;
+        if (range.high > brand.high) {
+            range.high = brand.high;
+        }
+    }
+    const bool debit = regulatedDebit || (roll >> 56) % 10 < 4;
+    range.network = debit ? NetworkType::Debit : NetworkType::Credit;
+    range.flags = static_cast<std::uint8_t>((regulatedDebit || (debit && (roll >> 20) % 3 == 0) ? BinFlagRegulated : 0) |
+                                            ((roll >> 24) % 10 == 0 ? BinFlagPrepaid : 0) |
+                                            ((roll >> 28) % 10 == 0 ? BinFlagCommercial : 0));
+    return range;
+}
+
+// Answers the way the table must, by looking at every range: the narrowest holding the key wins,
+// then the later one. A delta's ranges and removals sit on top of the table it applies to.
+class ReferenceTable {
+public:
+    explicit ReferenceTable(std::vector<BinRange> ranges) : _ranges(std::move(ranges)) {}
+
+    ReferenceTable(const ReferenceTable *base, const BinDelta &delta) : _base(base), _delta(delta) {}
+
+    BinInfo classify(std::uint32_t key) const {
+        if (_base != nullptr) {
+            for (auto it = _delta.ranges.rbegin(); it != _delta.ranges.rend(); ++it) {
+                if (it->low <= key && key <= it->high) {
+                    return infoFor(*it);
+                }
+            }
+            for (const auto &removal : _delta.removals) {
+                if (removal.first <= key && key <= removal.second) {
+                    return BinInfo();
+                }
+            }
+            return _base->classify(key);
+        }
+        const BinRange *best = nullptr;
+        for (const BinRange &range : _ranges) {
+            if (range.low <= key && key <= range.high &&
+                (best == nullptr || range.high - range.low <= best->high - best->low)) {
+                best = &range;
+            }
+        }
+        return best == nullptr ? BinInfo() : infoFor(*best);
+    }
+
+private:
+    static BinInfo infoFor(const BinRange &range) {
+        BinInfo info;
+        info.brand = range.brand;
+        info.network = range.network;
+        info.flags = range.flags;
+        info.minPanLength = range.minPanLength;
+        info.maxPanLength = range.maxPanLength;
+        info.matched = true;
+        return info;
+    }
+
+    std::vector<BinRange> _ranges;
+    const ReferenceTable *_base = nullptr;
+    BinDelta _delta;
+};
+
+bool sameInfo(const BinInfo &a, const BinInfo &b) {
+    return a.matched == b.matched && a.brand == b.brand && a.network == b.network && a.flags == b.flags &&
+           a.minPanLength == b.minPanLength && a.maxPanLength == b.maxPanLength;
+}
+
+std::string keyDigits(std::uint32_t key) {
+    char digits[kBinDigits + 1];
+    std::snprintf(digits, sizeof(digits), "%08u", key);
+    return std::string(digits, kBinDigits);
+}
+
+// A PAN of length digits in the range holding key, with its Luhn check digit.
+std::string panFor(std::uint32_t key, std::size_t length, std::uint64_t seed) {
+    std::string pan = keyDigits(key);
+    while (pan.size() + 1 < length) {
+        seed = mix64(seed);
+        pan.push_back(static_cast<char>('0' + seed % 10));
+    }
+    for (char check = '0'; check <= '9'; ++check) {
+        if (luhnValid((pan + check).data(), length)) {
+            return pan + check;
+        }
+    }
+    return pan;
+}
+
+std::uint32_t randomKey(std::uint64_t seed) {
+    // Half the keys where the brands are, so most land in a range.
+    const std::uint64_t roll = mix64(seed);
+    if (roll % 2 == 0) {
+        return static_cast<std::uint32_t>((roll >> 8) % 100000000);
+    }
+    return 30000000 + static_cast<std::uint32_t>((roll >> 8) % 36000000);
+}
+
+bool checkTyping(const BinTable &table) {
+    // The brand is known as soon as the digits typed so far settle it.
+    struct Typed {
+        const char *digits;
+        CardBrand brand;
+    };
+    const Typed typed[] = {
+        {"4", CardBrand::Visa}, {"3", CardBrand::Unknown}, {"34", CardBrand::AmericanExpress},
+        {"2", CardBrand::Unknown}, {"222", CardBrand::Unknown}, {"2221", CardBrand::Mastercard},
+        {"51", CardBrand::Mastercard}, {"601", CardBrand::Unknown}, {"6011", CardBrand::DiscoverCard},
+        {"6221", CardBrand::Unknown}, {"62212", CardBrand::Unknown}, {"622126", CardBrand::DiscoverCard},
+        {"3528", CardBrand::JCB}, {"9", CardBrand::Unknown}, {"", CardBrand::Unknown},
+    };
+    bool passed = true;
+    for (const Typed &entry : typed) {
+        passed &= table.classify(entry.digits, std::string(entry.digits).size()).brand == entry.brand;
+    }
+    passed &= !table.classify("4x", 2).matched && table.classify("4x", 2).brand == CardBrand::Unknown;
+    return passed;
+}
+
+bool checkPans(const BinTable &table, const std::vector<BinRange> &issuers) {
+    bool passed = true;
+    for (std::size_t i = 0; i < issuers.size() && i < 200; ++i) {
+        const std::uint32_t key = issuers[i].low;
+        const BinInfo info = table.classify(keyDigits(key).data(), kBinDigits);
+        if (!info.matched) {
+            passed = false;
+            continue;
+        }
+        const std::string shortest = panFor(key, info.minPanLength, i);
+        const std::string longest = panFor(key, info.maxPanLength, i);
+        passed &= table.checkPan(shortest.data(), shortest.size()) == PanCheck::Valid;
+        passed &= table.checkPan(longest.data(), longest.size()) == PanCheck::Valid;
+        passed &= table.checkPan(shortest.data(), shortest.size() - 1) == PanCheck::Incomplete;
+        const std::string tooLong = longest + "0";
+        passed &= table.checkPan(tooLong.data(), tooLong.size()) == PanCheck::TooLong;
+        std::string wrong = shortest;
+        wrong.back() = static_cast<char>('0' + (wrong.back() - '0' + 1) % 10);
+        passed &= table.checkPan(wrong.data(), wrong.size()) == PanCheck::BadCheckDigit;
+        std::string spaced = shortest;
+        spaced[4] = ' ';
+        passed &= table.checkPan(spaced.data(), spaced.size()) == PanCheck::UnknownBin;
+    }
+    const std::string unknown = panFor(99999999, 16, 1);
+    passed &= table.checkPan(unknown.data(), unknown.size()) == PanCheck::UnknownBin;
+    return passed;
+}
+
+bool matchesReference(const BinTable &table, const ReferenceTable &reference, std::uint64_t keys, std::uint64_t seed) {
+    bool passed = true;
+    for (std::uint64_t i = 0; i < keys; ++i) {
+        const std::uint32_t key = randomKey(seed + i);
+        passed &= sameInfo(table.classify(keyDigits(key).data(), kBinDigits), reference.classify(key));
+    }
+    return passed;
+}
+
+} // namespace
+
+bool runBinTableScenario(const std::string &workDirectory, std::uint64_t ranges) {
+    const std::string path = workDirectory + "/bin-table-scenario.bins";
+    const std::vector<BinRange> brands = brandRanges();
+    std::vector<BinRange> source = brands;
+    std::vector<BinRange> issuers;
+    for (std::uint64_t i = 0; i < ranges; ++i) {
+        issuers.push_back(issuerRange(brands, i, false));
+    }
+    source.insert(source.end(), issuers.begin(), issuers.end());
+    const ReferenceTable reference(source);
+
+    ::unlink(path.c_str());
+    std::unique_ptr<BinTable> table;
+    bool passed = BinTable::open(path, table) == ErrorCode::NotFound;
+    BinRange inverted;
+    inverted.low = 2;
+    inverted.high = 1;
+    passed &= BinTable::write(path, {inverted}, 1) == ErrorCode::InvalidArgument;
+    if (BinTable::write(path, source, 1) != ErrorCode::None || BinTable::open(path, table) != ErrorCode::None) {
+        std::printf("bin-table     could not write %s\n", path.c_str());
+        return false;
+    }
+
+    const std::uint64_t keys = 10 * ranges;
+    const std::uint64_t checkedKeys = keys < 2000 ? keys : 2000;
+    passed &= table->version() == 1 && table->rangeCount() >= brands.size();
+    passed &= matchesReference(*table, reference, checkedKeys, 0);
+    passed &= checkTyping(*table);
+    passed &= checkPans(*table, issuers);
+
+    // Time lookups on the mapping against looking through every range.
+    std::vector<std::string> cards(keys);
+    for (std::uint64_t i = 0; i < keys; ++i) {
+        cards[i] = keyDigits(randomKey(1000000 + i));
+    }
+    std::uint64_t matched = 0;
+    Nanos start = monotonicNanos();
+    for (const std::string &card : cards) {
+        matched += table->classify(card.data(), card.size()).matched;
+    }
+    const Nanos tableNanos = monotonicNanos() - start;
+    std::uint64_t scanned = 0;
+    start = monotonicNanos();
+    for (std::uint64_t i = 0; i < checkedKeys; ++i) {
+        scanned += reference.classify(randomKey(1000000 + i)).matched;
+    }
+    const Nanos scanNanos = monotonicNanos() - start;
+    const double perLookup = static_cast<double>(tableNanos) / static_cast<double>(keys == 0 ? 1 : keys);
+    const double perScan = static_cast<double>(scanNanos) / static_cast<double>(checkedKeys == 0 ? 1 : checkedKeys);
+    passed &= matched > 0 && scanned > 0 && perLookup < perScan;
+
+    // A delta retiring a few issuers and adding regulated debit BINs, while lookups carry on.
+    BinDelta delta;
+    delta.fromVersion = 1;
+    delta.toVersion = 2;
+    for (std::size_t i = 0; i < issuers.size(); i += 100) {
+        delta.removals.emplace_back(issuers[i].low, issuers[i].high);
+    }
+    for (std::uint64_t i = 0; i < ranges / 100 + 1; ++i) {
+        delta.ranges.push_back(issuerRange(brands, ranges + i, true));
+    }
+    const std::vector<std::uint8_t> encoded = encodeBinDelta(delta);
+    BinDelta decoded;
+    passed &= decodeBinDelta(encoded.data(), encoded.size(), decoded) == ErrorCode::None &&
+              decoded.removals == delta.removals && decoded.ranges.size() == delta.ranges.size();
+    std::vector<std::uint8_t> damaged(encoded);
+    damaged[damaged.size() / 2] ^= 0x04;
+    passed &= decodeBinDelta(damaged.data(), damaged.size(), decoded) == ErrorCode::InvalidArgument;
+    passed &= decodeBinDelta(encoded.data(), encoded.size() - 1, decoded) == ErrorCode::InvalidArgument;
+    BinDelta stale = delta;
+    stale.fromVersion = 0;
+    passed &= table->applyDelta(stale) == ErrorCode::InvalidArgument && table->version() == 1;
+
+    const ReferenceTable updated(&reference, delta);
+    std::atomic<bool> applying(true);
+    std::atomic<std::uint64_t> inconsistent(0);
+    std::thread reader([&] {
+        for (std::uint64_t i = 0; applying.load(std::memory_order_acquire) || i < 100; ++i) {
+            const std::uint32_t key = i % 2 == 0 ? delta.ranges[i % delta.ranges.size()].low : randomKey(i);
+            const BinInfo info = table->classify(keyDigits(key).data(), kBinDigits);
+            if (!sameInfo(info, reference.classify(key)) && !sameInfo(info, updated.classify(key))) {
+                ++inconsistent;
+            }
+        }
+    });
+    start = monotonicNanos();
+    passed &= table->applyDelta(decoded) == ErrorCode::None;
+    const Nanos deltaNanos = monotonicNanos() - start;
+    applying.store(false, std::memory_order_release);
+    reader.join();
+    passed &= inconsistent == 0 && table->version() == 2;
+    passed &= matchesReference(*table, updated, checkedKeys, 0);
+    for (const BinRange &added : delta.ranges) {
+        const BinInfo info = table->classify(keyDigits(added.high).data(), kBinDigits);
+        passed &= info.matched && info.isDebit() && (info.flags & BinFlagRegulated) != 0;
+    }
+
+    // What was written is what is opened next launch, and damage is refused.
+    std::unique_ptr<BinTable> reopened;
+    passed &= BinTable::open(path, reopened) == ErrorCode::None && reopened->version() == 2 &&
+              reopened->rangeCount() == table->rangeCount();
+    passed &= reopened != nullptr && matchesReference(*reopened, updated, checkedKeys / 4, 7);
+    std::uint64_t size = 0;
+    File file;
+    std::vector<std::uint8_t> bytes;
+    passed &= File::openForRead(path, file) == ErrorCode::None && file.size(size) == ErrorCode::None &&
+              file.readAll(bytes) == ErrorCode::None;
+    file.close();
+    bytes[bytes.size() - 3] ^= 0x20;
+    passed &= File::replace(path, bytes.data(), bytes.size()) == ErrorCode::None;
+    passed &= BinTable::open(path, reopened) == ErrorCode::InvalidArgument;
+    ::unlink(path.c_str());
+
+    std::printf("bin-table     %llu ranges in %.1f KiB, %.1f ns per lookup, %.1f ns scanning every range, "
+                "delta of %zu ranges in %.2f ms, %s\n",
+                static_cast<unsigned long long>(table->rangeCount()),
+                static_cast<double>(size) / 1024.0,
+                perLookup,
+                perScan,
+                delta.removals.size() + delta.ranges.size(),
+                static_cast<double>(deltaNanos) / 1e6,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,138 @@
+//
+//  CapabilityScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/CapabilityTable.hpp"
+#include "cft/Clock.hpp"
+#include "Scenarios.hpp"
+#include "WorkerPool.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// Stand-in for the SDK's rules. Beyond state, type and input method they depend on things
+// only the gateway knows about a transaction, modelled here by whether its batch has closed.
+CapabilityMask gatewayCapabilities(std::uint64_t index, ApiTransactionState state) {
+    const std::uint64_t roll = mix64(index);
+    const auto type = static_cast<TransactionType>(1 + (roll >> 8) % 3);
+    const auto cardInputMethod = static_cast<CardInputMethod>(1 + (roll >> 16) % (kCardInputMethodCount - 1));
+    const bool batchClosed = (roll >> 24) % 4 == 0;
+
+    CapabilityMask mask = 0;
+    const bool captured = state == ApiTransactionState::Approved || state == ApiTransactionState::Settled;
+    if (!batchClosed && (state == ApiTransactionState::PreApproved || state == ApiTransactionState::Approved)) {
+        mask |= capabilityBit(TransactionCapability::CanBeVoided);
+    }
+    if (captured && type == TransactionType::Sale) {
+        mask |= capabilityBit(TransactionCapability::CanBeRefundedWithoutCardInput);
+        if (cardInputMethod != CardInputMethod::Key) {
+            mask |= capabilityBit(TransactionCapability::CanBeRefundedWithCardInput);
+        }
+    }
+    return mask;
+}
+
+// Rows of a list screen; a transaction can show up more than once, e.g. under two filters.
+std::uint64_t transactionOfRow(std::uint64_t row, std::uint64_t rows) {
+    return mix64(row) % (rows / 2 + 1);
+}
+
+TransactionCapabilityKey capabilityKey(std::uint64_t transaction) {
+    TransactionCapabilityKey key;
+    key.transactionId = "txn-" + std::to_string(transaction);
+    key.state = static_cast<ApiTransactionState>(mix64(transaction) % kApiTransactionStateCount);
+    return key;
+}
+
+} // namespace
+
+bool runCapabilityScenario(MockGateway &gateway, std::uint64_t rows, unsigned concurrency) {
+    TransactionCapabilityTable table;
+    WorkerPool pool(concurrency);
+    std::mutex lock;
+    std::unordered_set<std::uint64_t> inFlight;
+    std::atomic<std::uint64_t> queries{0};
+    std::atomic<std::uint64_t> answered{0};
+
+    // First pass, as a list screen would: unknown rows start one query per transaction and
+    // render without capabilities until it answers.
+    std::uint64_t unknownRows = 0;
+    for (std::uint64_t i = 0; i < rows; ++i) {
+        const std::uint64_t transaction = transactionOfRow(i, rows);
+        const TransactionCapabilityKey key = capabilityKey(transaction);
+        CapabilityMask mask = 0;
+        if (table.lookup(key, mask)) {
+            continue;
+        }
+        ++unknownRows;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!inFlight.insert(transaction).second) {
+                continue;
+            }
+        }
+        ++queries;
+        pool.post([&, key, transaction] {
+            gateway.authorize(GatewayRequest());
+            table.store(key, gatewayCapabilities(transaction, key.state));
+            ++answered;
+        });
+    }
+    while (answered < queries) {
+        ::usleep(100);
+    }
+
+    // Second pass: every row is answered from the table, with its own transaction's answer.
+    std::uint64_t mismatches = 0;
+    std::uint64_t voidable = 0;
+    const Nanos start = monotonicNanos();
+    for (std::uint64_t i = 0; i < rows; ++i) {
+        const std::uint64_t transaction = transactionOfRow(i, rows);
+        const TransactionCapabilityKey key = capabilityKey(transaction);
+        CapabilityMask mask = 0;
+        if (!table.lookup(key, mask) || mask != gatewayCapabilities(transaction, key.state)) {
+            ++mismatches;
+        }
+        voidable += hasCapability(mask, TransactionCapability::CanBeVoided);
+    }
+    const Nanos elapsed = monotonicNanos() - start;
+
+    // Once the transaction moves on, say it is voided, the old answer no longer applies.
+    const std::uint64_t transaction = transactionOfRow(0, rows);
+    TransactionCapabilityKey moved = capabilityKey(transaction);
+    const bool unchanged = !table.store(moved, gatewayCapabilities(transaction, moved.state));
+    moved.state = moved.state == ApiTransactionState::Voided ? ApiTransactionState::Settled : ApiTransactionState::Voided;
+    CapabilityMask stale = 0;
+    const bool requeried = !table.lookup(moved, stale) && table.store(moved, gatewayCapabilities(transaction, moved.state));
+
+    const std::uint64_t generation = table.generation();
+    const std::size_t learned = table.learnedCount();
+    const bool cleared = table.clear() == learned && table.learnedCount() == 0 && table.generation() == generation + 1;
+
+    const bool passed = rows == 0 || (mismatches == 0 && queries == learned && unchanged && requeried && cleared);
+    std::printf("capabilities  %llu rows, %llu queries for %llu unknown rows, %llu voidable, %.1f ns/row, %s\n",
+                static_cast<unsigned long long>(rows),
+                static_cast<unsigned long long>(queries.load()),
+                static_cast<unsigned long long>(unknownRows),
+                static_cast<unsigned long long>(voidable),
+                rows == 0 ? 0.0 : static_cast<double>(elapsed) / static_cast<double>(rows),
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
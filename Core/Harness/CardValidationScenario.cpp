@@ -0,0 +1,327 @@
+//
+//  CardValidationScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "cft/CardValidation.hpp"
+#include "cft/Clock.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+struct ReferenceTrack {
+    std::string pan;
+    std::string name;
+    std::string expiry;
+    std::string serviceCode;
+    std::string discretionary;
+    bool hasLrc = false;
+};
+
+bool allDigits(const std::string &text) {
+    for (char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Luhn the way keyed entry checks it today: a character at a time over a string.
+bool referenceLuhn(const std::string &pan) {
+    if (pan.empty() || !allDigits(pan)) {
+        return false;
+    }
+    int sum = 0;
+    for (std::size_t i = 0; i < pan.size(); ++i) {
+        int digit = pan[pan.size() - 1 - i] - '0';
+        if (i % 2 == 1) {
+            digit *= 2;
+            if (digit > 9) {
+                digit -= 9;
+            }
+        }
+        sum += digit;
+    }
+    return sum % 10 == 0;
+}
+
+// Track parsing the way swipe handling does it today, splitting strings at the separators.
+TrackCheck referenceParse(const std::string &track, ReferenceTrack &fields) {
+    if (track.empty() || (track[0] != '%' && track[0] != ';')) {
+        return TrackCheck::BadSentinel;
+    }
+    const bool track1 = track[0] == '%';
+    const std::size_t end = track.find('?');
+    if (end == std::string::npos || end + 1 > (track1 ? kTrack1MaxLength : kTrack2MaxLength)) {
+        return TrackCheck::BadSentinel;
+    }
+    const std::string body = track.substr(0, end);
+    const std::string after = track.substr(end + 1);
+    const int base = track1 ? 0x20 : 0x30;
+    const int span = track1 ? 0x3F : 0x0F;
+    if (after.size() > 1) {
+        return TrackCheck::BadCharacter;
+    }
+    for (char c : body) {
+        if (static_cast<unsigned char>(c) < base || static_cast<unsigned char>(c) > base + span) {
+            return TrackCheck::BadCharacter;
+        }
+    }
+    fields = ReferenceTrack();
+    if (!after.empty()) {
+        int lrc = 0;
+        for (char c : track.substr(0, end + 1)) {
+            lrc ^= static_cast<unsigned char>(c) - base;
+        }
+        const int stored = static_cast<unsigned char>(after[0]) - base;
+        if (stored < 0 || stored > span || stored != lrc) {
+            return TrackCheck::BadLrc;
+        }
+        fields.hasLrc = true;
+    }
+
+    std::string rest;
+    if (track1) {
+        if (body.size() < 2 || body[1] != 'B') {
+            return TrackCheck::BadFormat;
+        }
+        rest = body.substr(2);
+    } else {
+        rest = body.substr(1);
+    }
+    const std::size_t separator = rest.find(track1 ? '^' : '=');
+    if (separator == std::string::npos) {
+        return TrackCheck::BadFormat;
+    }
+    fields.pan = rest.substr(0, separator);
+    rest = rest.substr(separator + 1);
+    if (fields.pan.size() < 12 || fields.pan.size() > 19 || !allDigits(fields.pan)) {
+        return TrackCheck::BadFormat;
+    }
+    if (track1) {
+        const std::size_t nameEnd = rest.find('^');
+        if (nameEnd == std::string::npos || nameEnd < 2 || nameEnd > 26) {
+            return TrackCheck::BadFormat;
+        }
+        fields.name = rest.substr(0, nameEnd);
+        rest = rest.substr(nameEnd + 1);
+    }
+    if (rest.size() < 7 || !allDigits(rest.substr(0, 7))) {
+        return TrackCheck::BadFormat;
+    }
+    fields.expiry = rest.substr(0, 4);
+    fields.serviceCode = rest.substr(4, 3);
+    fields.discretionary = rest.substr(7);
+    return referenceLuhn(fields.pan) ? TrackCheck::Valid : TrackCheck::BadCheckDigit;
+}
+
+std::string fieldText(const std::string &track, TrackField field) {
+    return track.substr(field.offset, field.length);
+}
+
+bool sameFields(const std::string &track, const TrackData &data, const ReferenceTrack &fields) {
+    return fieldText(track, data.pan) == fields.pan && fieldText(track, data.name) == fields.name &&
+           fieldText(track, data.expiry) == fields.expiry && fieldText(track, data.serviceCode) == fields.serviceCode &&
+           fieldText(track, data.discretionary) == fields.discretionary && data.hasLrc == fields.hasLrc;
+}
+
+std::string randomPan(std::uint64_t &seed) {
+    seed = mix64(seed);
+    const std::size_t length = 13 + seed % 7;
+    std::string pan(1, static_cast<char>('2' + (seed >> 8) % 5));
+    while (pan.size() + 1 < length) {
+        seed = mix64(seed);
+        pan.push_back(static_cast<char>('0' + seed % 10));
+    }
+    for (char check = '0'; check <= '9'; ++check) {
+        if (referenceLuhn(pan + check)) {
+            return pan + check;
+        }
+    }
+    return pan;
+}
+
+char lrcOf(const std::string &track, int base) {
+    int lrc = 0;
+    for (char c : track) {
+        lrc ^= static_cast<unsigned char>(c) - base;
+    }
+    return static_cast<char>(lrc + base);
+}
+
+// A swipe as a reader hands it over, mostly well formed, some damaged the ways swipes are.
+std::string randomTrack(std::uint64_t index) {
+    std::uint64_t seed = mix64(index * 7919 + 3);
+    const bool track1 = seed % 2 == 0;
+    const std::string pan = randomPan(seed);
+    seed = mix64(seed);
+    char expiry[8];
+    std::snprintf(expiry, sizeof(expiry), "%02u%02u", static_cast<unsigned>(20 + seed % 15),
+                  static_cast<unsigned>(1 + (seed >> 8) % 12));
+    std::string discretionary;
+    for (std::size_t i = 0, length = (seed >> 16) % 14; i < length; ++i) {
+        discretionary.push_back(static_cast<char>('0' + mix64(seed + i) % 10));
+    }
+    std::string track = track1 ? "%B" + pan + "^CARDHOLDER/TEST " + std::to_string(index % 1000) + "^" + expiry + "101" +
+                                     discretionary + "?"
+                               : ";" + pan + "=" + expiry + "201" + discretionary + "?";
+    const int base = track1 ? 0x20 : 0x30;
+    if ((seed >> 24) % 2 == 0) {
+        track.push_back(lrcOf(track, base));
+    }
+
+    seed = mix64(seed);
+    const std::size_t at = 1 + seed % (track.size() - 1);
+    switch ((seed >> 32) % 16) {
+    case 0:
+        // One digit misread.
+        track[track1 ? 3 : 2] = static_cast<char>('0' + (track[track1 ? 3 : 2] - '0' + 1) % 10);
+        break;
+    case 1:
+        track.back() = static_cast<char>(track.back() == '?' ? 'x' : track.back() ^ 0x01);
+        break;
+    case 2:
+        track.erase(track.find('?'));
+        break;
+    case 3:
+        track[at] = 'a';
+        break;
+    case 4:
+        track[at] = track1 ? '=' : '^';
+        break;
+    case 5:
+        track.insert(1, std::string(50, '0'));
+        break;
+    default:
+        break;
+    }
+    return track;
+}
+
+bool checkKeyed() {
+    bool passed = true;
+    passed &= keyedExpiryValid("1226", 4, 2026, 12) && keyedExpiryValid("12/26", 5, 2026, 12);
+    passed &= !keyedExpiryValid("1126", 4, 2026, 12) && keyedExpiryValid("0127", 4, 2026, 12);
+    passed &= !keyedExpiryValid("1326", 4, 2026, 1) && !keyedExpiryValid("0026", 4, 2026, 1);
+    passed &= !keyedExpiryValid("12-26", 5, 2026, 1) && !keyedExpiryValid("1x26", 4, 2026, 1);
+    passed &= !keyedExpiryValid("122", 3, 2026, 1);
+    passed &= cvvValid("1234", 4, CardBrand::AmericanExpress) && !cvvValid("123", 3, CardBrand::AmericanExpress);
+    passed &= cvvValid("123", 3, CardBrand::Visa) && !cvvValid("1234", 4, CardBrand::Visa);
+    passed &= cvvValid("123", 3, CardBrand::Unknown) && cvvValid("1234", 4, CardBrand::Unknown);
+    passed &= !cvvValid("12a", 3, CardBrand::Mastercard);
+    for (const char *pan : {"4111111111111111", "378282246310005", "6011111111111117", "5555555555554444",
+                            "30569309025904", "3530111333300000", "4222222222222", "6011000990139424009"}) {
+        const std::string text(pan);
+        passed &= luhnValid(text.data(), text.size()) && luhnValid(text.data(), text.size(), ValidationPath::Scalar);
+        std::string wrong = text;
+        wrong[wrong.size() / 2] = static_cast<char>('0' + (wrong[wrong.size() / 2] - '0' + 5) % 10);
+        passed &= !luhnValid(wrong.data(), wrong.size()) && !luhnValid(wrong.data(), wrong.size(), ValidationPath::Scalar);
+    }
+    passed &= !luhnValid("", 0) && !luhnValid("4111 1111 1111 1111", 19);
+    // Runs of zeros pass Luhn at any length; only 12 to 19 digits make a PAN.
+    passed &= panValid("4222222222222", 13) && panValid("6011000990139424009", 19);
+    passed &= luhnValid("00000000000", 11) && !panValid("00000000000", 11) && panValid("000000000000", 12);
+    passed &= panValid("0000000000000000000", 19) && !panValid("00000000000000000000", 20);
+    return passed;
+}
+
+} // namespace
+
+bool runCardValidationScenario(std::uint64_t swipes) {
+    std::vector<std::string> tracks(swipes);
+    std::vector<std::string> pans(swipes);
+    for (std::uint64_t i = 0; i < swipes; ++i) {
+        tracks[i] = randomTrack(i);
+        std::uint64_t seed = i;
+        pans[i] = randomPan(seed);
+        if (i % 4 == 0) {
+            pans[i][i % pans[i].size()] ^= 0x01;
+        }
+    }
+
+    // Every path gives the same answer and fields as the string-based parsing, damaged swipes included.
+    bool passed = checkKeyed();
+    std::uint64_t valid = 0;
+    for (const std::string &track : tracks) {
+        ReferenceTrack fields;
+        const TrackCheck expected = referenceParse(track, fields);
+        TrackData vector;
+        TrackData scalar;
+        passed &= parseTrack(track.data(), track.size(), vector) == expected;
+        passed &= parseTrack(track.data(), track.size(), scalar, ValidationPath::Scalar) == expected;
+        if (expected == TrackCheck::Valid) {
+            passed &= sameFields(track, vector, fields) && sameFields(track, scalar, fields);
+            ++valid;
+        }
+    }
+    for (const std::string &pan : pans) {
+        const bool expected = referenceLuhn(pan);
+        passed &= luhnValid(pan.data(), pan.size()) == expected &&
+                  luhnValid(pan.data(), pan.size(), ValidationPath::Scalar) == expected;
+    }
+    passed &= valid > swipes / 2 && valid < swipes;
+
+    // Swipes as a replay of historical data sees them, one after another.
+    std::uint64_t results = 0;
+    Nanos start = monotonicNanos();
+    for (const std::string &track : tracks) {
+        TrackData data;
+        results += static_cast<std::uint64_t>(parseTrack(track.data(), track.size(), data)) + data.pan.length;
+    }
+    const Nanos vectorNanos = monotonicNanos() - start;
+    start = monotonicNanos();
+    for (const std::string &track : tracks) {
+        TrackData data;
+        results += static_cast<std::uint64_t>(parseTrack(track.data(), track.size(), data, ValidationPath::Scalar)) +
+                   data.pan.length;
+    }
+    const Nanos scalarNanos = monotonicNanos() - start;
+    start = monotonicNanos();
+    for (const std::string &track : tracks) {
+        ReferenceTrack fields;
+        results += static_cast<std::uint64_t>(referenceParse(track, fields)) + fields.pan.size();
+    }
+    const Nanos stringNanos = monotonicNanos() - start;
+
+    start = monotonicNanos();
+    for (const std::string &pan : pans) {
+        results += luhnValid(pan.data(), pan.size());
+    }
+    const Nanos luhnVectorNanos = monotonicNanos() - start;
+    start = monotonicNanos();
+    for (const std::string &pan : pans) {
+        results += luhnValid(pan.data(), pan.size(), ValidationPath::Scalar);
+    }
+    const Nanos luhnScalarNanos = monotonicNanos() - start;
+
+    const double count = static_cast<double>(swipes == 0 ? 1 : swipes);
+    passed &= results > 0 && vectorNanos < stringNanos && scalarNanos < stringNanos;
+
+    std::printf("card-data     %llu swipes (%llu valid), %s %.1f ns, scalar %.1f ns, strings %.1f ns per swipe; "
+                "luhn %.1f ns against %.1f ns, %s\n",
+                static_cast<unsigned long long>(swipes),
+                static_cast<unsigned long long>(valid),
+                vectorValidationKernel(),
+                static_cast<double>(vectorNanos) / count,
+                static_cast<double>(scalarNanos) / count,
+                static_cast<double>(stringNanos) / count,
+                static_cast<double>(luhnVectorNanos) / count,
+                static_cast<double>(luhnScalarNanos) / count,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
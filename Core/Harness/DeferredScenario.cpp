@@ -0,0 +1,317 @@
+//
+//  DeferredScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/BatchScheduler.hpp"
+#include "cft/Bytes.hpp"
+#include "cft/Clock.hpp"
+#include "cft/DeferredQueue.hpp"
+#include "cft/DeferredRecord.hpp"
+#include "cft/File.hpp"
+#include "Scenarios.hpp"
+#include "WorkerPool.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// Stand-in for the SDK's deferred payload: a keyed archive of the transaction, mostly
+// repeated class and key names around a block of encrypted card data.
+std::vector<std::uint8_t> sdkPayload(std::uint64_t roll) {
+    static const char kArchiveKeys[] = "$archiver NSKeyedArchiver $objects $class $classname CFTTransaction "
+                                       "CFTAmount NSDecimalNumber CFTCardInfo CFTMerchantAccount NSDictionary "
+                                       "NS.keys NS.objects $top root $version ";
+    std::vector<std::uint8_t> payload;
+    const std::size_t repeats = 2 + roll % 6;
+    for (std::size_t i = 0; i < repeats; ++i) {
+        appendBytes(payload, kArchiveKeys, sizeof(kArchiveKeys) - 1);
+    }
+    for (std::size_t i = 0; i < 96 + roll % 160; ++i) {
+        payload.push_back(static_cast<std::uint8_t>(mix64(roll + i)));
+    }
+    return payload;
+}
+
+std::vector<std::uint8_t> emvTlv(std::uint64_t roll) {
+    static const std::uint8_t kTags[][2] = {{0x9F, 0x26}, {0x9F, 0x36}, {0x9F, 0x0D}, {0x9F, 0x0E}, {0x9F, 0x0F}, {0x9F, 0x34}};
+    std::vector<std::uint8_t> tlv = {0x4F, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10};
+    for (const auto &tag : kTags) {
+        tlv.insert(tlv.end(), {tag[0], tag[1], 0x08});
+        for (unsigned i = 0; i < 8; ++i) {
+            tlv.push_back(static_cast<std::uint8_t>(mix64(roll ^ tag[1]) >> (i * 8)));
+        }
+    }
+    return tlv;
+}
+
+std::vector<std::uint8_t> deferredRecord(std::uint64_t index, std::size_t &rawSize) {
+    const std::uint64_t roll = mix64(index);
+    const std::vector<std::uint8_t> payload = sdkPayload(roll);
+    const std::vector<std::uint8_t> tlv = emvTlv(roll);
+    rawSize = payload.size() + tlv.size();
+
+    DeferredRecordWriter writer;
+    writer.addBytes(DeferredField::SdkPayload, payload.data(), payload.size(), true);
+    writer.addInteger(DeferredField::AmountMinor, static_cast<std::int64_t>(100 + roll % 50000));
+    writer.addInteger(DeferredField::CreatedAtMillis, static_cast<std::int64_t>(index));
+    writer.addByte(DeferredField::CardInputMethod, static_cast<std::uint8_t>(CardInputMethod::Dip));
+    writer.addByte(DeferredField::CardBrand, static_cast<std::uint8_t>(CardBrand::Visa));
+    writer.addBytes(DeferredField::LastFour, reinterpret_cast<const std::uint8_t *>("4242"), 4);
+    writer.addBytes(DeferredField::EmvTlv, tlv.data(), tlv.size(), true);
+
+    std::vector<std::uint8_t> record;
+    writer.finish(record);
+    return record;
+}
+
+// Round trip every field, then make sure truncation and bit flips are caught.
+bool checkRecordFormat() {
+    std::size_t rawSize = 0;
+    std::vector<std::uint8_t> record = deferredRecord(7, rawSize);
+    const std::uint64_t roll = mix64(7);
+
+    DeferredRecordView view;
+    std::vector<std::uint8_t> payload;
+    std::vector<std::uint8_t> tlv;
+    std::int64_t amount = 0;
+    ByteRange lastFour;
+    if (DeferredRecordView::open(record.data(), record.size(), view) != ErrorCode::None || !view.verifyChecksum() ||
+        view.copyBytes(DeferredField::SdkPayload, payload) != ErrorCode::None || payload != sdkPayload(roll) ||
+        view.copyBytes(DeferredField::EmvTlv, tlv) != ErrorCode::None || tlv != emvTlv(roll) ||
+        !view.integer(DeferredField::AmountMinor, amount) || amount != static_cast<std::int64_t>(100 + roll % 50000) ||
+        !view.bytes(DeferredField::LastFour, lastFour) || std::string(reinterpret_cast<const char *>(lastFour.data), lastFour.size) != "4242") {
+        return false;
+    }
+
+    if (DeferredRecordView::open(record.data(), record.size() - 1, view) == ErrorCode::None) {
+        return false;
+    }
+    record[record.size() / 2] ^= 0x01;
+    return DeferredRecordView::open(record.data(), record.size(), view) == ErrorCode::None && !view.verifyChecksum();
+}
+
+DeferredEntryStatus entryStatus(const DeferredQueue &queue, std::uint64_t entryId) {
+    for (const DeferredEntryInfo &info : queue.entries()) {
+        if (info.entryId == entryId) {
+            return info.status;
+        }
+    }
+    return DeferredEntryStatus::DeadLettered;
+}
+
+// A claim outlives the process: the entry comes back interrupted, through compaction too, and
+// is not handed out again until released.
+bool checkInterruptedClaim(const std::string &path, const DeferredQueueConfig &config) {
+    ::unlink(path.c_str());
+    std::unique_ptr<DeferredQueue> queue;
+    std::uint64_t first = 0;
+    std::uint64_t second = 0;
+    const std::uint8_t data[] = {1, 2, 3};
+    if (DeferredQueue::open(path, config, queue) != ErrorCode::None ||
+        queue->enqueue(data, sizeof(data), 0, first) != ErrorCode::None ||
+        queue->enqueue(data, sizeof(data), 0, second) != ErrorCode::None ||
+        queue->claimReady(0, 1) != std::vector<std::uint64_t>{first}) {
+        return false;
+    }
+    queue.reset();
+    bool passed = DeferredQueue::open(path, config, queue) == ErrorCode::None &&
+                  entryStatus(*queue, first) == DeferredEntryStatus::Interrupted &&
+                  queue->compact() == ErrorCode::None;
+    queue.reset();
+    passed = passed && DeferredQueue::open(path, config, queue) == ErrorCode::None &&
+             entryStatus(*queue, first) == DeferredEntryStatus::Interrupted &&
+             queue->claimReady(0, 2) == std::vector<std::uint64_t>{second} &&
+             queue->release(first) == ErrorCode::None && queue->release(second) == ErrorCode::None;
+    queue.reset();
+    passed = passed && DeferredQueue::open(path, config, queue) == ErrorCode::None &&
+             queue->claimReady(0, 2) == std::vector<std::uint64_t>{first, second};
+    queue.reset();
+    ::unlink(path.c_str());
+    return passed;
+}
+
+// Retrying now makes the entries waiting out a backoff ready once; failing again backs off as usual.
+bool checkExpedite(const std::string &path, DeferredQueueConfig config) {
+    ::unlink(path.c_str());
+    config.baseRetryDelayMillis = 1000;
+    config.maxRetryDelayMillis = 8000;
+    std::unique_ptr<DeferredQueue> queue;
+    std::uint64_t entryId = 0;
+    const std::uint8_t data[] = {1, 2, 3};
+    bool willRetry = false;
+    bool passed = DeferredQueue::open(path, config, queue) == ErrorCode::None &&
+                  queue->enqueue(data, sizeof(data), 0, entryId) == ErrorCode::None &&
+                  queue->claimReady(0, 1).size() == 1 && queue->fail(entryId, true, 0, willRetry) == ErrorCode::None &&
+                  queue->claimReady(10, 1).empty();
+    passed = passed && queue->expedite(10) == 1 && queue->nextAttemptAtMillis() == 10 &&
+             queue->claimReady(10, 1) == std::vector<std::uint64_t>{entryId} &&
+             queue->fail(entryId, true, 10, willRetry) == ErrorCode::None && queue->claimReady(20, 1).empty() &&
+             queue->nextAttemptAtMillis() > 20 && queue->entries()[0].attempts == 2;
+    queue.reset();
+    ::unlink(path.c_str());
+    return passed;
+}
+
+// A file that is not a journal of this version is refused and left byte for byte as it was.
+bool checkForeignHeader(const std::string &path, const DeferredQueueConfig &config) {
+    static const std::uint8_t kForeign[] = {'C', 'F', 'T', 'D', 'Q', 0x09, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00};
+    std::vector<std::uint8_t> contents;
+    std::unique_ptr<DeferredQueue> queue;
+    bool passed = true;
+    for (std::size_t size : {std::size_t{3}, sizeof(kForeign)}) {
+        File file;
+        passed = passed && File::replace(path, kForeign, size) == ErrorCode::None &&
+                 DeferredQueue::open(path, config, queue) == ErrorCode::InvalidArgument && !queue &&
+                 File::openForRead(path, file) == ErrorCode::None && file.readAll(contents) == ErrorCode::None &&
+                 contents == std::vector<std::uint8_t>(kForeign, kForeign + size);
+    }
+    ::unlink(path.c_str());
+    return passed;
+}
+
+} // namespace
+
+bool runDeferredScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t items,
+                         unsigned concurrency) {
+    const std::string path = workDirectory + "/deferred-scenario.journal";
+    ::unlink(path.c_str());
+
+    DeferredQueueConfig config;
+    config.maxEntries = static_cast<std::size_t>(items);
+    config.baseRetryDelayMillis = 0;
+
+    std::unique_ptr<DeferredQueue> queue;
+    if (DeferredQueue::open(path, config, queue) != ErrorCode::None) {
+        std::printf("deferred      could not open %s\n", path.c_str());
+        return false;
+    }
+
+    if (!checkRecordFormat()) {
+        std::printf("deferred      record format round trip failed\n");
+        return false;
+    }
+    const std::string scratchPath = workDirectory + "/deferred-scenario-scratch.journal";
+    if (!checkInterruptedClaim(scratchPath, config)) {
+        std::printf("deferred      claim did not survive a restart\n");
+        return false;
+    }
+    if (!checkExpedite(scratchPath, config)) {
+        std::printf("deferred      retrying now did not back off again\n");
+        return false;
+    }
+    if (!checkForeignHeader(scratchPath, config)) {
+        std::printf("deferred      unreadable journal was not left alone\n");
+        return false;
+    }
+
+    std::size_t rawBytes = 0;
+    Nanos enqueueElapsed = 0;
+    for (std::uint64_t index = 0; index < items; ++index) {
+        std::size_t rawSize = 0;
+        const std::vector<std::uint8_t> record = deferredRecord(index, rawSize);
+        rawBytes += rawSize;
+        std::uint64_t entryId = 0;
+        const Nanos enqueueStart = monotonicNanos();
+        const ErrorCode enqueued = queue->enqueue(record.data(), record.size(), 0, entryId);
+        enqueueElapsed += monotonicNanos() - enqueueStart;
+        if (enqueued != ErrorCode::None) {
+            std::printf("deferred      enqueue %llu failed\n", static_cast<unsigned long long>(index));
+            return false;
+        }
+    }
+    const std::size_t storedBytes = queue->bytes();
+
+    // Backpressure: a full queue refuses further deferrals rather than growing without bound.
+    std::uint64_t overflowId = 0;
+    const bool refusedOverflow = queue->enqueue(nullptr, 0, 0, overflowId) == ErrorCode::CapacityExceeded;
+
+    // Crash mid-append: a torn record header at the tail must be discarded on reopen.
+    queue.reset();
+    {
+        File journal;
+        const std::uint8_t torn[5] = {0xFF, 0x00, 0x00, 0x00, 0x42};
+        if (File::openForAppend(path, journal) != ErrorCode::None || journal.append(torn, sizeof(torn)) != ErrorCode::None) {
+            return false;
+        }
+    }
+    if (DeferredQueue::open(path, config, queue) != ErrorCode::None || queue->count() != items) {
+        std::printf("deferred      recovered %zu of %llu entries\n", queue ? queue->count() : 0,
+                    static_cast<unsigned long long>(items));
+        return false;
+    }
+
+    WorkerPool pool(concurrency);
+    std::atomic<std::uint64_t> forwarded{0};
+    std::atomic<std::uint64_t> retries{0};
+    unsigned rounds = 0;
+    const Nanos drainStart = monotonicNanos();
+    for (std::vector<std::uint64_t> ready = queue->claimReady(0, items); !ready.empty();
+         ready = queue->claimReady(0, items), ++rounds) {
+        BatchScheduler scheduler(ready.size(), concurrency);
+        scheduler.run(
+            [&](std::size_t index) {
+                pool.post([&, index] {
+                    std::vector<std::uint8_t> payload;
+                    queue->payload(ready[index], payload);
+                    DeferredRecordView record;
+                    std::uint8_t inputMethod = 0;
+                    GatewayRequest request;
+                    if (DeferredRecordView::open(payload.data(), payload.size(), record) != ErrorCode::None ||
+                        !record.integer(DeferredField::AmountMinor, request.amountMinor) ||
+                        !record.byte(DeferredField::CardInputMethod, inputMethod)) {
+                        scheduler.complete(index, ErrorCode::InvalidArgument);
+                        return;
+                    }
+                    request.cardInputMethod = static_cast<CardInputMethod>(inputMethod);
+                    const GatewayResponse response = gateway.authorize(request);
+                    scheduler.complete(index, response.result == TransactionResult::Approved ? ErrorCode::None
+                                                                                             : ErrorCode::Declined);
+                });
+            },
+            [&](std::size_t index, ErrorCode error) {
+                if (error == ErrorCode::None) {
+                    queue->complete(ready[index]);
+                    ++forwarded;
+                } else {
+                    bool willRetry = false;
+                    queue->fail(ready[index], true, 0, willRetry);
+                    retries += willRetry;
+                }
+            });
+        scheduler.wait();
+    }
+    const Nanos drainElapsed = monotonicNanos() - drainStart;
+
+    const std::size_t deadLettered = queue->count();
+    queue.reset();
+    const bool reopened = DeferredQueue::open(path, config, queue) == ErrorCode::None && queue->count() == deadLettered;
+    ::unlink(path.c_str());
+
+    std::printf("deferred      %llu items, %llu forwarded, %llu retries, %zu dead-lettered in %u rounds; "
+                "enqueue %.1f us/item, drain %.0f items/s, %zu bytes stored for %zu raw\n",
+                static_cast<unsigned long long>(items),
+                static_cast<unsigned long long>(forwarded.load()),
+                static_cast<unsigned long long>(retries.load()),
+                deadLettered,
+                rounds,
+                static_cast<double>(enqueueElapsed) / 1e3 / static_cast<double>(items),
+                drainElapsed == 0 ? 0.0 : static_cast<double>(forwarded.load()) * 1e9 / static_cast<double>(drainElapsed),
+                storedBytes,
+                rawBytes);
+    return refusedOverflow && reopened && forwarded + deadLettered == items;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,198 @@
+//
+//  EventLogScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/EventLog.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// Producer index in the high half of transactionId, sequence in the low half.
+LogRecord syntheticRecord(std::uint64_t producer, std::uint64_t sequence) {
+    const std::uint64_t roll = mix64(sequence);
+    LogRecord record;
+    record.level = LogLevel::Info;
+    record.subsystem = static_cast<LogSubsystem>(roll % kLogSubsystemCount);
+    record.transactionId = (producer << 32) | sequence;
+    record.state = static_cast<TransactionState>((roll >> 8) % kTransactionStateCount);
+    record.readerEvent = static_cast<CardReaderEvent>((roll >> 16) % kCardReaderEventCount);
+    record.detail = static_cast<std::int32_t>(sequence);
+    return record;
+}
+
+// Starts every thread's work at once, so that all of them hold a ring at the same time.
+class StartLine {
+public:
+    explicit StartLine(unsigned threads) : _waiting(threads) {}
+
+    void arriveAndWait() {
+        _waiting.fetch_sub(1);
+        while (_waiting.load() > 0) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<unsigned> _waiting;
+};
+
+} // namespace
+
+bool runEventLogScenario(std::uint64_t records, unsigned threads) {
+    bool passed = true;
+
+    // Producers log in bursts, as transactions do, while a drainer runs beside them; every
+    // record is delivered in order or counted as dropped.
+    EventLog log;
+    std::atomic<bool> producing{true};
+    std::vector<std::uint64_t> nextSequence(threads, 0);
+    std::uint64_t delivered = 0;
+    std::uint64_t outOfOrder = 0;
+    auto checkOrder = [&](const LogRecord *batch, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint64_t producer = batch[i].transactionId >> 32;
+            const std::uint64_t sequence = batch[i].transactionId & 0xFFFFFFFF;
+            outOfOrder += producer >= threads || sequence < nextSequence[producer];
+            if (producer < threads) {
+                nextSequence[producer] = sequence + 1;
+            }
+        }
+        delivered += count;
+    };
+    std::thread drainer([&] {
+        while (producing.load()) {
+            log.drain(checkOrder);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    std::atomic<Nanos> writeNanos{0};
+    std::vector<std::thread> producers;
+    for (unsigned t = 0; t < threads; ++t) {
+        producers.emplace_back([&, t] {
+            Nanos spent = 0;
+            for (std::uint64_t i = 0; i < records;) {
+                const Nanos start = monotonicNanos();
+                for (const std::uint64_t end = std::min(records, i + 128); i < end; ++i) {
+                    log.write(syntheticRecord(t, i));
+                }
+                spent += monotonicNanos() - start;
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            writeNanos += spent;
+        });
+    }
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+    producing = false;
+    drainer.join();
+    log.drain(checkOrder);
+
+    const EventLogStats stats = log.stats();
+    const std::uint64_t attempted = records * threads;
+    passed &= outOfOrder == 0 && delivered == stats.written && delivered + stats.dropped == attempted;
+
+    // The synchronous path the SDK's loggerOutput: takes today: format and hand off under a lock.
+    std::mutex sinkLock;
+    std::uint64_t sinkBytes = 0;
+    const Nanos syncStart = monotonicNanos();
+    for (std::uint64_t i = 0; i < records; ++i) {
+        char line[160];
+        const LogRecord record = syntheticRecord(0, i);
+        formatLogRecord(record, 0, line, sizeof(line));
+        std::lock_guard<std::mutex> guard(sinkLock);
+        sinkBytes += std::string(line).size();
+    }
+    const Nanos syncNanos = monotonicNanos() - syncStart;
+    passed &= sinkBytes > 0;
+
+    // Levels and sampling are decided on the calling thread.
+    EventLogConfig sampledConfig;
+    sampledConfig.recordsPerThread = 2048;
+    EventLog sampled(sampledConfig);
+    sampled.setSampleRate(LogLevel::Info, 10);
+    std::uint64_t kept = 0;
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        kept += sampled.write(LogLevel::Debug, LogSubsystem::Reader, CardReaderEvent::BatteryStatusUpdated);
+        kept += sampled.write(LogLevel::Info, LogSubsystem::Transaction, i + 1, TransactionState::Processing);
+        kept += sampled.write(LogLevel::Error, LogSubsystem::Gateway, i + 1, TransactionState::Processing,
+                              ErrorCode::Declined);
+    }
+    const EventLogStats sampledStats = sampled.stats();
+    passed &= kept == 1100 && sampledStats.sampledOut == 900 && sampledStats.written == 1100;
+
+    // Memory cap: room for two rings, four threads logging at once.
+    EventLogConfig cappedConfig;
+    cappedConfig.recordsPerThread = 64;
+    cappedConfig.memoryLimitBytes = 2 * 64 * sizeof(LogRecord);
+    EventLog capped(cappedConfig);
+    StartLine startLine(4);
+    std::vector<std::thread> crowd;
+    for (unsigned t = 0; t < 4; ++t) {
+        crowd.emplace_back([&, t] {
+            capped.write(syntheticRecord(t, 0));
+            startLine.arriveAndWait();
+            for (std::uint64_t i = 1; i < 100; ++i) {
+                capped.write(syntheticRecord(t, i));
+            }
+        });
+    }
+    for (std::thread &thread : crowd) {
+        thread.join();
+    }
+    const EventLogStats cappedStats = capped.stats();
+    passed &= cappedStats.memoryBytes <= cappedConfig.memoryLimitBytes &&
+              cappedStats.written + cappedStats.dropped == 400 && cappedStats.dropped >= 200;
+
+    // A thread that starts after others exited reuses their ring.
+    capped.drain([](const LogRecord *, std::size_t) {});
+    std::thread([&] { capped.write(syntheticRecord(9, 0)); }).join();
+    passed &= capped.stats().memoryBytes == cappedStats.memoryBytes && capped.stats().written == cappedStats.written + 1;
+
+    char line[160];
+    LogRecord declined;
+    declined.level = LogLevel::Error;
+    declined.subsystem = LogSubsystem::Gateway;
+    declined.timestamp = 1500000000;
+    declined.state = TransactionState::Processing;
+    declined.error = ErrorCode::Declined;
+    formatLogRecord(declined, 0, line, sizeof(line));
+    passed &= std::strcmp(line, "1.500000 error gateway thread 0 state processing error declined") == 0;
+    std::vector<std::uint8_t> encoded;
+    encodeLogRecords(&declined, 1, encoded);
+    passed &= encoded.size() == 8 + sizeof(LogRecord);
+
+    const double writeNs = attempted == 0 ? 0.0 : static_cast<double>(writeNanos.load()) / static_cast<double>(attempted);
+    const double syncNs = records == 0 ? 0.0 : static_cast<double>(syncNanos) / static_cast<double>(records);
+    std::printf("event log     %u threads x %llu records, write %.1f ns (synchronous formatted %.1f ns), "
+                "%llu delivered, %llu dropped, %zu KB rings, %s\n",
+                threads,
+                static_cast<unsigned long long>(records),
+                writeNs,
+                syncNs,
+                static_cast<unsigned long long>(delivered),
+                static_cast<unsigned long long>(stats.dropped),
+                stats.memoryBytes / 1024,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
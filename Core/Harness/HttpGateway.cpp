@@ -0,0 +1,643 @@
+//
+//  HttpGateway.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "HttpGateway.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+#if defined(MSG_NOSIGNAL)
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+const char kV1MerchantAccounts[] = "/v1/merchant_accounts/";
+const char kV1Transactions[] = "/v1/transactions";
+const char kV2Transactions[] = "/v2/transactions/";
+const char kPingRequest[] = "GET /ping HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+const char kHeaderEnd[] = "\r\n\r\n";
+
+void configureSocket(int descriptor) {
+    const int on = 1;
+    ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#if defined(SO_NOSIGPIPE)
+    // Darwin has no MSG_NOSIGNAL; a write to a closed peer must fail instead of killing the process.
+    ::setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+int openConnection(std::uint16_t port) {
+    const int descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (descriptor < 0) {
+        return -1;
+    }
+    configureSocket(descriptor);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (::connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(descriptor);
+        return -1;
+    }
+    return descriptor;
+}
+
+bool sendAll(int descriptor, const char *data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t sent = ::send(descriptor, data, size, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+bool startsWithIgnoringCase(const char *text, const char *prefix) {
+    for (; *prefix != '\0'; ++text, ++prefix) {
+        char lower = *text;
+        if (lower >= 'A' && lower <= 'Z') {
+            lower = static_cast<char>(lower - 'A' + 'a');
+        }
+        if (lower != *prefix) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct HttpMessage {
+    // Sizes of the message at the front of the receive buffer.
+    std::size_t headSize = 0;
+    std::size_t bodySize = 0;
+    bool close = false;
+};
+
+bool receive(int descriptor, std::string &buffer) {
+    char chunk[4096];
+    for (;;) {
+        const ssize_t received = ::recv(descriptor, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(received));
+        return true;
+    }
+}
+
+/*!
+ * @brief Read one request or response into buffer
+ * @discussion Bytes past the message stay in buffer for the next call; consume() drops the message.
+ */
+bool readMessage(int descriptor, std::string &buffer, HttpMessage &message) {
+    std::size_t headEnd;
+    while ((headEnd = buffer.find(kHeaderEnd)) == std::string::npos) {
+        if (!receive(descriptor, buffer)) {
+            return false;
+        }
+    }
+    message.headSize = headEnd + 4;
+    for (std::size_t line = buffer.find("\r\n"); line < headEnd;) {
+        const std::size_t next = buffer.find("\r\n", line + 2);
+        const char *header = buffer.c_str() + line + 2;
+        if (startsWithIgnoringCase(header, "content-length:")) {
+            message.bodySize = std::strtoull(header + 15, nullptr, 10);
+        } else if (startsWithIgnoringCase(header, "connection:")) {
+            message.close = buffer.find("close", line + 2) < next;
+        }
+        line = next;
+    }
+    while (buffer.size() < message.headSize + message.bodySize) {
+        if (!receive(descriptor, buffer)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void consume(std::string &buffer, const HttpMessage &message) {
+    buffer.erase(0, message.headSize + message.bodySize);
+}
+
+bool ping(int descriptor) {
+    std::string buffer;
+    HttpMessage message;
+    return sendAll(descriptor, kPingRequest, sizeof(kPingRequest) - 1) && readMessage(descriptor, buffer, message) &&
+           !message.close;
+}
+
+bool jsonInteger(const char *body, std::size_t size, const char *key, std::int64_t &value) {
+    char pattern[32];
+    const int length = std::snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    if (length <= 0 || static_cast<std::size_t>(length) >= sizeof(pattern)) {
+        return false;
+    }
+    const char *end = body + size;
+    for (const char *at = body; at + length <= end; ++at) {
+        if (std::memcmp(at, pattern, static_cast<std::size_t>(length)) == 0) {
+            char *parsed = nullptr;
+            value = std::strtoll(at + length, &parsed, 10);
+            return parsed != at + length && parsed <= end;
+        }
+    }
+    return false;
+}
+
+void appendJson(std::string &out, const char *key, std::int64_t value) {
+    char field[48];
+    const int length = std::snprintf(field, sizeof(field), "%s\"%s\":%lld",
+                                     out.empty() || out.back() == '{' ? "" : ",", key,
+                                     static_cast<long long>(value));
+    out.append(field, static_cast<std::size_t>(length));
+}
+
+void appendHead(std::string &out, const char *statusLine, std::size_t contentLength) {
+    char head[128];
+    const int length = std::snprintf(head, sizeof(head),
+                                     "%s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+                                     statusLine, contentLength);
+    out.append(head, static_cast<std::size_t>(length));
+}
+
+/*!
+ * @brief Map a request line to a gateway request
+ * @return int - HTTP status: 200 when routed, otherwise the error to answer with
+ */
+int route(const char *line, std::size_t size, const char *body, std::size_t bodySize, GatewayRequest &request) {
+    if (size < 5 || std::memcmp(line, "POST ", 5) != 0) {
+        return size >= 4 && std::memcmp(line, "GET ", 4) == 0 ? 404 : 405;
+    }
+    const char *path = line + 5;
+    const char *pathEnd = static_cast<const char *>(std::memchr(path, ' ', size - 5));
+    if (pathEnd == nullptr) {
+        return 400;
+    }
+    const std::size_t pathSize = static_cast<std::size_t>(pathEnd - path);
+
+    std::int64_t value = 0;
+    if (pathSize == sizeof(kV1Transactions) - 1 && std::memcmp(path, kV1Transactions, pathSize) == 0) {
+        request.operation = GatewayOperation::Authorize;
+        if (!jsonInteger(body, bodySize, "type", value)) {
+            return 400;
+        }
+        request.type = static_cast<TransactionType>(value);
+        if (jsonInteger(body, bodySize, "cardInputMethod", value)) {
+            request.cardInputMethod = static_cast<CardInputMethod>(value);
+        }
+    } else if (pathSize > sizeof(kV2Transactions) - 1 &&
+               std::memcmp(path, kV2Transactions, sizeof(kV2Transactions) - 1) == 0) {
+        char *action = nullptr;
+        request.transactionId = std::strtoull(path + sizeof(kV2Transactions) - 1, &action, 10);
+        const std::size_t actionSize = static_cast<std::size_t>(pathEnd - action);
+        if (actionSize == 8 && std::memcmp(action, "/capture", 8) == 0) {
+            request.operation = GatewayOperation::Capture;
+        } else if (actionSize == 5 && std::memcmp(action, "/void", 5) == 0) {
+            request.operation = GatewayOperation::Void;
+        } else if (actionSize == 7 && std::memcmp(action, "/refund", 7) == 0) {
+            request.operation = GatewayOperation::Refund;
+        } else if (actionSize == 7 && std::memcmp(action, "/adjust", 7) == 0) {
+            request.operation = GatewayOperation::Adjust;
+        } else {
+            return 404;
+        }
+    } else {
+        return 404;
+    }
+    if (jsonInteger(body, bodySize, "amount", value)) {
+        request.amountMinor = value;
+    }
+    if (jsonInteger(body, bodySize, "cvm", value)) {
+        request.cvm = static_cast<Cvm>(value);
+    }
+    return 200;
+}
+
+/*!
+ * @brief Account id of a GET /v1/merchant_accounts/{id} request line
+ * @return bool - NO for any other request
+ */
+bool merchantAccountRoute(const char *line, std::size_t size, std::uint64_t &accountId) {
+    const std::size_t prefix = 4 + sizeof(kV1MerchantAccounts) - 1;
+    if (size <= prefix || std::memcmp(line, "GET ", 4) != 0 ||
+        std::memcmp(line + 4, kV1MerchantAccounts, sizeof(kV1MerchantAccounts) - 1) != 0) {
+        return false;
+    }
+    accountId = std::strtoull(line + prefix, nullptr, 10);
+    return true;
+}
+
+const char *statusLine(int status) {
+    switch (status) {
+        case 200: return "HTTP/1.1 200 OK";
+        case 400: return "HTTP/1.1 400 Bad Request";
+        case 404: return "HTTP/1.1 404 Not Found";
+        default: return "HTTP/1.1 405 Method Not Allowed";
+    }
+}
+
+} // namespace
+
+HttpGatewayServer::~HttpGatewayServer() {
+    stop();
+}
+
+ErrorCode HttpGatewayServer::start() {
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return ErrorCode::IOFailure;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, 128) != 0 ||
+        ::getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        ::close(listener);
+        return ErrorCode::IOFailure;
+    }
+    _listener = listener;
+    _port = ntohs(address.sin_port);
+    _stopping = false;
+    _acceptor = std::thread([this] { acceptLoop(); });
+    return ErrorCode::None;
+}
+
+void HttpGatewayServer::stop() {
+    if (!_acceptor.joinable()) {
+        return;
+    }
+    _stopping = true;
+    _acceptor.join();
+    ::close(_listener);
+    _listener = -1;
+
+    std::vector<std::thread> servers;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (int descriptor : _open) {
+            ::shutdown(descriptor, SHUT_RDWR);
+        }
+        servers.swap(_servers);
+    }
+    for (std::thread &server : servers) {
+        server.join();
+    }
+}
+
+void HttpGatewayServer::acceptLoop() {
+    while (!_stopping.load()) {
+        // Poll so stop() is noticed without relying on close() waking accept(), which Darwin does not do.
+        pollfd waiting{_listener, POLLIN, 0};
+        if (::poll(&waiting, 1, 50) <= 0) {
+            continue;
+        }
+        const int descriptor = ::accept(_listener, nullptr, nullptr);
+        if (descriptor < 0) {
+            continue;
+        }
+        configureSocket(descriptor);
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_stopping.load()) {
+            ::close(descriptor);
+            return;
+        }
+        _connections.fetch_add(1, std::memory_order_relaxed);
+        _open.push_back(descriptor);
+        _servers.emplace_back([this, descriptor] { serve(descriptor); });
+    }
+}
+
+void HttpGatewayServer::serve(int descriptor) {
+    std::string buffer;
+    std::string response;
+    std::string json;
+    for (;;) {
+        HttpMessage message;
+        if (!readMessage(descriptor, buffer, message)) {
+            break;
+        }
+        const std::size_t lineEnd = buffer.find("\r\n");
+        GatewayRequest request;
+        std::uint64_t accountId = 0;
+        const bool pingRequest = lineEnd >= 10 && std::memcmp(buffer.data(), "GET /ping ", 10) == 0;
+        const bool accountRequest = merchantAccountRoute(buffer.data(), lineEnd, accountId);
+        int status = pingRequest || accountRequest
+                         ? 200
+                         : route(buffer.data(), lineEnd, buffer.data() + message.headSize, message.bodySize, request);
+        consume(buffer, message);
+
+        json.assign("{");
+        if (pingRequest) {
+            // Nothing but the connection is being kept alive.
+        } else if (accountRequest) {
+            status = _backend.fetchMerchantAccount(accountId) == ErrorCode::None ? 200 : 404;
+            appendJson(json, "id", static_cast<std::int64_t>(accountId));
+        } else if (status == 200) {
+            const GatewayResponse outcome = _backend.authorize(request);
+            appendJson(json, "id", static_cast<std::int64_t>(outcome.transactionId));
+            appendJson(json, "result", static_cast<std::int64_t>(outcome.result));
+            appendJson(json, "cvm", static_cast<std::int64_t>(outcome.cvm));
+        }
+        json.push_back('}');
+        _requests.fetch_add(1, std::memory_order_relaxed);
+
+        response.clear();
+        appendHead(response, statusLine(status), json.size());
+        response.append(json);
+        if (!sendAll(descriptor, response.data(), response.size()) || message.close) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    for (std::size_t i = 0; i < _open.size(); ++i) {
+        if (_open[i] == descriptor) {
+            _open[i] = _open.back();
+            _open.pop_back();
+            break;
+        }
+    }
+    ::close(descriptor);
+}
+
+HttpGatewayClient::~HttpGatewayClient() {
+    disconnect();
+}
+
+HttpConnectionPool::HttpConnectionPool(std::uint16_t port, Nanos handshakeLatency, const ConnectionPoolConfig &config,
+                                       ClockFunction clock)
+    : _port(port), _handshakeLatency(handshakeLatency), _clock(clock), _pool(config) {
+    _pool.addHost();
+    _pool.addHost();
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+    std::vector<PoolTask> tasks;
+    _pool.closeAll(tasks);
+    for (const PoolTask &task : tasks) {
+        ::close(task.handle);
+    }
+}
+
+int HttpConnectionPool::open(std::size_t host) {
+    bool resumed;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        resumed = _pool.canResume(host, _clock());
+    }
+    const Nanos start = monotonicNanos();
+    const int descriptor = openConnection(_port);
+    if (descriptor < 0) {
+        return -1;
+    }
+    const Nanos handshake = resumed ? _handshakeLatency / 2 : _handshakeLatency;
+    if (handshake > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(handshake));
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    _pool.recordHandshake(host, monotonicNanos() - start, resumed, _clock());
+    _pool.connected(host, descriptor, _clock());
+    return descriptor;
+}
+
+int HttpConnectionPool::acquire(std::size_t host, bool &reused) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        const int descriptor = _pool.acquire(host, _clock());
+        reused = descriptor >= 0;
+        if (reused) {
+            _pool.recordRequest(host, true);
+            return descriptor;
+        }
+    }
+    const int descriptor = open(host);
+    if (descriptor >= 0) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pool.recordRequest(host, false);
+    }
+    return descriptor;
+}
+
+void HttpConnectionPool::release(std::size_t host, int descriptor, bool reusable) {
+    PoolRelease outcome;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        outcome = _pool.release(host, descriptor, reusable, _clock());
+    }
+    if (outcome == PoolRelease::Close) {
+        ::close(descriptor);
+    }
+}
+
+std::size_t HttpConnectionPool::maintain() {
+    std::vector<PoolTask> tasks;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pool.maintain(_clock(), tasks);
+    }
+    for (const PoolTask &task : tasks) {
+        switch (task.action) {
+            case PoolAction::Close:
+                ::close(task.handle);
+                break;
+            case PoolAction::KeepAlive:
+                release(task.host, task.handle, ping(task.handle));
+                break;
+            case PoolAction::Connect: {
+                const int descriptor = open(task.host);
+                if (descriptor >= 0) {
+                    release(task.host, descriptor, true);
+                }
+                break;
+            }
+        }
+    }
+    return tasks.size();
+}
+
+void HttpConnectionPool::networkChanged() {
+    std::lock_guard<std::mutex> guard(_lock);
+    _pool.networkChanged();
+}
+
+ConnectionStats HttpConnectionPool::stats(std::size_t host) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _pool.stats(host);
+}
+
+ConnectionStats HttpConnectionPool::totals() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _pool.totals();
+}
+
+ErrorCode HttpGatewayClient::connect() {
+    const int descriptor = openConnection(_port);
+    if (descriptor < 0) {
+        return ErrorCode::IOFailure;
+    }
+    if (_handshakeLatency > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(_handshakeLatency));
+    }
+    _descriptor = descriptor;
+    _buffer.clear();
+    ++_connects;
+    return ErrorCode::None;
+}
+
+ErrorCode HttpGatewayClient::preconnect() {
+    if (_pool != nullptr) {
+        bool reused = false;
+        const int descriptor = _pool->acquire(HttpConnectionPool::kV1Host, reused);
+        if (descriptor < 0) {
+            return ErrorCode::IOFailure;
+        }
+        _pool->release(HttpConnectionPool::kV1Host, descriptor, true);
+        return ErrorCode::None;
+    }
+    return _descriptor >= 0 ? ErrorCode::None : connect();
+}
+
+void HttpGatewayClient::disconnect() {
+    if (_descriptor >= 0) {
+        ::close(_descriptor);
+        _descriptor = -1;
+    }
+}
+
+ErrorCode HttpGatewayClient::exchange(std::size_t host, const std::string &request, int &status, std::string &body) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = _descriptor >= 0;
+        if (_pool != nullptr) {
+            _descriptor = _pool->acquire(host, reused);
+            _buffer.clear();
+            if (_descriptor < 0) {
+                return ErrorCode::IOFailure;
+            }
+        } else if (!reused && connect() != ErrorCode::None) {
+            return ErrorCode::IOFailure;
+        }
+        HttpMessage message;
+        const bool exchanged =
+            sendAll(_descriptor, request.data(), request.size()) && readMessage(_descriptor, _buffer, message);
+        if (_pool != nullptr) {
+            _pool->release(host, _descriptor, exchanged && !message.close);
+            _descriptor = -1;
+        }
+        if (exchanged) {
+            status = std::atoi(_buffer.c_str() + 9);
+            body.assign(_buffer, message.headSize, message.bodySize);
+            consume(_buffer, message);
+            if (message.close) {
+                disconnect();
+            }
+            return ErrorCode::None;
+        }
+        disconnect();
+        if (!reused) {
+            break;
+        }
+    }
+    return ErrorCode::IOFailure;
+}
+
+ErrorCode HttpGatewayClient::fetchMerchantAccount(std::uint64_t accountId) {
+    char head[128];
+    const int headSize = std::snprintf(head, sizeof(head), "GET %s%llu HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n",
+                                       kV1MerchantAccounts, static_cast<unsigned long long>(accountId));
+    _request.assign(head, static_cast<std::size_t>(headSize));
+    int status = 0;
+    if (exchange(HttpConnectionPool::kV1Host, _request, status, _body) != ErrorCode::None) {
+        return ErrorCode::IOFailure;
+    }
+    return status == 200 ? ErrorCode::None : ErrorCode::InvalidArgument;
+}
+
+GatewayResponse HttpGatewayClient::authorize(const GatewayRequest &request) {
+    char path[64];
+    switch (request.operation) {
+        case GatewayOperation::Authorize:
+            std::snprintf(path, sizeof(path), "%s", kV1Transactions);
+            break;
+        case GatewayOperation::Capture:
+        case GatewayOperation::Void:
+        case GatewayOperation::Refund:
+        case GatewayOperation::Adjust: {
+            const char *action = request.operation == GatewayOperation::Capture  ? "capture"
+                                 : request.operation == GatewayOperation::Void   ? "void"
+                                 : request.operation == GatewayOperation::Refund ? "refund"
+                                                                                 : "adjust";
+            std::snprintf(path, sizeof(path), "%s%llu/%s", kV2Transactions,
+                          static_cast<unsigned long long>(request.transactionId), action);
+            break;
+        }
+    }
+
+    _json.assign("{");
+    appendJson(_json, "type", static_cast<std::int64_t>(request.type));
+    appendJson(_json, "cardInputMethod", static_cast<std::int64_t>(request.cardInputMethod));
+    appendJson(_json, "amount", request.amountMinor);
+    appendJson(_json, "cvm", static_cast<std::int64_t>(request.cvm));
+    _json.push_back('}');
+
+    char head[160];
+    const int headSize = std::snprintf(head, sizeof(head),
+                                       "POST %s HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n"
+                                       "Content-Length: %zu\r\n\r\n",
+                                       path, _json.size());
+    _request.assign(head, static_cast<std::size_t>(headSize));
+    _request.append(_json);
+
+    GatewayResponse response;
+    response.result = TransactionResult::Errored;
+    int status = 0;
+    const std::size_t host =
+        request.operation == GatewayOperation::Authorize ? HttpConnectionPool::kV1Host : HttpConnectionPool::kV2Host;
+    if (exchange(host, _request, status, _body) != ErrorCode::None || status != 200) {
+        return response;
+    }
+    std::int64_t value = 0;
+    if (jsonInteger(_body.data(), _body.size(), "id", value)) {
+        response.transactionId = static_cast<std::uint64_t>(value);
+    }
+    if (jsonInteger(_body.data(), _body.size(), "result", value)) {
+        response.result = static_cast<TransactionResult>(value);
+    }
+    if (jsonInteger(_body.data(), _body.size(), "cvm", value)) {
+        response.cvm = static_cast<Cvm>(value);
+    }
+    return response;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,185 @@
+/*!
+ * @header HttpGateway.hpp
+ *
+ * @brief Loopback HTTP/1.1 stand-in for the CardFlight gateway's v1 and v2 endpoints.
+ * HttpGatewayServer answers on 127.0.0.1 with outcomes from a backing Gateway, usually a
+ * MockGateway; HttpGatewayClient is the Gateway a TransactionDriver talks to instead, so a run
+ * pays for serialization, sockets and keep-alive the way the SDK does against baseV1Url and
+ * baseV2Url. Clients given an HttpConnectionPool share their connections through it.
+ *
+ * Routes:
+ *   GET  /v1/merchant_accounts/{id}      validate a merchant account
+ *   POST /v1/transactions                authorize a card-present sale, authorization, refund or tokenization
+ *   POST /v2/transactions/{id}/capture   capture an authorization
+ *   POST /v2/transactions/{id}/void      void a record
+ *   POST /v2/transactions/{id}/refund    refund a record
+ *   POST /v2/transactions/{id}/adjust    replace the tip of a record, {"amount":tip}
+ *   GET  /ping                           keep-alive, answered without reaching the backing Gateway
+ *
+ * Bodies are flat JSON objects of integers, e.g. {"type":1,"cardInputMethod":3,"amount":1250,"cvm":1}
+ * in and {"id":42,"result":1,"cvm":2} out.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/ConnectionPool.hpp"
+#include "cft/Error.hpp"
+#include "MockGateway.hpp"
+
+namespace cft {
+namespace harness {
+
+class HttpGatewayServer {
+public:
+    explicit HttpGatewayServer(Gateway &backend) : _backend(backend) {}
+    ~HttpGatewayServer();
+
+    HttpGatewayServer(const HttpGatewayServer &) = delete;
+    HttpGatewayServer &operator=(const HttpGatewayServer &) = delete;
+
+    /*!
+     * @brief Listen on an ephemeral loopback port
+     * @return ErrorCode - IOFailure if the socket could not be bound
+     */
+    ErrorCode start();
+
+    /*!
+     * @brief Close the listener and every open connection, and join their threads
+     */
+    void stop();
+
+    std::uint16_t port() const { return _port; }
+    std::uint64_t requestCount() const { return _requests.load(std::memory_order_relaxed); }
+    std::uint64_t connectionCount() const { return _connections.load(std::memory_order_relaxed); }
+
+private:
+    void acceptLoop();
+    void serve(int descriptor);
+
+    Gateway &_backend;
+    int _listener = -1;
+    std::uint16_t _port = 0;
+    std::atomic<bool> _stopping{false};
+    std::atomic<std::uint64_t> _requests{0};
+    std::atomic<std::uint64_t> _connections{0};
+    std::thread _acceptor;
+    std::mutex _lock;
+    std::vector<int> _open;
+    std::vector<std::thread> _servers;
+};
+
+/*!
+ * @brief Connections to an HttpGatewayServer shared by every client that is given the pool
+ * @discussion Thread-safe. v1 and v2 are separate hosts, as baseV1Url and baseV2Url are, although
+ * both reach the same server here. New connections sleep for the handshake latency, or half of it
+ * when they resume a TLS session: one round trip instead of two.
+ */
+class HttpConnectionPool {
+public:
+    static constexpr std::size_t kV1Host = 0;
+    static constexpr std::size_t kV2Host = 1;
+
+    HttpConnectionPool(std::uint16_t port, Nanos handshakeLatency,
+                       const ConnectionPoolConfig &config = ConnectionPoolConfig(),
+                       ClockFunction clock = monotonicNanos);
+    ~HttpConnectionPool();
+
+    HttpConnectionPool(const HttpConnectionPool &) = delete;
+    HttpConnectionPool &operator=(const HttpConnectionPool &) = delete;
+
+    /*!
+     * @brief A connected descriptor for one request, reused when the host has one idle
+     * @return int - -1 if no connection could be opened
+     */
+    int acquire(std::size_t host, bool &reused);
+
+    /*!
+     * @brief Hand back a descriptor from acquire()
+     * @param reusable bool - NO when the request failed or the server asked to close
+     */
+    void release(std::size_t host, int descriptor, bool reusable);
+
+    /*!
+     * @brief Run the keep-alives, closes and reconnects due now
+     * @return std::size_t - Tasks run
+     */
+    std::size_t maintain();
+
+    void networkChanged();
+
+    ConnectionStats stats(std::size_t host) const;
+    ConnectionStats totals() const;
+
+private:
+    int open(std::size_t host);
+
+    std::uint16_t _port;
+    Nanos _handshakeLatency;
+    ClockFunction _clock;
+    mutable std::mutex _lock;
+    ConnectionPool _pool;
+    std::vector<PoolTask> _tasks;
+};
+
+/*!
+ * @brief Keep-alive client for one thread
+ * @discussion Not thread-safe; give each worker its own. A request that fails on a reused
+ * connection is retried once on a fresh one; a request that still fails comes back Errored.
+ */
+class HttpGatewayClient : public Gateway {
+public:
+    /*!
+     * @param handshakeLatency Nanos - Added to every new connection to stand in for the TLS handshake
+     * the live gateway needs and loopback does not
+     */
+    explicit HttpGatewayClient(std::uint16_t port, Nanos handshakeLatency = 0)
+        : _port(port), _handshakeLatency(handshakeLatency) {}
+
+    /*!
+     * @brief Client that takes a connection from pool for each request instead of keeping its own
+     */
+    explicit HttpGatewayClient(HttpConnectionPool &pool) : _port(0), _handshakeLatency(0), _pool(&pool) {}
+    ~HttpGatewayClient() override;
+
+    HttpGatewayClient(const HttpGatewayClient &) = delete;
+    HttpGatewayClient &operator=(const HttpGatewayClient &) = delete;
+
+    GatewayResponse authorize(const GatewayRequest &request) override;
+    ErrorCode fetchMerchantAccount(std::uint64_t accountId) override;
+
+    /*!
+     * @brief Open the connection now so the next request does not pay for it
+     */
+    ErrorCode preconnect();
+
+    std::uint64_t connectCount() const { return _connects; }
+
+private:
+    ErrorCode connect();
+    void disconnect();
+    ErrorCode exchange(std::size_t host, const std::string &request, int &status, std::string &body);
+
+    std::uint16_t _port;
+    Nanos _handshakeLatency;
+    HttpConnectionPool *_pool = nullptr;
+    int _descriptor = -1;
+    std::uint64_t _connects = 0;
+    // Reused across requests so steady-state round trips do not allocate.
+    std::string _request;
+    std::string _json;
+    std::string _body;
+    std::string _buffer;
+};
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,66 @@
+//
+//  MockGateway.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "MockGateway.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace cft {
+namespace harness {
+
+GatewayResponse MockGateway::authorize(const GatewayRequest &request) {
+    const std::uint64_t sequence = _requests.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (_config.latency > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(_config.latency));
+    }
+
+    const std::uint64_t roll = mix64(_config.seed ^ mix64(sequence));
+    GatewayResponse response;
+    response.transactionId = sequence;
+
+    // A tip may be adjusted back to nothing.
+    const bool needsAmount = request.operation != GatewayOperation::Void && request.operation != GatewayOperation::Adjust &&
+                             request.type != TransactionType::Tokenization;
+    if ((needsAmount && request.amountMinor <= 0) || request.amountMinor < 0) {
+        response.result = TransactionResult::Errored;
+        return response;
+    }
+
+    if (request.operation != GatewayOperation::Authorize) {
+        // Follow-up operations on an existing record are not card-present and never ask for CVM.
+        response.result = unitInterval(roll) < _config.declineRate ? TransactionResult::Declined
+                                                                   : (request.operation == GatewayOperation::Void
+                                                                          ? TransactionResult::Voided
+                                                                          : TransactionResult::Approved);
+        return response;
+    }
+
+    response.result = unitInterval(roll) < _config.declineRate ? TransactionResult::Declined
+                                                               : TransactionResult::Approved;
+
+    // Tap and quick chip run under CVM limits in the harness; everything else may be asked to sign.
+    const bool signatureEligible = request.cardInputMethod != CardInputMethod::Tap &&
+                                   request.cardInputMethod != CardInputMethod::QuickChip &&
+                                   request.cvm != Cvm::Pin;
+    if (response.result == TransactionResult::Approved && signatureEligible &&
+        unitInterval(mix64(roll)) < _config.signatureRate) {
+        response.cvm = Cvm::Signature;
+    }
+    return response;
+}
+
+ErrorCode MockGateway::fetchMerchantAccount(std::uint64_t accountId) {
+    _requests.fetch_add(1, std::memory_order_relaxed);
+    if (_config.latency > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(_config.latency));
+    }
+    return accountId == 0 ? ErrorCode::InvalidArgument : ErrorCode::None;
+}
+
+} // namespace harness
+} // namespace cft
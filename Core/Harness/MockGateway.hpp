@@ -0,0 +1,112 @@
+/*!
+ * @header MockGateway.hpp
+ *
+ * @brief In-process stand-in for the CardFlight gateway.
+ * Outcomes are a pure function of the seed and the request sequence number, so a
+ * replay run is reproducible regardless of thread interleaving.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "cft/Error.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+namespace harness {
+
+struct MockGatewayConfig {
+    std::uint64_t seed = 1;
+    double declineRate = 0.05;
+    double signatureRate = 0.25;
+    Nanos latency = 0;
+};
+
+enum class GatewayOperation : std::uint8_t {
+    Authorize,
+    Capture,
+    Void,
+    Refund,
+    Adjust
+};
+
+struct GatewayRequest {
+    GatewayOperation operation = GatewayOperation::Authorize;
+    TransactionType type = TransactionType::Sale;
+    CardInputMethod cardInputMethod = CardInputMethod::Unknown;
+    // The tip for Adjust, which replaces any tip the record had.
+    std::int64_t amountMinor = 0;
+    // Verification already done at the reader, e.g. Pin for online PIN.
+    Cvm cvm = Cvm::None;
+    // Gateway id of the record a capture, void, refund or adjustment applies to.
+    std::uint64_t transactionId = 0;
+};
+
+struct GatewayResponse {
+    std::uint64_t transactionId = 0;
+    TransactionResult result = TransactionResult::Unknown;
+    Cvm cvm = Cvm::None;
+};
+
+/*!
+ * @brief What TransactionDriver talks to: the in-process MockGateway or the HttpGatewayClient
+ */
+class Gateway {
+public:
+    virtual ~Gateway() = default;
+    virtual GatewayResponse authorize(const GatewayRequest &request) = 0;
+
+    /*!
+     * @brief Validate a merchant account, as the SDK does before a transaction can be created
+     * @return ErrorCode - InvalidArgument for account 0, IOFailure if the gateway could not be reached
+     */
+    virtual ErrorCode fetchMerchantAccount(std::uint64_t accountId) = 0;
+};
+
+class MockGateway : public Gateway {
+public:
+    explicit MockGateway(MockGatewayConfig config) : _config(config) {}
+
+    /*!
+     * @brief Authorize a request, blocking the calling thread for the configured latency
+     * @discussion Safe to call from any number of threads.
+     */
+    GatewayResponse authorize(const GatewayRequest &request) override;
+
+    /*!
+     * @brief Validate an account after the configured latency
+     */
+    ErrorCode fetchMerchantAccount(std::uint64_t accountId) override;
+
+    const MockGatewayConfig &config() const { return _config; }
+
+    std::uint64_t requestCount() const { return _requests.load(std::memory_order_relaxed); }
+
+private:
+    MockGatewayConfig _config;
+    std::atomic<std::uint64_t> _requests{0};
+};
+
+/*!
+ * @brief splitmix64 step, the harness' only source of pseudo randomness
+ */
+inline std::uint64_t mix64(std::uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/*!
+ * @brief Uniform double in [0, 1) derived from a 64 bit value
+ */
+inline double unitInterval(std::uint64_t value) {
+    return static_cast<double>(value >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // namespace harness
+} // namespace cft
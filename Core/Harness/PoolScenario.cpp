@@ -0,0 +1,204 @@
+//
+//  PoolScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/ConnectionPool.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "HttpGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const Nanos kSecond = 1000000000;
+
+Nanos virtualNow = 0;
+
+Nanos virtualClock() {
+    return virtualNow;
+}
+
+double micros(Nanos value) {
+    return static_cast<double>(value) / 1000.0;
+}
+
+// A connection dropped while several requests share it is closed after the last of them, and
+// releasing a connection the pool forgot never asks for a close.
+bool checkSharedRelease() {
+    ConnectionPoolConfig config;
+    config.streamsPerConnection = 2;
+    ConnectionPool pool(config);
+    const std::size_t host = pool.addHost();
+    bool passed = true;
+
+    pool.connected(host, 7, 0);
+    passed &= pool.acquire(host, 1) == 7;
+    passed &= pool.release(host, 7, false, 2) == PoolRelease::Kept && pool.connectionCount(host) == 1;
+    passed &= pool.acquire(host, 3) == -1;
+    passed &= pool.release(host, 7, true, 4) == PoolRelease::Close && pool.connectionCount(host) == 0;
+    passed &= pool.release(host, 7, true, 5) == PoolRelease::Unknown;
+
+    pool.connected(host, 8, 6);
+    passed &= pool.acquire(host, 7) == 8;
+    pool.networkChanged();
+    passed &= pool.release(host, 8, true, 8) == PoolRelease::Kept;
+    passed &= pool.release(host, 8, true, 9) == PoolRelease::Close;
+
+    pool.connected(host, 9, 10);
+    std::vector<PoolTask> tasks;
+    pool.closeAll(tasks);
+    passed &= tasks.size() == 1 && pool.release(host, 9, true, 11) == PoolRelease::Unknown;
+    return passed;
+}
+
+// A sale followed by a void or capture on it, the v1 then v2 pattern of a terminal.
+GatewayRequest requestFor(std::uint64_t index, std::uint64_t previousId) {
+    GatewayRequest request;
+    if (index % 2 == 0 || previousId == 0) {
+        request.operation = GatewayOperation::Authorize;
+        request.cardInputMethod = CardInputMethod::Dip;
+    } else {
+        request.operation = (index / 2) % 2 == 0 ? GatewayOperation::Void : GatewayOperation::Capture;
+        request.transactionId = previousId;
+    }
+    request.amountMinor = 100 + static_cast<std::int64_t>(mix64(index) % 50000);
+    return request;
+}
+
+/*!
+ * @brief requests requests on threads threads, each through a client of its own made by makeClient
+ * @discussion A client per request is how the SDK issues gateway calls.
+ */
+template <typename MakeClient>
+std::uint64_t runRequests(std::uint64_t requests, unsigned threads, MakeClient makeClient, LatencyHistogram &latency) {
+    std::vector<LatencyHistogram> latencies(threads);
+    std::vector<std::uint64_t> failures(threads, 0);
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < threads; ++worker) {
+        const std::uint64_t first = requests * worker / threads;
+        const std::uint64_t last = requests * (worker + 1) / threads;
+        workers.emplace_back([&, worker, first, last] {
+            std::uint64_t previousId = 0;
+            for (std::uint64_t i = first; i < last; ++i) {
+                const GatewayRequest request = requestFor(i, previousId);
+                const Nanos start = monotonicNanos();
+                std::unique_ptr<HttpGatewayClient> client = makeClient();
+                const GatewayResponse response = client->authorize(request);
+                latencies[worker].record(monotonicNanos() - start);
+                failures[worker] += response.result == TransactionResult::Errored;
+                previousId = response.transactionId;
+            }
+        });
+    }
+    std::uint64_t failed = 0;
+    for (unsigned worker = 0; worker < threads; ++worker) {
+        workers[worker].join();
+        latency.merge(latencies[worker]);
+        failed += failures[worker];
+    }
+    return failed;
+}
+
+// Keep-alives inside the warm window and idle closes after it, on a virtual clock.
+bool checkIdlePattern(std::uint16_t port) {
+    ConnectionPoolConfig config;
+    virtualNow = kSecond;
+    HttpConnectionPool pool(port, 0, config, virtualClock);
+    HttpGatewayClient client(pool);
+    bool passed = client.fetchMerchantAccount(1) == ErrorCode::None;
+
+    virtualNow += config.keepAliveInterval;
+    passed &= pool.maintain() == 1 && pool.stats(HttpConnectionPool::kV1Host).keepAlives == 1;
+    passed &= client.fetchMerchantAccount(1) == ErrorCode::None &&
+              pool.stats(HttpConnectionPool::kV1Host).reusedRequests == 1;
+
+    // Past the warm window nothing is pinged and the connection ages out.
+    virtualNow += config.warmWindow + config.idleTimeout;
+    passed &= pool.maintain() == 1;
+    const ConnectionStats stats = pool.stats(HttpConnectionPool::kV1Host);
+    passed &= stats.keepAlives == 1 && stats.closedIdle == 1 && stats.reconnects == 0 && pool.maintain() == 0;
+    return passed;
+}
+
+void printStats(const char *name, const ConnectionStats &stats) {
+    std::printf("  %-6s %10llu %9.1f%% %11llu %9llu %14.1f %11llu %11llu\n",
+                name,
+                static_cast<unsigned long long>(stats.requests),
+                stats.reuseRate() * 100.0,
+                static_cast<unsigned long long>(stats.handshakes),
+                static_cast<unsigned long long>(stats.resumedHandshakes),
+                micros(stats.meanHandshake()),
+                static_cast<unsigned long long>(stats.keepAlives),
+                static_cast<unsigned long long>(stats.reconnects));
+}
+
+} // namespace
+
+bool runPoolScenario(MockGateway &gateway, std::uint64_t requests, unsigned threads) {
+    HttpGatewayServer server(gateway);
+    if (server.start() != ErrorCode::None) {
+        std::printf("pool          could not start the HTTP gateway, FAILED\n");
+        return false;
+    }
+
+    // Loopback has no TLS; charge every full handshake two gateway round trips.
+    const Nanos handshake = 2 * gateway.config().latency;
+    const std::uint16_t port = server.port();
+    LatencyHistogram unpooled;
+    std::uint64_t failures = runRequests(requests, threads, [&] {
+        return std::unique_ptr<HttpGatewayClient>(new HttpGatewayClient(port, handshake));
+    }, unpooled);
+
+    HttpConnectionPool pool(port, handshake);
+    LatencyHistogram pooled;
+    failures += runRequests(requests, threads, [&] {
+        return std::unique_ptr<HttpGatewayClient>(new HttpGatewayClient(pool));
+    }, pooled);
+    const ConnectionStats steady = pool.totals();
+
+    // A network switch drops every connection; warm hosts reconnect, resuming their sessions.
+    pool.networkChanged();
+    const std::size_t reconnectTasks = pool.maintain();
+    HttpGatewayClient client(pool);
+    failures += client.fetchMerchantAccount(1) != ErrorCode::None;
+    const ConnectionStats v1 = pool.stats(HttpConnectionPool::kV1Host);
+    const ConnectionStats v2 = pool.stats(HttpConnectionPool::kV2Host);
+    const ConnectionStats totals = pool.totals();
+    // Short runs may never reach v2.
+    const bool bothHosts = requests >= 4 * threads;
+    const bool reconnected = !bothHosts ||
+                             (totals.reconnects == 2 && totals.resumedHandshakes >= steady.resumedHandshakes + 2 &&
+                              reconnectTasks >= 2 && totals.reusedRequests > steady.reusedRequests);
+
+    const bool idlePattern = checkIdlePattern(port) && checkSharedRelease();
+    server.stop();
+
+    // No more connections per host than requests in flight at once.
+    const bool reused = !bothHosts || (steady.handshakes <= 2 * threads && pooled.percentile(50) < unpooled.percentile(50));
+    const bool passed = failures == 0 && reused && reconnected && idlePattern;
+    std::printf("pool          %llu requests, p50 %.1f us connecting per request, %.1f us pooled, %.1f%% reused, %s\n",
+                static_cast<unsigned long long>(requests),
+                micros(unpooled.percentile(50)),
+                micros(pooled.percentile(50)),
+                steady.reuseRate() * 100.0,
+                passed ? "ok" : "FAILED");
+    std::printf("  %-6s %10s %10s %11s %9s %14s %11s %11s\n",
+                "host", "requests", "reused", "handshakes", "resumed", "handshake(us)", "keepalives", "reconnects");
+    printStats("v1", v1);
+    printStats("v2", v2);
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
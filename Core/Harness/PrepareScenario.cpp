@@ -0,0 +1,172 @@
+//
+//  PrepareScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+
+#include "cft/Clock.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/TransactionPreparation.hpp"
+#include "HttpGateway.hpp"
+#include "Scenarios.hpp"
+#include "SimulatedReader.hpp"
+#include "TransactionDriver.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const std::uint64_t kMerchantAccountId = 1;
+const std::uint8_t kRequiredSteps = preparationStepBit(PreparationStep::MerchantAccount);
+
+Nanos virtualNow = 0;
+
+Nanos virtualClock() {
+    return virtualNow;
+}
+
+class ConnectionListener : public SimulatedReader::Listener {
+public:
+    void readerDidReceiveEvent(CardReaderEvent event) override { _connected |= event == CardReaderEvent::Connected; }
+
+    bool connected() const { return _connected; }
+
+private:
+    bool _connected = false;
+};
+
+double micros(Nanos value) {
+    return static_cast<double>(value) / 1000.0;
+}
+
+TransactionPlan planFor(std::uint64_t index, Nanos readerStepDelay) {
+    TransactionPlan plan;
+    plan.cardInputMethod = CardInputMethod::Dip;
+    plan.amountMinor = 100 + static_cast<std::int64_t>(mix64(index) % 50000);
+    plan.readerStepDelay = readerStepDelay;
+    return plan;
+}
+
+// Everything a sale does when "Charge" is the first thing that happens.
+bool runCold(SimulatedReader &reader, std::uint16_t port, Nanos handshake, std::uint64_t index,
+             Nanos readerStepDelay, LatencyHistogram &latency) {
+    const Nanos start = monotonicNanos();
+    HttpGatewayClient client(port, handshake);
+    if (client.fetchMerchantAccount(kMerchantAccountId) != ErrorCode::None) {
+        return false;
+    }
+    TransactionPlan plan = planFor(index, readerStepDelay);
+    plan.connectReader = true;
+    TransactionDriver driver(reader, client, nullptr);
+    const TransactionOutcome outcome = driver.run(plan);
+    latency.record(monotonicNanos() - start);
+    return outcome.error == ErrorCode::None;
+}
+
+// The same work split at "Charge": everything but the amount happens while the checkout screen is up.
+bool runPrepared(SimulatedReader &reader, std::uint16_t port, Nanos handshake, std::uint64_t index,
+                 Nanos readerStepDelay, LatencyHistogram &latency) {
+    TransactionPreparation preparation(kRequiredSteps, 0);
+    HttpGatewayClient client(port, handshake);
+    preparation.complete(PreparationStep::Gateway, client.preconnect());
+    preparation.complete(PreparationStep::MerchantAccount, client.fetchMerchantAccount(kMerchantAccountId));
+    ConnectionListener listener;
+    reader.play(SimulatedReader::connectionScript(reader.model(), readerStepDelay), listener);
+    preparation.complete(PreparationStep::Reader, listener.connected() ? ErrorCode::None : ErrorCode::IOFailure);
+
+    const TransactionPlan plan = planFor(index, readerStepDelay);
+    const Nanos start = monotonicNanos();
+    if (preparation.bind(plan.amountMinor) != ErrorCode::None || !preparation.shouldStart()) {
+        return false;
+    }
+    TransactionDriver driver(reader, client, nullptr);
+    const TransactionOutcome outcome = driver.run(plan);
+    latency.record(monotonicNanos() - start);
+    return outcome.error == ErrorCode::None && preparation.warmedSteps() == preparation.finishedSteps();
+}
+
+// Failed, early-bound and expired preparations, on a virtual clock.
+bool checkLifecycle(HttpGatewayClient &client) {
+    bool passed = true;
+
+    TransactionPreparation rejected(kRequiredSteps, 0, virtualClock);
+    rejected.complete(PreparationStep::MerchantAccount, client.fetchMerchantAccount(0));
+    passed &= rejected.state() == PreparationState::Failed && rejected.error() == ErrorCode::InvalidArgument;
+    passed &= rejected.bind(500) == ErrorCode::IllegalTransition;
+
+    // A reader that fails to arm only costs the transaction its own connect.
+    TransactionPreparation early(kRequiredSteps, 0, virtualClock);
+    passed &= early.bind(0) == ErrorCode::InvalidArgument;
+    passed &= early.bind(500) == ErrorCode::None && !early.shouldStart();
+    early.complete(PreparationStep::Reader, ErrorCode::IOFailure);
+    early.complete(PreparationStep::MerchantAccount, ErrorCode::None);
+    passed &= !early.shouldStart();
+    early.complete(PreparationStep::Gateway, ErrorCode::None);
+    passed &= early.shouldStart() && early.amountMinor() == 500 &&
+              early.warmedSteps() != early.finishedSteps();
+    passed &= early.complete(PreparationStep::Gateway, ErrorCode::None) == ErrorCode::IllegalTransition;
+
+    const Nanos ttl = 5 * 60 * 1000000000LL;
+    virtualNow = 0;
+    TransactionPreparation stale(kRequiredSteps, ttl, virtualClock);
+    virtualNow += 1000;
+    stale.complete(PreparationStep::MerchantAccount, ErrorCode::None);
+    stale.complete(PreparationStep::Reader, ErrorCode::None);
+    stale.complete(PreparationStep::Gateway, ErrorCode::None);
+    passed &= stale.state() == PreparationState::Ready && stale.preparationTime() == 1000;
+    virtualNow += ttl + 1;
+    passed &= stale.state() == PreparationState::Expired;
+    // Binding an expired preparation still starts the sale, once.
+    passed &= stale.bind(500) == ErrorCode::None && stale.shouldStart() && stale.bind(500) == ErrorCode::IllegalTransition;
+
+    TransactionPreparation canceled(kRequiredSteps, 0, virtualClock);
+    canceled.cancel();
+    passed &= canceled.state() == PreparationState::Canceled &&
+              canceled.complete(PreparationStep::Reader, ErrorCode::None) == ErrorCode::IllegalTransition;
+    return passed;
+}
+
+} // namespace
+
+bool runPrepareScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions,
+                        Nanos readerStepDelay) {
+    HttpGatewayServer server(gateway);
+    if (server.start() != ErrorCode::None) {
+        std::printf("prepare       could not start the HTTP gateway, FAILED\n");
+        return false;
+    }
+
+    // Loopback has no TLS; charge every new connection one gateway round trip for the handshake.
+    const Nanos handshake = gateway.config().latency;
+    SimulatedReader reader(model);
+    LatencyHistogram cold;
+    LatencyHistogram prepared;
+    std::uint64_t failures = 0;
+    for (std::uint64_t i = 0; i < transactions; ++i) {
+        failures += !runCold(reader, server.port(), handshake, i, readerStepDelay, cold);
+        failures += !runPrepared(reader, server.port(), handshake, i, readerStepDelay, prepared);
+    }
+
+    HttpGatewayClient client(server.port());
+    const bool lifecycle = checkLifecycle(client);
+    server.stop();
+
+    const bool faster = transactions == 0 || prepared.percentile(50) < cold.percentile(50);
+    const bool passed = failures == 0 && lifecycle && faster;
+    std::printf("prepare       %llu transactions, charge to approval p50 %.1f us cold, %.1f us prepared, %s\n",
+                static_cast<unsigned long long>(transactions),
+                micros(cold.percentile(50)),
+                micros(prepared.percentile(50)),
+                passed ? "ok" : "FAILED");
+    std::printf("  %-10s %12s %12s\n", "path", "p50(us)", "p99(us)");
+    std::printf("  %-10s %12.1f %12.1f\n", "cold", micros(cold.percentile(50)), micros(cold.percentile(99)));
+    std::printf("  %-10s %12.1f %12.1f\n", "prepared", micros(prepared.percentile(50)), micros(prepared.percentile(99)));
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
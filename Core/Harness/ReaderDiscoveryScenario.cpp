@@ -0,0 +1,297 @@
+//
+//  ReaderDiscoveryScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Clock.hpp"
+#include "cft/File.hpp"
+#include "cft/ReaderDiscovery.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// A scan in a busy store: readers come into range over the first few seconds and advertise every
+// 100 ms with readings that jump several dB either way, now and then dropping 12 dB behind a body.
+const std::int64_t kScanMillis = 8000;
+const std::int64_t kStepMillis = 20;
+const std::int64_t kAdvertiseMillis = 100;
+const std::int64_t kArrivalSpreadMillis = 4000;
+const std::int64_t kLaunchMillis = 1570000000000;
+
+struct NearbyReader {
+    std::string name;
+    int signal;
+    std::int64_t arrivesAtMillis;
+};
+
+std::vector<NearbyReader> makeReaders(std::uint64_t count) {
+    std::vector<NearbyReader> readers;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "B250-%04llu", static_cast<unsigned long long>(1000 + i * 37));
+        const std::uint64_t roll = mix64(i * 7 + 3);
+        readers.push_back({name, -45 - static_cast<int>(roll % 50),
+                           static_cast<std::int64_t>((roll >> 16) % kArrivalSpreadMillis)});
+    }
+    return readers;
+}
+
+int noisyReading(const NearbyReader &reader, std::uint64_t seed) {
+    const std::uint64_t roll = mix64(seed);
+    const int jitter = static_cast<int>(roll % 9) - 4;
+    return reader.signal + jitter - ((roll >> 8) % 10 == 0 ? 12 : 0);
+}
+
+// Applies changes to names the way a table view applies a batch update, so the scenario fails if
+// a list patched only from the changes ever differs from ranked().
+std::vector<std::string> applyChanges(const std::vector<std::string> &names, const std::vector<ReaderChange> &changes,
+                                      std::size_t nextSize, bool &valid) {
+    std::vector<bool> leaving(names.size(), false);
+    std::vector<std::string> next(nextSize);
+    std::vector<bool> placed(nextSize, false);
+    for (const ReaderChange &change : changes) {
+        if (change.kind == ReaderChangeKind::Removed || change.kind == ReaderChangeKind::Moved) {
+            valid &= change.previousIndex < names.size() && names[change.previousIndex] == change.name;
+            if (change.previousIndex < names.size()) {
+                leaving[change.previousIndex] = true;
+            }
+        }
+        if (change.kind == ReaderChangeKind::Added || change.kind == ReaderChangeKind::Moved) {
+            valid &= change.index < nextSize && !placed[change.index];
+            if (change.index < nextSize) {
+                next[change.index] = change.name;
+                placed[change.index] = true;
+            }
+        }
+    }
+    std::size_t slot = 0;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (leaving[i]) {
+            continue;
+        }
+        while (slot < nextSize && placed[slot]) {
+            ++slot;
+        }
+        valid &= slot < nextSize;
+        if (slot < nextSize) {
+            next[slot++] = names[i];
+        }
+    }
+    for (const ReaderChange &change : changes) {
+        if (change.kind == ReaderChangeKind::Updated) {
+            valid &= change.index < nextSize && next[change.index] == change.name;
+        }
+    }
+    return next;
+}
+
+struct ScanResult {
+    bool consistent = true;
+    std::int64_t candidateAtMillis = -1;
+    std::int64_t settledAtMillis = 0;
+    std::uint64_t changes = 0;
+    std::uint64_t movesAfterSettling = 0;
+    std::uint64_t reloadedRows = 0;
+    std::uint64_t updates = 0;
+    Nanos nanos = 0;
+    std::vector<std::string> order;
+};
+
+ScanResult scan(ReaderDiscovery &discovery, const std::vector<NearbyReader> &readers) {
+    ScanResult result;
+    std::vector<std::string> mirror;
+    std::vector<ReaderChange> changes;
+    std::vector<ReaderSighting> visible;
+
+    auto absorb = [&](std::int64_t at) {
+        mirror = applyChanges(mirror, changes, discovery.ranked().size(), result.consistent);
+        for (std::size_t i = 0; i < mirror.size(); ++i) {
+            result.consistent &= mirror[i] == discovery.ranked()[i].name;
+        }
+        result.changes += changes.size();
+        result.reloadedRows += discovery.ranked().size();
+        ++result.updates;
+        if (at >= result.settledAtMillis + 2000) {
+            for (const ReaderChange &change : changes) {
+                result.movesAfterSettling += change.kind == ReaderChangeKind::Moved ? 1 : 0;
+            }
+        }
+        changes.clear();
+    };
+
+    for (const NearbyReader &reader : readers) {
+        result.settledAtMillis = std::max(result.settledAtMillis, reader.arrivesAtMillis);
+    }
+    for (std::int64_t at = 0; at < kScanMillis; at += kStepMillis) {
+        const std::int64_t now = kLaunchMillis + at;
+        bool arrived = false;
+        for (const NearbyReader &reader : readers) {
+            if (reader.arrivesAtMillis >= at && reader.arrivesAtMillis < at + kStepMillis) {
+                visible.push_back({reader.name, CardReaderModel::B250, false});
+                arrived = true;
+            }
+        }
+        const Nanos start = monotonicNanos();
+        if (arrived) {
+            discovery.updateVisible(visible, now, changes);
+            result.nanos += monotonicNanos() - start;
+            absorb(at);
+        }
+        for (std::size_t i = 0; i < readers.size(); ++i) {
+            const std::int64_t phase = static_cast<std::int64_t>(mix64(i) % kAdvertiseMillis);
+            if (readers[i].arrivesAtMillis <= at && (at + phase) % kAdvertiseMillis < kStepMillis) {
+                const Nanos signalStart = monotonicNanos();
+                discovery.updateSignal(readers[i].name, noisyReading(readers[i], mix64(i) + static_cast<std::uint64_t>(at)),
+                                       now, changes);
+                result.nanos += monotonicNanos() - signalStart;
+                absorb(at);
+            }
+        }
+        DiscoveredReader candidate;
+        if (result.candidateAtMillis < 0 && discovery.autoConnectCandidate(candidate)) {
+            result.candidateAtMillis = at;
+        }
+    }
+    for (const DiscoveredReader &reader : discovery.ranked()) {
+        result.order.push_back(reader.name);
+    }
+    return result;
+}
+
+// The last reader used is offered for auto-connect however long ago that was, connecting moves a
+// reader to the top, and a corrupt or missing file leaves the known readers as they were.
+bool checkKnownReaders(const std::string &path, const std::vector<NearbyReader> &readers) {
+    bool passed = true;
+    ReaderDiscovery discovery;
+    std::vector<ReaderChange> changes;
+    std::vector<ReaderSighting> visible;
+    for (const NearbyReader &reader : readers) {
+        visible.push_back({reader.name, CardReaderModel::B250, false});
+    }
+    discovery.recordConnected(readers[0].name, CardReaderModel::B250, kLaunchMillis - 7 * 24 * 3600 * 1000LL, changes);
+    discovery.recordDisconnected(readers[0].name, kLaunchMillis, changes);
+    discovery.updateVisible(visible, kLaunchMillis, changes);
+    DiscoveredReader candidate;
+    passed &= discovery.autoConnectCandidate(candidate) && candidate.name == readers[0].name;
+
+    discovery.recordConnected(readers.back().name, CardReaderModel::B250, kLaunchMillis, changes);
+    passed &= discovery.ranked().front().name == readers.back().name && discovery.ranked().front().connected;
+    passed &= !discovery.autoConnectCandidate(candidate);
+    discovery.recordDisconnected(readers.back().name, kLaunchMillis + 1000, changes);
+    passed &= discovery.ranked().front().name == readers.back().name && !discovery.ranked().front().connected;
+    passed &= discovery.autoConnectCandidate(candidate) && candidate.name == readers.back().name;
+
+    changes.clear();
+    discovery.endScan(kLaunchMillis + 2000, changes);
+    passed &= discovery.ranked().empty() && changes.size() == readers.size();
+
+    ::unlink(path.c_str());
+    ReaderDiscovery missing;
+    passed &= missing.load(path) == ErrorCode::NotFound;
+    passed &= discovery.save(path) == ErrorCode::None;
+    ReaderDiscovery restored;
+    passed &= restored.load(path) == ErrorCode::None && restored.knownReaders().size() == 2 &&
+              restored.knownReaders().front().name == readers.back().name &&
+              restored.knownReaders().front().connectCount == 1;
+
+    File file;
+    std::vector<std::uint8_t> bytes;
+    passed &= File::openForRead(path, file) == ErrorCode::None && file.readAll(bytes) == ErrorCode::None;
+    file.close();
+    bytes[bytes.size() / 2] ^= 0x10;
+    passed &= File::replace(path, bytes.data(), bytes.size()) == ErrorCode::None;
+    passed &= restored.load(path) == ErrorCode::InvalidArgument && restored.knownReaders().size() == 2;
+
+    // The known list stays bounded however many readers pass through.
+    ReaderDiscoveryConfig small;
+    small.maxKnownReaders = 4;
+    ReaderDiscovery bounded(small);
+    for (std::size_t i = 0; i < readers.size(); ++i) {
+        bounded.recordConnected(readers[i].name, CardReaderModel::B250, kLaunchMillis + static_cast<std::int64_t>(i), changes);
+    }
+    passed &= bounded.knownReaders().size() == std::min<std::size_t>(4, readers.size()) &&
+              bounded.knownReaders().front().name == readers.back().name;
+    return passed;
+}
+
+} // namespace
+
+bool runReaderDiscoveryScenario(const std::string &workDirectory, std::uint64_t readerCount) {
+    const std::vector<NearbyReader> readers = makeReaders(std::max<std::uint64_t>(readerCount, 2));
+    const std::string path = workDirectory + "/reader-discovery-scenario.readers";
+    bool passed = checkKnownReaders(path, readers);
+
+    // Last launch connected a reader that comes into range early; it is offered as soon as it is
+    // heard rather than once every reader has been.
+    std::vector<std::size_t> byArrival(readers.size());
+    for (std::size_t i = 0; i < readers.size(); ++i) {
+        byArrival[i] = i;
+    }
+    std::sort(byArrival.begin(), byArrival.end(), [&](std::size_t a, std::size_t b) {
+        return readers[a].arrivesAtMillis < readers[b].arrivesAtMillis;
+    });
+    const std::size_t lastUsed = byArrival[readers.size() / 4];
+    ReaderDiscovery previous;
+    std::vector<ReaderChange> ignored;
+    previous.recordConnected(readers[lastUsed].name, CardReaderModel::B250, kLaunchMillis - 2 * 3600 * 1000, ignored);
+    passed &= previous.save(path) == ErrorCode::None;
+
+    ReaderDiscovery discovery;
+    passed &= discovery.load(path) == ErrorCode::None;
+    ScanResult ranked = scan(discovery, readers);
+    passed &= ranked.consistent && ranked.order.size() == readers.size();
+    passed &= ranked.candidateAtMillis >= 0 && ranked.candidateAtMillis <= readers[lastUsed].arrivesAtMillis + kStepMillis;
+    passed &= !ranked.order.empty() && ranked.order.front() == readers[lastUsed].name;
+
+    // The same scan ranked on every raw reading, which is what sorting the SDK's list by signal gives.
+    ReaderDiscoveryConfig raw;
+    raw.signalStepDb = 1;
+    ReaderDiscovery jittery(raw);
+    ScanResult unsmoothed = scan(jittery, readers);
+    passed &= unsmoothed.consistent;
+    passed &= ranked.movesAfterSettling * 4 <= unsmoothed.movesAfterSettling || unsmoothed.movesAfterSettling == 0;
+
+    // Once settled, each reader after the last used one is within a signal step and the noise of
+    // the reader that would hold its place if signal were known exactly.
+    std::vector<int> strongest;
+    for (std::size_t i = 0; i < readers.size(); ++i) {
+        if (i != lastUsed) {
+            strongest.push_back(readers[i].signal);
+        }
+    }
+    std::sort(strongest.rbegin(), strongest.rend());
+    for (std::size_t rank = 1; rank < ranked.order.size() && rank < 6; ++rank) {
+        for (const NearbyReader &reader : readers) {
+            passed &= reader.name != ranked.order[rank] || reader.signal >= strongest[rank - 1] - 10;
+        }
+    }
+    ::unlink(path.c_str());
+
+    const double updates = ranked.updates > 0 ? static_cast<double>(ranked.updates) : 1.0;
+    std::printf("discovery     %zu readers: last used offered at %lld ms, scan settles at %lld ms; "
+                "%llu changes vs %llu rows reloaded\n",
+                readers.size(), static_cast<long long>(ranked.candidateAtMillis),
+                static_cast<long long>(ranked.settledAtMillis), static_cast<unsigned long long>(ranked.changes),
+                static_cast<unsigned long long>(ranked.reloadedRows));
+    std::printf("discovery     moves once settled %llu (%llu ranking every reading), %.2f us per update, %s\n",
+                static_cast<unsigned long long>(ranked.movesAfterSettling),
+                static_cast<unsigned long long>(unsmoothed.movesAfterSettling),
+                static_cast<double>(ranked.nanos) / updates / 1e3, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,399 @@
+//
+//  ReaderEventBusScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/ReaderEventBus.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+constexpr ReaderEventMask kMonitorEvents = readerEventBit(CardReaderEvent::Connected) |
+                                           readerEventBit(CardReaderEvent::Disconnected) |
+                                           readerEventBit(CardReaderEvent::ConnectionErrored) |
+                                           readerEventBit(CardReaderEvent::FatalError);
+
+// Cost of one UI update, paid per delivered event.
+constexpr Nanos kUiUpdateNanos = 2000;
+
+// Four in five events are battery updates, as a reader reports them while a card is in.
+CardReaderEvent eventFor(std::uint64_t reader, std::uint64_t index) {
+    static const CardReaderEvent kOthers[] = {
+        CardReaderEvent::CardInserted, CardReaderEvent::CardRemoved, CardReaderEvent::CardSwiped,
+        CardReaderEvent::CardTapped, CardReaderEvent::Connected, CardReaderEvent::Disconnected,
+        CardReaderEvent::Connecting,
+    };
+    const std::uint64_t roll = mix64((reader << 32) | index);
+    if (unitInterval(roll) < 0.8) {
+        return CardReaderEvent::BatteryStatusUpdated;
+    }
+    return kOthers[(roll >> 16) % (sizeof(kOthers) / sizeof(kOthers[0]))];
+}
+
+void spinFor(Nanos nanos) {
+    const Nanos start = monotonicNanos();
+    while (monotonicNanos() - start < nanos) {
+    }
+}
+
+// What one subscriber saw of each reader.
+struct ReaderView {
+    std::int64_t lastDetail = -1;
+    std::int64_t lastBattery = -1;
+    std::uint64_t events = 0;
+    std::uint64_t outOfOrder = 0;
+};
+
+// Runs a subscriber's drains on its own thread, as its dispatch queue would.
+class Subscriber {
+public:
+    Subscriber(ReaderEventBus &bus, ReaderEventSubscription subscription, unsigned readers, Nanos costPerEvent,
+               std::chrono::microseconds pause)
+        : _bus(bus), _id(bus.subscribe(subscription)), _views(readers), _costPerEvent(costPerEvent), _pause(pause) {}
+
+    void start() {
+        _thread = std::thread([this] {
+            while (_running.load()) {
+                drain();
+                std::this_thread::sleep_for(_pause);
+            }
+        });
+    }
+
+    void stop() {
+        _running = false;
+        _thread.join();
+        drain();
+    }
+
+    void drain() {
+        _bus.drain(_id, [this](const ReaderEventMessage *events, std::size_t count, std::uint64_t missed) {
+            _missed += missed;
+            ++_deliveries;
+            for (std::size_t i = 0; i < count; ++i) {
+                spinFor(_costPerEvent);
+                const ReaderEventMessage &event = events[i];
+                if (event.reader == 0 || event.reader > _views.size()) {
+                    ++_unexpected;
+                    continue;
+                }
+                ReaderView &view = _views[event.reader - 1];
+                ++view.events;
+                _masks |= readerEventBit(event.event);
+                if (event.event == CardReaderEvent::BatteryStatusUpdated) {
+                    view.lastBattery = event.detail;
+                }
+                view.outOfOrder += event.detail <= view.lastDetail;
+                view.lastDetail = event.detail;
+            }
+        });
+    }
+
+    ReaderEventBus::SubscriberId id() const { return _id; }
+    const std::vector<ReaderView> &views() const { return _views; }
+    ReaderEventMask masks() const { return _masks; }
+    std::uint64_t missed() const { return _missed; }
+    std::uint64_t deliveries() const { return _deliveries; }
+    std::uint64_t unexpected() const { return _unexpected; }
+
+private:
+    ReaderEventBus &_bus;
+    const ReaderEventBus::SubscriberId _id;
+    std::vector<ReaderView> _views;
+    const Nanos _costPerEvent;
+    const std::chrono::microseconds _pause;
+    std::atomic<bool> _running{true};
+    std::thread _thread;
+    ReaderEventMask _masks = 0;
+    std::uint64_t _missed = 0;
+    std::uint64_t _deliveries = 0;
+    std::uint64_t _unexpected = 0;
+};
+
+// What a producer got onto the bus.
+struct Published {
+    std::uint64_t accepted = 0;
+    std::uint64_t attempts = 0;
+    std::uint64_t rejected = 0;
+    std::uint64_t monitored = 0;
+    std::int64_t lastBattery = -1;
+    LatencyHistogram publishNanos;
+};
+
+bool checkPolicies() {
+    bool passed = true;
+
+    // Battery updates collapse to the newest per reader; card events around them are all kept.
+    ReaderEventBus bus;
+    ReaderEventSubscription uiSubscription;
+    const ReaderEventBus::SubscriberId ui = bus.subscribe(uiSubscription);
+    ReaderEventSubscription allSubscription;
+    allSubscription.coalesced = 0;
+    const ReaderEventBus::SubscriberId all = bus.subscribe(allSubscription);
+    for (std::int32_t level = 0; level < 50; ++level) {
+        bus.publish(CardReaderEvent::BatteryStatusUpdated, ReaderEventSource::Utilities, 1, level);
+        bus.publish(CardReaderEvent::BatteryStatusUpdated, ReaderEventSource::Utilities, 2, 100 + level);
+    }
+    bus.publish(CardReaderEvent::CardInserted, ReaderEventSource::Utilities, 1, 1);
+    bus.publish(CardReaderEvent::CardInserted, ReaderEventSource::Transaction, 1, 1);
+    bus.publish(CardReaderEvent::BatteryStatusUpdated, ReaderEventSource::Transaction, 1, 50);
+    std::vector<ReaderEventBus::SubscriberId> woken;
+    passed &= bus.dispatch(&woken) == 103 && woken.size() == 2;
+    std::vector<ReaderEventMessage> delivered;
+    auto collect = [&](const ReaderEventMessage *events, std::size_t count, std::uint64_t) {
+        delivered.assign(events, events + count);
+    };
+    bus.drain(ui, collect);
+    passed &= delivered.size() == 3 && delivered[0].reader == 2 && delivered[0].detail == 149 &&
+              delivered[1].event == CardReaderEvent::CardInserted && delivered[2].reader == 1 &&
+              delivered[2].detail == 50;
+    bus.drain(all, collect);
+    passed &= delivered.size() == 102 && bus.stats().duplicates == 1 && bus.subscriberStats(ui).coalesced == 99;
+
+    // Once delivered, the next update is held again rather than merged into the past.
+    bus.publish(CardReaderEvent::BatteryStatusUpdated, ReaderEventSource::Utilities, 1, 51);
+    woken.clear();
+    bus.dispatch(&woken);
+    passed &= woken.size() == 2 && bus.subscriberStats(ui).pending == 1;
+
+    // A full inbox drops for its subscriber only and reports how many were missed.
+    ReaderEventBus small;
+    ReaderEventSubscription oldest;
+    oldest.coalesced = 0;
+    oldest.capacity = 4;
+    ReaderEventSubscription newest = oldest;
+    newest.overflow = ReaderEventOverflow::DropNewest;
+    const ReaderEventBus::SubscriberId keepsNewest = small.subscribe(oldest);
+    const ReaderEventBus::SubscriberId keepsOldest = small.subscribe(newest);
+    for (std::int32_t i = 0; i < 10; ++i) {
+        small.publish(CardReaderEvent::CardSwiped, ReaderEventSource::Utilities, 1, i);
+    }
+    small.dispatch();
+    std::uint64_t missed = 0;
+    auto collectMissed = [&](const ReaderEventMessage *events, std::size_t count, std::uint64_t dropped) {
+        delivered.assign(events, events + count);
+        missed = dropped;
+    };
+    small.drain(keepsNewest, collectMissed);
+    passed &= delivered.size() == 4 && delivered.front().detail == 6 && missed == 6;
+    small.drain(keepsOldest, collectMissed);
+    passed &= delivered.size() == 4 && delivered.back().detail == 3 && missed == 6;
+
+    // Unsubscribing drops the inbox; the rest keep receiving.
+    small.unsubscribe(keepsNewest);
+    small.publish(CardReaderEvent::CardRemoved, ReaderEventSource::Utilities, 1, 10);
+    small.dispatch();
+    passed &= small.drain(keepsNewest, collectMissed) == 0 && small.drain(keepsOldest, collectMissed) == 1 &&
+              small.stats().subscribers == 1;
+
+    // A full queue rejects rather than waits, and takes events again once dispatched.
+    ReaderEventBusConfig tinyConfig;
+    tinyConfig.capacity = 8;
+    ReaderEventBus tiny(tinyConfig);
+    std::uint64_t accepted = 0;
+    for (std::int32_t i = 0; i < 10; ++i) {
+        accepted += tiny.publish(CardReaderEvent::CardTapped, ReaderEventSource::Utilities, 1, i);
+    }
+    passed &= accepted == 8 && tiny.stats().rejected == 2 && tiny.dispatch() == 8 &&
+              tiny.publish(CardReaderEvent::CardTapped, ReaderEventSource::Utilities, 1, 10);
+
+    // The same event outside the window, or with a different detail, is not a duplicate.
+    ReaderEventBus windowed;
+    ReaderEventMessage message;
+    message.event = CardReaderEvent::CardRemoved;
+    message.reader = 3;
+    message.timestamp = 1000;
+    windowed.publish(message);
+    message.source = ReaderEventSource::Transaction;
+    message.timestamp += ReaderEventBusConfig().duplicateWindowNanos + 1;
+    windowed.publish(message);
+    message.source = ReaderEventSource::Utilities;
+    message.detail = 7;
+    message.timestamp += 1;
+    windowed.publish(message);
+    windowed.dispatch();
+    passed &= windowed.stats().duplicates == 0 && windowed.stats().dispatched == 3;
+
+    passed &= readerEventId("B250-0042") == readerEventId("B250-0042") &&
+              readerEventId("B250-0042") != readerEventId("B250-0043");
+    return passed;
+}
+
+} // namespace
+
+bool runReaderEventBusScenario(std::uint64_t events, unsigned threads) {
+    bool passed = checkPolicies();
+
+    // One producer thread per reader, each event also reported on the transaction path unless it
+    // is a battery update, a dispatcher, and three subscribers: a slow UI, telemetry that wants
+    // everything and a monitor that wants connection changes.
+    ReaderEventBus bus;
+    ReaderEventSubscription uiSubscription;
+    uiSubscription.capacity = 64;
+    ReaderEventSubscription telemetrySubscription;
+    telemetrySubscription.coalesced = 0;
+    telemetrySubscription.capacity = static_cast<std::size_t>(events * threads * 2 + 1);
+    telemetrySubscription.overflow = ReaderEventOverflow::DropNewest;
+    ReaderEventSubscription monitorSubscription = telemetrySubscription;
+    monitorSubscription.events = kMonitorEvents;
+    Subscriber ui(bus, uiSubscription, threads, kUiUpdateNanos, std::chrono::microseconds(1000));
+    Subscriber telemetry(bus, telemetrySubscription, threads, 0, std::chrono::microseconds(100));
+    Subscriber monitor(bus, monitorSubscription, threads, 0, std::chrono::microseconds(500));
+    ui.start();
+    telemetry.start();
+    monitor.start();
+
+    std::atomic<bool> producing{true};
+    std::uint64_t wakeups = 0;
+    std::thread dispatcher([&] {
+        std::vector<ReaderEventBus::SubscriberId> woken;
+        while (producing.load()) {
+            woken.clear();
+            if (bus.dispatch(&woken) == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+            wakeups += woken.size();
+        }
+    });
+
+    std::vector<Published> published(threads);
+    std::vector<std::thread> producers;
+    for (unsigned t = 0; t < threads; ++t) {
+        producers.emplace_back([&, t] {
+            Published &mine = published[t];
+            const std::uint32_t reader = t + 1;
+            for (std::uint64_t i = 0; i < events; ++i) {
+                const CardReaderEvent event = eventFor(reader, i);
+                bool accepted = false;
+                for (int copy = 0; copy < (event == CardReaderEvent::BatteryStatusUpdated ? 1 : 2); ++copy) {
+                    const ReaderEventSource source = copy == 0 ? ReaderEventSource::Utilities
+                                                               : ReaderEventSource::Transaction;
+                    const Nanos start = monotonicNanos();
+                    const bool ok = bus.publish(event, source, reader, static_cast<std::int32_t>(i));
+                    mine.publishNanos.record(monotonicNanos() - start);
+                    ++mine.attempts;
+                    mine.rejected += !ok;
+                    accepted |= ok;
+                }
+                if (accepted) {
+                    ++mine.accepted;
+                    mine.monitored += (kMonitorEvents & readerEventBit(event)) != 0;
+                    if (event == CardReaderEvent::BatteryStatusUpdated) {
+                        mine.lastBattery = static_cast<std::int64_t>(i);
+                    }
+                }
+                if (i % 64 == 63) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+            }
+        });
+    }
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+    producing = false;
+    dispatcher.join();
+    while (bus.dispatch() > 0) {
+    }
+    ui.stop();
+    telemetry.stop();
+    monitor.stop();
+
+    // Every accepted event reaches telemetry once and in order; the monitor gets exactly its kinds.
+    const ReaderEventBusStats stats = bus.stats();
+    LatencyHistogram publishNanos;
+    std::uint64_t attempts = 0;
+    std::uint64_t rejected = 0;
+    std::uint64_t accepted = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+        const Published &mine = published[t];
+        publishNanos.merge(mine.publishNanos);
+        attempts += mine.attempts;
+        rejected += mine.rejected;
+        accepted += mine.accepted;
+        const ReaderView &seen = telemetry.views()[t];
+        passed &= seen.events == mine.accepted && seen.outOfOrder == 0 && seen.lastBattery == mine.lastBattery;
+        passed &= monitor.views()[t].events == mine.monitored;
+        // Merged updates still leave the UI on the reader's latest battery level; only a drop can lose it.
+        passed &= (ui.views()[t].lastBattery == mine.lastBattery || ui.missed() > 0) && ui.views()[t].outOfOrder == 0;
+    }
+    passed &= stats.published + stats.rejected == attempts && stats.rejected == rejected &&
+              stats.dispatched == stats.published && stats.dispatched - stats.duplicates == accepted;
+    passed &= telemetry.missed() == 0 && (monitor.masks() & ~kMonitorEvents) == 0 &&
+              ui.unexpected() + telemetry.unexpected() + monitor.unexpected() == 0;
+    const ReaderSubscriberStats uiStats = bus.subscriberStats(ui.id());
+    passed &= uiStats.delivered + uiStats.coalesced + uiStats.overflowed == accepted && uiStats.pending == 0 &&
+              ui.missed() == uiStats.overflowed;
+
+    // The delegate path today: the reader's thread hands each event to every subscriber in turn,
+    // so it waits out the UI's update every time.
+    std::mutex delegateLock;
+    std::vector<ReaderEventMessage> telemetryLog;
+    telemetryLog.reserve(static_cast<std::size_t>(events * threads));
+    LatencyHistogram delegateNanos;
+    std::vector<std::thread> delegators;
+    std::vector<LatencyHistogram> delegatorNanos(threads);
+    for (unsigned t = 0; t < threads; ++t) {
+        delegators.emplace_back([&, t] {
+            const std::uint32_t reader = t + 1;
+            for (std::uint64_t i = 0; i < events; ++i) {
+                ReaderEventMessage message;
+                message.event = eventFor(reader, i);
+                message.reader = reader;
+                message.detail = static_cast<std::int32_t>(i);
+                const Nanos start = monotonicNanos();
+                {
+                    std::lock_guard<std::mutex> guard(delegateLock);
+                    spinFor(kUiUpdateNanos);
+                    telemetryLog.push_back(message);
+                }
+                delegatorNanos[t].record(monotonicNanos() - start);
+                if (i % 64 == 63) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                }
+            }
+        });
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+        delegators[t].join();
+        delegateNanos.merge(delegatorNanos[t]);
+    }
+    passed &= telemetryLog.size() == events * threads;
+
+    std::printf("event bus     %u readers x %llu events, publish p50 %.2f us p99 %.2f us "
+                "(synchronous delegates p50 %.2f us p99 %.2f us), UI updates %llu of %llu "
+                "(%llu coalesced, %llu dropped), %llu duplicates, %llu rejected, %llu wakeups, %s\n",
+                threads,
+                static_cast<unsigned long long>(events),
+                publishNanos.percentile(50) / 1e3,
+                publishNanos.percentile(99) / 1e3,
+                delegateNanos.percentile(50) / 1e3,
+                delegateNanos.percentile(99) / 1e3,
+                static_cast<unsigned long long>(uiStats.delivered),
+                static_cast<unsigned long long>(accepted),
+                static_cast<unsigned long long>(uiStats.coalesced),
+                static_cast<unsigned long long>(uiStats.overflowed),
+                static_cast<unsigned long long>(stats.duplicates),
+                static_cast<unsigned long long>(stats.rejected),
+                static_cast<unsigned long long>(wakeups),
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,262 @@
+//
+//  ReaderLanesScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/ReaderLanes.hpp"
+#include "Scenarios.hpp"
+#include "SimulatedReader.hpp"
+#include "TransactionDriver.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+const Nanos kMillisecond = 1000000;
+
+const CardReaderModel kModels[] = {CardReaderModel::B250, CardReaderModel::B200, CardReaderModel::A250};
+
+const CardInputMethod kMethods[] = {CardInputMethod::Swipe, CardInputMethod::Dip, CardInputMethod::QuickChip};
+
+double micros(Nanos value) {
+    return static_cast<double>(value) / 1000.0;
+}
+
+std::string readerName(unsigned lane) {
+    return "CF-" + std::to_string(1000 + lane);
+}
+
+CardReaderModel modelFor(unsigned lane) {
+    return kModels[lane % (sizeof(kModels) / sizeof(kModels[0]))];
+}
+
+TransactionPlan planFor(std::uint64_t index, Nanos readerStepDelay) {
+    const std::uint64_t roll = mix64(index);
+    TransactionPlan plan;
+    plan.cardInputMethod = kMethods[roll % (sizeof(kMethods) / sizeof(kMethods[0]))];
+    plan.amountMinor = 100 + static_cast<std::int64_t>((roll >> 8) % 50000);
+    plan.readerStepDelay = readerStepDelay;
+    return plan;
+}
+
+bool succeeded(const TransactionOutcome &outcome) {
+    return outcome.error == ErrorCode::None && TransactionStateMachine::isTerminal(outcome.finalState);
+}
+
+// Routes a reader's events to its lane by name, the way the shim routes delegate callbacks.
+class LaneRouter : public SimulatedReader::Listener {
+public:
+    LaneRouter(const ReaderLanes &lanes, std::string readerName) : _lanes(lanes), _readerName(std::move(readerName)) {}
+
+    void readerDidReceiveEvent(CardReaderEvent event) override {
+        const std::shared_ptr<ReaderLane> lane = _lanes.find(_readerName);
+        if (lane != nullptr) {
+            lane->recordReaderEvent(event);
+        } else {
+            ++unrouted;
+        }
+    }
+
+    std::uint64_t unrouted = 0;
+
+private:
+    const ReaderLanes &_lanes;
+    const std::string _readerName;
+};
+
+// Claims, limits and hand-over of readers between lanes.
+bool checkRegistry() {
+    ReaderLanesConfig config;
+    config.maxLanes = 2;
+    ReaderLanes registry(config);
+
+    std::shared_ptr<ReaderLane> first;
+    std::shared_ptr<ReaderLane> second;
+    std::shared_ptr<ReaderLane> rejected;
+    bool passed = registry.open(readerName(0), CardReaderModel::B250, first) == ErrorCode::None;
+    passed &= registry.open(readerName(0), CardReaderModel::B250, rejected) == ErrorCode::InvalidArgument;
+    passed &= registry.open("", CardReaderModel::B250, rejected) == ErrorCode::InvalidArgument;
+    passed &= registry.open(readerName(1), CardReaderModel::B200, second) == ErrorCode::None;
+    passed &= registry.open(readerName(2), CardReaderModel::A250, rejected) == ErrorCode::CapacityExceeded;
+    passed &= rejected == nullptr && first->id() != second->id() && registry.size() == 2;
+    if (!passed) {
+        return false;
+    }
+
+    // One transaction at a time per lane, and a busy lane keeps its reader.
+    passed &= first->begin() == ErrorCode::None && first->begin() == ErrorCode::IllegalTransition;
+    passed &= registry.close(first->id()) == ErrorCode::IllegalTransition;
+    passed &= first->updateState(TransactionState::PendingCardInput) == ErrorCode::None;
+    passed &= first->updateState(TransactionState::Processing) == ErrorCode::IllegalTransition;
+    passed &= first->updateState(TransactionState::Completed) == ErrorCode::None;
+    passed &= !first->isBusy() && first->transactions() == 1 && first->transactionTimes().count() == 1;
+    passed &= first->updateState(TransactionState::PendingCardInput) == ErrorCode::IllegalTransition;
+    passed &= !second->isBusy() && second->transactions() == 0;
+
+    // An abandoned transaction is not timed.
+    passed &= second->begin() == ErrorCode::None;
+    second->abandon();
+    passed &= !second->isBusy() && second->transactions() == 0;
+
+    // Reader events reach only the lane of the reader that sent them.
+    LaneRouter router(registry, readerName(1));
+    const std::vector<ReaderStep> connection = SimulatedReader::connectionScript(CardReaderModel::B200, 0);
+    SimulatedReader(CardReaderModel::B200).play(connection, router);
+    passed &= second->readerEvents() == connection.size() && first->readerEvents() == 0 && router.unrouted == 0;
+
+    // Closing hands the reader to the next lane that asks for it.
+    const LaneId closed = first->id();
+    passed &= registry.close(closed) == ErrorCode::None && registry.close(closed) == ErrorCode::NotFound;
+    passed &= registry.find(readerName(0)) == nullptr && registry.lane(closed) == nullptr;
+    passed &= registry.open(readerName(2), CardReaderModel::A250, rejected) == ErrorCode::None;
+    passed &= registry.open(readerName(0), CardReaderModel::B250, first) == ErrorCode::CapacityExceeded;
+    passed &= registry.close(second->id()) == ErrorCode::None;
+    passed &= registry.open(readerName(0), CardReaderModel::B250, first) == ErrorCode::None;
+    passed &= first->id() != closed && registry.find(readerName(0)) == first && registry.lane(first->id()) == first;
+    return passed;
+}
+
+struct LanesRun {
+    LatencyHistogram transactionTimes;
+    std::vector<std::uint64_t> completed;
+    std::uint64_t failures = 0;
+    Nanos elapsed = 0;
+};
+
+// Each lane on a thread of its own with its own reader, as a checkout with several terminals runs.
+LanesRun runLanes(MockGateway &gateway, unsigned lanes, std::uint64_t transactions, Nanos readerStepDelay) {
+    ReaderLanesConfig config;
+    config.maxLanes = lanes;
+    ReaderLanes registry(config);
+    std::vector<std::shared_ptr<ReaderLane>> opened(lanes);
+    LanesRun run;
+    run.completed.assign(lanes, 0);
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        if (registry.open(readerName(lane), modelFor(lane), opened[lane]) != ErrorCode::None) {
+            ++run.failures;
+            return run;
+        }
+    }
+
+    std::vector<std::uint64_t> failures(lanes, 0);
+    std::vector<std::thread> workers;
+    const Nanos start = monotonicNanos();
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        workers.emplace_back([&, lane] {
+            ReaderLane &owned = *opened[lane];
+            SimulatedReader reader(owned.model());
+            TransactionDriver driver(reader, gateway, &owned);
+            LaneRouter router(registry, owned.readerName());
+            reader.play(SimulatedReader::connectionScript(owned.model(), 0), router);
+            for (std::uint64_t i = 0; i < transactions; ++i) {
+                failures[lane] += !succeeded(driver.run(planFor(lane * transactions + i, readerStepDelay)));
+            }
+        });
+    }
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        workers[lane].join();
+        run.transactionTimes.merge(opened[lane]->transactionTimes());
+        run.completed[lane] = opened[lane]->transactions();
+        run.failures += failures[lane];
+    }
+    run.elapsed = monotonicNanos() - start;
+
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        run.failures += registry.close(opened[lane]->id()) != ErrorCode::None;
+    }
+    return run;
+}
+
+// The same readers behind one shared session: each transaction waits for the one before it.
+LanesRun runShared(MockGateway &gateway, unsigned lanes, std::uint64_t transactions, Nanos readerStepDelay) {
+    std::mutex session;
+    std::vector<LatencyHistogram> times(lanes);
+    std::vector<std::uint64_t> failures(lanes, 0);
+    LanesRun run;
+    run.completed.assign(lanes, 0);
+    std::vector<std::thread> workers;
+    const Nanos start = monotonicNanos();
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        workers.emplace_back([&, lane] {
+            SimulatedReader reader(modelFor(lane));
+            TransactionDriver driver(reader, gateway, nullptr);
+            for (std::uint64_t i = 0; i < transactions; ++i) {
+                const Nanos began = monotonicNanos();
+                std::lock_guard<std::mutex> guard(session);
+                failures[lane] += !succeeded(driver.run(planFor(lane * transactions + i, readerStepDelay)));
+                times[lane].record(monotonicNanos() - began);
+                ++run.completed[lane];
+            }
+        });
+    }
+    for (unsigned lane = 0; lane < lanes; ++lane) {
+        workers[lane].join();
+        run.transactionTimes.merge(times[lane]);
+        run.failures += failures[lane];
+    }
+    run.elapsed = monotonicNanos() - start;
+    return run;
+}
+
+double perSecond(std::uint64_t count, Nanos elapsed) {
+    return elapsed == 0 ? 0.0 : static_cast<double>(count) * 1e9 / static_cast<double>(elapsed);
+}
+
+} // namespace
+
+bool runReaderLanesScenario(MockGateway &gateway, std::uint64_t transactions, unsigned lanes, Nanos readerStepDelay) {
+    const bool registry = checkRegistry();
+
+    const LanesRun solo = runLanes(gateway, 1, transactions, readerStepDelay);
+    const LanesRun laned = runLanes(gateway, lanes, transactions, readerStepDelay);
+    const LanesRun shared = runShared(gateway, lanes, transactions, readerStepDelay);
+
+    bool everyLane = laned.completed.size() == lanes;
+    for (std::uint64_t completed : laned.completed) {
+        everyLane &= completed == transactions;
+    }
+    // A lane runs about as fast beside others as alone; sleeps dominate, so this holds on one core.
+    const Nanos soloP50 = solo.transactionTimes.percentile(50);
+    const Nanos lanedP50 = laned.transactionTimes.percentile(50);
+    const bool isolated = lanedP50 <= 2 * soloP50 + kMillisecond;
+    const bool fasterThanShared = lanes < 2 || transactions == 0 ||
+                                  lanedP50 < shared.transactionTimes.percentile(50);
+    const bool passed = registry && everyLane && isolated && fasterThanShared &&
+                        solo.failures == 0 && laned.failures == 0 && shared.failures == 0;
+
+    const std::uint64_t total = transactions * lanes;
+    std::printf("lanes         %u lanes x %llu transactions, p50 %.1f us alone, %.1f us per lane, %.1f us through one session, %s\n",
+                lanes,
+                static_cast<unsigned long long>(transactions),
+                micros(soloP50),
+                micros(lanedP50),
+                micros(shared.transactionTimes.percentile(50)),
+                passed ? "ok" : "FAILED");
+    std::printf("  %-8s %12s %10s %10s %12s\n", "run", "transactions", "p50(us)", "p99(us)", "per second");
+    std::printf("  %-8s %12llu %10.1f %10.1f %12.1f\n", "alone",
+                static_cast<unsigned long long>(transactions), micros(soloP50),
+                micros(solo.transactionTimes.percentile(99)), perSecond(transactions, solo.elapsed));
+    std::printf("  %-8s %12llu %10.1f %10.1f %12.1f\n", "lanes",
+                static_cast<unsigned long long>(total), micros(lanedP50),
+                micros(laned.transactionTimes.percentile(99)), perSecond(total, laned.elapsed));
+    std::printf("  %-8s %12llu %10.1f %10.1f %12.1f\n", "shared",
+                static_cast<unsigned long long>(total), micros(shared.transactionTimes.percentile(50)),
+                micros(shared.transactionTimes.percentile(99)), perSecond(total, shared.elapsed));
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
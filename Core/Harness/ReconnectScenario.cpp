@@ -0,0 +1,339 @@
+//
+//  ReconnectScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "cft/ReaderConnection.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// Selecting a known reader directly, against the scan an app without one runs first to find it.
+const std::int64_t kScanMillis = 3000;
+const std::int64_t kHeartbeatAnswerMillis = 40;
+
+struct LinkProfile {
+    CardReaderModel model;
+    std::int64_t connectMillis;
+    std::int64_t connectJitterMillis;
+    double connectSuccess;
+};
+
+const LinkProfile kProfiles[] = {
+    {CardReaderModel::B250, 550, 350, 0.85},
+    {CardReaderModel::B200, 900, 500, 0.75},
+};
+
+// A reader that drops every few minutes: mostly a radio glitch it is back from at once, sometimes
+// a walk out of range. A third of the drops are silent, with no disconnect event from the SDK, and
+// half of the heartbeats sent to a silently dropped reader are never answered at all.
+struct SimulatedLink {
+    const LinkProfile *profile = nullptr;
+    std::uint64_t seed = 0;
+    bool up = false;
+    std::int64_t availableAtMillis = 0;
+    std::int64_t connectDoneAtMillis = -1;
+    std::int64_t heartbeatAtMillis = -1;
+    std::uint32_t failuresSinceAvailable = 0;
+
+    std::uint64_t roll() { return mix64(++seed); }
+
+    std::int64_t outageMillis() {
+        const double pick = unitInterval(roll());
+        if (pick < 0.6) {
+            return 0;
+        }
+        if (pick < 0.9) {
+            return 1000 + static_cast<std::int64_t>(roll() % 9000);
+        }
+        return 30000 + static_cast<std::int64_t>(roll() % 90000);
+    }
+
+    std::int64_t connectMillis() {
+        return profile->connectMillis + static_cast<std::int64_t>(roll() % profile->connectJitterMillis);
+    }
+};
+
+struct DropRecord {
+    std::int64_t atMillis;
+    std::int64_t outageMillis;
+    bool silent;
+    std::int64_t detectedAfterMillis;
+    std::int64_t readyAfterMillis;
+};
+
+struct ModelResult {
+    bool passed = true;
+    std::vector<DropRecord> drops;
+    std::vector<std::int64_t> baselineMillis;
+    std::uint64_t heartbeats = 0;
+};
+
+// Carries out whatever the connection asks for until it has nothing more to do.
+void drive(ReaderConnection &connection, SimulatedLink &link, std::int64_t now, ModelResult &result) {
+    for (;;) {
+        switch (connection.poll(now)) {
+        case ReaderLinkAction::None:
+            return;
+        case ReaderLinkAction::Connect:
+            link.connectDoneAtMillis = now + link.connectMillis();
+            break;
+        case ReaderLinkAction::Heartbeat:
+            ++result.heartbeats;
+            link.heartbeatAtMillis = link.up || link.roll() % 2 == 0 ? now + kHeartbeatAnswerMillis : -1;
+            break;
+        case ReaderLinkAction::Disconnect:
+            link.up = false;
+            link.connectDoneAtMillis = -1;
+            link.heartbeatAtMillis = -1;
+            break;
+        }
+    }
+}
+
+ModelResult runModel(const LinkProfile &profile, std::uint64_t drops, const ReaderConnectionConfig &config) {
+    ModelResult result;
+    ReaderConnection connection(config);
+    SimulatedLink link;
+    link.profile = &profile;
+    link.seed = static_cast<std::uint64_t>(profile.model) * 1000003;
+
+    std::int64_t now = 0;
+    std::int64_t nextDropAt = 60000;
+    bool awaitingDetection = false;
+    bool awaitingReady = false;
+    connection.connect("reader", profile.model, now);
+    drive(connection, link, now, result);
+
+    const std::int64_t detectBound = config.heartbeatIntervalMillis +
+                                     config.heartbeatTimeoutMillis * std::max<std::uint32_t>(config.maxMissedHeartbeats, 1);
+    while (result.drops.size() < drops || awaitingReady) {
+        std::int64_t next = nextDropAt;
+        const std::int64_t deadline = connection.nextDeadlineMillis();
+        if (deadline >= 0) {
+            next = std::min(next, std::max(deadline, now));
+        }
+        if (link.connectDoneAtMillis >= 0) {
+            next = std::min(next, link.connectDoneAtMillis);
+        }
+        if (link.heartbeatAtMillis >= 0) {
+            next = std::min(next, link.heartbeatAtMillis);
+        }
+        now = next;
+
+        if (now == link.connectDoneAtMillis) {
+            link.connectDoneAtMillis = -1;
+            if (now >= link.availableAtMillis && unitInterval(link.roll()) < profile.connectSuccess) {
+                link.up = true;
+                connection.connected("reader", profile.model, now);
+            } else {
+                link.failuresSinceAvailable += now >= link.availableAtMillis ? 1 : 0;
+                connection.connectFailed(now);
+            }
+        }
+        if (now == link.heartbeatAtMillis) {
+            link.heartbeatAtMillis = -1;
+            connection.heartbeatAnswered(link.up, now);
+        }
+        if (now == nextDropAt) {
+            nextDropAt = now + 60000 + static_cast<std::int64_t>(link.roll() % 540000);
+            if (link.up && !awaitingReady && result.drops.size() < drops) {
+                link.up = false;
+                const std::int64_t outage = link.outageMillis();
+                link.availableAtMillis = now + outage;
+                link.failuresSinceAvailable = 0;
+                const bool silent = link.roll() % 3 == 0;
+                result.drops.push_back({now, outage, silent, silent ? -1 : 0, -1});
+                awaitingDetection = silent;
+                awaitingReady = true;
+                if (!silent) {
+                    connection.disconnected(now);
+                }
+
+                // Without the manager: the app rescans and reconnects once it hears of the drop,
+                // which for a silent drop is the next transaction, a few minutes later on average.
+                const std::int64_t noticed = silent ? 30000 + static_cast<std::int64_t>(link.roll() % 270000) : 0;
+                result.baselineMillis.push_back(std::max(noticed, outage) + kScanMillis + link.connectMillis());
+            }
+        }
+
+        drive(connection, link, now, result);
+
+        if (awaitingReady) {
+            DropRecord &drop = result.drops.back();
+            if (awaitingDetection && connection.state() != ReaderLinkState::Ready) {
+                drop.detectedAfterMillis = now - drop.atMillis;
+                awaitingDetection = false;
+                result.passed &= drop.detectedAfterMillis <= detectBound;
+            }
+            if (!awaitingDetection && connection.state() == ReaderLinkState::Ready) {
+                drop.readyAfterMillis = now - drop.atMillis;
+                awaitingReady = false;
+                // Once the reader is back, each attempt waits at most one full backoff step.
+                const std::int64_t attempts = 1 + link.failuresSinceAvailable;
+                result.passed &= drop.readyAfterMillis <= drop.detectedAfterMillis + drop.outageMillis +
+                                                              attempts * (config.maxRetryDelayMillis + config.connectTimeoutMillis);
+            }
+        }
+    }
+
+    std::uint64_t readies = 0;
+    for (const DropRecord &drop : result.drops) {
+        readies += drop.readyAfterMillis >= 0 ? 1 : 0;
+    }
+    result.passed &= connection.timeToReady(profile.model, false).count() == 1;
+    result.passed &= connection.timeToReady(profile.model, true).count() == readies && readies == drops;
+    return result;
+}
+
+std::int64_t percentileMillis(std::vector<std::int64_t> values, double percentile) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const std::size_t index = static_cast<std::size_t>(percentile / 100 * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+// Backoff doubles and caps, an idle reader is let go and woken by activity, a connection made from
+// a scan is adopted, and giving the reader up stops every action.
+bool checkPolicy() {
+    bool passed = true;
+    ReaderConnectionConfig config;
+    config.baseRetryDelayMillis = 100;
+    config.maxRetryDelayMillis = 1000;
+    config.idleDisconnectMillis = 60000;
+    ReaderConnection connection(config);
+
+    connection.connect("reader", CardReaderModel::B250, 0);
+    std::int64_t now = 0;
+    const std::int64_t expected[] = {100, 200, 400, 800, 1000, 1000};
+    for (std::int64_t delay : expected) {
+        passed &= connection.poll(now) == ReaderLinkAction::Connect;
+        connection.connectFailed(now);
+        passed &= connection.state() == ReaderLinkState::Waiting && connection.nextDeadlineMillis() == now + delay;
+        passed &= connection.poll(now + delay - 1) == ReaderLinkAction::None;
+        now += delay;
+    }
+    passed &= connection.poll(now) == ReaderLinkAction::Connect && connection.attempts() == 6;
+    passed &= connection.poll(now + config.connectTimeoutMillis) == ReaderLinkAction::Disconnect &&
+              connection.state() == ReaderLinkState::Waiting;
+    now += config.connectTimeoutMillis + config.maxRetryDelayMillis;
+    passed &= connection.poll(now) == ReaderLinkAction::Connect;
+    connection.connected("reader", CardReaderModel::B250, now);
+    passed &= connection.attempts() == 0 && connection.timeToReady(CardReaderModel::B250, false).count() == 1;
+
+    passed &= connection.poll(now + config.heartbeatIntervalMillis) == ReaderLinkAction::Heartbeat;
+    connection.heartbeatAnswered(true, now + config.heartbeatIntervalMillis + 10);
+    connection.activity(now + 50000);
+    passed &= connection.poll(now + 100000) == ReaderLinkAction::Heartbeat;
+    connection.heartbeatAnswered(true, now + 100010);
+    passed &= connection.poll(now + 110000) == ReaderLinkAction::Disconnect &&
+              connection.state() == ReaderLinkState::Suspended && connection.nextDeadlineMillis() < 0;
+    connection.disconnected(now + 110100);
+    passed &= connection.state() == ReaderLinkState::Suspended;
+    connection.activity(now + 200000);
+    passed &= connection.poll(now + 200000) == ReaderLinkAction::Connect;
+    connection.connected("reader", CardReaderModel::B250, now + 200700);
+    passed &= connection.timeToReady(CardReaderModel::B250, true).count() == 1 &&
+              connection.timeToReady(CardReaderModel::B250, true).max() / 1000000 == 700;
+
+    connection.connected("other", CardReaderModel::B200, now + 300000);
+    passed &= connection.readerName() == "other" && connection.model() == CardReaderModel::B200;
+    passed &= connection.timeToReady(CardReaderModel::B200, false).count() == 0;
+
+    connection.disconnect();
+    connection.disconnected(now + 300100);
+    passed &= connection.state() == ReaderLinkState::Idle && connection.poll(now + 900000) == ReaderLinkAction::None &&
+              connection.nextDeadlineMillis() < 0;
+    return passed;
+}
+
+// Activity forgets missed heartbeats, and a transaction pauses heartbeats and is never cut off by
+// a disconnect, not even when the reader drops and its reconnect times out.
+bool checkTransactionPause() {
+    bool passed = true;
+    ReaderConnectionConfig config;
+    config.idleDisconnectMillis = 60000;
+    ReaderConnection connection(config);
+    connection.connect("reader", CardReaderModel::B250, 0);
+    passed &= connection.poll(0) == ReaderLinkAction::Connect;
+    connection.connected("reader", CardReaderModel::B250, 0);
+
+    const std::int64_t interval = config.heartbeatIntervalMillis;
+    const std::int64_t timeout = config.heartbeatTimeoutMillis;
+    passed &= connection.poll(interval) == ReaderLinkAction::Heartbeat;
+    passed &= connection.poll(interval + timeout) == ReaderLinkAction::Heartbeat;
+    connection.activity(interval + timeout + 1);
+    passed &= connection.poll(interval + 2 * timeout) == ReaderLinkAction::Heartbeat;
+
+    std::int64_t now = interval + 2 * timeout + 1;
+    connection.setTransactionActive(true, now);
+    passed &= connection.isTransactionActive() && connection.nextDeadlineMillis() < 0;
+    passed &= connection.poll(now + 10 * config.idleDisconnectMillis) == ReaderLinkAction::None;
+    connection.heartbeatAnswered(false, now + 100);
+    passed &= connection.state() == ReaderLinkState::Ready;
+
+    now += 10 * config.idleDisconnectMillis;
+    connection.disconnected(now);
+    passed &= connection.poll(now) == ReaderLinkAction::Connect;
+    passed &= connection.poll(now + config.connectTimeoutMillis) == ReaderLinkAction::None &&
+              connection.state() == ReaderLinkState::Connecting;
+    now += config.connectTimeoutMillis + 500;
+    connection.connected("reader", CardReaderModel::B250, now);
+
+    now += 1000;
+    connection.setTransactionActive(false, now);
+    passed &= connection.nextDeadlineMillis() == now + interval && connection.poll(now) == ReaderLinkAction::None;
+    passed &= connection.poll(now + interval) == ReaderLinkAction::Heartbeat;
+    return passed;
+}
+
+} // namespace
+
+bool runReconnectScenario(std::uint64_t drops) {
+    bool passed = checkPolicy() && checkTransactionPause();
+    ReaderConnectionConfig config;
+
+    for (const LinkProfile &profile : kProfiles) {
+        ModelResult result = runModel(profile, drops, config);
+        passed &= result.passed;
+
+        std::vector<std::int64_t> ready;
+        std::vector<std::int64_t> readyAtOnce;
+        std::vector<std::int64_t> detected;
+        for (const DropRecord &drop : result.drops) {
+            ready.push_back(drop.readyAfterMillis);
+            if (drop.outageMillis == 0 && !drop.silent) {
+                readyAtOnce.push_back(drop.readyAfterMillis);
+            }
+            if (drop.silent) {
+                detected.push_back(drop.detectedAfterMillis);
+            }
+        }
+        std::printf("reconnect     %-5s %llu drops: ready again p50 %lld ms p99 %lld ms (p50 %lld ms without the "
+                    "manager), %lld ms p50 when the reader is back at once\n",
+                    cardReaderModelName(profile.model), static_cast<unsigned long long>(result.drops.size()),
+                    static_cast<long long>(percentileMillis(ready, 50)), static_cast<long long>(percentileMillis(ready, 99)),
+                    static_cast<long long>(percentileMillis(result.baselineMillis, 50)),
+                    static_cast<long long>(percentileMillis(readyAtOnce, 50)));
+        std::printf("reconnect     %-5s %zu silent drops found in p50 %lld ms max %lld ms, %llu heartbeats, %s\n",
+                    cardReaderModelName(profile.model), detected.size(), static_cast<long long>(percentileMillis(detected, 50)),
+                    static_cast<long long>(percentileMillis(detected, 100)), static_cast<unsigned long long>(result.heartbeats),
+                    result.passed ? "ok" : "FAILED");
+    }
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
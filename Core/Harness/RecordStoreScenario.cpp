@@ -0,0 +1,234 @@
+//
+//  RecordStoreScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Clock.hpp"
+#include "cft/TransactionRecordStore.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+StoredTransactionRecord syntheticRecord(std::uint64_t index) {
+    const std::uint64_t roll = mix64(index);
+    StoredTransactionRecord record{};
+    record.apiTransactionState = static_cast<std::uint8_t>(roll % kApiTransactionStateCount);
+    record.result = static_cast<std::uint8_t>(TransactionResult::Approved);
+    record.createdAtMillis = static_cast<std::int64_t>(1546300800000 + index * 1000 + (roll >> 8) % 1000);
+    record.transactedAtMillis = record.createdAtMillis + 1500;
+    record.amountMinor = static_cast<std::int64_t>(100 + (roll >> 16) % 100000);
+    record.updatedAtMillis = record.createdAtMillis;
+    record.cardBrand = static_cast<std::uint8_t>(CardBrand::Visa);
+
+    char text[kStoredTextCapacity];
+    std::snprintf(text, sizeof(text), "%04u", static_cast<unsigned>((roll >> 24) % 200));
+    StoredTransactionRecord::assign(record.lastFour, text);
+    std::snprintf(text, sizeof(text), "txn_%012llu", static_cast<unsigned long long>(index));
+    StoredTransactionRecord::assign(record.transactionId, text);
+    if ((roll >> 32) % 4 == 0) {
+        std::snprintf(text, sizeof(text), "order-%u", static_cast<unsigned>((roll >> 40) % 50));
+        StoredTransactionRecord::assign(record.referenceId, text);
+    }
+    return record;
+}
+
+// The same query answered by scanning every record.
+std::vector<std::string> bruteForce(const std::vector<StoredTransactionRecord> &records, const TransactionRecordQuery &query) {
+    std::vector<const StoredTransactionRecord *> matching;
+    for (const StoredTransactionRecord &record : records) {
+        if (record.createdAtMillis >= query.createdFromMillis && record.createdAtMillis < query.createdToMillis &&
+            (!query.matchState || record.state() == query.state) &&
+            (query.lastFour.empty() || record.lastFourText() == query.lastFour) &&
+            (query.referenceId.empty() || StoredTransactionRecord::text(record.referenceId) == query.referenceId)) {
+            matching.push_back(&record);
+        }
+    }
+    // Records are generated in createdAt order, so newest first is reverse order.
+    std::vector<std::string> ids;
+    for (auto it = matching.rbegin(); it != matching.rend() && ids.size() < query.limit; ++it) {
+        ids.push_back(StoredTransactionRecord::text((*it)->transactionId));
+    }
+    return ids;
+}
+
+std::vector<std::string> transactionIds(const std::vector<StoredTransactionRecord> &records) {
+    std::vector<std::string> ids;
+    for (const StoredTransactionRecord &record : records) {
+        ids.push_back(StoredTransactionRecord::text(record.transactionId));
+    }
+    return ids;
+}
+
+// A state change followed by a tip-only write is still reported from the state before the change.
+bool checkTipKeepsTransition(TransactionRecordStore &store, StoredTransactionRecord &record) {
+    const std::uint64_t cursor = store.cursor();
+    const ApiTransactionState before = record.state();
+    TransactionRecordDelta delta;
+    delta.transactionId = StoredTransactionRecord::text(record.transactionId);
+    delta.state = before == ApiTransactionState::Voided ? ApiTransactionState::Declined : ApiTransactionState::Voided;
+    delta.result = static_cast<TransactionResult>(record.result);
+    bool changed = false;
+    if (store.applyDelta(delta, changed) != ErrorCode::None || !changed ||
+        store.compareAndSetTip(delta.transactionId, record.tipMinor, record.tipMinor + 100, 0) != ErrorCode::None) {
+        return false;
+    }
+    record.apiTransactionState = static_cast<std::uint8_t>(delta.state);
+
+    std::uint64_t nextCursor = cursor;
+    const std::vector<StoredTransactionRecord> changes = store.changesSince(cursor, 64, nextCursor);
+    return changes.size() == 1 && changes[0].previousState() == before && changes[0].state() == delta.state &&
+           changes[0].tipMinor == record.tipMinor + 100;
+}
+
+} // namespace
+
+bool runRecordStoreScenario(const std::string &workDirectory, std::uint64_t items) {
+    const std::string path = workDirectory + "/record-store-scenario.store";
+    ::unlink(path.c_str());
+
+    TransactionRecordStoreConfig config;
+    config.maxRecords = static_cast<std::size_t>(items);
+
+    std::unique_ptr<TransactionRecordStore> store;
+    if (TransactionRecordStore::open(path, config, store) != ErrorCode::None) {
+        std::printf("records       could not open %s\n", path.c_str());
+        return false;
+    }
+
+    // One more generation than fits, so the oldest records are evicted.
+    const std::uint64_t written = items + items / 4;
+    std::vector<StoredTransactionRecord> live;
+    const Nanos putStart = monotonicNanos();
+    for (std::uint64_t index = 0; index < written; ++index) {
+        const StoredTransactionRecord record = syntheticRecord(index);
+        if (store->put(record) != ErrorCode::None) {
+            std::printf("records       put %llu failed\n", static_cast<unsigned long long>(index));
+            return false;
+        }
+        if (index >= written - items) {
+            live.push_back(record);
+        }
+    }
+    const Nanos putElapsed = monotonicNanos() - putStart;
+
+    // Patch a record in place: a state change must move it between state index keys.
+    StoredTransactionRecord patched = live.back();
+    patched.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Settled);
+    store->put(patched);
+    live.back() = patched;
+
+    // Close and reopen: the indexes are rebuilt from the mapped slots.
+    store.reset();
+    if (TransactionRecordStore::open(path, config, store) != ErrorCode::None || store->count() != live.size()) {
+        std::printf("records       reopened with %zu of %zu records\n", store ? store->count() : 0, live.size());
+        return false;
+    }
+
+    // Delta sync: patch the state of every third open record, page through the changes since
+    // the cursor, and expect exactly those records back with their previous state.
+    const std::uint64_t cursor = store->cursor();
+    std::vector<std::pair<std::string, ApiTransactionState>> transitions;
+    for (std::size_t i = 0; i < live.size(); i += 3) {
+        StoredTransactionRecord &record = live[i];
+        TransactionRecordDelta delta;
+        delta.transactionId = StoredTransactionRecord::text(record.transactionId);
+        delta.state = isFinalApiTransactionState(record.state()) ? record.state() : ApiTransactionState::Settled;
+        delta.result = static_cast<TransactionResult>(record.result);
+        bool changed = false;
+        if (store->applyDelta(delta, changed) != ErrorCode::None || changed == (delta.state == record.state())) {
+            std::printf("records       delta for %s misapplied\n", delta.transactionId.c_str());
+            return false;
+        }
+        if (changed) {
+            transitions.emplace_back(delta.transactionId, record.state());
+            record.apiTransactionState = static_cast<std::uint8_t>(delta.state);
+        }
+    }
+    std::vector<std::pair<std::string, ApiTransactionState>> reported;
+    std::uint64_t nextCursor = cursor;
+    for (std::vector<StoredTransactionRecord> page = store->changesSince(nextCursor, 64, nextCursor); !page.empty();
+         page = store->changesSince(nextCursor, 64, nextCursor)) {
+        for (const StoredTransactionRecord &record : page) {
+            reported.emplace_back(StoredTransactionRecord::text(record.transactionId), record.previousState());
+        }
+    }
+    bool consistent = reported == transitions && nextCursor == store->cursor();
+    consistent &= checkTipKeepsTransition(*store, live[1]);
+
+    std::vector<TransactionRecordQuery> queries;
+    const std::int64_t firstCreated = live.front().createdAtMillis;
+    const std::int64_t span = live.back().createdAtMillis - firstCreated;
+    for (unsigned i = 0; i < 64; ++i) {
+        TransactionRecordQuery query;
+        query.createdFromMillis = firstCreated + span * i / 128;
+        query.createdToMillis = query.createdFromMillis + span / 4;
+        switch (i % 4) {
+            case 0: break;
+            case 1: query.matchState = true; query.state = static_cast<ApiTransactionState>(i % kApiTransactionStateCount); break;
+            case 2: query.lastFour = live[i * 7 % live.size()].lastFourText(); break;
+            case 3: query.referenceId = "order-" + std::to_string(i % 50); break;
+        }
+        query.limit = i % 8 == 0 ? std::numeric_limits<std::size_t>::max() : 25;
+        queries.push_back(query);
+    }
+
+    std::size_t matched = 0;
+    for (const TransactionRecordQuery &query : queries) {
+        const std::vector<std::string> ids = transactionIds(store->query(query));
+        consistent &= ids == bruteForce(live, query);
+        matched += ids.size();
+    }
+
+    StoredTransactionRecord found{};
+    const bool evicted = !store->get(StoredTransactionRecord::text(syntheticRecord(0).transactionId), found);
+    consistent &= store->get(StoredTransactionRecord::text(patched.transactionId), found) &&
+                  found.state() == ApiTransactionState::Settled;
+
+    const std::uint64_t lookups = 100000;
+    const Nanos getStart = monotonicNanos();
+    for (std::uint64_t i = 0; i < lookups; ++i) {
+        consistent &= store->get(StoredTransactionRecord::text(live[mix64(i) % live.size()].transactionId), found);
+    }
+    const Nanos getElapsed = monotonicNanos() - getStart;
+
+    TransactionRecordQuery recentByCard;
+    recentByCard.lastFour = live.back().lastFourText();
+    recentByCard.limit = 10;
+    const unsigned queryRuns = 10000;
+    const Nanos queryStart = monotonicNanos();
+    for (unsigned i = 0; i < queryRuns; ++i) {
+        matched += store->query(recentByCard).empty() ? 0 : 1;
+    }
+    const Nanos queryElapsed = monotonicNanos() - queryStart;
+
+    store.reset();
+    ::unlink(path.c_str());
+
+    std::printf("records       %zu stored (%llu written, oldest evicted: %s), %zu transitions synced, %zu matched; "
+                "put %.2f us, get %.2f us, last-four query %.2f us\n",
+                live.size(),
+                static_cast<unsigned long long>(written),
+                evicted ? "yes" : "no",
+                transitions.size(),
+                matched,
+                static_cast<double>(putElapsed) / 1e3 / static_cast<double>(written),
+                static_cast<double>(getElapsed) / 1e3 / static_cast<double>(lookups),
+                static_cast<double>(queryElapsed) / 1e3 / queryRuns);
+    return consistent && evicted;
+}
+
+} // namespace harness
+} // namespace cft
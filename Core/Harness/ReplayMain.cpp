@@ -0,0 +1,377 @@
+//
+//  ReplayMain.cpp
+//  CardFlight
+//
+//  Replays a reproducible mix of transactions through the portable core and
+//  reports throughput and per-state latency.
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/StateLatencyRecorder.hpp"
+#include "MockGateway.hpp"
+#include "SimulatedReader.hpp"
+#include "Scenarios.hpp"
+#include "TransactionDriver.hpp"
+
+using namespace cft;
+using namespace cft::harness;
+
+namespace {
+
+struct Options {
+    std::uint64_t transactions = 10000;
+    unsigned threads = 0;
+    std::uint64_t seed = 1;
+    Nanos readerStepDelay = 0;
+    MockGatewayConfig gateway;
+    CardReaderModel model = CardReaderModel::B250;
+    std::uint64_t batchItems = 0;
+    unsigned batchConcurrency = 8;
+    std::uint64_t deferredItems = 0;
+    std::uint64_t records = 0;
+    std::uint64_t accountCacheCallers = 0;
+    std::uint64_t capabilityRows = 0;
+    std::uint64_t tlvResponses = 0;
+    std::uint64_t logRecords = 0;
+    std::uint64_t tracedTransactions = 0;
+    std::uint64_t benchTransactions = 0;
+    std::uint64_t preparedTransactions = 0;
+    std::uint64_t pooledRequests = 0;
+    std::uint64_t amounts = 0;
+    std::uint64_t settlementRecords = 0;
+    std::uint64_t adjustedTips = 0;
+    std::uint64_t signatures = 0;
+    std::uint64_t signatureUploads = 0;
+    std::uint64_t discoveredReaders = 0;
+    std::uint64_t readerDrops = 0;
+    std::uint64_t readerEvents = 0;
+    std::uint64_t laneTransactions = 0;
+    std::uint64_t binRanges = 0;
+    std::uint64_t cardSwipes = 0;
+    std::string benchBaseline;
+    double benchTolerance = 0.25;
+    std::string workDirectory = ".";
+};
+
+struct WorkerResult {
+    StateLatencyRecorder recorder;
+    std::uint64_t completed = 0;
+    std::uint64_t deferred = 0;
+    std::uint64_t failures = 0;
+};
+
+void printUsage(const char *program) {
+    std::fprintf(stderr,
+                 "usage: %s [--transactions N] [--threads N] [--seed N] [--model 0-9]\n"
+                 "          [--reader-delay-us N] [--gateway-latency-us N] [--decline-rate F]\n"
+                 "          [--batch N] [--batch-concurrency N] [--deferred N] [--records N]\n"
+                 "          [--account-cache N] [--capabilities N] [--tlv N] [--event-log N]\n"
+                 "          [--trace N] [--bench N] [--bench-baseline PATH] [--bench-tolerance F]\n"
+                 "          [--prepare N] [--pool N] [--amounts N] [--settlement N] [--adjust N]\n"
+                 "          [--signatures N] [--signature-uploads N] [--reader-discovery N]\n"
+                 "          [--reconnect N] [--reader-events N] [--lanes N] [--bin-table N]\n"
+                 "          [--card-data N] [--work-dir PATH]\n",
+                 program);
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *flag = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (std::strcmp(flag, "--transactions") == 0) {
+            options.transactions = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--threads") == 0) {
+            options.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(flag, "--seed") == 0) {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--model") == 0) {
+            options.model = static_cast<CardReaderModel>(std::atoi(value));
+        } else if (std::strcmp(flag, "--reader-delay-us") == 0) {
+            options.readerStepDelay = std::strtoull(value, nullptr, 10) * 1000;
+        } else if (std::strcmp(flag, "--gateway-latency-us") == 0) {
+            options.gateway.latency = std::strtoull(value, nullptr, 10) * 1000;
+        } else if (std::strcmp(flag, "--decline-rate") == 0) {
+            options.gateway.declineRate = std::atof(value);
+        } else if (std::strcmp(flag, "--batch") == 0) {
+            options.batchItems = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--batch-concurrency") == 0) {
+            options.batchConcurrency = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(flag, "--deferred") == 0) {
+            options.deferredItems = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--records") == 0) {
+            options.records = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--account-cache") == 0) {
+            options.accountCacheCallers = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--capabilities") == 0) {
+            options.capabilityRows = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--tlv") == 0) {
+            options.tlvResponses = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--event-log") == 0) {
+            options.logRecords = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--trace") == 0) {
+            options.tracedTransactions = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--bench") == 0) {
+            options.benchTransactions = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--bench-baseline") == 0) {
+            options.benchBaseline = value;
+        } else if (std::strcmp(flag, "--bench-tolerance") == 0) {
+            options.benchTolerance = std::atof(value);
+        } else if (std::strcmp(flag, "--prepare") == 0) {
+            options.preparedTransactions = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--pool") == 0) {
+            options.pooledRequests = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--amounts") == 0) {
+            options.amounts = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--settlement") == 0) {
+            options.settlementRecords = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--adjust") == 0) {
+            options.adjustedTips = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--signatures") == 0) {
+            options.signatures = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--signature-uploads") == 0) {
+            options.signatureUploads = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--reader-discovery") == 0) {
+            options.discoveredReaders = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--reconnect") == 0) {
+            options.readerDrops = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--reader-events") == 0) {
+            options.readerEvents = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--lanes") == 0) {
+            options.laneTransactions = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--bin-table") == 0) {
+            options.binRanges = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--card-data") == 0) {
+            options.cardSwipes = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(flag, "--work-dir") == 0) {
+            options.workDirectory = value;
+        } else {
+            return false;
+        }
+    }
+    options.gateway.seed = options.seed;
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return true;
+}
+
+TransactionPlan planFor(std::uint64_t index, const Options &options) {
+    static const CardInputMethod kMethods[] = {
+        CardInputMethod::Swipe, CardInputMethod::Dip, CardInputMethod::Tap,
+        CardInputMethod::QuickChip, CardInputMethod::SwipeFallback, CardInputMethod::Key,
+    };
+
+    const std::uint64_t roll = mix64(options.seed ^ mix64(index));
+    TransactionPlan plan;
+    plan.cardInputMethod = kMethods[roll % (sizeof(kMethods) / sizeof(kMethods[0]))];
+    plan.amountMinor = 100 + static_cast<std::int64_t>((roll >> 8) % 50000);
+    plan.isAdjustmentRequested = ((roll >> 24) % 4) == 0;
+    plan.readerStepDelay = options.readerStepDelay;
+
+    const std::uint64_t option = (roll >> 32) % 100;
+    if (option < 5) {
+        plan.processOption = ProcessOption::Defer;
+        plan.resumeDeferred = (option % 2) == 0;
+    } else if (option < 7) {
+        plan.processOption = ProcessOption::Cancel;
+    } else {
+        plan.processOption = ProcessOption::Process;
+        plan.type = ((roll >> 40) % 10) == 0 ? TransactionType::Authorization : TransactionType::Sale;
+    }
+    return plan;
+}
+
+void runWorker(unsigned worker, const Options &options, MockGateway &gateway, WorkerResult &result) {
+    SimulatedReader reader(options.model);
+    TransactionDriver driver(reader, gateway, &result.recorder);
+
+    for (std::uint64_t index = worker; index < options.transactions; index += options.threads) {
+        const TransactionOutcome outcome = driver.run(planFor(index, options));
+        if (outcome.error != ErrorCode::None || !TransactionStateMachine::isTerminal(outcome.finalState)) {
+            ++result.failures;
+            std::fprintf(stderr, "transaction %llu stopped in %s: %s\n",
+                         static_cast<unsigned long long>(index),
+                         transactionStateName(outcome.finalState),
+                         errorCodeName(outcome.error));
+        } else if (outcome.finalState == TransactionState::Deferred) {
+            ++result.deferred;
+        } else {
+            ++result.completed;
+        }
+    }
+}
+
+double micros(Nanos value) {
+    return static_cast<double>(value) / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    MockGateway gateway(options.gateway);
+    std::vector<WorkerResult> results(options.threads);
+    std::vector<std::thread> workers;
+
+    const Nanos start = monotonicNanos();
+    for (unsigned worker = 0; worker < options.threads; ++worker) {
+        workers.emplace_back(runWorker, worker, std::cref(options), std::ref(gateway), std::ref(results[worker]));
+    }
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    const Nanos elapsed = monotonicNanos() - start;
+
+    WorkerResult total;
+    for (const WorkerResult &result : results) {
+        total.recorder.merge(result.recorder);
+        total.completed += result.completed;
+        total.deferred += result.deferred;
+        total.failures += result.failures;
+    }
+
+    std::printf("transactions  %llu (%llu completed, %llu deferred, %llu failed)\n",
+                static_cast<unsigned long long>(options.transactions),
+                static_cast<unsigned long long>(total.completed),
+                static_cast<unsigned long long>(total.deferred),
+                static_cast<unsigned long long>(total.failures));
+    std::printf("threads       %u\n", options.threads);
+    std::printf("elapsed       %.3f ms\n", micros(elapsed) / 1000.0);
+    std::printf("throughput    %.0f tx/s\n",
+                elapsed == 0 ? 0.0 : static_cast<double>(options.transactions) * 1e9 / static_cast<double>(elapsed));
+    std::printf("gateway       %llu requests\n\n", static_cast<unsigned long long>(gateway.requestCount()));
+
+    std::printf("%-30s %10s %12s %12s %12s %12s\n", "state", "exits", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+    for (std::size_t i = 1; i < kTransactionStateCount; ++i) {
+        const auto state = static_cast<TransactionState>(i);
+        const LatencyHistogram &histogram = total.recorder.histogram(state);
+        if (histogram.count() == 0) {
+            continue;
+        }
+        std::printf("%-30s %10llu %12.2f %12.2f %12.2f %12.2f\n",
+                    transactionStateName(state),
+                    static_cast<unsigned long long>(histogram.count()),
+                    micros(histogram.mean()),
+                    micros(histogram.percentile(50)),
+                    micros(histogram.percentile(99)),
+                    micros(histogram.max()));
+    }
+
+    bool scenariosPassed = true;
+    if (options.batchItems > 0) {
+        std::printf("\n");
+        scenariosPassed &= runBatchScenario(gateway, options.batchItems, 1);
+        scenariosPassed &= runBatchScenario(gateway, options.batchItems, options.batchConcurrency);
+    }
+    if (options.deferredItems > 0) {
+        std::printf("\n");
+        scenariosPassed &= runDeferredScenario(gateway, options.workDirectory, options.deferredItems,
+                                               options.batchConcurrency);
+    }
+    if (options.records > 0) {
+        std::printf("\n");
+        scenariosPassed &= runRecordStoreScenario(options.workDirectory, options.records);
+    }
+    if (options.accountCacheCallers > 0) {
+        std::printf("\n");
+        scenariosPassed &= runAccountCacheScenario(gateway, options.workDirectory, options.accountCacheCallers,
+                                                   options.batchConcurrency);
+    }
+    if (options.capabilityRows > 0) {
+        std::printf("\n");
+        scenariosPassed &= runCapabilityScenario(gateway, options.capabilityRows, options.batchConcurrency);
+    }
+    if (options.tlvResponses > 0) {
+        std::printf("\n");
+        scenariosPassed &= runTlvScenario(options.tlvResponses);
+    }
+    if (options.logRecords > 0) {
+        std::printf("\n");
+        scenariosPassed &= runEventLogScenario(options.logRecords, options.threads);
+    }
+    if (options.tracedTransactions > 0) {
+        std::printf("\n");
+        scenariosPassed &= runTraceScenario(gateway, options.model, options.tracedTransactions,
+                                            options.readerStepDelay);
+    }
+    if (options.benchTransactions > 0) {
+        std::printf("\n");
+        scenariosPassed &= runBenchScenario(gateway, options.model, options.benchTransactions, options.threads,
+                                            options.readerStepDelay, options.benchBaseline, options.benchTolerance);
+    }
+    if (options.preparedTransactions > 0) {
+        std::printf("\n");
+        scenariosPassed &= runPrepareScenario(gateway, options.model, options.preparedTransactions,
+                                              options.readerStepDelay);
+    }
+    if (options.pooledRequests > 0) {
+        std::printf("\n");
+        scenariosPassed &= runPoolScenario(gateway, options.pooledRequests, options.threads);
+    }
+    if (options.amounts > 0) {
+        std::printf("\n");
+        scenariosPassed &= runAmountScenario(options.amounts);
+    }
+    if (options.settlementRecords > 0) {
+        std::printf("\n");
+        scenariosPassed &= runSettlementScenario(options.workDirectory, options.settlementRecords);
+    }
+    if (options.adjustedTips > 0) {
+        std::printf("\n");
+        scenariosPassed &= runAdjustScenario(gateway, options.workDirectory, options.adjustedTips,
+                                             options.batchConcurrency);
+    }
+    if (options.signatures > 0) {
+        std::printf("\n");
+        scenariosPassed &= runSignatureScenario(options.signatures);
+    }
+    if (options.signatureUploads > 0) {
+        std::printf("\n");
+        scenariosPassed &= runSignatureUploadScenario(options.workDirectory, options.signatureUploads);
+    }
+    if (options.discoveredReaders > 0) {
+        std::printf("\n");
+        scenariosPassed &= runReaderDiscoveryScenario(options.workDirectory, options.discoveredReaders);
+    }
+    if (options.readerDrops > 0) {
+        std::printf("\n");
+        scenariosPassed &= runReconnectScenario(options.readerDrops);
+    }
+    if (options.readerEvents > 0) {
+        std::printf("\n");
+        scenariosPassed &= runReaderEventBusScenario(options.readerEvents, options.threads);
+    }
+    if (options.laneTransactions > 0) {
+        std::printf("\n");
+        scenariosPassed &= runReaderLanesScenario(gateway, options.laneTransactions, options.threads,
+                                                  options.readerStepDelay);
+    }
+    if (options.binRanges > 0) {
+        std::printf("\n");
+        scenariosPassed &= runBinTableScenario(options.workDirectory, options.binRanges);
+    }
+    if (options.cardSwipes > 0) {
+        std::printf("\n");
+        scenariosPassed &= runCardValidationScenario(options.cardSwipes);
+    }
+
+    return total.failures == 0 && scenariosPassed ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/*!
+ * @header Scenarios.hpp
+ *
+ * @brief Replay scenarios beyond single transactions. Each prints a one-line summary and
+ * returns false if an invariant was violated.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "MockGateway.hpp"
+#include "SimulatedReader.hpp"
+
+namespace cft {
+namespace harness {
+
+/*!
+ * @brief End-of-shift close out: void, capture or refund items records through the
+ * BatchScheduler, the way the CFTTransactionManager batch category drives the SDK.
+ */
+bool runBatchScenario(MockGateway &gateway, std::uint64_t items, unsigned concurrency);
+
+/*!
+ * @brief Outage recovery: defer items sales into a DeferredQueue, tear the journal tail as
+ * a crash would, reopen, and drain with bounded parallelism until nothing is pending.
+ */
+bool runDeferredScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t items,
+                         unsigned concurrency);
+
+/*!
+ * @brief Receipt lookups: fill a TransactionRecordStore past its limit, reopen it, sync state
+ * deltas, and check every index against a brute-force scan while timing lookups and queries.
+ */
+bool runRecordStoreScenario(const std::string &workDirectory, std::uint64_t items);
+
+/*!
+ * @brief Merchant account loading: many callers ask for a few accounts at once through a
+ * RefreshingCache, then the scenario walks the clock through prefetch, stale-while-revalidate
+ * with the gateway down, and a disk snapshot round trip.
+ */
+bool runAccountCacheScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t callers,
+                             unsigned concurrency);
+
+/*!
+ * @brief Transaction list rendering: evaluate capabilities for rows rows through a
+ * TransactionCapabilityTable, querying each transaction once and again after its state changes.
+ */
+bool runCapabilityScenario(MockGateway &gateway, std::uint64_t rows, unsigned concurrency);
+
+/*!
+ * @brief EMV data: parse responses reader responses with TlvIterator and EmvTags, check
+ * every tag against the generator, and feed truncated and bit-flipped copies to the parser.
+ */
+bool runTlvScenario(std::uint64_t responses);
+
+/*!
+ * @brief Always-on logging: threads threads each write records records to an EventLog while a
+ * drainer runs, timed against formatting each record synchronously; then sampling, levels
+ * and the memory cap are checked.
+ */
+bool runEventLogScenario(std::uint64_t records, unsigned threads);
+
+/*!
+ * @brief Slow sale triage: trace transactions transactions on one reader, check each
+ * breakdown accounts for the whole timeline, and print p50 and p99 per segment and state.
+ */
+bool runTraceScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions, Nanos readerStepDelay);
+
+/*!
+ * @brief Release benchmark: check every reader model's scripts, then run transactions transactions
+ * of each transaction type on model through an HttpGatewayServer backed by gateway, reporting
+ * throughput, p50 and p99 and allocations per transaction. With baselinePath, compare against
+ * the file and fail on more allocations or a p50 more than tolerance slower; a missing file is written.
+ */
+bool runBenchScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions, unsigned threads,
+                      Nanos readerStepDelay, const std::string &baselinePath, double tolerance);
+
+/*!
+ * @brief Checkout screen: time "Charge" to approval for transactions sales on model that start
+ * cold against the same sales prepared ahead through a TransactionPreparation, and check failed,
+ * early-bound and expired preparations.
+ */
+bool runPrepareScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions,
+                        Nanos readerStepDelay);
+
+/*!
+ * @brief Gateway connections: time requests requests on threads threads connecting per request
+ * against the same requests through an HttpConnectionPool, then check reconnects after a
+ * network change and keep-alives and idle closes over a terminal's idle period.
+ */
+bool runPoolScenario(MockGateway &gateway, std::uint64_t requests, unsigned threads);
+
+/*!
+ * @brief Fixed-point amounts: check rounding, overflow and bulk totals against a 128-bit
+ * reference, then time summing amounts amounts with and without per-value overflow checks.
+ */
+bool runAmountScenario(std::uint64_t amounts);
+
+/*!
+ * @brief Settlement totals: complete, tip, void and close a batch of records records in a
+ * TransactionRecordStore, keeping a SettlementLedger current from its changes and checking it
+ * against totals recomputed from every record.
+ */
+bool runSettlementScenario(const std::string &workDirectory, std::uint64_t records);
+
+/*!
+ * @brief Tip adjustment: close out tips tips through a TipAdjustmentBatch over the loopback
+ * gateway, one request at a time and then window at a time, checking the SettlementLedger shows
+ * every tip before the gateway answers and that declined tips are put back.
+ */
+bool runAdjustScenario(MockGateway &gateway, const std::string &workDirectory, std::uint64_t tips, unsigned window);
+
+/*!
+ * @brief Vector signatures: encode, decode and render signatures signatures drawn as touch
+ * strokes, checking round trips and damaged data, and compare their size with the bitmap the
+ * SDK is otherwise given.
+ */
+bool runSignatureScenario(std::uint64_t signatures);
+
+/*!
+ * @brief Signature uploads: queue signatures signatures, some attached twice and some signed
+ * again, then drain them over a link that drops a third of the uploads and a restart halfway,
+ * checking each transaction ends up with exactly its latest signature.
+ */
+bool runSignatureUploadScenario(const std::string &workDirectory, std::uint64_t signatures);
+
+/*!
+ * @brief Reader discovery: scan readers B250s arriving over four seconds with noisy signal,
+ * checking a list patched from the changes always matches the ranking, the last used reader is
+ * offered the moment it is heard, and the ranking holds still once the scan settles.
+ */
+bool runReaderDiscoveryScenario(const std::string &workDirectory, std::uint64_t readers);
+
+/*!
+ * @brief Reader reconnects: keep a B250 and a B200 connected through drops drops each, a third of
+ * them silent, checking heartbeats find every silent drop and each reader is ready again within
+ * a backoff step of coming back, and compare the time to ready with rescanning after each drop.
+ * Also checks heartbeats and disconnects wait while a transaction is active.
+ */
+bool runReconnectScenario(std::uint64_t drops);
+
+/*!
+ * @brief Reader event bus: threads readers publish events each, mostly battery updates and the
+ * rest reported on both delegate paths, to a slow UI, a telemetry and a monitor subscriber,
+ * checking telemetry gets every event once and in order and the UI ends on the latest battery
+ * level, and compare the publish time with handing each event to the subscribers in turn.
+ */
+bool runReaderEventBusScenario(std::uint64_t events, unsigned threads);
+
+/*!
+ * @brief Reader lanes: check readers are claimed by one lane at a time and their events routed to
+ * it, then run transactions transactions on each of lanes readers side by side, checking a lane's
+ * transactions take about as long as with one reader, and compare with sharing one reader session.
+ */
+bool runReaderLanesScenario(MockGateway &gateway, std::uint64_t transactions, unsigned lanes, Nanos readerStepDelay);
+
+/*!
+ * @brief BIN table: write ranges issuer ranges under the card brands, check lookups and PAN
+ * checks against a scan of every range, then apply a delta while lookups run and reopen the file,
+ * timing lookups on the table against the scan.
+ */
+bool runBinTableScenario(const std::string &workDirectory, std::uint64_t ranges);
+
+/*!
+ * @brief Card data validation: parse swipes track 1 and track 2 swipes, some damaged, and
+ * check keyed PANs, checking the vector and scalar paths agree with string-based parsing, and
+ * time the three against each other.
+ */
+bool runCardValidationScenario(std::uint64_t swipes);
+
+} // namespace harness
+} // namespace cft
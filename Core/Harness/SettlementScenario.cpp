@@ -0,0 +1,259 @@
+//
+//  SettlementScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Amount.hpp"
+#include "cft/Clock.hpp"
+#include "cft/SettlementLedger.hpp"
+#include "cft/TransactionRecordStore.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+StoredTransactionRecord completedRecord(std::uint64_t index) {
+    const std::uint64_t roll = mix64(index ^ 0x5e771e);
+    StoredTransactionRecord record{};
+    record.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Approved);
+    record.result = static_cast<std::uint8_t>(TransactionResult::Approved);
+    switch (roll % 10) {
+        case 0: record.transactionType = static_cast<std::uint8_t>(TransactionType::Refund); break;
+        case 1: record.transactionType = static_cast<std::uint8_t>(TransactionType::Authorization); break;
+        default: record.transactionType = static_cast<std::uint8_t>(TransactionType::Sale); break;
+    }
+    record.createdAtMillis = static_cast<std::int64_t>(1546300800000 + index * 1000);
+    record.transactedAtMillis = record.createdAtMillis + 1500;
+    record.amountMinor = static_cast<std::int64_t>(100 + (roll >> 8) % 50000);
+    record.updatedAtMillis = record.createdAtMillis;
+    record.cardBrand = static_cast<std::uint8_t>((roll >> 24) % kCardBrandCount);
+    record.networkType = static_cast<std::uint8_t>((roll >> 28) % kNetworkTypeCount);
+    record.cardInputMethod = static_cast<std::uint8_t>((roll >> 32) % kCardInputMethodCount);
+
+    char text[kStoredTextCapacity];
+    std::snprintf(text, sizeof(text), "txn_%012llu", static_cast<unsigned long long>(index));
+    StoredTransactionRecord::assign(record.transactionId, text);
+    return record;
+}
+
+// Totals of the open batch computed the way a manual close does today: from every record.
+SettlementTotals recompute(const TransactionRecordStore &store, std::uint64_t batchNumber) {
+    SettlementLedger ledger(SettlementScheme::BroadPosManual, batchNumber);
+    for (const StoredTransactionRecord &record : store.query(TransactionRecordQuery())) {
+        ledger.apply(record);
+    }
+    return ledger.totals();
+}
+
+// Totals of the records pending void, which a local close carries into the next batch.
+SettlementTotals pendingVoidTotals(const TransactionRecordStore &store, std::uint64_t batchNumber) {
+    SettlementLedger ledger(SettlementScheme::BroadPosManual, batchNumber);
+    for (const StoredTransactionRecord &record : store.query(TransactionRecordQuery())) {
+        if (record.state() == ApiTransactionState::PendingVoid) {
+            ledger.apply(record);
+        }
+    }
+    return ledger.totals();
+}
+
+bool isEmpty(const SettlementTotals &totals) {
+    SettlementTotals empty;
+    empty.batchNumber = totals.batchNumber;
+    return totals == empty;
+}
+
+// A refresh that still reports a locally settled record approved leaves it Settled; the
+// gateway's own Settled report ends the hold.
+bool checkSettledLocally(TransactionRecordStore &store, const std::string &transactionId) {
+    StoredTransactionRecord record;
+    if (!store.get(transactionId, record) || record.state() != ApiTransactionState::Settled) {
+        return false;
+    }
+    TransactionRecordDelta delta;
+    delta.transactionId = transactionId;
+    delta.state = ApiTransactionState::Approved;
+    delta.result = TransactionResult::Approved;
+    bool changed = true;
+    bool passed = store.applyDelta(delta, changed) == ErrorCode::None && !changed;
+    record.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Approved);
+    passed &= store.put(record) == ErrorCode::None && store.get(transactionId, record) &&
+              record.state() == ApiTransactionState::Settled;
+
+    delta.state = ApiTransactionState::Settled;
+    passed &= store.applyDelta(delta, changed) == ErrorCode::None && changed;
+    delta.state = ApiTransactionState::Approved;
+    passed &= store.applyDelta(delta, changed) == ErrorCode::None && changed && store.get(transactionId, record) &&
+              record.state() == ApiTransactionState::Approved;
+
+    // Restore the record the way the batch close left it.
+    passed &= store.settleLocally(transactionId, record.updatedAtMillis) == ErrorCode::None;
+    return passed && store.settleLocally("txn_missing", 0) == ErrorCode::NotFound;
+}
+
+bool checkEdges() {
+    bool passed = true;
+
+    SettlementLedger automatic(SettlementScheme::GatewayAuto);
+    SettlementTotals closed;
+    std::vector<std::string> ids;
+    passed &= automatic.closeBatch(closed, ids) == ErrorCode::IllegalTransition;
+
+    // A contribution that would overflow is refused and leaves the totals as they were.
+    SettlementLedger ledger(SettlementScheme::BroadPosManual);
+    StoredTransactionRecord sale = completedRecord(0);
+    sale.transactionType = static_cast<std::uint8_t>(TransactionType::Sale);
+    passed &= ledger.apply(sale) == ErrorCode::None;
+    const SettlementTotals before = ledger.totals();
+    StoredTransactionRecord huge = completedRecord(1);
+    huge.transactionType = static_cast<std::uint8_t>(TransactionType::Sale);
+    huge.amountMinor = std::numeric_limits<std::int64_t>::max();
+    passed &= ledger.apply(huge) == ErrorCode::InvalidArgument && ledger.totals() == before;
+    huge.amountMinor = -1;
+    passed &= ledger.apply(huge) == ErrorCode::InvalidArgument && ledger.openRecordCount() == 1;
+
+    // Voiding and re-approving the same record moves it out of and back into the batch.
+    sale.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Voided);
+    passed &= ledger.apply(sale) == ErrorCode::None && isEmpty(ledger.totals());
+    sale.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Approved);
+    passed &= ledger.apply(sale) == ErrorCode::None && ledger.totals() == before;
+    return passed;
+}
+
+} // namespace
+
+bool runSettlementScenario(const std::string &workDirectory, std::uint64_t records) {
+    const std::string path = workDirectory + "/settlement-scenario.store";
+    ::unlink(path.c_str());
+
+    TransactionRecordStoreConfig config;
+    config.maxRecords = static_cast<std::size_t>(records) + 1;
+    std::unique_ptr<TransactionRecordStore> store;
+    if (TransactionRecordStore::open(path, config, store) != ErrorCode::None) {
+        std::printf("settlement    could not open %s\n", path.c_str());
+        return false;
+    }
+
+    SettlementLedger ledger(SettlementScheme::BroadPosManual);
+    std::uint64_t cursor = 0;
+    std::uint64_t changes = 0;
+    Nanos catchUpNanos = 0;
+    bool passed = checkEdges();
+    auto catchUp = [&]() {
+        const Nanos start = monotonicNanos();
+        for (std::vector<StoredTransactionRecord> page = store->changesSince(cursor, 256, cursor); !page.empty();
+             page = store->changesSince(cursor, 256, cursor)) {
+            for (const StoredTransactionRecord &record : page) {
+                passed &= ledger.apply(record) == ErrorCode::None;
+            }
+            changes += page.size();
+        }
+        catchUpNanos += monotonicNanos() - start;
+    };
+
+    // A day of sales: most complete, some get a tip adjustment, a few are voided or refunded.
+    const std::uint64_t closeAt = records / 2;
+    SettlementTotals closedTotals;
+    std::size_t closedRecords = 0;
+    std::uint64_t checks = 0;
+    Nanos recomputeNanos = 0;
+    for (std::uint64_t index = 0; index < records; ++index) {
+        StoredTransactionRecord record = completedRecord(index);
+        passed &= store->put(record) == ErrorCode::None;
+
+        const std::uint64_t roll = mix64(index);
+        const std::uint64_t target = index - (roll >> 8) % (index + 1);
+        StoredTransactionRecord earlier;
+        if (roll % 4 == 0 && store->get(StoredTransactionRecord::text(completedRecord(target).transactionId), earlier) &&
+            SettlementLedger::isOpen(earlier)) {
+            Amount tip;
+            Amount(earlier.amountMinor, Amount::kUsdExponent).percentage(1500 + static_cast<std::int64_t>(roll >> 40) % 1000, tip);
+            earlier.tipMinor = tip.minorUnits();
+            passed &= store->put(earlier) == ErrorCode::None;
+        } else if (roll % 16 == 1 && store->get(StoredTransactionRecord::text(completedRecord(target).transactionId), earlier)) {
+            TransactionRecordDelta delta;
+            delta.transactionId = StoredTransactionRecord::text(earlier.transactionId);
+            delta.state = (roll >> 20) % 2 == 0 ? ApiTransactionState::Voided : ApiTransactionState::PendingVoid;
+            delta.result = static_cast<TransactionResult>(earlier.result);
+            bool changed = false;
+            passed &= store->applyDelta(delta, changed) == ErrorCode::None;
+        }
+
+        if (index % 64 == 63) {
+            catchUp();
+        }
+        if (index % (records / 8 + 1) == 0 || index + 1 == closeAt) {
+            catchUp();
+            const Nanos start = monotonicNanos();
+            passed &= ledger.totals() == recompute(*store, ledger.totals().batchNumber);
+            recomputeNanos += monotonicNanos() - start;
+            ++checks;
+        }
+
+        // Close the batch halfway: its approved records are marked Settled and drop out of the
+        // totals, and those pending void carry over into batch 2.
+        if (index + 1 == closeAt) {
+            const SettlementTotals before = ledger.totals();
+            const SettlementTotals carried = pendingVoidTotals(*store, 2);
+            std::vector<std::string> ids;
+            passed &= ledger.closeBatch(closedTotals, ids) == ErrorCode::None && closedTotals.batchNumber == 1 &&
+                      ledger.totals() == carried;
+            passed &= closedTotals.total.netMinor() + carried.total.netMinor() == before.total.netMinor() &&
+                      closedTotals.total.saleCount + carried.total.saleCount == before.total.saleCount &&
+                      closedTotals.total.refundCount + carried.total.refundCount == before.total.refundCount;
+            for (const std::string &id : ids) {
+                passed &= store->settleLocally(id, static_cast<std::int64_t>(1546300800000 + index * 1000)) == ErrorCode::None;
+            }
+            passed &= store->setSettlementBatchNumber(2) == ErrorCode::None;
+            if (!ids.empty()) {
+                passed &= checkSettledLocally(*store, ids.front());
+            }
+            catchUp();
+            passed &= ledger.totals() == carried && recompute(*store, 2) == carried;
+            closedRecords = ids.size();
+        }
+    }
+    catchUp();
+    const Nanos start = monotonicNanos();
+    passed &= ledger.totals() == recompute(*store, ledger.totals().batchNumber);
+    recomputeNanos += monotonicNanos() - start;
+    ++checks;
+
+    const SettlementTotals &open = ledger.totals();
+    std::int64_t brandNet = 0;
+    for (const SettlementBucket &bucket : open.byCardBrand) {
+        brandNet += bucket.netMinor();
+    }
+    passed &= brandNet == open.total.netMinor();
+
+    // The batch number survives reopening the store.
+    store.reset();
+    passed &= TransactionRecordStore::open(path, config, store) == ErrorCode::None &&
+              store->settlementBatchNumber() == (closeAt == 0 ? 1 : 2);
+    store.reset();
+    ::unlink(path.c_str());
+
+    std::printf("settlement    %llu records, %zu closed in batch 1 (net %lld), %zu open (net %lld); "
+                "%.2f us per change incremental, %.2f ms per full recompute, %s\n",
+                static_cast<unsigned long long>(records), closedRecords,
+                static_cast<long long>(closedTotals.total.netMinor()), ledger.openRecordCount(),
+                static_cast<long long>(open.total.netMinor()),
+                changes == 0 ? 0.0 : static_cast<double>(catchUpNanos) / changes / 1e3,
+                static_cast<double>(recomputeNanos) / checks / 1e6,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
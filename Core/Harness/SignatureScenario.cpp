@@ -0,0 +1,164 @@
+//
+//  SignatureScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/Compression.hpp"
+#include "cft/Signature.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+// A 600 x 200 point signature pad at two canvas units per point, as the shim records it.
+const std::uint16_t kCanvasWidth = 1200;
+const std::uint16_t kCanvasHeight = 400;
+const std::uint32_t kImageScale = 2;
+
+// Touches arrive at 120 Hz; each stroke is a loop-and-scrawl that drifts right like handwriting.
+Signature drawSignature(std::uint64_t seed) {
+    Signature signature(kCanvasWidth, kCanvasHeight);
+    const unsigned strokes = 3 + static_cast<unsigned>(mix64(seed) % 4);
+    std::uint32_t millis = 0;
+    double left = 60;
+    for (unsigned stroke = 0; stroke < strokes; ++stroke) {
+        const std::uint64_t roll = mix64(seed * 31 + stroke);
+        const unsigned points = 80 + static_cast<unsigned>(roll % 170);
+        const double speed = 2.0 + static_cast<double>((roll >> 16) % 40) / 10;
+        const double loops = 3.0 + static_cast<double>((roll >> 24) % 50) / 10;
+        signature.beginStroke();
+        for (unsigned i = 0; i < points; ++i) {
+            const double t = static_cast<double>(i) / points;
+            const double x = left + i * speed + 40 * std::sin(t * loops * 6.2832);
+            const double y = 200 + 120 * std::sin(t * loops * 3.1416 + stroke) * std::cos(t * 2.1);
+            SignaturePoint point;
+            point.x = static_cast<std::uint16_t>(std::min(kCanvasWidth - 1.0, std::max(0.0, x)));
+            point.y = static_cast<std::uint16_t>(std::min(kCanvasHeight - 1.0, std::max(0.0, y)));
+            point.millis = millis;
+            signature.addPoint(point);
+            millis += 8 + static_cast<std::uint32_t>(mix64(roll + i) % 2);
+        }
+        left += points * speed * 0.6;
+        millis += 150;
+    }
+    return signature;
+}
+
+std::size_t inkedPixels(const std::vector<std::uint8_t> &pixels) {
+    std::size_t inked = 0;
+    for (std::uint8_t pixel : pixels) {
+        inked += pixel < 128 ? 1 : 0;
+    }
+    return inked;
+}
+
+bool checkEdgeCases() {
+    bool passed = true;
+    Signature signature(100, 50);
+    passed &= signature.addPoint(SignaturePoint{1, 1, 0}) == ErrorCode::IllegalTransition;
+    signature.beginStroke();
+    signature.beginStroke();
+    passed &= signature.addPoint(SignaturePoint{100, 1, 0}) == ErrorCode::InvalidArgument;
+    passed &= signature.addPoint(SignaturePoint{10, 10, 5}) == ErrorCode::None;
+    passed &= signature.addPoint(SignaturePoint{10, 10, 9}) == ErrorCode::None;
+    passed &= signature.addPoint(SignaturePoint{11, 10, 4}) == ErrorCode::InvalidArgument;
+    passed &= signature.strokeCount() == 1 && signature.pointCount() == 1;
+
+    // A single tap is a dot, an empty pad is blank.
+    std::vector<std::uint8_t> pixels;
+    signature.render(200, 100, 4, pixels);
+    passed &= inkedPixels(pixels) > 0;
+    Signature(100, 50).render(200, 100, 4, pixels);
+    passed &= inkedPixels(pixels) == 0;
+
+    std::vector<std::uint8_t> encoded;
+    Signature empty(100, 50);
+    empty.encode(encoded);
+    Signature decoded;
+    passed &= Signature::decode(encoded.data(), encoded.size(), decoded) == ErrorCode::None && decoded == empty;
+    passed &= Signature::decode(encoded.data(), 4, decoded) == ErrorCode::InvalidArgument;
+    return passed;
+}
+
+} // namespace
+
+bool runSignatureScenario(std::uint64_t signatures) {
+    bool passed = checkEdgeCases();
+
+    std::vector<Signature> drawn;
+    drawn.reserve(signatures);
+    std::size_t points = 0;
+    for (std::uint64_t i = 0; i < signatures; ++i) {
+        drawn.push_back(drawSignature(i + 1));
+        points += drawn.back().pointCount();
+    }
+
+    std::vector<std::vector<std::uint8_t>> encoded(signatures);
+    std::size_t encodedBytes = 0;
+    Nanos start = monotonicNanos();
+    for (std::uint64_t i = 0; i < signatures; ++i) {
+        drawn[i].encode(encoded[i]);
+        encodedBytes += encoded[i].size();
+    }
+    const Nanos encodeNanos = monotonicNanos() - start;
+
+    start = monotonicNanos();
+    for (std::uint64_t i = 0; i < signatures; ++i) {
+        Signature decoded;
+        passed &= Signature::decode(encoded[i].data(), encoded[i].size(), decoded) == ErrorCode::None &&
+                  decoded == drawn[i];
+    }
+    const Nanos decodeNanos = monotonicNanos() - start;
+
+    // Any flipped bit or missing byte is caught rather than drawn.
+    for (std::uint64_t i = 0; i < signatures && i < 16; ++i) {
+        std::vector<std::uint8_t> damaged = encoded[i];
+        const std::size_t at = static_cast<std::size_t>(mix64(i) % damaged.size());
+        damaged[at] ^= static_cast<std::uint8_t>(1u << (i % 8));
+        Signature decoded;
+        passed &= Signature::decode(damaged.data(), damaged.size(), decoded) == ErrorCode::InvalidArgument;
+        passed &= Signature::decode(encoded[i].data(), encoded[i].size() - 1, decoded) == ErrorCode::InvalidArgument;
+    }
+
+    // The image the SDK would have been handed: the pad at screen scale, and what it compresses to.
+    const std::uint32_t imageWidth = kCanvasWidth / 2 * kImageScale;
+    const std::uint32_t imageHeight = kCanvasHeight / 2 * kImageScale;
+    const std::size_t bitmapBytes = static_cast<std::size_t>(imageWidth) * imageHeight * 4;
+    std::size_t compressedBytes = 0;
+    std::vector<std::uint8_t> pixels;
+    std::vector<std::uint8_t> compressed;
+    start = monotonicNanos();
+    for (std::uint64_t i = 0; i < signatures; ++i) {
+        drawn[i].render(imageWidth, imageHeight, 2.5 * kImageScale, pixels);
+        passed &= inkedPixels(pixels) > drawn[i].pointCount();
+        compressed.clear();
+        compressBlock(pixels.data(), pixels.size(), compressed);
+        compressedBytes += compressed.size();
+    }
+    const Nanos renderNanos = monotonicNanos() - start;
+
+    const double count = signatures > 0 ? static_cast<double>(signatures) : 1.0;
+    passed &= signatures == 0 || encodedBytes / count < 8 * 1024;
+    std::printf("signature     %llu signatures, %.0f points and %.0f bytes each (%.2f bytes/point); "
+                "%.0f KB as a %ux%u bitmap, %.1f KB compressed\n",
+                static_cast<unsigned long long>(signatures), points / count, encodedBytes / count,
+                points > 0 ? static_cast<double>(encodedBytes) / points : 0.0, bitmapBytes / 1024.0, imageWidth,
+                imageHeight, compressedBytes / count / 1024.0);
+    std::printf("signature     encode %.1f us, decode %.1f us, render and compress %.1f us each, %s\n",
+                static_cast<double>(encodeNanos) / count / 1e3, static_cast<double>(decodeNanos) / count / 1e3,
+                static_cast<double>(renderNanos) / count / 1e3, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
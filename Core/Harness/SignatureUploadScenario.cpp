@@ -0,0 +1,205 @@
+//
+//  SignatureUploadScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cft/Clock.hpp"
+#include "cft/Signature.hpp"
+#include "cft/SignatureUploadQueue.hpp"
+#include "MockGateway.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+std::vector<std::uint8_t> signatureBytes(std::uint64_t seed) {
+    Signature signature(1200, 400);
+    std::uint32_t millis = 0;
+    for (unsigned stroke = 0; stroke < 3; ++stroke) {
+        signature.beginStroke();
+        const unsigned points = 100 + static_cast<unsigned>(mix64(seed + stroke) % 150);
+        for (unsigned i = 0; i < points; ++i) {
+            const double t = static_cast<double>(i) / points;
+            SignaturePoint point;
+            point.x = static_cast<std::uint16_t>(100 + stroke * 300 + 250 * t + 30 * std::sin(t * 19 + seed));
+            point.y = static_cast<std::uint16_t>(200 + 150 * std::sin(t * 7 + stroke) * std::cos(t * 3));
+            point.millis = millis += 8;
+            signature.addPoint(point);
+        }
+    }
+    std::vector<std::uint8_t> encoded;
+    signature.encode(encoded);
+    return encoded;
+}
+
+std::string transactionId(std::uint64_t index) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "tx_%08llu", static_cast<unsigned long long>(index));
+    return text;
+}
+
+// Replacing a signature that is mid-upload: the old upload finishes and the new one still follows.
+bool checkReplaceInFlight(const std::string &path, const DeferredQueueConfig &config) {
+    ::unlink(path.c_str());
+    std::unique_ptr<SignatureUploadQueue> queue;
+    if (SignatureUploadQueue::open(path, config, queue) != ErrorCode::None) {
+        return false;
+    }
+    const std::vector<std::uint8_t> first = signatureBytes(1);
+    const std::vector<std::uint8_t> second = signatureBytes(2);
+    std::uint64_t firstId = 0;
+    std::uint64_t secondId = 0;
+    bool passed = queue->enqueue("tx_replace", SignatureFormat::Strokes, first.data(), first.size(), 0, firstId) ==
+                  ErrorCode::None;
+    passed &= queue->claimReady(0, 8).size() == 1;
+    passed &= queue->enqueue("tx_replace", SignatureFormat::Strokes, second.data(), second.size(), 0, secondId) ==
+                  ErrorCode::None &&
+              secondId != firstId;
+    // The newer signature waits for the one in flight, however many slots are free.
+    passed &= queue->claimReady(0, 8).empty() && queue->nextAttemptAtMillis() == -1;
+    passed &= queue->complete(firstId) == ErrorCode::None && queue->nextAttemptAtMillis() == 0;
+    const std::vector<SignatureUpload> next = queue->claimReady(0, 8);
+    passed &= next.size() == 1 && next[0].entryId == secondId && next[0].data == second;
+    passed &= queue->complete(secondId) == ErrorCode::None && queue->count() == 0;
+
+    // Retrying now skips the backoff of a failed upload once; failing again backs off as usual.
+    std::uint64_t retriedId = 0;
+    bool retrying = false;
+    passed &= queue->enqueue("tx_retry", SignatureFormat::Strokes, first.data(), first.size(), 0, retriedId) == ErrorCode::None;
+    passed &= queue->claimReady(0, 8).size() == 1 && queue->fail(retriedId, true, 0, retrying) == ErrorCode::None && retrying;
+    passed &= queue->claimReady(0, 8).empty() && queue->expedite(0) == 1 && queue->claimReady(0, 8).size() == 1;
+    passed &= queue->fail(retriedId, true, 0, retrying) == ErrorCode::None && queue->claimReady(0, 8).empty();
+    passed &= queue->remove("tx_retry") == ErrorCode::None && queue->count() == 0;
+
+    // Bad arguments and a signature the gateway will never take.
+    std::uint64_t unused = 0;
+    passed &= queue->enqueue("", SignatureFormat::Png, first.data(), first.size(), 0, unused) == ErrorCode::InvalidArgument;
+    passed &= queue->enqueue("tx_refused", SignatureFormat::Png, first.data(), first.size(), 0, unused) == ErrorCode::None;
+    bool willRetry = true;
+    for (const SignatureUpload &upload : queue->claimReady(0, 8)) {
+        passed &= queue->fail(upload.entryId, false, 0, willRetry) == ErrorCode::None && !willRetry;
+    }
+    const std::vector<std::string> dead = queue->deadLetteredTransactionIds();
+    passed &= dead.size() == 1 && dead[0] == "tx_refused";
+    passed &= queue->remove("tx_refused") == ErrorCode::None && queue->count() == 0;
+    queue.reset();
+    ::unlink(path.c_str());
+    return passed;
+}
+
+} // namespace
+
+bool runSignatureUploadScenario(const std::string &workDirectory, std::uint64_t signatures) {
+    const std::string path = workDirectory + "/signature-upload-scenario.journal";
+    DeferredQueueConfig config;
+    config.maxEntries = static_cast<std::size_t>(signatures) + 8;
+    config.maxAttempts = 32;
+    config.baseRetryDelayMillis = 500;
+    config.maxRetryDelayMillis = 8000;
+
+    bool passed = checkReplaceInFlight(path, config);
+    ::unlink(path.c_str());
+    std::unique_ptr<SignatureUploadQueue> queue;
+    if (SignatureUploadQueue::open(path, config, queue) != ErrorCode::None) {
+        std::printf("signature-up  could not open %s\n", path.c_str());
+        return false;
+    }
+
+    // What the transaction waits for now: the signature written to disk, not uploaded.
+    std::map<std::string, std::vector<std::uint8_t>> latest;
+    std::size_t bytes = 0;
+    std::uint64_t deduplicated = 0;
+    Nanos enqueueNanos = 0;
+    for (std::uint64_t i = 0; i < signatures; ++i) {
+        const std::string id = transactionId(i);
+        std::vector<std::uint8_t> data = signatureBytes(i);
+        std::uint64_t entryId = 0;
+        const Nanos start = monotonicNanos();
+        passed &= queue->enqueue(id, SignatureFormat::Strokes, data.data(), data.size(), 0, entryId) == ErrorCode::None;
+        enqueueNanos += monotonicNanos() - start;
+        bytes += data.size();
+
+        // Attaching the same signature twice is a no-op; signing again replaces it.
+        if (i % 5 == 0) {
+            std::uint64_t again = 0;
+            passed &= queue->enqueue(id, SignatureFormat::Strokes, data.data(), data.size(), 0, again) == ErrorCode::None &&
+                      again == entryId;
+            ++deduplicated;
+        }
+        if (i % 7 == 0) {
+            data = signatureBytes(i + signatures);
+            passed &= queue->enqueue(id, SignatureFormat::Strokes, data.data(), data.size(), 0, entryId) == ErrorCode::None;
+        }
+        latest[id] = data;
+    }
+    passed &= queue->count() == signatures;
+
+    // A weak link: a third of uploads time out, and the app is killed partway through the drain.
+    std::map<std::string, std::vector<std::uint8_t>> uploaded;
+    std::uint64_t attempts = 0;
+    std::uint64_t retries = 0;
+    std::uint64_t duplicates = 0;
+    std::int64_t now = 0;
+    bool crashed = false;
+    while (queue->count() > 0) {
+        const std::int64_t next = queue->nextAttemptAtMillis();
+        if (next < 0) {
+            passed = false;
+            break;
+        }
+        now = next > now ? next : now;
+        std::vector<SignatureUpload> claimed = queue->claimReady(now, 16);
+        if (!crashed && uploaded.size() >= signatures / 2) {
+            // Claimed but never answered: after the restart they are simply pending again.
+            crashed = true;
+            queue.reset();
+            passed &= SignatureUploadQueue::open(path, config, queue) == ErrorCode::None &&
+                      queue->count() == signatures - uploaded.size() && queue->pendingCount() == queue->count();
+            continue;
+        }
+        for (const SignatureUpload &upload : claimed) {
+            ++attempts;
+            if (mix64(upload.entryId * 131 + attempts) % 3 == 0) {
+                bool willRetry = false;
+                queue->fail(upload.entryId, true, now, willRetry);
+                retries += willRetry ? 1 : 0;
+                passed &= willRetry;
+                continue;
+            }
+            duplicates += uploaded.count(upload.transactionId);
+            uploaded[upload.transactionId] = upload.data;
+            passed &= queue->complete(upload.entryId) == ErrorCode::None;
+        }
+        now += 100;
+    }
+
+    passed &= uploaded == latest && duplicates == 0;
+    queue.reset();
+    passed &= SignatureUploadQueue::open(path, config, queue) == ErrorCode::None && queue->count() == 0;
+    queue.reset();
+    ::unlink(path.c_str());
+
+    const double count = signatures > 0 ? static_cast<double>(signatures) : 1.0;
+    std::printf("signature-up  %llu signatures, %.0f bytes each, queued in %.1f us each; %llu duplicates folded, "
+                "%llu uploads, %llu retries over %.1f s with a restart, %s\n",
+                static_cast<unsigned long long>(signatures), bytes / count, static_cast<double>(enqueueNanos) / count / 1e3,
+                static_cast<unsigned long long>(deduplicated), static_cast<unsigned long long>(attempts - retries),
+                static_cast<unsigned long long>(retries), static_cast<double>(now) / 1e3, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,146 @@
+//
+//  SimulatedReader.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "SimulatedReader.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace cft {
+namespace harness {
+
+bool SimulatedReader::supports(CardReaderModel model, CardInputMethod method) {
+    if (method == CardInputMethod::Key) {
+        return true;
+    }
+
+    bool swipe = false;
+    bool dip = false;
+    bool tap = false;
+    switch (model) {
+        case CardReaderModel::Shuttle:
+        case CardReaderModel::BTMag:
+        case CardReaderModel::A100:
+            swipe = true;
+            break;
+        case CardReaderModel::A200:
+        case CardReaderModel::B500:
+        case CardReaderModel::B200:
+            swipe = dip = true;
+            break;
+        case CardReaderModel::B550:
+        case CardReaderModel::A250:
+        case CardReaderModel::B250:
+            swipe = dip = tap = true;
+            break;
+        case CardReaderModel::Unknown:
+            break;
+    }
+
+    switch (method) {
+        case CardInputMethod::Swipe: return swipe;
+        case CardInputMethod::Dip:
+        case CardInputMethod::QuickChip:
+        case CardInputMethod::SwipeFallback: return dip;
+        case CardInputMethod::Tap: return tap;
+        default: return false;
+    }
+}
+
+bool SimulatedReader::isBluetooth(CardReaderModel model) {
+    switch (model) {
+        case CardReaderModel::BTMag:
+        case CardReaderModel::B550:
+        case CardReaderModel::B500:
+        case CardReaderModel::B200:
+        case CardReaderModel::B250:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::vector<ReaderStep> SimulatedReader::connectionScript(CardReaderModel model, Nanos stepDelay) {
+    // Audio jack readers are powered by the jack and report connected as soon as they are plugged in.
+    if (isBluetooth(model)) {
+        return {{CardReaderEvent::Connecting, stepDelay},
+                {CardReaderEvent::Connected, stepDelay},
+                {CardReaderEvent::BatteryStatusUpdated, stepDelay}};
+    }
+    return {{CardReaderEvent::Connected, stepDelay}};
+}
+
+std::vector<ReaderStep> SimulatedReader::script(CardReaderModel model, CardInputMethod method,
+                                                const ReaderScriptOptions &options) {
+    std::vector<ReaderStep> steps;
+    if (method == CardInputMethod::Key || !supports(model, method)) {
+        return steps;
+    }
+
+    const Nanos delay = options.stepDelay;
+    if (options.connect) {
+        steps = connectionScript(model, delay);
+    }
+
+    const auto chip = [&] {
+        steps.push_back({CardReaderEvent::CardInserted, delay});
+        if (options.applications > 1) {
+            steps.push_back({CardReaderEvent::Unknown, delay, ReaderAction::SelectApplication});
+        }
+        if (options.pinEntry) {
+            steps.push_back({CardReaderEvent::Unknown, delay, ReaderAction::EnterPin});
+        }
+    };
+
+    switch (method) {
+        case CardInputMethod::Swipe:
+            steps.push_back({CardReaderEvent::CardSwiped, delay});
+            break;
+        case CardInputMethod::Dip:
+            chip();
+            break;
+        case CardInputMethod::QuickChip:
+            // Quick chip hands the card back once the chip is read, before the gateway answers.
+            chip();
+            steps.push_back({CardReaderEvent::CardRemoved, delay});
+            break;
+        case CardInputMethod::SwipeFallback:
+            steps.push_back({CardReaderEvent::CardInserted, delay});
+            steps.push_back({CardReaderEvent::CardInsertErrored, delay});
+            steps.push_back({CardReaderEvent::CardRemoved, delay});
+            steps.push_back({CardReaderEvent::CardSwiped, delay});
+            break;
+        case CardInputMethod::Tap:
+            steps.push_back({CardReaderEvent::CardTapped, delay});
+            break;
+        default:
+            break;
+    }
+    return steps;
+}
+
+void SimulatedReader::play(const std::vector<ReaderStep> &steps, Listener &listener) const {
+    for (const ReaderStep &step : steps) {
+        if (step.delay > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(step.delay));
+        }
+        switch (step.action) {
+            case ReaderAction::Event:
+                listener.readerDidReceiveEvent(step.event);
+                break;
+            case ReaderAction::SelectApplication:
+                listener.readerDidRequestApplicationSelection();
+                break;
+            case ReaderAction::EnterPin:
+                listener.readerDidCapturePin();
+                break;
+        }
+    }
+}
+
+} // namespace harness
+} // namespace cft
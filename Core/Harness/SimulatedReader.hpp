@@ -0,0 +1,98 @@
+/*!
+ * @header SimulatedReader.hpp
+ *
+ * @brief Scripted stand-in for a physical card reader.
+ * Plays the CFTCardReaderEvent sequence a real reader of a given CFTCardReaderModel emits for
+ * a given input method, including connecting, chip application selection and PIN entry,
+ * optionally pausing between steps to model reader I/O time.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+namespace harness {
+
+/*!
+ * @typedef ReaderAction
+ * @constant Event The reader reports event
+ * @constant SelectApplication The chip offers more than one application and the cardholder picks one
+ * @constant EnterPin The cardholder enters a PIN on the reader
+ */
+enum class ReaderAction : std::uint8_t {
+    Event,
+    SelectApplication,
+    EnterPin
+};
+
+struct ReaderStep {
+    CardReaderEvent event;
+    Nanos delay;
+    ReaderAction action = ReaderAction::Event;
+};
+
+struct ReaderScriptOptions {
+    // Delay inserted before each step.
+    Nanos stepDelay = 0;
+    // Play the connection sequence of the model's interface first.
+    bool connect = false;
+    // Applications on the chip; more than one asks for selection on dip and quick chip.
+    std::uint8_t applications = 1;
+    // Chip cards verify with PIN on the reader.
+    bool pinEntry = false;
+};
+
+class SimulatedReader {
+public:
+    class Listener {
+    public:
+        virtual ~Listener() = default;
+        virtual void readerDidReceiveEvent(CardReaderEvent event) = 0;
+        virtual void readerDidRequestApplicationSelection() {}
+        virtual void readerDidCapturePin() {}
+    };
+
+    /*!
+     * @brief Whether a reader model can capture cards with the given input method
+     * @discussion Mirrors the capabilities listed for CFTCardReaderModel. Keyed entry never needs a reader.
+     */
+    static bool supports(CardReaderModel model, CardInputMethod method);
+
+    /*!
+     * @brief Whether a reader model connects over Bluetooth rather than the audio jack
+     */
+    static bool isBluetooth(CardReaderModel model);
+
+    /*!
+     * @brief Events a reader model reports while connecting
+     */
+    static std::vector<ReaderStep> connectionScript(CardReaderModel model, Nanos stepDelay);
+
+    /*!
+     * @brief Event script for an input method on a reader model
+     * @discussion Empty when the model does not support the method.
+     */
+    static std::vector<ReaderStep> script(CardReaderModel model, CardInputMethod method,
+                                          const ReaderScriptOptions &options);
+
+    explicit SimulatedReader(CardReaderModel model) : _model(model) {}
+
+    CardReaderModel model() const { return _model; }
+
+    /*!
+     * @brief Play a script to listener on the calling thread
+     */
+    void play(const std::vector<ReaderStep> &steps, Listener &listener) const;
+
+private:
+    CardReaderModel _model;
+};
+
+} // namespace harness
+} // namespace cft
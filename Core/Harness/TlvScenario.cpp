@@ -0,0 +1,168 @@
+//
+//  TlvScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/Tlv.hpp"
+#include "Scenarios.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+struct ReaderResponse {
+    std::vector<std::uint8_t> bytes;
+    // Value of each curated tag, empty when the response leaves it out.
+    std::vector<std::uint8_t> values[kEmvTagCount];
+    std::size_t elementCount = 0;
+};
+
+// A response template 77 holding the curated tags, a few the SDK drops, padding, and an
+// issuer script long enough to need the long length form.
+ReaderResponse syntheticResponse(std::uint64_t index) {
+    std::uint64_t roll = mix64(index);
+    ReaderResponse response;
+    std::vector<std::uint8_t> body;
+
+    for (std::size_t i = 0; i < kEmvTagCount; ++i) {
+        roll = mix64(roll);
+        if (roll % 8 == 0) {
+            continue;
+        }
+        const auto tag = static_cast<EmvTag>(i);
+        std::vector<std::uint8_t> &value = response.values[i];
+        const std::size_t length = 1 + (roll >> 8) % 16;
+        for (std::size_t j = 0; j < length; ++j) {
+            value.push_back(emvTagIsText(tag) ? static_cast<std::uint8_t>('A' + (roll >> (j % 48)) % 26)
+                                              : static_cast<std::uint8_t>(roll >> (j % 56)));
+        }
+        appendTlv(body, emvTagNumber(tag), value.data(), value.size());
+        ++response.elementCount;
+        if ((roll >> 40) % 5 == 0) {
+            body.push_back(0x00);
+        }
+    }
+
+    static const std::uint8_t kTerminalType[] = {0x22};
+    static const std::uint8_t kCountry[] = {0x08, 0x40};
+    appendTlv(body, 0x9F35, kTerminalType, sizeof(kTerminalType));
+    appendTlv(body, 0x9F1A, kCountry, sizeof(kCountry));
+    std::vector<std::uint8_t> script((roll >> 16) % 300, 0x86);
+    appendTlv(body, 0x9F18, script.data(), script.size());
+    response.elementCount += 3;
+
+    response.bytes.push_back(0x77);
+    if (body.size() < 0x80) {
+        response.bytes.push_back(static_cast<std::uint8_t>(body.size()));
+    } else {
+        response.bytes.push_back(0x82);
+        response.bytes.push_back(static_cast<std::uint8_t>(body.size() >> 8));
+        response.bytes.push_back(static_cast<std::uint8_t>(body.size()));
+    }
+    appendBytes(response.bytes, body.data(), body.size());
+    response.bytes.push_back(0xFF);
+    ++response.elementCount;
+    return response;
+}
+
+bool matches(const ByteRange &range, const std::vector<std::uint8_t> &expected) {
+    return range.size == expected.size() && std::equal(expected.begin(), expected.end(), range.data);
+}
+
+} // namespace
+
+bool runTlvScenario(std::uint64_t responses) {
+    std::vector<ReaderResponse> corpus;
+    corpus.reserve(responses);
+    std::size_t totalBytes = 0;
+    for (std::uint64_t i = 0; i < responses; ++i) {
+        corpus.push_back(syntheticResponse(i));
+        totalBytes += corpus.back().bytes.size();
+    }
+
+    std::uint64_t mismatches = 0;
+    for (const ReaderResponse &response : corpus) {
+        std::size_t elements = 0;
+        TlvIterator iterator(response.bytes.data(), response.bytes.size());
+        TlvElement element;
+        while (iterator.next(element)) {
+            ++elements;
+        }
+        mismatches += iterator.error() != ErrorCode::None || elements != response.elementCount;
+
+        EmvTags tags(response.bytes.data(), response.bytes.size());
+        for (std::size_t i = 0; i < kEmvTagCount; ++i) {
+            ByteRange value;
+            const bool found = tags.find(static_cast<EmvTag>(i), value);
+            mismatches += found != !response.values[i].empty() || (found && !matches(value, response.values[i]));
+        }
+    }
+
+    // Every truncation and single bit flip must parse to an error or to elements inside the buffer.
+    std::uint64_t damaged = 0;
+    std::uint64_t escapes = 0;
+    for (std::size_t r = 0; r < corpus.size() && r < 64; ++r) {
+        const std::vector<std::uint8_t> &original = corpus[r].bytes;
+        for (std::size_t cut = 0; cut <= original.size(); ++cut) {
+            for (std::size_t bit = 0; bit <= 8; ++bit) {
+                std::vector<std::uint8_t> copy(original.begin(), original.begin() + cut);
+                if (cut < original.size() && bit > 0) {
+                    copy.push_back(original[cut] ^ static_cast<std::uint8_t>(1u << (bit - 1)));
+                    copy.insert(copy.end(), original.begin() + cut + 1, original.end());
+                } else if (bit > 0) {
+                    break;
+                }
+                TlvIterator iterator(copy.data(), copy.size());
+                TlvElement element;
+                while (iterator.next(element)) {
+                    escapes += element.value.data < copy.data() ||
+                               element.value.data + element.value.size > copy.data() + copy.size();
+                }
+                damaged += iterator.error() != ErrorCode::None;
+            }
+        }
+    }
+
+    const Nanos iterateStart = monotonicNanos();
+    std::uint64_t checksum = 0;
+    for (const ReaderResponse &response : corpus) {
+        TlvIterator iterator(response.bytes.data(), response.bytes.size());
+        TlvElement element;
+        while (iterator.next(element)) {
+            checksum += element.tag + element.value.size;
+        }
+    }
+    const Nanos iterateElapsed = monotonicNanos() - iterateStart;
+
+    const Nanos lookupStart = monotonicNanos();
+    for (const ReaderResponse &response : corpus) {
+        EmvTags tags(response.bytes.data(), response.bytes.size());
+        ByteRange value;
+        checksum += tags.find(EmvTag::ApplicationCryptogram, value) ? value.size : 0;
+        checksum += tags.find(EmvTag::ApplicationTransactionCounter, value) ? value.size : 0;
+    }
+    const Nanos lookupElapsed = monotonicNanos() - lookupStart;
+
+    const bool passed = mismatches == 0 && escapes == 0 && damaged > 0;
+    std::printf("tlv           %llu responses, %.1f bytes avg, iterate %.1f ns, 2 curated tags %.1f ns, "
+                "%llu damaged inputs rejected, checksum %llx, %s\n",
+                static_cast<unsigned long long>(responses),
+                responses == 0 ? 0.0 : static_cast<double>(totalBytes) / static_cast<double>(responses),
+                responses == 0 ? 0.0 : static_cast<double>(iterateElapsed) / static_cast<double>(responses),
+                responses == 0 ? 0.0 : static_cast<double>(lookupElapsed) / static_cast<double>(responses),
+                static_cast<unsigned long long>(damaged),
+                static_cast<unsigned long long>(checksum),
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
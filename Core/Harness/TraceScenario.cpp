@@ -0,0 +1,136 @@
+//
+//  TraceScenario.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include <cstdio>
+
+#include "cft/Clock.hpp"
+#include "cft/TransactionTrace.hpp"
+#include "Scenarios.hpp"
+#include "SimulatedReader.hpp"
+#include "TransactionDriver.hpp"
+
+namespace cft {
+namespace harness {
+
+namespace {
+
+double micros(Nanos value) {
+    return static_cast<double>(value) / 1000.0;
+}
+
+void printHistogram(const char *name, const LatencyHistogram &histogram) {
+    if (histogram.count() == 0) {
+        return;
+    }
+    std::printf("  %-28s %10llu %12.2f %12.2f %12.2f\n",
+                name,
+                static_cast<unsigned long long>(histogram.count()),
+                micros(histogram.mean()),
+                micros(histogram.percentile(50)),
+                micros(histogram.percentile(99)));
+}
+
+Nanos steppingClock() {
+    static Nanos now = 0;
+    return now += 1000;
+}
+
+// A swipe fallback whose second attempt never sees a card keeps the first attempt's segments.
+bool checkFallbackWithoutCard() {
+    TransactionTrace trace(steppingClock);
+    trace.recordState(TransactionState::PendingCardInput);
+    trace.recordReaderEvent(CardReaderEvent::CardInserted);
+    trace.recordReaderEvent(CardReaderEvent::CardInsertErrored);
+    trace.recordState(TransactionState::PendingProcessOption);
+    trace.recordState(TransactionState::PendingCardInput);
+    trace.recordState(TransactionState::Completed);
+
+    const TraceBreakdown breakdown = trace.breakdown();
+    return breakdown.hasCardEvent &&
+           breakdown.segments[static_cast<std::size_t>(TraceSegment::CardPresentation)] == 1000 &&
+           breakdown.segments[static_cast<std::size_t>(TraceSegment::CardReading)] == 2000;
+}
+
+} // namespace
+
+bool runTraceScenario(MockGateway &gateway, CardReaderModel model, std::uint64_t transactions, Nanos readerStepDelay) {
+    static const CardInputMethod kMethods[] = {
+        CardInputMethod::Dip, CardInputMethod::Swipe, CardInputMethod::Tap,
+        CardInputMethod::QuickChip, CardInputMethod::SwipeFallback, CardInputMethod::Key,
+    };
+
+    SimulatedReader reader(model);
+    TransactionDriver driver(reader, gateway, nullptr);
+    TransactionTrace trace;
+    driver.setTrace(&trace);
+    TraceAggregator aggregator;
+
+    // The breakdown must account for every nanosecond between the first and last state.
+    std::uint64_t inconsistent = 0;
+    for (std::uint64_t i = 0; i < transactions; ++i) {
+        const std::uint64_t roll = mix64(i);
+        TransactionPlan plan;
+        plan.cardInputMethod = kMethods[roll % (sizeof(kMethods) / sizeof(kMethods[0]))];
+        plan.amountMinor = 100 + static_cast<std::int64_t>((roll >> 8) % 50000);
+        plan.isAdjustmentRequested = ((roll >> 24) % 4) == 0;
+        plan.readerStepDelay = readerStepDelay;
+        const TransactionOutcome outcome = driver.run(plan);
+        if (outcome.error != ErrorCode::None) {
+            ++inconsistent;
+            continue;
+        }
+
+        const TraceBreakdown breakdown = trace.breakdown();
+        Nanos accounted = 0;
+        for (Nanos nanos : breakdown.inState) {
+            accounted += nanos;
+        }
+        const auto segment = [&](TraceSegment which) {
+            return breakdown.segments[static_cast<std::size_t>(which)];
+        };
+        inconsistent += trace.droppedCount() != 0 || accounted != segment(TraceSegment::Total) ||
+                        segment(TraceSegment::Gateway) > breakdown.inState[static_cast<std::size_t>(TransactionState::Processing)] ||
+                        segment(TraceSegment::CardPresentation) + segment(TraceSegment::CardReading) >
+                            breakdown.inState[static_cast<std::size_t>(TransactionState::PendingCardInput)];
+        aggregator.add(breakdown);
+    }
+
+    // Cost of tracing itself: a full trace of events and its breakdown.
+    TransactionTrace overhead;
+    const std::uint64_t rounds = 10000;
+    Nanos sink = 0;
+    const Nanos overheadStart = monotonicNanos();
+    for (std::uint64_t round = 0; round < rounds; ++round) {
+        overhead.reset();
+        for (std::size_t i = 0; i < TransactionTrace::kCapacity; ++i) {
+            overhead.recordReaderEvent(CardReaderEvent::BatteryStatusUpdated);
+        }
+        sink += overhead.breakdown().segments[0];
+    }
+    const double nanosPerEvent = static_cast<double>(monotonicNanos() - overheadStart) /
+                                 static_cast<double>(rounds * TransactionTrace::kCapacity);
+
+    const bool passed = inconsistent == 0 && aggregator.count() == transactions && sink != ~Nanos(0) &&
+                        checkFallbackWithoutCard();
+    std::printf("trace         %llu transactions, %.1f ns per event, %s\n",
+                static_cast<unsigned long long>(transactions),
+                nanosPerEvent,
+                passed ? "ok" : "FAILED");
+    std::printf("  %-28s %10s %12s %12s %12s\n", "segment", "count", "mean(us)", "p50(us)", "p99(us)");
+    for (std::size_t i = 0; i < kTraceSegmentCount; ++i) {
+        const auto segment = static_cast<TraceSegment>(i);
+        printHistogram(traceSegmentName(segment), aggregator.segment(segment));
+    }
+    for (std::size_t i = 1; i < kTransactionStateCount; ++i) {
+        const auto state = static_cast<TransactionState>(i);
+        printHistogram(transactionStateName(state), aggregator.state(state));
+    }
+    return passed;
+}
+
+} // namespace harness
+} // namespace cft
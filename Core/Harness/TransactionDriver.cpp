@@ -0,0 +1,168 @@
+//
+//  TransactionDriver.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "TransactionDriver.hpp"
+
+namespace cft {
+namespace harness {
+
+#define CFT_RETURN_IF_ERROR(expression)         \
+    do {                                        \
+        const ErrorCode _code = (expression);   \
+        if (_code != ErrorCode::None) {         \
+            return _code;                       \
+        }                                       \
+    } while (0)
+
+TransactionOutcome TransactionDriver::run(const TransactionPlan &plan) {
+    TransactionOutcome outcome;
+    _machine.reset();
+    _cardInputMethod = plan.cardInputMethod;
+    _cardRead = false;
+    _chipInserted = false;
+    _pinEntered = false;
+    if (_trace != nullptr) {
+        _trace->reset();
+    }
+
+    auto finish = [&](ErrorCode error) {
+        outcome.error = error;
+        outcome.finalState = _machine.state();
+        outcome.result = _machine.result();
+        return outcome;
+    };
+
+    ErrorCode error = _machine.apply(TransactionEvent::Begin);
+    if (error == ErrorCode::None) {
+        error = _machine.apply(TransactionEvent::AttachParameters);
+    }
+    if (error != ErrorCode::None) {
+        return finish(error);
+    }
+
+    if (!SimulatedReader::supports(_reader.model(), plan.cardInputMethod)) {
+        return finish(_machine.apply(TransactionEvent::SelectCancel));
+    }
+
+    if (plan.cardInputMethod != CardInputMethod::Key) {
+        ReaderScriptOptions options;
+        options.stepDelay = plan.readerStepDelay;
+        options.connect = plan.connectReader;
+        options.applications = plan.applications;
+        options.pinEntry = plan.pinEntry;
+        _reader.play(SimulatedReader::script(_reader.model(), plan.cardInputMethod, options), *this);
+        if (!_cardRead && !_chipInserted) {
+            return finish(_machine.apply(TransactionEvent::Fail));
+        }
+    }
+    error = _machine.apply(TransactionEvent::ReceiveCardInput);
+    if (error != ErrorCode::None) {
+        return finish(error);
+    }
+
+    switch (plan.processOption) {
+        case ProcessOption::Defer:
+            error = _machine.apply(TransactionEvent::SelectDefer);
+            if (error == ErrorCode::None && plan.resumeDeferred) {
+                error = _machine.apply(TransactionEvent::Resume);
+                if (error == ErrorCode::None) {
+                    error = process(plan, outcome);
+                }
+            }
+            break;
+        case ProcessOption::Cancel:
+            error = _machine.apply(TransactionEvent::SelectCancel);
+            break;
+        default:
+            error = process(plan, outcome);
+            break;
+    }
+    return finish(error);
+}
+
+ErrorCode TransactionDriver::process(const TransactionPlan &plan, TransactionOutcome &outcome) {
+    CFT_RETURN_IF_ERROR(_machine.apply(TransactionEvent::SelectProcess));
+
+    GatewayRequest request;
+    request.type = plan.type;
+    request.cardInputMethod = plan.cardInputMethod;
+    request.amountMinor = plan.amountMinor;
+    request.cvm = _pinEntered ? Cvm::Pin : Cvm::None;
+    if (_trace != nullptr) {
+        _trace->recordGatewayRequest(static_cast<std::int32_t>(request.operation));
+    }
+    const GatewayResponse response = _gateway.authorize(request);
+    if (_trace != nullptr) {
+        _trace->recordGatewayResponse(static_cast<std::int32_t>(request.operation),
+                                      response.result == TransactionResult::Errored ? ErrorCode::Declined : ErrorCode::None);
+    }
+    outcome.transactionId = response.transactionId;
+
+    if (response.result == TransactionResult::Errored) {
+        return _machine.apply(TransactionEvent::Fail);
+    }
+    if (response.result == TransactionResult::Approved) {
+        if (response.cvm == Cvm::Signature) {
+            CFT_RETURN_IF_ERROR(_machine.apply(TransactionEvent::RequestCvm));
+            CFT_RETURN_IF_ERROR(_machine.apply(TransactionEvent::AttachCvm));
+        }
+        if (plan.isAdjustmentRequested) {
+            CFT_RETURN_IF_ERROR(_machine.apply(TransactionEvent::RequestAdjustment));
+            CFT_RETURN_IF_ERROR(_machine.apply(TransactionEvent::AttachAdjustment));
+        }
+    }
+    return _machine.apply(TransactionEvent::Complete, response.result);
+}
+
+void TransactionDriver::stateMachineDidTransition(const TransactionStateMachine &machine,
+                                                  TransactionState from,
+                                                  TransactionState to,
+                                                  Nanos timeInPrevious) {
+    if (_trace != nullptr) {
+        _trace->recordState(to);
+    }
+    if (_observer != nullptr) {
+        _observer->stateMachineDidTransition(machine, from, to, timeInPrevious);
+    }
+}
+
+void TransactionDriver::readerDidReceiveEvent(CardReaderEvent event) {
+    if (_trace != nullptr) {
+        _trace->recordReaderEvent(event);
+    }
+    switch (event) {
+        case CardReaderEvent::CardSwiped:
+        case CardReaderEvent::CardTapped:
+            _cardRead = true;
+            break;
+        case CardReaderEvent::CardInserted:
+            _chipInserted = true;
+            break;
+        case CardReaderEvent::CardInsertErrored:
+            _chipInserted = false;
+            break;
+        case CardReaderEvent::CardRemoved:
+            // An abandoned dip leaves the transaction waiting for card input, as in swipe fallback; quick chip
+            // has already read the chip by the time the card comes out.
+            if (_cardInputMethod == CardInputMethod::QuickChip && _chipInserted) {
+                _cardRead = true;
+            }
+            _chipInserted = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void TransactionDriver::readerDidCapturePin() {
+    _pinEntered = true;
+}
+
+#undef CFT_RETURN_IF_ERROR
+
+} // namespace harness
+} // namespace cft
@@ -0,0 +1,81 @@
+/*!
+ * @header TransactionDriver.hpp
+ *
+ * @brief Runs one transaction end to end against a SimulatedReader and MockGateway,
+ * the same way CFTTransaction drives a physical reader and the live gateway.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "cft/Error.hpp"
+#include "cft/TransactionStateMachine.hpp"
+#include "cft/TransactionTrace.hpp"
+#include "MockGateway.hpp"
+#include "SimulatedReader.hpp"
+
+namespace cft {
+namespace harness {
+
+struct TransactionPlan {
+    TransactionType type = TransactionType::Sale;
+    CardInputMethod cardInputMethod = CardInputMethod::Swipe;
+    ProcessOption processOption = ProcessOption::Process;
+    std::int64_t amountMinor = 0;
+    bool isAdjustmentRequested = false;
+    bool resumeDeferred = false;
+    Nanos readerStepDelay = 0;
+    bool connectReader = false;
+    std::uint8_t applications = 1;
+    bool pinEntry = false;
+};
+
+struct TransactionOutcome {
+    ErrorCode error = ErrorCode::None;
+    TransactionState finalState = TransactionState::Unknown;
+    TransactionResult result = TransactionResult::Unknown;
+    std::uint64_t transactionId = 0;
+};
+
+class TransactionDriver : private SimulatedReader::Listener, private TransactionStateMachine::Observer {
+public:
+    TransactionDriver(SimulatedReader &reader, Gateway &gateway, TransactionStateMachine::Observer *observer)
+        : _reader(reader), _gateway(gateway), _observer(observer), _machine(this) {}
+
+    /*!
+     * @brief Record each run's states, reader events and gateway round trips into trace
+     * @discussion The trace is reset at the start of every run; pass nullptr to stop tracing.
+     */
+    void setTrace(TransactionTrace *trace) { _trace = trace; }
+
+    /*!
+     * @brief Run plan to a terminal state
+     * @discussion The first illegal transition aborts the run and is reported in the outcome.
+     */
+    TransactionOutcome run(const TransactionPlan &plan);
+
+private:
+    void readerDidReceiveEvent(CardReaderEvent event) override;
+    void readerDidCapturePin() override;
+    void stateMachineDidTransition(const TransactionStateMachine &machine,
+                                   TransactionState from,
+                                   TransactionState to,
+                                   Nanos timeInPrevious) override;
+    ErrorCode process(const TransactionPlan &plan, TransactionOutcome &outcome);
+
+    SimulatedReader &_reader;
+    Gateway &_gateway;
+    TransactionStateMachine::Observer *_observer;
+    TransactionTrace *_trace = nullptr;
+    TransactionStateMachine _machine;
+    CardInputMethod _cardInputMethod = CardInputMethod::Unknown;
+    bool _cardRead = false;
+    bool _chipInserted = false;
+    bool _pinEntered = false;
+};
+
+} // namespace harness
+} // namespace cft
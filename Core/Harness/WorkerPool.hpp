@@ -0,0 +1,77 @@
+/*!
+ * @header WorkerPool.hpp
+ *
+ * @brief Minimal fixed-size thread pool used by the harness to stand in for the
+ * SDK's asynchronous network completions.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cft {
+namespace harness {
+
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads) {
+        for (unsigned i = 0; i < threads; ++i) {
+            _threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (std::thread &thread : _threads) {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _tasks.push_back(std::move(task));
+        }
+        _wake.notify_one();
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                _wake.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    return;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::deque<std::function<void()>> _tasks;
+    std::vector<std::thread> _threads;
+    bool _stopping = false;
+};
+
+} // namespace harness
+} // namespace cft
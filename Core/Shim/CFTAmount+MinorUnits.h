@@ -0,0 +1,142 @@
+/*!
+ * @header CFTAmount+MinorUnits.h
+ *
+ * @brief Amounts as whole cents.
+ * A CFTAmount wraps an NSDecimalNumber, which is exact but costs an object and decimal
+ * arithmetic per value. Code that totals or adjusts many amounts can keep them as int64 cents
+ * in a CFTAmountBuffer instead and only create CFTAmount objects for the values it shows.
+ * Arithmetic on cents is checked: a total that does not fit fails rather than wrapping.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTAmount.h>
+
+@interface CFTAmount (MinorUnits)
+
+/*!
+ * @property minorUnits
+ * @brief The amount in cents, rounded half to even
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) int64_t minorUnits;
+
+/*!
+ * @brief Amount of minorUnits cents
+ * @discussion Negative values become 0, as they do for amountWithDecimalNumber:.
+ * Added in 4.12.0
+ */
++ (nonnull instancetype)amountWithMinorUnits:(int64_t)minorUnits
+NS_SWIFT_NAME(init(minorUnits:));
+
+@end
+
+@interface CFTAmountAggregate : NSObject
+
+/*!
+ * @property count
+ * @brief Amounts aggregated
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/*!
+ * @property totalMinorUnits
+ * @brief Sum in cents; negative when refunds outweigh sales
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) int64_t totalMinorUnits;
+
+/*!
+ * @property minimumMinorUnits
+ * @brief Smallest amount in cents, 0 when count is 0
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) int64_t minimumMinorUnits;
+
+/*!
+ * @property maximumMinorUnits
+ * @brief Largest amount in cents, 0 when count is 0
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) int64_t maximumMinorUnits;
+
+/*!
+ * @property total
+ * @brief totalMinorUnits as an amount, created when first read
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *total;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTAmountBuffer : NSObject
+
+/*!
+ * @property count
+ * @brief Amounts appended so far
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/*!
+ * @brief Empty buffer with room for capacity amounts before it grows
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity;
+
+/*!
+ * @brief Buffer holding amounts, in order
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithAmounts:(nonnull NSArray<CFTAmount *> *)amounts;
+
+/*!
+ * @discussion A buffer is not thread safe; use it from one queue at a time.
+ * Added in 4.12.0
+ */
+- (void)appendAmount:(nonnull CFTAmount *)amount;
+
+/*!
+ * @brief Append minorUnits cents; refunds and reversals may be negative
+ * Added in 4.12.0
+ */
+- (void)appendMinorUnits:(int64_t)minorUnits;
+
+/*!
+ * @brief Cents at index, which must be below count
+ * Added in 4.12.0
+ */
+- (int64_t)minorUnitsAtIndex:(NSUInteger)index;
+
+/*!
+ * @brief Amount at index, which must be below count
+ * @discussion The CFTAmount is created by this call; the buffer only holds cents.
+ * Added in 4.12.0
+ */
+- (nonnull CFTAmount *)amountAtIndex:(NSUInteger)index;
+
+/*!
+ * @brief Sum of every amount in cents
+ * @param total int64_t * - Set to the sum on success
+ * @param error NSError ** - CFTCoreErrorCodeInvalidArgument if the sum does not fit in 64 bits
+ * @return BOOL - YES on success
+ * Added in 4.12.0
+ */
+- (BOOL)totalMinorUnits:(nonnull int64_t *)total error:(NSError * _Nullable * _Nullable)error;
+
+/*!
+ * @brief Total, minimum, maximum and count of every amount
+ * @return CFTAmountAggregate - nil if the total does not fit in 64 bits
+ * Added in 4.12.0
+ */
+- (nullable CFTAmountAggregate *)aggregateWithError:(NSError * _Nullable * _Nullable)error;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
@@ -0,0 +1,122 @@
+//
+//  CFTAmount+MinorUnits.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTAmount+MinorUnits.h"
+#import "CFTCorePrivate.h"
+
+#include <vector>
+
+#include "cft/Amount.hpp"
+
+@implementation CFTAmount (MinorUnits)
+
+- (int64_t)minorUnits {
+    return CFTCoreMinorUnits(self);
+}
+
++ (instancetype)amountWithMinorUnits:(int64_t)minorUnits {
+    return CFTCoreAmountWithMinorUnits(minorUnits);
+}
+
+@end
+
+@interface CFTAmountAggregate ()
+
+- (nonnull instancetype)initWithAggregate:(const cft::AmountAggregate &)aggregate;
+
+@end
+
+@implementation CFTAmountAggregate {
+    CFTAmount *_total;
+}
+
+- (instancetype)initWithAggregate:(const cft::AmountAggregate &)aggregate {
+    self = [super init];
+    if (self) {
+        _count = static_cast<NSUInteger>(aggregate.count);
+        _totalMinorUnits = aggregate.total;
+        _minimumMinorUnits = aggregate.minimum;
+        _maximumMinorUnits = aggregate.maximum;
+    }
+    return self;
+}
+
+- (CFTAmount *)total {
+    @synchronized (self) {
+        if (_total == nil) {
+            _total = CFTCoreAmountWithMinorUnits(_totalMinorUnits);
+        }
+        return _total;
+    }
+}
+
+@end
+
+@implementation CFTAmountBuffer {
+    std::vector<int64_t> _minorUnits;
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (self) {
+        _minorUnits.reserve(capacity);
+    }
+    return self;
+}
+
+- (instancetype)initWithAmounts:(NSArray<CFTAmount *> *)amounts {
+    self = [self initWithCapacity:amounts.count];
+    if (self) {
+        for (CFTAmount *amount in amounts) {
+            _minorUnits.push_back(CFTCoreMinorUnits(amount));
+        }
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return static_cast<NSUInteger>(_minorUnits.size());
+}
+
+- (void)appendAmount:(CFTAmount *)amount {
+    _minorUnits.push_back(CFTCoreMinorUnits(amount));
+}
+
+- (void)appendMinorUnits:(int64_t)minorUnits {
+    _minorUnits.push_back(minorUnits);
+}
+
+- (int64_t)minorUnitsAtIndex:(NSUInteger)index {
+    if (index >= _minorUnits.size()) {
+        [NSException raise:NSRangeException format:@"index %lu beyond count %lu",
+                           static_cast<unsigned long>(index), static_cast<unsigned long>(_minorUnits.size())];
+    }
+    return _minorUnits[index];
+}
+
+- (CFTAmount *)amountAtIndex:(NSUInteger)index {
+    return CFTCoreAmountWithMinorUnits([self minorUnitsAtIndex:index]);
+}
+
+- (BOOL)totalMinorUnits:(int64_t *)total error:(NSError **)error {
+    int64_t sum = 0;
+    if (!CFTCoreSucceeded(cft::sumMinorUnits(_minorUnits.data(), _minorUnits.size(), sum), error)) {
+        return NO;
+    }
+    *total = sum;
+    return YES;
+}
+
+- (CFTAmountAggregate *)aggregateWithError:(NSError **)error {
+    cft::AmountAggregate aggregate;
+    if (!CFTCoreSucceeded(cft::aggregateMinorUnits(_minorUnits.data(), _minorUnits.size(), aggregate), error)) {
+        return nil;
+    }
+    return [[CFTAmountAggregate alloc] initWithAggregate:aggregate];
+}
+
+@end
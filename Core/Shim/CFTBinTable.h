@@ -0,0 +1,161 @@
+/*!
+ * @header CFTBinTable.h
+ *
+ * @brief Card brand, network and PAN checks from the leading digits, without a round trip.
+ * A CFTBinTable answers from a file of BIN ranges mapped into memory, so it can classify a card
+ * on every keystroke of keyed entry and the moment a swipe is read, and say whether a debit card
+ * can be routed offline. The server sends the file once and deltas after that.
+ *
+ * Lookups can be made from any queue and never wait on applyDeltaData:error:.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTCardInfo;
+
+/*!
+ * @typedef CFTBinFlags
+ * @brief What else the table knows about cards in a range
+ * Added in 4.12.0
+ */
+typedef NS_OPTIONS(NSUInteger, CFTBinFlags) {
+    CFTBinFlagsNone = 0,
+    CFTBinFlagsPrepaid = 1 << 0,
+    CFTBinFlagsCommercial = 1 << 1,
+    /*! Debit card of an issuer under the interchange cap, routable over an unaffiliated network */
+    CFTBinFlagsRegulated = 1 << 2
+};
+
+/*!
+ * @typedef CFTPanCheck
+ * @brief Result of checking a whole PAN against its range
+ * @constant CFTPanCheckValid Length fits the range and the check digit is right
+ * @constant CFTPanCheckIncomplete Fewer digits than the range's shortest PAN
+ * @constant CFTPanCheckTooLong More digits than the range's longest PAN
+ * @constant CFTPanCheckBadCheckDigit The Luhn check digit is wrong
+ * @constant CFTPanCheckUnknownBin No range holds the PAN, or it has non-digit characters
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTPanCheck) {
+    CFTPanCheckValid,
+    CFTPanCheckIncomplete,
+    CFTPanCheckTooLong,
+    CFTPanCheckBadCheckDigit,
+    CFTPanCheckUnknownBin
+};
+
+@interface CFTBinInfo : NSObject
+
+/*!
+ * @property cardBrand
+ * @brief Known as soon as every card under the digits shares a brand, often before matched
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTCardBrand cardBrand;
+
+/*!
+ * @property networkType
+ * @brief CFTNetworkTypeUnknown until matched
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTNetworkType networkType;
+
+/*!
+ * @property flags
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTBinFlags flags;
+
+/*!
+ * @property minPanLength
+ * @brief Shortest PAN the issuer uses, 0 until matched
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger minPanLength;
+
+/*!
+ * @property maxPanLength
+ * @brief Longest PAN the issuer uses, 0 until matched
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger maxPanLength;
+
+/*!
+ * @property matched
+ * @brief YES when the digits fall in a single range of the table
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign, getter=isMatched) BOOL matched;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTBinTable : NSObject
+
+/*!
+ * @property version
+ * @brief Version of the table, which the next delta must start from
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint32_t version;
+
+/*!
+ * @property rangeCount
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger rangeCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Open a table the server sent
+ * @param fileURL NSURL - File holding the table
+ * @param error NSError - CFTCoreErrorCodeNotFound if there is no file, CFTCoreErrorCodeInvalidArgument
+ * if it is not a BIN table or is damaged
+ * Added in 4.12.0
+ */
+- (nullable instancetype)initWithFileURL:(nonnull NSURL *)fileURL
+                                   error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(fileURL:));
+
+/*!
+ * @brief Classify a card from the digits entered so far
+ * @param digits NSString - Leading digits of the PAN; only the first eight are used
+ * @return CFTBinInfo - Empty if digits holds anything but ASCII digits
+ * Added in 4.12.0
+ */
+- (nonnull CFTBinInfo *)classifyDigits:(nonnull NSString *)digits
+NS_SWIFT_NAME(classify(digits:));
+
+/*!
+ * @brief Classify a card the SDK has read, from its firstSix
+ * Added in 4.12.0
+ */
+- (nonnull CFTBinInfo *)classifyCardInfo:(nonnull CFTCardInfo *)cardInfo
+NS_SWIFT_NAME(classify(cardInfo:));
+
+/*!
+ * @brief Check a keyed PAN's length and check digit against its range
+ * Added in 4.12.0
+ */
+- (CFTPanCheck)checkPan:(nonnull NSString *)pan
+NS_SWIFT_NAME(check(pan:));
+
+/*!
+ * @brief Apply a delta from the server and rewrite the file
+ * @param deltaData NSData - The delta as sent
+ * @param error NSError - CFTCoreErrorCodeInvalidArgument if the delta is damaged or does not start
+ * from version, CFTCoreErrorCodeIOFailure if the file cannot be rewritten
+ * @return BOOL - YES once lookups answer from the new table
+ * Added in 4.12.0
+ */
+- (BOOL)applyDeltaData:(nonnull NSData *)deltaData error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(applyDelta(_:));
+
+@end
@@ -0,0 +1,105 @@
+//
+//  CFTBinTable.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTBinTable.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTCardInfo.h>
+
+#include <cstring>
+#include <memory>
+
+#include "cft/BinTable.hpp"
+
+static_assert(static_cast<NSInteger>(cft::CardBrand::Visa) == CFTCardBrandVisa, "");
+static_assert(static_cast<NSInteger>(cft::NetworkType::Debit) == CFTNetworkTypeDebit, "");
+static_assert(CFTBinFlagsRegulated == cft::BinFlagRegulated, "");
+static_assert(static_cast<NSInteger>(cft::PanCheck::UnknownBin) == CFTPanCheckUnknownBin, "");
+
+@interface CFTBinInfo ()
+
+- (nonnull instancetype)initWithInfo:(const cft::BinInfo &)info;
+
+@end
+
+@implementation CFTBinInfo
+
+- (instancetype)initWithInfo:(const cft::BinInfo &)info {
+    self = [super init];
+    if (self) {
+        _cardBrand = static_cast<CFTCardBrand>(info.brand);
+        _networkType = static_cast<CFTNetworkType>(info.network);
+        _flags = info.flags;
+        _minPanLength = info.minPanLength;
+        _maxPanLength = info.maxPanLength;
+        _matched = info.matched;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTBinTable {
+    std::unique_ptr<cft::BinTable> _table;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        if (!fileURL.isFileURL) {
+            CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+            return nil;
+        }
+        if (!CFTCoreSucceeded(cft::BinTable::open(fileURL.fileSystemRepresentation, _table), error)) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (uint32_t)version {
+    return _table->version();
+}
+
+- (NSUInteger)rangeCount {
+    return _table->rangeCount();
+}
+
+- (CFTBinInfo *)classifyDigits:(NSString *)digits {
+    // Only the first eight digits matter, so a longer string is never copied whole.
+    char ascii[cft::kBinDigits];
+    NSUInteger count = 0;
+    [digits getBytes:ascii maxLength:sizeof(ascii) usedLength:&count encoding:NSASCIIStringEncoding
+             options:0 range:NSMakeRange(0, digits.length) remainingRange:NULL];
+    if (count < MIN(digits.length, sizeof(ascii))) {
+        return [[CFTBinInfo alloc] initWithInfo:cft::BinInfo()];
+    }
+    return [[CFTBinInfo alloc] initWithInfo:_table->classify(ascii, count)];
+}
+
+- (CFTBinInfo *)classifyCardInfo:(CFTCardInfo *)cardInfo {
+    return [self classifyDigits:cardInfo.firstSix ?: @""];
+}
+
+- (CFTPanCheck)checkPan:(NSString *)pan {
+    const char *ascii = [pan cStringUsingEncoding:NSASCIIStringEncoding];
+    if (ascii == NULL) {
+        return CFTPanCheckUnknownBin;
+    }
+    return static_cast<CFTPanCheck>(_table->checkPan(ascii, std::strlen(ascii)));
+}
+
+- (BOOL)applyDeltaData:(NSData *)deltaData error:(NSError **)error {
+    cft::BinDelta delta;
+    if (!CFTCoreSucceeded(cft::decodeBinDelta(static_cast<const std::uint8_t *>(deltaData.bytes), deltaData.length, delta),
+                          error)) {
+        return NO;
+    }
+    return CFTCoreSucceeded(_table->applyDelta(delta), error);
+}
+
+@end
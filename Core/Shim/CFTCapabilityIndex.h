@@ -0,0 +1,180 @@
+/*!
+ * @header CFTCapabilityIndex.h
+ *
+ * @brief Synchronous, constant-time capability bitmasks.
+ * The capability queries of CFTMerchantAccountManager, CFTTransactionManager and CFTDeviceManager
+ * answer through a block with an array of boxed enum values. CFTCapabilityIndex asks each question
+ * once and keeps the answer as a bitmask that can be read from any queue without waiting, such as
+ * once per row while rendering a list of thousands of transactions.
+ *
+ * A transaction's capabilities are learned once per transaction and API state: they also depend
+ * on its batch, merchant account and processor, so no answer is shared between transactions.
+ * Until a transaction is known, lookups return an empty mask and start the query; a change
+ * notification follows.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTMerchantAccount;
+@class CFTMerchantAccountManager;
+@class CFTTransactionManager;
+@class CFTTransactionRecord;
+@class CFTTransactionRecordSummary;
+
+/*!
+ * @typedef CFTMerchantAccountCapabilities
+ * @brief Bitmask of CFTMerchantAccountCapability values
+ * Added in 4.12.0
+ */
+typedef NS_OPTIONS(NSUInteger, CFTMerchantAccountCapabilities) {
+    CFTMerchantAccountCapabilitiesNone = 0,
+    CFTMerchantAccountCapabilitiesCanProcessCredit = 1 << CFTMerchantAccountCapabilityCanProcessCredit,
+    CFTMerchantAccountCapabilitiesCanAdjustTransactions = 1 << CFTMerchantAccountCapabilityCanAdjustTransactions,
+    CFTMerchantAccountCapabilitiesCanDeferTransactions = 1 << CFTMerchantAccountCapabilityCanDeferTransactions,
+    CFTMerchantAccountCapabilitiesCanProcessDebit = 1 << CFTMerchantAccountCapabilityCanProcessDebit
+};
+
+/*!
+ * @typedef CFTTransactionCapabilities
+ * @brief Bitmask of CFTTransactionCapability values
+ * Added in 4.12.0
+ */
+typedef NS_OPTIONS(NSUInteger, CFTTransactionCapabilities) {
+    CFTTransactionCapabilitiesNone = 0,
+    CFTTransactionCapabilitiesCanBeRefundedWithCardInput = 1 << CFTTransactionCapabilityCanBeRefundedWithCardInput,
+    CFTTransactionCapabilitiesCanBeRefundedWithoutCardInput = 1 << CFTTransactionCapabilityCanBeRefundedWithoutCardInput,
+    CFTTransactionCapabilitiesCanBeVoided = 1 << CFTTransactionCapabilityCanBeVoided
+};
+
+/*!
+ * @typedef CFTDeviceManagerCapabilities
+ * @brief Bitmask of CFTDeviceManagerCapability values
+ * Added in 4.12.0
+ */
+typedef NS_OPTIONS(NSUInteger, CFTDeviceManagerCapabilities) {
+    CFTDeviceManagerCapabilitiesNone = 0,
+    CFTDeviceManagerCapabilitiesHasIntegratedKeypad = 1 << CFTDeviceManagerCapabilityHasIntegratedKeypad
+};
+
+/*!
+ * @brief Posted on the main queue when the capabilities of a merchant account change.
+ * The userInfo holds the merchantAccountId under CFTCapabilityMerchantAccountIdKey.
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSNotificationName _Nonnull const CFTMerchantAccountCapabilitiesDidChangeNotification;
+
+/*!
+ * @brief Posted on the main queue when learned transaction capabilities change.
+ * Coalesced: one notification covers every transaction answered since the last one.
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSNotificationName _Nonnull const CFTTransactionCapabilitiesDidChangeNotification;
+
+/*!
+ * @brief Posted on the main queue when the capabilities of the device change
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSNotificationName _Nonnull const CFTDeviceManagerCapabilitiesDidChangeNotification;
+
+/*!
+ * @brief userInfo key of CFTMerchantAccountCapabilitiesDidChangeNotification
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSString * _Nonnull const CFTCapabilityMerchantAccountIdKey;
+
+/*!
+ * @brief Bitmask of an array of boxed capability values, as returned by the SDK's capability queries
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSUInteger CFTCapabilityMaskFromArray(NSArray<NSNumber *> * _Nonnull capabilities);
+
+@interface CFTCapabilityIndex : NSObject
+
+/*!
+ * @property deviceCapabilities
+ * @brief Capabilities of this device. Empty until loadDeviceCapabilities has completed.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTDeviceManagerCapabilities deviceCapabilities;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Create an index answering through the given managers
+ * @param merchantAccountManager CFTMerchantAccountManager - Manager for merchant account queries
+ * @param transactionManager CFTTransactionManager - Manager for transaction queries
+ * @discussion Use one index per merchant account.
+ * Loads device capabilities right away.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithMerchantAccountManager:(nonnull CFTMerchantAccountManager *)merchantAccountManager
+                                    transactionManager:(nonnull CFTTransactionManager *)transactionManager
+NS_SWIFT_NAME(init(merchantAccountManager:transactionManager:));
+
+/*!
+ * @brief Capabilities of a merchant account, without waiting
+ * @return CFTMerchantAccountCapabilities - Empty until loadCapabilitiesForMerchantAccount: has completed
+ * Added in 4.12.0
+ */
+- (CFTMerchantAccountCapabilities)capabilitiesForMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+NS_SWIFT_NAME(capabilities(merchantAccount:));
+
+/*!
+ * @brief Capabilities of a transaction record, without waiting
+ * @param transactionRecord CFTTransactionRecord - Record to look up
+ * @param isKnown BOOL - Set to NO when the record has not been answered yet in its current state
+ * @return CFTTransactionCapabilities - Empty while unknown; the query is started and
+ * CFTTransactionCapabilitiesDidChangeNotification is posted once it answers
+ * Added in 4.12.0
+ */
+- (CFTTransactionCapabilities)capabilitiesForTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                                                       isKnown:(nullable BOOL *)isKnown
+NS_SWIFT_NAME(capabilities(transactionRecord:isKnown:));
+
+/*!
+ * @brief Capabilities of a stored record summary, without waiting
+ * @discussion Same as capabilitiesForTransactionRecord:isKnown:. The query for an unknown transaction needs
+ * a full record, so it only starts when summary.transactionRecord is in memory.
+ * Added in 4.12.0
+ */
+- (CFTTransactionCapabilities)capabilitiesForTransactionRecordSummary:(nonnull CFTTransactionRecordSummary *)summary
+                                                              isKnown:(nullable BOOL *)isKnown
+NS_SWIFT_NAME(capabilities(summary:isKnown:));
+
+/*!
+ * @brief Query a merchant account's capabilities again
+ * @param completion Block - Called on the main queue with the new capabilities, may be nil
+ * Added in 4.12.0
+ */
+- (void)loadCapabilitiesForMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                                completion:(void (^ _Nullable)(CFTMerchantAccountCapabilities capabilities))completion
+NS_SWIFT_NAME(loadCapabilities(merchantAccount:completion:));
+
+/*!
+ * @brief Learn the capabilities of every record in a list before it is shown
+ * @param completion Block - Called on the main queue once every record is known, may be nil
+ * Added in 4.12.0
+ */
+- (void)loadCapabilitiesForTransactionRecords:(nonnull NSArray<CFTTransactionRecord *> *)transactionRecords
+                                   completion:(void (^ _Nullable)(void))completion
+NS_SWIFT_NAME(loadCapabilities(transactionRecords:completion:));
+
+/*!
+ * @brief Query the device's capabilities again
+ * Added in 4.12.0
+ */
+- (void)loadDeviceCapabilities
+NS_SWIFT_NAME(loadDeviceCapabilities());
+
+/*!
+ * @brief Forget every learned transaction capability, e.g. after the merchant account's configuration changed
+ * Added in 4.12.0
+ */
+- (void)invalidateTransactionCapabilities
+NS_SWIFT_NAME(invalidateTransactionCapabilities());
+
+@end
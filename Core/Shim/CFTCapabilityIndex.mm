@@ -0,0 +1,261 @@
+//
+//  CFTCapabilityIndex.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTCapabilityIndex.h"
+#import "CFTTransactionRecordStore.h"
+
+#import <CardFlight/CFTCardInfo.h>
+#import <CardFlight/CFTDeviceManager.h>
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTMerchantAccountManager.h>
+#import <CardFlight/CFTTransactionManager.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <atomic>
+#include <memory>
+
+#include "cft/CapabilityTable.hpp"
+
+NSNotificationName const CFTMerchantAccountCapabilitiesDidChangeNotification = @"CFTMerchantAccountCapabilitiesDidChangeNotification";
+NSNotificationName const CFTTransactionCapabilitiesDidChangeNotification = @"CFTTransactionCapabilitiesDidChangeNotification";
+NSNotificationName const CFTDeviceManagerCapabilitiesDidChangeNotification = @"CFTDeviceManagerCapabilitiesDidChangeNotification";
+NSString * const CFTCapabilityMerchantAccountIdKey = @"merchantAccountId";
+
+static_assert(CFTTransactionCapabilitiesCanBeVoided == cft::capabilityBit(cft::TransactionCapability::CanBeVoided), "");
+static_assert(CFTMerchantAccountCapabilitiesCanProcessDebit == cft::capabilityBit(cft::MerchantAccountCapability::CanProcessDebit), "");
+static_assert(CFTDeviceManagerCapabilitiesHasIntegratedKeypad == cft::capabilityBit(cft::DeviceManagerCapability::HasIntegratedKeypad), "");
+
+NSUInteger CFTCapabilityMaskFromArray(NSArray<NSNumber *> *capabilities) {
+    NSUInteger mask = 0;
+    for (NSNumber *capability in capabilities) {
+        const NSInteger value = capability.integerValue;
+        // The table stores 32-bit masks, so only capabilities 0 to 31 are representable.
+        if (value >= 0 && value < 32) {
+            mask |= (NSUInteger)1 << value;
+        }
+    }
+    return mask;
+}
+
+static cft::TransactionCapabilityKey CFTCapabilityKey(NSString *transactionId, CFTApiTransactionState state) {
+    cft::TransactionCapabilityKey key;
+    const char *utf8 = transactionId.UTF8String;
+    if (utf8 != NULL) {
+        key.transactionId = utf8;
+    }
+    key.state = static_cast<cft::ApiTransactionState>(state);
+    return key;
+}
+
+static cft::TransactionCapabilityKey CFTCapabilityKeyForRecord(CFTTransactionRecord *transactionRecord) {
+    return CFTCapabilityKey(transactionRecord.transactionId, transactionRecord.apiTransactionState);
+}
+
+@implementation CFTCapabilityIndex {
+    __weak CFTMerchantAccountManager *_merchantAccountManager;
+    __weak CFTTransactionManager *_transactionManager;
+    std::unique_ptr<cft::TransactionCapabilityTable> _transactions;
+    std::atomic<NSUInteger> _device;
+    // Guarded by @synchronized(_merchantAccounts).
+    NSMutableDictionary<NSString *, NSNumber *> *_merchantAccounts;
+    // Main queue only: completions waiting on the query for each transactionId.
+    NSMutableDictionary<NSString *, NSMutableArray<dispatch_block_t> *> *_pendingQueries;
+    BOOL _transactionNotificationScheduled;
+}
+
+- (instancetype)initWithMerchantAccountManager:(CFTMerchantAccountManager *)merchantAccountManager
+                            transactionManager:(CFTTransactionManager *)transactionManager {
+    self = [super init];
+    if (self) {
+        _merchantAccountManager = merchantAccountManager;
+        _transactionManager = transactionManager;
+        _transactions.reset(new cft::TransactionCapabilityTable());
+        _device.store(0);
+        _merchantAccounts = [NSMutableDictionary dictionary];
+        _pendingQueries = [NSMutableDictionary dictionary];
+        [self loadDeviceCapabilities];
+    }
+    return self;
+}
+
+- (CFTDeviceManagerCapabilities)deviceCapabilities {
+    return _device.load(std::memory_order_acquire);
+}
+
+- (CFTMerchantAccountCapabilities)capabilitiesForMerchantAccount:(CFTMerchantAccount *)merchantAccount {
+    NSString *merchantAccountId = merchantAccount.merchantAccountId;
+    if (merchantAccountId == nil) {
+        return CFTMerchantAccountCapabilitiesNone;
+    }
+    @synchronized (_merchantAccounts) {
+        return _merchantAccounts[merchantAccountId].unsignedIntegerValue;
+    }
+}
+
+- (CFTTransactionCapabilities)capabilitiesForTransactionRecord:(CFTTransactionRecord *)transactionRecord isKnown:(BOOL *)isKnown {
+    cft::CapabilityMask mask = 0;
+    const BOOL known = _transactions->lookup(CFTCapabilityKeyForRecord(transactionRecord), mask);
+    if (isKnown != NULL) {
+        *isKnown = known;
+    }
+    if (!known) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self queryTransactionRecord:transactionRecord completion:nil];
+        });
+    }
+    return mask;
+}
+
+- (CFTTransactionCapabilities)capabilitiesForTransactionRecordSummary:(CFTTransactionRecordSummary *)summary isKnown:(BOOL *)isKnown {
+    CFTTransactionRecord *transactionRecord = summary.transactionRecord;
+    if (transactionRecord != nil) {
+        return [self capabilitiesForTransactionRecord:transactionRecord isKnown:isKnown];
+    }
+    cft::CapabilityMask mask = 0;
+    const BOOL known = _transactions->lookup(CFTCapabilityKey(summary.transactionId, summary.apiTransactionState), mask);
+    if (isKnown != NULL) {
+        *isKnown = known;
+    }
+    return mask;
+}
+
+- (void)loadCapabilitiesForMerchantAccount:(CFTMerchantAccount *)merchantAccount
+                                completion:(void (^)(CFTMerchantAccountCapabilities))completion {
+    NSString *merchantAccountId = [merchantAccount.merchantAccountId copy];
+    CFTMerchantAccountManager *merchantAccountManager = _merchantAccountManager;
+    if (merchantAccountId == nil || merchantAccountManager == nil) {
+        if (completion != nil) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion([self capabilitiesForMerchantAccount:merchantAccount]);
+            });
+        }
+        return;
+    }
+
+    [merchantAccountManager getCapabilitiesWithMerchantAccount:merchantAccount completion:^(NSArray<NSNumber *> *capabilities) {
+        const CFTMerchantAccountCapabilities mask = CFTCapabilityMaskFromArray(capabilities);
+        BOOL changed = NO;
+        @synchronized (self->_merchantAccounts) {
+            NSNumber *previous = self->_merchantAccounts[merchantAccountId];
+            changed = previous == nil || previous.unsignedIntegerValue != mask;
+            self->_merchantAccounts[merchantAccountId] = @(mask);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (changed) {
+                [[NSNotificationCenter defaultCenter] postNotificationName:CFTMerchantAccountCapabilitiesDidChangeNotification
+                                                                    object:self
+                                                                  userInfo:@{CFTCapabilityMerchantAccountIdKey: merchantAccountId}];
+            }
+            if (completion != nil) {
+                completion(mask);
+            }
+        });
+    }];
+}
+
+- (void)loadCapabilitiesForTransactionRecords:(NSArray<CFTTransactionRecord *> *)transactionRecords
+                                   completion:(void (^)(void))completion {
+    NSArray<CFTTransactionRecord *> *records = [transactionRecords copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        dispatch_group_t group = dispatch_group_create();
+        for (CFTTransactionRecord *transactionRecord in records) {
+            cft::CapabilityMask mask = 0;
+            if (self->_transactions->lookup(CFTCapabilityKeyForRecord(transactionRecord), mask)) {
+                continue;
+            }
+            // A transaction listed twice joins the first row's query.
+            dispatch_group_enter(group);
+            [self queryTransactionRecord:transactionRecord completion:^{
+                dispatch_group_leave(group);
+            }];
+        }
+        dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+            if (completion != nil) {
+                completion();
+            }
+        });
+    });
+}
+
+- (void)loadDeviceCapabilities {
+    [CFTDeviceManager getCapabilitiesWithCompletion:^(NSArray<NSNumber *> *capabilities) {
+        const NSUInteger mask = CFTCapabilityMaskFromArray(capabilities);
+        if (self->_device.exchange(mask, std::memory_order_acq_rel) == mask) {
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:CFTDeviceManagerCapabilitiesDidChangeNotification
+                                                                object:self];
+        });
+    }];
+}
+
+- (void)invalidateTransactionCapabilities {
+    if (_transactions->clear() > 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self scheduleTransactionNotification];
+        });
+    }
+}
+
+#pragma mark - Transaction queries
+
+// Main queue only.
+- (void)queryTransactionRecord:(CFTTransactionRecord *)transactionRecord completion:(nullable dispatch_block_t)completion {
+    const cft::TransactionCapabilityKey key = CFTCapabilityKeyForRecord(transactionRecord);
+    NSString *transactionId = [transactionRecord.transactionId copy];
+    cft::CapabilityMask mask = 0;
+    CFTTransactionManager *transactionManager = _transactionManager;
+    if (key.transactionId.empty() || transactionManager == nil || _transactions->lookup(key, mask)) {
+        if (completion != nil) {
+            completion();
+        }
+        return;
+    }
+
+    NSMutableArray<dispatch_block_t> *waiting = _pendingQueries[transactionId];
+    if (waiting != nil) {
+        if (completion != nil) {
+            [waiting addObject:[completion copy]];
+        }
+        return;
+    }
+    waiting = [NSMutableArray array];
+    if (completion != nil) {
+        [waiting addObject:[completion copy]];
+    }
+    _pendingQueries[transactionId] = waiting;
+
+    [transactionManager getCapabilitiesWithTransactionRecord:transactionRecord completion:^(NSArray<NSNumber *> *capabilities) {
+        const CFTTransactionCapabilities answer = CFTCapabilityMaskFromArray(capabilities);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (self->_transactions->store(key, static_cast<cft::CapabilityMask>(answer))) {
+                [self scheduleTransactionNotification];
+            }
+            NSArray<dispatch_block_t> *completions = self->_pendingQueries[transactionId];
+            [self->_pendingQueries removeObjectForKey:transactionId];
+            for (dispatch_block_t block in completions) {
+                block();
+            }
+        });
+    }];
+}
+
+// Main queue only. A screen that loads a thousand rows gets one notification, not one per transaction.
+- (void)scheduleTransactionNotification {
+    if (_transactionNotificationScheduled) {
+        return;
+    }
+    _transactionNotificationScheduled = YES;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self->_transactionNotificationScheduled = NO;
+        [[NSNotificationCenter defaultCenter] postNotificationName:CFTTransactionCapabilitiesDidChangeNotification
+                                                            object:self];
+    });
+}
+
+@end
@@ -0,0 +1,75 @@
+/*!
+ * @header CFTCardValidation.h
+ *
+ * @brief Checks on keyed and swiped card data that run without allocating, for custom entry
+ * forms that validate on every keystroke and for apps handed raw track data. The same code
+ * parses swipes in the replay tool.
+ *
+ * The checks run sixteen characters at a time where the device supports it.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+/*!
+ * @typedef CFTTrackCheck
+ * @brief Result of parsing a track
+ * @constant CFTTrackCheckValid Parsed, and the PAN passes the Luhn check
+ * @constant CFTTrackCheckBadSentinel No start or end sentinel
+ * @constant CFTTrackCheckBadCharacter A character outside the track's character set
+ * @constant CFTTrackCheckBadLrc The LRC after the end sentinel does not match
+ * @constant CFTTrackCheckBadFormat Separators, field lengths or digits do not fit the format
+ * @constant CFTTrackCheckBadCheckDigit The PAN fails the Luhn check
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTTrackCheck) {
+    CFTTrackCheckValid,
+    CFTTrackCheckBadSentinel,
+    CFTTrackCheckBadCharacter,
+    CFTTrackCheckBadLrc,
+    CFTTrackCheckBadFormat,
+    CFTTrackCheckBadCheckDigit
+};
+
+@interface CFTCardValidation : NSObject
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Luhn check of a keyed PAN
+ * @return BOOL - NO unless pan is 12 to 19 digits
+ * Added in 4.12.0
+ */
++ (BOOL)isValidPan:(nonnull NSString *)pan
+NS_SWIFT_NAME(isValid(pan:));
+
+/*!
+ * @brief Keyed expiry as "MMYY" or "MM/YY", not yet past in the Gregorian calendar
+ * Added in 4.12.0
+ */
++ (BOOL)isValidExpiry:(nonnull NSString *)expiry
+NS_SWIFT_NAME(isValid(expiry:));
+
+/*!
+ * @brief CVV of the right length for the brand, four digits for American Express and three
+ * for the others
+ * Added in 4.12.0
+ */
++ (BOOL)isValidCvv:(nonnull NSString *)cvv cardBrand:(CFTCardBrand)cardBrand
+NS_SWIFT_NAME(isValid(cvv:cardBrand:));
+
+/*!
+ * @brief Parse a track 1 or track 2 as read, checking its sentinels, LRC when present and PAN
+ * @param pan NSString - Set to the PAN when the track is valid, may be NULL
+ * @param expiry NSString - Set to the YYMM expiry when the track is valid, may be NULL
+ * Added in 4.12.0
+ */
++ (CFTTrackCheck)checkTrack:(nonnull NSString *)track
+                        pan:(NSString * _Nullable * _Nullable)pan
+                     expiry:(NSString * _Nullable * _Nullable)expiry
+NS_SWIFT_NAME(check(track:pan:expiry:));
+
+@end
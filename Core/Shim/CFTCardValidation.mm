@@ -0,0 +1,71 @@
+//
+//  CFTCardValidation.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTCardValidation.h"
+
+#include <cstring>
+
+#include "cft/CardValidation.hpp"
+
+static_assert(static_cast<NSInteger>(cft::TrackCheck::BadCheckDigit) == CFTTrackCheckBadCheckDigit, "");
+static_assert(static_cast<NSInteger>(cft::CardBrand::AmericanExpress) == CFTCardBrandAmericanExpress, "");
+
+// NULL for anything that is not plain ASCII, which no check accepts.
+static const char *CFTCardValidationASCII(NSString *text, std::size_t &count) {
+    const char *ascii = [text cStringUsingEncoding:NSASCIIStringEncoding];
+    count = ascii == NULL ? 0 : std::strlen(ascii);
+    return ascii;
+}
+
+static NSString *CFTCardValidationField(const char *track, cft::TrackField field) {
+    return [[NSString alloc] initWithBytes:track + field.offset length:field.length encoding:NSASCIIStringEncoding];
+}
+
+@implementation CFTCardValidation
+
++ (BOOL)isValidPan:(NSString *)pan {
+    std::size_t count = 0;
+    const char *ascii = CFTCardValidationASCII(pan, count);
+    return ascii != NULL && cft::panValid(ascii, count);
+}
+
++ (BOOL)isValidExpiry:(NSString *)expiry {
+    std::size_t count = 0;
+    const char *ascii = CFTCardValidationASCII(expiry, count);
+    // Card expiry years are Gregorian whatever calendar the device is set to.
+    NSCalendar *calendar = [NSCalendar calendarWithIdentifier:NSCalendarIdentifierGregorian];
+    NSDateComponents *today = [calendar components:NSCalendarUnitYear | NSCalendarUnitMonth fromDate:[NSDate date]];
+    return ascii != NULL && cft::keyedExpiryValid(ascii, count, static_cast<unsigned>(today.year),
+                                                  static_cast<unsigned>(today.month));
+}
+
++ (BOOL)isValidCvv:(NSString *)cvv cardBrand:(CFTCardBrand)cardBrand {
+    std::size_t count = 0;
+    const char *ascii = CFTCardValidationASCII(cvv, count);
+    return ascii != NULL && cft::cvvValid(ascii, count, static_cast<cft::CardBrand>(cardBrand));
+}
+
++ (CFTTrackCheck)checkTrack:(NSString *)track pan:(NSString **)pan expiry:(NSString **)expiry {
+    std::size_t count = 0;
+    const char *ascii = CFTCardValidationASCII(track, count);
+    if (ascii == NULL) {
+        return CFTTrackCheckBadCharacter;
+    }
+    cft::TrackData data;
+    const cft::TrackCheck check = cft::parseTrack(ascii, count, data);
+    if (check == cft::TrackCheck::Valid) {
+        if (pan != NULL) {
+            *pan = CFTCardValidationField(ascii, data.pan);
+        }
+        if (expiry != NULL) {
+            *expiry = CFTCardValidationField(ascii, data.expiry);
+        }
+    }
+    return static_cast<CFTTrackCheck>(check);
+}
+
+@end
@@ -0,0 +1,40 @@
+/*!
+ * @header CFTCoreError.h
+ *
+ * @brief Error domain and codes reported by the portable transaction core.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @brief Error domain of all NSErrors created from core error codes
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSString * _Nonnull const CFTCoreErrorDomain;
+
+/*!
+ * @typedef CFTCoreErrorCode
+ * @brief Codes in CFTCoreErrorDomain
+ * @constant CFTCoreErrorCodeIllegalTransition The requested change is not valid from the current transaction state
+ * @constant CFTCoreErrorCodeInvalidArgument An argument was out of range or malformed
+ * @constant CFTCoreErrorCodeDeclined The gateway declined or failed the request
+ * @constant CFTCoreErrorCodeInteractionRequired The request needs cardholder or merchant interaction, such as card input or a signature
+ * @constant CFTCoreErrorCodeCapacityExceeded A bounded store or queue is full
+ * @constant CFTCoreErrorCodeNotFound No entry exists for the given identifier
+ * @constant CFTCoreErrorCodeIOFailure A file could not be read, written or synced
+ * @constant CFTCoreErrorCodeExternal An error from the SDK or the system, recorded where only core codes fit
+ * @discussion Raw values match cft::ErrorCode.
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTCoreErrorCode) {
+    CFTCoreErrorCodeIllegalTransition NS_SWIFT_NAME(illegalTransition) = 1,
+    CFTCoreErrorCodeInvalidArgument NS_SWIFT_NAME(invalidArgument) = 2,
+    CFTCoreErrorCodeDeclined NS_SWIFT_NAME(declined) = 3,
+    CFTCoreErrorCodeInteractionRequired NS_SWIFT_NAME(interactionRequired) = 4,
+    CFTCoreErrorCodeCapacityExceeded NS_SWIFT_NAME(capacityExceeded) = 5,
+    CFTCoreErrorCodeNotFound NS_SWIFT_NAME(notFound) = 6,
+    CFTCoreErrorCodeIOFailure NS_SWIFT_NAME(ioFailure) = 7,
+    CFTCoreErrorCodeExternal NS_SWIFT_NAME(external) = 8
+};
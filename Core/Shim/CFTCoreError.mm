@@ -0,0 +1,60 @@
+//
+//  CFTCoreError.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#include <limits>
+
+NSString * const CFTCoreErrorDomain = @"com.cardflight.core";
+
+static_assert(static_cast<NSInteger>(cft::ErrorCode::IllegalTransition) == CFTCoreErrorCodeIllegalTransition, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::InvalidArgument) == CFTCoreErrorCodeInvalidArgument, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::Declined) == CFTCoreErrorCodeDeclined, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::InteractionRequired) == CFTCoreErrorCodeInteractionRequired, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::CapacityExceeded) == CFTCoreErrorCodeCapacityExceeded, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::NotFound) == CFTCoreErrorCodeNotFound, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::IOFailure) == CFTCoreErrorCodeIOFailure, "");
+static_assert(static_cast<NSInteger>(cft::ErrorCode::External) == CFTCoreErrorCodeExternal, "");
+
+NSError *CFTCoreMakeError(cft::ErrorCode code) {
+    if (code == cft::ErrorCode::None) {
+        return nil;
+    }
+    NSString *name = [NSString stringWithUTF8String:cft::errorCodeName(code)];
+    return [NSError errorWithDomain:CFTCoreErrorDomain
+                               code:static_cast<NSInteger>(code)
+                           userInfo:@{NSLocalizedDescriptionKey: name}];
+}
+
+BOOL CFTCoreSucceeded(cft::ErrorCode code, NSError **error) {
+    if (code == cft::ErrorCode::None) {
+        return YES;
+    }
+    if (error != NULL) {
+        *error = CFTCoreMakeError(code);
+    }
+    return NO;
+}
+
+cft::ErrorCode CFTCoreErrorCodeFromError(NSError *error, std::int32_t *detail) {
+    if (detail != NULL) {
+        *detail = 0;
+    }
+    if (error == nil) {
+        return cft::ErrorCode::None;
+    }
+    if ([error.domain isEqualToString:CFTCoreErrorDomain] && error.code > 0 &&
+        error.code < static_cast<NSInteger>(cft::ErrorCode::External)) {
+        return static_cast<cft::ErrorCode>(error.code);
+    }
+    if (detail != NULL && error.code >= std::numeric_limits<std::int32_t>::min() &&
+        error.code <= std::numeric_limits<std::int32_t>::max()) {
+        *detail = static_cast<std::int32_t>(error.code);
+    }
+    return cft::ErrorCode::External;
+}
@@ -0,0 +1,105 @@
+//
+//  CFTCorePrivate.h
+//  CardFlight
+//
+//  Helpers shared by the Objective-C++ shim. Not part of the public interface.
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <cstdint>
+
+#include "cft/Error.hpp"
+
+@class CFTAmount;
+@class CFTMerchantAccount;
+@class CFTTransactionMetrics;
+@class CFTTransactionRecordStore;
+
+namespace cft {
+class EventLog;
+class TransactionRecordStore;
+struct TraceBreakdown;
+}
+
+/*!
+ * @brief NSError in CFTCoreErrorDomain for a core error code
+ * @return NSError - nil for cft::ErrorCode::None
+ */
+NSError * _Nullable CFTCoreMakeError(cft::ErrorCode code);
+
+/*!
+ * @brief Assign CFTCoreMakeError(code) to error if the caller asked for it
+ * @return BOOL - YES when code is cft::ErrorCode::None
+ */
+BOOL CFTCoreSucceeded(cft::ErrorCode code, NSError * _Nullable * _Nullable error);
+
+/*!
+ * @brief Core code of an NSError, for stores that only hold core codes
+ * @param detail std::int32_t - Set to the error's own code when it is not a core error and fits, else 0; may be NULL
+ * @return cft::ErrorCode - None for nil, the code of a core error, External for anything else
+ */
+cft::ErrorCode CFTCoreErrorCodeFromError(NSError * _Nullable error, std::int32_t * _Nullable detail);
+
+/*!
+ * @brief Amount in minor currency units (cents), rounded half to even as CFTAmount rounds
+ */
+int64_t CFTCoreMinorUnits(CFTAmount * _Nonnull amount);
+
+CFTAmount * _Nonnull CFTCoreAmountWithMinorUnits(int64_t minorUnits);
+
+/*!
+ * @brief Milliseconds since 1970, the time base of every stored core timestamp
+ */
+int64_t CFTCoreMillisFromDate(NSDate * _Nonnull date);
+
+NSDate * _Nonnull CFTCoreDateFromMillis(int64_t millis);
+
+/*!
+ * @brief POST of a JSON or binary body to a v2 route of merchantAccount's gateway, authenticated with its API key
+ * @param path NSString - Percent-encoded route below baseV2Url; build identifiers into it with CFTCoreEscapedPathComponent
+ */
+NSMutableURLRequest * _Nonnull CFTCoreGatewayRequest(CFTMerchantAccount * _Nonnull merchantAccount, NSString * _Nonnull path,
+                                                     NSData * _Nonnull body, NSString * _Nonnull contentType);
+
+/*!
+ * @brief component percent-encoded as a single path segment, "/" included
+ */
+NSString * _Nonnull CFTCoreEscapedPathComponent(NSString * _Nonnull component);
+
+/*!
+ * @brief Keep shouldKeepReaderConnectionAlive set on [CFTReaderUtilities shared] until the matching release
+ * @discussion Every holder in the process shares one count: the first hold saves the app's value and the
+ * last release puts it back. Call on the main queue.
+ */
+void CFTCoreHoldReaderConnection(void);
+
+void CFTCoreReleaseReaderConnection(void);
+
+/*!
+ * @brief Record that a reader followed by a CFTReaderConnectionManager connected or went away
+ * @discussion Calls must pair up per reader. Call on the main queue.
+ */
+void CFTCoreNoteReaderConnected(BOOL connected);
+
+/*!
+ * @brief Whether a CFTReaderConnectionManager has a connected reader
+ */
+BOOL CFTCoreIsReaderConnected(void);
+
+/*!
+ * @brief Core log behind [CFTEventLog shared], for shim classes that log from hot paths
+ */
+cft::EventLog &CFTCoreSharedEventLog(void);
+
+/*!
+ * @brief Fold a finished transaction's breakdown into the session metrics
+ */
+void CFTCoreRecordTraceBreakdown(CFTTransactionMetrics * _Nonnull metrics, const cft::TraceBreakdown &breakdown);
+
+/*!
+ * @brief Core store behind a CFTTransactionRecordStore, for shim classes that follow its changes
+ */
+cft::TransactionRecordStore &CFTCoreRecordStore(CFTTransactionRecordStore * _Nonnull store);
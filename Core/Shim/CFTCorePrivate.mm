@@ -0,0 +1,117 @@
+//
+//  CFTCorePrivate.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTAmount.h>
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTReaderUtilities.h>
+
+#include "cft/Amount.hpp"
+
+int64_t CFTCoreMinorUnits(CFTAmount *amount) {
+    // Read the NSDecimal directly: its mantissa is up to eight 16-bit words, least significant
+    // first. Anything that fits in 64 bits converts without NSDecimalNumber arithmetic.
+    const NSDecimal decimal = amount.decimalValue.decimalValue;
+    if (decimal._length == 0) {
+        // Zero, or NaN when negative.
+        return 0;
+    }
+    if (decimal._length <= 4) {
+        uint64_t mantissa = 0;
+        for (unsigned int i = decimal._length; i > 0; --i) {
+            mantissa = (mantissa << 16) | decimal._mantissa[i - 1];
+        }
+        cft::Amount minorUnits;
+        if (cft::Amount::fromDecimal(mantissa, decimal._exponent, decimal._isNegative != 0,
+                                     cft::Amount::kUsdExponent, minorUnits) == cft::ErrorCode::None) {
+            return minorUnits.minorUnits();
+        }
+    }
+
+    NSDecimalNumberHandler *rounding = [NSDecimalNumberHandler decimalNumberHandlerWithRoundingMode:NSRoundBankers
+                                                                                              scale:0
+                                                                                   raiseOnExactness:NO
+                                                                                    raiseOnOverflow:NO
+                                                                                   raiseOnUnderflow:NO
+                                                                                raiseOnDivideByZero:NO];
+    return [amount.decimalValue decimalNumberByMultiplyingByPowerOf10:2 withBehavior:rounding].longLongValue;
+}
+
+CFTAmount *CFTCoreAmountWithMinorUnits(int64_t minorUnits) {
+    const unsigned long long magnitude = minorUnits < 0 ? 0ull - static_cast<unsigned long long>(minorUnits)
+                                                        : static_cast<unsigned long long>(minorUnits);
+    NSDecimalNumber *value = [NSDecimalNumber decimalNumberWithMantissa:magnitude exponent:-2 isNegative:minorUnits < 0];
+    return [CFTAmount amountWithDecimalNumber:value];
+}
+
+int64_t CFTCoreMillisFromDate(NSDate *date) {
+    return static_cast<int64_t>(llround(date.timeIntervalSince1970 * 1000.0));
+}
+
+NSDate *CFTCoreDateFromMillis(int64_t millis) {
+    return [NSDate dateWithTimeIntervalSince1970:static_cast<NSTimeInterval>(millis) / 1000.0];
+}
+
+NSMutableURLRequest *CFTCoreGatewayRequest(CFTMerchantAccount *merchantAccount, NSString *path, NSData *body, NSString *contentType) {
+    // Appended to the encoded path, since URLByAppendingPathComponent: would encode the escapes again.
+    NSURLComponents *components = [NSURLComponents componentsWithURL:merchantAccount.baseV2Url resolvingAgainstBaseURL:YES];
+    NSString *basePath = components.percentEncodedPath ?: @"";
+    components.percentEncodedPath = [basePath hasSuffix:@"/"] ? [basePath stringByAppendingString:path]
+                                                               : [NSString stringWithFormat:@"%@/%@", basePath, path];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:components.URL];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = body;
+    [request setValue:contentType forHTTPHeaderField:@"Content-Type"];
+    // The API key is the user name of Basic authentication, with an empty password.
+    NSData *credentials = [[NSString stringWithFormat:@"%@:", merchantAccount.apiKey ?: @""] dataUsingEncoding:NSUTF8StringEncoding];
+    [request setValue:[@"Basic " stringByAppendingString:[credentials base64EncodedStringWithOptions:0]]
+   forHTTPHeaderField:@"Authorization"];
+    return request;
+}
+
+NSString *CFTCoreEscapedPathComponent(NSString *component) {
+    static NSCharacterSet *allowed;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        NSMutableCharacterSet *characters = [[NSCharacterSet URLPathAllowedCharacterSet] mutableCopy];
+        [characters removeCharactersInString:@"/;"];
+        allowed = [characters copy];
+    });
+    return [component stringByAddingPercentEncodingWithAllowedCharacters:allowed] ?: @"";
+}
+
+// Main queue only, like the utilities session they guard.
+static NSUInteger CFTCoreReaderConnectionHolds = 0;
+static BOOL CFTCoreKeptReaderConnectionAlive = NO;
+static NSUInteger CFTCoreConnectedReaders = 0;
+
+void CFTCoreHoldReaderConnection(void) {
+    CFTReaderUtilities *utilities = [CFTReaderUtilities shared];
+    if (CFTCoreReaderConnectionHolds++ == 0) {
+        CFTCoreKeptReaderConnectionAlive = utilities.shouldKeepReaderConnectionAlive;
+    }
+    utilities.shouldKeepReaderConnectionAlive = YES;
+}
+
+void CFTCoreReleaseReaderConnection(void) {
+    if (CFTCoreReaderConnectionHolds > 0 && --CFTCoreReaderConnectionHolds == 0) {
+        [CFTReaderUtilities shared].shouldKeepReaderConnectionAlive = CFTCoreKeptReaderConnectionAlive;
+    }
+}
+
+void CFTCoreNoteReaderConnected(BOOL connected) {
+    if (connected) {
+        ++CFTCoreConnectedReaders;
+    } else if (CFTCoreConnectedReaders > 0) {
+        --CFTCoreConnectedReaders;
+    }
+}
+
+BOOL CFTCoreIsReaderConnected(void) {
+    return CFTCoreConnectedReaders > 0;
+}
@@ -0,0 +1,171 @@
+/*!
+ * @header CFTDeferredTransactionQueue.h
+ *
+ * @brief Durable store-and-forward queue for deferred transactions.
+ * Hand the data from transaction:didDeferWithData: to the queue and it is written to disk
+ * before enqueue returns. Once reachability is full the queue resumes the stored transactions
+ * with bounded parallelism, retrying failures with exponential backoff, so transactions taken
+ * offline survive app restarts and crashes without any bookkeeping in the app.
+ *
+ * A transaction that was being forwarded when the app stopped may or may not have reached the
+ * gateway. It is never resent on its own: the next open moves it to the dead letters, and the
+ * app should look for it in the transaction history before submitting it again.
+ *
+ * Entries are stored in the compact record format of cft/DeferredRecord.hpp: the SDK data
+ * compressed, plus amount, card and EMV fields that can be read without decoding it.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTDeferredTransactionQueue;
+@class CFTTransaction;
+@class CFTTransactionManager;
+@class CFTTransactionRecord;
+
+@protocol CFTDeferredTransactionQueueDelegate <NSObject>
+
+/*!
+ * @brief A queued transaction was resumed and processed by the gateway
+ * @param queue CFTDeferredTransactionQueue - Queue that forwarded the transaction
+ * @param transactionRecord CFTTransactionRecord - Record of the processed transaction, including declines
+ * @discussion The entry has been removed from the queue.
+ * Added in 4.12.0
+ */
+- (void)deferredTransactionQueue:(nonnull CFTDeferredTransactionQueue *)queue
+   didForwardTransactionWithRecord:(nonnull CFTTransactionRecord *)transactionRecord
+NS_SWIFT_NAME(deferredTransactionQueue(_:didForward:));
+
+/*!
+ * @brief A queued transaction could not be forwarded
+ * @param queue CFTDeferredTransactionQueue - Queue that attempted the transaction
+ * @param error NSError - Reason the attempt failed
+ * @param willRetry BOOL - YES if the entry was rescheduled, NO if it was moved to the dead letters
+ * @discussion Transactions needing interaction, such as a signature, are dead-lettered immediately
+ * with CFTCoreErrorCodeInteractionRequired.
+ * Added in 4.12.0
+ */
+- (void)deferredTransactionQueue:(nonnull CFTDeferredTransactionQueue *)queue
+ didFailToForwardTransactionWithError:(nonnull NSError *)error
+                       willRetry:(BOOL)willRetry
+NS_SWIFT_NAME(deferredTransactionQueue(_:didFailToForward:willRetry:));
+
+@end
+
+@interface CFTDeferredTransactionQueue : NSObject
+
+/*!
+ * @property delegate
+ * @brief Receives forwarding results on the main queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, weak, nullable) id<CFTDeferredTransactionQueueDelegate> delegate;
+
+/*!
+ * @property maxConcurrentResumes
+ * @brief Upper bound on transactions being resumed at once. Defaults to 4.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSUInteger maxConcurrentResumes;
+
+/*!
+ * @property reachability
+ * @brief Last reachability passed to updateReachability:
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTReachability reachability;
+
+/*!
+ * @property count
+ * @brief Number of stored transactions, including dead letters
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/*!
+ * @property pendingCount
+ * @brief Number of stored transactions still to be forwarded
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger pendingCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Open or create a queue
+ * @param fileURL NSURL - File the queue is stored in, created if missing
+ * @param transactionManager CFTTransactionManager - Manager used to resume stored transactions
+ * @param error NSError - Set when the file cannot be opened or is not a queue
+ * Added in 4.12.0
+ */
+- (nullable instancetype)initWithFileURL:(nonnull NSURL *)fileURL
+                      transactionManager:(nonnull CFTTransactionManager *)transactionManager
+                                   error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(fileURL:transactionManager:));
+
+/*!
+ * @brief Durably store deferred transaction data
+ * @param transactionData NSData - Data from transaction:didDeferWithData:
+ * @param error NSError - CFTCoreErrorCodeCapacityExceeded when the queue is full, CFTCoreErrorCodeIOFailure when it could not be written
+ * @return BOOL - YES once the data is on disk
+ * @discussion When the queue is full, stop offering the defer process option until it drains.
+ * Safe to call from any queue.
+ * Added in 4.12.0
+ */
+- (BOOL)enqueueTransactionData:(nonnull NSData *)transactionData
+                         error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(enqueue(transactionData:));
+
+/*!
+ * @brief Durably store a deferred transaction together with its card and amount details
+ * @param transaction CFTTransaction - Transaction that was deferred
+ * @param transactionData NSData - Data from transaction:didDeferWithData:
+ * @param error NSError - Same errors as enqueueTransactionData:error:
+ * @return BOOL - YES once the data is on disk
+ * @discussion Prefer this over enqueueTransactionData:error: from within transaction:didDeferWithData:.
+ * Added in 4.12.0
+ */
+- (BOOL)enqueueTransaction:(nonnull CFTTransaction *)transaction
+                      data:(nonnull NSData *)transactionData
+                     error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(enqueue(transaction:data:));
+
+/*!
+ * @brief Whether another transaction of the given size would be accepted
+ * Added in 4.12.0
+ */
+- (BOOL)canEnqueueTransactionDataOfLength:(NSUInteger)length
+NS_SWIFT_NAME(canEnqueue(length:));
+
+/*!
+ * @brief Report network reachability
+ * @param reachability CFTReachability - Forwarding runs only while reachability is CFTReachabilityFull
+ * @discussion Losing reachability stops new resumes; transactions already resumed finish normally.
+ * Added in 4.12.0
+ */
+- (void)updateReachability:(CFTReachability)reachability
+NS_SWIFT_NAME(update(reachability:));
+
+/*!
+ * @brief Forward every queued transaction now, ignoring backoff
+ * @discussion Only skips the wait of transactions queued when it is called; one that fails
+ * again waits out its next backoff as usual.
+ * Added in 4.12.0
+ */
+- (void)retryNow
+NS_SWIFT_NAME(retryNow());
+
+/*!
+ * @brief Drop every dead-lettered transaction
+ * @return NSArray<NSData *> - Data of the dropped transactions
+ * @discussion Includes transactions cut off mid-forward by the last shutdown, which may already
+ * have been processed.
+ * Added in 4.12.0
+ */
+- (nonnull NSArray<NSData *> *)removeDeadLetteredTransactions
+NS_SWIFT_NAME(removeDeadLetteredTransactions());
+
+@end
@@ -0,0 +1,279 @@
+//
+//  CFTDeferredTransactionQueue.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTDeferredTransactionQueue.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTEmvTlv.h"
+#import "CFTGatewaySession.h"
+#import "CFTUnattendedTransactionDelegate.h"
+
+#import <CardFlight/CFTAmount.h>
+#import <CardFlight/CFTCardInfo.h>
+#import <CardFlight/CFTEmvDetails.h>
+#import <CardFlight/CFTTransaction.h>
+#import <CardFlight/CFTTransactionManager.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "cft/DeferredQueue.hpp"
+#include "cft/DeferredRecord.hpp"
+
+static const NSUInteger CFTDeferredDefaultConcurrentResumes = 4;
+
+// Wait before pumping again after a claim that came back empty although an entry was due, e.g.
+// because the journal could not be written; doubled per claim in a row, up to the maximum.
+static const int64_t CFTDeferredStalledClaimDelayMillis = 1000;
+static const int64_t CFTDeferredMaxStalledClaimDelayMillis = 60 * 1000;
+
+static int64_t CFTDeferredNowMillis(void) {
+    return CFTCoreMillisFromDate([NSDate date]);
+}
+
+@implementation CFTDeferredTransactionQueue {
+    std::unique_ptr<cft::DeferredQueue> _queue;
+    __weak CFTTransactionManager *_transactionManager;
+    // Drain state below is only touched on the main queue.
+    NSMutableDictionary<NSNumber *, CFTUnattendedTransactionDelegate *> *_resumes;
+    NSUInteger _retryTimerGeneration;
+    NSUInteger _stalledClaims;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL
+             transactionManager:(CFTTransactionManager *)transactionManager
+                          error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        if (!fileURL.isFileURL) {
+            CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+            return nil;
+        }
+        if (!CFTCoreSucceeded(cft::DeferredQueue::open(fileURL.fileSystemRepresentation, cft::DeferredQueueConfig(), _queue), error)) {
+            return nil;
+        }
+        // A transaction being forwarded when the app stopped may already have reached the gateway.
+        // Sending it again could charge the card twice, so it goes to the dead letters instead.
+        const int64_t now = CFTDeferredNowMillis();
+        for (const cft::DeferredEntryInfo &info : _queue->entries()) {
+            if (info.status == cft::DeferredEntryStatus::Interrupted) {
+                bool willRetry = false;
+                _queue->fail(info.entryId, false, now, willRetry);
+            }
+        }
+        _transactionManager = transactionManager;
+        _resumes = [NSMutableDictionary dictionary];
+        _maxConcurrentResumes = CFTDeferredDefaultConcurrentResumes;
+        _reachability = CFTReachabilityUnknown;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _queue->count();
+}
+
+- (NSUInteger)pendingCount {
+    return _queue->pendingCount();
+}
+
+- (BOOL)enqueueTransactionData:(NSData *)transactionData error:(NSError **)error {
+    return [self storeTransactionData:transactionData transaction:nil error:error];
+}
+
+- (BOOL)enqueueTransaction:(CFTTransaction *)transaction data:(NSData *)transactionData error:(NSError **)error {
+    return [self storeTransactionData:transactionData transaction:transaction error:error];
+}
+
+- (BOOL)storeTransactionData:(nonnull NSData *)transactionData
+                 transaction:(nullable CFTTransaction *)transaction
+                       error:(NSError **)error {
+    const int64_t now = CFTDeferredNowMillis();
+
+    cft::DeferredRecordWriter writer;
+    writer.addBytes(cft::DeferredField::SdkPayload, static_cast<const std::uint8_t *>(transactionData.bytes),
+                    transactionData.length, true);
+    writer.addInteger(cft::DeferredField::CreatedAtMillis, now);
+    if (transaction.amount != nil) {
+        writer.addInteger(cft::DeferredField::AmountMinor, CFTCoreMinorUnits(transaction.amount));
+    }
+    CFTCardInfo *cardInfo = transaction.cardInfo;
+    if (cardInfo != nil) {
+        writer.addByte(cft::DeferredField::CardInputMethod, static_cast<std::uint8_t>(cardInfo.cardInputMethod));
+        writer.addByte(cft::DeferredField::CardBrand, static_cast<std::uint8_t>(cardInfo.cardBrand));
+        const char *lastFour = [cardInfo.lastFour cStringUsingEncoding:NSASCIIStringEncoding];
+        if (lastFour != NULL) {
+            writer.addBytes(cft::DeferredField::LastFour, reinterpret_cast<const std::uint8_t *>(lastFour), strlen(lastFour));
+        }
+        NSData *tlv = cardInfo.emvDetails != nil ? [[CFTEmvTlv alloc] initWithEmvDetails:cardInfo.emvDetails].data : nil;
+        if (tlv.length > 0) {
+            writer.addBytes(cft::DeferredField::EmvTlv, static_cast<const std::uint8_t *>(tlv.bytes), tlv.length, true);
+        }
+    }
+
+    std::vector<std::uint8_t> record;
+    if (!CFTCoreSucceeded(writer.finish(record), error)) {
+        return NO;
+    }
+
+    std::uint64_t entryId = 0;
+    if (!CFTCoreSucceeded(_queue->enqueue(record.data(), record.size(), now, entryId), error)) {
+        return NO;
+    }
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self pump];
+    });
+    return YES;
+}
+
+- (BOOL)canEnqueueTransactionDataOfLength:(NSUInteger)length {
+    // Worst case: the data does not compress and every other field is present.
+    return _queue->canAccept(length + 256);
+}
+
+- (void)updateReachability:(CFTReachability)reachability {
+    [[CFTGatewaySession shared] updateReachability:reachability];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self->_reachability = reachability;
+        [self pump];
+    });
+}
+
+- (void)retryNow {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        // Only what is queued now skips its backoff; a resume that fails again backs off as usual.
+        self->_queue->expedite(CFTDeferredNowMillis());
+        self->_stalledClaims = 0;
+        [self pump];
+    });
+}
+
+- (NSArray<NSData *> *)removeDeadLetteredTransactions {
+    NSMutableArray<NSData *> *removed = [NSMutableArray array];
+    for (const cft::DeferredEntryInfo &info : _queue->entries()) {
+        if (info.status != cft::DeferredEntryStatus::DeadLettered) {
+            continue;
+        }
+        NSData *transactionData = [self transactionDataForEntry:info.entryId];
+        if (_queue->remove(info.entryId) == cft::ErrorCode::None && transactionData != nil) {
+            [removed addObject:transactionData];
+        }
+    }
+    return removed;
+}
+
+#pragma mark - Draining
+
+// Starts resumes until maxConcurrentResumes are outstanding, then arms a timer for the next retry.
+- (void)pump {
+    CFTTransactionManager *manager = _transactionManager;
+    if (_reachability != CFTReachabilityFull || manager == nil) {
+        return;
+    }
+
+    const NSUInteger limit = MAX(_maxConcurrentResumes, (NSUInteger)1);
+    if (_resumes.count < limit) {
+        const int64_t now = CFTDeferredNowMillis();
+        const std::vector<std::uint64_t> claimed = _queue->claimReady(now, limit - _resumes.count);
+        const int64_t next = _queue->nextAttemptAtMillis();
+        _stalledClaims = claimed.empty() && next >= 0 && next <= now ? _stalledClaims + 1 : 0;
+        for (const std::uint64_t entryId : claimed) {
+            [self resumeEntry:entryId manager:manager];
+        }
+    }
+
+    [self scheduleRetryTimer];
+}
+
+// The SDK data of an entry. Entries that are not records are passed through as stored.
+- (NSData *)transactionDataForEntry:(std::uint64_t)entryId {
+    std::vector<std::uint8_t> stored;
+    if (_queue->payload(entryId, stored) != cft::ErrorCode::None) {
+        return nil;
+    }
+    if (!cft::DeferredRecordView::hasMagic(stored.data(), stored.size())) {
+        return [NSData dataWithBytes:stored.data() length:stored.size()];
+    }
+
+    cft::DeferredRecordView record;
+    std::vector<std::uint8_t> payload;
+    if (cft::DeferredRecordView::open(stored.data(), stored.size(), record) != cft::ErrorCode::None ||
+        !record.verifyChecksum() ||
+        record.copyBytes(cft::DeferredField::SdkPayload, payload) != cft::ErrorCode::None) {
+        return nil;
+    }
+    return [NSData dataWithBytes:payload.data() length:payload.size()];
+}
+
+- (void)resumeEntry:(std::uint64_t)entryId manager:(CFTTransactionManager *)manager {
+    NSData *transactionData = [self transactionDataForEntry:entryId];
+    if (transactionData == nil) {
+        bool willRetry = false;
+        _queue->fail(entryId, false, CFTDeferredNowMillis(), willRetry);
+        [self.delegate deferredTransactionQueue:self
+           didFailToForwardTransactionWithError:CFTCoreMakeError(cft::ErrorCode::InvalidArgument)
+                                      willRetry:NO];
+        return;
+    }
+
+    CFTUnattendedTransactionDelegate *delegate = [CFTUnattendedTransactionDelegate new];
+    __weak CFTDeferredTransactionQueue *weakSelf = self;
+    delegate.finish = ^(CFTTransactionRecord *record, NSError *error) {
+        [weakSelf finishEntry:entryId record:record error:error];
+    };
+    _resumes[@(entryId)] = delegate;
+
+    [manager resumeDeferredTransaction:transactionData
+                              delegate:delegate
+                            completion:[delegate creationBlock]];
+}
+
+- (void)finishEntry:(std::uint64_t)entryId record:(CFTTransactionRecord *)record error:(NSError *)error {
+    [_resumes removeObjectForKey:@(entryId)];
+
+    // A record means the gateway made a decision, approved or not; that is a forwarded transaction.
+    if (record != nil) {
+        _queue->complete(entryId);
+        [self.delegate deferredTransactionQueue:self didForwardTransactionWithRecord:record];
+    } else {
+        const BOOL retryable = !([error.domain isEqualToString:CFTCoreErrorDomain] &&
+                                 error.code == CFTCoreErrorCodeInteractionRequired);
+        bool willRetry = false;
+        _queue->fail(entryId, retryable, CFTDeferredNowMillis(), willRetry);
+        [self.delegate deferredTransactionQueue:self
+           didFailToForwardTransactionWithError:error ?: CFTCoreMakeError(cft::ErrorCode::Declined)
+                                      willRetry:willRetry];
+    }
+
+    [self pump];
+}
+
+- (void)scheduleRetryTimer {
+    const NSUInteger generation = ++_retryTimerGeneration;
+    const int64_t next = _queue->nextAttemptAtMillis();
+    if (next < 0 || _resumes.count >= MAX(_maxConcurrentResumes, (NSUInteger)1)) {
+        return;
+    }
+
+    int64_t delay = MAX(next - CFTDeferredNowMillis(), (int64_t)0);
+    if (_stalledClaims > 0) {
+        const int64_t backoff = CFTDeferredStalledClaimDelayMillis << MIN(_stalledClaims - 1, (NSUInteger)6);
+        delay = MAX(delay, MIN(backoff, CFTDeferredMaxStalledClaimDelayMillis));
+    }
+    __weak CFTDeferredTransactionQueue *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay * (int64_t)NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        CFTDeferredTransactionQueue *queue = weakSelf;
+        if (queue != nil && queue->_retryTimerGeneration == generation) {
+            [queue pump];
+        }
+    });
+}
+
+@end
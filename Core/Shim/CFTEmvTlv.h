@@ -0,0 +1,176 @@
+/*!
+ * @header CFTEmvTlv.h
+ *
+ * @brief Lazy, zero-copy view of EMV BER-TLV data.
+ * CFTEmvTlv keeps the raw bytes and nothing else. The curated values CFTEmvDetails exposes
+ * are located in one pass the first time any of them is read, and each string is only
+ * created when its property is first read. Every other tag, including the ones
+ * CFTEmvDetails drops, is reachable through valueForTag: and enumerateTagsUsingBlock:
+ * without copying.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class CFTEmvDetails;
+
+@interface CFTEmvTlv : NSObject
+
+/*!
+ * @property data
+ * @brief The BER-TLV bytes
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSData *data;
+
+/*!
+ * @property isValid
+ * @brief NO when the data is malformed. Tags before the damage are still readable.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isValid;
+
+/*!
+ * @property applicationPreferredName
+ * @brief Tag 9F12
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationPreferredName;
+
+/*!
+ * @property applicationId
+ * @brief Tag 4F, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationId;
+
+/*!
+ * @property applicationLabel
+ * @brief Tag 50
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationLabel;
+
+/*!
+ * @property transactionStatusIndicator
+ * @brief Tag 9B, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *transactionStatusIndicator;
+
+/*!
+ * @property applicationResponseCode
+ * @brief Tag 8A
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationResponseCode;
+
+/*!
+ * @property applicationCryptogram
+ * @brief Tag 9F26, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationCryptogram;
+
+/*!
+ * @property applicationTransactionCounter
+ * @brief Tag 9F36, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *applicationTransactionCounter;
+
+/*!
+ * @property panSequenceNumber
+ * @brief Tag 5F34, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *panSequenceNumber;
+
+/*!
+ * @property issuerActionCodeOnline
+ * @brief Tag 9F0F, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *issuerActionCodeOnline;
+
+/*!
+ * @property issuerActionCodeDenial
+ * @brief Tag 9F0E, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *issuerActionCodeDenial;
+
+/*!
+ * @property issuerActionCodeDefault
+ * @brief Tag 9F0D, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *issuerActionCodeDefault;
+
+/*!
+ * @property cardholderVerificationMethod
+ * @brief Tag 9F34, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *cardholderVerificationMethod;
+
+/*!
+ * @property entryMode
+ * @brief Tag 9F39, as hex
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *entryMode;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Wrap BER-TLV bytes, such as a reader response
+ * @discussion Nothing is parsed until a value is read.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithData:(nonnull NSData *)data
+NS_SWIFT_NAME(init(data:)) NS_DESIGNATED_INITIALIZER;
+
+/*!
+ * @brief Encode the values of a CFTEmvDetails as BER-TLV
+ * @discussion For when only the SDK's parsed details are available. Values that are not valid
+ * hex where hex is expected are left out.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithEmvDetails:(nonnull CFTEmvDetails *)emvDetails
+NS_SWIFT_NAME(init(emvDetails:));
+
+/*!
+ * @brief Value bytes of the first element with tag, searching templates too
+ * @param tag uint32_t - Tag bytes big-endian, e.g. 0x9F26
+ * @return NSData - nil if the tag is absent
+ * Added in 4.12.0
+ */
+- (nullable NSData *)valueForTag:(uint32_t)tag
+NS_SWIFT_NAME(value(tag:));
+
+/*!
+ * @brief Value of the first element with tag as upper-case hex
+ * Added in 4.12.0
+ */
+- (nullable NSString *)hexStringForTag:(uint32_t)tag
+NS_SWIFT_NAME(hexString(tag:));
+
+/*!
+ * @brief Visit every element in order, including those inside templates
+ * @param block Block - Receives the tag, the range of its value within data, and whether it is a template
+ * @discussion Runs synchronously on the calling queue and allocates nothing per element.
+ * Added in 4.12.0
+ */
+- (void)enumerateTagsUsingBlock:(void (NS_NOESCAPE ^ _Nonnull)(uint32_t tag, NSRange valueRange, BOOL isConstructed, BOOL * _Nonnull stop))block
+NS_SWIFT_NAME(enumerateTags(_:));
+
+/*!
+ * @brief The curated values keyed by printable name, built once and then shared
+ * Added in 4.12.0
+ */
+- (nonnull NSDictionary<NSString *, NSString *> *)asDictionary;
+
+@end
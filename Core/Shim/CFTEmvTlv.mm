@@ -0,0 +1,224 @@
+//
+//  CFTEmvTlv.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTEmvTlv.h"
+
+#import <CardFlight/CFTEmvDetails.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/Tlv.hpp"
+
+// Indexed by cft::EmvTag.
+static NSString * const CFTEmvTlvPrintableNames[cft::kEmvTagCount] = {
+    @"Application Preferred Name",
+    @"Application ID",
+    @"Application Label",
+    @"Transaction Status Indicator",
+    @"Application Response Code",
+    @"Application Cryptogram",
+    @"Application Transaction Counter",
+    @"PAN Sequence Number",
+    @"Issuer Action Code Online",
+    @"Issuer Action Code Denial",
+    @"Issuer Action Code Default",
+    @"Cardholder Verification Method",
+    @"Entry Mode",
+};
+
+static NSString *CFTEmvTlvHexString(const cft::ByteRange &value) {
+    std::string hex(value.size * 2, '\0');
+    cft::hexEncode(value.data, value.size, &hex[0]);
+    return [[NSString alloc] initWithBytes:hex.data() length:hex.size() encoding:NSASCIIStringEncoding];
+}
+
+// Appends one curated value of a CFTEmvDetails; hex values are decoded, others stored as ASCII.
+static void CFTEmvTlvAppend(std::vector<std::uint8_t> &tlv, cft::EmvTag tag, NSString *value) {
+    if (value.length == 0) {
+        return;
+    }
+    const char *ascii = [value cStringUsingEncoding:NSASCIIStringEncoding];
+    if (ascii == NULL) {
+        return;
+    }
+    const std::size_t length = strlen(ascii);
+    if (cft::emvTagIsText(tag)) {
+        cft::appendTlv(tlv, cft::emvTagNumber(tag), reinterpret_cast<const std::uint8_t *>(ascii), length);
+        return;
+    }
+    std::vector<std::uint8_t> bytes;
+    if (cft::hexDecode(ascii, length, bytes) == cft::ErrorCode::None) {
+        cft::appendTlv(tlv, cft::emvTagNumber(tag), bytes.data(), bytes.size());
+    }
+}
+
+@implementation CFTEmvTlv {
+    std::unique_ptr<cft::EmvTags> _tags;
+    // _tags and the memoized strings are guarded by @synchronized(self).
+    __strong NSString *_strings[cft::kEmvTagCount];
+    BOOL _decoded[cft::kEmvTagCount];
+    NSDictionary<NSString *, NSString *> *_dictionary;
+}
+
+- (instancetype)initWithData:(NSData *)data {
+    self = [super init];
+    if (self) {
+        _data = [data copy];
+        _tags.reset(new cft::EmvTags(static_cast<const std::uint8_t *>(_data.bytes), _data.length));
+    }
+    return self;
+}
+
+- (instancetype)initWithEmvDetails:(CFTEmvDetails *)emvDetails {
+    std::vector<std::uint8_t> tlv;
+    // Tag order of the reader's response, not declaration order.
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationId, emvDetails.applicationId);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationLabel, emvDetails.applicationLabel);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationResponseCode, emvDetails.applicationResponseCode);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::TransactionStatusIndicator, emvDetails.transactionStatusIndicator);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::PanSequenceNumber, emvDetails.panSequenceNumber);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::IssuerActionCodeDefault, emvDetails.issuerActionCodeDefault);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::IssuerActionCodeDenial, emvDetails.issuerActionCodeDenial);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::IssuerActionCodeOnline, emvDetails.issuerActionCodeOnline);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationPreferredName, emvDetails.applicationPreferredName);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationCryptogram, emvDetails.applicationCryptogram);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::CardholderVerificationMethod, emvDetails.cardholderVerificationMethod);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::ApplicationTransactionCounter, emvDetails.applicationTransactionCounter);
+    CFTEmvTlvAppend(tlv, cft::EmvTag::EntryMode, emvDetails.entryMode);
+    return [self initWithData:[NSData dataWithBytes:tlv.data() length:tlv.size()]];
+}
+
+- (BOOL)isValid {
+    // A full walk, since resolve() stops once every curated tag is found.
+    cft::TlvIterator iterator(static_cast<const std::uint8_t *>(_data.bytes), _data.length);
+    cft::TlvElement element;
+    while (iterator.next(element)) {
+    }
+    return iterator.error() == cft::ErrorCode::None;
+}
+
+- (NSString *)stringForTag:(cft::EmvTag)tag {
+    const auto index = static_cast<std::size_t>(tag);
+    @synchronized (self) {
+        if (!_decoded[index]) {
+            cft::ByteRange value;
+            if (_tags->find(tag, value)) {
+                _strings[index] = cft::emvTagIsText(tag)
+                    ? [[NSString alloc] initWithBytes:value.data length:value.size encoding:NSASCIIStringEncoding]
+                    : CFTEmvTlvHexString(value);
+            }
+            _decoded[index] = YES;
+        }
+        return _strings[index];
+    }
+}
+
+- (NSString *)applicationPreferredName {
+    return [self stringForTag:cft::EmvTag::ApplicationPreferredName];
+}
+
+- (NSString *)applicationId {
+    return [self stringForTag:cft::EmvTag::ApplicationId];
+}
+
+- (NSString *)applicationLabel {
+    return [self stringForTag:cft::EmvTag::ApplicationLabel];
+}
+
+- (NSString *)transactionStatusIndicator {
+    return [self stringForTag:cft::EmvTag::TransactionStatusIndicator];
+}
+
+- (NSString *)applicationResponseCode {
+    return [self stringForTag:cft::EmvTag::ApplicationResponseCode];
+}
+
+- (NSString *)applicationCryptogram {
+    return [self stringForTag:cft::EmvTag::ApplicationCryptogram];
+}
+
+- (NSString *)applicationTransactionCounter {
+    return [self stringForTag:cft::EmvTag::ApplicationTransactionCounter];
+}
+
+- (NSString *)panSequenceNumber {
+    return [self stringForTag:cft::EmvTag::PanSequenceNumber];
+}
+
+- (NSString *)issuerActionCodeOnline {
+    return [self stringForTag:cft::EmvTag::IssuerActionCodeOnline];
+}
+
+- (NSString *)issuerActionCodeDenial {
+    return [self stringForTag:cft::EmvTag::IssuerActionCodeDenial];
+}
+
+- (NSString *)issuerActionCodeDefault {
+    return [self stringForTag:cft::EmvTag::IssuerActionCodeDefault];
+}
+
+- (NSString *)cardholderVerificationMethod {
+    return [self stringForTag:cft::EmvTag::CardholderVerificationMethod];
+}
+
+- (NSString *)entryMode {
+    return [self stringForTag:cft::EmvTag::EntryMode];
+}
+
+- (NSData *)valueForTag:(uint32_t)tag {
+    cft::TlvElement element;
+    if (cft::findTlv(static_cast<const std::uint8_t *>(_data.bytes), _data.length, tag, element) != cft::ErrorCode::None) {
+        return nil;
+    }
+    const auto offset = static_cast<NSUInteger>(element.value.data - static_cast<const std::uint8_t *>(_data.bytes));
+    // Subdata of an immutable NSData shares its storage rather than copying.
+    return [_data subdataWithRange:NSMakeRange(offset, element.value.size)];
+}
+
+- (NSString *)hexStringForTag:(uint32_t)tag {
+    cft::TlvElement element;
+    if (cft::findTlv(static_cast<const std::uint8_t *>(_data.bytes), _data.length, tag, element) != cft::ErrorCode::None) {
+        return nil;
+    }
+    return CFTEmvTlvHexString(element.value);
+}
+
+- (void)enumerateTagsUsingBlock:(void (NS_NOESCAPE ^)(uint32_t, NSRange, BOOL, BOOL *))block {
+    const auto *bytes = static_cast<const std::uint8_t *>(_data.bytes);
+    cft::TlvIterator iterator(bytes, _data.length);
+    cft::TlvElement element;
+    BOOL stop = NO;
+    while (!stop && iterator.next(element)) {
+        const NSRange range = NSMakeRange(static_cast<NSUInteger>(element.value.data - bytes), element.value.size);
+        block(element.tag, range, element.constructed, &stop);
+    }
+}
+
+- (NSDictionary<NSString *, NSString *> *)asDictionary {
+    @synchronized (self) {
+        if (_dictionary != nil) {
+            return _dictionary;
+        }
+    }
+    NSMutableDictionary<NSString *, NSString *> *dictionary = [NSMutableDictionary dictionaryWithCapacity:cft::kEmvTagCount];
+    for (std::size_t i = 0; i < cft::kEmvTagCount; ++i) {
+        NSString *value = [self stringForTag:static_cast<cft::EmvTag>(i)];
+        if (value != nil) {
+            dictionary[CFTEmvTlvPrintableNames[i]] = value;
+        }
+    }
+    @synchronized (self) {
+        if (_dictionary == nil) {
+            _dictionary = [dictionary copy];
+        }
+        return _dictionary;
+    }
+}
+
+@end
@@ -0,0 +1,143 @@
+/*!
+ * @header CFTEventLog.h
+ *
+ * @brief Always-on structured logging that stays off the transaction path.
+ * CFTSessionManager's isLogging formats every message and calls loggerOutput: before the
+ * SDK moves on. CFTEventLog instead records fixed-size binary events into a lock-free ring
+ * owned by the calling thread, and a background queue drains them every drainInterval to
+ * format lines for the logger delegate or to hand binary chunks to recordsHandler.
+ *
+ * Levels and sampling are applied before anything is recorded. Ring memory is bounded; when
+ * a ring fills faster than it is drained, new events are dropped and counted, never waited on.
+ * Error events are drained promptly.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+#import <CardFlight/CFTLogger.h>
+
+/*!
+ * @typedef CFTEventLogLevel
+ * @brief Severity of an event
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTEventLogLevel) {
+    CFTEventLogLevelDebug NS_SWIFT_NAME(debug) = 0,
+    CFTEventLogLevelInfo NS_SWIFT_NAME(info) = 1,
+    CFTEventLogLevelWarning NS_SWIFT_NAME(warning) = 2,
+    CFTEventLogLevelError NS_SWIFT_NAME(error) = 3
+};
+
+/*!
+ * @typedef CFTEventLogSubsystem
+ * @brief Component an event came from
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTEventLogSubsystem) {
+    CFTEventLogSubsystemSession NS_SWIFT_NAME(session) = 0,
+    CFTEventLogSubsystemTransaction NS_SWIFT_NAME(transaction) = 1,
+    CFTEventLogSubsystemReader NS_SWIFT_NAME(reader) = 2,
+    CFTEventLogSubsystemGateway NS_SWIFT_NAME(gateway) = 3,
+    CFTEventLogSubsystemDeferredQueue NS_SWIFT_NAME(deferredQueue) = 4,
+    CFTEventLogSubsystemRecordStore NS_SWIFT_NAME(recordStore) = 5,
+    CFTEventLogSubsystemAccountCache NS_SWIFT_NAME(accountCache) = 6
+};
+
+@interface CFTEventLog : NSObject
+
+/*!
+ * @property minimumLevel
+ * @brief Events below this level are discarded where they are logged. Defaults to CFTEventLogLevelInfo.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readwrite, assign) CFTEventLogLevel minimumLevel;
+
+/*!
+ * @property drainInterval
+ * @brief Seconds between background drains. Defaults to 1.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readwrite, assign) NSTimeInterval drainInterval;
+
+/*!
+ * @property loggerDelegate
+ * @brief Receives one formatted line per event on the log's background queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, readwrite, weak, nullable) id <CFTLoggerDelegate> loggerDelegate;
+
+/*!
+ * @property recordsHandler
+ * @brief Receives each drained batch in the compact binary format, for shipping, on the log's background queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, readwrite, copy, nullable) void (^recordsHandler)(NSData * _Nonnull records);
+
+/*!
+ * @property droppedCount
+ * @brief Events lost to a full ring or to the memory limit since the log was created
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t droppedCount;
+
+/*!
+ * @brief The log the transaction core writes to
+ * Added in 4.12.0
+ */
++ (nonnull instancetype)shared;
+
+/*!
+ * @brief Create a log with 1024 events per thread and at most 256 KB of ring memory
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)init;
+
+/*!
+ * @brief Create a log with explicit bounds
+ * @param eventsPerThread NSUInteger - Ring size of each logging thread, rounded up to a power of two
+ * @param memoryLimit NSUInteger - Bytes all rings together may use; threads beyond it have their events dropped
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithEventsPerThread:(NSUInteger)eventsPerThread
+                                    memoryLimit:(NSUInteger)memoryLimit
+NS_SWIFT_NAME(init(eventsPerThread:memoryLimit:)) NS_DESIGNATED_INITIALIZER;
+
+/*!
+ * @brief Keep one in every `every` events of level
+ * @param every NSUInteger - 0 or 1 keeps every event
+ * Added in 4.12.0
+ */
+- (void)setSampleRate:(NSUInteger)every forLevel:(CFTEventLogLevel)level
+NS_SWIFT_NAME(setSampleRate(_:for:));
+
+/*!
+ * @brief Record a transaction state change
+ * @param transactionId uint64_t - Any id that correlates events of one transaction
+ * @param error NSError - Recorded by code when it is in CFTCoreErrorDomain, otherwise as CFTCoreErrorCodeExternal with its own code as detail
+ * Added in 4.12.0
+ */
+- (void)logLevel:(CFTEventLogLevel)level
+       subsystem:(CFTEventLogSubsystem)subsystem
+   transactionId:(uint64_t)transactionId
+           state:(CFTTransactionState)state
+           error:(nullable NSError *)error
+NS_SWIFT_NAME(log(level:subsystem:transactionId:state:error:));
+
+/*!
+ * @brief Record a card reader event
+ * Added in 4.12.0
+ */
+- (void)logLevel:(CFTEventLogLevel)level
+     readerEvent:(CFTCardReaderEvent)readerEvent
+           error:(nullable NSError *)error
+NS_SWIFT_NAME(log(level:readerEvent:error:));
+
+/*!
+ * @brief Drain everything recorded so far before returning
+ * Added in 4.12.0
+ */
+- (void)flush;
+
+@end
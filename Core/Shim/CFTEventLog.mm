@@ -0,0 +1,217 @@
+//
+//  CFTEventLog.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTEventLog.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/EventLog.hpp"
+
+static_assert(static_cast<NSInteger>(cft::LogLevel::Error) == CFTEventLogLevelError, "");
+static_assert(static_cast<NSInteger>(cft::LogSubsystem::AccountCache) == CFTEventLogSubsystemAccountCache, "");
+static_assert(static_cast<NSInteger>(cft::CardReaderEvent::BatteryStatusUpdated) == CFTCardReaderEventBatteryStatusUpdated, "");
+
+static const NSTimeInterval CFTEventLogDefaultDrainInterval = 1;
+static const NSUInteger CFTEventLogDefaultEventsPerThread = 1024;
+static const NSUInteger CFTEventLogDefaultMemoryLimit = 256 * 1024;
+
+static void *CFTEventLogQueueKey = &CFTEventLogQueueKey;
+
+@implementation CFTEventLog {
+    std::unique_ptr<cft::EventLog> _log;
+    cft::Nanos _origin;
+    dispatch_queue_t _drainQueue;
+    // Only touched on _drainQueue.
+    NSUInteger _drainTimerGeneration;
+    std::atomic<bool> _promptDrainScheduled;
+    void (^_recordsHandler)(NSData *);
+}
+
+@synthesize drainInterval = _drainInterval;
+
++ (instancetype)shared {
+    static CFTEventLog *shared;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        shared = [[CFTEventLog alloc] init];
+    });
+    return shared;
+}
+
+- (instancetype)init {
+    return [self initWithEventsPerThread:CFTEventLogDefaultEventsPerThread memoryLimit:CFTEventLogDefaultMemoryLimit];
+}
+
+- (instancetype)initWithEventsPerThread:(NSUInteger)eventsPerThread memoryLimit:(NSUInteger)memoryLimit {
+    self = [super init];
+    if (self) {
+        cft::EventLogConfig config;
+        config.recordsPerThread = eventsPerThread;
+        config.memoryLimitBytes = memoryLimit;
+        _log.reset(new cft::EventLog(config));
+        _origin = cft::monotonicNanos();
+        _drainInterval = CFTEventLogDefaultDrainInterval;
+        _promptDrainScheduled = false;
+        _drainQueue = dispatch_queue_create("com.cardflight.eventlog", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_drainQueue, CFTEventLogQueueKey, CFTEventLogQueueKey, NULL);
+        dispatch_async(_drainQueue, ^{
+            [self scheduleDrainTimer];
+        });
+    }
+    return self;
+}
+
+- (CFTEventLogLevel)minimumLevel {
+    return static_cast<CFTEventLogLevel>(_log->minimumLevel());
+}
+
+- (void)setMinimumLevel:(CFTEventLogLevel)minimumLevel {
+    _log->setMinimumLevel(static_cast<cft::LogLevel>(minimumLevel));
+}
+
+- (NSTimeInterval)drainInterval {
+    @synchronized (self) {
+        return _drainInterval;
+    }
+}
+
+- (void)setDrainInterval:(NSTimeInterval)drainInterval {
+    @synchronized (self) {
+        _drainInterval = MAX(drainInterval, 0.01);
+    }
+    dispatch_async(_drainQueue, ^{
+        [self scheduleDrainTimer];
+    });
+}
+
+- (void (^)(NSData *))recordsHandler {
+    @synchronized (self) {
+        return _recordsHandler;
+    }
+}
+
+- (void)setRecordsHandler:(void (^)(NSData *))recordsHandler {
+    @synchronized (self) {
+        _recordsHandler = [recordsHandler copy];
+    }
+}
+
+- (uint64_t)droppedCount {
+    return _log->stats().dropped;
+}
+
+- (void)setSampleRate:(NSUInteger)every forLevel:(CFTEventLogLevel)level {
+    _log->setSampleRate(static_cast<cft::LogLevel>(level),
+                        static_cast<std::uint32_t>(MIN(every, (NSUInteger)std::numeric_limits<std::uint32_t>::max())));
+}
+
+- (void)logLevel:(CFTEventLogLevel)level
+       subsystem:(CFTEventLogSubsystem)subsystem
+   transactionId:(uint64_t)transactionId
+           state:(CFTTransactionState)state
+           error:(NSError *)error {
+    const auto coreLevel = static_cast<cft::LogLevel>(level);
+    if (!_log->isEnabled(coreLevel)) {
+        return;
+    }
+    std::int32_t detail = 0;
+    const cft::ErrorCode code = CFTCoreErrorCodeFromError(error, &detail);
+    if (_log->write(coreLevel, static_cast<cft::LogSubsystem>(subsystem), transactionId,
+                    static_cast<cft::TransactionState>(state), code, detail)) {
+        [self didWriteLevel:level];
+    }
+}
+
+- (void)logLevel:(CFTEventLogLevel)level readerEvent:(CFTCardReaderEvent)readerEvent error:(NSError *)error {
+    const auto coreLevel = static_cast<cft::LogLevel>(level);
+    if (!_log->isEnabled(coreLevel)) {
+        return;
+    }
+    std::int32_t detail = 0;
+    const cft::ErrorCode code = CFTCoreErrorCodeFromError(error, &detail);
+    if (_log->write(coreLevel, cft::LogSubsystem::Reader, static_cast<cft::CardReaderEvent>(readerEvent), code, detail)) {
+        [self didWriteLevel:level];
+    }
+}
+
+- (void)flush {
+    if (dispatch_get_specific(CFTEventLogQueueKey) == CFTEventLogQueueKey) {
+        [self drain];
+        return;
+    }
+    dispatch_sync(_drainQueue, ^{
+        [self drain];
+    });
+}
+
+#pragma mark - Private
+
+- (void)didWriteLevel:(CFTEventLogLevel)level {
+    // Errors are rare enough that one wakeup per burst of them is cheap.
+    if (level == CFTEventLogLevelError && !_promptDrainScheduled.exchange(true)) {
+        __weak CFTEventLog *weakSelf = self;
+        dispatch_async(_drainQueue, ^{
+            CFTEventLog *log = weakSelf;
+            if (log != nil) {
+                log->_promptDrainScheduled = false;
+                [log drain];
+            }
+        });
+    }
+}
+
+- (void)scheduleDrainTimer {
+    const NSUInteger generation = ++_drainTimerGeneration;
+    const NSTimeInterval interval = self.drainInterval;
+    __weak CFTEventLog *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)), _drainQueue, ^{
+        CFTEventLog *log = weakSelf;
+        if (log != nil && log->_drainTimerGeneration == generation) {
+            [log drain];
+            [log scheduleDrainTimer];
+        }
+    });
+}
+
+// Runs on _drainQueue. Rings are drained even with nobody listening so that they never fill.
+- (void)drain {
+    id <CFTLoggerDelegate> delegate = self.loggerDelegate;
+    const BOOL wantsLines = [delegate respondsToSelector:@selector(loggerOutput:)];
+    void (^recordsHandler)(NSData *) = self.recordsHandler;
+    const cft::Nanos origin = _origin;
+
+    _log->drain([&](const cft::LogRecord *records, std::size_t count) {
+        if (recordsHandler != nil) {
+            std::vector<std::uint8_t> encoded;
+            cft::encodeLogRecords(records, count, encoded);
+            recordsHandler([NSData dataWithBytes:encoded.data() length:encoded.size()]);
+        }
+        if (wantsLines) {
+            char line[192];
+            for (std::size_t i = 0; i < count; ++i) {
+                @autoreleasepool {
+                    cft::formatLogRecord(records[i], origin, line, sizeof(line));
+                    [delegate loggerOutput:[NSString stringWithUTF8String:line]];
+                }
+            }
+        }
+    });
+}
+
+// Inside the implementation for access to _log.
+cft::EventLog &CFTCoreSharedEventLog(void) {
+    CFTEventLog *log = [CFTEventLog shared];
+    return *log->_log;
+}
+
+@end
@@ -0,0 +1,134 @@
+/*!
+ * @header CFTGatewaySession.h
+ *
+ * @brief One URL session for every gateway request the shim makes.
+ * Requests to baseV1Url and baseV2Url share HTTP/2 connections and TLS sessions instead of
+ * each setting up its own. Connections are kept alive while the terminal is between customers,
+ * dropped once it goes quiet, and reopened as soon as reachability changes so the next sale
+ * does not pay for the handshake.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTConstants.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTMerchantAccount;
+
+@interface CFTGatewayConnectionMetrics : NSObject
+
+/*!
+ * @property requestCount
+ * @brief Requests completed, keep-alives excluded
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger requestCount;
+
+/*!
+ * @property reusedRequestCount
+ * @brief Requests that went out on a connection that was already open
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger reusedRequestCount;
+
+/*!
+ * @property reuseRate
+ * @brief reusedRequestCount over requestCount, 0 before the first request
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) double reuseRate;
+
+/*!
+ * @property handshakeCount
+ * @brief TLS handshakes made
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger handshakeCount;
+
+/*!
+ * @property meanHandshakeDuration
+ * @brief Seconds per TLS handshake
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSTimeInterval meanHandshakeDuration;
+
+/*!
+ * @property keepAliveCount
+ * @brief Keep-alives sent to idle connections
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger keepAliveCount;
+
+/*!
+ * @property reconnectCount
+ * @brief Connections opened ahead of a request, after reachability changed or the gateway closed one
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger reconnectCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTGatewaySession : NSObject
+
+/*!
+ * @property URLSession
+ * @brief Session the shim's gateway requests go through
+ * @discussion Tasks created on it directly are not included in connectionMetrics; use
+ * dataTaskWithRequest:completionHandler:.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) NSURLSession *URLSession;
+
+/*!
+ * @property connectionMetrics
+ * @brief Connection reuse across every gateway host
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTGatewayConnectionMetrics *connectionMetrics;
+
++ (nonnull instancetype)shared;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Data task on URLSession whose connection use is included in connectionMetrics
+ * @discussion The completion handler is called on the main queue.
+ * Added in 4.12.0
+ */
+- (nonnull NSURLSessionDataTask *)dataTaskWithRequest:(nonnull NSURLRequest *)request
+                                    completionHandler:(nonnull void (^)(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error))completionHandler
+NS_SWIFT_NAME(dataTask(with:completionHandler:));
+
+/*!
+ * @brief Open connections to an account's gateway hosts ahead of its next request
+ * @param completion CFTBasicBlock - Called on the main queue once the v1 host answered, with the error if it could not be reached
+ * Added in 4.12.0
+ */
+- (void)connectToMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                      completion:(nullable CFTBasicBlock)completion
+NS_SWIFT_NAME(connect(merchantAccount:completion:));
+
+/*!
+ * @brief Report network reachability
+ * @discussion Any change drops the open connections, which belong to the old network path.
+ * Hosts used recently are reconnected right away while reachability is CFTReachabilityFull.
+ * Pass the same value given to CFTTransaction's updateReachability:.
+ * Added in 4.12.0
+ */
+- (void)updateReachability:(CFTReachability)reachability
+NS_SWIFT_NAME(update(reachability:));
+
+/*!
+ * @brief Connection reuse for one host
+ * @return CFTGatewayConnectionMetrics - nil if no request went to host
+ * Added in 4.12.0
+ */
+- (nullable CFTGatewayConnectionMetrics *)connectionMetricsForHost:(nonnull NSString *)host
+NS_SWIFT_NAME(connectionMetrics(host:));
+
+@end
@@ -0,0 +1,305 @@
+//
+//  CFTGatewaySession.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTGatewaySession.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTMerchantAccount.h>
+
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/ConnectionPool.hpp"
+
+// Concurrent streams the gateway allows on one HTTP/2 connection.
+static const std::size_t CFTGatewaySessionStreamsPerConnection = 100;
+static const NSTimeInterval CFTGatewaySessionMaintenanceInterval = 10;
+static const NSTimeInterval CFTGatewaySessionRequestTimeout = 30;
+static NSString * const CFTGatewaySessionMaintenanceTask = @"com.cardflight.gateway-session.maintenance";
+
+@interface CFTGatewayConnectionMetrics ()
+
+- (nonnull instancetype)initWithStats:(const cft::ConnectionStats &)stats;
+
+@end
+
+@implementation CFTGatewayConnectionMetrics
+
+- (instancetype)initWithStats:(const cft::ConnectionStats &)stats {
+    self = [super init];
+    if (self) {
+        _requestCount = static_cast<NSUInteger>(stats.requests);
+        _reusedRequestCount = static_cast<NSUInteger>(stats.reusedRequests);
+        _reuseRate = stats.reuseRate();
+        _handshakeCount = static_cast<NSUInteger>(stats.handshakes);
+        _meanHandshakeDuration = static_cast<NSTimeInterval>(stats.meanHandshake()) / NSEC_PER_SEC;
+        _keepAliveCount = static_cast<NSUInteger>(stats.keepAlives);
+        _reconnectCount = static_cast<NSUInteger>(stats.reconnects);
+    }
+    return self;
+}
+
+@end
+
+@interface CFTGatewaySession () <NSURLSessionTaskDelegate>
+
+- (nonnull instancetype)initPrivate;
+
+@end
+
+@implementation CFTGatewaySession {
+    // Guarded by @synchronized (self). NSURLSession multiplexes each host onto one connection,
+    // so the pool sees one connection per host and uses the host's index as its handle.
+    cft::ConnectionPool _pool;
+    NSMutableDictionary<NSString *, NSNumber *> *_hostIndexes;
+    NSMutableArray<NSURL *> *_hostURLs;
+    CFTReachability _reachability;
+    NSTimer *_maintenanceTimer;
+}
+
++ (instancetype)shared {
+    static CFTGatewaySession *shared;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        shared = [[CFTGatewaySession alloc] initPrivate];
+    });
+    return shared;
+}
+
+- (instancetype)initPrivate {
+    self = [super init];
+    if (self) {
+        cft::ConnectionPoolConfig config;
+        config.streamsPerConnection = CFTGatewaySessionStreamsPerConnection;
+        config.maxIdlePerHost = 1;
+        _pool = cft::ConnectionPool(config);
+        _hostIndexes = [NSMutableDictionary dictionary];
+        _hostURLs = [NSMutableArray array];
+        _reachability = CFTReachabilityUnknown;
+
+        // HTTP/2 is negotiated by ALPN and TLS sessions are resumed within one session, so
+        // everything that shares it shares both.
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        configuration.HTTPMaximumConnectionsPerHost = 2;
+        configuration.TLSMinimumSupportedProtocol = kTLSProtocol12;
+        configuration.URLCache = nil;
+        configuration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        configuration.timeoutIntervalForRequest = CFTGatewaySessionRequestTimeout;
+        _URLSession = [NSURLSession sessionWithConfiguration:configuration
+                                                    delegate:self
+                                               delegateQueue:[NSOperationQueue mainQueue]];
+    }
+    return self;
+}
+
+- (NSURLSessionDataTask *)dataTaskWithRequest:(NSURLRequest *)request
+                            completionHandler:(void (^)(NSData *, NSURLResponse *, NSError *))completionHandler {
+    if (request.URL.host != nil) {
+        [self hostIndexForURL:request.URL];
+    }
+    return [_URLSession dataTaskWithRequest:request completionHandler:completionHandler];
+}
+
+- (void)connectToMerchantAccount:(CFTMerchantAccount *)merchantAccount completion:(CFTBasicBlock)completion {
+    const std::size_t v1 = [self hostIndexForURL:merchantAccount.baseV1Url];
+    const std::size_t v2 = [self hostIndexForURL:merchantAccount.baseV2Url];
+    [self connectHost:v1 completion:completion];
+    if (v2 != v1) {
+        [self connectHost:v2 completion:nil];
+    }
+}
+
+- (void)updateReachability:(CFTReachability)reachability {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (reachability == self->_reachability) {
+            return;
+        }
+        const BOOL hadReachability = self->_reachability != CFTReachabilityUnknown;
+        self->_reachability = reachability;
+        if (!hadReachability) {
+            return;
+        }
+        @synchronized (self) {
+            self->_pool.networkChanged();
+        }
+        [self maintain];
+    });
+}
+
+- (CFTGatewayConnectionMetrics *)connectionMetrics {
+    @synchronized (self) {
+        return [[CFTGatewayConnectionMetrics alloc] initWithStats:_pool.totals()];
+    }
+}
+
+- (CFTGatewayConnectionMetrics *)connectionMetricsForHost:(NSString *)host {
+    @synchronized (self) {
+        NSNumber *index = _hostIndexes[host.lowercaseString];
+        if (index == nil) {
+            return nil;
+        }
+        return [[CFTGatewayConnectionMetrics alloc] initWithStats:_pool.stats(index.unsignedIntegerValue)];
+    }
+}
+
+#pragma mark - Hosts
+
+- (std::size_t)hostIndexForURL:(NSURL *)url {
+    NSString *host = url.host.lowercaseString ?: @"";
+    @synchronized (self) {
+        NSNumber *index = _hostIndexes[host];
+        if (index == nil) {
+            NSURLComponents *components = [[NSURLComponents alloc] init];
+            components.scheme = url.scheme;
+            components.host = url.host;
+            components.port = url.port;
+            components.path = @"/";
+            index = @(_pool.addHost());
+            _hostIndexes[host] = index;
+            [_hostURLs addObject:components.URL ?: url];
+        }
+        return index.unsignedIntegerValue;
+    }
+}
+
+- (nonnull NSURL *)URLForHost:(std::size_t)host {
+    @synchronized (self) {
+        return _hostURLs[host];
+    }
+}
+
+- (void)sendHeadToHost:(std::size_t)host completion:(void (^)(BOOL answered, NSError *error))completion {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[self URLForHost:host]];
+    request.HTTPMethod = @"HEAD";
+    // Any response at all means the connection is open; the status does not matter.
+    NSURLSessionDataTask *task = [_URLSession dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+        completion(response != nil, response != nil ? nil : error ?: CFTCoreMakeError(cft::ErrorCode::IOFailure));
+    }];
+    task.taskDescription = CFTGatewaySessionMaintenanceTask;
+    [task resume];
+}
+
+#pragma mark - Maintenance
+
+- (void)connectHost:(std::size_t)host completion:(CFTBasicBlock)completion {
+    [self sendHeadToHost:host completion:^(BOOL answered, NSError *error) {
+        if (answered) {
+            @synchronized (self) {
+                const cft::Nanos now = cft::monotonicNanos();
+                if (self->_pool.connectionCount(host) == 0) {
+                    self->_pool.connected(host, static_cast<int>(host), now);
+                    self->_pool.release(host, static_cast<int>(host), true, now);
+                }
+            }
+        }
+        if (completion != nil) {
+            completion(error);
+        }
+    }];
+}
+
+- (void)maintain {
+    std::vector<cft::PoolTask> tasks;
+    BOOL warm;
+    @synchronized (self) {
+        const cft::Nanos now = cft::monotonicNanos();
+        _pool.maintain(now, tasks);
+        warm = _pool.isWarm(now);
+    }
+
+    BOOL flush = NO;
+    NSMutableIndexSet *connects = [NSMutableIndexSet indexSet];
+    for (const cft::PoolTask &task : tasks) {
+        switch (task.action) {
+            case cft::PoolAction::Close:
+                flush = YES;
+                break;
+            case cft::PoolAction::KeepAlive: {
+                const std::size_t host = task.host;
+                [self sendHeadToHost:host completion:^(BOOL answered, NSError *error) {
+                    @synchronized (self) {
+                        self->_pool.release(host, static_cast<int>(host), answered, cft::monotonicNanos());
+                    }
+                }];
+                break;
+            }
+            case cft::PoolAction::Connect:
+                if (_reachability != CFTReachabilityRestricted) {
+                    [connects addIndex:task.host];
+                }
+                break;
+        }
+    }
+
+    void (^connect)(void) = ^{
+        [connects enumerateIndexesUsingBlock:^(NSUInteger host, BOOL *stop) {
+            [self connectHost:host completion:nil];
+        }];
+    };
+    // NSURLSession cannot close one connection; flushing closes every idle one, which for
+    // dropped hosts is all they have. Reconnects wait for it so they do not land on the old path.
+    if (flush) {
+        [_URLSession flushWithCompletionHandler:^{
+            dispatch_async(dispatch_get_main_queue(), connect);
+        }];
+    } else {
+        connect();
+    }
+    [self scheduleMaintenance:warm];
+}
+
+- (void)scheduleMaintenance:(BOOL)warm {
+    if (!warm) {
+        [_maintenanceTimer invalidate];
+        _maintenanceTimer = nil;
+        return;
+    }
+    if (_maintenanceTimer != nil) {
+        return;
+    }
+    __weak CFTGatewaySession *weakSelf = self;
+    _maintenanceTimer = [NSTimer scheduledTimerWithTimeInterval:CFTGatewaySessionMaintenanceInterval repeats:YES block:^(NSTimer *timer) {
+        [weakSelf maintain];
+    }];
+    _maintenanceTimer.tolerance = CFTGatewaySessionMaintenanceInterval / 2;
+}
+
+#pragma mark - NSURLSessionTaskDelegate
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics {
+    NSURLSessionTaskTransactionMetrics *transaction = metrics.transactionMetrics.lastObject;
+    NSURL *url = transaction.request.URL ?: task.originalRequest.URL;
+    if (transaction == nil || url.host == nil || [task.taskDescription isEqualToString:CFTGatewaySessionMaintenanceTask]) {
+        return;
+    }
+
+    const std::size_t host = [self hostIndexForURL:url];
+    @synchronized (self) {
+        const cft::Nanos now = cft::monotonicNanos();
+        int handle = _pool.acquire(host, now);
+        if (handle < 0) {
+            handle = static_cast<int>(host);
+            _pool.connected(host, handle, now);
+        }
+        _pool.release(host, handle, transaction.response != nil, now);
+        _pool.recordRequest(host, transaction.reusedConnection);
+        if (!transaction.reusedConnection && transaction.secureConnectionStartDate != nil &&
+            transaction.secureConnectionEndDate != nil) {
+            // URL session metrics do not say whether the session was resumed.
+            const NSTimeInterval handshake =
+                [transaction.secureConnectionEndDate timeIntervalSinceDate:transaction.secureConnectionStartDate];
+            _pool.recordHandshake(host, static_cast<cft::Nanos>(MAX(handshake, 0) * NSEC_PER_SEC), false, now);
+        }
+    }
+    // The first request of a quiet period starts keep-alives again.
+    if (_maintenanceTimer == nil) {
+        [self maintain];
+    }
+}
+
+@end
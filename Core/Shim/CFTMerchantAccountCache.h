@@ -0,0 +1,207 @@
+/*!
+ * @header CFTMerchantAccountCache.h
+ *
+ * @brief Cached merchant account configuration, so starting a sale never waits on an account fetch.
+ * Concurrent requests for the same account share a single fetchWithMerchantAccount:completion:
+ * call. Accounts are refreshed in the background shortly before their time to live runs out,
+ * and once it has run out the last known configuration keeps being served while a refresh
+ * is in flight.
+ *
+ * Permissions, settlement and processor of each account are kept on disk between launches.
+ * API keys are never written to disk.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTCredentials;
+@class CFTMerchantAccount;
+@class CFTMerchantAccountManager;
+
+@interface CFTMerchantAccountSnapshot : NSObject
+
+/*!
+ * @property merchantAccountId
+ * @brief Identifier the account is cached under
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSString *merchantAccountId;
+
+/*!
+ * @property merchantAccountName
+ * @brief Name of the merchant account
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *merchantAccountName;
+
+/*!
+ * @property mid
+ * @brief Merchant id
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *mid;
+
+/*!
+ * @property tid
+ * @brief Terminal id
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *tid;
+
+/*!
+ * @property processor
+ * @brief Processor of the merchant account
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *processor;
+
+/*!
+ * @property settlementScheme
+ * @brief Settlement scheme of the merchant account
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTMerchantAccountSettlementScheme settlementScheme;
+
+/*!
+ * @property dipEnabledReaders
+ * @brief CFTCardReaderModel values permitted to accept dip
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSArray<NSNumber *> *dipEnabledReaders;
+
+/*!
+ * @property quickChipEnabledReaders
+ * @brief CFTCardReaderModel values permitted to use quick chip
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSArray<NSNumber *> *quickChipEnabledReaders;
+
+/*!
+ * @property isAvsEnabled
+ * @brief Whether AVS is enabled
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isAvsEnabled;
+
+/*!
+ * @property isKeyedEntryEnabled
+ * @brief Whether keyed entry is enabled
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isKeyedEntryEnabled;
+
+/*!
+ * @property allowDebit
+ * @brief Whether debit is allowed
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL allowDebit;
+
+/*!
+ * @property fetchedAt
+ * @brief When the configuration was fetched from the gateway
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) NSDate *fetchedAt;
+
+/*!
+ * @property isStale
+ * @brief YES when the configuration is past its time to live and a refresh has been started
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isStale;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/*!
+ * @typedef CFTMerchantAccountSnapshotBlock
+ * @brief Receives the account configuration, or the fetch error when none could be served
+ */
+typedef void (^CFTMerchantAccountSnapshotBlock)(CFTMerchantAccountSnapshot * _Nullable snapshot, NSError * _Nullable error);
+
+@interface CFTMerchantAccountCache : NSObject
+
+/*!
+ * @property timeToLive
+ * @brief Time a fetched configuration is served without refreshing
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSTimeInterval timeToLive;
+
+/*!
+ * @property fetchCount
+ * @brief Number of account fetches sent to the gateway
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger fetchCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Create a cache, loading configurations saved by a previous launch
+ * @param fileURL NSURL - File configurations are saved in, nil to keep them in memory only
+ * @param merchantAccountManager CFTMerchantAccountManager - Manager used to fetch accounts
+ * @param timeToLive NSTimeInterval - Time a configuration is served without refreshing, 0 for the default of 15 minutes
+ * @discussion Configurations stay usable for 24 hours past their time to live while a refresh is attempted.
+ * A missing or unreadable file starts an empty cache.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithFileURL:(nullable NSURL *)fileURL
+                 merchantAccountManager:(nonnull CFTMerchantAccountManager *)merchantAccountManager
+                             timeToLive:(NSTimeInterval)timeToLive
+NS_SWIFT_NAME(init(fileURL:merchantAccountManager:timeToLive:));
+
+/*!
+ * @brief Configuration of an account, fetching it only if nothing servable is cached
+ * @param merchantAccount CFTMerchantAccount - Account to fetch. It is refreshed in place by the fetch.
+ * @param completion CFTMerchantAccountSnapshotBlock - Called on the main queue
+ * @discussion Callers asking for the same account while a fetch is in flight share its result. A cache
+ * released before the fetch finishes completes with CFTCoreErrorCodeInvalidArgument.
+ * Added in 4.12.0
+ */
+- (void)fetchMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                  completion:(nonnull CFTMerchantAccountSnapshotBlock)completion
+NS_SWIFT_NAME(fetch(merchantAccount:completion:));
+
+/*!
+ * @brief Cached configuration of an account, without waiting
+ * @param merchantAccount CFTMerchantAccount - Account to look up
+ * @return CFTMerchantAccountSnapshot - nil when nothing servable is cached, in which case a fetch is started
+ * @discussion Call before starting a sale. A refresh is started in the background when one is due.
+ * Added in 4.12.0
+ */
+- (nullable CFTMerchantAccountSnapshot *)snapshotForMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+NS_SWIFT_NAME(snapshot(merchantAccount:));
+
+/*!
+ * @brief Refresh an account now unless a fetch for it is already in flight
+ * Added in 4.12.0
+ */
+- (void)refreshMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+NS_SWIFT_NAME(refresh(merchantAccount:));
+
+/*!
+ * @brief Forget the cached configuration of an account, e.g. after getValidationErrorWithMerchantAccount: reports an error
+ * Added in 4.12.0
+ */
+- (void)invalidateMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+NS_SWIFT_NAME(invalidate(merchantAccount:));
+
+/*!
+ * @brief Coalesced forceRefreshWithCompletion: for legacy credentials
+ * @param credentials CFTCredentials - Credentials to refresh
+ * @param completion Block - Called on the main queue with the result of the shared refresh
+ * @discussion Completes immediately when the credentials were refreshed successfully within timeToLive.
+ * Added in 4.12.0
+ */
+- (void)refreshCredentials:(nonnull CFTCredentials *)credentials
+                completion:(nonnull void (^)(CFTCredentials * _Nullable credentials, BOOL success, NSError * _Nullable error))completion
+NS_SWIFT_NAME(refresh(credentials:completion:));
+
+@end
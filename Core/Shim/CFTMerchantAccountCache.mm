@@ -0,0 +1,360 @@
+//
+//  CFTMerchantAccountCache.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTMerchantAccountCache.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTCredentials.h>
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTMerchantAccountManager.h>
+#import <CardFlight/CFTPermissions.h>
+#import <CardFlight/CFTSettlement.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "cft/RefreshingCache.hpp"
+
+static const NSTimeInterval CFTMerchantAccountDefaultTimeToLive = 15 * 60;
+static const NSTimeInterval CFTMerchantAccountMaxStaleness = 24 * 60 * 60;
+
+static int64_t CFTMerchantAccountNowMillis(void) {
+    return CFTCoreMillisFromDate([NSDate date]);
+}
+
+static std::string CFTMerchantAccountKey(CFTMerchantAccount *merchantAccount) {
+    const char *utf8 = merchantAccount.merchantAccountId.UTF8String;
+    return utf8 == NULL ? std::string() : std::string(utf8);
+}
+
+// Cached values are the JSON form of the fields below. The API key is deliberately left out.
+static std::string CFTMerchantAccountEncode(CFTMerchantAccount *merchantAccount) {
+    NSMutableDictionary<NSString *, id> *fields = [NSMutableDictionary dictionary];
+    fields[@"merchantAccountName"] = merchantAccount.merchantAccountName;
+    fields[@"mid"] = merchantAccount.mid;
+    fields[@"tid"] = merchantAccount.tid;
+    fields[@"processor"] = merchantAccount.processor;
+    fields[@"settlementScheme"] = @(merchantAccount.settlement.scheme);
+    CFTPermissions *permissions = merchantAccount.permissions;
+    fields[@"dipEnabledReaders"] = permissions.dipEnabledReaders ?: @[];
+    fields[@"quickChipEnabledReaders"] = permissions.quickChipEnabledReaders ?: @[];
+    fields[@"isAvsEnabled"] = @(permissions.isAvsEnabled);
+    fields[@"isKeyedEntryEnabled"] = @(permissions.isKeyedEntryEnabled);
+    fields[@"allowDebit"] = @(permissions.allowDebit);
+    fields[@"fetchedAtMillis"] = @(CFTMerchantAccountNowMillis());
+
+    NSData *json = [NSJSONSerialization dataWithJSONObject:fields options:0 error:NULL];
+    return json == nil ? std::string() : std::string(static_cast<const char *>(json.bytes), json.length);
+}
+
+@interface CFTMerchantAccountSnapshot ()
+
+- (nullable instancetype)initWithMerchantAccountId:(nonnull NSString *)merchantAccountId
+                                             value:(const std::string &)value
+                                           isStale:(BOOL)isStale;
+
+@end
+
+@implementation CFTMerchantAccountSnapshot
+
+- (instancetype)initWithMerchantAccountId:(NSString *)merchantAccountId
+                                    value:(const std::string &)value
+                                  isStale:(BOOL)isStale {
+    NSData *json = [NSData dataWithBytes:value.data() length:value.size()];
+    NSDictionary<NSString *, id> *fields = [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+    if (![fields isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+
+    self = [super init];
+    if (self) {
+        _merchantAccountId = [merchantAccountId copy];
+        _merchantAccountName = [fields[@"merchantAccountName"] copy];
+        _mid = [fields[@"mid"] copy];
+        _tid = [fields[@"tid"] copy];
+        _processor = [fields[@"processor"] copy];
+        _settlementScheme = static_cast<CFTMerchantAccountSettlementScheme>([fields[@"settlementScheme"] integerValue]);
+        _dipEnabledReaders = [fields[@"dipEnabledReaders"] copy] ?: @[];
+        _quickChipEnabledReaders = [fields[@"quickChipEnabledReaders"] copy] ?: @[];
+        _isAvsEnabled = [fields[@"isAvsEnabled"] boolValue];
+        _isKeyedEntryEnabled = [fields[@"isKeyedEntryEnabled"] boolValue];
+        _allowDebit = [fields[@"allowDebit"] boolValue];
+        _fetchedAt = CFTCoreDateFromMillis([fields[@"fetchedAtMillis"] longLongValue]);
+        _isStale = isStale;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTMerchantAccountCache {
+    std::shared_ptr<cft::RefreshingCache> _cache;
+    std::string _path;
+    __weak CFTMerchantAccountManager *_merchantAccountManager;
+    dispatch_queue_t _saveQueue;
+    // Guarded by @synchronized(self); fetches can be requested from any queue.
+    NSMutableDictionary<NSString *, CFTMerchantAccount *> *_merchantAccounts;
+    NSMutableDictionary<NSString *, NSError *> *_fetchErrors;
+    // Main queue only.
+    NSUInteger _prefetchTimerGeneration;
+    NSMapTable *_credentialRefreshes;
+    NSMapTable *_credentialsRefreshedAt;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL
+         merchantAccountManager:(CFTMerchantAccountManager *)merchantAccountManager
+                     timeToLive:(NSTimeInterval)timeToLive {
+    self = [super init];
+    if (self) {
+        _timeToLive = timeToLive > 0 ? timeToLive : CFTMerchantAccountDefaultTimeToLive;
+        _merchantAccountManager = merchantAccountManager;
+        _merchantAccounts = [NSMutableDictionary dictionary];
+        _fetchErrors = [NSMutableDictionary dictionary];
+        _credentialRefreshes = [NSMapTable strongToStrongObjectsMapTable];
+        _credentialsRefreshedAt = [NSMapTable weakToStrongObjectsMapTable];
+        _saveQueue = dispatch_queue_create("com.cardflight.merchant-account-cache", DISPATCH_QUEUE_SERIAL);
+
+        cft::RefreshingCacheConfig config;
+        config.ttlMillis = static_cast<int64_t>(_timeToLive * 1000);
+        // Refresh in the last eighth of the time to live, but never sooner than a minute before.
+        config.prefetchLeadMillis = std::min<int64_t>(config.ttlMillis / 8, 60 * 1000);
+        config.maxStaleMillis = static_cast<int64_t>(CFTMerchantAccountMaxStaleness * 1000);
+
+        __weak CFTMerchantAccountCache *weakSelf = self;
+        _cache.reset(new cft::RefreshingCache(config, [weakSelf](const std::string &key) {
+            NSString *merchantAccountId = [[NSString alloc] initWithBytes:key.data() length:key.size() encoding:NSUTF8StringEncoding];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf startFetchForMerchantAccountId:merchantAccountId];
+            });
+        }));
+
+        if (fileURL.isFileURL) {
+            _path = fileURL.fileSystemRepresentation;
+            // A missing or damaged snapshot only costs a fetch.
+            _cache->load(_path);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self schedulePrefetchTimer];
+        });
+    }
+    return self;
+}
+
+- (NSUInteger)fetchCount {
+    return _cache->fetchCount();
+}
+
+- (void)rememberMerchantAccount:(CFTMerchantAccount *)merchantAccount {
+    @synchronized (self) {
+        _merchantAccounts[merchantAccount.merchantAccountId] = merchantAccount;
+    }
+}
+
+- (void)fetchMerchantAccount:(CFTMerchantAccount *)merchantAccount completion:(CFTMerchantAccountSnapshotBlock)completion {
+    NSString *merchantAccountId = [merchantAccount.merchantAccountId copy];
+    if (merchantAccountId.length == 0) {
+        NSError *error = CFTCoreMakeError(cft::ErrorCode::InvalidArgument);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(nil, error);
+        });
+        return;
+    }
+    [self rememberMerchantAccount:merchantAccount];
+
+    __weak CFTMerchantAccountCache *weakSelf = self;
+    _cache->get(CFTMerchantAccountKey(merchantAccount), CFTMerchantAccountNowMillis(),
+                [weakSelf, merchantAccountId, completion](cft::ErrorCode code, const std::string &value, cft::CacheFreshness freshness) {
+        CFTMerchantAccountCache *cache = weakSelf;
+        CFTMerchantAccountSnapshot *snapshot = nil;
+        NSError *error = nil;
+        if (cache == nil) {
+            // Released while the fetch was in flight; still report exactly one outcome.
+            error = CFTCoreMakeError(cft::ErrorCode::InvalidArgument);
+        } else if (code == cft::ErrorCode::None) {
+            snapshot = [cache snapshotForMerchantAccountId:merchantAccountId value:value freshness:freshness];
+        } else {
+            error = [cache fetchErrorForMerchantAccountId:merchantAccountId] ?: CFTCoreMakeError(code);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(snapshot, error);
+        });
+    });
+}
+
+- (CFTMerchantAccountSnapshot *)snapshotForMerchantAccount:(CFTMerchantAccount *)merchantAccount {
+    if (merchantAccount.merchantAccountId.length == 0) {
+        return nil;
+    }
+    [self rememberMerchantAccount:merchantAccount];
+
+    // tryGet() starts any refresh that is due, so this never waits on the network.
+    std::string value;
+    const cft::CacheFreshness freshness = _cache->tryGet(CFTMerchantAccountKey(merchantAccount), CFTMerchantAccountNowMillis(), value);
+    if (freshness != cft::CacheFreshness::Fresh && freshness != cft::CacheFreshness::Stale) {
+        return nil;
+    }
+    return [self snapshotForMerchantAccountId:merchantAccount.merchantAccountId value:value freshness:freshness];
+}
+
+- (void)refreshMerchantAccount:(CFTMerchantAccount *)merchantAccount {
+    if (merchantAccount.merchantAccountId.length == 0) {
+        return;
+    }
+    [self rememberMerchantAccount:merchantAccount];
+    _cache->refresh(CFTMerchantAccountKey(merchantAccount));
+}
+
+- (void)invalidateMerchantAccount:(CFTMerchantAccount *)merchantAccount {
+    if (merchantAccount.merchantAccountId.length == 0) {
+        return;
+    }
+    _cache->invalidate(CFTMerchantAccountKey(merchantAccount));
+    [self saveSnapshot];
+}
+
+#pragma mark - Fetching
+
+- (nullable CFTMerchantAccountSnapshot *)snapshotForMerchantAccountId:(NSString *)merchantAccountId
+                                                                value:(const std::string &)value
+                                                            freshness:(cft::CacheFreshness)freshness {
+    return [[CFTMerchantAccountSnapshot alloc] initWithMerchantAccountId:merchantAccountId
+                                                                   value:value
+                                                                 isStale:freshness == cft::CacheFreshness::Stale];
+}
+
+- (nullable NSError *)fetchErrorForMerchantAccountId:(NSString *)merchantAccountId {
+    @synchronized (self) {
+        return _fetchErrors[merchantAccountId];
+    }
+}
+
+- (void)startFetchForMerchantAccountId:(NSString *)merchantAccountId {
+    CFTMerchantAccount *merchantAccount = nil;
+    @synchronized (self) {
+        merchantAccount = _merchantAccounts[merchantAccountId];
+    }
+    CFTMerchantAccountManager *merchantAccountManager = _merchantAccountManager;
+    const std::string key = merchantAccountId.UTF8String ?: "";
+    if (merchantAccount == nil || merchantAccountManager == nil) {
+        // Only accounts restored from disk, never asked for since launch, end up here.
+        _cache->complete(key, cft::ErrorCode::NotFound, std::string(), CFTMerchantAccountNowMillis());
+        [self schedulePrefetchTimer];
+        return;
+    }
+
+    __weak CFTMerchantAccountCache *weakSelf = self;
+    [merchantAccountManager fetchWithMerchantAccount:merchantAccount completion:^(BOOL success, NSError *error) {
+        [weakSelf finishFetchForMerchantAccount:merchantAccount key:key success:success error:error];
+    }];
+}
+
+- (void)finishFetchForMerchantAccount:(CFTMerchantAccount *)merchantAccount
+                                  key:(const std::string &)key
+                              success:(BOOL)success
+                                error:(NSError *)error {
+    NSString *merchantAccountId = merchantAccount.merchantAccountId;
+    const std::string value = success ? CFTMerchantAccountEncode(merchantAccount) : std::string();
+    const BOOL stored = success && !value.empty();
+    @synchronized (self) {
+        if (stored) {
+            [_fetchErrors removeObjectForKey:merchantAccountId];
+        } else {
+            _fetchErrors[merchantAccountId] = error ?: CFTCoreMakeError(cft::ErrorCode::Declined);
+        }
+    }
+
+    _cache->complete(key, stored ? cft::ErrorCode::None : cft::ErrorCode::Declined, value, CFTMerchantAccountNowMillis());
+    if (stored) {
+        [self saveSnapshot];
+    }
+    [self schedulePrefetchTimer];
+}
+
+- (void)saveSnapshot {
+    if (_path.empty()) {
+        return;
+    }
+    // The block holds its own reference to the cache, so the write finishes even if self goes away.
+    const std::shared_ptr<cft::RefreshingCache> cache = _cache;
+    const std::string path = _path;
+    dispatch_async(_saveQueue, ^{
+        cache->save(path);
+    });
+}
+
+- (void)schedulePrefetchTimer {
+    const NSUInteger generation = ++_prefetchTimerGeneration;
+    const int64_t now = CFTMerchantAccountNowMillis();
+    const int64_t next = _cache->nextPrefetchMillis(now);
+    if (next == std::numeric_limits<int64_t>::max()) {
+        return;
+    }
+
+    const int64_t delay = MAX(next - now, (int64_t)0);
+    __weak CFTMerchantAccountCache *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay * (int64_t)NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        CFTMerchantAccountCache *cache = weakSelf;
+        if (cache != nil && cache->_prefetchTimerGeneration == generation) {
+            cache->_cache->prefetchDue(CFTMerchantAccountNowMillis());
+            [cache schedulePrefetchTimer];
+        }
+    });
+}
+
+#pragma mark - Legacy credentials
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+- (void)refreshCredentials:(CFTCredentials *)credentials
+                completion:(void (^)(CFTCredentials *, BOOL, NSError *))completion {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        NSDate *refreshedAt = [self->_credentialsRefreshedAt objectForKey:credentials];
+        if (refreshedAt != nil && -refreshedAt.timeIntervalSinceNow < self->_timeToLive) {
+            completion(credentials, YES, nil);
+            return;
+        }
+
+        NSMutableArray *waiting = [self->_credentialRefreshes objectForKey:credentials];
+        if (waiting != nil) {
+            [waiting addObject:[completion copy]];
+            return;
+        }
+        waiting = [NSMutableArray arrayWithObject:[completion copy]];
+        [self->_credentialRefreshes setObject:waiting forKey:credentials];
+
+        __weak CFTMerchantAccountCache *weakSelf = self;
+        [credentials forceRefreshWithCompletion:^(CFTCredentials *refreshed, BOOL success, NSError *error) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf finishRefreshOfCredentials:credentials refreshed:refreshed success:success error:error];
+            });
+        }];
+    });
+}
+
+- (void)finishRefreshOfCredentials:(CFTCredentials *)credentials
+                         refreshed:(CFTCredentials *)refreshed
+                           success:(BOOL)success
+                             error:(NSError *)error {
+    NSArray *waiting = [_credentialRefreshes objectForKey:credentials];
+    [_credentialRefreshes removeObjectForKey:credentials];
+    if (success) {
+        [_credentialsRefreshedAt setObject:[NSDate date] forKey:credentials];
+    } else {
+        [_credentialsRefreshedAt removeObjectForKey:credentials];
+    }
+    for (void (^completion)(CFTCredentials *, BOOL, NSError *) in waiting) {
+        completion(refreshed ?: credentials, success, error);
+    }
+}
+
+#pragma clang diagnostic pop
+
+@end
@@ -0,0 +1,222 @@
+/*!
+ * @header CFTReaderConnectionManager.h
+ *
+ * @brief Keeps a Bluetooth reader connected between transactions and reconnects it when it drops.
+ * Once connectCardReader: is called the manager keeps that reader connected: a drop is answered
+ * by selecting the same reader again at once, without a scan, and then with exponential backoff
+ * while it stays out of reach. Heartbeats check the reader is still there, so a reader that went
+ * away without a disconnect event is found before the next transaction needs it. Readers can be
+ * let go after a quiet period to save their battery and are woken by noteActivity. Between
+ * beginTransaction and endTransaction no heartbeat scans are run and the reader is never
+ * disconnected.
+ *
+ * The manager does not become the CFTReaderUtilities delegate. Set it as the connectionManager of
+ * a CFTReaderDiscovery, or pass it the reader list and events from your own delegate.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTCardReaderInfo;
+@class CFTReaderConnectionManager;
+
+/*!
+ * @typedef CFTReaderConnectionState
+ * @brief Where the manager is in keeping its reader connected
+ * @constant CFTReaderConnectionStateIdle No reader is being kept connected
+ * @constant CFTReaderConnectionStateConnecting A connection attempt is under way
+ * @constant CFTReaderConnectionStateReady The reader is connected
+ * @constant CFTReaderConnectionStateWaiting The reader dropped or could not be reached; another attempt follows
+ * @constant CFTReaderConnectionStateSuspended The reader was let go after idleDisconnectInterval
+ * @discussion Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTReaderConnectionState) {
+    CFTReaderConnectionStateIdle NS_SWIFT_NAME(idle) = 0,
+    CFTReaderConnectionStateConnecting NS_SWIFT_NAME(connecting) = 1,
+    CFTReaderConnectionStateReady NS_SWIFT_NAME(ready) = 2,
+    CFTReaderConnectionStateWaiting NS_SWIFT_NAME(waiting) = 3,
+    CFTReaderConnectionStateSuspended NS_SWIFT_NAME(suspended) = 4
+};
+
+@interface CFTReaderConnectionConfiguration : NSObject <NSCopying>
+
+/*!
+ * @property heartbeatInterval
+ * @brief Time between heartbeats while connected, 0 for none. Each heartbeat is a short scan, so
+ * shorter intervals find silent drops sooner at some cost to battery. Defaults to 30 seconds.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval heartbeatInterval;
+
+/*!
+ * @property heartbeatTimeout
+ * @brief Time a heartbeat may go unanswered. Defaults to 5 seconds.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval heartbeatTimeout;
+
+/*!
+ * @property maxMissedHeartbeats
+ * @brief Unanswered heartbeats in a row after which the reader is treated as dropped. Defaults to 2.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSUInteger maxMissedHeartbeats;
+
+/*!
+ * @property connectTimeout
+ * @brief Time a connection attempt may take, at least 0.1 seconds. Defaults to 15 seconds.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval connectTimeout;
+
+/*!
+ * @property baseRetryDelay
+ * @brief Delay before the second reconnect attempt, doubling per attempt. The first is immediate. At least 0.1 seconds;
+ * defaults to 0.5 seconds.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval baseRetryDelay;
+
+/*!
+ * @property maxRetryDelay
+ * @brief Longest delay between reconnect attempts. Defaults to 60 seconds.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval maxRetryDelay;
+
+/*!
+ * @property idleDisconnectInterval
+ * @brief Let the reader go after this long without noteActivity, 0 to keep it. Defaults to 0.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSTimeInterval idleDisconnectInterval;
+
+@end
+
+@protocol CFTReaderConnectionManagerDelegate <NSObject>
+
+/*!
+ * @brief The connection state changed
+ * @param manager CFTReaderConnectionManager - Manager whose state changed
+ * @param state CFTReaderConnectionState - New state
+ * Added in 4.12.0
+ */
+- (void)readerConnectionManager:(nonnull CFTReaderConnectionManager *)manager didChangeState:(CFTReaderConnectionState)state
+NS_SWIFT_NAME(readerConnectionManager(_:didChange:));
+
+@end
+
+@interface CFTReaderConnectionManager : NSObject
+
+/*!
+ * @property delegate
+ * @brief Receives state changes on the main queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, weak, nullable) id<CFTReaderConnectionManagerDelegate> delegate;
+
+/*!
+ * @property configuration
+ * @brief Heartbeat, backoff and power settings, fixed at init
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) CFTReaderConnectionConfiguration *configuration;
+
+/*!
+ * @property state
+ * @brief Current connection state
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTReaderConnectionState state;
+
+/*!
+ * @property cardReaderInfo
+ * @brief Reader being kept connected, nil when idle
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTCardReaderInfo *cardReaderInfo;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+- (nonnull instancetype)initWithConfiguration:(nonnull CFTReaderConnectionConfiguration *)configuration
+NS_SWIFT_NAME(init(configuration:));
+
+/*!
+ * @brief Connect a reader and keep it connected
+ * @discussion Keeps shouldKeepReaderConnectionAlive set on [CFTReaderUtilities shared] until disconnect,
+ * sharing one hold with prepared transactions; the app's value comes back once neither holds it. A
+ * utilities session must be open. Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)connectCardReader:(nonnull CFTCardReaderInfo *)cardReaderInfo
+NS_SWIFT_NAME(connect(_:));
+
+/*!
+ * @brief Disconnect the reader and stop reconnecting it
+ * @discussion During a transaction the reader is disconnected once it ends. Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)disconnect
+NS_SWIFT_NAME(disconnect());
+
+/*!
+ * @brief The reader is about to be used
+ * @discussion Postpones the idle disconnect, forgets missed heartbeats and reconnects a suspended
+ * reader. Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)noteActivity
+NS_SWIFT_NAME(noteActivity());
+
+/*!
+ * @brief A transaction is starting on the reader
+ * @discussion Call before starting a transaction. Notes activity, then pauses heartbeats and
+ * holds back every disconnect, including one asked for with disconnect, until endTransaction.
+ * A reader that drops is still reconnected. Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)beginTransaction
+NS_SWIFT_NAME(beginTransaction());
+
+/*!
+ * @brief The transaction started with beginTransaction finished
+ * @discussion Call from the transaction's completion. Heartbeats and the idle period start over.
+ * Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)endTransaction
+NS_SWIFT_NAME(endTransaction());
+
+/*!
+ * @brief Pass on CFTReaderUtilitiesDelegate utilities:didReceiveCardReaderEvent:cardReaderInfo:
+ * @discussion A reader connected some other way is adopted and kept connected.
+ * Added in 4.12.0
+ */
+- (void)handleCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent cardReaderInfo:(nullable CFTCardReaderInfo *)cardReaderInfo
+NS_SWIFT_NAME(handle(cardReaderEvent:cardReaderInfo:));
+
+/*!
+ * @brief Pass on CFTReaderUtilitiesDelegate utilities:didUpdateCardReaderArray:
+ * @discussion Answers heartbeats.
+ * Added in 4.12.0
+ */
+- (void)handleCardReaderArray:(nonnull NSArray<CFTCardReaderInfo *> *)cardReaderArray
+NS_SWIFT_NAME(handle(cardReaderArray:));
+
+/*!
+ * @brief Time from asking for a connection to the reader being ready
+ * @param percentile double - In the range [0, 100]
+ * @param cardReaderModel CFTCardReaderModel - Model to report on
+ * @param reconnect BOOL - YES for reconnections after a drop or suspend, NO for first connections
+ * @return NSTimeInterval - 0 before the first such connection
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)timeToReadyPercentile:(double)percentile
+                        cardReaderModel:(CFTCardReaderModel)cardReaderModel
+                              reconnect:(BOOL)reconnect
+NS_SWIFT_NAME(timeToReady(percentile:cardReaderModel:reconnect:));
+
+@end
@@ -0,0 +1,276 @@
+//
+//  CFTReaderConnectionManager.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTReaderConnectionManager.h"
+
+#import <CardFlight/CFTCardReaderInfo.h>
+#import <CardFlight/CFTReaderUtilities.h>
+
+#include <memory>
+#include <string>
+
+#include "cft/ReaderConnection.hpp"
+
+static int64_t CFTReaderConnectionMillis(NSTimeInterval interval) {
+    return static_cast<int64_t>(interval * 1000);
+}
+
+// Floor of connectTimeout and baseRetryDelay. At 0 a connect would time out and be retried at the
+// same instant, and pump would never run out of actions.
+static const NSTimeInterval CFTReaderConnectionMinimumDelay = 0.1;
+
+// Uptime rather than wall-clock time, so changing the device clock does not fire timers early or late.
+static int64_t CFTReaderConnectionNowMillis(void) {
+    return CFTReaderConnectionMillis([NSProcessInfo processInfo].systemUptime);
+}
+
+@interface CFTReaderConnectionConfiguration ()
+
+- (cft::ReaderConnectionConfig)coreConfig;
+
+@end
+
+@implementation CFTReaderConnectionConfiguration
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        const cft::ReaderConnectionConfig defaults;
+        _heartbeatInterval = defaults.heartbeatIntervalMillis / 1000.0;
+        _heartbeatTimeout = defaults.heartbeatTimeoutMillis / 1000.0;
+        _maxMissedHeartbeats = defaults.maxMissedHeartbeats;
+        _connectTimeout = defaults.connectTimeoutMillis / 1000.0;
+        _baseRetryDelay = defaults.baseRetryDelayMillis / 1000.0;
+        _maxRetryDelay = defaults.maxRetryDelayMillis / 1000.0;
+        _idleDisconnectInterval = defaults.idleDisconnectMillis / 1000.0;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    CFTReaderConnectionConfiguration *copy = [[[self class] allocWithZone:zone] init];
+    copy.heartbeatInterval = _heartbeatInterval;
+    copy.heartbeatTimeout = _heartbeatTimeout;
+    copy.maxMissedHeartbeats = _maxMissedHeartbeats;
+    copy.connectTimeout = _connectTimeout;
+    copy.baseRetryDelay = _baseRetryDelay;
+    copy.maxRetryDelay = _maxRetryDelay;
+    copy.idleDisconnectInterval = _idleDisconnectInterval;
+    return copy;
+}
+
+- (cft::ReaderConnectionConfig)coreConfig {
+    cft::ReaderConnectionConfig config;
+    config.heartbeatIntervalMillis = CFTReaderConnectionMillis(MAX(_heartbeatInterval, 0));
+    config.heartbeatTimeoutMillis = CFTReaderConnectionMillis(MAX(_heartbeatTimeout, 0));
+    config.maxMissedHeartbeats = static_cast<std::uint32_t>(MIN(_maxMissedHeartbeats, (NSUInteger)UINT32_MAX));
+    const NSTimeInterval baseRetryDelay = MAX(_baseRetryDelay, CFTReaderConnectionMinimumDelay);
+    config.connectTimeoutMillis = CFTReaderConnectionMillis(MAX(_connectTimeout, CFTReaderConnectionMinimumDelay));
+    config.baseRetryDelayMillis = CFTReaderConnectionMillis(baseRetryDelay);
+    config.maxRetryDelayMillis = CFTReaderConnectionMillis(MAX(_maxRetryDelay, baseRetryDelay));
+    config.idleDisconnectMillis = CFTReaderConnectionMillis(MAX(_idleDisconnectInterval, 0));
+    return config;
+}
+
+@end
+
+@implementation CFTReaderConnectionManager {
+    // Everything below is only touched on the main queue.
+    std::unique_ptr<cft::ReaderConnection> _connection;
+    BOOL _heartbeatPending;
+    // Counted by CFTCoreHoldReaderConnection() and CFTCoreNoteReaderConnected() respectively.
+    BOOL _holdsReaderConnection;
+    BOOL _readerConnected;
+    BOOL _disconnectAfterTransaction;
+    NSUInteger _timerGeneration;
+}
+
+- (instancetype)initWithConfiguration:(CFTReaderConnectionConfiguration *)configuration {
+    self = [super init];
+    if (self) {
+        _configuration = [configuration copy];
+        _connection.reset(new cft::ReaderConnection([_configuration coreConfig]));
+        _state = CFTReaderConnectionStateIdle;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self setReaderConnected:NO];
+    [self setHoldsReaderConnection:NO];
+}
+
+- (void)setHoldsReaderConnection:(BOOL)holds {
+    if (holds != _holdsReaderConnection) {
+        _holdsReaderConnection = holds;
+        holds ? CFTCoreHoldReaderConnection() : CFTCoreReleaseReaderConnection();
+    }
+}
+
+- (void)setReaderConnected:(BOOL)connected {
+    if (connected != _readerConnected) {
+        _readerConnected = connected;
+        CFTCoreNoteReaderConnected(connected);
+    }
+}
+
+- (void)connectCardReader:(CFTCardReaderInfo *)cardReaderInfo {
+    [self setHoldsReaderConnection:YES];
+    _cardReaderInfo = cardReaderInfo;
+    _disconnectAfterTransaction = NO;
+    _connection->connect(std::string(cardReaderInfo.name.UTF8String ?: ""),
+                         static_cast<cft::CardReaderModel>(cardReaderInfo.cardReaderModel), CFTReaderConnectionNowMillis());
+    [self pump];
+}
+
+- (void)disconnect {
+    if (_cardReaderInfo == nil) {
+        return;
+    }
+    _connection->disconnect();
+    _cardReaderInfo = nil;
+    _heartbeatPending = NO;
+
+    [self setHoldsReaderConnection:NO];
+    if (_connection->isTransactionActive()) {
+        _disconnectAfterTransaction = YES;
+    } else {
+        [self setReaderConnected:NO];
+        [[CFTReaderUtilities shared] disconnectCardReader];
+    }
+    [self pump];
+}
+
+- (void)noteActivity {
+    _connection->activity(CFTReaderConnectionNowMillis());
+    [self pump];
+}
+
+- (void)beginTransaction {
+    const int64_t now = CFTReaderConnectionNowMillis();
+    _connection->activity(now);
+    _connection->setTransactionActive(true, now);
+    _heartbeatPending = NO;
+    [self pump];
+}
+
+- (void)endTransaction {
+    _connection->setTransactionActive(false, CFTReaderConnectionNowMillis());
+    if (_disconnectAfterTransaction && _cardReaderInfo == nil) {
+        [self setReaderConnected:NO];
+        [[CFTReaderUtilities shared] disconnectCardReader];
+    }
+    _disconnectAfterTransaction = NO;
+    [self pump];
+}
+
+- (void)handleCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo {
+    const int64_t now = CFTReaderConnectionNowMillis();
+    switch (cardReaderEvent) {
+        case CFTCardReaderEventConnected:
+            if (cardReaderInfo == nil) {
+                return;
+            }
+            [self setHoldsReaderConnection:YES];
+            [self setReaderConnected:YES];
+            _cardReaderInfo = cardReaderInfo;
+            _connection->connected(std::string(cardReaderInfo.name.UTF8String ?: ""),
+                                   static_cast<cft::CardReaderModel>(cardReaderInfo.cardReaderModel), now);
+            break;
+        case CFTCardReaderEventDisconnected:
+            [self setReaderConnected:NO];
+            _connection->disconnected(now);
+            break;
+        case CFTCardReaderEventConnectionErrored:
+            [self setReaderConnected:NO];
+            _connection->connectFailed(now);
+            break;
+        default:
+            return;
+    }
+    _heartbeatPending = NO;
+    [self pump];
+}
+
+- (void)handleCardReaderArray:(NSArray<CFTCardReaderInfo *> *)cardReaderArray {
+    if (!_heartbeatPending) {
+        return;
+    }
+    _heartbeatPending = NO;
+
+    BOOL present = NO;
+    for (CFTCardReaderInfo *info in cardReaderArray) {
+        if ([info.name isEqualToString:_cardReaderInfo.name] && info.readerStatus == CFTCardReaderStatusConnected) {
+            present = YES;
+            break;
+        }
+    }
+    _connection->heartbeatAnswered(present, CFTReaderConnectionNowMillis());
+    [self pump];
+}
+
+- (NSTimeInterval)timeToReadyPercentile:(double)percentile cardReaderModel:(CFTCardReaderModel)cardReaderModel reconnect:(BOOL)reconnect {
+    const cft::LatencyHistogram &histogram = _connection->timeToReady(static_cast<cft::CardReaderModel>(cardReaderModel), reconnect);
+    return histogram.count() == 0 ? 0 : histogram.percentile(percentile) / 1e9;
+}
+
+#pragma mark - Driving
+
+// Carries out every action the core asks for, then arms a timer for its next deadline. While a
+// transaction is active the core asks for neither heartbeats nor disconnects.
+- (void)pump {
+    CFTReaderUtilities *utilities = [CFTReaderUtilities shared];
+    const int64_t now = CFTReaderConnectionNowMillis();
+    for (;;) {
+        const cft::ReaderLinkAction action = _connection->poll(now);
+        if (action == cft::ReaderLinkAction::None) {
+            break;
+        }
+        switch (action) {
+            case cft::ReaderLinkAction::Connect:
+                [utilities selectCardReaderInfo:_cardReaderInfo cardReaderModel:_cardReaderInfo.cardReaderModel];
+                break;
+            case cft::ReaderLinkAction::Heartbeat:
+                _heartbeatPending = YES;
+                [utilities scanBluetoothCardReaders];
+                break;
+            case cft::ReaderLinkAction::Disconnect:
+                _heartbeatPending = NO;
+                [self setReaderConnected:NO];
+                [utilities disconnectCardReader];
+                break;
+            case cft::ReaderLinkAction::None:
+                break;
+        }
+    }
+
+    const CFTReaderConnectionState state = static_cast<CFTReaderConnectionState>(_connection->state());
+    if (state != _state) {
+        _state = state;
+        [self.delegate readerConnectionManager:self didChangeState:state];
+    }
+    [self scheduleTimer];
+}
+
+- (void)scheduleTimer {
+    const NSUInteger generation = ++_timerGeneration;
+    const int64_t next = _connection->nextDeadlineMillis();
+    if (next < 0) {
+        return;
+    }
+
+    const int64_t delay = MAX(next - CFTReaderConnectionNowMillis(), (int64_t)0);
+    __weak CFTReaderConnectionManager *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay * (int64_t)NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        CFTReaderConnectionManager *manager = weakSelf;
+        if (manager != nil && manager->_timerGeneration == generation) {
+            [manager pump];
+        }
+    });
+}
+
+@end
@@ -0,0 +1,247 @@
+/*!
+ * @header CFTReaderDiscovery.h
+ *
+ * @brief Bluetooth reader scanning with a ranked list that changes a row at a time.
+ * CFTReaderDiscovery runs a CFTReaderUtilities scan and reports each change to the readers in
+ * range as the insertions, removals, moves and reloads a table view needs, instead of a new
+ * array. The connected reader comes first, then readers used in the last twelve hours, then the
+ * rest by signal strength. The reader used last is remembered across launches and connected as
+ * soon as it is in range, without waiting for the scan to finish.
+ *
+ * CFTCardReaderInfo carries no signal strength, so the discovery also listens to Bluetooth
+ * advertisements itself and matches them to readers by name. The app's Info.plist needs
+ * NSBluetoothAlwaysUsageDescription, as it already does to use Bluetooth readers.
+ *
+ * CFTReaderDiscovery becomes the delegate of [CFTReaderUtilities shared] while it is running and
+ * forwards the session and reader events it receives. Reader events are also published to
+ * [CFTReaderEventBus shared].
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTCardReaderInfo;
+@class CFTReaderConnectionManager;
+@class CFTReaderDiscovery;
+
+/*!
+ * @typedef CFTReaderChangeKind
+ * @brief How one row of CFTReaderDiscovery.readers changed
+ * @constant CFTReaderChangeKindRemoved Row at previousIndex was deleted
+ * @constant CFTReaderChangeKindAdded Row was inserted at index
+ * @constant CFTReaderChangeKindMoved Row moved from previousIndex to index; its contents may have changed too
+ * @constant CFTReaderChangeKindUpdated Row at index changed connection, signal or last use
+ * @discussion Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTReaderChangeKind) {
+    CFTReaderChangeKindRemoved NS_SWIFT_NAME(removed) = 0,
+    CFTReaderChangeKindAdded NS_SWIFT_NAME(added) = 1,
+    CFTReaderChangeKindMoved NS_SWIFT_NAME(moved) = 2,
+    CFTReaderChangeKindUpdated NS_SWIFT_NAME(updated) = 3
+};
+
+@interface CFTDiscoveredReader : NSObject
+
+/*!
+ * @property cardReaderInfo
+ * @brief Reader as the SDK last reported it; pass it to connectReader:
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTCardReaderInfo *cardReaderInfo;
+
+/*!
+ * @property signalStrength
+ * @brief Smoothed signal strength in dBm, NSNotFound until an advertisement is heard
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSInteger signalStrength;
+
+/*!
+ * @property lastUsedDate
+ * @brief When the reader was last connected, nil if it never was
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) NSDate *lastUsedDate;
+
+/*!
+ * @property isConnected
+ * @brief YES while the reader is connected
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isConnected;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTReaderChange : NSObject
+
+/*!
+ * @property kind
+ * @brief What happened to the row
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTReaderChangeKind kind;
+
+/*!
+ * @property name
+ * @brief Name of the reader in the row
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSString *name;
+
+/*!
+ * @property index
+ * @brief Row in the new list; unused for removals
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger index;
+
+/*!
+ * @property previousIndex
+ * @brief Row in the previous list; unused for insertions
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger previousIndex;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@protocol CFTReaderDiscoveryDelegate <NSObject>
+
+/*!
+ * @brief The ranked readers changed
+ * @param discovery CFTReaderDiscovery - Discovery that changed
+ * @param readers NSArray<CFTDiscoveredReader *> - Every reader in range, in rank order
+ * @param changes NSArray<CFTReaderChange *> - The changes from the previous readers. Apply them
+ * together in one performBatchUpdates: removals and move sources at previousIndex, insertions,
+ * move targets and reloads at index.
+ * Added in 4.12.0
+ */
+- (void)readerDiscovery:(nonnull CFTReaderDiscovery *)discovery
+       didUpdateReaders:(nonnull NSArray<CFTDiscoveredReader *> *)readers
+                changes:(nonnull NSArray<CFTReaderChange *> *)changes
+NS_SWIFT_NAME(readerDiscovery(_:didUpdate:changes:));
+
+@optional
+
+/*!
+ * @brief The reader used last is in range and nothing is connected
+ * @param discovery CFTReaderDiscovery - Discovery about to connect
+ * @param reader CFTDiscoveredReader - Reader it would connect
+ * @return BOOL - NO to leave the choice to the user. Without this method the reader is connected.
+ * Added in 4.12.0
+ */
+- (BOOL)readerDiscovery:(nonnull CFTReaderDiscovery *)discovery shouldAutoConnectReader:(nonnull CFTDiscoveredReader *)reader
+NS_SWIFT_NAME(readerDiscovery(_:shouldAutoConnect:));
+
+/*!
+ * @brief Forwarded from CFTReaderUtilitiesDelegate
+ * Added in 4.12.0
+ */
+- (void)readerDiscovery:(nonnull CFTReaderDiscovery *)discovery
+didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+         cardReaderInfo:(nullable CFTCardReaderInfo *)cardReaderInfo
+NS_SWIFT_NAME(readerDiscovery(_:didReceive:cardReaderInfo:));
+
+/*!
+ * @brief Forwarded from CFTReaderUtilitiesDelegate
+ * Added in 4.12.0
+ */
+- (void)readerDiscovery:(nonnull CFTReaderDiscovery *)discovery
+didUpdateSessionStatusTo:(CFTReaderUtilitiesSessionStatus)status
+              withError:(nullable NSError *)error
+NS_SWIFT_NAME(readerDiscovery(_:didUpdateSessionStatusTo:withError:));
+
+@end
+
+@interface CFTReaderDiscovery : NSObject
+
+/*!
+ * @property delegate
+ * @brief Receives changes and forwarded events on the main queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, weak, nullable) id<CFTReaderDiscoveryDelegate> delegate;
+
+/*!
+ * @property connectionManager
+ * @brief Given the reader list and events, and used for every connection, so a reader connected
+ * here is kept connected and reconnected when it drops
+ * Added in 4.12.0
+ */
+@property (nonatomic, weak, nullable) CFTReaderConnectionManager *connectionManager;
+
+/*!
+ * @property readers
+ * @brief Every reader in range, in rank order
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSArray<CFTDiscoveredReader *> *readers;
+
+/*!
+ * @property isScanning
+ * @brief YES between start and stop
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isScanning;
+
+/*!
+ * @property autoConnects
+ * @brief Connect the reader used last once per scan when it comes into range. Defaults to YES.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) BOOL autoConnects;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Discovery that remembers readers in a file
+ * @param fileURL NSURL - File the readers used before are kept in, created on the first connection.
+ * nil to remember them only until the discovery is released.
+ * @discussion A missing or unreadable file starts with no remembered readers.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithKnownReadersFileURL:(nullable NSURL *)fileURL
+NS_SWIFT_NAME(init(knownReadersFileURL:));
+
+/*!
+ * @brief Open a utilities session if needed and scan
+ * @discussion Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)start
+NS_SWIFT_NAME(start());
+
+/*!
+ * @brief Stop listening for readers
+ * @discussion Every reader but a connected one is removed. The utilities session stays open so the
+ * connected reader stays connected. Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)stop
+NS_SWIFT_NAME(stop());
+
+/*!
+ * @brief Connect a reader from readers
+ * @discussion Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)connectReader:(nonnull CFTDiscoveredReader *)reader
+NS_SWIFT_NAME(connect(_:));
+
+/*!
+ * @brief Stop remembering a reader, so it is no longer ranked first or connected automatically
+ * @discussion Call on the main queue.
+ * Added in 4.12.0
+ */
+- (void)forgetReader:(nonnull CFTDiscoveredReader *)reader
+NS_SWIFT_NAME(forget(_:));
+
+@end
@@ -0,0 +1,289 @@
+//
+//  CFTReaderDiscovery.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTReaderDiscovery.h"
+#import "CFTCorePrivate.h"
+#import "CFTReaderConnectionManager.h"
+#import "CFTReaderEventBus.h"
+
+#import <CoreBluetooth/CoreBluetooth.h>
+#import <CardFlight/CFTCardReaderInfo.h>
+#import <CardFlight/CFTReaderUtilities.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/ReaderDiscovery.hpp"
+
+static int64_t CFTReaderDiscoveryNowMillis(void) {
+    return CFTCoreMillisFromDate([NSDate date]);
+}
+
+@interface CFTDiscoveredReader ()
+
+- (nonnull instancetype)initWithCardReaderInfo:(nonnull CFTCardReaderInfo *)cardReaderInfo
+                                        reader:(const cft::DiscoveredReader &)reader;
+
+@end
+
+@interface CFTReaderChange ()
+
+- (nonnull instancetype)initWithChange:(const cft::ReaderChange &)change;
+
+@end
+
+@interface CFTReaderDiscovery () <CFTReaderUtilitiesDelegate, CBCentralManagerDelegate>
+@end
+
+@implementation CFTDiscoveredReader
+
+- (instancetype)initWithCardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo reader:(const cft::DiscoveredReader &)reader {
+    self = [super init];
+    if (self) {
+        _cardReaderInfo = cardReaderInfo;
+        _signalStrength = reader.signal == cft::kNoSignal ? NSNotFound : reader.signal;
+        _lastUsedDate = reader.lastUsedMillis > 0 ? CFTCoreDateFromMillis(reader.lastUsedMillis) : nil;
+        _isConnected = reader.connected;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTReaderChange
+
+- (instancetype)initWithChange:(const cft::ReaderChange &)change {
+    self = [super init];
+    if (self) {
+        _kind = static_cast<CFTReaderChangeKind>(change.kind);
+        _name = @(change.name.c_str());
+        _index = change.index;
+        _previousIndex = change.previousIndex;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTReaderDiscovery {
+    // Everything below is only touched on the main queue.
+    std::unique_ptr<cft::ReaderDiscovery> _discovery;
+    NSURL *_fileURL;
+    NSMutableDictionary<NSString *, CFTCardReaderInfo *> *_cardReaderInfos;
+    CBCentralManager *_centralManager;
+    BOOL _sessionOpen;
+    BOOL _autoConnectOffered;
+}
+
+- (instancetype)initWithKnownReadersFileURL:(NSURL *)fileURL {
+    self = [super init];
+    if (self) {
+        _discovery.reset(new cft::ReaderDiscovery());
+        _fileURL = fileURL.isFileURL ? fileURL : nil;
+        if (_fileURL != nil) {
+            _discovery->load(_fileURL.fileSystemRepresentation);
+        }
+        _cardReaderInfos = [NSMutableDictionary dictionary];
+        _readers = @[];
+        _autoConnects = YES;
+    }
+    return self;
+}
+
+- (void)start {
+    if (_isScanning) {
+        return;
+    }
+    _isScanning = YES;
+    _autoConnectOffered = NO;
+
+    CFTReaderUtilities *utilities = [CFTReaderUtilities shared];
+    utilities.delegate = self;
+    if (_sessionOpen) {
+        [utilities scanBluetoothCardReaders];
+    } else {
+        [utilities openSessionWithDelegate:self];
+    }
+
+    if (_centralManager == nil) {
+        _centralManager = [[CBCentralManager alloc] initWithDelegate:self
+                                                               queue:dispatch_get_main_queue()
+                                                             options:@{CBCentralManagerOptionShowPowerAlertKey: @NO}];
+    } else {
+        [self centralManagerDidUpdateState:_centralManager];
+    }
+}
+
+- (void)stop {
+    if (!_isScanning) {
+        return;
+    }
+    _isScanning = NO;
+    if (_centralManager.state == CBManagerStatePoweredOn) {
+        [_centralManager stopScan];
+    }
+
+    std::vector<cft::ReaderChange> changes;
+    _discovery->endScan(CFTReaderDiscoveryNowMillis(), changes);
+    [self publishChanges:changes];
+}
+
+- (void)connectReader:(CFTDiscoveredReader *)reader {
+    _autoConnectOffered = YES;
+    CFTReaderConnectionManager *connectionManager = self.connectionManager;
+    if (connectionManager != nil) {
+        [connectionManager connectCardReader:reader.cardReaderInfo];
+    } else {
+        [[CFTReaderUtilities shared] selectCardReaderInfo:reader.cardReaderInfo cardReaderModel:reader.cardReaderInfo.cardReaderModel];
+    }
+}
+
+- (void)forgetReader:(CFTDiscoveredReader *)reader {
+    std::vector<cft::ReaderChange> changes;
+    _discovery->forget(std::string(reader.cardReaderInfo.name.UTF8String ?: ""), CFTReaderDiscoveryNowMillis(), changes);
+    [self saveKnownReaders];
+    [self publishChanges:changes];
+}
+
+#pragma mark - Ranking
+
+- (void)publishChanges:(const std::vector<cft::ReaderChange> &)changes {
+    if (changes.empty()) {
+        return;
+    }
+
+    NSMutableArray<CFTDiscoveredReader *> *readers = [NSMutableArray arrayWithCapacity:_discovery->ranked().size()];
+    for (const cft::DiscoveredReader &reader : _discovery->ranked()) {
+        CFTCardReaderInfo *info = _cardReaderInfos[@(reader.name.c_str())];
+        if (info != nil) {
+            [readers addObject:[[CFTDiscoveredReader alloc] initWithCardReaderInfo:info reader:reader]];
+        }
+    }
+    NSMutableArray<CFTReaderChange *> *readerChanges = [NSMutableArray arrayWithCapacity:changes.size()];
+    for (const cft::ReaderChange &change : changes) {
+        [readerChanges addObject:[[CFTReaderChange alloc] initWithChange:change]];
+    }
+    _readers = [readers copy];
+    [self.delegate readerDiscovery:self didUpdateReaders:_readers changes:readerChanges];
+
+    [self offerAutoConnect];
+}
+
+- (void)offerAutoConnect {
+    cft::DiscoveredReader candidate;
+    if (!_autoConnects || _autoConnectOffered || !_isScanning || !_discovery->autoConnectCandidate(candidate)) {
+        return;
+    }
+    CFTCardReaderInfo *info = _cardReaderInfos[@(candidate.name.c_str())];
+    if (info == nil) {
+        return;
+    }
+    _autoConnectOffered = YES;
+
+    CFTDiscoveredReader *reader = [[CFTDiscoveredReader alloc] initWithCardReaderInfo:info reader:candidate];
+    id<CFTReaderDiscoveryDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(readerDiscovery:shouldAutoConnectReader:)] &&
+        ![delegate readerDiscovery:self shouldAutoConnectReader:reader]) {
+        return;
+    }
+    [self connectReader:reader];
+}
+
+// Losing the file only costs the ranking of past readers, so a failed write is not reported.
+- (void)saveKnownReaders {
+    if (_fileURL != nil) {
+        _discovery->save(_fileURL.fileSystemRepresentation);
+    }
+}
+
+#pragma mark - CFTReaderUtilitiesDelegate
+
+- (void)utilities:(CFTReaderUtilities *)utilities didUpdateSessionStatusTo:(CFTReaderUtilitiesSessionStatus)status withError:(NSError *)error {
+    _sessionOpen = status == CFTReaderUtilitiesSessionStatusOpen;
+    if (_sessionOpen && _isScanning) {
+        [utilities scanBluetoothCardReaders];
+    }
+
+    id<CFTReaderDiscoveryDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(readerDiscovery:didUpdateSessionStatusTo:withError:)]) {
+        [delegate readerDiscovery:self didUpdateSessionStatusTo:status withError:error];
+    }
+}
+
+- (void)utilities:(CFTReaderUtilities *)utilities didUpdateCardReaderArray:(NSArray<CFTCardReaderInfo *> *)cardReaderArray {
+    // Heartbeat scans of the connection manager also land here; outside a scan of our own they
+    // would make every reader out of sight look lost.
+    [self.connectionManager handleCardReaderArray:cardReaderArray];
+    if (!_isScanning) {
+        return;
+    }
+
+    std::vector<cft::ReaderSighting> visible;
+    visible.reserve(cardReaderArray.count);
+    for (CFTCardReaderInfo *info in cardReaderArray) {
+        _cardReaderInfos[info.name] = info;
+        visible.push_back(cft::ReaderSighting{std::string(info.name.UTF8String ?: ""),
+                                              static_cast<cft::CardReaderModel>(info.cardReaderModel),
+                                              info.readerStatus == CFTCardReaderStatusConnected});
+    }
+
+    std::vector<cft::ReaderChange> changes;
+    _discovery->updateVisible(visible, CFTReaderDiscoveryNowMillis(), changes);
+    [self publishChanges:changes];
+}
+
+- (void)utilities:(CFTReaderUtilities *)utilities didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+   cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo {
+    [[CFTReaderEventBus shared] publishCardReaderEvent:cardReaderEvent
+                                        cardReaderInfo:cardReaderInfo
+                                                source:CFTReaderEventSourceUtilities];
+    [self.connectionManager handleCardReaderEvent:cardReaderEvent cardReaderInfo:cardReaderInfo];
+
+    if (cardReaderInfo != nil &&
+        (cardReaderEvent == CFTCardReaderEventConnected || cardReaderEvent == CFTCardReaderEventDisconnected)) {
+        const std::string name(cardReaderInfo.name.UTF8String ?: "");
+        std::vector<cft::ReaderChange> changes;
+        _cardReaderInfos[cardReaderInfo.name] = cardReaderInfo;
+        if (cardReaderEvent == CFTCardReaderEventConnected) {
+            _discovery->recordConnected(name, static_cast<cft::CardReaderModel>(cardReaderInfo.cardReaderModel),
+                                        CFTReaderDiscoveryNowMillis(), changes);
+            [self saveKnownReaders];
+        } else {
+            _discovery->recordDisconnected(name, CFTReaderDiscoveryNowMillis(), changes);
+        }
+        [self publishChanges:changes];
+    }
+
+    id<CFTReaderDiscoveryDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(readerDiscovery:didReceiveCardReaderEvent:cardReaderInfo:)]) {
+        [delegate readerDiscovery:self didReceiveCardReaderEvent:cardReaderEvent cardReaderInfo:cardReaderInfo];
+    }
+}
+
+#pragma mark - CBCentralManagerDelegate
+
+- (void)centralManagerDidUpdateState:(CBCentralManager *)central {
+    if (central.state == CBManagerStatePoweredOn && _isScanning) {
+        [central scanForPeripheralsWithServices:nil options:@{CBCentralManagerScanOptionAllowDuplicatesKey: @YES}];
+    }
+}
+
+- (void)centralManager:(CBCentralManager *)central
+ didDiscoverPeripheral:(CBPeripheral *)peripheral
+     advertisementData:(NSDictionary<NSString *, id> *)advertisementData
+                  RSSI:(NSNumber *)RSSI {
+    NSString *name = advertisementData[CBAdvertisementDataLocalNameKey] ?: peripheral.name;
+    if (name == nil || !_isScanning) {
+        return;
+    }
+    std::vector<cft::ReaderChange> changes;
+    _discovery->updateSignal(std::string(name.UTF8String ?: ""), RSSI.intValue, CFTReaderDiscoveryNowMillis(), changes);
+    [self publishChanges:changes];
+}
+
+@end
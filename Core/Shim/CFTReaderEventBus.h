@@ -0,0 +1,197 @@
+/*!
+ * @header CFTReaderEventBus.h
+ *
+ * @brief Card reader events for any number of subscribers, each on its own queue.
+ * CFTReaderUtilitiesDelegate and CFTTransactionDelegate each report reader events to a single
+ * delegate on the main queue, and a reader can send battery updates faster than a screen needs
+ * them. The bus takes events from both paths, keeps an event reported on both once, and hands
+ * them to every subscriber on the queue it chose, in the order they happened.
+ *
+ * Publishing never waits for a subscriber: events go into a bounded lock-free queue and are
+ * moved to the subscribers' inboxes on the bus's own queue. A subscriber that falls behind has
+ * battery updates and connecting events merged to the newest per reader, and past its capacity
+ * loses events itself, told how many it missed, while the others carry on.
+ *
+ * CFTReaderDiscovery and CFTTransactionTracer publish the events they see to the shared bus.
+ * Apps with their own delegates call publishCardReaderEvent:cardReaderInfo:source: from them.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTCardReaderInfo;
+
+/*!
+ * @typedef CFTReaderEventSource
+ * @brief Delegate path an event was reported on
+ * @constant CFTReaderEventSourceUtilities CFTReaderUtilitiesDelegate
+ * @constant CFTReaderEventSourceTransaction CFTTransactionDelegate
+ * @discussion Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTReaderEventSource) {
+    CFTReaderEventSourceUtilities NS_SWIFT_NAME(utilities) = 0,
+    CFTReaderEventSourceTransaction NS_SWIFT_NAME(transaction) = 1
+};
+
+/*!
+ * @typedef CFTReaderEventOverflow
+ * @brief What a subscriber that has fallen capacity events behind gives up
+ * @constant CFTReaderEventOverflowDropOldest Its oldest undelivered event
+ * @constant CFTReaderEventOverflowDropNewest The event that did not fit
+ * @discussion Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTReaderEventOverflow) {
+    CFTReaderEventOverflowDropOldest NS_SWIFT_NAME(dropOldest) = 0,
+    CFTReaderEventOverflowDropNewest NS_SWIFT_NAME(dropNewest) = 1
+};
+
+@interface CFTReaderEvent : NSObject
+
+/*!
+ * @property cardReaderEvent
+ * @brief What the reader reported
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTCardReaderEvent cardReaderEvent;
+
+/*!
+ * @property cardReaderInfo
+ * @brief The reader as it was last published, nil if the event came without one
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTCardReaderInfo *cardReaderInfo;
+
+/*!
+ * @property source
+ * @brief Path the event was first reported on
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTReaderEventSource source;
+
+/*!
+ * @property date
+ * @brief When the event was published
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) NSDate *date;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTReaderEventSubscriptionOptions : NSObject <NSCopying>
+
+/*!
+ * @property cardReaderEvents
+ * @brief CFTCardReaderEvent values to receive, nil for all. Defaults to nil.
+ * Added in 4.12.0
+ */
+@property (nonatomic, copy, nullable) NSIndexSet *cardReaderEvents;
+
+/*!
+ * @property coalescedCardReaderEvents
+ * @brief CFTCardReaderEvent values of which only the newest undelivered one per reader is kept.
+ * Defaults to batteryStatusUpdated and connecting; empty to receive every event.
+ * Added in 4.12.0
+ */
+@property (nonatomic, copy, nonnull) NSIndexSet *coalescedCardReaderEvents;
+
+/*!
+ * @property capacity
+ * @brief Undelivered events held for the subscriber. Defaults to 256.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSUInteger capacity;
+
+/*!
+ * @property overflow
+ * @brief What is dropped past capacity. Defaults to CFTReaderEventOverflowDropOldest.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) CFTReaderEventOverflow overflow;
+
+@end
+
+@interface CFTReaderEventSubscription : NSObject
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTReaderEventBus : NSObject
+
+/*!
+ * @property rejectedCount
+ * @brief Events dropped because the bus's queue was full when they were published
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t rejectedCount;
+
+/*!
+ * @property duplicateCount
+ * @brief Events dropped because the other path had just reported them
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t duplicateCount;
+
+/*!
+ * @brief The bus CFTReaderDiscovery and CFTTransactionTracer publish to
+ * Added in 4.12.0
+ */
++ (nonnull instancetype)shared;
+
+/*!
+ * @brief Create a bus holding up to 1024 events between publishing and delivery to the inboxes
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)init;
+
+/*!
+ * @brief Create a bus with an explicit queue size
+ * @param capacity NSUInteger - Events published but not yet moved to inboxes, rounded up to a power of two
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithCapacity:(NSUInteger)capacity
+NS_SWIFT_NAME(init(capacity:)) NS_DESIGNATED_INITIALIZER;
+
+/*!
+ * @brief Publish a reader event from any thread
+ * @discussion Never waits for a subscriber. The same event with the same battery status from
+ * the other source within 100 ms is dropped as a duplicate.
+ * @return BOOL - NO if the bus's queue was full and the event was dropped
+ * Added in 4.12.0
+ */
+- (BOOL)publishCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+                cardReaderInfo:(nullable CFTCardReaderInfo *)cardReaderInfo
+                        source:(CFTReaderEventSource)source
+NS_SWIFT_NAME(publish(_:cardReaderInfo:source:));
+
+/*!
+ * @brief Receive events published from now on
+ * @param options CFTReaderEventSubscriptionOptions - nil for every event with the defaults
+ * @param queue dispatch_queue_t - Queue handler is called on; nil for the main queue. Calls do not overlap.
+ * @param handler - Called with the events delivered since the last call, oldest first, and how
+ * many the subscriber lost to its capacity in between. A non-zero missedCount means state
+ * tracked from events should be refreshed.
+ * @return CFTReaderEventSubscription - Keep it to unsubscribe
+ * Added in 4.12.0
+ */
+- (nonnull CFTReaderEventSubscription *)subscribeWithOptions:(nullable CFTReaderEventSubscriptionOptions *)options
+                                                       queue:(nullable dispatch_queue_t)queue
+                                                     handler:(nonnull void (^)(NSArray<CFTReaderEvent *> * _Nonnull events,
+                                                                               NSUInteger missedCount))handler
+NS_SWIFT_NAME(subscribe(options:queue:handler:));
+
+/*!
+ * @brief Stop delivering to a subscriber
+ * @discussion Events not yet delivered are discarded. A call to the handler already under way finishes.
+ * Added in 4.12.0
+ */
+- (void)unsubscribe:(nonnull CFTReaderEventSubscription *)subscription
+NS_SWIFT_NAME(unsubscribe(_:));
+
+@end
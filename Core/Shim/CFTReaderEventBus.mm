@@ -0,0 +1,287 @@
+//
+//  CFTReaderEventBus.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTReaderEventBus.h"
+
+#import <CardFlight/CFTCardReaderInfo.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "cft/Clock.hpp"
+#include "cft/ReaderEventBus.hpp"
+
+static_assert(static_cast<NSInteger>(cft::ReaderEventSource::Transaction) == CFTReaderEventSourceTransaction, "");
+static_assert(static_cast<NSInteger>(cft::ReaderEventOverflow::DropNewest) == CFTReaderEventOverflowDropNewest, "");
+
+static const NSUInteger CFTReaderEventBusDefaultCapacity = 1024;
+
+static cft::ReaderEventMask CFTReaderEventMask(NSIndexSet *events) {
+    __block cft::ReaderEventMask mask = 0;
+    [events enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        if (index < cft::kCardReaderEventCount) {
+            mask |= cft::readerEventBit(static_cast<cft::CardReaderEvent>(index));
+        }
+    }];
+    return mask;
+}
+
+@interface CFTReaderEvent ()
+
+- (nonnull instancetype)initWithMessage:(const cft::ReaderEventMessage &)message
+                         cardReaderInfo:(nullable CFTCardReaderInfo *)cardReaderInfo
+                                   date:(nonnull NSDate *)date;
+
+@end
+
+@interface CFTReaderEventSubscriptionOptions ()
+
+- (cft::ReaderEventSubscription)coreSubscription;
+
+@end
+
+@interface CFTReaderEventSubscription ()
+
+@property (nonatomic, readonly, assign) cft::ReaderEventBus::SubscriberId subscriberId;
+@property (nonatomic, readonly, strong, nonnull) dispatch_queue_t queue;
+@property (nonatomic, readonly, copy, nonnull) void (^handler)(NSArray<CFTReaderEvent *> *, NSUInteger);
+
+- (nonnull instancetype)initWithSubscriberId:(cft::ReaderEventBus::SubscriberId)subscriberId
+                                       queue:(nonnull dispatch_queue_t)queue
+                                     handler:(nonnull void (^)(NSArray<CFTReaderEvent *> *, NSUInteger))handler;
+
+@end
+
+@implementation CFTReaderEvent
+
+- (instancetype)initWithMessage:(const cft::ReaderEventMessage &)message
+                 cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo
+                           date:(NSDate *)date {
+    self = [super init];
+    if (self) {
+        _cardReaderEvent = static_cast<CFTCardReaderEvent>(message.event);
+        _cardReaderInfo = cardReaderInfo;
+        _source = static_cast<CFTReaderEventSource>(message.source);
+        _date = date;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTReaderEventSubscriptionOptions
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        const cft::ReaderEventSubscription defaults;
+        NSMutableIndexSet *coalesced = [NSMutableIndexSet indexSet];
+        for (NSUInteger event = 0; event < cft::kCardReaderEventCount; ++event) {
+            if (defaults.coalesced & cft::readerEventBit(static_cast<cft::CardReaderEvent>(event))) {
+                [coalesced addIndex:event];
+            }
+        }
+        _coalescedCardReaderEvents = [coalesced copy];
+        _capacity = defaults.capacity;
+        _overflow = static_cast<CFTReaderEventOverflow>(defaults.overflow);
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    CFTReaderEventSubscriptionOptions *copy = [[[self class] allocWithZone:zone] init];
+    copy.cardReaderEvents = _cardReaderEvents;
+    copy.coalescedCardReaderEvents = _coalescedCardReaderEvents;
+    copy.capacity = _capacity;
+    copy.overflow = _overflow;
+    return copy;
+}
+
+- (cft::ReaderEventSubscription)coreSubscription {
+    cft::ReaderEventSubscription subscription;
+    subscription.events = _cardReaderEvents == nil ? cft::kAllReaderEvents : CFTReaderEventMask(_cardReaderEvents);
+    subscription.coalesced = CFTReaderEventMask(_coalescedCardReaderEvents);
+    subscription.capacity = MAX(_capacity, (NSUInteger)1);
+    subscription.overflow = _overflow == CFTReaderEventOverflowDropNewest ? cft::ReaderEventOverflow::DropNewest
+                                                                          : cft::ReaderEventOverflow::DropOldest;
+    return subscription;
+}
+
+@end
+
+@implementation CFTReaderEventSubscription
+
+- (instancetype)initWithSubscriberId:(cft::ReaderEventBus::SubscriberId)subscriberId
+                               queue:(dispatch_queue_t)queue
+                             handler:(void (^)(NSArray<CFTReaderEvent *> *, NSUInteger))handler {
+    self = [super init];
+    if (self) {
+        _subscriberId = subscriberId;
+        _queue = queue;
+        _handler = [handler copy];
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTReaderEventBus {
+    std::unique_ptr<cft::ReaderEventBus> _bus;
+    // Moves published events into inboxes; one dispatch is queued at a time.
+    dispatch_queue_t _dispatchQueue;
+    std::atomic<bool> _dispatchScheduled;
+    // Guarded by @synchronized on themselves.
+    NSMutableDictionary<NSNumber *, CFTReaderEventSubscription *> *_subscriptions;
+    NSMutableDictionary<NSNumber *, CFTCardReaderInfo *> *_cardReaderInfos;
+}
+
++ (instancetype)shared {
+    static CFTReaderEventBus *shared;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        shared = [[CFTReaderEventBus alloc] init];
+    });
+    return shared;
+}
+
+- (instancetype)init {
+    return [self initWithCapacity:CFTReaderEventBusDefaultCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (self) {
+        cft::ReaderEventBusConfig config;
+        config.capacity = MAX(capacity, (NSUInteger)2);
+        _bus.reset(new cft::ReaderEventBus(config));
+        _dispatchQueue = dispatch_queue_create("com.cardflight.readereventbus", DISPATCH_QUEUE_SERIAL);
+        _dispatchScheduled = false;
+        _subscriptions = [NSMutableDictionary dictionary];
+        _cardReaderInfos = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (uint64_t)rejectedCount {
+    return _bus->stats().rejected;
+}
+
+- (uint64_t)duplicateCount {
+    return _bus->stats().duplicates;
+}
+
+- (BOOL)publishCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+                cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo
+                        source:(CFTReaderEventSource)source {
+    std::uint32_t reader = 0;
+    std::int32_t batteryStatus = 0;
+    if (cardReaderInfo != nil) {
+        reader = cft::readerEventId(cardReaderInfo.name.UTF8String);
+        batteryStatus = static_cast<std::int32_t>(cardReaderInfo.batteryStatus);
+        // Held only for the assignment; deliveries copy the table under it.
+        @synchronized (_cardReaderInfos) {
+            _cardReaderInfos[@(reader)] = cardReaderInfo;
+        }
+    }
+    const BOOL published = _bus->publish(static_cast<cft::CardReaderEvent>(cardReaderEvent),
+                                         static_cast<cft::ReaderEventSource>(source), reader, batteryStatus);
+    if (published) {
+        [self scheduleDispatch];
+    }
+    return published;
+}
+
+- (CFTReaderEventSubscription *)subscribeWithOptions:(CFTReaderEventSubscriptionOptions *)options
+                                               queue:(dispatch_queue_t)queue
+                                             handler:(void (^)(NSArray<CFTReaderEvent *> *, NSUInteger))handler {
+    CFTReaderEventSubscriptionOptions *resolved = options ?: [[CFTReaderEventSubscriptionOptions alloc] init];
+    const cft::ReaderEventBus::SubscriberId subscriberId = _bus->subscribe([resolved coreSubscription]);
+    CFTReaderEventSubscription *subscription =
+        [[CFTReaderEventSubscription alloc] initWithSubscriberId:subscriberId
+                                                           queue:queue ?: dispatch_get_main_queue()
+                                                         handler:handler];
+    @synchronized (_subscriptions) {
+        _subscriptions[@(subscriberId)] = subscription;
+    }
+    return subscription;
+}
+
+- (void)unsubscribe:(CFTReaderEventSubscription *)subscription {
+    @synchronized (_subscriptions) {
+        [_subscriptions removeObjectForKey:@(subscription.subscriberId)];
+    }
+    _bus->unsubscribe(subscription.subscriberId);
+}
+
+#pragma mark - Delivery
+
+// Called by every publisher; only the first since the last dispatch queues one.
+- (void)scheduleDispatch {
+    if (_dispatchScheduled.exchange(true)) {
+        return;
+    }
+    __weak CFTReaderEventBus *weakSelf = self;
+    dispatch_async(_dispatchQueue, ^{
+        CFTReaderEventBus *bus = weakSelf;
+        if (bus != nil) {
+            // Cleared first, so an event published during the dispatch queues another.
+            bus->_dispatchScheduled = false;
+            [bus dispatch];
+        }
+    });
+}
+
+// Runs on _dispatchQueue.
+- (void)dispatch {
+    std::vector<cft::ReaderEventBus::SubscriberId> woken;
+    while (_bus->dispatch(&woken) > 0) {
+    }
+    for (cft::ReaderEventBus::SubscriberId subscriberId : woken) {
+        CFTReaderEventSubscription *subscription;
+        @synchronized (_subscriptions) {
+            subscription = _subscriptions[@(subscriberId)];
+        }
+        if (subscription == nil) {
+            continue;
+        }
+        __weak CFTReaderEventBus *weakSelf = self;
+        dispatch_async(subscription.queue, ^{
+            [weakSelf deliverToSubscription:subscription];
+        });
+    }
+}
+
+// Runs on the subscriber's queue, once for each time its inbox stops being empty.
+- (void)deliverToSubscription:(CFTReaderEventSubscription *)subscription {
+    const cft::Nanos now = cft::monotonicNanos();
+    NSDate *date = [NSDate date];
+    NSArray<CFTReaderEvent *> *events = nil;
+    NSUInteger missedCount = 0;
+    _bus->drain(subscription.subscriberId, [&](const cft::ReaderEventMessage *messages, std::size_t count, std::uint64_t missed) {
+        NSDictionary<NSNumber *, CFTCardReaderInfo *> *infos;
+        @synchronized (_cardReaderInfos) {
+            infos = [_cardReaderInfos copy];
+        }
+        NSMutableArray<CFTReaderEvent *> *delivered = [NSMutableArray arrayWithCapacity:count];
+        for (std::size_t i = 0; i < count; ++i) {
+            const cft::ReaderEventMessage &message = messages[i];
+            const cft::Nanos age = now > message.timestamp ? now - message.timestamp : 0;
+            CFTCardReaderInfo *info = message.reader != 0 ? infos[@(message.reader)] : nil;
+            [delivered addObject:[[CFTReaderEvent alloc] initWithMessage:message
+                                                          cardReaderInfo:info
+                                                                    date:[date dateByAddingTimeInterval:-(age / 1e9)]]];
+        }
+        events = delivered;
+        missedCount = static_cast<NSUInteger>(missed);
+    });
+    if (events != nil) {
+        subscription.handler(events, missedCount);
+    }
+}
+
+@end
@@ -0,0 +1,138 @@
+/*!
+ * @header CFTReaderSession.h
+ *
+ * @brief One session per card reader, so a checkout with several readers runs a transaction on
+ * each at the same time. CFTReaderUtilities is shared by the whole app; a CFTReaderSession
+ * belongs to one CFTCardReaderInfo and starts its transactions bound to that reader.
+ *
+ * Each session follows its transactions on a serial queue of its own and keeps its own state
+ * and transaction times, so a busy reader never holds up the bookkeeping of another. A reader
+ * belongs to at most one open session.
+ *
+ * Several transactions in flight at once rely on the SDK connecting to each selected reader
+ * independently. Delegate callbacks reach the app exactly as the SDK reports them.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+#import <CardFlight/CFTTransaction.h>
+
+@class CFTCardReaderInfo;
+
+@interface CFTReaderSession : NSObject
+
+/*!
+ * @property cardReaderInfo
+ * @brief The reader the session's transactions use
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTCardReaderInfo *cardReaderInfo;
+
+/*!
+ * @property transaction
+ * @brief The transaction running on the session, nil once it is released or abandoned
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, weak, nullable) CFTTransaction *transaction;
+
+/*!
+ * @property state
+ * @brief State of the session's transaction as last reported by the SDK
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionState state;
+
+/*!
+ * @property busy
+ * @brief YES from beginning a transaction until it completes, defers or is abandoned
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign, getter=isBusy) BOOL busy;
+
+/*!
+ * @property transactionCount
+ * @brief Transactions that completed or deferred on the session
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger transactionCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Open a session for a reader
+ * @param cardReaderInfo CFTCardReaderInfo - From discovery or a CFTReaderUtilitiesDelegate callback
+ * @param error NSError - CFTCoreErrorCodeInvalidArgument if the reader already has a session,
+ * CFTCoreErrorCodeCapacityExceeded if eight sessions are open
+ * @return CFTReaderSession - nil on error
+ * Added in 4.12.0
+ */
++ (nullable instancetype)sessionWithCardReaderInfo:(nonnull CFTCardReaderInfo *)cardReaderInfo
+                                             error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(cardReaderInfo:));
+
+/*!
+ * @brief The open session of a reader, for routing reader callbacks to it
+ * @return CFTReaderSession - nil if the reader has none
+ * Added in 4.12.0
+ */
++ (nullable instancetype)sessionForCardReaderInfo:(nonnull CFTCardReaderInfo *)cardReaderInfo
+NS_SWIFT_NAME(session(for:));
+
+/*!
+ * @brief Start a transaction on the session's reader
+ * @param delegate id<CFTTransactionDelegate> - Receives every callback of the transaction
+ * @param error NSError - CFTCoreErrorCodeIllegalTransition while the previous transaction runs,
+ * or if the SDK cannot start one now
+ * @return CFTTransaction - Already bound to cardReaderInfo; nil on error
+ * @discussion The transaction's delegate is the session, which forwards to delegate. Keep the
+ * transaction and delegate alive for the length of the transaction. The transaction is abandoned
+ * when it is released or through abandonTransaction; an error short of completing or deferring
+ * leaves it running.
+ * Added in 4.12.0
+ */
+- (nullable CFTTransaction *)beginTransactionWithDelegate:(nonnull id<CFTTransactionDelegate>)delegate
+                                                    error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(beginTransaction(delegate:));
+
+/*!
+ * @brief Give up on the running transaction so the session can begin another or close
+ * @discussion Does not stop the transaction in the SDK; cancel it there first if it still runs.
+ * Nothing it reports afterwards reaches the session, though its delegate still hears of it.
+ * Does nothing when no transaction is running.
+ * Added in 4.12.0
+ */
+- (void)abandonTransaction
+NS_SWIFT_NAME(abandonTransaction());
+
+/*!
+ * @brief Time from beginning a transaction to it completing or deferring
+ * @param percentile double - In the range [0, 100]
+ * @return NSTimeInterval - 0 before the first transaction finishes
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)transactionDurationPercentile:(double)percentile
+NS_SWIFT_NAME(transactionDuration(percentile:));
+
+/*!
+ * @brief Time the session's transactions spent in a state
+ * @param state CFTTransactionState
+ * @param percentile double - In the range [0, 100]
+ * @return NSTimeInterval - Seconds, 0 if no transaction has left state
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile
+NS_SWIFT_NAME(duration(in:percentile:));
+
+/*!
+ * @brief Give the reader up so another session can open it
+ * @param error NSError - CFTCoreErrorCodeIllegalTransition while a transaction runs,
+ * CFTCoreErrorCodeNotFound if the session is already closed
+ * @return BOOL - YES if the session was closed
+ * Added in 4.12.0
+ */
+- (BOOL)close:(NSError * _Nullable * _Nullable)error;
+
+@end
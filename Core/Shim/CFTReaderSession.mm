@@ -0,0 +1,368 @@
+//
+//  CFTReaderSession.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTReaderSession.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTCardReaderInfo.h>
+#import <objc/runtime.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "cft/ReaderLanes.hpp"
+
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingAdjustment) == CFTTransactionStatePendingAdjustment, "");
+
+// Every session of the process shares one registry, so a reader is never claimed twice.
+static cft::ReaderLanes &CFTReaderSessionLanes(void) {
+    static cft::ReaderLanes *lanes = new cft::ReaderLanes();
+    return *lanes;
+}
+
+// Open sessions by reader name; weak, so a session the app lets go of closes itself.
+static NSMapTable<NSString *, CFTReaderSession *> *CFTReaderSessionTable(void) {
+    static NSMapTable<NSString *, CFTReaderSession *> *table;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        table = [NSMapTable strongToWeakObjectsMapTable];
+    });
+    return table;
+}
+
+@class CFTReaderSessionDelegate;
+
+@interface CFTReaderSession ()
+
+- (nonnull instancetype)initWithCardReaderInfo:(nonnull CFTCardReaderInfo *)cardReaderInfo
+                                          lane:(std::shared_ptr<cft::ReaderLane>)lane;
+
+- (void)transactionOf:(CFTReaderSessionDelegate *)transactionDelegate didUpdateState:(CFTTransactionState)state;
+- (void)transactionOf:(CFTReaderSessionDelegate *)transactionDelegate
+    didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent;
+- (void)abandonTransactionOf:(CFTReaderSessionDelegate *)transactionDelegate;
+
+@end
+
+// Sits between a session's transaction and the app's delegate, as CFTTransactionTracer does.
+@interface CFTReaderSessionDelegate : NSObject <CFTTransactionDelegate>
+
+@property (nonatomic, readonly, weak) CFTReaderSession *session;
+@property (nonatomic, readonly, weak) id<CFTTransactionDelegate> delegate;
+
+- (instancetype)initWithSession:(CFTReaderSession *)session delegate:(id<CFTTransactionDelegate>)delegate;
+
+@end
+
+@implementation CFTReaderSessionDelegate
+
+- (instancetype)initWithSession:(CFTReaderSession *)session delegate:(id<CFTTransactionDelegate>)delegate {
+    self = [super init];
+    if (self) {
+        _session = session;
+        _delegate = delegate;
+    }
+    return self;
+}
+
+- (void)transaction:(CFTTransaction *)transaction didUpdateState:(CFTTransactionState)state error:(NSError *)error {
+    [self.session transactionOf:self didUpdateState:state];
+    [self.delegate transaction:transaction didUpdateState:state error:error];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestDisplayMessages:(CFTMessage *)message {
+    [self.delegate transaction:transaction didRequestDisplayMessages:message];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestProcessOptionWithCardInfo:(CFTCardInfo *)cardInfo {
+    [self.delegate transaction:transaction didRequestProcessOptionWithCardInfo:cardInfo];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didDeferWithData:(NSData *)transactionData {
+    [self.delegate transaction:transaction didDeferWithData:transactionData];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestCvm:(CFTCVM)cvm {
+    [self.delegate transaction:transaction didRequestCvm:cvm];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didCompleteWithTransactionRecord:(CFTTransactionRecord *)transactionRecord {
+    [self.delegate transaction:transaction didCompleteWithTransactionRecord:transactionRecord];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+     cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo {
+    [self.session transactionOf:self didReceiveCardReaderEvent:cardReaderEvent];
+    id<CFTTransactionDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(transaction:didReceiveCardReaderEvent:cardReaderInfo:)]) {
+        [delegate transaction:transaction didReceiveCardReaderEvent:cardReaderEvent cardReaderInfo:cardReaderInfo];
+    }
+}
+
+// The remaining optional callbacks go straight to the delegate, and only when it implements them.
+- (BOOL)respondsToSelector:(SEL)selector {
+    if ([super respondsToSelector:selector]) {
+        return YES;
+    }
+    struct objc_method_description method = protocol_getMethodDescription(@protocol(CFTTransactionDelegate), selector, NO, YES);
+    return method.name != NULL && [self.delegate respondsToSelector:selector];
+}
+
+- (id)forwardingTargetForSelector:(SEL)selector {
+    id<CFTTransactionDelegate> delegate = self.delegate;
+    return [delegate respondsToSelector:selector] ? delegate : [super forwardingTargetForSelector:selector];
+}
+
+@end
+
+// Hangs off a session's transaction, so the reader is given back when the transaction is released
+// before it finishes.
+@interface CFTReaderSessionTransactionGuard : NSObject
+
+- (instancetype)initWithSession:(CFTReaderSession *)session transactionDelegate:(CFTReaderSessionDelegate *)transactionDelegate;
+
+@end
+
+@implementation CFTReaderSessionTransactionGuard {
+    __weak CFTReaderSession *_session;
+    __weak CFTReaderSessionDelegate *_transactionDelegate;
+}
+
+- (instancetype)initWithSession:(CFTReaderSession *)session transactionDelegate:(CFTReaderSessionDelegate *)transactionDelegate {
+    self = [super init];
+    if (self) {
+        _session = session;
+        _transactionDelegate = transactionDelegate;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    CFTReaderSessionDelegate *transactionDelegate = _transactionDelegate;
+    if (transactionDelegate != nil) {
+        [_session abandonTransactionOf:transactionDelegate];
+    }
+}
+
+@end
+
+static const void *const CFTReaderSessionTransactionGuardKey = &CFTReaderSessionTransactionGuardKey;
+
+@implementation CFTReaderSession {
+    std::shared_ptr<cft::ReaderLane> _lane;
+    // The lane is only touched on this queue.
+    dispatch_queue_t _queue;
+    // Guarded by @synchronized (self). The transaction only holds its delegate weakly, so the
+    // session keeps the delegate; callbacks from any other delegate are from an abandoned transaction.
+    __weak CFTTransaction *_transaction;
+    CFTReaderSessionDelegate *_transactionDelegate;
+    BOOL _closed;
+}
+
++ (instancetype)sessionWithCardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo error:(NSError **)error {
+    NSString *name = cardReaderInfo.name;
+    std::shared_ptr<cft::ReaderLane> lane;
+    if (!CFTCoreSucceeded(CFTReaderSessionLanes().open(std::string(name.UTF8String ?: ""),
+                                                       static_cast<cft::CardReaderModel>(cardReaderInfo.cardReaderModel), lane),
+                          error)) {
+        return nil;
+    }
+    CFTReaderSession *session = [[CFTReaderSession alloc] initWithCardReaderInfo:cardReaderInfo lane:lane];
+    NSMapTable<NSString *, CFTReaderSession *> *table = CFTReaderSessionTable();
+    @synchronized (table) {
+        [table setObject:session forKey:name];
+    }
+    return session;
+}
+
++ (instancetype)sessionForCardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo {
+    NSString *name = cardReaderInfo.name;
+    // Readers without a session, the common case, are answered without the table's lock.
+    if (name == nil || CFTReaderSessionLanes().find(std::string(name.UTF8String ?: "")) == nullptr) {
+        return nil;
+    }
+    NSMapTable<NSString *, CFTReaderSession *> *table = CFTReaderSessionTable();
+    @synchronized (table) {
+        return [table objectForKey:name];
+    }
+}
+
+- (instancetype)initWithCardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo lane:(std::shared_ptr<cft::ReaderLane>)lane {
+    self = [super init];
+    if (self) {
+        _cardReaderInfo = cardReaderInfo;
+        _lane = std::move(lane);
+        NSString *label = [NSString stringWithFormat:@"com.cardflight.readersession.%u", _lane->id()];
+        _queue = dispatch_queue_create(label.UTF8String, DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (!_closed) {
+        _lane->abandon();
+        CFTReaderSessionLanes().close(_lane->id());
+    }
+}
+
+- (CFTTransaction *)transaction {
+    @synchronized (self) {
+        return _transaction;
+    }
+}
+
+- (CFTTransactionState)state {
+    __block CFTTransactionState state;
+    dispatch_sync(_queue, ^{
+        state = static_cast<CFTTransactionState>(self->_lane->state());
+    });
+    return state;
+}
+
+- (BOOL)isBusy {
+    return _lane->isBusy();
+}
+
+- (NSUInteger)transactionCount {
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{
+        count = static_cast<NSUInteger>(self->_lane->transactions());
+    });
+    return count;
+}
+
+- (CFTTransaction *)beginTransactionWithDelegate:(id<CFTTransactionDelegate>)delegate error:(NSError **)error {
+    __block cft::ErrorCode code = cft::ErrorCode::None;
+    dispatch_sync(_queue, ^{
+        code = self->_closed ? cft::ErrorCode::NotFound : self->_lane->begin();
+    });
+    if (!CFTCoreSucceeded(code, error)) {
+        return nil;
+    }
+
+    CFTReaderSessionDelegate *transactionDelegate = [[CFTReaderSessionDelegate alloc] initWithSession:self delegate:delegate];
+    CFTTransaction *transaction = [[CFTTransaction alloc] initWithDelegate:transactionDelegate];
+    if (transaction == nil) {
+        dispatch_sync(_queue, ^{
+            self->_lane->abandon();
+        });
+        CFTCoreSucceeded(cft::ErrorCode::IllegalTransition, error);
+        return nil;
+    }
+    @synchronized (self) {
+        _transaction = transaction;
+        _transactionDelegate = transactionDelegate;
+    }
+    objc_setAssociatedObject(transaction, CFTReaderSessionTransactionGuardKey,
+                             [[CFTReaderSessionTransactionGuard alloc] initWithSession:self transactionDelegate:transactionDelegate],
+                             OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    [transaction selectCardReaderInfo:_cardReaderInfo cardReaderModel:_cardReaderInfo.cardReaderModel];
+    return transaction;
+}
+
+- (void)abandonTransaction {
+    CFTReaderSessionDelegate *transactionDelegate;
+    @synchronized (self) {
+        transactionDelegate = _transactionDelegate;
+    }
+    if (transactionDelegate != nil) {
+        [self abandonTransactionOf:transactionDelegate];
+    }
+}
+
+- (NSTimeInterval)transactionDurationPercentile:(double)percentile {
+    __block cft::Nanos nanos = 0;
+    dispatch_sync(_queue, ^{
+        const cft::LatencyHistogram &histogram = self->_lane->transactionTimes();
+        nanos = histogram.count() == 0 ? 0 : histogram.percentile(percentile);
+    });
+    return static_cast<NSTimeInterval>(nanos) / NSEC_PER_SEC;
+}
+
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile {
+    if (state < 0 || static_cast<std::size_t>(state) >= cft::kTransactionStateCount) {
+        return 0;
+    }
+    __block cft::Nanos nanos = 0;
+    dispatch_sync(_queue, ^{
+        nanos = self->_lane->stateLatencies().histogram(static_cast<cft::TransactionState>(state)).percentile(percentile);
+    });
+    return static_cast<NSTimeInterval>(nanos) / NSEC_PER_SEC;
+}
+
+- (BOOL)close:(NSError **)error {
+    __block cft::ErrorCode code = cft::ErrorCode::None;
+    dispatch_sync(_queue, ^{
+        code = self->_closed ? cft::ErrorCode::NotFound : CFTReaderSessionLanes().close(self->_lane->id());
+        self->_closed = self->_closed || code == cft::ErrorCode::None;
+    });
+    if (!CFTCoreSucceeded(code, error)) {
+        return NO;
+    }
+    NSMapTable<NSString *, CFTReaderSession *> *table = CFTReaderSessionTable();
+    @synchronized (table) {
+        if ([table objectForKey:_cardReaderInfo.name] == self) {
+            [table removeObjectForKey:_cardReaderInfo.name];
+        }
+    }
+    return YES;
+}
+
+#pragma mark - Following the transaction
+
+- (BOOL)isCurrentTransactionOf:(CFTReaderSessionDelegate *)transactionDelegate {
+    @synchronized (self) {
+        return _transactionDelegate == transactionDelegate;
+    }
+}
+
+// Errors short of a final state are left to the app, which may still retry the transaction; it is
+// abandoned only through abandonTransaction or when the transaction is released.
+- (void)transactionOf:(CFTReaderSessionDelegate *)transactionDelegate didUpdateState:(CFTTransactionState)state {
+    if (![self isCurrentTransactionOf:transactionDelegate]) {
+        return;
+    }
+    const auto coreState = static_cast<cft::TransactionState>(state);
+    dispatch_async(_queue, ^{
+        // A state that cannot follow the last one is skipped; a final one still frees the reader.
+        if (self->_lane->updateState(coreState) != cft::ErrorCode::None &&
+            cft::TransactionStateMachine::isTerminal(coreState)) {
+            self->_lane->abandon();
+        }
+    });
+}
+
+- (void)transactionOf:(CFTReaderSessionDelegate *)transactionDelegate
+    didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent {
+    if (![self isCurrentTransactionOf:transactionDelegate]) {
+        return;
+    }
+    dispatch_async(_queue, ^{
+        self->_lane->recordReaderEvent(static_cast<cft::CardReaderEvent>(cardReaderEvent));
+    });
+}
+
+// Detaches the transaction first, so nothing it reports later reaches the lane of the next one.
+- (void)abandonTransactionOf:(CFTReaderSessionDelegate *)transactionDelegate {
+    @synchronized (self) {
+        if (_transactionDelegate != transactionDelegate) {
+            return;
+        }
+        _transactionDelegate = nil;
+        _transaction = nil;
+    }
+    // Queued behind the callbacks already dispatched, and ahead of a close: that follows. A
+    // transaction that already finished keeps its final state.
+    dispatch_async(_queue, ^{
+        if (self->_lane->isBusy()) {
+            self->_lane->abandon();
+        }
+    });
+}
+
+@end
@@ -0,0 +1,93 @@
+/*!
+ * @header CFTSessionManager+Metrics.h
+ *
+ * @brief Streaming transaction metrics.
+ * Every transaction traced with CFTTransactionTracer reports its events to the metrics delegate
+ * as they happen and its finished trace at the end, and is folded into transactionMetrics so
+ * p50 and p99 of each state and segment can be read at any time.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <CardFlight/CFTSessionManager.h>
+#import <CardFlight/CFTEnum.h>
+
+#import "CFTTransactionTrace.h"
+
+@class CFTTransaction;
+
+@protocol CFTTransactionMetricsDelegate <NSObject>
+
+@optional
+
+/*!
+ * @brief A traced transaction recorded an event
+ * @discussion Called on the queue the SDK delivered the underlying callback on, before the transaction's delegate sees it.
+ * Added in 4.12.0
+ */
+- (void)transaction:(nonnull CFTTransaction *)transaction didRecordTraceEvent:(nonnull CFTTransactionTraceEvent *)event
+NS_SWIFT_NAME(transaction(_:didRecord:));
+
+/*!
+ * @brief A traced transaction completed or was deferred
+ * Added in 4.12.0
+ */
+- (void)transaction:(nonnull CFTTransaction *)transaction didFinishWithTrace:(nonnull CFTTransactionTrace *)trace
+NS_SWIFT_NAME(transaction(_:didFinishWith:));
+
+@end
+
+@interface CFTTransactionMetrics : NSObject
+
+/*!
+ * @property transactionCount
+ * @brief Traced transactions included since the last reset
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger transactionCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Time spent in a state per transaction that visited it
+ * @param percentile double - In the range [0, 100]
+ * @return NSTimeInterval - Seconds
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile
+NS_SWIFT_NAME(duration(in:percentile:));
+
+/*!
+ * @brief Time attributed to a segment per transaction that had it
+ * @discussion Keyed transactions have no card segments and are left out of them.
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationOfSegment:(CFTTransactionTraceSegment)segment percentile:(double)percentile
+NS_SWIFT_NAME(duration(of:percentile:));
+
+/*!
+ * @brief Forget every transaction included so far
+ * Added in 4.12.0
+ */
+- (void)reset;
+
+@end
+
+@interface CFTSessionManager (Metrics)
+
+/*!
+ * @property metricsDelegate
+ * @brief Receives the events and traces of every traced transaction
+ * Added in 4.12.0
+ */
+@property (nonatomic, readwrite, weak, nullable) id <CFTTransactionMetricsDelegate> metricsDelegate;
+
+/*!
+ * @property transactionMetrics
+ * @brief Percentiles across every traced transaction of the session
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTTransactionMetrics *transactionMetrics;
+
+@end
@@ -0,0 +1,108 @@
+//
+//  CFTSessionManager+Metrics.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTSessionManager+Metrics.h"
+#import "CFTCorePrivate.h"
+
+#import <objc/runtime.h>
+
+#include "cft/TransactionTrace.hpp"
+
+static void *CFTSessionManagerMetricsKey = &CFTSessionManagerMetricsKey;
+static void *CFTSessionManagerMetricsDelegateKey = &CFTSessionManagerMetricsDelegateKey;
+
+// Associated objects cannot be weak; the box holds the weak reference instead.
+@interface CFTMetricsDelegateBox : NSObject
+
+@property (nonatomic, weak) id<CFTTransactionMetricsDelegate> delegate;
+
+@end
+
+@implementation CFTMetricsDelegateBox
+
+@end
+
+@interface CFTTransactionMetrics ()
+
+- (instancetype)initPrivate;
+
+@end
+
+@implementation CFTTransactionMetrics {
+    cft::TraceAggregator _aggregator;
+}
+
+- (instancetype)initPrivate {
+    return [super init];
+}
+
+- (NSUInteger)transactionCount {
+    @synchronized (self) {
+        return static_cast<NSUInteger>(_aggregator.count());
+    }
+}
+
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile {
+    if (state < 0 || static_cast<std::size_t>(state) >= cft::kTransactionStateCount) {
+        return 0;
+    }
+    @synchronized (self) {
+        return static_cast<NSTimeInterval>(
+                   _aggregator.state(static_cast<cft::TransactionState>(state)).percentile(percentile)) / 1e9;
+    }
+}
+
+- (NSTimeInterval)durationOfSegment:(CFTTransactionTraceSegment)segment percentile:(double)percentile {
+    if (segment < 0 || static_cast<std::size_t>(segment) >= cft::kTraceSegmentCount) {
+        return 0;
+    }
+    @synchronized (self) {
+        return static_cast<NSTimeInterval>(
+                   _aggregator.segment(static_cast<cft::TraceSegment>(segment)).percentile(percentile)) / 1e9;
+    }
+}
+
+- (void)reset {
+    @synchronized (self) {
+        _aggregator.clear();
+    }
+}
+
+// Inside the implementation for access to _aggregator.
+void CFTCoreRecordTraceBreakdown(CFTTransactionMetrics *metrics, const cft::TraceBreakdown &breakdown) {
+    @synchronized (metrics) {
+        metrics->_aggregator.add(breakdown);
+    }
+}
+
+@end
+
+@implementation CFTSessionManager (Metrics)
+
+- (id<CFTTransactionMetricsDelegate>)metricsDelegate {
+    CFTMetricsDelegateBox *box = objc_getAssociatedObject(self, CFTSessionManagerMetricsDelegateKey);
+    return box.delegate;
+}
+
+- (void)setMetricsDelegate:(id<CFTTransactionMetricsDelegate>)metricsDelegate {
+    CFTMetricsDelegateBox *box = [[CFTMetricsDelegateBox alloc] init];
+    box.delegate = metricsDelegate;
+    objc_setAssociatedObject(self, CFTSessionManagerMetricsDelegateKey, box, OBJC_ASSOCIATION_RETAIN);
+}
+
+- (CFTTransactionMetrics *)transactionMetrics {
+    @synchronized (self) {
+        CFTTransactionMetrics *metrics = objc_getAssociatedObject(self, CFTSessionManagerMetricsKey);
+        if (metrics == nil) {
+            metrics = [[CFTTransactionMetrics alloc] initPrivate];
+            objc_setAssociatedObject(self, CFTSessionManagerMetricsKey, metrics, OBJC_ASSOCIATION_RETAIN);
+        }
+        return metrics;
+    }
+}
+
+@end
@@ -0,0 +1,154 @@
+/*!
+ * @header CFTSettlementLedger.h
+ *
+ * @brief Totals of the open settlement batch, available without downloading its records.
+ * The ledger follows a CFTTransactionRecordStore through its change cursor: each record that
+ * is stored, adjusted, voided, refunded or settled updates the totals by its own difference.
+ * Totals are broken down by card brand, network type and card input method, with tips kept
+ * apart from sale amounts.
+ *
+ * Accounts settled with CFTMerchantAccountSettlementSchemeBroadPosManual close their batch
+ * through closeBatchWithError:. Under every other scheme the host closes the batch and its
+ * records leave the totals as the store learns they are settled.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTAmount;
+@class CFTMerchantAccount;
+@class CFTTransactionRecordStore;
+
+@interface CFTSettlementBucket : NSObject
+
+/*!
+ * @property saleCount
+ * @brief Approved sales and captured authorizations
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger saleCount;
+
+/*!
+ * @property refundCount
+ * @brief Approved refunds
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger refundCount;
+
+/*!
+ * @property sales
+ * @brief Sale amounts, tips excluded
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *sales;
+
+/*!
+ * @property tips
+ * @brief Tips on the sales
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *tips;
+
+/*!
+ * @property refunds
+ * @brief Refund amounts
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *refunds;
+
+/*!
+ * @property netMinorUnits
+ * @brief Sales and tips less refunds, in cents. Negative when refunds outweigh sales.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) int64_t netMinorUnits;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTSettlementTotals : NSObject
+
+/*!
+ * @property batchNumber
+ * @brief Batches closed on this device before this one, plus one; kept with the record store
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t batchNumber;
+
+/*!
+ * @property total
+ * @brief The whole batch
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTSettlementBucket *total;
+
+/*!
+ * @brief Records of the batch paid with cardBrand
+ * Added in 4.12.0
+ */
+- (nonnull CFTSettlementBucket *)bucketForCardBrand:(CFTCardBrand)cardBrand;
+
+/*!
+ * @brief Records of the batch processed over networkType
+ * Added in 4.12.0
+ */
+- (nonnull CFTSettlementBucket *)bucketForNetworkType:(CFTNetworkType)networkType;
+
+/*!
+ * @brief Records of the batch whose card was read with cardInputMethod
+ * Added in 4.12.0
+ */
+- (nonnull CFTSettlementBucket *)bucketForCardInputMethod:(CFTCardInputMethod)cardInputMethod;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTSettlementLedger : NSObject
+
+/*!
+ * @property settlementScheme
+ * @brief Scheme of the merchant account the ledger was created for
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTMerchantAccountSettlementScheme settlementScheme;
+
+/*!
+ * @property totals
+ * @brief Totals of the open batch, including every change stored so far
+ * @discussion Reading it applies the store's changes since the last read, so it costs time in
+ * proportion to what changed rather than to the size of the batch.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTSettlementTotals *totals;
+
+/*!
+ * @brief Ledger for the records in store, which should hold one merchant account's records
+ * @discussion Builds the totals from the records already stored.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithTransactionRecordStore:(nonnull CFTTransactionRecordStore *)store
+                                       merchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+NS_SWIFT_NAME(init(transactionRecordStore:merchantAccount:));
+
+/*!
+ * @brief Close the open batch
+ * @param error NSError - CFTCoreErrorCodeIllegalTransition unless the scheme is CFTMerchantAccountSettlementSchemeBroadPosManual,
+ * or the store's error when the close could not be written. The totals are then those of the records as stored.
+ * @return CFTSettlementTotals - Final totals of the closed batch, nil on error
+ * @discussion The batch's approved records are marked CFTApiTransactionStateSettled in the store,
+ * and stay so while the gateway still reports them approved. Records pending void carry over
+ * into the next batch. Submit the returned totals through the account's settlement flow.
+ * Added in 4.12.0
+ */
+- (nullable CFTSettlementTotals *)closeBatchWithError:(NSError * _Nullable * _Nullable)error;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
@@ -0,0 +1,164 @@
+//
+//  CFTSettlementLedger.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTSettlementLedger.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTTransactionRecordStore.h"
+
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTSettlement.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/SettlementLedger.hpp"
+#include "cft/TransactionRecordStore.hpp"
+
+static_assert(CFTMerchantAccountSettlementSchemeBroadPosManual == static_cast<NSInteger>(cft::SettlementScheme::BroadPosManual), "");
+
+// Changes applied per store lock, so a large catch-up does not hold the store for long.
+static const std::size_t CFTSettlementLedgerPageSize = 256;
+
+@interface CFTSettlementBucket ()
+
+- (nonnull instancetype)initWithBucket:(const cft::SettlementBucket &)bucket;
+
+@end
+
+@implementation CFTSettlementBucket
+
+- (instancetype)initWithBucket:(const cft::SettlementBucket &)bucket {
+    self = [super init];
+    if (self) {
+        _saleCount = bucket.saleCount;
+        _refundCount = bucket.refundCount;
+        _sales = CFTCoreAmountWithMinorUnits(bucket.salesMinor);
+        _tips = CFTCoreAmountWithMinorUnits(bucket.tipsMinor);
+        _refunds = CFTCoreAmountWithMinorUnits(bucket.refundsMinor);
+        _netMinorUnits = bucket.netMinor();
+    }
+    return self;
+}
+
+@end
+
+@interface CFTSettlementTotals ()
+
+- (nonnull instancetype)initWithTotals:(const cft::SettlementTotals &)totals;
+
+@end
+
+@implementation CFTSettlementTotals {
+    cft::SettlementTotals _totals;
+}
+
+- (instancetype)initWithTotals:(const cft::SettlementTotals &)totals {
+    self = [super init];
+    if (self) {
+        _totals = totals;
+        _batchNumber = totals.batchNumber;
+        _total = [[CFTSettlementBucket alloc] initWithBucket:totals.total];
+    }
+    return self;
+}
+
+// Values outside the known enumeration are counted as Unknown, like the core does.
+- (CFTSettlementBucket *)bucketForCardBrand:(CFTCardBrand)cardBrand {
+    const std::size_t index = static_cast<std::size_t>(cardBrand);
+    return [[CFTSettlementBucket alloc] initWithBucket:_totals.byCardBrand[index < cft::kCardBrandCount ? index : 0]];
+}
+
+- (CFTSettlementBucket *)bucketForNetworkType:(CFTNetworkType)networkType {
+    const std::size_t index = static_cast<std::size_t>(networkType);
+    return [[CFTSettlementBucket alloc] initWithBucket:_totals.byNetworkType[index < cft::kNetworkTypeCount ? index : 0]];
+}
+
+- (CFTSettlementBucket *)bucketForCardInputMethod:(CFTCardInputMethod)cardInputMethod {
+    const std::size_t index = static_cast<std::size_t>(cardInputMethod);
+    return [[CFTSettlementBucket alloc] initWithBucket:_totals.byCardInputMethod[index < cft::kCardInputMethodCount ? index : 0]];
+}
+
+@end
+
+@implementation CFTSettlementLedger {
+    // Guarded by @synchronized (self).
+    std::unique_ptr<cft::SettlementLedger> _ledger;
+    CFTTransactionRecordStore *_store;
+    uint64_t _cursor;
+}
+
+- (instancetype)initWithTransactionRecordStore:(CFTTransactionRecordStore *)store merchantAccount:(CFTMerchantAccount *)merchantAccount {
+    self = [super init];
+    if (self) {
+        _settlementScheme = merchantAccount.settlement.scheme;
+        _store = store;
+        [self rebuild];
+    }
+    return self;
+}
+
+- (CFTSettlementTotals *)totals {
+    @synchronized (self) {
+        [self catchUp];
+        return [[CFTSettlementTotals alloc] initWithTotals:_ledger->totals()];
+    }
+}
+
+- (CFTSettlementTotals *)closeBatchWithError:(NSError **)error {
+    @synchronized (self) {
+        [self catchUp];
+        cft::SettlementTotals closed;
+        std::vector<std::string> transactionIds;
+        if (!CFTCoreSucceeded(_ledger->closeBatch(closed, transactionIds), error)) {
+            return nil;
+        }
+
+        cft::TransactionRecordStore &store = CFTCoreRecordStore(_store);
+        const int64_t now = CFTCoreMillisFromDate([NSDate date]);
+        // Held Settled until the gateway reports them settled too, so a refresh that still sees
+        // them approved does not reopen them. A record removed since it was read has nothing to hold.
+        for (const std::string &transactionId : transactionIds) {
+            const cft::ErrorCode code = store.settleLocally(transactionId, now);
+            if (code != cft::ErrorCode::NotFound && !CFTCoreSucceeded(code, error)) {
+                [self rebuild];
+                return nil;
+            }
+        }
+        if (!CFTCoreSucceeded(store.setSettlementBatchNumber(closed.batchNumber + 1), error)) {
+            [self rebuild];
+            return nil;
+        }
+        // The settled records are outside the new batch; reading them back is a no-op.
+        [self catchUp];
+        return [[CFTSettlementTotals alloc] initWithTotals:closed];
+    }
+}
+
+// Totals of what the store holds, from scratch. After a close that was only partly written the
+// ledger's own batch no longer matches the store.
+- (void)rebuild {
+    cft::TransactionRecordStore &store = CFTCoreRecordStore(_store);
+    _ledger.reset(new cft::SettlementLedger(static_cast<cft::SettlementScheme>(_settlementScheme), store.settlementBatchNumber()));
+    _cursor = 0;
+    [self catchUp];
+}
+
+- (void)catchUp {
+    cft::TransactionRecordStore &store = CFTCoreRecordStore(_store);
+    for (std::vector<cft::StoredTransactionRecord> page = store.changesSince(_cursor, CFTSettlementLedgerPageSize, _cursor);
+         !page.empty();
+         page = store.changesSince(_cursor, CFTSettlementLedgerPageSize, _cursor)) {
+        for (const cft::StoredTransactionRecord &record : page) {
+            // A record whose amounts cannot be added is left out rather than corrupting the totals.
+            _ledger->apply(record);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,118 @@
+/*!
+ * @header CFTSignature.h
+ *
+ * @brief A signature captured as the strokes the cardholder drew.
+ * Feed it touch points as they arrive; it keeps them in a delta-encoded form of a few kilobytes
+ * and only draws an image when one is asked for. encodedData can be stored or sent instead of
+ * an image and turned back into the same signature later.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <UIKit/UIKit.h>
+#import <CardFlight/CFTTransaction.h>
+
+@interface CFTSignature : NSObject <NSCopying>
+
+/*!
+ * @property canvasSize
+ * @brief Size of the signature pad in points
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CGSize canvasSize;
+
+/*!
+ * @property strokeCount
+ * @brief Strokes drawn so far
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger strokeCount;
+
+/*!
+ * @property pointCount
+ * @brief Points kept across every stroke. Repeated touches at the same position are not counted.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger pointCount;
+
+/*!
+ * @property isEmpty
+ * @brief YES until the first point is added
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL isEmpty;
+
+/*!
+ * @property encodedData
+ * @brief The strokes in their compact encoding, usually a few kilobytes
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) NSData *encodedData;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Empty signature for a pad of canvasSize points
+ * @discussion Positions are kept to half a point; pads larger than 32767 points are clipped.
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithCanvasSize:(CGSize)canvasSize
+NS_SWIFT_NAME(init(canvasSize:));
+
+/*!
+ * @brief Signature from encodedData
+ * @param error NSError - CFTCoreErrorCodeInvalidArgument when the data is damaged or not a signature
+ * Added in 4.12.0
+ */
+- (nullable instancetype)initWithEncodedData:(nonnull NSData *)encodedData
+                                       error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(encodedData:));
+
+/*!
+ * @brief Start a stroke where the pen touched down
+ * @param timestamp NSTimeInterval - The touch's timestamp
+ * @discussion Points off the pad are moved to its edge. Call from touchesBegan:withEvent:.
+ * Added in 4.12.0
+ */
+- (void)moveToPoint:(CGPoint)point timestamp:(NSTimeInterval)timestamp
+NS_SWIFT_NAME(move(to:timestamp:));
+
+/*!
+ * @brief Extend the current stroke
+ * @param timestamp NSTimeInterval - The touch's timestamp
+ * @discussion Ignored before the first moveToPoint:timestamp:. Call from touchesMoved:withEvent:,
+ * including coalesced touches for the smoothest line.
+ * Added in 4.12.0
+ */
+- (void)addLineToPoint:(CGPoint)point timestamp:(NSTimeInterval)timestamp
+NS_SWIFT_NAME(addLine(to:timestamp:));
+
+/*!
+ * @brief Draw the signature, black on white
+ * @param size CGSize - Size of the image in points
+ * @param scale CGFloat - Pixels per point, 0 for the main screen's scale
+ * @param lineWidth CGFloat - Line width in points
+ * @discussion Safe to call off the main thread.
+ * Added in 4.12.0
+ */
+- (nonnull UIImage *)imageWithSize:(CGSize)size scale:(CGFloat)scale lineWidth:(CGFloat)lineWidth
+NS_SWIFT_NAME(image(size:scale:lineWidth:));
+
+@end
+
+@interface CFTTransaction (VectorSignature)
+
+/*!
+ * @brief Attach a signature captured as strokes
+ * @param signature CFTSignature - Signature to attach
+ * @discussion The image the gateway needs is drawn on a background queue at one pixel per point,
+ * and attachSignature: is then called on the main queue, so the checkout screen is not held up
+ * drawing it. Same state requirements as attachSignature:. To keep the full signature, queue it
+ * with CFTSignatureUploadQueue once the transaction completes.
+ * Added in 4.12.0
+ */
+- (void)attachVectorSignature:(nonnull CFTSignature *)signature
+NS_SWIFT_NAME(attach(vectorSignature:));
+
+@end
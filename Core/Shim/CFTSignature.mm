@@ -0,0 +1,162 @@
+//
+//  CFTSignature.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTSignature.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "cft/Signature.hpp"
+
+// Canvas units per point: half-point positions are finer than any finger or stylus draws.
+static const CGFloat CFTSignatureUnitsPerPoint = 2;
+
+static const CGFloat CFTSignatureAttachedLineWidth = 2.5;
+
+static std::uint16_t CFTSignatureCanvasUnits(CGFloat points) {
+    const CGFloat units = std::ceil(std::max<CGFloat>(points, 0) * CFTSignatureUnitsPerPoint);
+    return static_cast<std::uint16_t>(std::min<CGFloat>(std::max<CGFloat>(units, 1), UINT16_MAX));
+}
+
+@implementation CFTSignature {
+    // Guarded by @synchronized (self); points arrive on the main thread while images may be drawn elsewhere.
+    std::unique_ptr<cft::Signature> _signature;
+    NSTimeInterval _firstTimestamp;
+    uint32_t _lastMillis;
+}
+
+- (instancetype)initWithCanvasSize:(CGSize)canvasSize {
+    self = [super init];
+    if (self) {
+        _canvasSize = canvasSize;
+        _signature.reset(new cft::Signature(CFTSignatureCanvasUnits(canvasSize.width), CFTSignatureCanvasUnits(canvasSize.height)));
+        _firstTimestamp = -1;
+    }
+    return self;
+}
+
+- (instancetype)initWithEncodedData:(NSData *)encodedData error:(NSError **)error {
+    std::unique_ptr<cft::Signature> signature(new cft::Signature());
+    if (!CFTCoreSucceeded(cft::Signature::decode(static_cast<const std::uint8_t *>(encodedData.bytes), encodedData.length, *signature), error)) {
+        return nil;
+    }
+    self = [super init];
+    if (self) {
+        _canvasSize = CGSizeMake(signature->width() / CFTSignatureUnitsPerPoint, signature->height() / CFTSignatureUnitsPerPoint);
+        _signature = std::move(signature);
+        _firstTimestamp = -1;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    @synchronized (self) {
+        CFTSignature *copy = [[CFTSignature alloc] initWithCanvasSize:_canvasSize];
+        *copy->_signature = *_signature;
+        copy->_firstTimestamp = _firstTimestamp;
+        copy->_lastMillis = _lastMillis;
+        return copy;
+    }
+}
+
+- (NSUInteger)strokeCount {
+    @synchronized (self) {
+        return _signature->isEmpty() ? 0 : _signature->strokeCount();
+    }
+}
+
+- (NSUInteger)pointCount {
+    @synchronized (self) {
+        return _signature->pointCount();
+    }
+}
+
+- (BOOL)isEmpty {
+    @synchronized (self) {
+        return _signature->isEmpty();
+    }
+}
+
+- (NSData *)encodedData {
+    std::vector<std::uint8_t> encoded;
+    @synchronized (self) {
+        _signature->encode(encoded);
+    }
+    return [NSData dataWithBytes:encoded.data() length:encoded.size()];
+}
+
+- (void)moveToPoint:(CGPoint)point timestamp:(NSTimeInterval)timestamp {
+    @synchronized (self) {
+        _signature->beginStroke();
+        [self addPoint:point timestamp:timestamp];
+    }
+}
+
+- (void)addLineToPoint:(CGPoint)point timestamp:(NSTimeInterval)timestamp {
+    @synchronized (self) {
+        [self addPoint:point timestamp:timestamp];
+    }
+}
+
+// Callers hold the lock. Touches slightly out of order keep the previous time rather than being dropped.
+- (void)addPoint:(CGPoint)point timestamp:(NSTimeInterval)timestamp {
+    if (_firstTimestamp < 0) {
+        _firstTimestamp = timestamp;
+    }
+    const double millis = std::min<double>(std::max<double>((timestamp - _firstTimestamp) * 1000, _lastMillis), UINT32_MAX);
+    _lastMillis = static_cast<uint32_t>(millis);
+
+    cft::SignaturePoint corePoint;
+    const CGFloat x = std::floor(point.x * CFTSignatureUnitsPerPoint);
+    const CGFloat y = std::floor(point.y * CFTSignatureUnitsPerPoint);
+    corePoint.x = static_cast<std::uint16_t>(std::min<CGFloat>(std::max<CGFloat>(x, 0), _signature->width() - 1));
+    corePoint.y = static_cast<std::uint16_t>(std::min<CGFloat>(std::max<CGFloat>(y, 0), _signature->height() - 1));
+    corePoint.millis = _lastMillis;
+    _signature->addPoint(corePoint);
+}
+
+- (UIImage *)imageWithSize:(CGSize)size scale:(CGFloat)scale lineWidth:(CGFloat)lineWidth {
+    const CGFloat pixelsPerPoint = scale > 0 ? scale : [UIScreen mainScreen].scale;
+    const size_t width = static_cast<size_t>(std::max<CGFloat>(1, std::ceil(size.width * pixelsPerPoint)));
+    const size_t height = static_cast<size_t>(std::max<CGFloat>(1, std::ceil(size.height * pixelsPerPoint)));
+
+    std::vector<std::uint8_t> pixels;
+    @synchronized (self) {
+        _signature->render(static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height), lineWidth * pixelsPerPoint, pixels);
+    }
+
+    NSData *bytes = [NSData dataWithBytes:pixels.data() length:pixels.size()];
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)bytes);
+    CGColorSpaceRef gray = CGColorSpaceCreateDeviceGray();
+    CGImageRef image = CGImageCreate(width, height, 8, 8, width, gray, kCGImageAlphaNone, provider, NULL, false, kCGRenderingIntentDefault);
+    UIImage *result = [UIImage imageWithCGImage:image scale:pixelsPerPoint orientation:UIImageOrientationUp];
+    CGImageRelease(image);
+    CGColorSpaceRelease(gray);
+    CGDataProviderRelease(provider);
+    return result;
+}
+
+@end
+
+@implementation CFTTransaction (VectorSignature)
+
+- (void)attachVectorSignature:(CFTSignature *)signature {
+    // Strokes added after this call are not part of what was attached.
+    CFTSignature *attached = [signature copy];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        UIImage *image = [attached imageWithSize:attached.canvasSize scale:1 lineWidth:CFTSignatureAttachedLineWidth];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self attachSignature:image];
+        });
+    });
+}
+
+@end
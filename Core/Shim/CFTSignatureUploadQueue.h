@@ -0,0 +1,171 @@
+/*!
+ * @header CFTSignatureUploadQueue.h
+ *
+ * @brief Uploads signatures in the background, after their transactions have completed.
+ * A queued signature is on disk before enqueue returns and is uploaded once reachability is
+ * full, retrying with exponential backoff across app restarts. Each transaction keeps at most
+ * one queued signature: queuing the same one again does nothing and a new one replaces it.
+ * Results arrive through the delegate rather than the transaction's callbacks.
+ *
+ * The SDK uploads whatever attachSignature: is given before the transaction completes. Attach
+ * the small image of attachVectorSignature: there and queue the full signature here from
+ * transaction:didCompleteWithTransactionRecord:, so completion does not wait on the upload.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <UIKit/UIKit.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTMerchantAccount;
+@class CFTSignature;
+@class CFTSignatureUploadQueue;
+@class CFTTransactionRecord;
+
+/*!
+ * @brief userInfo key of the HTTP status, an NSNumber, in the error of an upload the gateway refused
+ * Added in 4.12.0
+ */
+FOUNDATION_EXPORT NSString * _Nonnull const CFTSignatureUploadStatusCodeKey;
+
+@protocol CFTSignatureUploadQueueDelegate <NSObject>
+
+/*!
+ * @brief The latest signature queued for a transaction was uploaded
+ * @param queue CFTSignatureUploadQueue - Queue that uploaded the signature
+ * @param transactionId NSString - Transaction the signature belongs to
+ * Added in 4.12.0
+ */
+- (void)signatureUploadQueue:(nonnull CFTSignatureUploadQueue *)queue
+didUploadSignatureForTransactionId:(nonnull NSString *)transactionId
+NS_SWIFT_NAME(signatureUploadQueue(_:didUploadSignatureFor:));
+
+/*!
+ * @brief A signature could not be uploaded
+ * @param queue CFTSignatureUploadQueue - Queue that attempted the upload
+ * @param transactionId NSString - Transaction the signature belongs to
+ * @param error NSError - Reason the attempt failed: the network error, or CFTCoreErrorCodeExternal with the
+ * HTTP status under CFTSignatureUploadStatusCodeKey when the gateway answered with anything but success
+ * @param willRetry BOOL - YES if the upload was rescheduled, NO if it was moved to the dead letters
+ * Added in 4.12.0
+ */
+- (void)signatureUploadQueue:(nonnull CFTSignatureUploadQueue *)queue
+didFailToUploadSignatureForTransactionId:(nonnull NSString *)transactionId
+                       error:(nonnull NSError *)error
+                   willRetry:(BOOL)willRetry
+NS_SWIFT_NAME(signatureUploadQueue(_:didFailToUploadSignatureFor:error:willRetry:));
+
+@end
+
+@interface CFTSignatureUploadQueue : NSObject
+
+/*!
+ * @property delegate
+ * @brief Receives upload results on the main queue
+ * Added in 4.12.0
+ */
+@property (nonatomic, weak, nullable) id<CFTSignatureUploadQueueDelegate> delegate;
+
+/*!
+ * @property merchantAccount
+ * @brief Account whose transactions the queued signatures belong to
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTMerchantAccount *merchantAccount;
+
+/*!
+ * @property maxConcurrentUploads
+ * @brief Upper bound on uploads in flight. Defaults to 2.
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSUInteger maxConcurrentUploads;
+
+/*!
+ * @property reachability
+ * @brief Last reachability passed to updateReachability:
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTReachability reachability;
+
+/*!
+ * @property count
+ * @brief Transactions with a signature still queued, including dead letters
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Open or create a queue
+ * @param fileURL NSURL - File the queue is stored in, created if missing
+ * @param merchantAccount CFTMerchantAccount - Account the signatures are uploaded to
+ * @param error NSError - Set when the file cannot be opened or is not a queue
+ * Added in 4.12.0
+ */
+- (nullable instancetype)initWithFileURL:(nonnull NSURL *)fileURL
+                         merchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                                   error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(fileURL:merchantAccount:));
+
+/*!
+ * @brief Durably queue the signature of a completed transaction
+ * @param signature CFTSignature - Signature as drawn, uploaded in its compact encoding
+ * @param transactionRecord CFTTransactionRecord - Record of the transaction that was signed
+ * @param error NSError - CFTCoreErrorCodeInvalidArgument for a record without a transactionId, CFTCoreErrorCodeCapacityExceeded when the queue is full
+ * @return BOOL - YES once the signature is on disk
+ * @discussion Safe to call from any queue.
+ * Added in 4.12.0
+ */
+- (BOOL)enqueueSignature:(nonnull CFTSignature *)signature
+    forTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                   error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(enqueue(signature:transactionRecord:));
+
+/*!
+ * @brief Durably queue a signature image of a completed transaction
+ * @param image UIImage - Signature image, uploaded as PNG
+ * @param transactionRecord CFTTransactionRecord - Record of the transaction that was signed
+ * @param error NSError - Same errors as enqueueSignature:forTransactionRecord:error:
+ * @return BOOL - YES once the signature is on disk
+ * Added in 4.12.0
+ */
+- (BOOL)enqueueSignatureImage:(nonnull UIImage *)image
+         forTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                        error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(enqueue(signatureImage:transactionRecord:));
+
+/*!
+ * @brief Whether a signature for the record is still waiting to be uploaded
+ * Added in 4.12.0
+ */
+- (BOOL)hasQueuedSignatureForTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+NS_SWIFT_NAME(hasQueuedSignature(transactionRecord:));
+
+/*!
+ * @brief Report network reachability
+ * @param reachability CFTReachability - Uploads run only while reachability is CFTReachabilityFull
+ * Added in 4.12.0
+ */
+- (void)updateReachability:(CFTReachability)reachability
+NS_SWIFT_NAME(update(reachability:));
+
+/*!
+ * @brief Upload every queued signature now, ignoring backoff
+ * @discussion Only skips the wait of signatures queued when it is called; one that fails
+ * again waits out its next backoff as usual.
+ * Added in 4.12.0
+ */
+- (void)retryNow
+NS_SWIFT_NAME(retryNow());
+
+/*!
+ * @brief Drop every dead-lettered signature
+ * @return NSArray<NSString *> - Transaction ids whose signatures were dropped
+ * Added in 4.12.0
+ */
+- (nonnull NSArray<NSString *> *)removeDeadLetteredSignatures
+NS_SWIFT_NAME(removeDeadLetteredSignatures());
+
+@end
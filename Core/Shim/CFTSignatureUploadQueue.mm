@@ -0,0 +1,227 @@
+//
+//  CFTSignatureUploadQueue.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTSignatureUploadQueue.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTGatewaySession.h"
+#import "CFTSignature.h"
+
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/SignatureUploadQueue.hpp"
+
+static const NSUInteger CFTSignatureUploadDefaultConcurrentUploads = 2;
+
+// Wait before pumping again after a claim that came back empty although a signature was due, e.g.
+// because the journal could not be written; doubled per claim in a row, up to the maximum.
+static const int64_t CFTSignatureUploadStalledClaimDelayMillis = 1000;
+static const int64_t CFTSignatureUploadMaxStalledClaimDelayMillis = 60 * 1000;
+
+NSString * const CFTSignatureUploadStatusCodeKey = @"statusCode";
+
+static NSString * const CFTSignatureUploadStrokesContentType = @"application/octet-stream";
+static NSString * const CFTSignatureUploadPngContentType = @"image/png";
+
+static int64_t CFTSignatureUploadNowMillis(void) {
+    return CFTCoreMillisFromDate([NSDate date]);
+}
+
+// Client errors other than timeouts and throttling will fail the same way every time.
+static BOOL CFTSignatureUploadIsRetryable(NSURLResponse *response) {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return YES;
+    }
+    const NSInteger status = ((NSHTTPURLResponse *)response).statusCode;
+    return status < 400 || status >= 500 || status == 408 || status == 429;
+}
+
+// A gateway answer other than success. It is not a decline: the signature may not have reached it.
+static NSError *CFTSignatureUploadStatusError(NSInteger status) {
+    return [NSError errorWithDomain:CFTCoreErrorDomain
+                               code:CFTCoreErrorCodeExternal
+                           userInfo:@{NSLocalizedDescriptionKey: [NSHTTPURLResponse localizedStringForStatusCode:status],
+                                      CFTSignatureUploadStatusCodeKey: @(status)}];
+}
+
+@implementation CFTSignatureUploadQueue {
+    std::unique_ptr<cft::SignatureUploadQueue> _queue;
+    // Drain state below is only touched on the main queue.
+    NSMutableSet<NSNumber *> *_uploads;
+    NSUInteger _retryTimerGeneration;
+    NSUInteger _stalledClaims;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL merchantAccount:(CFTMerchantAccount *)merchantAccount error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        if (!fileURL.isFileURL) {
+            CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+            return nil;
+        }
+        if (!CFTCoreSucceeded(cft::SignatureUploadQueue::open(fileURL.fileSystemRepresentation, cft::DeferredQueueConfig(), _queue), error)) {
+            return nil;
+        }
+        _merchantAccount = merchantAccount;
+        _uploads = [NSMutableSet set];
+        _maxConcurrentUploads = CFTSignatureUploadDefaultConcurrentUploads;
+        _reachability = CFTReachabilityUnknown;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _queue->count();
+}
+
+- (BOOL)enqueueSignature:(CFTSignature *)signature forTransactionRecord:(CFTTransactionRecord *)transactionRecord error:(NSError **)error {
+    return [self storeData:signature.encodedData format:cft::SignatureFormat::Strokes transactionRecord:transactionRecord error:error];
+}
+
+- (BOOL)enqueueSignatureImage:(UIImage *)image forTransactionRecord:(CFTTransactionRecord *)transactionRecord error:(NSError **)error {
+    NSData *png = UIImagePNGRepresentation(image);
+    if (png == nil) {
+        CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+        return NO;
+    }
+    return [self storeData:png format:cft::SignatureFormat::Png transactionRecord:transactionRecord error:error];
+}
+
+- (BOOL)storeData:(nonnull NSData *)data
+           format:(cft::SignatureFormat)format
+transactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+            error:(NSError **)error {
+    const std::string transactionId(transactionRecord.transactionId.UTF8String ?: "");
+    std::uint64_t entryId = 0;
+    if (!CFTCoreSucceeded(_queue->enqueue(transactionId, format, static_cast<const std::uint8_t *>(data.bytes), data.length,
+                                          CFTSignatureUploadNowMillis(), entryId), error)) {
+        return NO;
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self pump];
+    });
+    return YES;
+}
+
+- (BOOL)hasQueuedSignatureForTransactionRecord:(CFTTransactionRecord *)transactionRecord {
+    cft::DeferredEntryInfo info;
+    return _queue->find(std::string(transactionRecord.transactionId.UTF8String ?: ""), info);
+}
+
+- (void)updateReachability:(CFTReachability)reachability {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self->_reachability = reachability;
+        [self pump];
+    });
+}
+
+- (void)retryNow {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        // Only what is queued now skips its backoff; an upload that fails again backs off as usual.
+        self->_queue->expedite(CFTSignatureUploadNowMillis());
+        self->_stalledClaims = 0;
+        [self pump];
+    });
+}
+
+- (NSArray<NSString *> *)removeDeadLetteredSignatures {
+    NSMutableArray<NSString *> *removed = [NSMutableArray array];
+    for (const std::string &transactionId : _queue->deadLetteredTransactionIds()) {
+        if (_queue->remove(transactionId) == cft::ErrorCode::None) {
+            [removed addObject:@(transactionId.c_str())];
+        }
+    }
+    return removed;
+}
+
+#pragma mark - Draining
+
+// Starts uploads until maxConcurrentUploads are outstanding, then arms a timer for the next retry.
+- (void)pump {
+    if (_reachability != CFTReachabilityFull) {
+        return;
+    }
+
+    const NSUInteger limit = MAX(_maxConcurrentUploads, (NSUInteger)1);
+    if (_uploads.count < limit) {
+        const int64_t now = CFTSignatureUploadNowMillis();
+        std::vector<cft::SignatureUpload> claimed = _queue->claimReady(now, limit - _uploads.count);
+        const int64_t next = _queue->nextAttemptAtMillis();
+        _stalledClaims = claimed.empty() && next >= 0 && next <= now ? _stalledClaims + 1 : 0;
+        for (const cft::SignatureUpload &upload : claimed) {
+            [self startUpload:upload];
+        }
+    }
+
+    [self scheduleRetryTimer];
+}
+
+// The SDK only sends a signature attached to a transaction in flight and documents no call for a
+// completed one. The route is assumed from the v2 API's transaction routes: POST
+// transactions/{id}/signature with the signature bytes as the body.
+- (void)startUpload:(const cft::SignatureUpload &)upload {
+    const std::uint64_t entryId = upload.entryId;
+    NSString *transactionId = @(upload.transactionId.c_str());
+    NSString *path = [NSString stringWithFormat:@"transactions/%@/signature", CFTCoreEscapedPathComponent(transactionId)];
+    NSData *body = [NSData dataWithBytes:upload.data.data() length:upload.data.size()];
+    NSString *contentType = upload.format == cft::SignatureFormat::Png ? CFTSignatureUploadPngContentType
+                                                                       : CFTSignatureUploadStrokesContentType;
+    [_uploads addObject:@(entryId)];
+
+    __weak CFTSignatureUploadQueue *weakSelf = self;
+    NSURLRequest *request = CFTCoreGatewayRequest(_merchantAccount, path, body, contentType);
+    [[[CFTGatewaySession shared] dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+        [weakSelf finishEntry:entryId transactionId:transactionId response:response error:error];
+    }] resume];
+}
+
+- (void)finishEntry:(std::uint64_t)entryId transactionId:(NSString *)transactionId response:(NSURLResponse *)response error:(NSError *)error {
+    [_uploads removeObject:@(entryId)];
+
+    const NSInteger status = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 0;
+    if (error == nil && status >= 200 && status < 300) {
+        _queue->complete(entryId);
+        [self.delegate signatureUploadQueue:self didUploadSignatureForTransactionId:transactionId];
+    } else {
+        bool willRetry = false;
+        _queue->fail(entryId, error != nil || CFTSignatureUploadIsRetryable(response), CFTSignatureUploadNowMillis(), willRetry);
+        [self.delegate signatureUploadQueue:self
+    didFailToUploadSignatureForTransactionId:transactionId
+                                      error:error ?: CFTSignatureUploadStatusError(status)
+                                  willRetry:willRetry];
+    }
+
+    [self pump];
+}
+
+- (void)scheduleRetryTimer {
+    const NSUInteger generation = ++_retryTimerGeneration;
+    const int64_t next = _queue->nextAttemptAtMillis();
+    if (next < 0 || _uploads.count >= MAX(_maxConcurrentUploads, (NSUInteger)1)) {
+        return;
+    }
+
+    int64_t delay = MAX(next - CFTSignatureUploadNowMillis(), (int64_t)0);
+    if (_stalledClaims > 0) {
+        const int64_t backoff = CFTSignatureUploadStalledClaimDelayMillis << MIN(_stalledClaims - 1, (NSUInteger)6);
+        delay = MAX(delay, MIN(backoff, CFTSignatureUploadMaxStalledClaimDelayMillis));
+    }
+    __weak CFTSignatureUploadQueue *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay * (int64_t)NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        CFTSignatureUploadQueue *queue = weakSelf;
+        if (queue != nil && queue->_retryTimerGeneration == generation) {
+            [queue pump];
+        }
+    });
+}
+
+@end
@@ -0,0 +1,66 @@
+/*!
+ * @header CFTTransactionCore.h
+ *
+ * @brief Objective-C face of the portable transaction state machine.
+ * A CFTTransactionCore follows one CFTTransaction: feed it every state reported through
+ * transaction:didUpdateState:error: and it validates the flow and times each state.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@interface CFTTransactionCore : NSObject
+
+/*!
+ * @property state
+ * @brief Last state accepted by the core
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionState state;
+
+/*!
+ * @property result
+ * @brief Result recorded when the transaction completed
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionResult result;
+
+/*!
+ * @brief Advance to an observed state
+ * @param state CFTTransactionState - State reported by the transaction
+ * @param error NSError - Populated with CFTCoreErrorCodeIllegalTransition if state cannot follow the current state
+ * @return BOOL - YES if the transition was accepted
+ * Added in 4.12.0
+ */
+- (BOOL)updateState:(CFTTransactionState)state error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(update(state:));
+
+/*!
+ * @brief Record the final result of the transaction
+ * @param result CFTTransactionResult
+ * @discussion Completes a transaction in CFTTransactionStateProcessing with the given result.
+ * Added in 4.12.0
+ */
+- (BOOL)completeWithResult:(CFTTransactionResult)result error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(complete(result:));
+
+/*!
+ * @brief Time spent in a state
+ * @param state CFTTransactionState
+ * @param percentile double - In the range [0, 100]
+ * @return NSTimeInterval - Seconds, across every time this core left state
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile
+NS_SWIFT_NAME(duration(in:percentile:));
+
+/*!
+ * @brief Return to CFTTransactionStateUnknown to follow another transaction
+ * @discussion Accumulated durations are kept.
+ * Added in 4.12.0
+ */
+- (void)reset;
+
+@end
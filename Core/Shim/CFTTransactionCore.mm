@@ -0,0 +1,91 @@
+//
+//  CFTTransactionCore.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionCore.h"
+#import "CFTCorePrivate.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "cft/EventLog.hpp"
+#include "cft/StateLatencyRecorder.hpp"
+#include "cft/TransactionStateMachine.hpp"
+
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingTransactionParameters) == CFTTransactionStatePendingTransactionParameters, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingCardInput) == CFTTransactionStatePendingCardInput, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingProcessOption) == CFTTransactionStatePendingProcessOption, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::Processing) == CFTTransactionStateProcessing, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::Completed) == CFTTransactionStateCompleted, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::Deferred) == CFTTransactionStateDeferred, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingCvm) == CFTTransactionStatePendingCvm, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingAdjustment) == CFTTransactionStatePendingAdjustment, "");
+static_assert(static_cast<NSInteger>(cft::TransactionResult::Voided) == CFTTransactionResultVoided, "");
+
+// Correlates the event log records of one core.
+static std::atomic<std::uint64_t> CFTTransactionCoreNextLogId{1};
+
+@implementation CFTTransactionCore {
+    std::uint64_t _logId;
+    std::mutex _lock;
+    cft::StateLatencyRecorder _recorder;
+    cft::TransactionStateMachine _machine;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _logId = CFTTransactionCoreNextLogId.fetch_add(1, std::memory_order_relaxed);
+        _machine.setObserver(&_recorder);
+        // CFTTransaction objects are handed out already in PendingTransactionParameters.
+        _machine.apply(cft::TransactionEvent::Begin);
+    }
+    return self;
+}
+
+- (CFTTransactionState)state {
+    std::lock_guard<std::mutex> guard(_lock);
+    return static_cast<CFTTransactionState>(_machine.state());
+}
+
+- (CFTTransactionResult)result {
+    std::lock_guard<std::mutex> guard(_lock);
+    return static_cast<CFTTransactionResult>(_machine.result());
+}
+
+- (BOOL)updateState:(CFTTransactionState)state error:(NSError **)error {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (static_cast<CFTTransactionState>(_machine.state()) == state) {
+        return YES;
+    }
+    const cft::ErrorCode code = _machine.transitionTo(static_cast<cft::TransactionState>(state));
+    CFTCoreSharedEventLog().write(code == cft::ErrorCode::None ? cft::LogLevel::Info : cft::LogLevel::Warning,
+                                  cft::LogSubsystem::Transaction, _logId, static_cast<cft::TransactionState>(state), code);
+    return CFTCoreSucceeded(code, error);
+}
+
+- (BOOL)completeWithResult:(CFTTransactionResult)result error:(NSError **)error {
+    std::lock_guard<std::mutex> guard(_lock);
+    return CFTCoreSucceeded(_machine.apply(cft::TransactionEvent::Complete,
+                                           static_cast<cft::TransactionResult>(result)), error);
+}
+
+- (NSTimeInterval)durationInState:(CFTTransactionState)state percentile:(double)percentile {
+    if (state < 0 || static_cast<std::size_t>(state) >= cft::kTransactionStateCount) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    const cft::Nanos nanos = _recorder.histogram(static_cast<cft::TransactionState>(state)).percentile(percentile);
+    return static_cast<NSTimeInterval>(nanos) / NSEC_PER_SEC;
+}
+
+- (void)reset {
+    std::lock_guard<std::mutex> guard(_lock);
+    _machine.reset();
+    _machine.apply(cft::TransactionEvent::Begin);
+}
+
+@end
@@ -0,0 +1,123 @@
+/*!
+ * @header CFTTransactionManager+Batch.h
+ *
+ * @brief Void, capture or refund many transaction records in one call.
+ * Requests are issued with bounded concurrency and each item's result is reported as soon
+ * as it arrives, so closing out a terminal no longer waits on one round trip at a time.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <CardFlight/CFTTransactionManager.h>
+
+@class CFTAmount;
+@class CFTTransactionRecord;
+
+/*!
+ * @typedef CFTBatchOperation
+ * @brief Operation applied to every item of a batch
+ * @constant CFTBatchOperationVoid Void each record, see attemptVoidWithTransactionRecord:transactionDelegate:completion:
+ * @constant CFTBatchOperationCapture Capture each authorization, see captureAuthWithAmount:transactionRecord:completion:
+ * @constant CFTBatchOperationRefund Refund each record without card input, see createRefundWithAmount:transactionRecord:transactionDelegate:completion:
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTBatchOperation) {
+    CFTBatchOperationVoid NS_SWIFT_NAME(voidTransaction) = 0,
+    CFTBatchOperationCapture NS_SWIFT_NAME(capture) = 1,
+    CFTBatchOperationRefund NS_SWIFT_NAME(refund) = 2
+};
+
+@interface CFTBatchItem : NSObject
+
+/*!
+ * @property transactionRecord
+ * @brief Record the operation applies to
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTTransactionRecord *transactionRecord;
+
+/*!
+ * @property amount
+ * @brief Amount to capture or refund. Ignored for voids; when nil the record's amount is used.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTAmount *amount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Initialize a batch item
+ * @param transactionRecord CFTTransactionRecord - Record the operation applies to
+ * @param amount CFTAmount - Amount to capture or refund, nil to use the record's amount
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                                           amount:(nullable CFTAmount *)amount
+NS_SWIFT_NAME(init(transactionRecord:amount:));
+
+@end
+
+@interface CFTBatchItemResult : NSObject
+
+/*!
+ * @property index
+ * @brief Position of the item in the submitted array
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger index;
+
+/*!
+ * @property item
+ * @brief Item the result belongs to
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTBatchItem *item;
+
+/*!
+ * @property transactionRecord
+ * @brief Record produced by a void or refund. Captures report nil.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTTransactionRecord *transactionRecord;
+
+/*!
+ * @property error
+ * @brief Error that prevented the item from succeeding, nil on success
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) NSError *error;
+
+/*!
+ * @property succeeded
+ * @brief YES if the gateway accepted the operation
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL succeeded;
+
+@end
+
+typedef void (^CFTBatchItemResultBlock)(CFTBatchItemResult * _Nonnull result);
+typedef void (^CFTBatchCompletionBlock)(NSArray<CFTBatchItemResult *> * _Nonnull results);
+
+@interface CFTTransactionManager (Batch)
+
+/*!
+ * @brief Apply an operation to many transaction records
+ * @param operation CFTBatchOperation - Operation to apply to every item
+ * @param items NSArray<CFTBatchItem *> - Records and amounts
+ * @param maxConcurrentRequests NSUInteger - Upper bound on outstanding requests, 0 uses the default of 8
+ * @param itemResult CFTBatchItemResultBlock - Called on the main queue as each item finishes, in completion order
+ * @param completion CFTBatchCompletionBlock - Called on the main queue once every item has finished, results in submission order
+ * @discussion Items that would need cardholder interaction, such as a refund requiring card input
+ * or a signature, fail with CFTCoreErrorCodeInteractionRequired instead of blocking the batch.
+ * Added in 4.12.0
+ */
+- (void)performBatchOperation:(CFTBatchOperation)operation
+                        items:(nonnull NSArray<CFTBatchItem *> *)items
+        maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                   itemResult:(nullable CFTBatchItemResultBlock)itemResult
+                   completion:(nullable CFTBatchCompletionBlock)completion
+NS_SWIFT_NAME(performBatch(operation:items:maxConcurrentRequests:itemResult:completion:));
+
+@end
@@ -0,0 +1,170 @@
+//
+//  CFTTransactionManager+Batch.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionManager+Batch.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTUnattendedTransactionDelegate.h"
+
+#import <CardFlight/CFTAmount.h>
+#import <CardFlight/CFTTransaction.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <memory>
+
+#include "cft/BatchScheduler.hpp"
+
+static const NSUInteger CFTBatchDefaultConcurrentRequests = 8;
+
+@interface CFTBatchItem ()
+
+- (nonnull CFTAmount *)resolvedAmount;
+
+@end
+
+@interface CFTBatchItemResult ()
+
+- (nonnull instancetype)initWithIndex:(NSUInteger)index
+                                 item:(nonnull CFTBatchItem *)item
+                    transactionRecord:(nullable CFTTransactionRecord *)transactionRecord
+                                error:(nullable NSError *)error;
+
+@end
+
+@implementation CFTBatchItem
+
+- (instancetype)initWithTransactionRecord:(CFTTransactionRecord *)transactionRecord amount:(CFTAmount *)amount {
+    self = [super init];
+    if (self) {
+        _transactionRecord = transactionRecord;
+        _amount = amount;
+    }
+    return self;
+}
+
+- (nonnull CFTAmount *)resolvedAmount {
+    return _amount ?: _transactionRecord.amount;
+}
+
+@end
+
+@implementation CFTBatchItemResult
+
+- (instancetype)initWithIndex:(NSUInteger)index
+                         item:(CFTBatchItem *)item
+            transactionRecord:(CFTTransactionRecord *)transactionRecord
+                        error:(NSError *)error {
+    self = [super init];
+    if (self) {
+        _index = index;
+        _item = item;
+        _transactionRecord = transactionRecord;
+        _error = error;
+    }
+    return self;
+}
+
+- (BOOL)succeeded {
+    return _error == nil;
+}
+
+@end
+
+@implementation CFTTransactionManager (Batch)
+
+- (void)performBatchOperation:(CFTBatchOperation)operation
+                        items:(NSArray<CFTBatchItem *> *)items
+        maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                   itemResult:(CFTBatchItemResultBlock)itemResult
+                   completion:(CFTBatchCompletionBlock)completion {
+    NSArray<CFTBatchItem *> *batchItems = [items copy];
+    const NSUInteger concurrency = maxConcurrentRequests > 0 ? maxConcurrentRequests : CFTBatchDefaultConcurrentRequests;
+
+    // Results and live delegates are only touched on the main queue, like every SDK callback.
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:batchItems.count];
+    for (NSUInteger i = 0; i < batchItems.count; ++i) {
+        [results addObject:[NSNull null]];
+    }
+    NSMutableDictionary<NSNumber *, CFTUnattendedTransactionDelegate *> *delegates = [NSMutableDictionary dictionary];
+
+    if (batchItems.count == 0) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(@[]);
+            });
+        }
+        return;
+    }
+
+    // The batch keeps its scheduler alive until the last result, so callers need not hold on to anything.
+    __block std::shared_ptr<cft::BatchScheduler> scheduler = std::make_shared<cft::BatchScheduler>(batchItems.count, concurrency);
+
+    void (^report)(NSUInteger, CFTTransactionRecord *, NSError *) = ^(NSUInteger index, CFTTransactionRecord *record, NSError *error) {
+        if (scheduler == nullptr || results[index] != [NSNull null]) {
+            return;
+        }
+        CFTBatchItemResult *result = [[CFTBatchItemResult alloc] initWithIndex:index
+                                                                          item:batchItems[index]
+                                                             transactionRecord:record
+                                                                         error:error];
+        results[index] = result;
+        [delegates removeObjectForKey:@(index)];
+        if (itemResult) {
+            itemResult(result);
+        }
+
+        scheduler->complete(index, error == nil ? cft::ErrorCode::None : cft::ErrorCode::Declined);
+        if (scheduler->isFinished()) {
+            scheduler.reset();
+            if (completion) {
+                completion([results copy]);
+            }
+        }
+    };
+
+    __weak CFTTransactionManager *weakSelf = self;
+    auto start = [=](std::size_t index) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            CFTTransactionManager *manager = weakSelf;
+            CFTBatchItem *item = batchItems[index];
+            if (manager == nil) {
+                report(index, nil, CFTCoreMakeError(cft::ErrorCode::InvalidArgument));
+                return;
+            }
+
+            if (operation == CFTBatchOperationCapture) {
+                [manager captureAuthWithAmount:[item resolvedAmount]
+                             transactionRecord:item.transactionRecord
+                                    completion:^(BOOL success, NSError *error) {
+                    report(index, nil, success ? nil : (error ?: CFTCoreMakeError(cft::ErrorCode::Declined)));
+                }];
+                return;
+            }
+
+            CFTUnattendedTransactionDelegate *delegate = [CFTUnattendedTransactionDelegate new];
+            delegate.finish = ^(CFTTransactionRecord *record, NSError *error) {
+                report(index, record, error);
+            };
+            delegates[@(index)] = delegate;
+
+            if (operation == CFTBatchOperationVoid) {
+                [manager attemptVoidWithTransactionRecord:item.transactionRecord
+                                      transactionDelegate:delegate
+                                               completion:[delegate creationBlock]];
+            } else {
+                [manager createRefundWithAmount:[item resolvedAmount]
+                              transactionRecord:item.transactionRecord
+                            transactionDelegate:delegate
+                                     completion:[delegate creationBlock]];
+            }
+        });
+    };
+
+    scheduler->run(start, nullptr);
+}
+
+@end
@@ -0,0 +1,39 @@
+/*!
+ * @header CFTTransactionManager+DeltaRefresh.h
+ *
+ * @brief Refresh many transaction records at once and report only the ones whose state changed.
+ * Records already in a final state (voided, declined, settled, canceled) are skipped without a
+ * request, records are refreshed in place with bounded concurrency, and the record store is
+ * patched in place, so polling hundreds of open authorizations costs one request per open
+ * record and hands back only the transitions.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <CardFlight/CFTTransactionManager.h>
+
+@class CFTTransactionRecord;
+@class CFTTransactionRecordStore;
+@class CFTTransactionRecordTransition;
+
+typedef void (^CFTTransactionRecordTransitionsBlock)(NSArray<CFTTransactionRecordTransition *> * _Nonnull transitions,
+                                                     NSArray<NSError *> * _Nonnull errors);
+
+@interface CFTTransactionManager (DeltaRefresh)
+
+/*!
+ * @brief Refresh the state of many records
+ * @param transactionRecords NSArray<CFTTransactionRecord *> - Records to refresh; they are updated in place
+ * @param store CFTTransactionRecordStore - Store to patch; records not stored yet are added
+ * @param maxConcurrentRequests NSUInteger - Upper bound on outstanding refreshes, 0 uses the default of 8
+ * @param completion CFTTransactionRecordTransitionsBlock - Called on the main queue with the state changes and any refresh errors
+ * @discussion Changes are also available afterwards from the store's transitionsSinceCursor:limit:nextCursor:.
+ * Added in 4.12.0
+ */
+- (void)refreshTransactionRecords:(nonnull NSArray<CFTTransactionRecord *> *)transactionRecords
+                            store:(nonnull CFTTransactionRecordStore *)store
+            maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                       completion:(nullable CFTTransactionRecordTransitionsBlock)completion
+NS_SWIFT_NAME(refresh(transactionRecords:store:maxConcurrentRequests:completion:));
+
+@end
@@ -0,0 +1,100 @@
+//
+//  CFTTransactionManager+DeltaRefresh.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionManager+DeltaRefresh.h"
+#import "CFTCorePrivate.h"
+#import "CFTTransactionRecordStore.h"
+
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <memory>
+
+#include "cft/BatchScheduler.hpp"
+#include "cft/Types.hpp"
+
+static const NSUInteger CFTDeltaRefreshDefaultConcurrentRequests = 8;
+
+@implementation CFTTransactionManager (DeltaRefresh)
+
+- (void)refreshTransactionRecords:(NSArray<CFTTransactionRecord *> *)transactionRecords
+                            store:(CFTTransactionRecordStore *)store
+            maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                       completion:(CFTTransactionRecordTransitionsBlock)completion {
+    NSMutableArray<NSError *> *errors = [NSMutableArray array];
+
+    // Only records that can still change are worth a request, and each only once.
+    NSMutableArray<CFTTransactionRecord *> *open = [NSMutableArray array];
+    NSMutableSet<NSString *> *seen = [NSMutableSet set];
+    for (CFTTransactionRecord *record in transactionRecords) {
+        const auto state = static_cast<cft::ApiTransactionState>(record.apiTransactionState);
+        if (record.transactionId == nil || [seen containsObject:record.transactionId] || cft::isFinalApiTransactionState(state)) {
+            continue;
+        }
+        NSError *error = nil;
+        if ([store summaryForTransactionId:record.transactionId] == nil && ![store storeTransactionRecord:record error:&error]) {
+            [errors addObject:error];
+            continue;
+        }
+        [seen addObject:record.transactionId];
+        [open addObject:record];
+    }
+
+    NSMutableArray<CFTTransactionRecordTransition *> *transitions = [NSMutableArray array];
+    if (open.count == 0) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(transitions, errors);
+            });
+        }
+        return;
+    }
+
+    const NSUInteger concurrency = maxConcurrentRequests > 0 ? maxConcurrentRequests : CFTDeltaRefreshDefaultConcurrentRequests;
+    __block std::shared_ptr<cft::BatchScheduler> scheduler = std::make_shared<cft::BatchScheduler>(open.count, concurrency);
+
+    void (^report)(NSUInteger, NSError *) = ^(NSUInteger index, NSError *error) {
+        if (error != nil) {
+            [errors addObject:error];
+        } else {
+            NSError *storeError = nil;
+            CFTTransactionRecordTransition *transition = [store updateStateOfTransactionRecord:open[index] error:&storeError];
+            if (transition != nil) {
+                [transitions addObject:transition];
+            } else if (storeError != nil) {
+                [errors addObject:storeError];
+            }
+        }
+
+        scheduler->complete(index, error == nil ? cft::ErrorCode::None : cft::ErrorCode::Declined);
+        if (scheduler->isFinished()) {
+            scheduler.reset();
+            if (completion) {
+                completion(transitions, errors);
+            }
+        }
+    };
+
+    __weak CFTTransactionManager *weakSelf = self;
+    auto start = [=](std::size_t index) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            CFTTransactionManager *manager = weakSelf;
+            if (manager == nil) {
+                report(index, CFTCoreMakeError(cft::ErrorCode::InvalidArgument));
+                return;
+            }
+            [manager refreshWithTransactionRecord:open[index] completion:^(BOOL success, NSError *error) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    report(index, success ? nil : (error ?: CFTCoreMakeError(cft::ErrorCode::Declined)));
+                });
+            }];
+        });
+    };
+
+    scheduler->run(start, nullptr);
+}
+
+@end
@@ -0,0 +1,134 @@
+/*!
+ * @header CFTTransactionManager+Prepare.h
+ *
+ * @brief Sales prepared before the amount is known.
+ * Preparing a sale when the checkout screen appears validates the merchant account and keeps
+ * the reader connected while the cashier is still ringing items up. Binding the amount then starts the sale straight away, or as soon as the last
+ * outstanding step finishes.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <CardFlight/CFTTransactionManager.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTAmount;
+@class CFTMerchantAccount;
+@class CFTMerchantAccountCache;
+@class CFTPreparedTransaction;
+@protocol CFTTransactionDelegate;
+
+/*!
+ * @typedef CFTPreparedTransactionState
+ * @constant CFTPreparedTransactionStatePreparing Steps are outstanding and no amount is bound
+ * @constant CFTPreparedTransactionStateReady Every step finished; waiting for the amount
+ * @constant CFTPreparedTransactionStateBound The amount is bound; the sale starts once every step finished
+ * @constant CFTPreparedTransactionStateFailed The merchant account could not be validated, see error
+ * @constant CFTPreparedTransactionStateExpired Ready for longer than the time to live. Binding starts the sale without preparation.
+ * @constant CFTPreparedTransactionStateCanceled cancel was called
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTPreparedTransactionState) {
+    CFTPreparedTransactionStatePreparing NS_SWIFT_NAME(preparing) = 0,
+    CFTPreparedTransactionStateReady NS_SWIFT_NAME(ready) = 1,
+    CFTPreparedTransactionStateBound NS_SWIFT_NAME(bound) = 2,
+    CFTPreparedTransactionStateFailed NS_SWIFT_NAME(failed) = 3,
+    CFTPreparedTransactionStateExpired NS_SWIFT_NAME(expired) = 4,
+    CFTPreparedTransactionStateCanceled NS_SWIFT_NAME(canceled) = 5
+};
+
+/*!
+ * @typedef CFTPreparedTransactionBlock
+ * @brief Called on the main queue when preparation finishes, with the error that failed it if any
+ */
+typedef void (^CFTPreparedTransactionBlock)(CFTPreparedTransaction * _Nonnull preparedTransaction, NSError * _Nullable error);
+
+/*!
+ * @brief A sale waiting for its amount
+ * @discussion Use from the main queue.
+ */
+@interface CFTPreparedTransaction : NSObject
+
+/*!
+ * @property merchantAccount
+ * @brief Account the sale will be processed on
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTMerchantAccount *merchantAccount;
+
+/*!
+ * @property state
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTPreparedTransactionState state;
+
+/*!
+ * @property error
+ * @brief Why the merchant account could not be validated
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) NSError *error;
+
+/*!
+ * @property preparationDuration
+ * @brief Seconds from preparing until every step finished, 0 while preparing
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSTimeInterval preparationDuration;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Bind the amount and start the sale
+ * @param amount CFTAmount - Amount of the sale
+ * @param delegate CFTTransactionDelegate - Receives the transaction's events
+ * @param completion CFTTransactionBlock - Called as createSaleWithAmount:networkType:merchantAccount:callbackUrl:metadata:isAdjustmentRequested:isSignatureRequired:isQuickChipEnabled:delegate:completion: calls it,
+ * or with an error in CFTCoreErrorDomain: InvalidArgument for amounts below one cent, IllegalTransition when already bound or canceled.
+ * When preparation failed the completion gets its error.
+ * @discussion The sale starts immediately when preparation finished, otherwise when it does.
+ * An expired preparation starts the sale without it.
+ * Added in 4.12.0
+ */
+- (void)bindAmount:(nonnull CFTAmount *)amount
+          delegate:(nonnull id<CFTTransactionDelegate>)delegate
+        completion:(nonnull CFTTransactionBlock)completion
+NS_SWIFT_NAME(bind(amount:delegate:completion:));
+
+/*!
+ * @brief Abandon the preparation. A sale already started is not affected.
+ * Added in 4.12.0
+ */
+- (void)cancel;
+
+@end
+
+@interface CFTTransactionManager (Prepare)
+
+/*!
+ * @brief Prepare a sale whose amount is not known yet
+ * @param merchantAccountCache CFTMerchantAccountCache - Validates the account from its cache when given, otherwise the account is fetched
+ * @param timeToLive NSTimeInterval - How long a ready preparation stays usable, 0 for no limit
+ * @param readyHandler CFTPreparedTransactionBlock - Called when preparation finishes or fails
+ * @return CFTPreparedTransaction - Bind the amount to it at any time, including before it is ready
+ * @discussion Other parameters are those of createSaleWithAmount:networkType:merchantAccount:callbackUrl:metadata:isAdjustmentRequested:isSignatureRequired:isQuickChipEnabled:delegate:completion:.
+ * Validating the account and keeping the reader connected run concurrently; only the account is required.
+ * The reader counts as warmed only when a CFTReaderConnectionManager has one connected.
+ * The SDK connects to the gateway for the sale itself.
+ * shouldKeepReaderConnectionAlive on [CFTReaderUtilities shared] is held while the preparation lasts, in
+ * the same hold as CFTReaderConnectionManager, and the app's value comes back once nothing holds it.
+ * Added in 4.12.0
+ */
+- (nonnull CFTPreparedTransaction *)prepareSaleWithMerchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                                                       networkType:(CFTNetworkType)networkType
+                                                       callbackUrl:(nullable NSURL *)callbackUrl
+                                                          metadata:(nullable NSDictionary<NSString *, id> *)metadata
+                                             isAdjustmentRequested:(BOOL)isAdjustmentRequested
+                                               isSignatureRequired:(BOOL)isSignatureRequired
+                                                isQuickChipEnabled:(BOOL)isQuickChipEnabled
+                                              merchantAccountCache:(nullable CFTMerchantAccountCache *)merchantAccountCache
+                                                        timeToLive:(NSTimeInterval)timeToLive
+                                                      readyHandler:(nullable CFTPreparedTransactionBlock)readyHandler
+NS_SWIFT_NAME(prepareSale(merchantAccount:networkType:callbackUrl:metadata:isAdjustmentRequested:isSignatureRequired:isQuickChipEnabled:merchantAccountCache:timeToLive:readyHandler:));
+
+@end
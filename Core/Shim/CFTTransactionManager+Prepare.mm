@@ -0,0 +1,284 @@
+//
+//  CFTTransactionManager+Prepare.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionManager+Prepare.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTMerchantAccountCache.h"
+
+#import <CardFlight/CFTAmount.h>
+#import <CardFlight/CFTMerchantAccount.h>
+#import <CardFlight/CFTMerchantAccountManager.h>
+#import <CardFlight/CFTTransaction.h>
+
+#include <memory>
+
+#include "cft/TransactionPreparation.hpp"
+
+static_assert(CFTPreparedTransactionStatePreparing == static_cast<NSInteger>(cft::PreparationState::Preparing), "");
+static_assert(CFTPreparedTransactionStateReady == static_cast<NSInteger>(cft::PreparationState::Ready), "");
+static_assert(CFTPreparedTransactionStateBound == static_cast<NSInteger>(cft::PreparationState::Bound), "");
+static_assert(CFTPreparedTransactionStateFailed == static_cast<NSInteger>(cft::PreparationState::Failed), "");
+static_assert(CFTPreparedTransactionStateExpired == static_cast<NSInteger>(cft::PreparationState::Expired), "");
+static_assert(CFTPreparedTransactionStateCanceled == static_cast<NSInteger>(cft::PreparationState::Canceled), "");
+
+@interface CFTPreparedTransaction ()
+
+- (nonnull instancetype)initWithTransactionManager:(nonnull CFTTransactionManager *)transactionManager
+                                   merchantAccount:(nonnull CFTMerchantAccount *)merchantAccount
+                                       networkType:(CFTNetworkType)networkType
+                                       callbackUrl:(nullable NSURL *)callbackUrl
+                                          metadata:(nullable NSDictionary<NSString *, id> *)metadata
+                             isAdjustmentRequested:(BOOL)isAdjustmentRequested
+                               isSignatureRequired:(BOOL)isSignatureRequired
+                                isQuickChipEnabled:(BOOL)isQuickChipEnabled
+                                        timeToLive:(NSTimeInterval)timeToLive
+                                      readyHandler:(nullable CFTPreparedTransactionBlock)readyHandler;
+
+- (void)startWithMerchantAccountCache:(nullable CFTMerchantAccountCache *)merchantAccountCache;
+
+@end
+
+@implementation CFTPreparedTransaction {
+    std::unique_ptr<cft::TransactionPreparation> _preparation;
+    CFTTransactionManager *_transactionManager;
+    CFTNetworkType _networkType;
+    NSURL *_callbackUrl;
+    NSDictionary<NSString *, id> *_metadata;
+    BOOL _isAdjustmentRequested;
+    BOOL _isSignatureRequired;
+    BOOL _isQuickChipEnabled;
+    CFTPreparedTransactionBlock _readyHandler;
+    CFTAmount *_amount;
+    id<CFTTransactionDelegate> _delegate;
+    CFTTransactionBlock _completion;
+    NSTimeInterval _timeToLive;
+    // Whether this preparation still counts among the holds of CFTCoreHoldReaderConnection().
+    BOOL _holdsReaderConnection;
+}
+
+- (instancetype)initWithTransactionManager:(CFTTransactionManager *)transactionManager
+                           merchantAccount:(CFTMerchantAccount *)merchantAccount
+                               networkType:(CFTNetworkType)networkType
+                               callbackUrl:(NSURL *)callbackUrl
+                                  metadata:(NSDictionary<NSString *, id> *)metadata
+                     isAdjustmentRequested:(BOOL)isAdjustmentRequested
+                       isSignatureRequired:(BOOL)isSignatureRequired
+                        isQuickChipEnabled:(BOOL)isQuickChipEnabled
+                                timeToLive:(NSTimeInterval)timeToLive
+                              readyHandler:(CFTPreparedTransactionBlock)readyHandler {
+    self = [super init];
+    if (self) {
+        _preparation.reset(new cft::TransactionPreparation(cft::preparationStepBit(cft::PreparationStep::MerchantAccount),
+                                                           static_cast<cft::Nanos>(MAX(timeToLive, 0) * NSEC_PER_SEC)));
+        _transactionManager = transactionManager;
+        _merchantAccount = merchantAccount;
+        _networkType = networkType;
+        _callbackUrl = [callbackUrl copy];
+        _metadata = [metadata copy];
+        _isAdjustmentRequested = isAdjustmentRequested;
+        _isSignatureRequired = isSignatureRequired;
+        _isQuickChipEnabled = isQuickChipEnabled;
+        _readyHandler = [readyHandler copy];
+        _timeToLive = MAX(timeToLive, 0);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self releaseReaderConnection];
+}
+
+- (CFTPreparedTransactionState)state {
+    return static_cast<CFTPreparedTransactionState>(_preparation->state());
+}
+
+- (NSTimeInterval)preparationDuration {
+    return static_cast<NSTimeInterval>(_preparation->preparationTime()) / NSEC_PER_SEC;
+}
+
+- (void)startWithMerchantAccountCache:(CFTMerchantAccountCache *)merchantAccountCache {
+    __weak CFTPreparedTransaction *weakSelf = self;
+
+    if (merchantAccountCache != nil) {
+        [merchantAccountCache fetchMerchantAccount:_merchantAccount completion:^(CFTMerchantAccountSnapshot *snapshot, NSError *error) {
+            [weakSelf completeStep:cft::PreparationStep::MerchantAccount error:snapshot != nil ? nil : error];
+        }];
+    } else {
+        [[CFTMerchantAccountManager shared] fetchWithMerchantAccount:_merchantAccount completion:^(BOOL success, NSError *error) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf completeStep:cft::PreparationStep::MerchantAccount
+                                 error:success ? nil : error ?: CFTCoreMakeError(cft::ErrorCode::Declined)];
+            });
+        }];
+    }
+
+    // Kept until the sale is created or the preparation fails, is canceled or expires. Without a
+    // connected reader there is nothing warm to keep, and the sale connects one itself.
+    CFTCoreHoldReaderConnection();
+    _holdsReaderConnection = YES;
+    [self completeStep:cft::PreparationStep::Reader
+                 error:CFTCoreIsReaderConnected() ? nil : CFTCoreMakeError(cft::ErrorCode::NotFound)];
+
+    // createSale connects to the gateway through the SDK's own session, which cannot be opened
+    // from here, so there is nothing to warm up.
+    [self completeStep:cft::PreparationStep::Gateway error:nil];
+}
+
+- (void)releaseReaderConnection {
+    if (_holdsReaderConnection) {
+        _holdsReaderConnection = NO;
+        CFTCoreReleaseReaderConnection();
+    }
+}
+
+- (void)scheduleExpiry {
+    if (_timeToLive <= 0) {
+        return;
+    }
+    __weak CFTPreparedTransaction *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_timeToLive * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        CFTPreparedTransaction *preparedTransaction = weakSelf;
+        if (preparedTransaction == nil) {
+            return;
+        }
+        const cft::PreparationState state = preparedTransaction->_preparation->state();
+        if (state == cft::PreparationState::Expired) {
+            [preparedTransaction releaseReaderConnection];
+        } else if (state == cft::PreparationState::Ready) {
+            // Woken a moment before the deadline.
+            preparedTransaction->_timeToLive = 0.01;
+            [preparedTransaction scheduleExpiry];
+        }
+    });
+}
+
+- (void)completeStep:(cft::PreparationStep)step error:(NSError *)error {
+    const BOOL wasReady = _preparation->isReady();
+    // Failed steps are recorded as IOFailure; only the account's error is kept for the caller.
+    if (_preparation->complete(step, error == nil ? cft::ErrorCode::None : cft::ErrorCode::IOFailure) != cft::ErrorCode::None) {
+        return;
+    }
+
+    if (_preparation->state() == cft::PreparationState::Failed) {
+        _error = error;
+        [self finishWithError:error];
+        return;
+    }
+    if (!wasReady && _preparation->isReady()) {
+        [self finishWithError:nil];
+        if (_preparation->shouldStart()) {
+            [self startSale];
+        } else {
+            [self scheduleExpiry];
+        }
+    }
+}
+
+- (void)finishWithError:(NSError *)error {
+    CFTPreparedTransactionBlock readyHandler = _readyHandler;
+    _readyHandler = nil;
+    if (readyHandler != nil) {
+        readyHandler(self, error);
+    }
+
+    if (error == nil) {
+        return;
+    }
+    [self releaseReaderConnection];
+    CFTTransactionBlock completion = _completion;
+    if (completion != nil) {
+        _completion = nil;
+        _delegate = nil;
+        completion(nil, error);
+    }
+}
+
+- (void)bindAmount:(CFTAmount *)amount delegate:(id<CFTTransactionDelegate>)delegate completion:(CFTTransactionBlock)completion {
+    if (_preparation->state() == cft::PreparationState::Failed) {
+        completion(nil, _error);
+        return;
+    }
+    // An expired preparation is bound too, so that it starts one sale and no more.
+    const cft::ErrorCode code = _preparation->bind(CFTCoreMinorUnits(amount));
+    if (code != cft::ErrorCode::None) {
+        completion(nil, CFTCoreMakeError(code));
+        return;
+    }
+
+    _amount = amount;
+    _delegate = delegate;
+    _completion = [completion copy];
+    if (_preparation->shouldStart()) {
+        [self startSale];
+    }
+}
+
+- (void)startSale {
+    CFTTransactionBlock saleCompletion = _completion;
+    id<CFTTransactionDelegate> delegate = _delegate;
+    _completion = nil;
+    _delegate = nil;
+    CFTTransactionBlock completion = ^(CFTTransaction *transaction, NSError *error) {
+        [self releaseReaderConnection];
+        if (saleCompletion != nil) {
+            saleCompletion(transaction, error);
+        }
+    };
+    [_transactionManager createSaleWithAmount:_amount
+                                  networkType:_networkType
+                              merchantAccount:_merchantAccount
+                                  callbackUrl:_callbackUrl
+                                     metadata:_metadata
+                        isAdjustmentRequested:_isAdjustmentRequested
+                          isSignatureRequired:_isSignatureRequired
+                           isQuickChipEnabled:_isQuickChipEnabled
+                                     delegate:delegate
+                                   completion:completion];
+}
+
+- (void)cancel {
+    _preparation->cancel();
+    [self releaseReaderConnection];
+    _readyHandler = nil;
+    CFTTransactionBlock completion = _completion;
+    _completion = nil;
+    _delegate = nil;
+    if (completion != nil) {
+        completion(nil, CFTCoreMakeError(cft::ErrorCode::IllegalTransition));
+    }
+}
+
+@end
+
+@implementation CFTTransactionManager (Prepare)
+
+- (CFTPreparedTransaction *)prepareSaleWithMerchantAccount:(CFTMerchantAccount *)merchantAccount
+                                               networkType:(CFTNetworkType)networkType
+                                               callbackUrl:(NSURL *)callbackUrl
+                                                  metadata:(NSDictionary<NSString *, id> *)metadata
+                                     isAdjustmentRequested:(BOOL)isAdjustmentRequested
+                                       isSignatureRequired:(BOOL)isSignatureRequired
+                                        isQuickChipEnabled:(BOOL)isQuickChipEnabled
+                                      merchantAccountCache:(CFTMerchantAccountCache *)merchantAccountCache
+                                                timeToLive:(NSTimeInterval)timeToLive
+                                              readyHandler:(CFTPreparedTransactionBlock)readyHandler {
+    CFTPreparedTransaction *preparedTransaction = [[CFTPreparedTransaction alloc] initWithTransactionManager:self
+                                                                                             merchantAccount:merchantAccount
+                                                                                                 networkType:networkType
+                                                                                                 callbackUrl:callbackUrl
+                                                                                                    metadata:metadata
+                                                                                       isAdjustmentRequested:isAdjustmentRequested
+                                                                                         isSignatureRequired:isSignatureRequired
+                                                                                          isQuickChipEnabled:isQuickChipEnabled
+                                                                                                  timeToLive:timeToLive
+                                                                                                readyHandler:readyHandler];
+    [preparedTransaction startWithMerchantAccountCache:merchantAccountCache];
+    return preparedTransaction;
+}
+
+@end
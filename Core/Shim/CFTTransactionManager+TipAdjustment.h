@@ -0,0 +1,110 @@
+/*!
+ * @header CFTTransactionManager+TipAdjustment.h
+ *
+ * @brief Adjust the tips of many completed transaction records in one call.
+ * Every tip is written to a CFTTransactionRecordStore before the first request goes out, so a
+ * CFTSettlementLedger on that store shows the adjusted totals at once. The requests then share
+ * the gateway session's connections with a bounded number in flight, and a tip the gateway
+ * refuses is put back to what it was.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <CardFlight/CFTTransactionManager.h>
+
+@class CFTAdjustment;
+@class CFTTransactionRecord;
+@class CFTTransactionRecordStore;
+
+@interface CFTTipAdjustmentItem : NSObject
+
+/*!
+ * @property transactionRecord
+ * @brief Approved sale or authorization whose tip is replaced
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTTransactionRecord *transactionRecord;
+
+/*!
+ * @property adjustment
+ * @brief Adjustment holding the new tip. A nil tipAmount removes the tip. Its metadata is sent
+ * with the tip and must be serializable as JSON.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAdjustment *adjustment;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Initialize a tip adjustment item
+ * @param transactionRecord CFTTransactionRecord - Record whose tip is replaced
+ * @param adjustment CFTAdjustment - Adjustment holding the new tip
+ * Added in 4.12.0
+ */
+- (nonnull instancetype)initWithTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                                       adjustment:(nonnull CFTAdjustment *)adjustment
+NS_SWIFT_NAME(init(transactionRecord:adjustment:));
+
+@end
+
+@interface CFTTipAdjustmentResult : NSObject
+
+/*!
+ * @property index
+ * @brief Position of the item in the submitted array
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger index;
+
+/*!
+ * @property item
+ * @brief Item the result belongs to
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTTipAdjustmentItem *item;
+
+/*!
+ * @property error
+ * @brief Why the tip was not adjusted, nil on success
+ * @discussion CFTCoreErrorCodeIllegalTransition for a record that is not an approved sale or
+ * authorization and CFTCoreErrorCodeNotFound for one that could not be stored; neither was sent.
+ * CFTCoreErrorCodeInvalidArgument when the adjustment's metadata is not valid JSON; its tip is put back.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) NSError *error;
+
+/*!
+ * @property succeeded
+ * @brief YES if the gateway accepted the tip
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL succeeded;
+
+@end
+
+typedef void (^CFTTipAdjustmentResultBlock)(CFTTipAdjustmentResult * _Nonnull result);
+typedef void (^CFTTipAdjustmentCompletionBlock)(NSArray<CFTTipAdjustmentResult *> * _Nonnull results);
+
+@interface CFTTransactionManager (TipAdjustment)
+
+/*!
+ * @brief Replace the tips of many transaction records
+ * @param items NSArray<CFTTipAdjustmentItem *> - Records and their new tips
+ * @param store CFTTransactionRecordStore - Store the tips are applied to before the gateway answers; records not yet in it are added
+ * @param maxConcurrentRequests NSUInteger - Upper bound on outstanding requests, 0 uses the default of 8
+ * @param itemResult CFTTipAdjustmentResultBlock - Called on the main queue as each item finishes, in completion order
+ * @param completion CFTTipAdjustmentCompletionBlock - Called on the main queue once every item has finished, results in submission order
+ * @discussion When the call returns every valid tip is already in store. A tip the gateway
+ * declines, or that fails to reach it, is restored in store unless a newer tip was stored for
+ * the record in the meantime.
+ * Added in 4.12.0
+ */
+- (void)adjustTipsWithItems:(nonnull NSArray<CFTTipAdjustmentItem *> *)items
+     transactionRecordStore:(nonnull CFTTransactionRecordStore *)store
+      maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                 itemResult:(nullable CFTTipAdjustmentResultBlock)itemResult
+                 completion:(nullable CFTTipAdjustmentCompletionBlock)completion
+NS_SWIFT_NAME(adjustTips(items:transactionRecordStore:maxConcurrentRequests:itemResult:completion:));
+
+@end
@@ -0,0 +1,200 @@
+//
+//  CFTTransactionManager+TipAdjustment.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionManager+TipAdjustment.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTGatewaySession.h"
+#import "CFTTransactionRecordStore.h"
+
+#import <CardFlight/CFTAdjustment.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/BatchScheduler.hpp"
+#include "cft/TipAdjustmentBatch.hpp"
+
+static const NSUInteger CFTTipAdjustmentDefaultConcurrentRequests = 8;
+
+@interface CFTTipAdjustmentResult ()
+
+- (nonnull instancetype)initWithIndex:(NSUInteger)index
+                                 item:(nonnull CFTTipAdjustmentItem *)item
+                                error:(nullable NSError *)error;
+
+@end
+
+@implementation CFTTipAdjustmentItem
+
+- (instancetype)initWithTransactionRecord:(CFTTransactionRecord *)transactionRecord adjustment:(CFTAdjustment *)adjustment {
+    self = [super init];
+    if (self) {
+        _transactionRecord = transactionRecord;
+        _adjustment = adjustment;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTTipAdjustmentResult
+
+- (instancetype)initWithIndex:(NSUInteger)index item:(CFTTipAdjustmentItem *)item error:(NSError *)error {
+    self = [super init];
+    if (self) {
+        _index = index;
+        _item = item;
+        _error = error;
+    }
+    return self;
+}
+
+- (BOOL)succeeded {
+    return _error == nil;
+}
+
+@end
+
+// The SDK only adjusts a transaction in flight (-[CFTTransaction attachAdjustment:]) and documents
+// no call for a completed record. The route and body below are assumed from the v2 API's
+// transaction routes: POST transactions/{id}/adjust with the tip in minor units and the
+// adjustment's metadata. Nil when the metadata cannot be sent as JSON.
+static NSURLRequest *CFTTipAdjustmentRequest(CFTTransactionRecord *record, CFTAdjustment *adjustment, int64_t tipMinor) {
+    NSMutableDictionary *fields = [NSMutableDictionary dictionaryWithObject:@(tipMinor) forKey:@"amount"];
+    if (adjustment.metadata != nil) {
+        if (![NSJSONSerialization isValidJSONObject:adjustment.metadata]) {
+            return nil;
+        }
+        fields[@"metadata"] = adjustment.metadata;
+    }
+    NSData *body = [NSJSONSerialization dataWithJSONObject:fields options:0 error:nil];
+    if (body == nil) {
+        return nil;
+    }
+    NSString *path = [NSString stringWithFormat:@"transactions/%@/adjust", CFTCoreEscapedPathComponent(record.transactionId)];
+    return CFTCoreGatewayRequest(record.merchantAccount, path, body, @"application/json");
+}
+
+static cft::ErrorCode CFTTipAdjustmentOutcome(NSURLResponse *response, NSError *error) {
+    if (error != nil || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return cft::ErrorCode::IOFailure;
+    }
+    const NSInteger status = ((NSHTTPURLResponse *)response).statusCode;
+    if (status >= 200 && status < 300) {
+        return cft::ErrorCode::None;
+    }
+    return status >= 500 ? cft::ErrorCode::IOFailure : cft::ErrorCode::Declined;
+}
+
+@implementation CFTTransactionManager (TipAdjustment)
+
+- (void)adjustTipsWithItems:(NSArray<CFTTipAdjustmentItem *> *)items
+     transactionRecordStore:(CFTTransactionRecordStore *)store
+      maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                 itemResult:(CFTTipAdjustmentResultBlock)itemResult
+                 completion:(CFTTipAdjustmentCompletionBlock)completion {
+    NSArray<CFTTipAdjustmentItem *> *adjustmentItems = [items copy];
+    const NSUInteger concurrency = maxConcurrentRequests > 0 ? maxConcurrentRequests : CFTTipAdjustmentDefaultConcurrentRequests;
+
+    // Records the store has not seen yet are added with their current tip, which a failure restores.
+    // Stored ones are left alone, since storing again would overwrite their state and tip.
+    cft::TransactionRecordStore &coreStore = CFTCoreRecordStore(store);
+    std::vector<cft::TipAdjustment> adjustments;
+    adjustments.reserve(adjustmentItems.count);
+    for (CFTTipAdjustmentItem *item in adjustmentItems) {
+        std::string transactionId(item.transactionRecord.transactionId.UTF8String ?: "");
+        cft::StoredTransactionRecord stored;
+        if (!coreStore.get(transactionId, stored)) {
+            [store storeTransactionRecord:item.transactionRecord adjustment:nil error:nil];
+        }
+        CFTAmount *tip = item.adjustment.tipAmount;
+        adjustments.push_back(cft::TipAdjustment{std::move(transactionId), tip != nil ? CFTCoreMinorUnits(tip) : 0});
+    }
+
+    // The batch and scheduler are only touched on the main queue once the tips are applied. The
+    // batch refers to the store's core, so its deleter holds the store until the batch is gone.
+    std::shared_ptr<cft::TipAdjustmentBatch> batch(
+        new cft::TipAdjustmentBatch(coreStore, std::move(adjustments)),
+        [store](cft::TipAdjustmentBatch *finished) { delete finished; });
+    batch->applyOptimistically(CFTCoreMillisFromDate([NSDate date]));
+
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:adjustmentItems.count];
+    std::vector<std::size_t> applied;
+    for (NSUInteger i = 0; i < adjustmentItems.count; ++i) {
+        if (batch->state(i) == cft::TipAdjustmentState::Applied) {
+            applied.push_back(i);
+            [results addObject:[NSNull null]];
+        } else {
+            [results addObject:[[CFTTipAdjustmentResult alloc] initWithIndex:i
+                                                                         item:adjustmentItems[i]
+                                                                        error:CFTCoreMakeError(batch->error(i))]];
+        }
+    }
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (itemResult) {
+            for (CFTTipAdjustmentResult *result in results) {
+                if (result != (id)[NSNull null]) {
+                    itemResult(result);
+                }
+            }
+        }
+        if (applied.empty() && completion) {
+            completion([results copy]);
+        }
+    });
+    if (applied.empty()) {
+        return;
+    }
+
+    __block std::shared_ptr<cft::BatchScheduler> scheduler = std::make_shared<cft::BatchScheduler>(applied.size(), concurrency);
+
+    void (^report)(std::size_t, cft::ErrorCode) = ^(std::size_t item, cft::ErrorCode outcome) {
+        const std::size_t index = applied[item];
+        batch->complete(index, outcome, CFTCoreMillisFromDate([NSDate date]));
+
+        CFTTipAdjustmentResult *result = [[CFTTipAdjustmentResult alloc] initWithIndex:index
+                                                                                  item:adjustmentItems[index]
+                                                                                 error:CFTCoreMakeError(outcome)];
+        results[index] = result;
+        if (itemResult) {
+            itemResult(result);
+        }
+
+        scheduler->complete(item, outcome);
+        if (scheduler->isFinished()) {
+            scheduler.reset();
+            if (completion) {
+                completion([results copy]);
+            }
+        }
+    };
+
+    auto start = [=](std::size_t item) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            const std::size_t index = applied[item];
+            CFTTipAdjustmentItem *adjustmentItem = adjustmentItems[index];
+            NSURLRequest *request = CFTTipAdjustmentRequest(adjustmentItem.transactionRecord, adjustmentItem.adjustment,
+                                                            batch->adjustment(index).tipMinor);
+            if (request == nil) {
+                report(item, cft::ErrorCode::InvalidArgument);
+                return;
+            }
+            [[[CFTGatewaySession shared] dataTaskWithRequest:request
+                                           completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                report(item, CFTTipAdjustmentOutcome(response, error));
+            }] resume];
+        });
+    };
+
+    scheduler->run(start, nullptr);
+}
+
+@end
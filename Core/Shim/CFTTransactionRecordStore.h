@@ -0,0 +1,324 @@
+/*!
+ * @header CFTTransactionRecordStore.h
+ *
+ * @brief On-device store of transaction records for receipt reprints and lookups.
+ * Records are summarized into a memory-mapped file keyed by transactionId, with indexes on
+ * creation date, API state, last four and reference id. Lookups and queries run locally in
+ * microseconds and work offline.
+ *
+ * Every change to the store advances a cursor. transitionsSinceCursor:limit:nextCursor: returns
+ * only the records whose state changed after a cursor, so pollers never rescan the whole store.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+
+@class CFTAdjustment;
+@class CFTAmount;
+@class CFTTransactionRecord;
+
+@interface CFTTransactionRecordSummary : NSObject
+
+/*!
+ * @property transactionId
+ * @brief Identifier the summary is stored under
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSString *transactionId;
+
+/*!
+ * @property chargeId
+ * @brief Charge id of the record, if it had one
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *chargeId;
+
+/*!
+ * @property referenceId
+ * @brief Reference id of the record, if it had one
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *referenceId;
+
+/*!
+ * @property amount
+ * @brief Amount of the transaction
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *amount;
+
+/*!
+ * @property createdAt
+ * @brief Creation date of the record
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) NSDate *createdAt;
+
+/*!
+ * @property transactedAt
+ * @brief Date the transaction was processed, nil if it was not
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) NSDate *transactedAt;
+
+/*!
+ * @property apiTransactionState
+ * @brief State of the record when it was last stored
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTApiTransactionState apiTransactionState;
+
+/*!
+ * @property result
+ * @brief Result of the transaction
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionResult result;
+
+/*!
+ * @property transactionType
+ * @brief Type of the transaction
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionType transactionType;
+
+/*!
+ * @property cardBrand
+ * @brief Brand of the card used
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTCardBrand cardBrand;
+
+/*!
+ * @property cardInputMethod
+ * @brief How the card was read
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTCardInputMethod cardInputMethod;
+
+/*!
+ * @property networkType
+ * @brief Network the transaction was processed over
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTNetworkType networkType;
+
+/*!
+ * @property tipAmount
+ * @brief Tip on top of amount, 0 when none was stored with the record
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTAmount *tipAmount;
+
+/*!
+ * @property lastFour
+ * @brief Last four digits of the card number
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nullable) NSString *lastFour;
+
+/*!
+ * @property transactionRecord
+ * @brief The full record, when it was stored by this process and is still in memory
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTTransactionRecord *transactionRecord;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTTransactionRecordTransition : NSObject
+
+/*!
+ * @property transactionId
+ * @brief Record whose state changed
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSString *transactionId;
+
+/*!
+ * @property previousState
+ * @brief State before the change
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTApiTransactionState previousState;
+
+/*!
+ * @property state
+ * @brief State after the change
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTApiTransactionState state;
+
+/*!
+ * @property cursor
+ * @brief Store cursor of the change, 0 if it was not stored
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t cursor;
+
+/*!
+ * @property transactionRecord
+ * @brief The full record, when it is in memory
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTTransactionRecord *transactionRecord;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTTransactionRecordQuery : NSObject
+
+/*!
+ * @property createdFrom
+ * @brief Earliest creation date to match, inclusive. nil for no lower bound.
+ * Added in 4.12.0
+ */
+@property (nonatomic, strong, nullable) NSDate *createdFrom;
+
+/*!
+ * @property createdTo
+ * @brief Latest creation date to match, exclusive. nil for no upper bound.
+ * Added in 4.12.0
+ */
+@property (nonatomic, strong, nullable) NSDate *createdTo;
+
+/*!
+ * @property apiTransactionState
+ * @brief CFTApiTransactionState to match, nil for any
+ * Added in 4.12.0
+ */
+@property (nonatomic, strong, nullable) NSNumber *apiTransactionState;
+
+/*!
+ * @property lastFour
+ * @brief Last four digits to match, nil for any
+ * Added in 4.12.0
+ */
+@property (nonatomic, copy, nullable) NSString *lastFour;
+
+/*!
+ * @property referenceId
+ * @brief Reference id to match, nil for any
+ * Added in 4.12.0
+ */
+@property (nonatomic, copy, nullable) NSString *referenceId;
+
+/*!
+ * @property limit
+ * @brief Maximum number of results, 0 for no limit
+ * Added in 4.12.0
+ */
+@property (nonatomic, assign) NSUInteger limit;
+
+@end
+
+@interface CFTTransactionRecordStore : NSObject
+
+/*!
+ * @property count
+ * @brief Number of stored records
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger count;
+
+/*!
+ * @property cursor
+ * @brief Cursor of the latest change. Persisted with the store and never decreases.
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) uint64_t cursor;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Open or create a store
+ * @param fileURL NSURL - File the store is kept in, created if missing
+ * @param maxRecords NSUInteger - The oldest records are dropped beyond this many, 0 uses the default of 20000
+ * @param error NSError - Set when the file cannot be opened or is not a record store
+ * Added in 4.12.0
+ */
+- (nullable instancetype)initWithFileURL:(nonnull NSURL *)fileURL
+                              maxRecords:(NSUInteger)maxRecords
+                                   error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(init(fileURL:maxRecords:));
+
+/*!
+ * @brief Store or update a record
+ * @param transactionRecord CFTTransactionRecord - Record to store, replacing any with the same transactionId
+ * @param error NSError - CFTCoreErrorCodeInvalidArgument when the record has no transactionId or an id longer than 64 characters
+ * @return BOOL - YES when stored
+ * @discussion Call from the completion of a transaction, fetch or refresh to keep the store current.
+ * Added in 4.12.0
+ */
+- (BOOL)storeTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                         error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(store(transactionRecord:));
+
+/*!
+ * @brief Store or update a record along with the adjustment attached to its transaction
+ * @param adjustment CFTAdjustment - Adjustment whose tipAmount is stored with the record; nil keeps the stored tip
+ * @discussion Call after attachAdjustment: so that settlement totals include the tip.
+ * Added in 4.12.0
+ */
+- (BOOL)storeTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                    adjustment:(nullable CFTAdjustment *)adjustment
+                         error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(store(transactionRecord:adjustment:));
+
+/*!
+ * @brief Patch the stored state of a record in place, storing it if it is new
+ * @param transactionRecord CFTTransactionRecord - Record with its current state, e.g. after a refresh
+ * @param error NSError - Same errors as storeTransactionRecord:error:
+ * @return CFTTransactionRecordTransition - The change, or nil for a new record, an unchanged state, or an error
+ * Added in 4.12.0
+ */
+- (nullable CFTTransactionRecordTransition *)updateStateOfTransactionRecord:(nonnull CFTTransactionRecord *)transactionRecord
+                                                                      error:(NSError * _Nullable * _Nullable)error
+NS_SWIFT_NAME(updateState(transactionRecord:));
+
+/*!
+ * @brief State changes after a cursor, oldest first
+ * @param cursor uint64_t - 0 for every stored record, otherwise a nextCursor or cursor value from before
+ * @param limit NSUInteger - Maximum number of changes to examine, 0 for no limit
+ * @param nextCursor uint64_t - Set to the cursor to pass next time
+ * @discussion A record that changed several times since cursor is reported once, from its state before
+ * the latest state change. Only a state change moves that previous state, so a record changed in other
+ * fields after cursor is reported with its latest state change even when that came earlier.
+ * Added in 4.12.0
+ */
+- (nonnull NSArray<CFTTransactionRecordTransition *> *)transitionsSinceCursor:(uint64_t)cursor
+                                                                        limit:(NSUInteger)limit
+                                                                   nextCursor:(nullable uint64_t *)nextCursor
+NS_SWIFT_NAME(transitions(since:limit:nextCursor:));
+
+/*!
+ * @brief Look up a record by transactionId
+ * Added in 4.12.0
+ */
+- (nullable CFTTransactionRecordSummary *)summaryForTransactionId:(nonnull NSString *)transactionId
+NS_SWIFT_NAME(summary(transactionId:));
+
+/*!
+ * @brief Records matching every set filter of the query, newest first
+ * Added in 4.12.0
+ */
+- (nonnull NSArray<CFTTransactionRecordSummary *> *)summariesMatchingQuery:(nonnull CFTTransactionRecordQuery *)query
+NS_SWIFT_NAME(summaries(matching:));
+
+/*!
+ * @brief Remove a record
+ * @return BOOL - NO if no record is stored under transactionId
+ * Added in 4.12.0
+ */
+- (BOOL)removeTransactionRecordWithTransactionId:(nonnull NSString *)transactionId
+NS_SWIFT_NAME(removeTransactionRecord(transactionId:));
+
+@end
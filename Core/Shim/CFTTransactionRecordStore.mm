@@ -0,0 +1,288 @@
+//
+//  CFTTransactionRecordStore.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionRecordStore.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTAdjustment.h>
+#import <CardFlight/CFTAmount.h>
+#import <CardFlight/CFTCardInfo.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cft/TransactionRecordStore.hpp"
+
+static NSString *CFTRecordText(const std::string &text) {
+    return text.empty() ? nil : [[NSString alloc] initWithBytes:text.data() length:text.size() encoding:NSUTF8StringEncoding];
+}
+
+static std::string CFTRecordString(NSString *string) {
+    const char *utf8 = string.UTF8String;
+    return utf8 == NULL ? std::string() : std::string(utf8);
+}
+
+@interface CFTTransactionRecordSummary ()
+
+- (nonnull instancetype)initWithStoredRecord:(const cft::StoredTransactionRecord &)record
+                           transactionRecord:(nullable CFTTransactionRecord *)transactionRecord;
+
+@end
+
+@implementation CFTTransactionRecordSummary
+
+- (instancetype)initWithStoredRecord:(const cft::StoredTransactionRecord &)record
+                   transactionRecord:(CFTTransactionRecord *)transactionRecord {
+    self = [super init];
+    if (self) {
+        _transactionId = CFTRecordText(cft::StoredTransactionRecord::text(record.transactionId)) ?: @"";
+        _chargeId = CFTRecordText(cft::StoredTransactionRecord::text(record.chargeId));
+        _referenceId = CFTRecordText(cft::StoredTransactionRecord::text(record.referenceId));
+        _amount = CFTCoreAmountWithMinorUnits(record.amountMinor);
+        _createdAt = CFTCoreDateFromMillis(record.createdAtMillis);
+        _transactedAt = record.transactedAtMillis < 0 ? nil : CFTCoreDateFromMillis(record.transactedAtMillis);
+        _apiTransactionState = static_cast<CFTApiTransactionState>(record.apiTransactionState);
+        _result = static_cast<CFTTransactionResult>(record.result);
+        _transactionType = static_cast<CFTTransactionType>(record.transactionType);
+        _cardBrand = static_cast<CFTCardBrand>(record.cardBrand);
+        _cardInputMethod = static_cast<CFTCardInputMethod>(record.cardInputMethod);
+        _networkType = static_cast<CFTNetworkType>(record.networkType);
+        _tipAmount = CFTCoreAmountWithMinorUnits(record.tipMinor);
+        _lastFour = CFTRecordText(record.lastFourText());
+        _transactionRecord = transactionRecord;
+    }
+    return self;
+}
+
+@end
+
+@interface CFTTransactionRecordTransition ()
+
+- (nonnull instancetype)initWithTransactionId:(nonnull NSString *)transactionId
+                                previousState:(CFTApiTransactionState)previousState
+                                        state:(CFTApiTransactionState)state
+                                       cursor:(uint64_t)cursor
+                            transactionRecord:(nullable CFTTransactionRecord *)transactionRecord;
+
+@end
+
+@implementation CFTTransactionRecordTransition
+
+- (instancetype)initWithTransactionId:(NSString *)transactionId
+                        previousState:(CFTApiTransactionState)previousState
+                                state:(CFTApiTransactionState)state
+                               cursor:(uint64_t)cursor
+                    transactionRecord:(CFTTransactionRecord *)transactionRecord {
+    self = [super init];
+    if (self) {
+        _transactionId = [transactionId copy];
+        _previousState = previousState;
+        _state = state;
+        _cursor = cursor;
+        _transactionRecord = transactionRecord;
+    }
+    return self;
+}
+
+@end
+
+@implementation CFTTransactionRecordQuery
+@end
+
+@implementation CFTTransactionRecordStore {
+    std::unique_ptr<cft::TransactionRecordStore> _store;
+    // Full records stored by this process, so lookups can hand back the real object while it is around.
+    NSCache<NSString *, CFTTransactionRecord *> *_liveRecords;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL maxRecords:(NSUInteger)maxRecords error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        if (!fileURL.isFileURL) {
+            CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+            return nil;
+        }
+        cft::TransactionRecordStoreConfig config;
+        if (maxRecords > 0) {
+            config.maxRecords = maxRecords;
+        }
+        if (!CFTCoreSucceeded(cft::TransactionRecordStore::open(fileURL.fileSystemRepresentation, config, _store), error)) {
+            return nil;
+        }
+        _liveRecords = [NSCache new];
+        _liveRecords.countLimit = 500;
+    }
+    return self;
+}
+
+// Defined inside the implementation so it can reach the ivar.
+cft::TransactionRecordStore &CFTCoreRecordStore(CFTTransactionRecordStore *store) {
+    return *store->_store;
+}
+
+- (NSUInteger)count {
+    return _store->count();
+}
+
+- (BOOL)storeTransactionRecord:(CFTTransactionRecord *)transactionRecord error:(NSError **)error {
+    return [self storeTransactionRecord:transactionRecord adjustment:nil error:error];
+}
+
+- (BOOL)storeTransactionRecord:(CFTTransactionRecord *)transactionRecord
+                    adjustment:(CFTAdjustment *)adjustment
+                         error:(NSError **)error {
+    cft::StoredTransactionRecord record{};
+    if (transactionRecord.transactionId.length == 0 ||
+        cft::StoredTransactionRecord::assign(record.transactionId, CFTRecordString(transactionRecord.transactionId)) != cft::ErrorCode::None) {
+        return CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+    }
+    // Over-long optional ids are left out rather than truncated, so a query never matches a prefix.
+    cft::StoredTransactionRecord::assign(record.chargeId, CFTRecordString(transactionRecord.chargeId));
+    cft::StoredTransactionRecord::assign(record.referenceId, CFTRecordString(transactionRecord.referenceId));
+    cft::StoredTransactionRecord::assign(record.lastFour, CFTRecordString(transactionRecord.cardInfo.lastFour));
+
+    record.apiTransactionState = static_cast<std::uint8_t>(transactionRecord.apiTransactionState);
+    record.result = static_cast<std::uint8_t>(transactionRecord.result);
+    record.transactionType = static_cast<std::uint8_t>(transactionRecord.transactionType);
+    record.createdAtMillis = CFTCoreMillisFromDate(transactionRecord.createdAt);
+    record.transactedAtMillis = transactionRecord.transactedAt ? CFTCoreMillisFromDate(transactionRecord.transactedAt) : -1;
+    record.amountMinor = CFTCoreMinorUnits(transactionRecord.amount);
+    record.updatedAtMillis = CFTCoreMillisFromDate([NSDate date]);
+    record.cardBrand = static_cast<std::uint8_t>(transactionRecord.cardInfo.cardBrand);
+    record.cardInputMethod = static_cast<std::uint8_t>(transactionRecord.cardInfo.cardInputMethod);
+    record.networkType = static_cast<std::uint8_t>(transactionRecord.networkType);
+
+    // Records carry no tip, so a record stored without its adjustment keeps the tip stored before.
+    cft::StoredTransactionRecord existing;
+    if (adjustment.tipAmount != nil) {
+        record.tipMinor = CFTCoreMinorUnits(adjustment.tipAmount);
+    } else if (_store->get(CFTRecordString(transactionRecord.transactionId), existing)) {
+        record.tipMinor = existing.tipMinor;
+    }
+
+    if (!CFTCoreSucceeded(_store->put(record), error)) {
+        return NO;
+    }
+    [_liveRecords setObject:transactionRecord forKey:transactionRecord.transactionId];
+    return YES;
+}
+
+- (uint64_t)cursor {
+    return _store->cursor();
+}
+
+- (CFTTransactionRecordTransition *)updateStateOfTransactionRecord:(CFTTransactionRecord *)transactionRecord error:(NSError **)error {
+    NSString *transactionId = transactionRecord.transactionId;
+    if (transactionId.length == 0) {
+        CFTCoreSucceeded(cft::ErrorCode::InvalidArgument, error);
+        return nil;
+    }
+
+    cft::TransactionRecordDelta delta;
+    delta.transactionId = CFTRecordString(transactionId);
+    delta.state = static_cast<cft::ApiTransactionState>(transactionRecord.apiTransactionState);
+    delta.result = static_cast<cft::TransactionResult>(transactionRecord.result);
+    delta.transactedAtMillis = transactionRecord.transactedAt ? CFTCoreMillisFromDate(transactionRecord.transactedAt) : -1;
+    delta.updatedAtMillis = CFTCoreMillisFromDate([NSDate date]);
+
+    cft::StoredTransactionRecord record{};
+    const bool stored = _store->get(delta.transactionId, record);
+    const std::uint8_t storedState = record.apiTransactionState;
+    bool changed = false;
+    const cft::ErrorCode code = _store->applyDelta(delta, changed);
+    if (code == cft::ErrorCode::NotFound) {
+        if (![self storeTransactionRecord:transactionRecord error:error]) {
+            return nil;
+        }
+    } else if (!CFTCoreSucceeded(code, error) || !changed) {
+        return nil;
+    }
+
+    [_liveRecords setObject:transactionRecord forKey:transactionId];
+    // A write that kept the state keeps the previous state too, so compare with the state before it.
+    if (!stored || !_store->get(delta.transactionId, record) || record.apiTransactionState == storedState) {
+        return nil;
+    }
+    return [[CFTTransactionRecordTransition alloc] initWithTransactionId:transactionId
+                                                           previousState:static_cast<CFTApiTransactionState>(record.previousApiTransactionState)
+                                                                   state:static_cast<CFTApiTransactionState>(record.apiTransactionState)
+                                                                  cursor:record.changeSequence
+                                                       transactionRecord:transactionRecord];
+}
+
+- (NSArray<CFTTransactionRecordTransition *> *)transitionsSinceCursor:(uint64_t)cursor
+                                                                limit:(NSUInteger)limit
+                                                           nextCursor:(uint64_t *)nextCursor {
+    std::uint64_t next = cursor;
+    const std::vector<cft::StoredTransactionRecord> changes =
+        _store->changesSince(cursor, limit > 0 ? limit : std::numeric_limits<std::size_t>::max(), next);
+    if (nextCursor != NULL) {
+        *nextCursor = next;
+    }
+
+    NSMutableArray<CFTTransactionRecordTransition *> *transitions = [NSMutableArray arrayWithCapacity:changes.size()];
+    for (const cft::StoredTransactionRecord &record : changes) {
+        // New records and changes to other fields also advance the cursor but are not transitions.
+        NSString *transactionId = CFTRecordText(cft::StoredTransactionRecord::text(record.transactionId));
+        if (transactionId == nil || record.previousApiTransactionState == record.apiTransactionState) {
+            continue;
+        }
+        [transitions addObject:[[CFTTransactionRecordTransition alloc] initWithTransactionId:transactionId
+                                                                               previousState:static_cast<CFTApiTransactionState>(record.previousApiTransactionState)
+                                                                                       state:static_cast<CFTApiTransactionState>(record.apiTransactionState)
+                                                                                      cursor:record.changeSequence
+                                                                           transactionRecord:[_liveRecords objectForKey:transactionId]]];
+    }
+    return transitions;
+}
+
+- (CFTTransactionRecordSummary *)summaryForTransactionId:(NSString *)transactionId {
+    cft::StoredTransactionRecord record;
+    if (!_store->get(CFTRecordString(transactionId), record)) {
+        return nil;
+    }
+    return [[CFTTransactionRecordSummary alloc] initWithStoredRecord:record
+                                                   transactionRecord:[_liveRecords objectForKey:transactionId]];
+}
+
+- (NSArray<CFTTransactionRecordSummary *> *)summariesMatchingQuery:(CFTTransactionRecordQuery *)query {
+    cft::TransactionRecordQuery coreQuery;
+    if (query.createdFrom != nil) {
+        coreQuery.createdFromMillis = CFTCoreMillisFromDate(query.createdFrom);
+    }
+    if (query.createdTo != nil) {
+        coreQuery.createdToMillis = CFTCoreMillisFromDate(query.createdTo);
+    }
+    if (query.apiTransactionState != nil) {
+        coreQuery.matchState = true;
+        coreQuery.state = static_cast<cft::ApiTransactionState>(query.apiTransactionState.integerValue);
+    }
+    coreQuery.lastFour = CFTRecordString(query.lastFour);
+    coreQuery.referenceId = CFTRecordString(query.referenceId);
+    if (query.limit > 0) {
+        coreQuery.limit = query.limit;
+    }
+
+    NSMutableArray<CFTTransactionRecordSummary *> *summaries = [NSMutableArray array];
+    for (const cft::StoredTransactionRecord &record : _store->query(coreQuery)) {
+        NSString *transactionId = CFTRecordText(cft::StoredTransactionRecord::text(record.transactionId));
+        CFTTransactionRecord *live = transactionId ? [_liveRecords objectForKey:transactionId] : nil;
+        [summaries addObject:[[CFTTransactionRecordSummary alloc] initWithStoredRecord:record transactionRecord:live]];
+    }
+    return summaries;
+}
+
+- (BOOL)removeTransactionRecordWithTransactionId:(NSString *)transactionId {
+    [_liveRecords removeObjectForKey:transactionId];
+    return _store->remove(CFTRecordString(transactionId)) == cft::ErrorCode::None;
+}
+
+@end
@@ -0,0 +1,183 @@
+/*!
+ * @header CFTTransactionTrace.h
+ *
+ * @brief Per-transaction latency tracing.
+ * A CFTTransactionTracer sits between a CFTTransaction and its delegate, timestamps every
+ * state update and card reader event on the monotonic clock, and forwards each callback
+ * unchanged. When the transaction finishes, the trace is attached to its CFTTransactionRecord
+ * and reported to CFTSessionManager's metrics delegate.
+ *
+ * Card reader events are also published to [CFTReaderEventBus shared].
+ *
+ * The SDK does not report its gateway calls, so time spent in CFTTransactionStateProcessing
+ * is traced as gateway time; each entry into that state counts as one round trip.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTEnum.h>
+#import <CardFlight/CFTTransaction.h>
+#import <CardFlight/CFTTransactionRecord.h>
+
+/*!
+ * @typedef CFTTransactionTraceEventKind
+ * @constant CFTTransactionTraceEventKindState The transaction entered state
+ * @constant CFTTransactionTraceEventKindCardReaderEvent The reader reported cardReaderEvent
+ * @constant CFTTransactionTraceEventKindGatewayRequest A gateway round trip started
+ * @constant CFTTransactionTraceEventKindGatewayResponse A gateway round trip finished
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTTransactionTraceEventKind) {
+    CFTTransactionTraceEventKindState NS_SWIFT_NAME(state) = 0,
+    CFTTransactionTraceEventKindCardReaderEvent NS_SWIFT_NAME(cardReaderEvent) = 1,
+    CFTTransactionTraceEventKindGatewayRequest NS_SWIFT_NAME(gatewayRequest) = 2,
+    CFTTransactionTraceEventKindGatewayResponse NS_SWIFT_NAME(gatewayResponse) = 3
+};
+
+/*!
+ * @typedef CFTTransactionTraceSegment
+ * @constant CFTTransactionTraceSegmentTotal From the start of the trace to its last event
+ * @constant CFTTransactionTraceSegmentCardPresentation From asking for card input until the reader reports a card
+ * @constant CFTTransactionTraceSegmentCardReading From the reader reporting a card until card input is complete, including application selection
+ * @constant CFTTransactionTraceSegmentGateway Gateway round trips
+ * Added in 4.12.0
+ */
+typedef NS_ENUM(NSInteger, CFTTransactionTraceSegment) {
+    CFTTransactionTraceSegmentTotal NS_SWIFT_NAME(total) = 0,
+    CFTTransactionTraceSegmentCardPresentation NS_SWIFT_NAME(cardPresentation) = 1,
+    CFTTransactionTraceSegmentCardReading NS_SWIFT_NAME(cardReading) = 2,
+    CFTTransactionTraceSegmentGateway NS_SWIFT_NAME(gateway) = 3
+};
+
+@interface CFTTransactionTraceEvent : NSObject
+
+/*!
+ * @property kind
+ * @brief What happened
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionTraceEventKind kind;
+
+/*!
+ * @property offset
+ * @brief Seconds since the trace started
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSTimeInterval offset;
+
+/*!
+ * @property state
+ * @brief State entered, for CFTTransactionTraceEventKindState
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTTransactionState state;
+
+/*!
+ * @property cardReaderEvent
+ * @brief Event received, for CFTTransactionTraceEventKindCardReaderEvent
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) CFTCardReaderEvent cardReaderEvent;
+
+/*!
+ * @property hasError
+ * @brief YES when the event was reported with an error
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) BOOL hasError;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+@end
+
+@interface CFTTransactionTrace : NSObject
+
+/*!
+ * @property events
+ * @brief Everything recorded, oldest first
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, copy, nonnull) NSArray<CFTTransactionTraceEvent *> *events;
+
+/*!
+ * @property droppedEventCount
+ * @brief Events left out because the trace was full, e.g. during a long run of battery updates
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, assign) NSUInteger droppedEventCount;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Seconds spent in state, summed over every visit
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationInState:(CFTTransactionState)state
+NS_SWIFT_NAME(duration(in:));
+
+/*!
+ * @brief Seconds attributed to segment
+ * Added in 4.12.0
+ */
+- (NSTimeInterval)durationOfSegment:(CFTTransactionTraceSegment)segment
+NS_SWIFT_NAME(duration(of:));
+
+/*!
+ * @brief Trace in the shape of sdkData: milliseconds per state and segment, and the event timeline
+ * Added in 4.12.0
+ */
+- (nonnull NSDictionary<NSString *, id> *)asDictionary;
+
+@end
+
+@interface CFTTransactionTracer : NSObject <CFTTransactionDelegate>
+
+/*!
+ * @property delegate
+ * @brief Receives every callback of the traced transaction
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, weak, nullable) id <CFTTransactionDelegate> delegate;
+
+/*!
+ * @property trace
+ * @brief Snapshot of the trace so far
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nonnull) CFTTransactionTrace *trace;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
++ (nonnull instancetype)new NS_UNAVAILABLE;
+
+/*!
+ * @brief Start tracing transaction
+ * @param transaction CFTTransaction - Its delegate becomes the tracer, which the transaction keeps alive
+ * @param delegate id<CFTTransactionDelegate> - The delegate the transaction would otherwise have
+ * @discussion Call from the transaction's creation completion, before doing anything else with it.
+ * Added in 4.12.0
+ */
++ (nonnull instancetype)traceTransaction:(nonnull CFTTransaction *)transaction
+                                delegate:(nonnull id <CFTTransactionDelegate>)delegate
+NS_SWIFT_NAME(trace(_:delegate:));
+
+@end
+
+@interface CFTTransactionRecord (CFTTrace)
+
+/*!
+ * @property trace
+ * @brief Trace of the transaction that produced this record, when it was traced
+ * Added in 4.12.0
+ */
+@property (nonatomic, readonly, strong, nullable) CFTTransactionTrace *trace;
+
+/*!
+ * @brief sdkData with the trace's asDictionary under the "trace" key
+ * Added in 4.12.0
+ */
+- (nonnull NSDictionary *)sdkDataWithTrace;
+
+@end
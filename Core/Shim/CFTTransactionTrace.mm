@@ -0,0 +1,370 @@
+//
+//  CFTTransactionTrace.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTTransactionTrace.h"
+#import "CFTSessionManager+Metrics.h"
+#import "CFTCoreError.h"
+#import "CFTCorePrivate.h"
+#import "CFTReaderEventBus.h"
+
+#import <objc/runtime.h>
+
+#include <atomic>
+
+#include "cft/EventLog.hpp"
+#include "cft/TransactionTrace.hpp"
+
+static_assert(static_cast<NSInteger>(cft::TraceEventKind::GatewayResponse) == CFTTransactionTraceEventKindGatewayResponse, "");
+static_assert(static_cast<NSInteger>(cft::TraceSegment::Gateway) == CFTTransactionTraceSegmentGateway, "");
+static_assert(static_cast<NSInteger>(cft::TransactionState::PendingAdjustment) == CFTTransactionStatePendingAdjustment, "");
+
+static void *CFTTransactionTracerKey = &CFTTransactionTracerKey;
+static void *CFTTransactionRecordTraceKey = &CFTTransactionRecordTraceKey;
+
+static NSString * const CFTTransactionTraceStatesKey = @"states";
+static NSString * const CFTTransactionTraceSegmentsKey = @"segments";
+static NSString * const CFTTransactionTraceEventsKey = @"events";
+static NSString * const CFTTransactionTraceDroppedKey = @"dropped";
+
+static NSTimeInterval CFTTransactionTraceSeconds(cft::Nanos nanos) {
+    return static_cast<NSTimeInterval>(nanos) / 1e9;
+}
+
+static NSNumber *CFTTransactionTraceMillis(cft::Nanos nanos) {
+    return @(static_cast<double>(nanos) / 1e6);
+}
+
+@interface CFTTransactionTraceEvent ()
+
+- (instancetype)initWithEvent:(const cft::TraceEvent &)event origin:(cft::Nanos)origin;
+
+- (NSDictionary<NSString *, id> *)asDictionary;
+
+@end
+
+@implementation CFTTransactionTraceEvent
+
+- (instancetype)initWithEvent:(const cft::TraceEvent &)event origin:(cft::Nanos)origin {
+    self = [super init];
+    if (self) {
+        _kind = static_cast<CFTTransactionTraceEventKind>(event.kind);
+        _offset = CFTTransactionTraceSeconds(event.at - origin);
+        _state = event.kind == cft::TraceEventKind::State ? static_cast<CFTTransactionState>(event.value)
+                                                          : CFTTransactionStateUnknown;
+        _cardReaderEvent = event.kind == cft::TraceEventKind::ReaderEvent ? static_cast<CFTCardReaderEvent>(event.value)
+                                                                          : CFTCardReaderEventUnknown;
+        _hasError = event.error != cft::ErrorCode::None;
+    }
+    return self;
+}
+
+- (NSDictionary<NSString *, id> *)asDictionary {
+    NSMutableDictionary<NSString *, id> *dictionary = [NSMutableDictionary dictionary];
+    dictionary[@"offset"] = @(_offset * 1000);
+    switch (_kind) {
+        case CFTTransactionTraceEventKindState:
+            dictionary[@"state"] = @(cft::transactionStateName(static_cast<cft::TransactionState>(_state)));
+            break;
+        case CFTTransactionTraceEventKindCardReaderEvent:
+            dictionary[@"cardReaderEvent"] = @(_cardReaderEvent);
+            break;
+        case CFTTransactionTraceEventKindGatewayRequest:
+            dictionary[@"gateway"] = @"request";
+            break;
+        case CFTTransactionTraceEventKindGatewayResponse:
+            dictionary[@"gateway"] = @"response";
+            break;
+    }
+    if (_hasError) {
+        dictionary[@"error"] = @YES;
+    }
+    return dictionary;
+}
+
+@end
+
+@interface CFTTransactionTrace ()
+
+- (instancetype)initWithTrace:(const cft::TransactionTrace &)trace;
+
+- (const cft::TraceBreakdown &)breakdown;
+
+@end
+
+@implementation CFTTransactionTrace {
+    cft::TransactionTrace _trace;
+    cft::TraceBreakdown _breakdown;
+    NSArray<CFTTransactionTraceEvent *> *_events;
+    NSDictionary<NSString *, id> *_dictionary;
+}
+
+- (instancetype)initWithTrace:(const cft::TransactionTrace &)trace {
+    self = [super init];
+    if (self) {
+        _trace = trace;
+        _breakdown = trace.breakdown();
+    }
+    return self;
+}
+
+- (const cft::TraceBreakdown &)breakdown {
+    return _breakdown;
+}
+
+- (NSArray<CFTTransactionTraceEvent *> *)events {
+    @synchronized (self) {
+        if (_events == nil) {
+            const std::size_t size = _trace.size();
+            const cft::TraceEvent *events = _trace.events();
+            const cft::Nanos origin = size > 0 ? events[0].at : 0;
+            NSMutableArray<CFTTransactionTraceEvent *> *built = [NSMutableArray arrayWithCapacity:size];
+            for (std::size_t i = 0; i < size; ++i) {
+                [built addObject:[[CFTTransactionTraceEvent alloc] initWithEvent:events[i] origin:origin]];
+            }
+            _events = [built copy];
+        }
+        return _events;
+    }
+}
+
+- (NSUInteger)droppedEventCount {
+    return _trace.droppedCount();
+}
+
+- (NSTimeInterval)durationInState:(CFTTransactionState)state {
+    if (state < 0 || static_cast<std::size_t>(state) >= cft::kTransactionStateCount) {
+        return 0;
+    }
+    return CFTTransactionTraceSeconds(_breakdown.inState[static_cast<std::size_t>(state)]);
+}
+
+- (NSTimeInterval)durationOfSegment:(CFTTransactionTraceSegment)segment {
+    if (segment < 0 || static_cast<std::size_t>(segment) >= cft::kTraceSegmentCount) {
+        return 0;
+    }
+    return CFTTransactionTraceSeconds(_breakdown.segments[static_cast<std::size_t>(segment)]);
+}
+
+- (NSDictionary<NSString *, id> *)asDictionary {
+    NSArray<CFTTransactionTraceEvent *> *events = self.events;
+    @synchronized (self) {
+        if (_dictionary == nil) {
+            NSMutableDictionary<NSString *, NSNumber *> *states = [NSMutableDictionary dictionary];
+            for (std::size_t i = 0; i < cft::kTransactionStateCount; ++i) {
+                if (_breakdown.entries[i] > 0) {
+                    const auto state = static_cast<cft::TransactionState>(i);
+                    states[@(cft::transactionStateName(state))] = CFTTransactionTraceMillis(_breakdown.inState[i]);
+                }
+            }
+            NSMutableDictionary<NSString *, NSNumber *> *segments = [NSMutableDictionary dictionary];
+            for (std::size_t i = 0; i < cft::kTraceSegmentCount; ++i) {
+                const auto segment = static_cast<cft::TraceSegment>(i);
+                const bool present = segment == cft::TraceSegment::Total ||
+                                     (segment == cft::TraceSegment::Gateway ? _breakdown.gatewayRequests > 0
+                                                                            : _breakdown.hasCardEvent);
+                if (present) {
+                    segments[@(cft::traceSegmentName(segment))] = CFTTransactionTraceMillis(_breakdown.segments[i]);
+                }
+            }
+            NSMutableArray<NSDictionary *> *timeline = [NSMutableArray arrayWithCapacity:events.count];
+            for (CFTTransactionTraceEvent *event in events) {
+                [timeline addObject:[event asDictionary]];
+            }
+            _dictionary = @{
+                CFTTransactionTraceStatesKey: [states copy],
+                CFTTransactionTraceSegmentsKey: [segments copy],
+                CFTTransactionTraceEventsKey: [timeline copy],
+                CFTTransactionTraceDroppedKey: @(_trace.droppedCount()),
+            };
+        }
+        return _dictionary;
+    }
+}
+
+@end
+
+@implementation CFTTransactionTracer {
+    cft::TransactionTrace _trace;
+    std::uint64_t _logId;
+    CFTTransactionState _state;
+    BOOL _requestOpen;
+    BOOL _finished;
+}
+
++ (instancetype)traceTransaction:(CFTTransaction *)transaction delegate:(id<CFTTransactionDelegate>)delegate {
+    CFTTransactionTracer *tracer = [[CFTTransactionTracer alloc] initWithDelegate:delegate];
+    // The transaction only holds its delegate weakly.
+    objc_setAssociatedObject(transaction, CFTTransactionTracerKey, tracer, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    transaction.delegate = tracer;
+    return tracer;
+}
+
+- (instancetype)initWithDelegate:(id<CFTTransactionDelegate>)delegate {
+    self = [super init];
+    if (self) {
+        static std::atomic<std::uint64_t> nextLogId(1);
+        _delegate = delegate;
+        _logId = nextLogId.fetch_add(1, std::memory_order_relaxed);
+        _state = CFTTransactionStatePendingTransactionParameters;
+        _trace.recordState(cft::TransactionState::PendingTransactionParameters);
+    }
+    return self;
+}
+
+- (CFTTransactionTrace *)trace {
+    @synchronized (self) {
+        return [[CFTTransactionTrace alloc] initWithTrace:_trace];
+    }
+}
+
+#pragma mark - Recording
+
+- (void)transaction:(CFTTransaction *)transaction recordedEventAtIndex:(std::size_t)index {
+    id<CFTTransactionMetricsDelegate> metricsDelegate = [CFTSessionManager shared].metricsDelegate;
+    if (![metricsDelegate respondsToSelector:@selector(transaction:didRecordTraceEvent:)]) {
+        return;
+    }
+    CFTTransactionTraceEvent *event;
+    @synchronized (self) {
+        if (index >= _trace.size()) {
+            return;
+        }
+        event = [[CFTTransactionTraceEvent alloc] initWithEvent:_trace.events()[index] origin:_trace.events()[0].at];
+    }
+    [metricsDelegate transaction:transaction didRecordTraceEvent:event];
+}
+
+- (void)recordState:(CFTTransactionState)state error:(NSError *)error transaction:(CFTTransaction *)transaction {
+    const cft::ErrorCode code = CFTCoreErrorCodeFromError(error, NULL);
+    const auto coreState = static_cast<cft::TransactionState>(state);
+    std::size_t first;
+    std::size_t last;
+    @synchronized (self) {
+        first = _trace.size();
+        // Processing stands in for the gateway round trip the SDK does not report.
+        if (_requestOpen && state != CFTTransactionStateProcessing) {
+            _trace.recordGatewayResponse(0, code);
+            _requestOpen = NO;
+        }
+        _trace.recordState(coreState, code);
+        if (state == CFTTransactionStateProcessing && _state != CFTTransactionStateProcessing) {
+            _trace.recordGatewayRequest(0);
+            _requestOpen = YES;
+        }
+        _state = state;
+        last = _trace.size();
+    }
+    CFTCoreSharedEventLog().write(code == cft::ErrorCode::None ? cft::LogLevel::Debug : cft::LogLevel::Warning,
+                                  cft::LogSubsystem::Transaction, _logId, coreState, code);
+    for (std::size_t i = first; i < last; ++i) {
+        [self transaction:transaction recordedEventAtIndex:i];
+    }
+}
+
+- (void)finishTransaction:(CFTTransaction *)transaction record:(CFTTransactionRecord *)record {
+    CFTTransactionTrace *trace;
+    @synchronized (self) {
+        if (_finished) {
+            return;
+        }
+        _finished = YES;
+        if (_requestOpen) {
+            _trace.recordGatewayResponse(0);
+            _requestOpen = NO;
+        }
+        trace = [[CFTTransactionTrace alloc] initWithTrace:_trace];
+    }
+    if (record != nil) {
+        objc_setAssociatedObject(record, CFTTransactionRecordTraceKey, trace, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
+    CFTCoreRecordTraceBreakdown([CFTSessionManager shared].transactionMetrics, [trace breakdown]);
+    id<CFTTransactionMetricsDelegate> metricsDelegate = [CFTSessionManager shared].metricsDelegate;
+    if ([metricsDelegate respondsToSelector:@selector(transaction:didFinishWithTrace:)]) {
+        [metricsDelegate transaction:transaction didFinishWithTrace:trace];
+    }
+}
+
+#pragma mark - CFTTransactionDelegate
+
+- (void)transaction:(CFTTransaction *)transaction didUpdateState:(CFTTransactionState)state error:(NSError *)error {
+    [self recordState:state error:error transaction:transaction];
+    [self.delegate transaction:transaction didUpdateState:state error:error];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestDisplayMessages:(CFTMessage *)message {
+    [self.delegate transaction:transaction didRequestDisplayMessages:message];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestProcessOptionWithCardInfo:(CFTCardInfo *)cardInfo {
+    [self.delegate transaction:transaction didRequestProcessOptionWithCardInfo:cardInfo];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didDeferWithData:(NSData *)transactionData {
+    [self finishTransaction:transaction record:nil];
+    [self.delegate transaction:transaction didDeferWithData:transactionData];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestCvm:(CFTCVM)cvm {
+    [self.delegate transaction:transaction didRequestCvm:cvm];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didCompleteWithTransactionRecord:(CFTTransactionRecord *)transactionRecord {
+    [self finishTransaction:transaction record:transactionRecord];
+    [self.delegate transaction:transaction didCompleteWithTransactionRecord:transactionRecord];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didReceiveCardReaderEvent:(CFTCardReaderEvent)cardReaderEvent
+     cardReaderInfo:(CFTCardReaderInfo *)cardReaderInfo {
+    std::size_t index;
+    @synchronized (self) {
+        index = _trace.size();
+        _trace.recordReaderEvent(static_cast<cft::CardReaderEvent>(cardReaderEvent));
+    }
+    [self transaction:transaction recordedEventAtIndex:index];
+    [[CFTReaderEventBus shared] publishCardReaderEvent:cardReaderEvent
+                                        cardReaderInfo:cardReaderInfo
+                                                source:CFTReaderEventSourceTransaction];
+    id<CFTTransactionDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(transaction:didReceiveCardReaderEvent:cardReaderInfo:)]) {
+        [delegate transaction:transaction didReceiveCardReaderEvent:cardReaderEvent cardReaderInfo:cardReaderInfo];
+    }
+}
+
+#pragma mark - Forwarding
+
+// The remaining optional callbacks go straight to the delegate, and only when it implements them.
+- (BOOL)respondsToSelector:(SEL)selector {
+    if ([super respondsToSelector:selector]) {
+        return YES;
+    }
+    struct objc_method_description method = protocol_getMethodDescription(@protocol(CFTTransactionDelegate), selector, NO, YES);
+    return method.name != NULL && [self.delegate respondsToSelector:selector];
+}
+
+- (id)forwardingTargetForSelector:(SEL)selector {
+    id<CFTTransactionDelegate> delegate = self.delegate;
+    return [delegate respondsToSelector:selector] ? delegate : [super forwardingTargetForSelector:selector];
+}
+
+@end
+
+@implementation CFTTransactionRecord (CFTTrace)
+
+- (CFTTransactionTrace *)trace {
+    return objc_getAssociatedObject(self, CFTTransactionRecordTraceKey);
+}
+
+- (NSDictionary *)sdkDataWithTrace {
+    NSMutableDictionary *data = [NSMutableDictionary dictionaryWithDictionary:self.sdkData ?: @{}];
+    CFTTransactionTrace *trace = self.trace;
+    if (trace != nil) {
+        data[@"trace"] = [trace asDictionary];
+    }
+    return [data copy];
+}
+
+@end
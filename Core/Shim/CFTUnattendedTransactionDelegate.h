@@ -0,0 +1,35 @@
+//
+//  CFTUnattendedTransactionDelegate.h
+//  CardFlight
+//
+//  Transaction delegate used by shim APIs that drive transactions without a merchant
+//  at the device. Not part of the public interface.
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CardFlight/CFTTransaction.h>
+
+@class CFTTransactionRecord;
+
+/*!
+ * Answers the prompts an unattended transaction can answer and reports exactly one outcome.
+ * Card input, deferral, a tip adjustment and any cardholder verification finish the transaction with
+ * CFTCoreErrorCodeInteractionRequired; a completed record that was neither approved nor
+ * voided finishes with CFTCoreErrorCodeDeclined.
+ */
+@interface CFTUnattendedTransactionDelegate : NSObject <CFTTransactionDelegate>
+
+@property (nonatomic, strong, nullable) CFTTransaction *transaction;
+@property (nonatomic, copy, nullable) void (^finish)(CFTTransactionRecord * _Nullable record, NSError * _Nullable error);
+
+- (void)finishWithRecord:(nullable CFTTransactionRecord *)record error:(nullable NSError *)error;
+
+/*!
+ * @brief Completion block for the SDK call that creates the transaction
+ * @discussion Keeps the transaction alive until it finishes, or finishes with the creation error.
+ */
+- (nonnull CFTTransactionBlock)creationBlock;
+
+@end
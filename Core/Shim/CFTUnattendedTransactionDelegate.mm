@@ -0,0 +1,69 @@
+//
+//  CFTUnattendedTransactionDelegate.mm
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#import "CFTUnattendedTransactionDelegate.h"
+#import "CFTCorePrivate.h"
+
+#import <CardFlight/CFTTransactionRecord.h>
+
+@implementation CFTUnattendedTransactionDelegate
+
+- (void)finishWithRecord:(CFTTransactionRecord *)record error:(NSError *)error {
+    void (^finish)(CFTTransactionRecord *, NSError *) = self.finish;
+    self.finish = nil;
+    self.transaction = nil;
+    if (finish) {
+        finish(record, error);
+    }
+}
+
+- (CFTTransactionBlock)creationBlock {
+    return ^(CFTTransaction *transaction, NSError *error) {
+        if (error != nil || transaction == nil) {
+            [self finishWithRecord:nil error:error ?: CFTCoreMakeError(cft::ErrorCode::Declined)];
+        } else if (self.finish != nil) {
+            self.transaction = transaction;
+        }
+    };
+}
+
+- (void)transaction:(CFTTransaction *)transaction didUpdateState:(CFTTransactionState)state error:(NSError *)error {
+    if (error != nil) {
+        [self finishWithRecord:nil error:error];
+    } else if (state == CFTTransactionStatePendingCardInput || state == CFTTransactionStatePendingAdjustment) {
+        [self finishWithRecord:nil error:CFTCoreMakeError(cft::ErrorCode::InteractionRequired)];
+    }
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestDisplayMessages:(CFTMessage *)message {
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestProcessOptionWithCardInfo:(CFTCardInfo *)cardInfo {
+    [transaction selectProcessOption:CFTProcessOptionProcess];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didDeferWithData:(NSData *)transactionData {
+    [self finishWithRecord:nil error:CFTCoreMakeError(cft::ErrorCode::InteractionRequired)];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didRequestCvm:(CFTCVM)cvm {
+    if (cvm != CFTCVMNone) {
+        [self finishWithRecord:nil error:CFTCoreMakeError(cft::ErrorCode::InteractionRequired)];
+    }
+}
+
+- (void)didRequestAdjustmentForTransaction:(CFTTransaction *)transaction {
+    [self finishWithRecord:nil error:CFTCoreMakeError(cft::ErrorCode::InteractionRequired)];
+}
+
+- (void)transaction:(CFTTransaction *)transaction didCompleteWithTransactionRecord:(CFTTransactionRecord *)transactionRecord {
+    const BOOL accepted = transactionRecord.result == CFTTransactionResultApproved ||
+                          transactionRecord.result == CFTTransactionResultVoided;
+    [self finishWithRecord:transactionRecord error:accepted ? nil : CFTCoreMakeError(cft::ErrorCode::Declined)];
+}
+
+@end
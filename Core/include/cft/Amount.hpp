@@ -0,0 +1,90 @@
+/*!
+ * @header Amount.hpp
+ *
+ * @brief Fixed-point money: an int64 count of minor units and the currency's exponent.
+ * $12.34 is 1234 with exponent 2. Arithmetic is exact and checked; anything that would
+ * overflow or mix exponents fails with InvalidArgument instead of wrapping. Rounding is
+ * half to even, the banker's rounding CFTAmount applies.
+ *
+ * sumMinorUnits() and aggregateMinorUnits() work on plain arrays of minor units so that
+ * totals over thousands of records run as straight-line loops the compiler vectorizes.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+class Amount {
+public:
+    static constexpr std::uint8_t kUsdExponent = 2;
+    // 10^18 is the largest power of ten an int64 holds.
+    static constexpr std::uint8_t kMaxExponent = 18;
+
+    constexpr Amount() = default;
+    constexpr Amount(std::int64_t minorUnits, std::uint8_t exponent) : _minorUnits(minorUnits), _exponent(exponent) {}
+
+    /*!
+     * @brief mantissa × 10^decimalExponent, rounded to exponent digits after the point
+     * @discussion Matches the layout of NSDecimal, so the shim converts without NSDecimalNumber arithmetic.
+     * @return ErrorCode - InvalidArgument if exponent is above kMaxExponent or the value does not fit
+     */
+    static ErrorCode fromDecimal(std::uint64_t mantissa, std::int32_t decimalExponent, bool negative,
+                                 std::uint8_t exponent, Amount &out);
+
+    std::int64_t minorUnits() const { return _minorUnits; }
+    std::uint8_t exponent() const { return _exponent; }
+
+    /*!
+     * @brief The same value with exponent digits after the point, rounding when digits are dropped
+     */
+    ErrorCode rescaled(std::uint8_t exponent, Amount &out) const;
+
+    /*!
+     * @return ErrorCode - InvalidArgument if the exponents differ or the result does not fit
+     */
+    ErrorCode added(Amount other, Amount &out) const;
+    ErrorCode subtracted(Amount other, Amount &out) const;
+    ErrorCode multiplied(std::int64_t factor, Amount &out) const;
+
+    /*!
+     * @brief basisPoints hundredths of a percent of the amount, e.g. 1800 for an 18% tip
+     */
+    ErrorCode percentage(std::int64_t basisPoints, Amount &out) const;
+
+    bool operator==(const Amount &other) const {
+        return _minorUnits == other._minorUnits && _exponent == other._exponent;
+    }
+    bool operator!=(const Amount &other) const { return !(*this == other); }
+
+private:
+    std::int64_t _minorUnits = 0;
+    std::uint8_t _exponent = kUsdExponent;
+};
+
+struct AmountAggregate {
+    std::int64_t total = 0;
+    std::int64_t minimum = 0;
+    std::int64_t maximum = 0;
+    std::size_t count = 0;
+};
+
+/*!
+ * @brief Total of count values in one currency
+ * @return ErrorCode - InvalidArgument if the total does not fit in an int64. Intermediate sums may.
+ */
+ErrorCode sumMinorUnits(const std::int64_t *values, std::size_t count, std::int64_t &total);
+
+/*!
+ * @brief Total, minimum and maximum of count values in one pass
+ * @discussion Minimum and maximum are 0 when count is 0.
+ */
+ErrorCode aggregateMinorUnits(const std::int64_t *values, std::size_t count, AmountAggregate &aggregate);
+
+} // namespace cft
@@ -0,0 +1,94 @@
+/*!
+ * @header BatchScheduler.hpp
+ *
+ * @brief Runs a fixed list of independent asynchronous requests with bounded concurrency.
+ * The scheduler never blocks and owns no threads: it calls the start function for the
+ * next item whenever a slot frees up, and the caller reports each finished item through
+ * complete(). Results are delivered in completion order, not submission order.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+class BatchScheduler {
+public:
+    /*!
+     * @brief Begins the request for item index. Must eventually lead to exactly one complete(index, ...).
+     */
+    using StartFunction = std::function<void(std::size_t index)>;
+
+    /*!
+     * @brief Receives each item's outcome as it arrives, before the next item is started.
+     * @discussion Called on the thread that reported the item, so results for different
+     * items may be delivered concurrently.
+     */
+    using ResultFunction = std::function<void(std::size_t index, ErrorCode error)>;
+
+    /*!
+     * @param itemCount std::size_t - Number of items in the batch
+     * @param maxInFlight std::size_t - Upper bound on outstanding requests, 0 is treated as 1
+     */
+    BatchScheduler(std::size_t itemCount, std::size_t maxInFlight);
+
+    BatchScheduler(const BatchScheduler &) = delete;
+    BatchScheduler &operator=(const BatchScheduler &) = delete;
+
+    /*!
+     * @brief Start the first window of requests
+     * @discussion start may call complete() synchronously; the scheduler does not recurse,
+     * so batches of any size are safe with synchronous executors.
+     */
+    void run(StartFunction start, ResultFunction result);
+
+    /*!
+     * @brief Report the outcome of an item started by run()
+     * @discussion Thread-safe. A report that is refused changes nothing.
+     * @return ErrorCode - InvalidArgument if index has not been started, IllegalTransition if it
+     * has already completed
+     */
+    ErrorCode complete(std::size_t index, ErrorCode error);
+
+    /*!
+     * @brief Block until every item has completed and its result has been delivered
+     */
+    void wait();
+
+    bool isFinished() const;
+    std::size_t itemCount() const { return _itemCount; }
+    std::size_t succeededCount() const;
+    std::size_t failedCount() const;
+    std::size_t peakInFlight() const;
+
+private:
+    void pump(std::unique_lock<std::mutex> &lock);
+
+    const std::size_t _itemCount;
+    const std::size_t _maxInFlight;
+
+    mutable std::mutex _lock;
+    std::condition_variable _finished;
+    StartFunction _start;
+    ResultFunction _result;
+    std::size_t _nextIndex = 0;
+    std::size_t _inFlight = 0;
+    std::size_t _peakInFlight = 0;
+    std::size_t _succeeded = 0;
+    std::size_t _failed = 0;
+    std::size_t _reported = 0;
+    bool _pumping = false;
+    std::unique_ptr<bool[]> _done;
+};
+
+} // namespace cft
@@ -0,0 +1,201 @@
+/*!
+ * @header BinTable.hpp
+ *
+ * @brief Offline table of card BIN ranges, classifying a card from its leading digits without
+ * a gateway round trip: brand, credit or debit network, prepaid, commercial and regulated
+ * flags, and the PAN lengths the issuer uses.
+ *
+ * BINs are compared as eight-digit keys; a shorter prefix stands for every key it starts. The
+ * file holds the ranges sorted and disjoint, where a narrower range has already won over the
+ * wider one it sat in. Lookups run on the read-only mapping of the file: the first four digits
+ * index a bucket of ranges, and a second table gives the brand shared by every card under a
+ * one- to four-digit prefix, so a card typed one digit at a time is classified as soon as its
+ * brand is certain. Each lookup costs the same however large the table grows.
+ *
+ * Deltas from the server rewrite the file and swap in the new mapping; lookups already under
+ * way finish on the old one.
+ *
+ * File layout, little-endian:
+ *   header   "CFTBINS\0" u32 format u32 version u32 rangeCount u32 crc32 of the rest of the file
+ *            u64 reserved
+ *   buckets  10001 x u32, the first range ending at or after each four-digit prefix, then the
+ *            range count; zero padding to 8 bytes
+ *   brands   11110 x u8, the brand of every card under each prefix of one to four digits,
+ *            CardBrand::Unknown when they differ; zero padding to 8 bytes
+ *   ranges   rangeCount x StoredBinRange
+ *
+ * Delta layout, little-endian:
+ *   "CFTBIND\0" u32 fromVersion u32 toVersion u32 removalCount u32 rangeCount,
+ *   removalCount x (u32 low u32 high), rangeCount x StoredBinRange, u32 crc32 of all before it
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/File.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*! @brief Digits in a BIN key; shorter prefixes are padded to it */
+constexpr std::size_t kBinDigits = 8;
+
+/*! @brief Prepaid or gift card */
+constexpr std::uint8_t BinFlagPrepaid = 1u << 0;
+/*! @brief Business, corporate or purchasing card */
+constexpr std::uint8_t BinFlagCommercial = 1u << 1;
+/*! @brief Debit card of an issuer under the interchange cap, routable over an unaffiliated network */
+constexpr std::uint8_t BinFlagRegulated = 1u << 2;
+
+/*!
+ * @brief BINs low to high inclusive, as eight-digit keys, and what cards in them are
+ */
+struct BinRange {
+    std::uint32_t low = 0;
+    std::uint32_t high = 0;
+    CardBrand brand = CardBrand::Unknown;
+    NetworkType network = NetworkType::Unknown;
+    /*! BinFlagPrepaid, BinFlagCommercial and BinFlagRegulated */
+    std::uint8_t flags = 0;
+    std::uint8_t minPanLength = 12;
+    std::uint8_t maxPanLength = 19;
+};
+
+/*! @brief A range as stored in the table and in deltas; 16 bytes */
+struct StoredBinRange {
+    std::uint32_t low;
+    std::uint32_t high;
+    std::uint8_t brand;
+    std::uint8_t network;
+    std::uint8_t flags;
+    std::uint8_t minPanLength;
+    std::uint8_t maxPanLength;
+    std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(StoredBinRange) == 16, "StoredBinRange is part of the file format");
+
+/*!
+ * @brief What the table knows about a card from the digits seen so far
+ * @discussion brand may be known before the rest: it is set as soon as every card under the
+ * digits shares a brand. The other fields are set once the digits fall in a single range.
+ */
+struct BinInfo {
+    CardBrand brand = CardBrand::Unknown;
+    NetworkType network = NetworkType::Unknown;
+    std::uint8_t flags = 0;
+    std::uint8_t minPanLength = 0;
+    std::uint8_t maxPanLength = 0;
+    /*! The digits fall in a single range */
+    bool matched = false;
+
+    bool isDebit() const { return network == NetworkType::Debit; }
+};
+
+/*!
+ * @typedef PanCheck
+ * @constant Valid Length fits the range and the check digit is right
+ * @constant Incomplete Fewer digits than the range's shortest PAN, or too few to pick a range
+ * @constant TooLong More digits than the range's longest PAN
+ * @constant BadCheckDigit The Luhn check digit is wrong
+ * @constant UnknownBin No range holds the PAN, or it has non-digit characters
+ */
+enum class PanCheck : std::uint8_t {
+    Valid,
+    Incomplete,
+    TooLong,
+    BadCheckDigit,
+    UnknownBin
+};
+
+/*!
+ * @brief Ranges to remove and add, taking a table from one version to the next
+ * @discussion Removals apply first. Each added range replaces whatever it overlaps.
+ */
+struct BinDelta {
+    std::uint32_t fromVersion = 0;
+    std::uint32_t toVersion = 0;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> removals;
+    std::vector<BinRange> ranges;
+};
+
+/*!
+ * @brief Delta in its wire layout
+ */
+std::vector<std::uint8_t> encodeBinDelta(const BinDelta &delta);
+
+/*!
+ * @return ErrorCode::InvalidArgument if data is truncated, corrupt or has an inverted range
+ */
+ErrorCode decodeBinDelta(const std::uint8_t *data, std::size_t size, BinDelta &delta);
+
+/*!
+ * @brief Memory-mapped BIN table; lookups are thread-safe and take no lock
+ */
+class BinTable {
+public:
+    /*!
+     * @brief Write a table of ranges to path, replacing it atomically
+     * @discussion Where ranges overlap the narrower one wins; between equally wide ones, the later.
+     * @return ErrorCode::InvalidArgument for a range with low above high or past eight digits
+     */
+    static ErrorCode write(const std::string &path, const std::vector<BinRange> &ranges, std::uint32_t version);
+
+    /*!
+     * @brief Map the table at path
+     * @return ErrorCode::NotFound if there is none, ErrorCode::InvalidArgument if it fails its checks
+     */
+    static ErrorCode open(const std::string &path, std::unique_ptr<BinTable> &table);
+
+    BinTable(const BinTable &) = delete;
+    BinTable &operator=(const BinTable &) = delete;
+
+    /*!
+     * @brief Classify a card from its first count digits
+     * @discussion Digits past the eighth are ignored. Anything but ASCII digits gives an empty BinInfo.
+     */
+    BinInfo classify(const char *digits, std::size_t count) const;
+
+    /*!
+     * @brief Check a whole keyed or swiped PAN against its range
+     */
+    PanCheck checkPan(const char *digits, std::size_t count) const;
+
+    /*!
+     * @brief Apply a delta and rewrite the file
+     * @return ErrorCode::InvalidArgument if the delta is not from version()
+     */
+    ErrorCode applyDelta(const BinDelta &delta);
+
+    std::uint32_t version() const;
+    std::size_t rangeCount() const;
+
+    /*!
+     * @brief Every range, sorted and disjoint
+     */
+    std::vector<BinRange> ranges() const;
+
+private:
+    struct Image;
+
+    BinTable(std::string path, std::shared_ptr<const Image> image);
+
+    std::shared_ptr<const Image> snapshot() const;
+
+    const std::string _path;
+    // Replaced whole under _writeLock and read with atomic loads.
+    std::shared_ptr<const Image> _image;
+    std::mutex _writeLock;
+};
+
+} // namespace cft
@@ -0,0 +1,54 @@
+/*!
+ * @header Bytes.hpp
+ *
+ * @brief Little-endian integer encoding used by every on-disk and wire format in the core.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The core's binary formats assume a little-endian host"
+#endif
+
+namespace cft {
+
+/*!
+ * @brief Borrowed view of bytes inside a buffer; valid while the buffer's storage is
+ */
+struct ByteRange {
+    const std::uint8_t *data = nullptr;
+    std::size_t size = 0;
+};
+
+template <typename T>
+inline T loadLittleEndian(const std::uint8_t *bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+template <typename T>
+inline void storeLittleEndian(std::uint8_t *bytes, T value) {
+    std::memcpy(bytes, &value, sizeof(T));
+}
+
+template <typename T>
+inline void appendLittleEndian(std::vector<std::uint8_t> &buffer, T value) {
+    const std::size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    storeLittleEndian(buffer.data() + offset, value);
+}
+
+inline void appendBytes(std::vector<std::uint8_t> &buffer, const void *data, std::size_t size) {
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+} // namespace cft
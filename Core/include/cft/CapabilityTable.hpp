@@ -0,0 +1,96 @@
+/*!
+ * @header CapabilityTable.hpp
+ *
+ * @brief Capability bitmasks and a table of learned transaction capabilities.
+ * The SDK answers capability queries asynchronously with an array of enum values. What a
+ * transaction can do depends on more than its type and input method (its batch, merchant
+ * account and processor among them), so the table keeps one answer per transaction, learned
+ * once from the SDK. The answer is tied to the API state it was given in: after a void or a
+ * settlement the transaction is asked about again. Lookups are a hash probe under a short
+ * lock, safe from any thread.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef CapabilityMask
+ * @brief Bit n is set when capability n of the matching enum is present
+ */
+using CapabilityMask = std::uint32_t;
+
+template <typename Capability>
+constexpr CapabilityMask capabilityBit(Capability capability) {
+    return CapabilityMask(1) << static_cast<std::uint32_t>(capability);
+}
+
+template <typename Capability>
+constexpr bool hasCapability(CapabilityMask mask, Capability capability) {
+    return (mask & capabilityBit(capability)) != 0;
+}
+
+/*!
+ * @brief Which answer a transaction's capabilities are looked up by
+ */
+struct TransactionCapabilityKey {
+    std::string transactionId;
+    ApiTransactionState state = ApiTransactionState::Unknown;
+};
+
+class TransactionCapabilityTable {
+public:
+    TransactionCapabilityTable() = default;
+
+    TransactionCapabilityTable(const TransactionCapabilityTable &) = delete;
+    TransactionCapabilityTable &operator=(const TransactionCapabilityTable &) = delete;
+
+    /*!
+     * @brief Capabilities of the transaction in key
+     * @return bool - false if they have not been learned yet, or were learned in another
+     * state; mask is then untouched
+     */
+    bool lookup(const TransactionCapabilityKey &key, CapabilityMask &mask) const;
+
+    /*!
+     * @brief Record the capabilities of the transaction in key, replacing any for another state
+     * @return bool - true if this changed what lookup() reports; false for an empty transactionId
+     */
+    bool store(const TransactionCapabilityKey &key, CapabilityMask mask);
+
+    /*!
+     * @brief Forget everything, e.g. when the merchant account changes
+     * @return std::size_t - Number of transactions that had been learned
+     */
+    std::size_t clear();
+
+    std::size_t learnedCount() const;
+
+    /*!
+     * @brief Incremented by every store() or clear() that changed the table
+     */
+    std::uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+private:
+    struct Answer {
+        ApiTransactionState state = ApiTransactionState::Unknown;
+        CapabilityMask mask = 0;
+    };
+
+    mutable std::mutex _lock;
+    std::unordered_map<std::string, Answer> _answers;
+    std::atomic<std::uint64_t> _generation{0};
+};
+
+} // namespace cft
@@ -0,0 +1,119 @@
+/*!
+ * @header CardValidation.hpp
+ *
+ * @brief Checks on card data as it is keyed or swiped: the Luhn check digit, keyed expiry and
+ * CVV, and ISO 7813 track 1 and track 2 parsing with sentinel and LRC verification.
+ *
+ * The work on each byte runs sixteen bytes at a time with SSE2 on x86-64 and NEON on arm64,
+ * and one byte at a time elsewhere. Both paths give the same answers; ValidationPath::Scalar
+ * forces the byte-at-a-time one, to compare against.
+ *
+ * Nothing here allocates. Parsed track fields are offsets into the caller's buffer.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef ValidationPath
+ * @constant Vector SIMD where the build has it, otherwise the same as Scalar
+ * @constant Scalar One byte at a time
+ */
+enum class ValidationPath : std::uint8_t {
+    Vector,
+    Scalar
+};
+
+/*!
+ * @brief What ValidationPath::Vector runs in this build: "sse2", "neon" or "scalar"
+ */
+const char *vectorValidationKernel();
+
+/*!
+ * @brief Luhn check over count ASCII digits; false if any is not a digit or count is 0
+ */
+bool luhnValid(const char *digits, std::size_t count, ValidationPath path = ValidationPath::Vector);
+
+/*!
+ * @brief Keyed PAN: 12 to 19 ASCII digits passing the Luhn check
+ */
+bool panValid(const char *digits, std::size_t count);
+
+/*!
+ * @brief Keyed expiry as "MMYY" or "MM/YY", valid through the end of its month
+ * @param year unsigned - Current year, four digits; YY is taken in its century
+ * @param month unsigned - Current month, 1 to 12
+ */
+bool keyedExpiryValid(const char *text, std::size_t count, unsigned year, unsigned month);
+
+/*!
+ * @brief CVV of the right length for the brand: four digits for American Express, three for
+ * the others, either when the brand is unknown
+ */
+bool cvvValid(const char *digits, std::size_t count, CardBrand brand);
+
+/*! @brief Longest track 1 from start to end sentinel */
+constexpr std::size_t kTrack1MaxLength = 79;
+/*! @brief Longest track 2 from start to end sentinel */
+constexpr std::size_t kTrack2MaxLength = 40;
+
+/*!
+ * @brief Where a field sits in the track it was parsed from
+ */
+struct TrackField {
+    std::uint8_t offset = 0;
+    std::uint8_t length = 0;
+};
+
+/*!
+ * @brief Fields of a parsed track
+ * @discussion name is empty for track 2. expiry is YYMM as the track carries it.
+ */
+struct TrackData {
+    /*! 1 or 2 */
+    std::uint8_t format = 0;
+    TrackField pan;
+    TrackField name;
+    TrackField expiry;
+    TrackField serviceCode;
+    TrackField discretionary;
+    /*! The track ended with an LRC character after the end sentinel, and it matched */
+    bool hasLrc = false;
+};
+
+/*!
+ * @typedef TrackCheck
+ * @constant Valid Parsed, and the PAN passes the Luhn check
+ * @constant BadSentinel No start sentinel ('%' or ';'), or no end sentinel '?'
+ * @constant BadCharacter A character outside the track's character set, or more than one after '?'
+ * @constant BadLrc The character after '?' is not the LRC of the track
+ * @constant BadFormat Separators, field lengths or digits are not those of the format
+ * @constant BadCheckDigit The PAN fails the Luhn check
+ */
+enum class TrackCheck : std::uint8_t {
+    Valid,
+    BadSentinel,
+    BadCharacter,
+    BadLrc,
+    BadFormat,
+    BadCheckDigit
+};
+
+/*!
+ * @brief Parse a track 1 ("%B...^NAME^YYMMSSS...?") or track 2 (";...=YYMMSSS...?") as read
+ * @discussion The format is chosen by the start sentinel. The LRC after the end sentinel is
+ * optional, since many readers strip it; when present it must match. track is only filled
+ * when the result is TrackCheck::Valid.
+ */
+TrackCheck parseTrack(const char *data, std::size_t size, TrackData &track,
+                      ValidationPath path = ValidationPath::Vector);
+
+} // namespace cft
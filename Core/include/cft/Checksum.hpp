@@ -0,0 +1,23 @@
+/*!
+ * @header Checksum.hpp
+ *
+ * @brief CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320) used to detect torn or
+ * corrupted records in on-disk stores.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cft {
+
+/*!
+ * @brief CRC-32 of size bytes at data
+ * @param seed std::uint32_t - Result of a previous call to continue a running checksum, 0 to start
+ */
+std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t seed = 0);
+
+} // namespace cft
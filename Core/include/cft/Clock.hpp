@@ -0,0 +1,33 @@
+/*!
+ * @header Clock.hpp
+ *
+ * @brief Monotonic time source used by the core.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef ClockFunction
+ * @brief Source of monotonic nanoseconds. Components that timestamp take one of these
+ * so that the harness can substitute a virtual clock.
+ */
+using ClockFunction = Nanos (*)();
+
+/*!
+ * @brief Current monotonic time in nanoseconds
+ * @discussion Backed by std::chrono::steady_clock, so it never jumps when the wall clock changes.
+ */
+inline Nanos monotonicNanos() {
+    return static_cast<Nanos>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace cft
@@ -0,0 +1,34 @@
+/*!
+ * @header Compression.hpp
+ *
+ * @brief Small LZ77 block codec for compressing sections of stored records.
+ * The stream is a series of sequences, each a token byte (high nibble literal count,
+ * low nibble match length - 4, 15 meaning "more length bytes follow"), the literals,
+ * then a u16 little-endian back-reference offset. The final sequence carries only literals.
+ * It trades ratio for speed and needs no external library on either platform.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+/*!
+ * @brief Append the compressed form of size bytes at data to out
+ */
+void compressBlock(const std::uint8_t *data, std::size_t size, std::vector<std::uint8_t> &out);
+
+/*!
+ * @brief Decompress a block into exactly decompressedSize bytes at out
+ * @return ErrorCode::InvalidArgument when the block is malformed or does not decode to decompressedSize bytes
+ */
+ErrorCode decompressBlock(const std::uint8_t *data, std::size_t size, std::uint8_t *out, std::size_t decompressedSize);
+
+} // namespace cft
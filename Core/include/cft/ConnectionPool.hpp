@@ -0,0 +1,184 @@
+/*!
+ * @header ConnectionPool.hpp
+ *
+ * @brief Bookkeeping for connections to the gateway hosts, shared by every gateway call.
+ * Like RefreshingCache the pool owns no sockets or threads. Callers ask it for a connection
+ * before a request and hand the connection back afterwards; when none can be reused they
+ * connect themselves and register the result. Handles are opaque to the pool.
+ *
+ * A connection carries up to streamsPerConnection requests at once: 1 for HTTP/1.1, the
+ * peer's concurrent stream limit for HTTP/2. Idle connections are kept for idleTimeout.
+ * While a host is warm, that is it served a request within warmWindow, maintain() asks
+ * for a keep-alive on connections idle for keepAliveInterval, and asks for a new connection
+ * when the host has none left, for example after networkChanged() dropped them.
+ * A TLS session is resumable for sessionLifetime after the host's last handshake.
+ *
+ * Times are monotonic nanoseconds passed in by the caller. Not thread-safe.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+struct ConnectionPoolConfig {
+    std::size_t streamsPerConnection = 1;
+    std::size_t maxIdlePerHost = 4;
+    // Below the gateway load balancer's own idle limit, so the pool closes first.
+    Nanos idleTimeout = 90LL * 1000000000;
+    Nanos keepAliveInterval = 30LL * 1000000000;
+    // Terminals usually see the next customer within minutes; past that, stop spending radio time.
+    Nanos warmWindow = 15LL * 60 * 1000000000;
+    Nanos sessionLifetime = 60LL * 60 * 1000000000;
+};
+
+struct ConnectionStats {
+    std::uint64_t requests = 0;
+    std::uint64_t reusedRequests = 0;
+    std::uint64_t handshakes = 0;
+    std::uint64_t resumedHandshakes = 0;
+    Nanos handshakeNanos = 0;
+    std::uint64_t keepAlives = 0;
+    std::uint64_t closedIdle = 0;
+    // Connections maintain() asked for ahead of a request.
+    std::uint64_t reconnects = 0;
+
+    double reuseRate() const {
+        return requests == 0 ? 0.0 : static_cast<double>(reusedRequests) / static_cast<double>(requests);
+    }
+
+    Nanos meanHandshake() const { return handshakes == 0 ? 0 : handshakeNanos / static_cast<Nanos>(handshakes); }
+
+    void merge(const ConnectionStats &other);
+};
+
+/*!
+ * @typedef PoolAction
+ * @constant Close Close handle; the pool has forgotten it
+ * @constant KeepAlive Send a keep-alive on handle, then release() it
+ * @constant Connect Connect to host ahead of its next request, then connected() and release() it
+ */
+enum class PoolAction : std::uint8_t {
+    Close,
+    KeepAlive,
+    Connect
+};
+
+/*!
+ * @typedef PoolRelease
+ * @constant Kept The pool still has the connection. One the pool dropped stays until its last stream
+ * is released, and is not handed out again.
+ * @constant Close Close the connection; the pool has forgotten it and none of its streams is in use
+ * @constant Unknown The pool no longer knew the connection, for example after closeAll(); leave it be
+ */
+enum class PoolRelease : std::uint8_t {
+    Kept,
+    Close,
+    Unknown
+};
+
+struct PoolTask {
+    PoolAction action;
+    std::size_t host;
+    int handle;
+};
+
+class ConnectionPool {
+public:
+    explicit ConnectionPool(const ConnectionPoolConfig &config = ConnectionPoolConfig());
+
+    /*!
+     * @return std::size_t - Index to pass as host from now on
+     */
+    std::size_t addHost();
+
+    std::size_t hostCount() const { return _hosts.size(); }
+
+    /*!
+     * @brief A connection to host with a free stream, which the request now occupies
+     * @return int - The connection's handle, -1 when the caller has to connect
+     */
+    int acquire(std::size_t host, Nanos now);
+
+    /*!
+     * @brief Whether a new connection to host can resume the last TLS session
+     */
+    bool canResume(std::size_t host, Nanos now) const;
+
+    /*!
+     * @brief Register a connection the caller opened. One stream is taken by the caller.
+     */
+    void connected(std::size_t host, int handle, Nanos now);
+
+    /*!
+     * @brief Return the stream taken by acquire() or connected()
+     * @param reusable bool - NO when the peer closed the connection or the request failed on it
+     */
+    PoolRelease release(std::size_t host, int handle, bool reusable, Nanos now);
+
+    void recordRequest(std::size_t host, bool reused);
+    void recordHandshake(std::size_t host, Nanos duration, bool resumed, Nanos now);
+
+    /*!
+     * @brief Keep-alives, closes and reconnects due at now
+     * @discussion Appends to tasks. Connections handed out for a keep-alive count as in use.
+     */
+    void maintain(Nanos now, std::vector<PoolTask> &tasks);
+
+    /*!
+     * @brief Connections opened so far are no longer usable, for example after a switch from Wi-Fi to cellular
+     * @discussion Idle ones are closed by the next maintain(), which also reconnects warm hosts;
+     * busy ones are dropped when their last stream is released. TLS sessions stay resumable.
+     */
+    void networkChanged();
+
+    /*!
+     * @brief Forget every connection, appending a Close task for each
+     */
+    void closeAll(std::vector<PoolTask> &tasks);
+
+    /*!
+     * @brief Whether any host served a request within warmWindow
+     */
+    bool isWarm(Nanos now) const;
+
+    std::size_t connectionCount(std::size_t host) const { return _hosts[host].connections.size(); }
+    const ConnectionStats &stats(std::size_t host) const { return _hosts[host].stats; }
+    ConnectionStats totals() const;
+
+private:
+    struct Connection {
+        int handle;
+        std::uint32_t generation;
+        std::size_t streams;
+        Nanos lastUsed;
+        // Cleared when a request failed on it; the pool forgets it once its last stream is released.
+        bool reusable;
+    };
+
+    struct Host {
+        std::vector<Connection> connections;
+        ConnectionStats stats;
+        Nanos lastRequest = 0;
+        Nanos lastHandshake = 0;
+        Nanos connectRequestedAt = 0;
+        bool connectRequested = false;
+        bool served = false;
+        bool hasSession = false;
+    };
+
+    bool isWarm(const Host &host, Nanos now) const;
+
+    ConnectionPoolConfig _config;
+    std::vector<Host> _hosts;
+    std::uint32_t _generation = 0;
+};
+
+} // namespace cft
@@ -0,0 +1,188 @@
+/*!
+ * @header DeferredQueue.hpp
+ *
+ * @brief Crash-safe, append-only store-and-forward queue for deferred transaction data.
+ *
+ * Every mutation is appended to a journal as a checksummed record and synced before the
+ * call returns, so an entry acknowledged by enqueue() survives a crash or power loss.
+ * On open the journal is replayed; a torn record at the tail (a write interrupted by a
+ * crash) is truncated away. A file whose header is not a journal of this version is refused
+ * and left untouched, so a downgrade never discards entries it cannot read. The journal is rewritten without dead records once they make
+ * up most of the file.
+ *
+ * Journal layout, little-endian:
+ *   file header   "CFTDQ" u8 version u16 reserved
+ *   record        u32 bodyLength, u32 crc32(body), body
+ *   body          u8 kind, u64 entryId, kind-specific fields
+ *     Enqueue     u64 enqueuedAtMillis, payload bytes
+ *     Attempt     u32 attempts, i64 nextAttemptAtMillis
+ *     Remove      -
+ *     DeadLetter  u32 attempts
+ *     Claim       -
+ *
+ * Claims are journaled too. An entry that was being forwarded when the process died may or
+ * may not have reached the gateway, so after the next open it is Interrupted rather than
+ * ready: the owner decides whether sending it again is safe, through release() or fail().
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/File.hpp"
+
+namespace cft {
+
+struct DeferredQueueConfig {
+    /*! Maximum number of live entries, pending or dead-lettered. */
+    std::size_t maxEntries = 2000;
+    /*! Maximum total payload bytes of live entries. */
+    std::size_t maxBytes = 64 * 1024 * 1024;
+    /*! Failed attempts after which an entry is dead-lettered instead of retried. */
+    std::uint32_t maxAttempts = 8;
+    /*! Delay before the first retry; doubles per attempt up to maxRetryDelayMillis. */
+    std::int64_t baseRetryDelayMillis = 2000;
+    std::int64_t maxRetryDelayMillis = 5 * 60 * 1000;
+    /*! Sync every append. Only disable for benchmarks. */
+    bool syncOnWrite = true;
+};
+
+/*!
+ * @typedef DeferredEntryStatus
+ * @constant Pending Waiting to be claimed, possibly not before nextAttemptAtMillis
+ * @constant InFlight Claimed by a drainer and not yet completed or failed
+ * @constant DeadLettered Exceeded maxAttempts or failed permanently, kept until removed
+ * @constant Interrupted Claimed when the process stopped; never claimed again until released
+ */
+enum class DeferredEntryStatus : std::uint8_t {
+    Pending = 0,
+    InFlight = 1,
+    DeadLettered = 2,
+    Interrupted = 3
+};
+
+struct DeferredEntryInfo {
+    std::uint64_t entryId = 0;
+    DeferredEntryStatus status = DeferredEntryStatus::Pending;
+    std::uint32_t attempts = 0;
+    std::int64_t enqueuedAtMillis = 0;
+    std::int64_t nextAttemptAtMillis = 0;
+    std::size_t size = 0;
+};
+
+class DeferredQueue {
+public:
+    /*!
+     * @brief Open or create the queue journal at path
+     * @return ErrorCode::InvalidArgument if the file is not a journal of this version
+     */
+    static ErrorCode open(const std::string &path, const DeferredQueueConfig &config,
+                          std::unique_ptr<DeferredQueue> &queue);
+
+    /*!
+     * @brief Durably append deferred transaction data
+     * @return ErrorCode::CapacityExceeded when the entry or byte limit would be exceeded
+     */
+    ErrorCode enqueue(const std::uint8_t *data, std::size_t size, std::int64_t nowMillis, std::uint64_t &entryId);
+
+    /*!
+     * @brief Claim up to limit pending entries whose retry time has passed, oldest first
+     * @discussion Each claim is journaled before the entry is returned.
+     * @param held std::set<std::uint64_t> - Entries to leave pending this time
+     */
+    std::vector<std::uint64_t> claimReady(std::int64_t nowMillis, std::size_t limit,
+                                          const std::set<std::uint64_t> &held = std::set<std::uint64_t>());
+
+    /*!
+     * @brief Copy the payload of an entry
+     */
+    ErrorCode payload(std::uint64_t entryId, std::vector<std::uint8_t> &data) const;
+
+    /*!
+     * @brief The claimed entry was forwarded; remove it
+     */
+    ErrorCode complete(std::uint64_t entryId);
+
+    /*!
+     * @brief The claimed entry could not be forwarded
+     * @param retryable bool - NO dead-letters the entry immediately
+     * @return ErrorCode::None, with willRetry telling whether the entry was rescheduled or dead-lettered
+     */
+    ErrorCode fail(std::uint64_t entryId, bool retryable, std::int64_t nowMillis, bool &willRetry);
+
+    /*!
+     * @brief Return a claimed or interrupted entry to pending without counting an attempt, e.g.
+     * when connectivity drops
+     */
+    ErrorCode release(std::uint64_t entryId);
+
+    /*!
+     * @brief Make every pending entry ready at nowMillis, e.g. when the user asks to retry now
+     * @discussion Attempts are unchanged, and an entry that fails again backs off as usual. The
+     * earlier retry time comes back after a restart unless the journal is compacted first.
+     * @return std::size_t - Entries made ready
+     */
+    std::size_t expedite(std::int64_t nowMillis);
+
+    /*!
+     * @brief Permanently drop an entry in any state
+     */
+    ErrorCode remove(std::uint64_t entryId);
+
+    /*!
+     * @brief Rewrite the journal with only live entries
+     */
+    ErrorCode compact();
+
+    std::vector<DeferredEntryInfo> entries() const;
+    std::size_t count() const;
+    std::size_t pendingCount() const;
+    std::size_t bytes() const;
+
+    /*!
+     * @brief Earliest nextAttemptAtMillis among pending entries not in held, or -1 when there are none
+     */
+    std::int64_t nextAttemptAtMillis(const std::set<std::uint64_t> &held = std::set<std::uint64_t>()) const;
+
+    /*!
+     * @brief Whether another entry of size bytes would be accepted right now
+     */
+    bool canAccept(std::size_t size) const;
+
+private:
+    struct Entry {
+        DeferredEntryInfo info;
+        std::vector<std::uint8_t> data;
+    };
+
+    DeferredQueue(std::string path, const DeferredQueueConfig &config);
+
+    ErrorCode load();
+    ErrorCode appendRecord(const std::vector<std::uint8_t> &body);
+    ErrorCode compactLocked();
+    ErrorCode removeLocked(std::uint64_t entryId);
+    bool canAcceptLocked(std::size_t size) const;
+    std::int64_t retryDelayMillis(std::uint32_t attempts) const;
+
+    const std::string _path;
+    const DeferredQueueConfig _config;
+
+    mutable std::mutex _lock;
+    File _journal;
+    std::map<std::uint64_t, Entry> _entries;
+    std::uint64_t _nextEntryId = 1;
+    std::size_t _bytes = 0;
+    std::uint64_t _journalBytes = 0;
+};
+
+} // namespace cft
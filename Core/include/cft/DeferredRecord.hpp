@@ -0,0 +1,139 @@
+/*!
+ * @header DeferredRecord.hpp
+ *
+ * @brief Compact, versioned binary encoding of a deferred transaction.
+ * A record is self-describing and can be read in place: a fixed header, a directory of
+ * fields sorted by tag, then the field bytes. Readers skip tags they do not know, so new
+ * fields do not need a version change; the version only changes when this layout does.
+ *
+ * Layout, little-endian:
+ *   header     "CFDR" u8 version u8 reserved u16 fieldCount u32 totalLength u32 crc32(bytes 16..totalLength)
+ *   directory  fieldCount x { u16 tag, u16 flags, u32 offset, u32 length }, tags strictly ascending
+ *   data       field bytes at offset from the start of the record
+ *
+ * A field with DeferredFieldFlagCompressed stores u32 decompressedLength followed by a
+ * compressBlock() stream.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cft/Bytes.hpp"
+#include "cft/Error.hpp"
+
+namespace cft {
+
+constexpr std::uint8_t kDeferredRecordVersion = 1;
+constexpr std::size_t kDeferredRecordHeaderSize = 16;
+constexpr std::size_t kDeferredRecordDirectoryEntrySize = 12;
+
+/*!
+ * @typedef DeferredField
+ * @brief Field tags. Values are persisted and must never be reused.
+ * @constant SdkPayload Opaque data from transaction:didDeferWithData:, needed to resume
+ * @constant AmountMinor i64 amount in minor currency units
+ * @constant CreatedAtMillis i64 wall-clock time the transaction was deferred
+ * @constant CardInputMethod u8 CardInputMethod
+ * @constant CardBrand u8 CardBrand
+ * @constant LastFour ASCII last four digits of the PAN
+ * @constant EmvTlv BER-TLV encoded EMV data of the card read
+ */
+enum class DeferredField : std::uint16_t {
+    SdkPayload = 1,
+    AmountMinor = 2,
+    CreatedAtMillis = 3,
+    CardInputMethod = 4,
+    CardBrand = 5,
+    LastFour = 6,
+    EmvTlv = 7
+};
+
+constexpr std::uint16_t DeferredFieldFlagCompressed = 1u << 0;
+
+class DeferredRecordWriter {
+public:
+    void addInteger(DeferredField field, std::int64_t value);
+    void addByte(DeferredField field, std::uint8_t value);
+
+    /*!
+     * @brief Add a byte field
+     * @param compress bool - Store compressed when that is smaller
+     */
+    void addBytes(DeferredField field, const std::uint8_t *data, std::size_t size, bool compress = false);
+
+    /*!
+     * @brief Encode the fields added so far
+     * @return ErrorCode::InvalidArgument when a field was added twice
+     */
+    ErrorCode finish(std::vector<std::uint8_t> &record) const;
+
+private:
+    struct Field {
+        DeferredField tag;
+        std::uint16_t flags;
+        std::vector<std::uint8_t> bytes;
+    };
+
+    std::vector<Field> _fields;
+};
+
+/*!
+ * Zero-copy reader over an encoded record. open() checks the structure in time
+ * proportional to the number of fields without touching field data; verifyChecksum()
+ * additionally checks every byte.
+ */
+class DeferredRecordView {
+public:
+    /*!
+     * @brief Check the header and directory and bind the view to data
+     * @return ErrorCode::InvalidArgument when data is not a well-formed record of a known version
+     */
+    static ErrorCode open(const std::uint8_t *data, std::size_t size, DeferredRecordView &view);
+
+    /*!
+     * @brief Whether data starts with the record magic, without any further checks
+     */
+    static bool hasMagic(const std::uint8_t *data, std::size_t size);
+
+    bool verifyChecksum() const;
+
+    std::uint8_t version() const;
+    std::size_t size() const { return _size; }
+    std::size_t fieldCount() const { return _fieldCount; }
+
+    bool has(DeferredField field) const;
+    bool isCompressed(DeferredField field) const;
+
+    /*!
+     * @brief Stored bytes of a field, compressed or not
+     */
+    bool raw(DeferredField field, ByteRange &range) const;
+
+    bool integer(DeferredField field, std::int64_t &value) const;
+    bool byte(DeferredField field, std::uint8_t &value) const;
+
+    /*!
+     * @brief Bytes of an uncompressed field without copying
+     * @return false when the field is missing or compressed
+     */
+    bool bytes(DeferredField field, ByteRange &range) const;
+
+    /*!
+     * @brief Copy a field's bytes, decompressing if needed
+     */
+    ErrorCode copyBytes(DeferredField field, std::vector<std::uint8_t> &out) const;
+
+private:
+    bool find(DeferredField field, std::uint16_t &flags, ByteRange &range) const;
+
+    const std::uint8_t *_data = nullptr;
+    std::size_t _size = 0;
+    std::size_t _fieldCount = 0;
+};
+
+} // namespace cft
@@ -0,0 +1,47 @@
+/*!
+ * @header Error.hpp
+ *
+ * @brief Error codes returned by the portable core.
+ * The core does not throw; every fallible operation returns an ErrorCode and
+ * the Objective-C shim converts non-zero codes into NSErrors in CFTCoreErrorDomain.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace cft {
+
+/*!
+ * @typedef ErrorCode
+ * @brief Result of a core operation
+ * @constant None Operation succeeded
+ * @constant IllegalTransition The requested event is not valid from the current transaction state
+ * @constant InvalidArgument An argument was out of range or malformed
+ * @constant Declined The gateway declined or failed the request
+ * @constant InteractionRequired The request needs cardholder or merchant interaction an unattended operation cannot provide
+ * @constant CapacityExceeded A bounded store or queue is full
+ * @constant NotFound No entry exists for the given identifier
+ * @constant IOFailure A file could not be read, written or synced
+ * @constant External An error reported by the SDK or the system rather than by the core
+ */
+enum class ErrorCode : std::int32_t {
+    None = 0,
+    IllegalTransition = 1,
+    InvalidArgument = 2,
+    Declined = 3,
+    InteractionRequired = 4,
+    CapacityExceeded = 5,
+    NotFound = 6,
+    IOFailure = 7,
+    External = 8
+};
+
+/*!
+ * @brief Printable name of an error code
+ */
+const char *errorCodeName(ErrorCode code);
+
+} // namespace cft
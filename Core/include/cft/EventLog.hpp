@@ -0,0 +1,205 @@
+/*!
+ * @header EventLog.hpp
+ *
+ * @brief Always-on structured event log with a lock-free write path.
+ * Each thread that logs gets its own single-producer ring of fixed-size binary records, so
+ * logging is a level check, a sampling check and one record copy: no formatting, no locks
+ * and no allocation after the thread's first record. A full ring drops the record and
+ * counts the drop rather than blocking the caller.
+ *
+ * Like RefreshingCache the log owns no threads: a drainer calls drain() periodically and
+ * formats or ships what it gets. The rings are bounded by memoryLimitBytes; threads beyond
+ * what fits have their records dropped and counted.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef LogLevel
+ * @brief Severity of a record; records below the log's minimum level are discarded on the calling thread
+ */
+enum class LogLevel : std::uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+constexpr std::size_t kLogLevelCount = 4;
+
+/*!
+ * @typedef LogSubsystem
+ * @brief Component a record came from
+ */
+enum class LogSubsystem : std::uint8_t {
+    Session,
+    Transaction,
+    Reader,
+    Gateway,
+    DeferredQueue,
+    RecordStore,
+    AccountCache
+};
+
+constexpr std::size_t kLogSubsystemCount = 7;
+
+/*!
+ * @brief One event, 40 bytes. Fields that do not apply stay zero, which is each enum's Unknown or None.
+ */
+struct LogRecord {
+    Nanos timestamp = 0;
+    // Caller-chosen correlation id, e.g. a transaction's sequence number.
+    std::uint64_t transactionId = 0;
+    // Ring the record was written to; stable for a thread's lifetime.
+    std::uint32_t thread = 0;
+    TransactionState state = TransactionState::Unknown;
+    CardReaderEvent readerEvent = CardReaderEvent::Unknown;
+    ErrorCode error = ErrorCode::None;
+    // Free-form number such as a duration in microseconds or an HTTP status.
+    std::int32_t detail = 0;
+    LogLevel level = LogLevel::Info;
+    LogSubsystem subsystem = LogSubsystem::Session;
+};
+
+static_assert(std::is_trivially_copyable<LogRecord>::value, "LogRecord is copied as bytes");
+static_assert(sizeof(LogRecord) == 40, "LogRecord is part of the shipped binary format");
+
+struct EventLogConfig {
+    // Per thread, rounded up to a power of two.
+    std::size_t recordsPerThread = 1024;
+    // Rings are allocated on first use until the next one would pass this; the first is always allowed.
+    std::size_t memoryLimitBytes = 256 * 1024;
+    LogLevel minimumLevel = LogLevel::Info;
+};
+
+struct EventLogStats {
+    std::uint64_t written = 0;
+    std::uint64_t drained = 0;
+    // Lost to a full ring or to the memory limit.
+    std::uint64_t dropped = 0;
+    // Skipped by sampling; not counted as dropped.
+    std::uint64_t sampledOut = 0;
+    std::size_t threads = 0;
+    std::size_t memoryBytes = 0;
+};
+
+class EventLog {
+public:
+    /*!
+     * @brief Receives drained records, oldest first across every thread drained in the call
+     * @discussion records is only valid for the duration of the call.
+     */
+    using SinkFunction = std::function<void(const LogRecord *records, std::size_t count)>;
+
+    explicit EventLog(EventLogConfig config = EventLogConfig());
+    ~EventLog();
+
+    EventLog(const EventLog &) = delete;
+    EventLog &operator=(const EventLog &) = delete;
+
+    /*!
+     * @brief Cheap enough to guard building a record
+     */
+    bool isEnabled(LogLevel level) const {
+        return level >= _minimumLevel.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief Append a record from the calling thread
+     * @discussion Fills in thread, and timestamp when it is zero. Never blocks.
+     * @return bool - false if the record was filtered, sampled out or dropped
+     */
+    bool write(LogRecord record);
+
+    bool write(LogLevel level, LogSubsystem subsystem, std::uint64_t transactionId, TransactionState state,
+               ErrorCode error = ErrorCode::None, std::int32_t detail = 0);
+
+    bool write(LogLevel level, LogSubsystem subsystem, CardReaderEvent readerEvent,
+               ErrorCode error = ErrorCode::None, std::int32_t detail = 0);
+
+    void setMinimumLevel(LogLevel level) { _minimumLevel.store(level, std::memory_order_relaxed); }
+    LogLevel minimumLevel() const { return _minimumLevel.load(std::memory_order_relaxed); }
+
+    /*!
+     * @brief Keep one in every `every` records of level; 0 and 1 keep all
+     * @discussion Counted per thread, so the kept records of each thread are evenly spaced.
+     */
+    void setSampleRate(LogLevel level, std::uint32_t every);
+
+    /*!
+     * @brief Move up to maxRecords records out of the rings and hand them to sink
+     * @discussion Drains may run on any thread but are serialized with each other.
+     * @return std::size_t - Records delivered
+     */
+    std::size_t drain(const SinkFunction &sink, std::size_t maxRecords = SIZE_MAX);
+
+    EventLogStats stats() const;
+
+private:
+    struct Ring;
+    struct ThreadRings;
+
+    Ring *threadRing();
+    std::shared_ptr<Ring> claimRing();
+
+    const std::size_t _capacity;
+    const std::size_t _maxRings;
+    const std::uint64_t _id;
+    std::atomic<LogLevel> _minimumLevel;
+    std::array<std::atomic<std::uint32_t>, kLogLevelCount> _sampleEvery;
+
+    // Slots [0, _ringCount) are published; registration is serialized by _registerLock.
+    std::unique_ptr<std::shared_ptr<Ring>[]> _rings;
+    std::atomic<std::size_t> _ringCount{0};
+    std::mutex _registerLock;
+    std::atomic<std::uint64_t> _unattributedDrops{0};
+
+    std::mutex _drainLock;
+    std::vector<LogRecord> _scratch;
+    // Where a drain capped by maxRecords resumes, so no thread is starved.
+    std::size_t _nextRing = 0;
+    std::atomic<std::uint64_t> _drained{0};
+};
+
+/*!
+ * @brief Printable name of a level
+ */
+const char *logLevelName(LogLevel level);
+
+/*!
+ * @brief Printable name of a subsystem
+ */
+const char *logSubsystemName(LogSubsystem subsystem);
+
+/*!
+ * @brief Render a record as one line of text, without a trailing newline
+ * @param origin Nanos - Timestamps are printed as seconds since origin
+ * @return std::size_t - Characters written, truncated to size - 1 and always terminated
+ */
+std::size_t formatLogRecord(const LogRecord &record, Nanos origin, char *buffer, std::size_t size);
+
+/*!
+ * @brief Append a self-contained chunk in the shipped binary format
+ * @discussion "CFL" and a version byte, a u32 record count, then 40 little-endian bytes per
+ * record in LogRecord field order with the two padding bytes zeroed.
+ */
+void encodeLogRecords(const LogRecord *records, std::size_t count, std::vector<std::uint8_t> &buffer);
+
+} // namespace cft
@@ -0,0 +1,107 @@
+/*!
+ * @header File.hpp
+ *
+ * @brief Thin RAII wrappers over a POSIX file descriptor and a shared memory mapping for
+ * the core's on-disk stores.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+class File {
+public:
+    File() = default;
+    ~File();
+
+    File(File &&other) noexcept;
+    File &operator=(File &&other) noexcept;
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+
+    /*!
+     * @brief Open path for reading and appending, creating it if needed
+     */
+    static ErrorCode openForAppend(const std::string &path, File &file);
+
+    /*!
+     * @brief Open path for reading and writing at any offset, creating it if needed
+     */
+    static ErrorCode openForUpdate(const std::string &path, File &file);
+
+    /*!
+     * @brief Open an existing file read-only
+     * @return ErrorCode - NotFound if path does not exist
+     */
+    static ErrorCode openForRead(const std::string &path, File &file);
+
+    /*!
+     * @brief Create or truncate path, write data, sync, and atomically rename over destination
+     */
+    static ErrorCode replace(const std::string &destination, const std::uint8_t *data, std::size_t size);
+
+    bool isOpen() const { return _descriptor >= 0; }
+    int descriptor() const { return _descriptor; }
+
+    ErrorCode readAll(std::vector<std::uint8_t> &contents) const;
+    ErrorCode append(const std::uint8_t *data, std::size_t size);
+    ErrorCode truncate(std::uint64_t size);
+    ErrorCode sync();
+    ErrorCode size(std::uint64_t &size) const;
+    void close();
+
+private:
+    int _descriptor = -1;
+};
+
+/*!
+ * Shared mapping of the first size bytes of a file. Writes through a read-write mapping
+ * reach the file; sync() makes them durable.
+ */
+class MappedRegion {
+public:
+    MappedRegion() = default;
+    ~MappedRegion();
+
+    MappedRegion(MappedRegion &&other) noexcept;
+    MappedRegion &operator=(MappedRegion &&other) noexcept;
+    MappedRegion(const MappedRegion &) = delete;
+    MappedRegion &operator=(const MappedRegion &) = delete;
+
+    /*!
+     * @brief Map size bytes of file, which must already be at least that long
+     */
+    static ErrorCode map(const File &file, std::size_t size, MappedRegion &region);
+
+    /*!
+     * @brief Map size bytes of a file opened for reading; writing through data() faults
+     */
+    static ErrorCode mapReadOnly(const File &file, std::size_t size, MappedRegion &region);
+
+    std::uint8_t *data() const { return _data; }
+    std::size_t size() const { return _size; }
+
+    ErrorCode sync();
+
+    /*!
+     * @brief Sync only the pages covering length bytes at offset
+     */
+    ErrorCode sync(std::size_t offset, std::size_t length);
+
+    void unmap();
+
+private:
+    std::uint8_t *_data = nullptr;
+    std::size_t _size = 0;
+};
+
+} // namespace cft
@@ -0,0 +1,55 @@
+/*!
+ * @header LatencyHistogram.hpp
+ *
+ * @brief Fixed-size log-linear histogram of nanosecond durations.
+ * Each power of two is split into 16 linear sub-buckets, so any reported
+ * percentile is within 6.25% of the true value. Recording never allocates.
+ * Instances are not thread-safe; record per thread and merge.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+class LatencyHistogram {
+public:
+    static constexpr std::size_t kSubBucketBits = 4;
+    static constexpr std::size_t kSubBucketCount = std::size_t(1) << kSubBucketBits;
+    static constexpr std::size_t kBucketCount = kSubBucketCount + (64 - kSubBucketBits) * kSubBucketCount;
+
+    void record(Nanos value);
+    void merge(const LatencyHistogram &other);
+    void clear();
+
+    std::uint64_t count() const { return _count; }
+    Nanos min() const { return _count == 0 ? 0 : _min; }
+    Nanos max() const { return _max; }
+    Nanos mean() const { return _count == 0 ? 0 : static_cast<Nanos>(_sum / _count); }
+
+    /*!
+     * @brief Value at the given percentile
+     * @param percentile double - In the range [0, 100]
+     * @return Nanos - Upper bound of the bucket holding the percentile, clamped to max()
+     */
+    Nanos percentile(double percentile) const;
+
+private:
+    static std::size_t bucketIndex(Nanos value);
+    static Nanos bucketUpperBound(std::size_t index);
+
+    std::array<std::uint64_t, kBucketCount> _buckets{};
+    std::uint64_t _count = 0;
+    Nanos _min = ~Nanos(0);
+    Nanos _max = 0;
+    unsigned __int128 _sum = 0;
+};
+
+} // namespace cft
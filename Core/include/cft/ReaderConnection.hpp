@@ -0,0 +1,169 @@
+/*!
+ * @header ReaderConnection.hpp
+ *
+ * @brief Keeps one Bluetooth reader connected: heartbeats, reconnects and idle power-down.
+ * ReaderConnection decides what to do next; the caller does it and reports back what the reader
+ * did. Call poll() whenever something was reported or nextDeadlineMillis() passes, and carry out
+ * the action it returns:
+ *   Connect    select the remembered reader directly, without scanning for it
+ *   Heartbeat  check the reader is still there and call heartbeatAnswered()
+ *   Disconnect disconnect the reader
+ * A reader that drops is reconnected at once, then after delays that double from
+ * baseRetryDelayMillis up to maxRetryDelayMillis. A reader that stops answering heartbeats is
+ * treated as dropped, so a silent drop is found before the next transaction needs the reader.
+ * While a transaction is running no heartbeats are sent and the reader is never disconnected;
+ * a disconnect that comes due is carried out once the transaction ends.
+ *
+ * The time from asking for a connection to the reader being ready is recorded per reader model,
+ * separately for first connections and for reconnections.
+ *
+ * Times are milliseconds on any clock that does not go backwards. Not thread safe.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "cft/LatencyHistogram.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+struct ReaderConnectionConfig {
+    /*! Time between heartbeats while connected; 0 sends none. */
+    std::int64_t heartbeatIntervalMillis = 30 * 1000;
+    /*! Time a heartbeat may go unanswered before it counts as missed. */
+    std::int64_t heartbeatTimeoutMillis = 5 * 1000;
+    /*! Missed heartbeats in a row after which the reader is treated as dropped. */
+    std::uint32_t maxMissedHeartbeats = 2;
+    /*! Time a connection attempt may take before it counts as failed. */
+    std::int64_t connectTimeoutMillis = 15 * 1000;
+    /*! Delay before the second reconnect attempt; the first is immediate. Doubles per attempt. */
+    std::int64_t baseRetryDelayMillis = 500;
+    std::int64_t maxRetryDelayMillis = 60 * 1000;
+    /*! Disconnect after this long without activity() to save the reader's battery; 0 stays connected. */
+    std::int64_t idleDisconnectMillis = 0;
+};
+
+/*!
+ * @typedef ReaderLinkState
+ * @constant Idle No reader is wanted
+ * @constant Connecting A connection was asked for and not yet answered
+ * @constant Ready The reader is connected
+ * @constant Waiting The reader dropped or could not be reached; the next attempt is at nextDeadlineMillis()
+ * @constant Suspended Disconnected after idleDisconnectMillis; activity() reconnects
+ */
+enum class ReaderLinkState : std::uint8_t {
+    Idle,
+    Connecting,
+    Ready,
+    Waiting,
+    Suspended
+};
+
+enum class ReaderLinkAction : std::uint8_t {
+    None,
+    Connect,
+    Heartbeat,
+    Disconnect
+};
+
+class ReaderConnection {
+public:
+    explicit ReaderConnection(const ReaderConnectionConfig &config = ReaderConnectionConfig()) : _config(config) {}
+
+    /*!
+     * @brief Keep the named reader connected from now on
+     */
+    void connect(const std::string &name, CardReaderModel model, std::int64_t nowMillis);
+
+    /*!
+     * @brief Stop keeping a reader connected; the caller disconnects it
+     */
+    void disconnect();
+
+    /*!
+     * @brief A reader connected
+     * @discussion A reader connected some other way, such as from a scan, is adopted and kept connected.
+     */
+    void connected(const std::string &name, CardReaderModel model, std::int64_t nowMillis);
+
+    void connectFailed(std::int64_t nowMillis);
+
+    /*!
+     * @brief The reader disconnected without being asked to
+     */
+    void disconnected(std::int64_t nowMillis);
+
+    /*!
+     * @param present bool - false if the reader was checked and is gone
+     */
+    void heartbeatAnswered(bool present, std::int64_t nowMillis);
+
+    /*!
+     * @brief The reader is about to be used; postpones the idle disconnect, forgets missed
+     * heartbeats and wakes a suspended reader
+     */
+    void activity(std::int64_t nowMillis);
+
+    /*!
+     * @brief A transaction started or ended on the reader
+     * @discussion Heartbeats and disconnects wait while one is active; the heartbeat interval and
+     * idle period start over when it ends.
+     */
+    void setTransactionActive(bool active, std::int64_t nowMillis);
+    bool isTransactionActive() const { return _transactionActive; }
+
+    /*!
+     * @brief What to do now
+     */
+    ReaderLinkAction poll(std::int64_t nowMillis);
+
+    /*!
+     * @return std::int64_t - When poll() next has something to do, -1 if only a report can change that
+     */
+    std::int64_t nextDeadlineMillis() const;
+
+    ReaderLinkState state() const { return _state; }
+    const std::string &readerName() const { return _name; }
+    CardReaderModel model() const { return _model; }
+    /*! Failed attempts since the reader was last ready. */
+    std::uint32_t attempts() const { return _attempts; }
+
+    /*!
+     * @param reconnect bool - false for first connections, true for reconnections after a drop or a suspend
+     */
+    const LatencyHistogram &timeToReady(CardReaderModel model, bool reconnect) const;
+
+private:
+    void startConnecting(std::int64_t nowMillis, bool reconnect);
+    void drop(std::int64_t nowMillis);
+    std::int64_t retryDelayMillis(std::uint32_t attempts) const;
+    static std::size_t modelIndex(CardReaderModel model);
+
+    const ReaderConnectionConfig _config;
+    ReaderLinkState _state = ReaderLinkState::Idle;
+    std::string _name;
+    CardReaderModel _model = CardReaderModel::Unknown;
+    std::uint32_t _attempts = 0;
+    bool _connectIssued = false;
+    bool _reconnecting = false;
+    std::int64_t _readyTimerStartMillis = -1;
+    std::int64_t _connectIssuedAtMillis = 0;
+    std::int64_t _retryAtMillis = 0;
+    std::int64_t _lastActivityMillis = 0;
+    std::int64_t _nextHeartbeatAtMillis = 0;
+    bool _heartbeatOutstanding = false;
+    std::int64_t _heartbeatDeadlineMillis = 0;
+    std::uint32_t _missedHeartbeats = 0;
+    bool _disconnectPending = false;
+    bool _transactionActive = false;
+    std::array<LatencyHistogram, kCardReaderModelCount> _firstConnections;
+    std::array<LatencyHistogram, kCardReaderModelCount> _reconnections;
+};
+
+} // namespace cft
@@ -0,0 +1,165 @@
+/*!
+ * @header ReaderDiscovery.hpp
+ *
+ * @brief Ranked, incremental view of the Bluetooth readers a scan can see.
+ * The SDK reports the full reader list on every change; ReaderDiscovery turns each report,
+ * and each signal strength reading, into the few insertions, removals, moves and updates that
+ * changed, so a list on screen is patched rather than reloaded. Readers are ranked:
+ *   1. the connected reader
+ *   2. readers connected within recentUseMillis, most recent first
+ *   3. everything else by signal strength, strongest first, then by last use
+ * Signal strength only reorders readers once it moves by signalStepDb, so readers at similar
+ * distances do not trade places on every advertisement.
+ *
+ * Readers that were connected before are remembered, with when they were last used, and can
+ * be saved across launches. The most recently used one is offered for auto-connect as soon as
+ * a scan sees it.
+ *
+ * Times are wall-clock milliseconds since 1970 passed in by the caller. Not thread safe.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*! @brief Signal strength of a reader no reading has arrived for. */
+constexpr int kNoSignal = -128;
+
+struct ReaderDiscoveryConfig {
+    /*! Signal change in dB that moves a reader in the ranking. */
+    int signalStepDb = 6;
+    /*! How long after its last connection a reader ranks above the others. */
+    std::int64_t recentUseMillis = 12 * 60 * 60 * 1000;
+    /*! Readers remembered; the least recently used are forgotten first. */
+    std::size_t maxKnownReaders = 64;
+};
+
+/*!
+ * @brief A reader as the SDK reported it
+ */
+struct ReaderSighting {
+    std::string name;
+    CardReaderModel model = CardReaderModel::Unknown;
+    bool connected = false;
+};
+
+struct KnownReader {
+    std::string name;
+    CardReaderModel model = CardReaderModel::Unknown;
+    std::int64_t lastUsedMillis = 0;
+    std::uint32_t connectCount = 0;
+};
+
+struct DiscoveredReader {
+    std::string name;
+    CardReaderModel model = CardReaderModel::Unknown;
+    bool connected = false;
+    /*! Smoothed reading in dBm, kNoSignal before the first. */
+    int signal = kNoSignal;
+    /*! Reading the ranking uses; follows signal in steps of signalStepDb. */
+    int rankedSignal = kNoSignal;
+    /*! 0 for a reader never connected. */
+    std::int64_t lastUsedMillis = 0;
+};
+
+/*!
+ * @typedef ReaderChangeKind
+ * @constant Removed Gone from previousIndex
+ * @constant Added New at index
+ * @constant Moved From previousIndex to index; its other fields may have changed too
+ * @constant Updated Connection or ranked signal changed at index
+ */
+enum class ReaderChangeKind : std::uint8_t {
+    Removed,
+    Added,
+    Moved,
+    Updated
+};
+
+/*!
+ * @brief One change to ranked(). Apply a call's changes like a table view batch update:
+ * removals and move sources by previousIndex in the old list, insertions, move targets and
+ * updates by index in the new one.
+ */
+struct ReaderChange {
+    ReaderChangeKind kind = ReaderChangeKind::Updated;
+    std::string name;
+    std::size_t index = 0;
+    std::size_t previousIndex = 0;
+};
+
+class ReaderDiscovery {
+public:
+    explicit ReaderDiscovery(const ReaderDiscoveryConfig &config = ReaderDiscoveryConfig()) : _config(config) {}
+
+    /*!
+     * @brief Replace the visible readers with the SDK's latest list
+     */
+    void updateVisible(const std::vector<ReaderSighting> &visible, std::int64_t nowMillis,
+                       std::vector<ReaderChange> &changes);
+
+    /*!
+     * @brief A signal strength reading for a reader, in dBm
+     * @discussion Readings outside -127...20 dBm are ignored; CoreBluetooth reports 127 when it has none.
+     * Readings for readers the SDK has not listed yet are kept until it does.
+     */
+    void updateSignal(const std::string &name, int signal, std::int64_t nowMillis, std::vector<ReaderChange> &changes);
+
+    /*!
+     * @brief The scan stopped; every visible reader is removed except a connected one
+     */
+    void endScan(std::int64_t nowMillis, std::vector<ReaderChange> &changes);
+
+    /*!
+     * @brief A reader connected; it becomes the most recently used
+     */
+    void recordConnected(const std::string &name, CardReaderModel model, std::int64_t nowMillis,
+                         std::vector<ReaderChange> &changes);
+
+    void recordDisconnected(const std::string &name, std::int64_t nowMillis, std::vector<ReaderChange> &changes);
+
+    /*!
+     * @brief The visible reader to connect without asking, if any
+     * @return bool - true when the most recently used reader is visible and nothing is connected
+     */
+    bool autoConnectCandidate(DiscoveredReader &reader) const;
+
+    const std::vector<DiscoveredReader> &ranked() const { return _ranked; }
+    std::vector<KnownReader> knownReaders() const;
+
+    /*!
+     * @brief Stop remembering a reader; it stays visible but loses its rank from past use
+     */
+    void forget(const std::string &name, std::int64_t nowMillis, std::vector<ReaderChange> &changes);
+
+    ErrorCode save(const std::string &path) const;
+
+    /*!
+     * @brief Merge readers saved by save(), keeping the later use of each
+     * @discussion Call before scanning; readers already visible pick up the merged use on the next update.
+     * @return ErrorCode - NotFound if path does not exist, InvalidArgument if it is not a saved list
+     */
+    ErrorCode load(const std::string &path);
+
+private:
+    void rerank(std::vector<DiscoveredReader> next, std::int64_t nowMillis, std::vector<ReaderChange> &changes);
+    void trimKnownReaders();
+
+    const ReaderDiscoveryConfig _config;
+    std::vector<DiscoveredReader> _ranked;
+    std::map<std::string, KnownReader> _known;
+    std::map<std::string, int> _pendingSignals;
+};
+
+} // namespace cft
@@ -0,0 +1,230 @@
+/*!
+ * @header ReaderEventBus.hpp
+ *
+ * @brief Fan-out of reader events to any number of subscribers without blocking the publisher.
+ * Reader events arrive on two overlapping delegate paths, the utilities delegate and the
+ * transaction delegate. Both publish into one bounded multi-producer queue: publishing is a slot
+ * claim and a copy, never waits on a subscriber, and counts the event as rejected when the queue
+ * is full. The same event reported by both paths is kept once.
+ *
+ * Like EventLog the bus owns no threads. A dispatcher calls dispatch() to move published events
+ * into each subscriber's bounded inbox, and each subscriber drains its own inbox on its own
+ * queue. An inbox drops an undelivered event of a coalesced kind, such as a battery update, when
+ * a newer one from the same reader arrives, and when it is full drops events for that subscriber
+ * only, so a slow subscriber never holds up the publisher or the other subscribers. Events are
+ * delivered in publish order.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef ReaderEventSource
+ * @brief Delegate path an event was reported on
+ */
+enum class ReaderEventSource : std::uint8_t {
+    Utilities,
+    Transaction
+};
+
+/*!
+ * @brief One reader event, 32 bytes
+ */
+struct ReaderEventMessage {
+    Nanos timestamp = 0;
+    // Assigned by the bus in publish order.
+    std::uint64_t sequence = 0;
+    // Caller-chosen reader id, e.g. a hash of the reader's name.
+    std::uint32_t reader = 0;
+    CardReaderEvent event = CardReaderEvent::Unknown;
+    // Free-form number such as a battery status.
+    std::int32_t detail = 0;
+    ReaderEventSource source = ReaderEventSource::Utilities;
+};
+
+static_assert(std::is_trivially_copyable<ReaderEventMessage>::value, "ReaderEventMessage is copied as bytes");
+
+/*!
+ * @typedef ReaderEventMask
+ * @brief One bit per CardReaderEvent, from readerEventBit()
+ */
+using ReaderEventMask = std::uint32_t;
+
+constexpr ReaderEventMask readerEventBit(CardReaderEvent event) {
+    return ReaderEventMask(1) << static_cast<std::uint32_t>(event);
+}
+
+constexpr ReaderEventMask kAllReaderEvents = (ReaderEventMask(1) << kCardReaderEventCount) - 1;
+
+// Events that describe a current state, so only the newest undelivered one matters.
+constexpr ReaderEventMask kCoalescedReaderEvents =
+    readerEventBit(CardReaderEvent::BatteryStatusUpdated) | readerEventBit(CardReaderEvent::Connecting);
+
+/*!
+ * @typedef ReaderEventOverflow
+ * @brief What a full inbox gives up
+ */
+enum class ReaderEventOverflow : std::uint8_t {
+    DropOldest,
+    DropNewest
+};
+
+struct ReaderEventBusConfig {
+    // Events published but not yet dispatched, rounded up to a power of two.
+    std::size_t capacity = 1024;
+    // The same event and detail from the other source within this window is a duplicate; 0 keeps both.
+    Nanos duplicateWindowNanos = 100000000;
+};
+
+struct ReaderEventSubscription {
+    ReaderEventMask events = kAllReaderEvents;
+    // Kinds where an undelivered event is dropped when a newer one from the same reader arrives.
+    ReaderEventMask coalesced = kCoalescedReaderEvents;
+    // Undelivered events held for the subscriber; at least 1.
+    std::size_t capacity = 256;
+    ReaderEventOverflow overflow = ReaderEventOverflow::DropOldest;
+};
+
+struct ReaderEventBusStats {
+    std::uint64_t published = 0;
+    // Lost to a full queue; publish returned false.
+    std::uint64_t rejected = 0;
+    std::uint64_t dispatched = 0;
+    // Reported again on the other source and dropped; counted in dispatched.
+    std::uint64_t duplicates = 0;
+    std::size_t subscribers = 0;
+};
+
+struct ReaderSubscriberStats {
+    std::uint64_t delivered = 0;
+    // Dropped for a newer event of the same kind before delivery.
+    std::uint64_t coalesced = 0;
+    // Dropped by a full inbox.
+    std::uint64_t overflowed = 0;
+    std::size_t pending = 0;
+};
+
+class ReaderEventBus {
+public:
+    /*!
+     * @typedef SubscriberId
+     * @brief Handle from subscribe(); never 0
+     */
+    using SubscriberId = std::uint32_t;
+
+    /*!
+     * @brief Receives drained events in inbox order
+     * @discussion missed counts the events the inbox dropped since the previous drain, so the
+     * subscriber knows to re-read any state it tracks. events is only valid for the duration of
+     * the call.
+     */
+    using SinkFunction = std::function<void(const ReaderEventMessage *events, std::size_t count, std::uint64_t missed)>;
+
+    explicit ReaderEventBus(ReaderEventBusConfig config = ReaderEventBusConfig());
+    ~ReaderEventBus();
+
+    ReaderEventBus(const ReaderEventBus &) = delete;
+    ReaderEventBus &operator=(const ReaderEventBus &) = delete;
+
+    /*!
+     * @brief Queue an event for dispatch from any thread
+     * @discussion Fills in sequence, and timestamp when it is zero. Never blocks.
+     * @return bool - false if the queue was full and the event was dropped
+     */
+    bool publish(ReaderEventMessage message);
+
+    bool publish(CardReaderEvent event, ReaderEventSource source, std::uint32_t reader, std::int32_t detail = 0);
+
+    /*!
+     * @brief Add a subscriber; it receives events dispatched from now on
+     */
+    SubscriberId subscribe(ReaderEventSubscription subscription = ReaderEventSubscription());
+
+    /*!
+     * @brief Remove a subscriber and discard its undelivered events
+     * @discussion A drain already running for it finishes.
+     */
+    void unsubscribe(SubscriberId subscriber);
+
+    /*!
+     * @brief Move up to maxEvents published events into the inboxes of the subscribers that want them
+     * @discussion Dispatches may run on any thread but are serialized with each other. An event
+     * whose publisher has claimed a slot but not yet filled it holds back the ones behind it
+     * until the next dispatch.
+     * @param woken std::vector<SubscriberId> * - If given, receives the subscribers whose inbox was
+     * empty before this call and is not now; each needs a drain scheduled.
+     * @return std::size_t - Events taken off the queue, duplicates included
+     */
+    std::size_t dispatch(std::vector<SubscriberId> *woken = nullptr, std::size_t maxEvents = SIZE_MAX);
+
+    /*!
+     * @brief Hand up to maxEvents of a subscriber's undelivered events to sink
+     * @discussion Safe beside dispatch() and drains of other subscribers; drains of one
+     * subscriber are serialized. sink is called once, without holding the inbox, even when
+     * there is nothing to deliver but missed events.
+     * @return std::size_t - Events delivered
+     */
+    std::size_t drain(SubscriberId subscriber, const SinkFunction &sink, std::size_t maxEvents = SIZE_MAX);
+
+    ReaderEventBusStats stats() const;
+
+    /*!
+     * @brief Delivery counts for one subscriber; all zero once it is unsubscribed
+     */
+    ReaderSubscriberStats subscriberStats(SubscriberId subscriber) const;
+
+private:
+    struct Cell;
+    struct Inbox;
+    struct LastSeen {
+        Nanos timestamp;
+        std::int32_t detail;
+        ReaderEventSource source;
+    };
+
+    std::shared_ptr<Inbox> findInbox(SubscriberId subscriber) const;
+    bool isDuplicate(const ReaderEventMessage &message);
+
+    const std::size_t _mask;
+    const Nanos _duplicateWindowNanos;
+    std::unique_ptr<Cell[]> _cells;
+
+    // Claimed by publishers.
+    alignas(64) std::atomic<std::uint64_t> _enqueuePosition{0};
+    std::atomic<std::uint64_t> _rejected{0};
+
+    // Owned by the dispatcher, under _dispatchLock.
+    alignas(64) std::mutex _dispatchLock;
+    std::uint64_t _dequeuePosition = 0;
+    std::vector<ReaderEventMessage> _batch;
+    std::unordered_map<std::uint64_t, LastSeen> _lastSeen;
+    std::atomic<std::uint64_t> _dispatched{0};
+    std::atomic<std::uint64_t> _duplicates{0};
+
+    mutable std::mutex _subscribersLock;
+    std::vector<std::shared_ptr<Inbox>> _inboxes;
+    SubscriberId _nextSubscriber = 1;
+};
+
+/*!
+ * @brief Stable reader id for a reader name, for ReaderEventMessage::reader
+ */
+std::uint32_t readerEventId(const char *name);
+
+} // namespace cft
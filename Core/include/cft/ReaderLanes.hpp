@@ -0,0 +1,163 @@
+/*!
+ * @header ReaderLanes.hpp
+ *
+ * @brief Checkout lanes, one per card reader, that run transactions side by side.
+ * A lane owns everything about its reader's transactions: its own state machine, per-state
+ * latencies and transaction times. Nothing in a lane is shared with another lane, so each can
+ * run on its own queue and one busy lane never waits on another.
+ *
+ * ReaderLanes hands out the lanes and routes reader events to them by reader name. A reader
+ * belongs to at most one lane. Routing reads an immutable snapshot of the lanes, so looking up a
+ * lane takes no lock; only opening and closing lanes do.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "cft/Clock.hpp"
+#include "cft/Error.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/StateLatencyRecorder.hpp"
+#include "cft/TransactionStateMachine.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef LaneId
+ * @brief Handle of an open lane; never 0
+ */
+using LaneId = std::uint32_t;
+
+/*!
+ * @brief One reader and the transactions run on it
+ * @discussion Not thread-safe: use a lane from one queue at a time. isBusy() may be read anywhere.
+ */
+class ReaderLane : public TransactionStateMachine::Observer {
+public:
+    ReaderLane(LaneId id, std::string readerName, CardReaderModel model, ClockFunction clock = monotonicNanos);
+
+    ReaderLane(const ReaderLane &) = delete;
+    ReaderLane &operator=(const ReaderLane &) = delete;
+
+    LaneId id() const { return _id; }
+    const std::string &readerName() const { return _readerName; }
+    CardReaderModel model() const { return _model; }
+
+    /*!
+     * @brief Start a transaction on the lane
+     * @return ErrorCode::IllegalTransition while the previous one has not reached a terminal state
+     */
+    ErrorCode begin();
+
+    /*!
+     * @brief Follow the lane's transaction to an observed state
+     * @discussion Ends the transaction when state is terminal.
+     * @return ErrorCode::IllegalTransition if no transaction is running or state cannot follow the current one
+     */
+    ErrorCode updateState(TransactionState state);
+
+    /*!
+     * @brief Count an event from the lane's reader
+     */
+    void recordReaderEvent(CardReaderEvent event);
+
+    /*!
+     * @brief Give up on the running transaction without timing it
+     */
+    void abandon();
+
+    bool isBusy() const { return _busy.load(std::memory_order_acquire); }
+    TransactionState state() const { return _machine.state(); }
+
+    /*!
+     * @brief Time from begin() to a terminal state, per transaction
+     */
+    const LatencyHistogram &transactionTimes() const { return _transactionTimes; }
+    const StateLatencyRecorder &stateLatencies() const { return _states; }
+    std::uint64_t transactions() const { return _transactions; }
+    std::uint64_t readerEvents() const { return _readerEvents; }
+
+    /*!
+     * @discussion The lane also observes state machines that drive its reader directly, such as
+     * the harness' transaction driver. Such a machine leaving TransactionState::Unknown starts a
+     * transaction as begin() does, so either way of following a transaction is timed the same.
+     */
+    void stateMachineDidTransition(const TransactionStateMachine &machine,
+                                   TransactionState from,
+                                   TransactionState to,
+                                   Nanos timeInPrevious) override;
+
+private:
+    const LaneId _id;
+    const std::string _readerName;
+    const CardReaderModel _model;
+    const ClockFunction _clock;
+    TransactionStateMachine _machine;
+    StateLatencyRecorder _states;
+    LatencyHistogram _transactionTimes;
+    std::atomic<bool> _busy{false};
+    Nanos _startedAt = 0;
+    std::uint64_t _transactions = 0;
+    std::uint64_t _readerEvents = 0;
+};
+
+struct ReaderLanesConfig {
+    std::size_t maxLanes = 8;
+    ClockFunction clock = monotonicNanos;
+};
+
+/*!
+ * @brief Registry of open lanes; thread-safe
+ */
+class ReaderLanes {
+public:
+    explicit ReaderLanes(ReaderLanesConfig config = ReaderLanesConfig());
+
+    ReaderLanes(const ReaderLanes &) = delete;
+    ReaderLanes &operator=(const ReaderLanes &) = delete;
+
+    /*!
+     * @brief Open a lane for a reader
+     * @return ErrorCode::InvalidArgument if the name is empty or the reader has a lane,
+     * ErrorCode::CapacityExceeded if maxLanes are open
+     */
+    ErrorCode open(const std::string &readerName, CardReaderModel model, std::shared_ptr<ReaderLane> &lane);
+
+    /*!
+     * @brief Close a lane so its reader can be given to another
+     * @return ErrorCode::NotFound for an unknown lane, ErrorCode::IllegalTransition while it runs a transaction
+     */
+    ErrorCode close(LaneId lane);
+
+    /*!
+     * @brief Lane a reader belongs to, null if none; takes no lock
+     */
+    std::shared_ptr<ReaderLane> find(const std::string &readerName) const;
+
+    std::shared_ptr<ReaderLane> lane(LaneId lane) const;
+
+    std::size_t size() const;
+
+private:
+    using LaneMap = std::unordered_map<std::string, std::shared_ptr<ReaderLane>>;
+
+    std::shared_ptr<const LaneMap> snapshot() const;
+
+    const ReaderLanesConfig _config;
+    // Replaced whole under _writeLock and read with atomic loads.
+    std::shared_ptr<const LaneMap> _lanes;
+    std::mutex _writeLock;
+    LaneId _nextLane = 1;
+};
+
+} // namespace cft
@@ -0,0 +1,172 @@
+/*!
+ * @header RefreshingCache.hpp
+ *
+ * @brief Keyed cache of opaque values fetched from the network, with single-flight
+ * coalescing, TTL-driven prefetch and stale-while-revalidate.
+ * Like BatchScheduler the cache owns no threads: it calls the fetch function when a key
+ * needs loading and the caller reports the result through complete(). However many
+ * callers ask for a key at once, at most one fetch for it is outstanding.
+ *
+ * A value is fresh for ttlMillis after it was fetched and is served without a fetch.
+ * Within prefetchLeadMillis of going stale, reads also start a background refresh.
+ * Stale values are served immediately for another maxStaleMillis while a refresh runs;
+ * only missing or expired keys make callers wait for the network.
+ *
+ * Times are wall-clock milliseconds since 1970 passed in by the caller, so that snapshots
+ * saved to disk keep their age across launches.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef CacheFreshness
+ * @constant Missing No value is cached
+ * @constant Fresh The value is younger than the TTL
+ * @constant Stale The value is past the TTL but may still be served while it is refreshed
+ * @constant Expired The value is too old to serve
+ */
+enum class CacheFreshness : std::uint8_t {
+    Missing,
+    Fresh,
+    Stale,
+    Expired
+};
+
+struct RefreshingCacheConfig {
+    std::int64_t ttlMillis = 15 * 60 * 1000;
+    std::int64_t prefetchLeadMillis = 2 * 60 * 1000;
+    std::int64_t maxStaleMillis = 24 * 60 * 60 * 1000;
+    // Background refreshes of a key are not retried sooner than this after one fails.
+    // Callers waiting on a missing or expired key always start a fetch.
+    std::int64_t retryMillis = 30 * 1000;
+};
+
+class RefreshingCache {
+public:
+    /*!
+     * @brief Begins loading key. Must eventually lead to exactly one complete(key, ...).
+     * @discussion Called without the cache's lock held, so it may call complete() synchronously.
+     */
+    using FetchFunction = std::function<void(const std::string &key)>;
+
+    /*!
+     * @brief Receives a value, or an error when a fetch failed and nothing servable was cached
+     */
+    using ValueFunction = std::function<void(ErrorCode error, const std::string &value, CacheFreshness freshness)>;
+
+    RefreshingCache(RefreshingCacheConfig config, FetchFunction fetch);
+
+    RefreshingCache(const RefreshingCache &) = delete;
+    RefreshingCache &operator=(const RefreshingCache &) = delete;
+
+    /*!
+     * @brief Deliver the value of key, fetching it if needed
+     * @discussion Fresh and stale values are delivered synchronously, before any refresh is
+     * started. Otherwise callback is queued and runs on the thread that calls complete().
+     */
+    void get(const std::string &key, std::int64_t nowMillis, ValueFunction callback);
+
+    /*!
+     * @brief Copy the servable value of key without waiting, starting whatever fetch get() would
+     * @return CacheFreshness - Fresh or Stale when value was set, otherwise Missing or Expired
+     * and a fetch is outstanding
+     */
+    CacheFreshness tryGet(const std::string &key, std::int64_t nowMillis, std::string &value);
+
+    /*!
+     * @brief Copy the cached value of key without fetching
+     * @return CacheFreshness - Missing when nothing is cached, in which case value is untouched
+     */
+    CacheFreshness peek(const std::string &key, std::int64_t nowMillis, std::string &value) const;
+
+    /*!
+     * @brief Start a fetch of key unless one is already outstanding
+     * @return bool - true if this call started a fetch
+     */
+    bool refresh(const std::string &key);
+
+    /*!
+     * @brief Start background refreshes for every servable key within its prefetch window
+     * @return std::size_t - Number of fetches started
+     */
+    std::size_t prefetchDue(std::int64_t nowMillis);
+
+    /*!
+     * @brief Earliest time prefetchDue() will have work, INT64_MAX if never
+     */
+    std::int64_t nextPrefetchMillis(std::int64_t nowMillis) const;
+
+    /*!
+     * @brief Report the result of a fetch started by the cache
+     * @discussion Thread-safe. Reports for keys with no outstanding fetch are ignored.
+     */
+    void complete(const std::string &key, ErrorCode error, const std::string &value, std::int64_t nowMillis);
+
+    /*!
+     * @brief Store a value obtained outside the cache as if it had just been fetched
+     */
+    void put(const std::string &key, const std::string &value, std::int64_t nowMillis);
+
+    /*!
+     * @brief Drop the cached value of key. An outstanding fetch still completes normally.
+     */
+    void invalidate(const std::string &key);
+
+    /*!
+     * @brief Atomically write every cached value and its fetch time to path
+     */
+    ErrorCode save(const std::string &path) const;
+
+    /*!
+     * @brief Merge values saved by save(), keeping whichever copy of a key was fetched last
+     * @return ErrorCode - NotFound if path does not exist, InvalidArgument if it is not a valid snapshot
+     */
+    ErrorCode load(const std::string &path);
+
+    std::size_t size() const;
+    std::uint64_t fetchCount() const;
+    // get() calls that joined a fetch another caller had already started.
+    std::uint64_t coalescedCount() const;
+    std::uint64_t freshHitCount() const;
+    std::uint64_t staleHitCount() const;
+
+private:
+    struct Entry {
+        std::string value;
+        std::int64_t fetchedAtMillis = 0;
+        std::int64_t failedAtMillis = 0;
+        bool hasValue = false;
+        bool hasFailed = false;
+        bool inFlight = false;
+        std::vector<ValueFunction> waiters;
+    };
+
+    CacheFreshness freshness(const Entry &entry, std::int64_t nowMillis) const;
+    bool needsBackgroundRefresh(const Entry &entry, std::int64_t nowMillis) const;
+
+    const RefreshingCacheConfig _config;
+    const FetchFunction _fetch;
+
+    mutable std::mutex _lock;
+    std::unordered_map<std::string, Entry> _entries;
+    std::uint64_t _fetches = 0;
+    std::uint64_t _coalesced = 0;
+    std::uint64_t _freshHits = 0;
+    std::uint64_t _staleHits = 0;
+};
+
+} // namespace cft
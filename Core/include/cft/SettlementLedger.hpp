@@ -0,0 +1,116 @@
+/*!
+ * @header SettlementLedger.hpp
+ *
+ * @brief Running totals of the open settlement batch, kept from transaction record changes.
+ * Each record contributes to the batch while it is approved and unsettled: sales and captured
+ * authorizations as sales, refunds as refunds, with any tip on top. Applying a record again
+ * after it completes, is adjusted, voided or settled replaces its earlier contribution, so the
+ * totals stay exact without rescanning the batch. Feed it from TransactionRecordStore::changesSince().
+ *
+ * Totals are broken down by card brand, network type and card input method. For accounts on
+ * SettlementScheme::BroadPosManual the batch is closed locally with closeBatch(); every other
+ * scheme closes on the host, and its records leave the totals as they become Settled. Records
+ * pending void are not settled by a local close; they carry over into the next batch.
+ *
+ * A ledger is not thread safe.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/TransactionRecordStore.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * Amounts in minor units and record counts of one slice of a batch.
+ */
+struct SettlementBucket {
+    std::int64_t salesMinor = 0;
+    std::int64_t refundsMinor = 0;
+    std::int64_t tipsMinor = 0;
+    std::uint32_t saleCount = 0;
+    std::uint32_t refundCount = 0;
+
+    /*! @brief Sales and tips less refunds */
+    std::int64_t netMinor() const { return salesMinor + tipsMinor - refundsMinor; }
+
+    bool operator==(const SettlementBucket &other) const;
+    bool operator!=(const SettlementBucket &other) const { return !(*this == other); }
+};
+
+struct SettlementTotals {
+    /*! Batches closed before this one plus one */
+    std::uint64_t batchNumber = 1;
+    SettlementBucket total;
+    std::array<SettlementBucket, kCardBrandCount> byCardBrand{};
+    std::array<SettlementBucket, kNetworkTypeCount> byNetworkType{};
+    std::array<SettlementBucket, kCardInputMethodCount> byCardInputMethod{};
+
+    bool operator==(const SettlementTotals &other) const;
+    bool operator!=(const SettlementTotals &other) const { return !(*this == other); }
+};
+
+class SettlementLedger {
+public:
+    explicit SettlementLedger(SettlementScheme scheme, std::uint64_t batchNumber = 1);
+
+    /*!
+     * @brief Whether record belongs in an open batch: approved or pending void, and a sale,
+     * authorization or refund
+     */
+    static bool isOpen(const StoredTransactionRecord &record);
+
+    /*!
+     * @brief Replace the record's contribution with one for its current state
+     * @return ErrorCode - InvalidArgument for a negative amount or tip, or totals that would overflow;
+     * the totals are unchanged
+     */
+    ErrorCode apply(const StoredTransactionRecord &record);
+
+    /*!
+     * @brief Drop the contribution of a record, e.g. one removed from the store
+     */
+    void remove(const std::string &transactionId);
+
+    const SettlementTotals &totals() const { return _totals; }
+    SettlementScheme scheme() const { return _scheme; }
+    std::size_t openRecordCount() const { return _open.size(); }
+
+    /*!
+     * @brief Close the open batch and start the next one with the records pending void
+     * @param closed SettlementTotals - Set to the totals of the closed batch, its approved records
+     * @param transactionIds std::vector<std::string> - Set to the records in it, to be marked Settled
+     * @return ErrorCode - IllegalTransition unless the scheme is BroadPosManual
+     */
+    ErrorCode closeBatch(SettlementTotals &closed, std::vector<std::string> &transactionIds);
+
+private:
+    struct Contribution {
+        std::int64_t amountMinor;
+        std::int64_t tipMinor;
+        bool refund;
+        bool pendingVoid;
+        std::uint8_t cardBrand;
+        std::uint8_t networkType;
+        std::uint8_t cardInputMethod;
+    };
+
+    static void add(SettlementTotals &totals, const Contribution &contribution, int sign);
+
+    const SettlementScheme _scheme;
+    SettlementTotals _totals;
+    std::unordered_map<std::string, Contribution> _open;
+};
+
+} // namespace cft
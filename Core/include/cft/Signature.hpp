@@ -0,0 +1,100 @@
+/*!
+ * @header Signature.hpp
+ *
+ * @brief A cardholder signature kept as the strokes that were drawn rather than as an image.
+ * Points sit on an integer canvas; each stroke is stored as deltas from the point before it,
+ * so a typical signature encodes to a few kilobytes against hundreds for its bitmap. An image
+ * is only produced when render() is called, at whatever size is needed then.
+ *
+ * Layout, little-endian:
+ *   header  "CFSG" u8 version u8 reserved u16 width u16 height u16 reserved u32 crc32(bytes 16..end)
+ *   body    varint strokeCount, then per stroke varint pointCount and pointCount x
+ *           { zigzag varint dx, zigzag varint dy, varint dMillis }
+ *
+ * Deltas run across strokes: a stroke's first point is relative to the last point of the
+ * stroke before it, and the first point of all to (0, 0, 0).
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cft/Error.hpp"
+
+namespace cft {
+
+constexpr std::uint8_t kSignatureVersion = 1;
+constexpr std::size_t kSignatureHeaderSize = 16;
+
+struct SignaturePoint {
+    std::uint16_t x = 0;
+    std::uint16_t y = 0;
+    std::uint32_t millis = 0;
+
+    bool operator==(const SignaturePoint &other) const {
+        return x == other.x && y == other.y && millis == other.millis;
+    }
+};
+
+class Signature {
+public:
+    Signature() = default;
+    Signature(std::uint16_t width, std::uint16_t height) : _width(width), _height(height) {}
+
+    /*!
+     * @brief Start a new stroke; the next point is where the pen touched down
+     */
+    void beginStroke();
+
+    /*!
+     * @brief Extend the current stroke to point
+     * @discussion A point at the same position as the previous one only moves its time and
+     * is not stored.
+     * @return ErrorCode - IllegalTransition before beginStroke(), InvalidArgument for a point
+     * off the canvas or earlier than the one before it
+     */
+    ErrorCode addPoint(const SignaturePoint &point);
+
+    std::uint16_t width() const { return _width; }
+    std::uint16_t height() const { return _height; }
+    std::size_t strokeCount() const { return _strokeEnds.size(); }
+    std::size_t pointCount() const { return _points.size(); }
+    bool isEmpty() const { return _points.empty(); }
+
+    /*!
+     * @brief Points of stroke index, in the order they were drawn
+     */
+    const SignaturePoint *strokePoints(std::size_t index, std::size_t &count) const;
+
+    void encode(std::vector<std::uint8_t> &out) const;
+
+    /*!
+     * @brief Decode what encode() produced
+     * @return ErrorCode - InvalidArgument for data that is truncated, corrupt or of an unknown version
+     */
+    static ErrorCode decode(const std::uint8_t *data, std::size_t size, Signature &signature);
+
+    /*!
+     * @brief Draw the signature scaled to width by height pixels
+     * @param penWidth double - Line width in output pixels
+     * @param pixels std::vector<std::uint8_t> - Set to width * height 8-bit gray rows, 255 for paper and 0 for ink
+     */
+    void render(std::uint32_t width, std::uint32_t height, double penWidth, std::vector<std::uint8_t> &pixels) const;
+
+    bool operator==(const Signature &other) const;
+
+private:
+    std::size_t currentStrokeStart() const;
+
+    std::uint16_t _width = 0;
+    std::uint16_t _height = 0;
+    std::vector<SignaturePoint> _points;
+    // One past the last point of each stroke.
+    std::vector<std::size_t> _strokeEnds;
+};
+
+} // namespace cft
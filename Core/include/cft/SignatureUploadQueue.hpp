@@ -0,0 +1,133 @@
+/*!
+ * @header SignatureUploadQueue.hpp
+ *
+ * @brief Durable queue of signatures waiting to be uploaded, at most one per transaction.
+ * Signatures are kept in a DeferredQueue journal, so they survive crashes and are retried
+ * with its backoff. Queuing a signature for a transaction that already has one replaces the
+ * queued one; queuing the same bytes again is a no-op. A replaced signature that is already
+ * being uploaded finishes, and the newer one is not claimed until it has.
+ *
+ * Payload of each journal entry:
+ *   u8 format, u8 transactionIdLength, transactionId bytes, signature bytes
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cft/DeferredQueue.hpp"
+#include "cft/Error.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef SignatureFormat
+ * @brief Encoding of queued signature bytes. Values are persisted and must never be reused.
+ * @constant Strokes Signature::encode() output
+ * @constant Png A PNG image
+ */
+enum class SignatureFormat : std::uint8_t {
+    Strokes = 1,
+    Png = 2
+};
+
+struct SignatureUpload {
+    std::uint64_t entryId = 0;
+    std::string transactionId;
+    SignatureFormat format = SignatureFormat::Strokes;
+    std::vector<std::uint8_t> data;
+};
+
+class SignatureUploadQueue {
+public:
+    /*!
+     * @brief Open or create the queue journal at path
+     * @discussion Signatures left behind by a replacement that was interrupted are dropped, and
+     * uploads cut off by the last shutdown are pending again.
+     */
+    static ErrorCode open(const std::string &path, const DeferredQueueConfig &config,
+                          std::unique_ptr<SignatureUploadQueue> &queue);
+
+    /*!
+     * @brief Durably queue the signature of a transaction
+     * @param entryId std::uint64_t - Set to the queued entry, the existing one when the same signature is already queued
+     * @return ErrorCode - InvalidArgument for an empty or over-long transactionId, CapacityExceeded when the queue is full
+     */
+    ErrorCode enqueue(const std::string &transactionId, SignatureFormat format, const std::uint8_t *data,
+                      std::size_t size, std::int64_t nowMillis, std::uint64_t &entryId);
+
+    /*!
+     * @brief Claim up to limit signatures whose retry time has passed, oldest first
+     * @discussion A signature whose transaction still has a replaced one in flight is left pending,
+     * so two uploads for one transaction never race.
+     */
+    std::vector<SignatureUpload> claimReady(std::int64_t nowMillis, std::size_t limit);
+
+    /*!
+     * @brief The claimed signature was uploaded; remove it
+     */
+    ErrorCode complete(std::uint64_t entryId);
+
+    /*!
+     * @brief The claimed signature could not be uploaded
+     * @param retryable bool - false dead-letters the entry immediately
+     */
+    ErrorCode fail(std::uint64_t entryId, bool retryable, std::int64_t nowMillis, bool &willRetry);
+
+    /*!
+     * @brief Return a claimed signature to pending without counting an attempt
+     */
+    ErrorCode release(std::uint64_t entryId);
+
+    /*!
+     * @brief Make every pending signature ready at nowMillis, see DeferredQueue::expedite()
+     */
+    std::size_t expedite(std::int64_t nowMillis);
+
+    /*!
+     * @brief Drop the queued signature of a transaction in any state
+     */
+    ErrorCode remove(const std::string &transactionId);
+
+    /*!
+     * @brief State of the latest signature queued for transactionId
+     * @return bool - false when none is queued
+     */
+    bool find(const std::string &transactionId, DeferredEntryInfo &info) const;
+
+    /*!
+     * @brief Transactions whose latest signature is dead-lettered
+     */
+    std::vector<std::string> deadLetteredTransactionIds() const;
+
+    std::size_t count() const;
+    std::size_t pendingCount() const;
+    /*!
+     * @brief Earliest retry time among signatures claimReady() would take, or -1 when there are none
+     */
+    std::int64_t nextAttemptAtMillis() const;
+
+private:
+    explicit SignatureUploadQueue(std::unique_ptr<DeferredQueue> queue) : _queue(std::move(queue)) {}
+
+    ErrorCode load();
+    bool isSuperseded(const std::string &transactionId, std::uint64_t entryId) const;
+    std::set<std::uint64_t> heldEntries() const;
+
+    mutable std::mutex _lock;
+    std::unique_ptr<DeferredQueue> _queue;
+    // Latest entry per transaction; older entries still in the journal are in flight.
+    std::map<std::string, std::uint64_t> _byTransaction;
+    std::map<std::uint64_t, std::string> _transactionByEntry;
+};
+
+} // namespace cft
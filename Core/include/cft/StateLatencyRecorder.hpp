@@ -0,0 +1,48 @@
+/*!
+ * @header StateLatencyRecorder.hpp
+ *
+ * @brief TransactionStateMachine observer that accumulates time spent in each state.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "cft/LatencyHistogram.hpp"
+#include "cft/TransactionStateMachine.hpp"
+
+namespace cft {
+
+class StateLatencyRecorder : public TransactionStateMachine::Observer {
+public:
+    void stateMachineDidTransition(const TransactionStateMachine &machine,
+                                   TransactionState from,
+                                   TransactionState to,
+                                   Nanos timeInPrevious) override;
+
+    /*!
+     * @brief Time spent in state before leaving it
+     */
+    const LatencyHistogram &histogram(TransactionState state) const {
+        return _states[static_cast<std::size_t>(state)];
+    }
+
+    /*!
+     * @brief Number of transactions that reached state, terminal states included
+     */
+    std::uint64_t entries(TransactionState state) const {
+        return _entries[static_cast<std::size_t>(state)];
+    }
+
+    void merge(const StateLatencyRecorder &other);
+    void clear();
+
+private:
+    std::array<LatencyHistogram, kTransactionStateCount> _states{};
+    std::array<std::uint64_t, kTransactionStateCount> _entries{};
+};
+
+} // namespace cft
@@ -0,0 +1,98 @@
+/*!
+ * @header TipAdjustmentBatch.hpp
+ *
+ * @brief Tips for many stored records, applied locally before the gateway confirms them.
+ * applyOptimistically() writes every tip into the TransactionRecordStore at once, so a
+ * SettlementLedger following the store shows the adjusted totals immediately. The gateway
+ * requests then run in any order; complete() keeps a confirmed tip and puts back the previous
+ * one for a tip the gateway refused.
+ *
+ * A batch is not thread safe. The store it writes to is.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/TransactionRecordStore.hpp"
+
+namespace cft {
+
+struct TipAdjustment {
+    std::string transactionId;
+    std::int64_t tipMinor = 0;
+};
+
+/*!
+ * @typedef TipAdjustmentState
+ * @constant Pending Not applied yet
+ * @constant Rejected Never sent: the record is missing, not an approved sale or authorization, or the tip is negative
+ * @constant Applied Written to the store, waiting for the gateway
+ * @constant Confirmed The gateway accepted the tip
+ * @constant Reverted The gateway refused the tip and the previous one was restored
+ */
+enum class TipAdjustmentState : std::uint8_t {
+    Pending,
+    Rejected,
+    Applied,
+    Confirmed,
+    Reverted
+};
+
+class TipAdjustmentBatch {
+public:
+    TipAdjustmentBatch(TransactionRecordStore &store, std::vector<TipAdjustment> adjustments);
+
+    /*!
+     * @brief Write every valid tip to the store
+     * @return std::size_t - Adjustments applied; the others are Rejected, see error()
+     */
+    std::size_t applyOptimistically(std::int64_t updatedAtMillis);
+
+    /*!
+     * @brief Record the gateway's answer for an Applied adjustment
+     * @discussion A refused tip is only rolled back while the stored tip is still the one this
+     * batch wrote, so a newer adjustment stored in the meantime is not overwritten.
+     * @return ErrorCode - IllegalTransition if the adjustment is not Applied
+     */
+    ErrorCode complete(std::size_t index, ErrorCode outcome, std::int64_t updatedAtMillis);
+
+    std::size_t size() const { return _items.size(); }
+    const TipAdjustment &adjustment(std::size_t index) const { return _items[index].adjustment; }
+    TipAdjustmentState state(std::size_t index) const { return _items[index].state; }
+
+    /*!
+     * @brief Why a Rejected adjustment was not sent, or the gateway's error for a Reverted one
+     */
+    ErrorCode error(std::size_t index) const { return _items[index].error; }
+
+    /*!
+     * @brief Adjustments still waiting for the gateway
+     */
+    std::size_t outstandingCount() const { return _outstanding; }
+
+    /*!
+     * @brief Whether record is an approved sale or authorization, the only records that take a tip
+     */
+    static bool isAdjustable(const StoredTransactionRecord &record);
+
+private:
+    struct Item {
+        TipAdjustment adjustment;
+        std::int64_t previousTipMinor = 0;
+        TipAdjustmentState state = TipAdjustmentState::Pending;
+        ErrorCode error = ErrorCode::None;
+    };
+
+    TransactionRecordStore &_store;
+    std::vector<Item> _items;
+    std::size_t _outstanding = 0;
+};
+
+} // namespace cft
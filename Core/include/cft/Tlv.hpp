@@ -0,0 +1,145 @@
+/*!
+ * @header Tlv.hpp
+ *
+ * @brief Allocation-free BER-TLV parsing of EMV reader data.
+ * TlvIterator walks every element of a buffer in order, descending into constructed
+ * templates such as 70 and 77, and hands out borrowed views of the values. EmvTags resolves
+ * the curated tags behind CFTEmvDetails in a single pass on first access; nothing is copied
+ * or decoded until a caller asks for it.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cft/Bytes.hpp"
+#include "cft/Error.hpp"
+
+namespace cft {
+
+struct TlvElement {
+    // Tag bytes big-endian in the low bits, e.g. 0x9F26.
+    std::uint32_t tag = 0;
+    ByteRange value;
+    bool constructed = false;
+    // 0 for top-level elements, 1 inside one template, and so on.
+    unsigned depth = 0;
+};
+
+class TlvIterator {
+public:
+    static constexpr unsigned kMaxDepth = 4;
+
+    /*!
+     * @param descend bool - Also yield the elements inside constructed ones, after the constructed element itself
+     */
+    TlvIterator(const std::uint8_t *data, std::size_t size, bool descend = true);
+
+    /*!
+     * @brief Advance to the next element
+     * @return bool - false at the end of the data or when it is malformed; error() tells which
+     */
+    bool next(TlvElement &element);
+
+    /*!
+     * @brief InvalidArgument once a malformed element was reached, None otherwise
+     */
+    ErrorCode error() const { return _error; }
+
+private:
+    const std::uint8_t *_cursor;
+    // End of each enclosing element; _ends[0] is the end of the data.
+    std::array<const std::uint8_t *, kMaxDepth + 1> _ends;
+    unsigned _depth = 0;
+    const bool _descend;
+    ErrorCode _error = ErrorCode::None;
+};
+
+/*!
+ * @brief First element with tag, searching templates too
+ * @return ErrorCode - NotFound if absent, InvalidArgument if the data is malformed before it
+ */
+ErrorCode findTlv(const std::uint8_t *data, std::size_t size, std::uint32_t tag, TlvElement &element);
+
+/*!
+ * @brief Append a primitive element, using the long length form when needed
+ */
+void appendTlv(std::vector<std::uint8_t> &buffer, std::uint32_t tag, const std::uint8_t *value, std::size_t size);
+
+/*!
+ * @brief Write size bytes as 2 * size upper-case hex digits to out
+ */
+void hexEncode(const std::uint8_t *data, std::size_t size, char *out);
+
+/*!
+ * @brief Decode hex digits of either case
+ * @return ErrorCode - InvalidArgument for an odd length or a non-hex character; out is then unspecified
+ */
+ErrorCode hexDecode(const char *text, std::size_t length, std::vector<std::uint8_t> &out);
+
+/*!
+ * @typedef EmvTag
+ * @brief The tags CFTEmvDetails exposes, in declaration order of its properties
+ */
+enum class EmvTag : std::uint8_t {
+    ApplicationPreferredName,       // 9F12, text
+    ApplicationId,                  // 4F
+    ApplicationLabel,               // 50, text
+    TransactionStatusIndicator,     // 9B
+    ApplicationResponseCode,        // 8A, text
+    ApplicationCryptogram,          // 9F26
+    ApplicationTransactionCounter,  // 9F36
+    PanSequenceNumber,              // 5F34
+    IssuerActionCodeOnline,         // 9F0F
+    IssuerActionCodeDenial,         // 9F0E
+    IssuerActionCodeDefault,        // 9F0D
+    CardholderVerificationMethod,   // 9F34
+    EntryMode                       // 9F39
+};
+
+constexpr std::size_t kEmvTagCount = 13;
+
+/*!
+ * @brief BER tag number of a curated tag
+ */
+std::uint32_t emvTagNumber(EmvTag tag);
+
+/*!
+ * @brief Whether a curated tag holds text (an, ans) rather than binary shown as hex
+ */
+bool emvTagIsText(EmvTag tag);
+
+/*!
+ * @brief Curated tags of an EMV buffer, located in one pass on the first lookup
+ * @discussion Borrows the buffer, which must outlive it. Not thread-safe until the first
+ * lookup has returned; callers that share one across threads resolve() it up front.
+ */
+class EmvTags {
+public:
+    EmvTags(const std::uint8_t *data, std::size_t size) : _data(data), _size(size) {}
+
+    bool find(EmvTag tag, ByteRange &value);
+
+    /*!
+     * @brief Locate every curated tag now
+     * @return ErrorCode - InvalidArgument if the data is malformed; tags before the damage are still found
+     */
+    ErrorCode resolve();
+
+    bool isResolved() const { return _resolved; }
+
+private:
+    const std::uint8_t *_data;
+    std::size_t _size;
+    bool _resolved = false;
+    ErrorCode _error = ErrorCode::None;
+    std::array<ByteRange, kEmvTagCount> _values{};
+    std::array<bool, kEmvTagCount> _present{};
+};
+
+} // namespace cft
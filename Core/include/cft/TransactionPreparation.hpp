@@ -0,0 +1,130 @@
+/*!
+ * @header TransactionPreparation.hpp
+ *
+ * @brief Readiness of a transaction prepared before its amount is known.
+ * Validating the merchant account, arming the reader and opening the gateway connection are
+ * started as independent steps when the checkout screen appears. The amount can be bound at any
+ * point; the transaction starts as soon as it is bound and every step has finished, so a
+ * cashier pressing "Charge" only waits for whatever preparation is still outstanding.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Clock.hpp"
+#include "cft/Error.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef PreparationStep
+ * @constant MerchantAccount The account is validated and its configuration cached
+ * @constant Reader The connected reader is kept connected and ready for card input
+ * @constant Gateway A connection to the gateway is open
+ */
+enum class PreparationStep : std::uint8_t {
+    MerchantAccount,
+    Reader,
+    Gateway
+};
+
+constexpr std::size_t kPreparationStepCount = 3;
+
+constexpr std::uint8_t preparationStepBit(PreparationStep step) {
+    return static_cast<std::uint8_t>(1u << static_cast<unsigned>(step));
+}
+
+/*!
+ * @typedef PreparationState
+ * @constant Preparing Steps are outstanding and no amount is bound
+ * @constant Ready Every step finished; waiting for the amount
+ * @constant Bound The amount is bound; the transaction starts once isReady()
+ * @constant Failed A required step failed, see error()
+ * @constant Expired Ready for longer than the time to live without an amount; binding it still
+ * starts the transaction, without the benefit of preparation
+ * @constant Canceled cancel() was called
+ */
+enum class PreparationState : std::uint8_t {
+    Preparing,
+    Ready,
+    Bound,
+    Failed,
+    Expired,
+    Canceled
+};
+
+/*!
+ * @brief Steps and amount of one prepared transaction
+ * @discussion Not thread-safe; the shim drives it from the main queue.
+ */
+class TransactionPreparation {
+public:
+    /*!
+     * @param requiredSteps std::uint8_t - preparationStepBit()s of steps whose failure fails the preparation.
+     * Other steps only warm things up: when they fail, the transaction pays for them itself.
+     * @param timeToLive Nanos - How long a ready preparation stays usable, 0 for no limit
+     */
+    TransactionPreparation(std::uint8_t requiredSteps, Nanos timeToLive, ClockFunction clock = monotonicNanos);
+
+    /*!
+     * @brief Record the outcome of a step
+     * @return ErrorCode - IllegalTransition if the step already finished or the preparation failed or was canceled
+     */
+    ErrorCode complete(PreparationStep step, ErrorCode error);
+
+    /*!
+     * @brief Bind the amount, whether or not preparation has finished
+     * @return ErrorCode - InvalidArgument for amounts below one minor unit, IllegalTransition unless
+     * Preparing, Ready or Expired. A preparation is bound at most once.
+     */
+    ErrorCode bind(std::int64_t amountMinor);
+
+    void cancel();
+
+    PreparationState state() const;
+
+    /*!
+     * @brief Every step finished and no required step failed
+     */
+    bool isReady() const;
+
+    /*!
+     * @brief Bound and ready: the moment to start the transaction
+     */
+    bool shouldStart() const { return state() == PreparationState::Bound && isReady(); }
+
+    std::uint8_t finishedSteps() const { return _finished; }
+    std::uint8_t warmedSteps() const { return _warmed; }
+    ErrorCode error() const { return _error; }
+    std::int64_t amountMinor() const { return _amountMinor; }
+
+    /*!
+     * @brief Time from construction until the last step finished, 0 while preparing
+     */
+    Nanos preparationTime() const { return _readyAt == 0 ? 0 : _readyAt - _createdAt; }
+
+private:
+    static constexpr std::uint8_t kAllSteps = (1u << kPreparationStepCount) - 1;
+
+    ClockFunction _clock;
+    std::uint8_t _required;
+    std::uint8_t _finished = 0;
+    std::uint8_t _warmed = 0;
+    Nanos _timeToLive;
+    Nanos _createdAt;
+    Nanos _readyAt = 0;
+    PreparationState _state = PreparationState::Preparing;
+    ErrorCode _error = ErrorCode::None;
+    std::int64_t _amountMinor = 0;
+};
+
+/*!
+ * @brief Printable name of a preparation state
+ */
+const char *preparationStateName(PreparationState state);
+
+} // namespace cft
@@ -0,0 +1,247 @@
+/*!
+ * @header TransactionRecordStore.hpp
+ *
+ * @brief On-device, memory-mapped store of transaction record summaries keyed by transaction id,
+ * with secondary indexes on creation time, API state, last four and reference id.
+ *
+ * The file is a 64-byte header followed by fixed-size 256-byte slots, so a record is read and
+ * patched in place through the mapping. Each slot carries a CRC-32; a slot torn by a crash fails
+ * its check and is dropped when the store is opened. The indexes live in memory and are rebuilt
+ * from the slots on open.
+ *
+ * Every write stamps the slot with the next change sequence number, which doubles as a
+ * cursor: changesSince(cursor) returns the records changed after it, each with the state it
+ * had before its latest state change. applyDelta() patches state fields of a slot in place.
+ *
+ * A record settled on the device by closing a batch stays Settled while the gateway still
+ * reports it approved, so a refresh that lags the close does not put it back in the open batch.
+ * The number of that open batch is kept in the header.
+ *
+ * File layout, little-endian:
+ *   header  "CFTRECS\0" u32 version u32 slotSize u32 capacity u32 reserved u64 latestChangeSequence
+ *           u64 settlementBatchNumber (0 in files written before it was kept), zero padding to 64 bytes
+ *   slots   capacity x StoredTransactionRecord
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cft/Error.hpp"
+#include "cft/File.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+constexpr std::size_t kStoredTextCapacity = 64;
+
+/*!
+ * Summary of a CFTTransactionRecord as stored in a slot. Text fields are NUL-padded
+ * and hold at most their size in characters.
+ */
+struct StoredTransactionRecord {
+    std::uint32_t checksum;
+    std::uint8_t flags;
+    std::uint8_t apiTransactionState;
+    std::uint8_t result;
+    std::uint8_t transactionType;
+    std::int64_t createdAtMillis;
+    /*! -1 when the record has not been transacted */
+    std::int64_t transactedAtMillis;
+    std::int64_t amountMinor;
+    /*! Last time the stored summary changed, set by the caller */
+    std::int64_t updatedAtMillis;
+    std::uint8_t cardBrand;
+    std::uint8_t cardInputMethod;
+    char lastFour[4];
+    /*! State before the latest state change, equal to apiTransactionState until the state first changes */
+    std::uint8_t previousApiTransactionState;
+    std::uint8_t networkType;
+    char transactionId[kStoredTextCapacity];
+    char chargeId[kStoredTextCapacity];
+    char referenceId[kStoredTextCapacity];
+    /*! Assigned by the store on every write, see changesSince() */
+    std::uint64_t changeSequence;
+    /*! Tip on top of amountMinor; 0 in slots written before tips were stored */
+    std::int64_t tipMinor;
+
+    ApiTransactionState state() const { return static_cast<ApiTransactionState>(apiTransactionState); }
+    ApiTransactionState previousState() const { return static_cast<ApiTransactionState>(previousApiTransactionState); }
+    std::string lastFourText() const;
+
+    /*!
+     * @brief Copy text into a fixed field
+     * @return ErrorCode::InvalidArgument when text does not fit
+     */
+    template <std::size_t N>
+    static ErrorCode assign(char (&field)[N], const std::string &text);
+
+    template <std::size_t N>
+    static std::string text(const char (&field)[N]);
+};
+
+static_assert(sizeof(StoredTransactionRecord) == 256, "StoredTransactionRecord is persisted and must stay 256 bytes");
+
+/*!
+ * Conjunction of filters. Unset filters match everything; the time range is
+ * [createdFromMillis, createdToMillis).
+ */
+struct TransactionRecordQuery {
+    std::int64_t createdFromMillis = std::numeric_limits<std::int64_t>::min();
+    std::int64_t createdToMillis = std::numeric_limits<std::int64_t>::max();
+    bool matchState = false;
+    ApiTransactionState state = ApiTransactionState::Unknown;
+    std::string lastFour;
+    std::string referenceId;
+    std::size_t limit = std::numeric_limits<std::size_t>::max();
+};
+
+/*!
+ * State of one record as reported by the gateway, applied with applyDelta().
+ */
+struct TransactionRecordDelta {
+    std::string transactionId;
+    ApiTransactionState state = ApiTransactionState::Unknown;
+    TransactionResult result = TransactionResult::Unknown;
+    /*! -1 to leave the stored value */
+    std::int64_t transactedAtMillis = -1;
+    std::int64_t updatedAtMillis = 0;
+};
+
+struct TransactionRecordStoreConfig {
+    /*! The oldest records by createdAt are evicted beyond this. */
+    std::size_t maxRecords = 20000;
+    /*! Sync each written slot before put() returns. */
+    bool syncOnWrite = false;
+};
+
+class TransactionRecordStore {
+public:
+    static ErrorCode open(const std::string &path, const TransactionRecordStoreConfig &config,
+                          std::unique_ptr<TransactionRecordStore> &store);
+
+    /*!
+     * @brief Insert a record or replace the one with the same transactionId
+     * @return ErrorCode::InvalidArgument when transactionId is empty
+     */
+    ErrorCode put(const StoredTransactionRecord &record);
+
+    /*!
+     * @brief Patch the state of a stored record in place
+     * @param changed bool - Set to whether any stored field differed; unchanged records keep their sequence
+     * @return ErrorCode::NotFound when no record has the delta's transactionId
+     */
+    ErrorCode applyDelta(const TransactionRecordDelta &delta, bool &changed);
+
+    /*!
+     * @brief Mark a record Settled by a batch closed on the device
+     * @discussion Until a delta or put() reports it Settled, or in a state other than Approved,
+     * reports of it as Approved leave it Settled.
+     * @return ErrorCode::NotFound when no record has transactionId
+     */
+    ErrorCode settleLocally(const std::string &transactionId, std::int64_t updatedAtMillis);
+
+    /*!
+     * @brief Number of the open settlement batch of the records in the store, 1 until set
+     */
+    std::uint64_t settlementBatchNumber() const;
+
+    ErrorCode setSettlementBatchNumber(std::uint64_t batchNumber);
+
+    /*!
+     * @brief Replace the stored tip, provided it is still expectedTipMinor
+     * @return ErrorCode::NotFound when no record has transactionId, IllegalTransition when its tip
+     * is no longer expectedTipMinor
+     */
+    ErrorCode compareAndSetTip(const std::string &transactionId, std::int64_t expectedTipMinor, std::int64_t tipMinor,
+                               std::int64_t updatedAtMillis);
+
+    /*!
+     * @brief Records changed after cursor, oldest change first
+     * @param nextCursor std::uint64_t - Cursor to pass next time; covers exactly the records returned
+     */
+    std::vector<StoredTransactionRecord> changesSince(std::uint64_t cursor, std::size_t limit, std::uint64_t &nextCursor) const;
+
+    /*!
+     * @brief Sequence number of the latest change; changesSince(cursor()) is empty
+     */
+    std::uint64_t cursor() const;
+
+    bool get(const std::string &transactionId, StoredTransactionRecord &record) const;
+    ErrorCode remove(const std::string &transactionId);
+
+    /*!
+     * @brief Records matching every filter, newest first, at most query.limit of them
+     * @discussion Runs on the most selective index: reference id, then last four, then state,
+     * then creation time. Each index is ordered by creation time within a key, so a limited
+     * query stops after limit matches.
+     */
+    std::vector<StoredTransactionRecord> query(const TransactionRecordQuery &query) const;
+
+    std::size_t count() const;
+    ErrorCode sync();
+
+private:
+    template <typename Key>
+    using Index = std::multimap<std::pair<Key, std::int64_t>, std::uint32_t>;
+
+    TransactionRecordStore(const TransactionRecordStoreConfig &config);
+
+    ErrorCode load(const std::string &path);
+    ErrorCode grow();
+    StoredTransactionRecord *slot(std::uint32_t index) const;
+    void index(std::uint32_t slotIndex, const StoredTransactionRecord &record);
+    void unindex(std::uint32_t slotIndex, const StoredTransactionRecord &record);
+    void removeSlot(std::uint32_t slotIndex);
+    ErrorCode writeSlot(std::uint32_t slotIndex, const StoredTransactionRecord &record);
+
+    const TransactionRecordStoreConfig _config;
+
+    mutable std::mutex _lock;
+    File _file;
+    MappedRegion _region;
+    std::uint32_t _capacity = 0;
+    std::vector<std::uint32_t> _freeSlots;
+
+    std::uint64_t _sequence = 0;
+    std::unordered_map<std::string, std::uint32_t> _byTransactionId;
+    std::map<std::uint64_t, std::uint32_t> _bySequence;
+    // Keyed by (0, createdAt) so that every index is scanned the same way.
+    Index<std::uint8_t> _byCreatedAt;
+    Index<std::uint8_t> _byState;
+    Index<std::uint32_t> _byLastFour;
+    Index<std::string> _byReferenceId;
+};
+
+template <std::size_t N>
+ErrorCode StoredTransactionRecord::assign(char (&field)[N], const std::string &text) {
+    if (text.size() > N) {
+        return ErrorCode::InvalidArgument;
+    }
+    std::memset(field, 0, N);
+    std::memcpy(field, text.data(), text.size());
+    return ErrorCode::None;
+}
+
+template <std::size_t N>
+std::string StoredTransactionRecord::text(const char (&field)[N]) {
+    std::size_t length = 0;
+    while (length < N && field[length] != '\0') {
+        ++length;
+    }
+    return std::string(field, length);
+}
+
+} // namespace cft
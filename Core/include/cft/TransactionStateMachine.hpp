@@ -0,0 +1,132 @@
+/*!
+ * @header TransactionStateMachine.hpp
+ *
+ * @brief Headless model of the CFTTransaction state flow.
+ * The machine owns no I/O: readers, gateways and UI feed it events and it answers
+ * with the resulting CFTTransactionState, or ErrorCode::IllegalTransition when the
+ * event is not valid from the current state.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Clock.hpp"
+#include "cft/Error.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef TransactionEvent
+ * @brief Inputs that move a transaction between states
+ * @constant Begin Transaction object created
+ * @constant AttachParameters Amount and merchant account bound, reader setup may begin
+ * @constant ReceiveCardInput Card data captured by a reader or keyed entry
+ * @constant SelectProcess CFTProcessOptionProcess selected
+ * @constant SelectDefer CFTProcessOptionDefer selected
+ * @constant SelectCancel CFTProcessOptionCancel selected, or card input abandoned
+ * @constant Resume Deferred transaction data handed back to resumeDeferredTransaction
+ * @constant RequestCvm Gateway or card requested a cardholder verification method
+ * @constant AttachCvm Signature or PIN attached
+ * @constant RequestAdjustment Adjustment requested through didRequestAdjustmentForTransaction
+ * @constant AttachAdjustment Adjustment attached
+ * @constant Complete Gateway returned a final result
+ * @constant Fail Transaction errored and cannot continue
+ */
+enum class TransactionEvent : std::uint8_t {
+    Begin = 0,
+    AttachParameters,
+    ReceiveCardInput,
+    SelectProcess,
+    SelectDefer,
+    SelectCancel,
+    Resume,
+    RequestCvm,
+    AttachCvm,
+    RequestAdjustment,
+    AttachAdjustment,
+    Complete,
+    Fail
+};
+
+constexpr std::size_t kTransactionEventCount = 13;
+
+/*!
+ * @brief Printable name of a transaction event
+ */
+const char *transactionEventName(TransactionEvent event);
+
+class TransactionStateMachine {
+public:
+    /*!
+     * @brief Receives every accepted transition
+     * @discussion Called synchronously on the thread that applied the event, after the
+     * machine has moved to the new state. timeInPrevious is the monotonic time spent in the
+     * state that was just left.
+     */
+    class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void stateMachineDidTransition(const TransactionStateMachine &machine,
+                                               TransactionState from,
+                                               TransactionState to,
+                                               Nanos timeInPrevious) = 0;
+    };
+
+    /*!
+     * @brief Target state of event from state
+     * @return TransactionState::Unknown when the transition is illegal
+     */
+    static TransactionState targetState(TransactionState state, TransactionEvent event);
+
+    /*!
+     * @brief Whether a transaction can be left in this state
+     * @discussion Completed and Deferred are the only states a transaction ends in.
+     */
+    static bool isTerminal(TransactionState state);
+
+    explicit TransactionStateMachine(Observer *observer = nullptr, ClockFunction clock = monotonicNanos);
+
+    TransactionState state() const { return _state; }
+    TransactionResult result() const { return _result; }
+    Nanos enteredStateAt() const { return _enteredStateAt; }
+    std::uint32_t transitionCount() const { return _transitionCount; }
+
+    void setObserver(Observer *observer) { _observer = observer; }
+
+    /*!
+     * @brief Apply an event
+     * @param event TransactionEvent
+     * @param result TransactionResult - Only read for Complete. Cancel and Fail imply Canceled and Errored.
+     * @return ErrorCode::IllegalTransition if the event is not valid from the current state, state is unchanged
+     */
+    ErrorCode apply(TransactionEvent event, TransactionResult result = TransactionResult::Unknown);
+
+    /*!
+     * @brief Move to an externally observed state
+     * @discussion Used by the shim, which learns about states from didUpdateState: rather
+     * than about events. Succeeds if any single event leads from the current state to state.
+     */
+    ErrorCode transitionTo(TransactionState state);
+
+    /*!
+     * @brief Return to TransactionState::Unknown so the machine can be reused for another transaction
+     */
+    void reset();
+
+private:
+    void enter(TransactionState state);
+
+    Observer *_observer;
+    ClockFunction _clock;
+    TransactionState _state;
+    TransactionResult _result;
+    Nanos _enteredStateAt;
+    std::uint32_t _transitionCount;
+};
+
+} // namespace cft
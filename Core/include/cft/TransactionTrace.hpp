@@ -0,0 +1,138 @@
+/*!
+ * @header TransactionTrace.hpp
+ *
+ * @brief Monotonic timeline of one transaction and fleet-wide aggregation of many.
+ * A TransactionTrace records every state change, card reader event and gateway round trip
+ * of a transaction into a fixed array, then breaks the timeline down into time per state and
+ * the segments a slow sale is usually blamed on: waiting for the card, reading it (including
+ * application selection) and talking to the gateway. A TraceAggregator folds breakdowns into
+ * histograms so p50 and p99 of each can be compared across transactions.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "cft/Clock.hpp"
+#include "cft/Error.hpp"
+#include "cft/LatencyHistogram.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+/*!
+ * @typedef TraceEventKind
+ * @constant State value is the TransactionState entered
+ * @constant ReaderEvent value is the CardReaderEvent received
+ * @constant GatewayRequest value identifies the request, e.g. a GatewayOperation
+ * @constant GatewayResponse value matches the request's
+ */
+enum class TraceEventKind : std::uint8_t {
+    State,
+    ReaderEvent,
+    GatewayRequest,
+    GatewayResponse
+};
+
+struct TraceEvent {
+    Nanos at = 0;
+    TraceEventKind kind = TraceEventKind::State;
+    std::int32_t value = 0;
+    ErrorCode error = ErrorCode::None;
+};
+
+/*!
+ * @typedef TraceSegment
+ * @constant Total First to last event
+ * @constant CardPresentation From asking for card input to the first card event, i.e. the cardholder and reader I/O
+ * @constant CardReading From the first card event to leaving PendingCardInput, which covers chip application selection
+ * @constant Gateway Sum of gateway round trips
+ */
+enum class TraceSegment : std::uint8_t {
+    Total,
+    CardPresentation,
+    CardReading,
+    Gateway
+};
+
+constexpr std::size_t kTraceSegmentCount = 4;
+
+struct TraceBreakdown {
+    // Exclusive time in each state; the terminal state contributes nothing.
+    std::array<Nanos, kTransactionStateCount> inState{};
+    std::array<Nanos, kTraceSegmentCount> segments{};
+    std::array<std::uint32_t, kTransactionStateCount> entries{};
+    std::uint32_t gatewayRequests = 0;
+    // Keyed transactions have no card presentation or reading.
+    bool hasCardEvent = false;
+};
+
+/*!
+ * @brief Timeline of one transaction
+ * @discussion Not thread-safe; a transaction's callbacks arrive on one queue. Recording never
+ * allocates: events past kCapacity are counted in droppedCount() and left out.
+ */
+class TransactionTrace {
+public:
+    static constexpr std::size_t kCapacity = 64;
+
+    explicit TransactionTrace(ClockFunction clock = monotonicNanos) : _clock(clock) {}
+
+    void recordState(TransactionState state, ErrorCode error = ErrorCode::None);
+    void recordReaderEvent(CardReaderEvent event, ErrorCode error = ErrorCode::None);
+    void recordGatewayRequest(std::int32_t request);
+    void recordGatewayResponse(std::int32_t request, ErrorCode error = ErrorCode::None);
+
+    void reset();
+
+    const TraceEvent *events() const { return _events.data(); }
+    std::size_t size() const { return _size; }
+    std::uint32_t droppedCount() const { return _dropped; }
+
+    TraceBreakdown breakdown() const;
+
+private:
+    void record(TraceEventKind kind, std::int32_t value, ErrorCode error);
+
+    ClockFunction _clock;
+    std::array<TraceEvent, kCapacity> _events{};
+    std::size_t _size = 0;
+    std::uint32_t _dropped = 0;
+};
+
+/*!
+ * @brief Histograms of many transactions' breakdowns
+ * @discussion Not thread-safe; aggregate per thread and merge, like StateLatencyRecorder.
+ */
+class TraceAggregator {
+public:
+    void add(const TraceBreakdown &breakdown);
+    void merge(const TraceAggregator &other);
+    void clear();
+
+    std::uint64_t count() const { return _count; }
+
+    const LatencyHistogram &state(TransactionState state) const {
+        return _states[static_cast<std::size_t>(state)];
+    }
+
+    const LatencyHistogram &segment(TraceSegment segment) const {
+        return _segments[static_cast<std::size_t>(segment)];
+    }
+
+private:
+    std::array<LatencyHistogram, kTransactionStateCount> _states{};
+    std::array<LatencyHistogram, kTraceSegmentCount> _segments{};
+    std::uint64_t _count = 0;
+};
+
+/*!
+ * @brief Printable name of a segment
+ */
+const char *traceSegmentName(TraceSegment segment);
+
+} // namespace cft
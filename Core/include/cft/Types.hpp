@@ -0,0 +1,229 @@
+/*!
+ * @header Types.hpp
+ *
+ * @brief Portable mirrors of the public enumerations declared in CFTEnum.h.
+ * Raw values are identical to their Objective-C counterparts so that values
+ * can be cast across the shim boundary without a lookup table.
+ *
+ * @copyright 2019 CardFlight Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cft {
+
+/*!
+ * @typedef Nanos
+ * @brief Monotonic nanoseconds, used for every timestamp and duration in the core.
+ */
+using Nanos = std::uint64_t;
+
+/*! @brief Mirrors CFTTransactionState. */
+enum class TransactionState : std::int32_t {
+    Unknown = 0,
+    PendingTransactionParameters = 1,
+    PendingCardInput = 2,
+    PendingProcessOption = 3,
+    Processing = 4,
+    Completed = 5,
+    Deferred = 6,
+    PendingCvm = 7,
+    PendingAdjustment = 8
+};
+
+constexpr std::size_t kTransactionStateCount = 9;
+
+/*! @brief Mirrors CFTCardReaderEvent. */
+enum class CardReaderEvent : std::int32_t {
+    Unknown = 0,
+    Disconnected = 1,
+    Connected = 2,
+    ConnectionErrored = 3,
+    CardSwiped = 4,
+    CardSwipeErrored = 5,
+    CardInserted = 6,
+    CardInsertErrored = 7,
+    CardRemoved = 8,
+    CardTapped = 9,
+    CardTapErrored = 10,
+    UpdateStarted = 11,
+    UpdateCompleted = 12,
+    AudioRecordingPermissionNotGranted = 13,
+    FatalError = 14,
+    Connecting = 15,
+    BatteryStatusUpdated = 16
+};
+
+constexpr std::size_t kCardReaderEventCount = 17;
+
+/*! @brief Mirrors CFTCardInputMethod. */
+enum class CardInputMethod : std::int32_t {
+    Unknown = 0,
+    Key = 1,
+    Swipe = 2,
+    Dip = 3,
+    Tap = 4,
+    SwipeFallback = 5,
+    QuickChip = 6
+};
+
+constexpr std::size_t kCardInputMethodCount = 7;
+
+/*! @brief Mirrors CFTProcessOption. */
+enum class ProcessOption : std::int32_t {
+    Unknown = 0,
+    Process = 1,
+    Defer = 2,
+    Cancel = 3
+};
+
+/*! @brief Mirrors CFTCVM. */
+enum class Cvm : std::int32_t {
+    Unknown = 0,
+    None = 1,
+    Signature = 2,
+    Pin = 3
+};
+
+/*! @brief Mirrors CFTTransactionResult. */
+enum class TransactionResult : std::int32_t {
+    Unknown = 0,
+    Approved = 1,
+    Declined = 2,
+    Errored = 3,
+    Canceled = 4,
+    Voided = 5
+};
+
+/*! @brief Mirrors CFTTransactionType. */
+enum class TransactionType : std::int32_t {
+    Unknown = 0,
+    Sale = 1,
+    Refund = 2,
+    Authorization = 3,
+    Tokenization = 4
+};
+
+constexpr std::size_t kTransactionTypeCount = 5;
+
+/*! @brief Mirrors CFTApiTransactionState. */
+enum class ApiTransactionState : std::int32_t {
+    Unknown = 0,
+    PendingPreApproved = 1,
+    PreApproved = 2,
+    PendingApproved = 3,
+    Approved = 4,
+    PendingVoid = 5,
+    Voided = 6,
+    Declined = 7,
+    Settled = 8,
+    Canceled = 9
+};
+
+constexpr std::size_t kApiTransactionStateCount = 10;
+
+/*! @brief Mirrors CFTCardBrand. */
+enum class CardBrand : std::int32_t {
+    Unknown = 0,
+    AmericanExpress = 1,
+    DinersClub = 2,
+    DiscoverCard = 3,
+    JCB = 4,
+    Mastercard = 5,
+    Visa = 6
+};
+
+constexpr std::size_t kCardBrandCount = 7;
+
+/*! @brief Mirrors CFTReachability. */
+enum class Reachability : std::int32_t {
+    Unknown = 0,
+    Full = 1,
+    Restricted = 2
+};
+
+/*! @brief Mirrors CFTCardReaderModel. */
+enum class CardReaderModel : std::int32_t {
+    Unknown = 0,
+    Shuttle = 1,
+    BTMag = 2,
+    A100 = 3,
+    A200 = 4,
+    B550 = 5,
+    B500 = 6,
+    A250 = 7,
+    B200 = 8,
+    B250 = 9
+};
+
+constexpr std::size_t kCardReaderModelCount = 10;
+
+/*! @brief Mirrors CFTNetworkType. */
+enum class NetworkType : std::int32_t {
+    Unknown = 0,
+    Credit = 1,
+    Debit = 2
+};
+
+constexpr std::size_t kNetworkTypeCount = 3;
+
+/*! @brief Mirrors CFTMerchantAccountSettlementScheme. */
+enum class SettlementScheme : std::int32_t {
+    Unknown = 0,
+    BroadPosAuto = 1,
+    BroadPosManual = 2,
+    HostAuto = 3,
+    GatewayAuto = 4
+};
+
+/*! @brief Mirrors CFTMerchantAccountCapability. */
+enum class MerchantAccountCapability : std::int32_t {
+    CanProcessCredit = 0,
+    CanAdjustTransactions = 1,
+    CanDeferTransactions = 2,
+    CanProcessDebit = 3
+};
+
+/*! @brief Mirrors CFTTransactionCapability. */
+enum class TransactionCapability : std::int32_t {
+    CanBeRefundedWithCardInput = 0,
+    CanBeRefundedWithoutCardInput = 1,
+    CanBeVoided = 2
+};
+
+/*! @brief Mirrors CFTDeviceManagerCapability. */
+enum class DeviceManagerCapability : std::int32_t {
+    HasIntegratedKeypad = 0
+};
+
+/*!
+ * @brief Printable name of a transaction state, matching the Swift names in CFTEnum.h.
+ */
+const char *transactionStateName(TransactionState state);
+
+/*!
+ * @brief Printable name of a card reader event, matching the Swift names in CFTEnum.h.
+ */
+const char *cardReaderEventName(CardReaderEvent event);
+
+/*!
+ * @brief Printable name of a card input method, matching the Swift names in CFTEnum.h.
+ */
+const char *cardInputMethodName(CardInputMethod method);
+
+/*!
+ * @brief Printable name of a card reader model, matching the Swift names in CFTEnum.h.
+ */
+const char *cardReaderModelName(CardReaderModel model);
+
+/*!
+ * @brief Whether a record in this API state can no longer change on the gateway
+ * @discussion Voided, declined, settled and canceled records are final; everything else
+ * may still move, e.g. pendingApproved to approved to settled.
+ */
+bool isFinalApiTransactionState(ApiTransactionState state);
+
+} // namespace cft
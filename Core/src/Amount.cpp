@@ -0,0 +1,201 @@
+//
+//  Amount.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/Amount.hpp"
+
+#include <limits>
+
+namespace cft {
+
+namespace {
+
+using Wide = __int128;
+
+constexpr std::int64_t kMaxMinorUnits = std::numeric_limits<std::int64_t>::max();
+constexpr std::int64_t kMinMinorUnits = std::numeric_limits<std::int64_t>::min();
+
+// Sums of a block this long cannot overflow while every value is within ±kSafeMagnitude.
+constexpr std::size_t kBlockSize = 1024;
+constexpr std::uint64_t kSafeMagnitude = std::uint64_t(1) << 52;
+
+constexpr std::uint64_t kPowersOfTen[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+constexpr std::int32_t kMaxPowerOfTen = 19;
+
+bool fits(Wide value) {
+    return value >= kMinMinorUnits && value <= kMaxMinorUnits;
+}
+
+/*!
+ * @brief numerator / denominator rounded half to even, for a positive denominator
+ */
+Wide divideRounded(Wide numerator, Wide denominator) {
+    const bool negative = numerator < 0;
+    const Wide magnitude = negative ? -numerator : numerator;
+    Wide quotient = magnitude / denominator;
+    const Wide twiceRemainder = (magnitude % denominator) * 2;
+    if (twiceRemainder > denominator || (twiceRemainder == denominator && (quotient & 1) != 0)) {
+        ++quotient;
+    }
+    return negative ? -quotient : quotient;
+}
+
+ErrorCode store(Wide value, std::uint8_t exponent, Amount &out) {
+    if (!fits(value)) {
+        return ErrorCode::InvalidArgument;
+    }
+    out = Amount(static_cast<std::int64_t>(value), exponent);
+    return ErrorCode::None;
+}
+
+// Below 2 * kSafeMagnitude exactly when value is within ±kSafeMagnitude. An add and an OR
+// per value are all the bounds check costs, and both vectorize without 64-bit shifts.
+inline std::uint64_t offsetBound(std::int64_t value) {
+    return static_cast<std::uint64_t>(value) + kSafeMagnitude;
+}
+
+Wide exactSum(const std::int64_t *values, std::size_t count) {
+    Wide total = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+} // namespace
+
+constexpr std::uint8_t Amount::kUsdExponent;
+constexpr std::uint8_t Amount::kMaxExponent;
+
+ErrorCode Amount::fromDecimal(std::uint64_t mantissa, std::int32_t decimalExponent, bool negative,
+                              std::uint8_t exponent, Amount &out) {
+    if (exponent > kMaxExponent) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::int32_t shift = decimalExponent + exponent;
+    Wide value;
+    if (mantissa == 0) {
+        value = 0;
+    } else if (shift >= 0) {
+        // Checked before scaling: 2^64 * 10^19 does not fit in 128 bits either.
+        const Wide limit = negative ? -static_cast<Wide>(kMinMinorUnits) : static_cast<Wide>(kMaxMinorUnits);
+        if (shift > kMaxPowerOfTen || static_cast<Wide>(mantissa) > limit / kPowersOfTen[shift]) {
+            return ErrorCode::InvalidArgument;
+        }
+        value = static_cast<Wide>(mantissa) * kPowersOfTen[shift];
+    } else if (-shift > kMaxPowerOfTen) {
+        // Below half a minor unit: 2^64 / 10^20 < 0.5.
+        value = 0;
+    } else {
+        value = divideRounded(static_cast<Wide>(mantissa), kPowersOfTen[-shift]);
+    }
+    return store(negative ? -value : value, exponent, out);
+}
+
+ErrorCode Amount::rescaled(std::uint8_t exponent, Amount &out) const {
+    if (exponent > kMaxExponent) {
+        return ErrorCode::InvalidArgument;
+    }
+    if (exponent >= _exponent) {
+        return store(static_cast<Wide>(_minorUnits) * kPowersOfTen[exponent - _exponent], exponent, out);
+    }
+    return store(divideRounded(_minorUnits, kPowersOfTen[_exponent - exponent]), exponent, out);
+}
+
+ErrorCode Amount::added(Amount other, Amount &out) const {
+    std::int64_t sum;
+    if (other._exponent != _exponent || __builtin_add_overflow(_minorUnits, other._minorUnits, &sum)) {
+        return ErrorCode::InvalidArgument;
+    }
+    out = Amount(sum, _exponent);
+    return ErrorCode::None;
+}
+
+ErrorCode Amount::subtracted(Amount other, Amount &out) const {
+    std::int64_t difference;
+    if (other._exponent != _exponent || __builtin_sub_overflow(_minorUnits, other._minorUnits, &difference)) {
+        return ErrorCode::InvalidArgument;
+    }
+    out = Amount(difference, _exponent);
+    return ErrorCode::None;
+}
+
+ErrorCode Amount::multiplied(std::int64_t factor, Amount &out) const {
+    std::int64_t product;
+    if (__builtin_mul_overflow(_minorUnits, factor, &product)) {
+        return ErrorCode::InvalidArgument;
+    }
+    out = Amount(product, _exponent);
+    return ErrorCode::None;
+}
+
+ErrorCode Amount::percentage(std::int64_t basisPoints, Amount &out) const {
+    return store(divideRounded(static_cast<Wide>(_minorUnits) * basisPoints, 10000), _exponent, out);
+}
+
+ErrorCode sumMinorUnits(const std::int64_t *values, std::size_t count, std::int64_t &total) {
+    Wide wide = 0;
+    for (std::size_t start = 0; start < count; start += kBlockSize) {
+        const std::size_t end = count - start < kBlockSize ? count : start + kBlockSize;
+        // Wrapping unsigned adds keep the loop free of branches; the bound says whether they wrapped.
+        std::uint64_t blockSum = 0;
+        std::uint64_t bounds = 0;
+        for (std::size_t i = start; i < end; ++i) {
+            blockSum += static_cast<std::uint64_t>(values[i]);
+            bounds |= offsetBound(values[i]);
+        }
+        wide += bounds < 2 * kSafeMagnitude ? static_cast<std::int64_t>(blockSum) : exactSum(values + start, end - start);
+    }
+    total = 0;
+    if (!fits(wide)) {
+        return ErrorCode::InvalidArgument;
+    }
+    total = static_cast<std::int64_t>(wide);
+    return ErrorCode::None;
+}
+
+ErrorCode aggregateMinorUnits(const std::int64_t *values, std::size_t count, AmountAggregate &aggregate) {
+    aggregate = AmountAggregate();
+    aggregate.count = count;
+    if (count == 0) {
+        return ErrorCode::None;
+    }
+
+    // A separate pass for the extremes keeps the summing loop as tight as sumMinorUnits'.
+    std::int64_t minimum = values[0];
+    std::int64_t maximum = values[0];
+    for (std::size_t i = 1; i < count; ++i) {
+        minimum = values[i] < minimum ? values[i] : minimum;
+        maximum = values[i] > maximum ? values[i] : maximum;
+    }
+    aggregate.minimum = minimum;
+    aggregate.maximum = maximum;
+    return sumMinorUnits(values, count, aggregate.total);
+}
+
+} // namespace cft
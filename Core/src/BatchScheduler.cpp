@@ -0,0 +1,111 @@
+//
+//  BatchScheduler.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/BatchScheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace cft {
+
+BatchScheduler::BatchScheduler(std::size_t itemCount, std::size_t maxInFlight)
+    : _itemCount(itemCount),
+      _maxInFlight(std::max<std::size_t>(1, maxInFlight)),
+      _done(new bool[itemCount]()) {}
+
+void BatchScheduler::run(StartFunction start, ResultFunction result) {
+    std::unique_lock<std::mutex> lock(_lock);
+    _start = std::move(start);
+    _result = std::move(result);
+    pump(lock);
+}
+
+ErrorCode BatchScheduler::complete(std::size_t index, ErrorCode error) {
+    std::unique_lock<std::mutex> lock(_lock);
+    // Only started items hold a slot; anything else would free one that was never taken.
+    if (index >= _nextIndex) {
+        return ErrorCode::InvalidArgument;
+    }
+    if (_done[index]) {
+        return ErrorCode::IllegalTransition;
+    }
+    _done[index] = true;
+    --_inFlight;
+    if (error == ErrorCode::None) {
+        ++_succeeded;
+    } else {
+        ++_failed;
+    }
+
+    if (_result) {
+        // Results are reported outside the lock so the callback may inspect the scheduler.
+        ResultFunction result = _result;
+        lock.unlock();
+        result(index, error);
+        lock.lock();
+    }
+
+    // Only count the item once its result has been delivered, so wait() never returns
+    // while a result callback is still running.
+    if (++_reported == _itemCount) {
+        _finished.notify_all();
+    }
+    pump(lock);
+    return ErrorCode::None;
+}
+
+void BatchScheduler::pump(std::unique_lock<std::mutex> &lock) {
+    // Only one frame launches items at a time. A synchronous complete() from inside start()
+    // frees its slot and returns; the outer loop then launches the next item, so the
+    // stack depth stays constant however long the batch is.
+    if (_pumping || !_start) {
+        return;
+    }
+    _pumping = true;
+    while (_inFlight < _maxInFlight && _nextIndex < _itemCount) {
+        const std::size_t index = _nextIndex++;
+        ++_inFlight;
+        _peakInFlight = std::max(_peakInFlight, _inFlight);
+
+        StartFunction start = _start;
+        lock.unlock();
+        start(index);
+        lock.lock();
+    }
+    _pumping = false;
+
+    if (_itemCount == 0) {
+        _finished.notify_all();
+    }
+}
+
+void BatchScheduler::wait() {
+    std::unique_lock<std::mutex> lock(_lock);
+    _finished.wait(lock, [this] { return _reported == _itemCount; });
+}
+
+bool BatchScheduler::isFinished() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _reported == _itemCount;
+}
+
+std::size_t BatchScheduler::succeededCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _succeeded;
+}
+
+std::size_t BatchScheduler::failedCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _failed;
+}
+
+std::size_t BatchScheduler::peakInFlight() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _peakInFlight;
+}
+
+} // namespace cft
@@ -0,0 +1,494 @@
+//
+//  BinTable.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/BinTable.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <numeric>
+
+#include "cft/Bytes.hpp"
+#include "cft/CardValidation.hpp"
+#include "cft/Checksum.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr char kFileMagic[8] = {'C', 'F', 'T', 'B', 'I', 'N', 'S', '\0'};
+constexpr char kDeltaMagic[8] = {'C', 'F', 'T', 'B', 'I', 'N', 'D', '\0'};
+constexpr std::uint32_t kFormat = 1;
+constexpr std::size_t kHeaderSize = 32;
+constexpr std::size_t kDeltaHeaderSize = sizeof(kDeltaMagic) + 16;
+
+constexpr std::uint32_t kKeyLimit = 100000000;
+constexpr std::uint32_t kBucketWidth = 10000;
+constexpr std::size_t kBucketCount = kKeyLimit / kBucketWidth;
+// Prefixes of one to four digits: 10 + 100 + 1000 + 10000.
+constexpr std::size_t kBrandPrefixCount = 11110;
+
+constexpr std::size_t padded(std::size_t size) {
+    return (size + 7) / 8 * 8;
+}
+
+constexpr std::size_t kBucketsOffset = kHeaderSize;
+constexpr std::size_t kBrandsOffset = kBucketsOffset + padded((kBucketCount + 1) * sizeof(std::uint32_t));
+constexpr std::size_t kRangesOffset = kBrandsOffset + padded(kBrandPrefixCount);
+
+constexpr std::uint32_t kPowersOfTen[kBinDigits + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+// Index in the brand table of the first prefix with digits digits.
+constexpr std::size_t brandLevelOffset(std::size_t digits) {
+    return (kPowersOfTen[digits] - 10) / 9;
+}
+
+static_assert(brandLevelOffset(1) == 0 && brandLevelOffset(4) + kBucketCount == kBrandPrefixCount, "brand table levels");
+
+StoredBinRange store(const BinRange &range) {
+    StoredBinRange stored = {};
+    stored.low = range.low;
+    stored.high = range.high;
+    stored.brand = static_cast<std::uint8_t>(range.brand);
+    stored.network = static_cast<std::uint8_t>(range.network);
+    stored.flags = range.flags;
+    stored.minPanLength = range.minPanLength;
+    stored.maxPanLength = range.maxPanLength;
+    return stored;
+}
+
+BinRange load(const StoredBinRange &stored) {
+    BinRange range;
+    range.low = stored.low;
+    range.high = stored.high;
+    range.brand = static_cast<CardBrand>(stored.brand);
+    range.network = static_cast<NetworkType>(stored.network);
+    range.flags = stored.flags;
+    range.minPanLength = stored.minPanLength;
+    range.maxPanLength = stored.maxPanLength;
+    return range;
+}
+
+bool isValid(const BinRange &range) {
+    return range.low <= range.high && range.high < kKeyLimit && range.minPanLength <= range.maxPanLength &&
+           static_cast<std::size_t>(range.brand) < kCardBrandCount &&
+           static_cast<std::size_t>(range.network) < kNetworkTypeCount;
+}
+
+bool sameCards(const BinRange &a, const BinRange &b) {
+    return a.brand == b.brand && a.network == b.network && a.flags == b.flags &&
+           a.minPanLength == b.minPanLength && a.maxPanLength == b.maxPanLength;
+}
+
+using RangeMap = std::map<std::uint32_t, BinRange>;
+
+// Clear low..high, then lay range over it if there is one.
+void paint(RangeMap &map, std::uint32_t low, std::uint32_t high, const BinRange *range) {
+    auto it = map.upper_bound(low);
+    if (it != map.begin() && std::prev(it)->second.high >= low) {
+        --it;
+    }
+    std::vector<BinRange> pieces;
+    while (it != map.end() && it->first <= high) {
+        const BinRange covered = it->second;
+        it = map.erase(it);
+        if (covered.low < low) {
+            BinRange left = covered;
+            left.high = low - 1;
+            pieces.push_back(left);
+        }
+        if (covered.high > high) {
+            BinRange right = covered;
+            right.low = high + 1;
+            pieces.push_back(right);
+        }
+    }
+    for (const BinRange &piece : pieces) {
+        map.emplace(piece.low, piece);
+    }
+    if (range != nullptr) {
+        map.emplace(range->low, *range);
+    }
+}
+
+// Sorted and disjoint, with neighbours that describe the same cards merged.
+std::vector<BinRange> flatten(const RangeMap &map) {
+    std::vector<BinRange> ranges;
+    ranges.reserve(map.size());
+    for (const auto &entry : map) {
+        if (!ranges.empty() && ranges.back().high + 1 == entry.second.low && sameCards(ranges.back(), entry.second)) {
+            ranges.back().high = entry.second.high;
+        } else {
+            ranges.push_back(entry.second);
+        }
+    }
+    return ranges;
+}
+
+RangeMap toMap(const std::vector<BinRange> &ranges) {
+    RangeMap map;
+    for (const BinRange &range : ranges) {
+        map.emplace_hint(map.end(), range.low, range);
+    }
+    return map;
+}
+
+std::vector<std::uint8_t> buildImage(const std::vector<BinRange> &ranges, std::uint32_t version) {
+    const auto count = static_cast<std::uint32_t>(ranges.size());
+    std::vector<std::uint8_t> image(kRangesOffset + ranges.size() * sizeof(StoredBinRange), 0);
+
+    std::size_t next = 0;
+    for (std::size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+        while (next < ranges.size() && ranges[next].high < bucket * kBucketWidth) {
+            ++next;
+        }
+        storeLittleEndian(&image[kBucketsOffset + bucket * 4], static_cast<std::uint32_t>(next));
+    }
+    storeLittleEndian(&image[kBucketsOffset + kBucketCount * 4], count);
+
+    // Four-digit prefixes from the ranges, shorter ones from the ten prefixes under each.
+    std::uint8_t *brands = &image[kBrandsOffset];
+    next = 0;
+    for (std::uint32_t bucket = 0; bucket < kBucketCount; ++bucket) {
+        const std::uint32_t low = bucket * kBucketWidth;
+        const std::uint32_t high = low + kBucketWidth - 1;
+        while (next < ranges.size() && ranges[next].high < low) {
+            ++next;
+        }
+        CardBrand brand = CardBrand::Unknown;
+        if (next < ranges.size() && ranges[next].low <= low) {
+            brand = ranges[next].brand;
+            std::uint32_t coveredTo = ranges[next].high;
+            for (std::size_t i = next + 1; coveredTo < high && i < ranges.size(); ++i) {
+                if (ranges[i].low != coveredTo + 1 || ranges[i].brand != brand) {
+                    break;
+                }
+                coveredTo = ranges[i].high;
+            }
+            if (coveredTo < high) {
+                brand = CardBrand::Unknown;
+            }
+        }
+        brands[brandLevelOffset(4) + bucket] = static_cast<std::uint8_t>(brand);
+    }
+    for (std::size_t digits = 3; digits >= 1; --digits) {
+        for (std::size_t prefix = 0; prefix < kPowersOfTen[digits]; ++prefix) {
+            const std::uint8_t *children = brands + brandLevelOffset(digits + 1) + prefix * 10;
+            const bool shared = std::all_of(children, children + 10, [&](std::uint8_t brand) { return brand == children[0]; });
+            brands[brandLevelOffset(digits) + prefix] = shared ? children[0] : static_cast<std::uint8_t>(CardBrand::Unknown);
+        }
+    }
+
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+        const StoredBinRange stored = store(ranges[i]);
+        std::memcpy(&image[kRangesOffset + i * sizeof(StoredBinRange)], &stored, sizeof(stored));
+    }
+
+    std::memcpy(image.data(), kFileMagic, sizeof(kFileMagic));
+    storeLittleEndian(&image[8], kFormat);
+    storeLittleEndian(&image[12], version);
+    storeLittleEndian(&image[16], count);
+    storeLittleEndian(&image[20], crc32(image.data() + kHeaderSize, image.size() - kHeaderSize));
+    return image;
+}
+
+} // namespace
+
+struct BinTable::Image {
+    File file;
+    MappedRegion region;
+    std::uint32_t version = 0;
+    std::uint32_t count = 0;
+
+    std::uint32_t bucket(std::size_t index) const {
+        return loadLittleEndian<std::uint32_t>(region.data() + kBucketsOffset + index * 4);
+    }
+
+    CardBrand prefixBrand(std::size_t digits, std::uint32_t prefix) const {
+        return static_cast<CardBrand>(region.data()[kBrandsOffset + brandLevelOffset(digits) + prefix]);
+    }
+
+    StoredBinRange range(std::size_t index) const {
+        StoredBinRange stored;
+        std::memcpy(&stored, region.data() + kRangesOffset + index * sizeof(StoredBinRange), sizeof(stored));
+        return stored;
+    }
+
+    std::uint32_t high(std::size_t index) const {
+        return loadLittleEndian<std::uint32_t>(region.data() + kRangesOffset + index * sizeof(StoredBinRange) + 4);
+    }
+
+    // First range ending at or after key, or count; searched within key's bucket.
+    std::size_t find(std::uint32_t key) const {
+        const std::size_t bucketIndex = key / kBucketWidth;
+        std::size_t first = bucket(bucketIndex);
+        std::size_t last = std::min<std::size_t>(bucket(bucketIndex + 1) + 1, count);
+        while (first < last) {
+            const std::size_t middle = first + (last - first) / 2;
+            if (high(middle) < key) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return first;
+    }
+
+    static ErrorCode open(const std::string &path, std::shared_ptr<const Image> &image);
+};
+
+ErrorCode BinTable::Image::open(const std::string &path, std::shared_ptr<const Image> &image) {
+    auto opened = std::make_shared<Image>();
+    ErrorCode error = File::openForRead(path, opened->file);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::uint64_t size = 0;
+    error = opened->file.size(size);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    if (size < kRangesOffset) {
+        return ErrorCode::InvalidArgument;
+    }
+    error = MappedRegion::mapReadOnly(opened->file, static_cast<std::size_t>(size), opened->region);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+
+    const std::uint8_t *data = opened->region.data();
+    opened->version = loadLittleEndian<std::uint32_t>(data + 12);
+    opened->count = loadLittleEndian<std::uint32_t>(data + 16);
+    if (std::memcmp(data, kFileMagic, sizeof(kFileMagic)) != 0 || loadLittleEndian<std::uint32_t>(data + 8) != kFormat ||
+        size != kRangesOffset + static_cast<std::uint64_t>(opened->count) * sizeof(StoredBinRange) ||
+        loadLittleEndian<std::uint32_t>(data + 20) != crc32(data + kHeaderSize, static_cast<std::size_t>(size) - kHeaderSize) ||
+        opened->bucket(kBucketCount) != opened->count) {
+        return ErrorCode::InvalidArgument;
+    }
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+        if (opened->bucket(i) > opened->bucket(i + 1)) {
+            return ErrorCode::InvalidArgument;
+        }
+    }
+    image = std::move(opened);
+    return ErrorCode::None;
+}
+
+std::vector<std::uint8_t> encodeBinDelta(const BinDelta &delta) {
+    const std::size_t rangesOffset = kDeltaHeaderSize + delta.removals.size() * 8;
+    std::vector<std::uint8_t> encoded(rangesOffset + delta.ranges.size() * sizeof(StoredBinRange) + 4, 0);
+    std::memcpy(encoded.data(), kDeltaMagic, sizeof(kDeltaMagic));
+    storeLittleEndian(&encoded[8], delta.fromVersion);
+    storeLittleEndian(&encoded[12], delta.toVersion);
+    storeLittleEndian(&encoded[16], static_cast<std::uint32_t>(delta.removals.size()));
+    storeLittleEndian(&encoded[20], static_cast<std::uint32_t>(delta.ranges.size()));
+    for (std::size_t i = 0; i < delta.removals.size(); ++i) {
+        storeLittleEndian(&encoded[kDeltaHeaderSize + i * 8], delta.removals[i].first);
+        storeLittleEndian(&encoded[kDeltaHeaderSize + i * 8 + 4], delta.removals[i].second);
+    }
+    for (std::size_t i = 0; i < delta.ranges.size(); ++i) {
+        const StoredBinRange stored = store(delta.ranges[i]);
+        std::memcpy(&encoded[rangesOffset + i * sizeof(StoredBinRange)], &stored, sizeof(stored));
+    }
+    storeLittleEndian(&encoded[encoded.size() - 4], crc32(encoded.data(), encoded.size() - 4));
+    return encoded;
+}
+
+ErrorCode decodeBinDelta(const std::uint8_t *data, std::size_t size, BinDelta &delta) {
+    if (size < kDeltaHeaderSize + 4 || std::memcmp(data, kDeltaMagic, sizeof(kDeltaMagic)) != 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::uint64_t removals = loadLittleEndian<std::uint32_t>(data + 16);
+    const std::uint64_t ranges = loadLittleEndian<std::uint32_t>(data + 20);
+    if (size != kDeltaHeaderSize + removals * 8 + ranges * sizeof(StoredBinRange) + 4 ||
+        loadLittleEndian<std::uint32_t>(data + size - 4) != crc32(data, size - 4)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    BinDelta decoded;
+    decoded.fromVersion = loadLittleEndian<std::uint32_t>(data + 8);
+    decoded.toVersion = loadLittleEndian<std::uint32_t>(data + 12);
+    const std::uint8_t *cursor = data + kDeltaHeaderSize;
+    for (std::uint64_t i = 0; i < removals; ++i, cursor += 8) {
+        const std::uint32_t low = loadLittleEndian<std::uint32_t>(cursor);
+        const std::uint32_t high = loadLittleEndian<std::uint32_t>(cursor + 4);
+        if (low > high || high >= kKeyLimit) {
+            return ErrorCode::InvalidArgument;
+        }
+        decoded.removals.emplace_back(low, high);
+    }
+    for (std::uint64_t i = 0; i < ranges; ++i, cursor += sizeof(StoredBinRange)) {
+        StoredBinRange stored;
+        std::memcpy(&stored, cursor, sizeof(stored));
+        const BinRange range = load(stored);
+        if (!isValid(range)) {
+            return ErrorCode::InvalidArgument;
+        }
+        decoded.ranges.push_back(range);
+    }
+    delta = std::move(decoded);
+    return ErrorCode::None;
+}
+
+ErrorCode BinTable::write(const std::string &path, const std::vector<BinRange> &ranges, std::uint32_t version) {
+    if (!std::all_of(ranges.begin(), ranges.end(), isValid)) {
+        return ErrorCode::InvalidArgument;
+    }
+    // Widest first, so every narrower range is laid over the ones it sits in.
+    std::vector<std::size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return ranges[a].high - ranges[a].low > ranges[b].high - ranges[b].low;
+    });
+    RangeMap map;
+    for (std::size_t index : order) {
+        paint(map, ranges[index].low, ranges[index].high, &ranges[index]);
+    }
+    const std::vector<std::uint8_t> image = buildImage(flatten(map), version);
+    return File::replace(path, image.data(), image.size());
+}
+
+ErrorCode BinTable::open(const std::string &path, std::unique_ptr<BinTable> &table) {
+    std::shared_ptr<const Image> image;
+    const ErrorCode error = Image::open(path, image);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    table.reset(new BinTable(path, std::move(image)));
+    return ErrorCode::None;
+}
+
+BinTable::BinTable(std::string path, std::shared_ptr<const Image> image)
+    : _path(std::move(path)), _image(std::move(image)) {}
+
+std::shared_ptr<const BinTable::Image> BinTable::snapshot() const {
+    return std::atomic_load_explicit(&_image, std::memory_order_acquire);
+}
+
+BinInfo BinTable::classify(const char *digits, std::size_t count) const {
+    BinInfo info;
+    const std::size_t used = std::min(count, kBinDigits);
+    std::uint32_t prefix = 0;
+    for (std::size_t i = 0; i < used; ++i) {
+        const unsigned digit = static_cast<unsigned>(digits[i] - '0');
+        if (digit > 9) {
+            return BinInfo();
+        }
+        prefix = prefix * 10 + digit;
+    }
+    if (used == 0) {
+        return info;
+    }
+
+    const std::shared_ptr<const Image> image = snapshot();
+    const std::uint32_t width = kPowersOfTen[kBinDigits - used];
+    const std::uint32_t low = prefix * width;
+    const std::uint32_t high = low + width - 1;
+    if (used <= 4) {
+        info.brand = image->prefixBrand(used, prefix);
+    }
+
+    const std::size_t index = image->find(low);
+    if (index == image->count) {
+        return info;
+    }
+    const BinRange range = load(image->range(index));
+    if (range.low <= low && range.high >= high) {
+        info.brand = range.brand;
+        info.network = range.network;
+        info.flags = range.flags;
+        info.minPanLength = range.minPanLength;
+        info.maxPanLength = range.maxPanLength;
+        info.matched = true;
+    } else if (used > 4 && range.low <= low) {
+        // The digits span several ranges, all inside one bucket; the brand holds if they agree.
+        std::uint32_t coveredTo = range.high;
+        for (std::size_t i = index + 1; coveredTo < high && i < image->count; ++i) {
+            const StoredBinRange next = image->range(i);
+            if (next.low != coveredTo + 1 || static_cast<CardBrand>(next.brand) != range.brand) {
+                break;
+            }
+            coveredTo = next.high;
+        }
+        if (coveredTo >= high) {
+            info.brand = range.brand;
+        }
+    }
+    return info;
+}
+
+PanCheck BinTable::checkPan(const char *digits, std::size_t count) const {
+    if (count == 0 || !std::all_of(digits, digits + count, [](char c) { return c >= '0' && c <= '9'; })) {
+        return PanCheck::UnknownBin;
+    }
+    const BinInfo info = classify(digits, count);
+    if (!info.matched) {
+        return count < kBinDigits ? PanCheck::Incomplete : PanCheck::UnknownBin;
+    }
+    if (count < info.minPanLength) {
+        return PanCheck::Incomplete;
+    }
+    if (count > info.maxPanLength) {
+        return PanCheck::TooLong;
+    }
+    return luhnValid(digits, count) ? PanCheck::Valid : PanCheck::BadCheckDigit;
+}
+
+ErrorCode BinTable::applyDelta(const BinDelta &delta) {
+    if (!std::all_of(delta.ranges.begin(), delta.ranges.end(), isValid)) {
+        return ErrorCode::InvalidArgument;
+    }
+    std::lock_guard<std::mutex> guard(_writeLock);
+    const std::shared_ptr<const Image> current = snapshot();
+    if (delta.fromVersion != current->version) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    RangeMap map = toMap(ranges());
+    for (const auto &removal : delta.removals) {
+        if (removal.first > removal.second) {
+            return ErrorCode::InvalidArgument;
+        }
+        paint(map, removal.first, removal.second, nullptr);
+    }
+    for (const BinRange &range : delta.ranges) {
+        paint(map, range.low, range.high, &range);
+    }
+    const std::vector<std::uint8_t> image = buildImage(flatten(map), delta.toVersion);
+    ErrorCode error = File::replace(_path, image.data(), image.size());
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::shared_ptr<const Image> replaced;
+    error = Image::open(_path, replaced);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::atomic_store_explicit(&_image, std::move(replaced), std::memory_order_release);
+    return ErrorCode::None;
+}
+
+std::uint32_t BinTable::version() const {
+    return snapshot()->version;
+}
+
+std::size_t BinTable::rangeCount() const {
+    return snapshot()->count;
+}
+
+std::vector<BinRange> BinTable::ranges() const {
+    const std::shared_ptr<const Image> image = snapshot();
+    std::vector<BinRange> ranges;
+    ranges.reserve(image->count);
+    for (std::size_t i = 0; i < image->count; ++i) {
+        ranges.push_back(load(image->range(i)));
+    }
+    return ranges;
+}
+
+} // namespace cft
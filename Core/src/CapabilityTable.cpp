@@ -0,0 +1,53 @@
+//
+//  CapabilityTable.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/CapabilityTable.hpp"
+
+namespace cft {
+
+bool TransactionCapabilityTable::lookup(const TransactionCapabilityKey &key, CapabilityMask &mask) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto found = _answers.find(key.transactionId);
+    if (found == _answers.end() || found->second.state != key.state) {
+        return false;
+    }
+    mask = found->second.mask;
+    return true;
+}
+
+bool TransactionCapabilityTable::store(const TransactionCapabilityKey &key, CapabilityMask mask) {
+    if (key.transactionId.empty()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    auto inserted = _answers.emplace(key.transactionId, Answer());
+    Answer &answer = inserted.first->second;
+    if (!inserted.second && answer.state == key.state && answer.mask == mask) {
+        return false;
+    }
+    answer.state = key.state;
+    answer.mask = mask;
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    return true;
+}
+
+std::size_t TransactionCapabilityTable::clear() {
+    std::lock_guard<std::mutex> guard(_lock);
+    const std::size_t cleared = _answers.size();
+    _answers.clear();
+    if (cleared > 0) {
+        _generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+    return cleared;
+}
+
+std::size_t TransactionCapabilityTable::learnedCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _answers.size();
+}
+
+} // namespace cft
@@ -0,0 +1,362 @@
+//
+//  CardValidation.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/CardValidation.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CFT_VALIDATION_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CFT_VALIDATION_NEON 1
+#endif
+
+namespace cft {
+
+namespace {
+
+constexpr std::size_t kMinPanLength = 12;
+constexpr std::size_t kMaxPanLength = 19;
+constexpr std::size_t kMaxNameLength = 26;
+// YYMM and the service code.
+constexpr std::size_t kExpiryLength = 4;
+constexpr std::size_t kServiceCodeLength = 3;
+
+// Byte-at-a-time versions of the four loops parsing is made of.
+struct ScalarKernel {
+    // Every byte in [low, high].
+    static bool inRange(const std::uint8_t *bytes, std::size_t count, std::uint8_t low, std::uint8_t high) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (static_cast<std::uint8_t>(bytes[i] - low) > high - low) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Index of the first byte equal to value, count if none is.
+    static std::size_t find(const std::uint8_t *bytes, std::size_t count, std::uint8_t value) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (bytes[i] == value) {
+                return i;
+            }
+        }
+        return count;
+    }
+
+    // XOR of every byte less base, which is how a track's LRC is formed.
+    static std::uint8_t xorFold(const std::uint8_t *bytes, std::size_t count, std::uint8_t base) {
+        std::uint8_t folded = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            folded ^= static_cast<std::uint8_t>(bytes[i] - base);
+        }
+        return folded;
+    }
+
+    static bool luhn(const std::uint8_t *digits, std::size_t count) {
+        unsigned sum = 0;
+        bool doubled = false;
+        for (std::size_t i = count; i-- > 0;) {
+            const unsigned digit = static_cast<unsigned>(digits[i] - '0');
+            if (digit > 9) {
+                return false;
+            }
+            sum += doubled ? (digit > 4 ? digit * 2 - 9 : digit * 2) : digit;
+            doubled = !doubled;
+        }
+        return count > 0 && sum % 10 == 0;
+    }
+};
+
+// Luhn works on blocks of sixteen digits counted from the check digit, so the digits to double
+// are always the even bytes of a block. The leftmost block is padded with '0's, which add nothing.
+constexpr std::size_t kBlock = 16;
+
+#if defined(CFT_VALIDATION_SSE2)
+
+struct VectorKernel {
+    static bool inRange(const std::uint8_t *bytes, std::size_t count, std::uint8_t low, std::uint8_t high) {
+        const __m128i lows = _mm_set1_epi8(static_cast<char>(low));
+        const __m128i spans = _mm_set1_epi8(static_cast<char>(high - low));
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            const __m128i offsets = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i)), lows);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(offsets, spans), spans)) != 0xFFFF) {
+                return false;
+            }
+        }
+        return ScalarKernel::inRange(bytes + i, count - i, low, high);
+    }
+
+    static std::size_t find(const std::uint8_t *bytes, std::size_t count, std::uint8_t value) {
+        const __m128i values = _mm_set1_epi8(static_cast<char>(value));
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            const int mask = _mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i)), values));
+            if (mask != 0) {
+                return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+            }
+        }
+        return i + ScalarKernel::find(bytes + i, count - i, value);
+    }
+
+    static std::uint8_t xorFold(const std::uint8_t *bytes, std::size_t count, std::uint8_t base) {
+        const __m128i bases = _mm_set1_epi8(static_cast<char>(base));
+        __m128i folded = _mm_setzero_si128();
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            folded = _mm_xor_si128(folded, _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i)), bases));
+        }
+        folded = _mm_xor_si128(folded, _mm_srli_si128(folded, 8));
+        folded = _mm_xor_si128(folded, _mm_srli_si128(folded, 4));
+        folded = _mm_xor_si128(folded, _mm_srli_si128(folded, 2));
+        folded = _mm_xor_si128(folded, _mm_srli_si128(folded, 1));
+        return static_cast<std::uint8_t>(_mm_cvtsi128_si32(folded)) ^ ScalarKernel::xorFold(bytes + i, count - i, base);
+    }
+
+    static bool luhn(const std::uint8_t *digits, std::size_t count) {
+        if (count == 0) {
+            return false;
+        }
+        const __m128i zeros = _mm_set1_epi8('0');
+        const __m128i fours = _mm_set1_epi8(4);
+        const __m128i nines = _mm_set1_epi8(9);
+        const __m128i evens = _mm_setr_epi8(-1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0);
+        unsigned sum = 0;
+        std::uint8_t padded[kBlock];
+        for (std::size_t end = count; end > 0;) {
+            const std::uint8_t *block;
+            if (end >= kBlock) {
+                block = digits + end - kBlock;
+                end -= kBlock;
+            } else {
+                std::memset(padded, '0', kBlock);
+                std::memcpy(padded + kBlock - end, digits, end);
+                block = padded;
+                end = 0;
+            }
+            const __m128i values = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block)), zeros);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, nines), nines)) != 0xFFFF) {
+                return false;
+            }
+            const __m128i doubled = _mm_sub_epi8(_mm_add_epi8(values, values),
+                                                 _mm_and_si128(_mm_cmpgt_epi8(values, fours), nines));
+            const __m128i terms = _mm_or_si128(_mm_and_si128(evens, doubled), _mm_andnot_si128(evens, values));
+            const __m128i sums = _mm_sad_epu8(terms, _mm_setzero_si128());
+            sum += static_cast<unsigned>(_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+        }
+        return sum % 10 == 0;
+    }
+};
+
+#elif defined(CFT_VALIDATION_NEON)
+
+struct VectorKernel {
+    static bool inRange(const std::uint8_t *bytes, std::size_t count, std::uint8_t low, std::uint8_t high) {
+        const uint8x16_t lows = vdupq_n_u8(low);
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            if (vmaxvq_u8(vsubq_u8(vld1q_u8(bytes + i), lows)) > high - low) {
+                return false;
+            }
+        }
+        return ScalarKernel::inRange(bytes + i, count - i, low, high);
+    }
+
+    static std::size_t find(const std::uint8_t *bytes, std::size_t count, std::uint8_t value) {
+        const uint8x16_t values = vdupq_n_u8(value);
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            const uint8x16_t equal = vceqq_u8(vld1q_u8(bytes + i), values);
+            if (vmaxvq_u8(equal) != 0) {
+                // Narrowing leaves four bits per byte, so the first set nibble is the first match.
+                const std::uint64_t mask =
+                    vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+                return i + static_cast<std::size_t>(__builtin_ctzll(mask) / 4);
+            }
+        }
+        return i + ScalarKernel::find(bytes + i, count - i, value);
+    }
+
+    static std::uint8_t xorFold(const std::uint8_t *bytes, std::size_t count, std::uint8_t base) {
+        const uint8x16_t bases = vdupq_n_u8(base);
+        uint8x16_t folded = vdupq_n_u8(0);
+        std::size_t i = 0;
+        for (; i + kBlock <= count; i += kBlock) {
+            folded = veorq_u8(folded, vsubq_u8(vld1q_u8(bytes + i), bases));
+        }
+        const uint64x2_t halves = vreinterpretq_u64_u8(folded);
+        std::uint64_t lanes = vgetq_lane_u64(halves, 0) ^ vgetq_lane_u64(halves, 1);
+        lanes ^= lanes >> 32;
+        lanes ^= lanes >> 16;
+        lanes ^= lanes >> 8;
+        return static_cast<std::uint8_t>(lanes) ^ ScalarKernel::xorFold(bytes + i, count - i, base);
+    }
+
+    static bool luhn(const std::uint8_t *digits, std::size_t count) {
+        if (count == 0) {
+            return false;
+        }
+        static const std::uint8_t kEvens[kBlock] = {0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0,
+                                                    0xFF, 0, 0xFF, 0, 0xFF, 0, 0xFF, 0};
+        const uint8x16_t evens = vld1q_u8(kEvens);
+        const uint8x16_t zeros = vdupq_n_u8('0');
+        const uint8x16_t fours = vdupq_n_u8(4);
+        const uint8x16_t nines = vdupq_n_u8(9);
+        unsigned sum = 0;
+        std::uint8_t padded[kBlock];
+        for (std::size_t end = count; end > 0;) {
+            const std::uint8_t *block;
+            if (end >= kBlock) {
+                block = digits + end - kBlock;
+                end -= kBlock;
+            } else {
+                std::memset(padded, '0', kBlock);
+                std::memcpy(padded + kBlock - end, digits, end);
+                block = padded;
+                end = 0;
+            }
+            const uint8x16_t values = vsubq_u8(vld1q_u8(block), zeros);
+            if (vmaxvq_u8(values) > 9) {
+                return false;
+            }
+            const uint8x16_t doubled = vsubq_u8(vaddq_u8(values, values), vandq_u8(vcgtq_u8(values, fours), nines));
+            // At most sixteen nines, so the byte sum cannot wrap.
+            sum += vaddvq_u8(vbslq_u8(evens, doubled, values));
+        }
+        return sum % 10 == 0;
+    }
+};
+
+#else
+
+using VectorKernel = ScalarKernel;
+
+#endif
+
+template <typename Kernel>
+TrackCheck parse(const std::uint8_t *data, std::size_t size, TrackData &track) {
+    if (size == 0 || (data[0] != '%' && data[0] != ';')) {
+        return TrackCheck::BadSentinel;
+    }
+    const bool track1 = data[0] == '%';
+    // Track 1 is six-bit characters from 0x20, track 2 four-bit characters from 0x30.
+    const std::uint8_t base = track1 ? 0x20 : 0x30;
+    const std::uint8_t last = track1 ? 0x5F : 0x3F;
+    const std::size_t limit = std::min(size, track1 ? kTrack1MaxLength : kTrack2MaxLength);
+    const std::size_t end = Kernel::find(data, limit, '?');
+    if (end == limit) {
+        return TrackCheck::BadSentinel;
+    }
+    if (size - end > 2 || !Kernel::inRange(data, end, base, last)) {
+        return TrackCheck::BadCharacter;
+    }
+    const bool hasLrc = size - end == 2;
+    if (hasLrc && (static_cast<std::uint8_t>(data[end + 1] - base) > last - base ||
+                   Kernel::xorFold(data, end + 1, base) != static_cast<std::uint8_t>(data[end + 1] - base))) {
+        return TrackCheck::BadLrc;
+    }
+
+    TrackData parsed;
+    parsed.format = track1 ? 1 : 2;
+    parsed.hasLrc = hasLrc;
+    std::size_t at = 1;
+    if (track1) {
+        if (end < 2 || data[1] != 'B') {
+            return TrackCheck::BadFormat;
+        }
+        at = 2;
+    }
+    const std::uint8_t separator = track1 ? '^' : '=';
+    const std::size_t panLength = Kernel::find(data + at, end - at, separator);
+    if (panLength < kMinPanLength || panLength > kMaxPanLength || panLength == end - at ||
+        !Kernel::inRange(data + at, panLength, '0', '9')) {
+        return TrackCheck::BadFormat;
+    }
+    parsed.pan = {static_cast<std::uint8_t>(at), static_cast<std::uint8_t>(panLength)};
+    at += panLength + 1;
+    if (track1) {
+        const std::size_t nameLength = Kernel::find(data + at, end - at, '^');
+        if (nameLength < 2 || nameLength > kMaxNameLength || nameLength == end - at) {
+            return TrackCheck::BadFormat;
+        }
+        parsed.name = {static_cast<std::uint8_t>(at), static_cast<std::uint8_t>(nameLength)};
+        at += nameLength + 1;
+    }
+    if (end - at < kExpiryLength + kServiceCodeLength ||
+        !Kernel::inRange(data + at, kExpiryLength + kServiceCodeLength, '0', '9')) {
+        return TrackCheck::BadFormat;
+    }
+    parsed.expiry = {static_cast<std::uint8_t>(at), static_cast<std::uint8_t>(kExpiryLength)};
+    parsed.serviceCode = {static_cast<std::uint8_t>(at + kExpiryLength), static_cast<std::uint8_t>(kServiceCodeLength)};
+    at += kExpiryLength + kServiceCodeLength;
+    parsed.discretionary = {static_cast<std::uint8_t>(at), static_cast<std::uint8_t>(end - at)};
+
+    if (!Kernel::luhn(data + parsed.pan.offset, parsed.pan.length)) {
+        return TrackCheck::BadCheckDigit;
+    }
+    track = parsed;
+    return TrackCheck::Valid;
+}
+
+bool twoDigits(const char *text, unsigned &value) {
+    const unsigned tens = static_cast<unsigned>(text[0] - '0');
+    const unsigned ones = static_cast<unsigned>(text[1] - '0');
+    value = tens * 10 + ones;
+    return tens <= 9 && ones <= 9;
+}
+
+} // namespace
+
+const char *vectorValidationKernel() {
+#if defined(CFT_VALIDATION_SSE2)
+    return "sse2";
+#elif defined(CFT_VALIDATION_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+bool luhnValid(const char *digits, std::size_t count, ValidationPath path) {
+    const auto *bytes = reinterpret_cast<const std::uint8_t *>(digits);
+    return path == ValidationPath::Vector ? VectorKernel::luhn(bytes, count) : ScalarKernel::luhn(bytes, count);
+}
+
+bool panValid(const char *digits, std::size_t count) {
+    return count >= kMinPanLength && count <= kMaxPanLength && luhnValid(digits, count);
+}
+
+bool keyedExpiryValid(const char *text, std::size_t count, unsigned year, unsigned month) {
+    unsigned expiryMonth = 0;
+    unsigned expiryYear = 0;
+    if ((count != 4 && (count != 5 || text[2] != '/')) || !twoDigits(text, expiryMonth) ||
+        !twoDigits(text + count - 2, expiryYear) || expiryMonth < 1 || expiryMonth > 12) {
+        return false;
+    }
+    expiryYear += year / 100 * 100;
+    return expiryYear > year || (expiryYear == year && expiryMonth >= month);
+}
+
+bool cvvValid(const char *digits, std::size_t count, CardBrand brand) {
+    const bool rightLength = brand == CardBrand::AmericanExpress ? count == 4
+                           : brand == CardBrand::Unknown         ? count == 3 || count == 4
+                                                                 : count == 3;
+    return rightLength && ScalarKernel::inRange(reinterpret_cast<const std::uint8_t *>(digits), count, '0', '9');
+}
+
+TrackCheck parseTrack(const char *data, std::size_t size, TrackData &track, ValidationPath path) {
+    const auto *bytes = reinterpret_cast<const std::uint8_t *>(data);
+    return path == ValidationPath::Vector ? parse<VectorKernel>(bytes, size, track)
+                                          : parse<ScalarKernel>(bytes, size, track);
+}
+
+} // namespace cft
@@ -0,0 +1,147 @@
+//
+//  Compression.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/Compression.hpp"
+
+#include <cstring>
+
+#include "cft/Bytes.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::size_t kMinMatch = 4;
+// The last bytes of a block are always literals, which keeps the match search in bounds.
+constexpr std::size_t kEndLiterals = 5;
+constexpr std::size_t kMaxOffset = 0xFFFF;
+constexpr unsigned kHashBits = 12;
+
+inline std::uint32_t hash4(std::uint32_t value) {
+    return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+void appendLength(std::vector<std::uint8_t> &out, std::size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(static_cast<std::uint8_t>(length));
+}
+
+void appendSequence(std::vector<std::uint8_t> &out, const std::uint8_t *literals, std::size_t literalCount,
+                    std::size_t offset, std::size_t matchLength) {
+    const std::size_t matchCode = matchLength == 0 ? 0 : matchLength - kMinMatch;
+    const std::uint8_t literalNibble = literalCount < 15 ? static_cast<std::uint8_t>(literalCount) : 15;
+    const std::uint8_t matchNibble = matchCode < 15 ? static_cast<std::uint8_t>(matchCode) : 15;
+    out.push_back(static_cast<std::uint8_t>(literalNibble << 4 | matchNibble));
+    if (literalNibble == 15) {
+        appendLength(out, literalCount - 15);
+    }
+    appendBytes(out, literals, literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    appendLittleEndian(out, static_cast<std::uint16_t>(offset));
+    if (matchNibble == 15) {
+        appendLength(out, matchCode - 15);
+    }
+}
+
+// Reads an extended length; false when the stream ends first.
+bool readLength(const std::uint8_t *data, std::size_t size, std::size_t &position, std::size_t &length) {
+    std::uint8_t byte = 0;
+    do {
+        if (position >= size) {
+            return false;
+        }
+        byte = data[position++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+void compressBlock(const std::uint8_t *data, std::size_t size, std::vector<std::uint8_t> &out) {
+    std::uint32_t table[1u << kHashBits] = {};
+    std::size_t anchor = 0;
+    std::size_t position = 0;
+
+    if (size >= kMinMatch + kEndLiterals) {
+        const std::size_t limit = size - kEndLiterals;
+        while (position + kMinMatch <= limit) {
+            const std::uint32_t value = loadLittleEndian<std::uint32_t>(data + position);
+            std::uint32_t &slot = table[hash4(value)];
+            const std::size_t candidate = slot;
+            slot = static_cast<std::uint32_t>(position + 1);
+
+            if (candidate == 0 || position - (candidate - 1) > kMaxOffset ||
+                loadLittleEndian<std::uint32_t>(data + candidate - 1) != value) {
+                ++position;
+                continue;
+            }
+
+            const std::size_t reference = candidate - 1;
+            std::size_t length = kMinMatch;
+            while (position + length < limit && data[reference + length] == data[position + length]) {
+                ++length;
+            }
+            appendSequence(out, data + anchor, position - anchor, position - reference, length);
+            position += length;
+            anchor = position;
+        }
+    }
+
+    appendSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+ErrorCode decompressBlock(const std::uint8_t *data, std::size_t size, std::uint8_t *out, std::size_t decompressedSize) {
+    std::size_t in = 0;
+    std::size_t written = 0;
+    while (in < size) {
+        const std::uint8_t token = data[in++];
+
+        std::size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(data, size, in, literalCount)) {
+            return ErrorCode::InvalidArgument;
+        }
+        if (literalCount > size - in || literalCount > decompressedSize - written) {
+            return ErrorCode::InvalidArgument;
+        }
+        if (literalCount > 0) {
+            std::memcpy(out + written, data + in, literalCount);
+        }
+        in += literalCount;
+        written += literalCount;
+
+        if (in == size) {
+            break;
+        }
+
+        if (size - in < 2) {
+            return ErrorCode::InvalidArgument;
+        }
+        const std::size_t offset = loadLittleEndian<std::uint16_t>(data + in);
+        in += 2;
+        std::size_t matchLength = (token & 0x0F) + kMinMatch;
+        if ((token & 0x0F) == 15 && !readLength(data, size, in, matchLength)) {
+            return ErrorCode::InvalidArgument;
+        }
+        if (offset == 0 || offset > written || matchLength > decompressedSize - written) {
+            return ErrorCode::InvalidArgument;
+        }
+        // Byte by byte: the source may overlap the bytes being written.
+        const std::uint8_t *source = out + written - offset;
+        for (std::size_t i = 0; i < matchLength; ++i) {
+            out[written + i] = source[i];
+        }
+        written += matchLength;
+    }
+    return written == decompressedSize ? ErrorCode::None : ErrorCode::InvalidArgument;
+}
+
+} // namespace cft
@@ -0,0 +1,192 @@
+//
+//  ConnectionPool.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/ConnectionPool.hpp"
+
+namespace cft {
+
+void ConnectionStats::merge(const ConnectionStats &other) {
+    requests += other.requests;
+    reusedRequests += other.reusedRequests;
+    handshakes += other.handshakes;
+    resumedHandshakes += other.resumedHandshakes;
+    handshakeNanos += other.handshakeNanos;
+    keepAlives += other.keepAlives;
+    closedIdle += other.closedIdle;
+    reconnects += other.reconnects;
+}
+
+ConnectionPool::ConnectionPool(const ConnectionPoolConfig &config) : _config(config) {
+    if (_config.streamsPerConnection == 0) {
+        _config.streamsPerConnection = 1;
+    }
+}
+
+std::size_t ConnectionPool::addHost() {
+    _hosts.emplace_back();
+    return _hosts.size() - 1;
+}
+
+int ConnectionPool::acquire(std::size_t host, Nanos now) {
+    Host &entry = _hosts[host];
+    entry.lastRequest = now;
+    entry.served = true;
+
+    // Pack streams onto the busiest connection, then the most recently used, so that the
+    // fewest connections stay warm and the rest age out.
+    Connection *best = nullptr;
+    for (Connection &connection : entry.connections) {
+        if (!connection.reusable || connection.generation != _generation ||
+            connection.streams >= _config.streamsPerConnection) {
+            continue;
+        }
+        if (best == nullptr || connection.streams > best->streams ||
+            (connection.streams == best->streams && connection.lastUsed > best->lastUsed)) {
+            best = &connection;
+        }
+    }
+    if (best == nullptr) {
+        return -1;
+    }
+    ++best->streams;
+    best->lastUsed = now;
+    return best->handle;
+}
+
+bool ConnectionPool::canResume(std::size_t host, Nanos now) const {
+    const Host &entry = _hosts[host];
+    return entry.hasSession && now - entry.lastHandshake < _config.sessionLifetime;
+}
+
+void ConnectionPool::connected(std::size_t host, int handle, Nanos now) {
+    Host &entry = _hosts[host];
+    entry.connections.push_back({handle, _generation, 1, now, true});
+    entry.connectRequested = false;
+}
+
+PoolRelease ConnectionPool::release(std::size_t host, int handle, bool reusable, Nanos now) {
+    std::vector<Connection> &connections = _hosts[host].connections;
+    std::size_t idle = 0;
+    std::size_t found = connections.size();
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i].handle == handle) {
+            found = i;
+        } else {
+            idle += connections[i].streams == 0;
+        }
+    }
+    if (found == connections.size()) {
+        return PoolRelease::Unknown;
+    }
+
+    Connection &connection = connections[found];
+    if (connection.streams > 0) {
+        --connection.streams;
+    }
+    connection.lastUsed = now;
+    connection.reusable = connection.reusable && reusable;
+    // Other requests may still be running on a dropped connection, so it is only closed after the last.
+    if (connection.streams > 0) {
+        return PoolRelease::Kept;
+    }
+    if (!connection.reusable || connection.generation != _generation || idle >= _config.maxIdlePerHost) {
+        connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(found));
+        return PoolRelease::Close;
+    }
+    return PoolRelease::Kept;
+}
+
+void ConnectionPool::recordRequest(std::size_t host, bool reused) {
+    ConnectionStats &stats = _hosts[host].stats;
+    ++stats.requests;
+    stats.reusedRequests += reused;
+}
+
+void ConnectionPool::recordHandshake(std::size_t host, Nanos duration, bool resumed, Nanos now) {
+    Host &entry = _hosts[host];
+    ++entry.stats.handshakes;
+    entry.stats.resumedHandshakes += resumed;
+    entry.stats.handshakeNanos += duration;
+    entry.hasSession = true;
+    entry.lastHandshake = now;
+}
+
+void ConnectionPool::maintain(Nanos now, std::vector<PoolTask> &tasks) {
+    for (std::size_t host = 0; host < _hosts.size(); ++host) {
+        Host &entry = _hosts[host];
+        const bool warm = isWarm(entry, now);
+        std::vector<Connection> &connections = entry.connections;
+        for (std::size_t i = 0; i < connections.size();) {
+            Connection &connection = connections[i];
+            if (connection.streams > 0) {
+                ++i;
+                continue;
+            }
+            if (connection.generation != _generation || now - connection.lastUsed >= _config.idleTimeout) {
+                tasks.push_back({PoolAction::Close, host, connection.handle});
+                ++entry.stats.closedIdle;
+                connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+                continue;
+            }
+            if (warm && now - connection.lastUsed >= _config.keepAliveInterval) {
+                tasks.push_back({PoolAction::KeepAlive, host, connection.handle});
+                ++entry.stats.keepAlives;
+                connection.streams = 1;
+            }
+            ++i;
+        }
+
+        // A connect that never reported back is asked for again after a keep-alive interval.
+        const bool connectOutstanding =
+            entry.connectRequested && now - entry.connectRequestedAt < _config.keepAliveInterval;
+        if (warm && connections.empty() && !connectOutstanding) {
+            tasks.push_back({PoolAction::Connect, host, -1});
+            ++entry.stats.reconnects;
+            entry.connectRequested = true;
+            entry.connectRequestedAt = now;
+        }
+    }
+}
+
+void ConnectionPool::networkChanged() {
+    ++_generation;
+    for (Host &entry : _hosts) {
+        entry.connectRequested = false;
+    }
+}
+
+void ConnectionPool::closeAll(std::vector<PoolTask> &tasks) {
+    for (std::size_t host = 0; host < _hosts.size(); ++host) {
+        for (const Connection &connection : _hosts[host].connections) {
+            tasks.push_back({PoolAction::Close, host, connection.handle});
+        }
+        _hosts[host].connections.clear();
+    }
+}
+
+bool ConnectionPool::isWarm(Nanos now) const {
+    for (const Host &entry : _hosts) {
+        if (isWarm(entry, now)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ConnectionPool::isWarm(const Host &host, Nanos now) const {
+    return host.served && now - host.lastRequest < _config.warmWindow;
+}
+
+ConnectionStats ConnectionPool::totals() const {
+    ConnectionStats totals;
+    for (const Host &entry : _hosts) {
+        totals.merge(entry.stats);
+    }
+    return totals;
+}
+
+} // namespace cft
@@ -0,0 +1,454 @@
+//
+//  DeferredQueue.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/DeferredQueue.hpp"
+
+#include <algorithm>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::uint8_t kFileMagic[5] = {'C', 'F', 'T', 'D', 'Q'};
+constexpr std::uint8_t kFileVersion = 1;
+constexpr std::size_t kFileHeaderSize = 8;
+constexpr std::size_t kRecordHeaderSize = 8;
+constexpr std::size_t kBodyPrefixSize = 9;
+
+// Journals smaller than this are never compacted; rewriting them would cost more than it saves.
+constexpr std::uint64_t kCompactionFloorBytes = 64 * 1024;
+
+enum class RecordKind : std::uint8_t {
+    Enqueue = 1,
+    Attempt = 2,
+    Remove = 3,
+    DeadLetter = 4,
+    Claim = 5
+};
+
+std::vector<std::uint8_t> fileHeader() {
+    std::vector<std::uint8_t> header(kFileMagic, kFileMagic + sizeof(kFileMagic));
+    header.push_back(kFileVersion);
+    appendLittleEndian<std::uint16_t>(header, 0);
+    return header;
+}
+
+std::vector<std::uint8_t> recordBody(RecordKind kind, std::uint64_t entryId) {
+    std::vector<std::uint8_t> body;
+    body.push_back(static_cast<std::uint8_t>(kind));
+    appendLittleEndian(body, entryId);
+    return body;
+}
+
+void appendFramed(std::vector<std::uint8_t> &buffer, const std::vector<std::uint8_t> &body) {
+    appendLittleEndian(buffer, static_cast<std::uint32_t>(body.size()));
+    appendLittleEndian(buffer, crc32(body.data(), body.size()));
+    appendBytes(buffer, body.data(), body.size());
+}
+
+} // namespace
+
+ErrorCode DeferredQueue::open(const std::string &path, const DeferredQueueConfig &config,
+                              std::unique_ptr<DeferredQueue> &queue) {
+    std::unique_ptr<DeferredQueue> opened(new DeferredQueue(path, config));
+    const ErrorCode error = opened->load();
+    if (error == ErrorCode::None) {
+        queue = std::move(opened);
+    }
+    return error;
+}
+
+DeferredQueue::DeferredQueue(std::string path, const DeferredQueueConfig &config)
+    : _path(std::move(path)), _config(config) {}
+
+ErrorCode DeferredQueue::load() {
+    ErrorCode error = File::openForAppend(_path, _journal);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+
+    std::vector<std::uint8_t> contents;
+    error = _journal.readAll(contents);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+
+    if (contents.empty()) {
+        // A new journal. The header is put in place whole, so it can never be found torn.
+        const std::vector<std::uint8_t> header = fileHeader();
+        error = File::replace(_path, header.data(), header.size());
+        if (error == ErrorCode::None) {
+            error = File::openForAppend(_path, _journal);
+        }
+        _journalBytes = header.size();
+        return error;
+    }
+    if (contents.size() < kFileHeaderSize ||
+        !std::equal(kFileMagic, kFileMagic + sizeof(kFileMagic), contents.begin()) ||
+        contents[sizeof(kFileMagic)] != kFileVersion) {
+        // Not a journal this build can read, perhaps one written by a newer version. It may hold
+        // transactions never forwarded, so it is left as it is.
+        _journal.close();
+        return ErrorCode::InvalidArgument;
+    }
+
+    std::size_t offset = kFileHeaderSize;
+    while (offset + kRecordHeaderSize <= contents.size()) {
+        const auto bodyLength = loadLittleEndian<std::uint32_t>(&contents[offset]);
+        const auto checksum = loadLittleEndian<std::uint32_t>(&contents[offset + 4]);
+        const std::size_t bodyOffset = offset + kRecordHeaderSize;
+        if (bodyLength < kBodyPrefixSize || bodyOffset + bodyLength > contents.size() ||
+            crc32(&contents[bodyOffset], bodyLength) != checksum) {
+            break;
+        }
+
+        const std::uint8_t *body = &contents[bodyOffset];
+        const auto kind = static_cast<RecordKind>(body[0]);
+        const auto entryId = loadLittleEndian<std::uint64_t>(body + 1);
+        const std::uint8_t *fields = body + kBodyPrefixSize;
+        const std::size_t fieldsLength = bodyLength - kBodyPrefixSize;
+
+        switch (kind) {
+            case RecordKind::Enqueue:
+                if (fieldsLength >= 8) {
+                    Entry &entry = _entries[entryId];
+                    entry.info.entryId = entryId;
+                    entry.info.enqueuedAtMillis = loadLittleEndian<std::int64_t>(fields);
+                    entry.info.nextAttemptAtMillis = entry.info.enqueuedAtMillis;
+                    entry.data.assign(fields + 8, fields + fieldsLength);
+                    entry.info.size = entry.data.size();
+                    _bytes += entry.data.size();
+                }
+                break;
+            case RecordKind::Attempt: {
+                auto found = _entries.find(entryId);
+                if (found != _entries.end() && fieldsLength >= 12) {
+                    found->second.info.attempts = loadLittleEndian<std::uint32_t>(fields);
+                    found->second.info.nextAttemptAtMillis = loadLittleEndian<std::int64_t>(fields + 4);
+                    if (found->second.info.status != DeferredEntryStatus::DeadLettered) {
+                        found->second.info.status = DeferredEntryStatus::Pending;
+                    }
+                }
+                break;
+            }
+            case RecordKind::Claim: {
+                auto found = _entries.find(entryId);
+                if (found != _entries.end() && found->second.info.status != DeferredEntryStatus::DeadLettered) {
+                    found->second.info.status = DeferredEntryStatus::Interrupted;
+                }
+                break;
+            }
+            case RecordKind::DeadLetter: {
+                auto found = _entries.find(entryId);
+                if (found != _entries.end() && fieldsLength >= 4) {
+                    found->second.info.attempts = loadLittleEndian<std::uint32_t>(fields);
+                    found->second.info.status = DeferredEntryStatus::DeadLettered;
+                }
+                break;
+            }
+            case RecordKind::Remove: {
+                auto found = _entries.find(entryId);
+                if (found != _entries.end()) {
+                    _bytes -= found->second.data.size();
+                    _entries.erase(found);
+                }
+                break;
+            }
+        }
+        _nextEntryId = std::max(_nextEntryId, entryId + 1);
+        offset = bodyOffset + bodyLength;
+    }
+
+    if (offset != contents.size()) {
+        // Everything after the last intact record was never acknowledged to a caller.
+        error = _journal.truncate(offset);
+        if (error == ErrorCode::None) {
+            error = _journal.sync();
+        }
+    }
+    _journalBytes = offset;
+    return error;
+}
+
+ErrorCode DeferredQueue::appendRecord(const std::vector<std::uint8_t> &body) {
+    std::vector<std::uint8_t> record;
+    record.reserve(kRecordHeaderSize + body.size());
+    appendFramed(record, body);
+
+    ErrorCode error = _journal.append(record.data(), record.size());
+    if (error == ErrorCode::None && _config.syncOnWrite) {
+        error = _journal.sync();
+    }
+    if (error != ErrorCode::None) {
+        // Drop any partial record so later appends are not hidden behind it on the next load.
+        _journal.truncate(_journalBytes);
+        return error;
+    }
+    _journalBytes += record.size();
+    return ErrorCode::None;
+}
+
+ErrorCode DeferredQueue::enqueue(const std::uint8_t *data, std::size_t size, std::int64_t nowMillis,
+                                 std::uint64_t &entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!canAcceptLocked(size)) {
+        return ErrorCode::CapacityExceeded;
+    }
+
+    const std::uint64_t newEntryId = _nextEntryId;
+    std::vector<std::uint8_t> body = recordBody(RecordKind::Enqueue, newEntryId);
+    appendLittleEndian(body, nowMillis);
+    appendBytes(body, data, size);
+
+    const ErrorCode error = appendRecord(body);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+
+    ++_nextEntryId;
+    Entry &entry = _entries[newEntryId];
+    entry.info.entryId = newEntryId;
+    entry.info.enqueuedAtMillis = nowMillis;
+    entry.info.nextAttemptAtMillis = nowMillis;
+    entry.info.size = size;
+    entry.data.assign(data, data + size);
+    _bytes += size;
+    entryId = newEntryId;
+    return ErrorCode::None;
+}
+
+std::vector<std::uint64_t> DeferredQueue::claimReady(std::int64_t nowMillis, std::size_t limit,
+                                                     const std::set<std::uint64_t> &held) {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<std::uint64_t> claimed;
+    for (auto &pair : _entries) {
+        if (claimed.size() >= limit) {
+            break;
+        }
+        DeferredEntryInfo &info = pair.second.info;
+        if (info.status == DeferredEntryStatus::Pending && info.nextAttemptAtMillis <= nowMillis &&
+            held.count(pair.first) == 0) {
+            if (appendRecord(recordBody(RecordKind::Claim, pair.first)) != ErrorCode::None) {
+                break;
+            }
+            info.status = DeferredEntryStatus::InFlight;
+            claimed.push_back(pair.first);
+        }
+    }
+    return claimed;
+}
+
+ErrorCode DeferredQueue::payload(std::uint64_t entryId, std::vector<std::uint8_t> &data) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto found = _entries.find(entryId);
+    if (found == _entries.end()) {
+        return ErrorCode::NotFound;
+    }
+    data = found->second.data;
+    return ErrorCode::None;
+}
+
+ErrorCode DeferredQueue::complete(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    return removeLocked(entryId);
+}
+
+ErrorCode DeferredQueue::remove(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    return removeLocked(entryId);
+}
+
+ErrorCode DeferredQueue::removeLocked(std::uint64_t entryId) {
+    auto found = _entries.find(entryId);
+    if (found == _entries.end()) {
+        return ErrorCode::NotFound;
+    }
+
+    const ErrorCode error = appendRecord(recordBody(RecordKind::Remove, entryId));
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    _bytes -= found->second.data.size();
+    _entries.erase(found);
+
+    const std::uint64_t liveEstimate = _bytes + _entries.size() * 64 + kFileHeaderSize;
+    if (_journalBytes > kCompactionFloorBytes && _journalBytes > liveEstimate * 2) {
+        // A failed compaction leaves the old journal in place, which is still correct.
+        compactLocked();
+    }
+    return ErrorCode::None;
+}
+
+std::size_t DeferredQueue::expedite(std::int64_t nowMillis) {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::size_t expedited = 0;
+    for (auto &pair : _entries) {
+        DeferredEntryInfo &info = pair.second.info;
+        if (info.status == DeferredEntryStatus::Pending && info.nextAttemptAtMillis > nowMillis) {
+            info.nextAttemptAtMillis = nowMillis;
+            ++expedited;
+        }
+    }
+    return expedited;
+}
+
+ErrorCode DeferredQueue::fail(std::uint64_t entryId, bool retryable, std::int64_t nowMillis, bool &willRetry) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto found = _entries.find(entryId);
+    if (found == _entries.end()) {
+        return ErrorCode::NotFound;
+    }
+
+    DeferredEntryInfo &info = found->second.info;
+    const std::uint32_t attempts = info.attempts + 1;
+    willRetry = retryable && attempts < _config.maxAttempts;
+
+    std::vector<std::uint8_t> body;
+    std::int64_t nextAttemptAt = info.nextAttemptAtMillis;
+    if (willRetry) {
+        nextAttemptAt = nowMillis + retryDelayMillis(attempts);
+        body = recordBody(RecordKind::Attempt, entryId);
+        appendLittleEndian(body, attempts);
+        appendLittleEndian(body, nextAttemptAt);
+    } else {
+        body = recordBody(RecordKind::DeadLetter, entryId);
+        appendLittleEndian(body, attempts);
+    }
+
+    const ErrorCode error = appendRecord(body);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    info.attempts = attempts;
+    info.nextAttemptAtMillis = nextAttemptAt;
+    info.status = willRetry ? DeferredEntryStatus::Pending : DeferredEntryStatus::DeadLettered;
+    return ErrorCode::None;
+}
+
+ErrorCode DeferredQueue::release(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto found = _entries.find(entryId);
+    if (found == _entries.end()) {
+        return ErrorCode::NotFound;
+    }
+    DeferredEntryInfo &info = found->second.info;
+    if (info.status != DeferredEntryStatus::InFlight && info.status != DeferredEntryStatus::Interrupted) {
+        return ErrorCode::None;
+    }
+    // An attempt record with nothing changed is what returns the entry to pending on the next open.
+    std::vector<std::uint8_t> body = recordBody(RecordKind::Attempt, entryId);
+    appendLittleEndian(body, info.attempts);
+    appendLittleEndian(body, info.nextAttemptAtMillis);
+    const ErrorCode error = appendRecord(body);
+    if (error == ErrorCode::None) {
+        info.status = DeferredEntryStatus::Pending;
+    }
+    return error;
+}
+
+ErrorCode DeferredQueue::compact() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return compactLocked();
+}
+
+ErrorCode DeferredQueue::compactLocked() {
+    std::vector<std::uint8_t> contents = fileHeader();
+    for (const auto &pair : _entries) {
+        const Entry &entry = pair.second;
+        std::vector<std::uint8_t> body = recordBody(RecordKind::Enqueue, pair.first);
+        appendLittleEndian(body, entry.info.enqueuedAtMillis);
+        appendBytes(body, entry.data.data(), entry.data.size());
+        appendFramed(contents, body);
+
+        if (entry.info.status == DeferredEntryStatus::DeadLettered) {
+            body = recordBody(RecordKind::DeadLetter, pair.first);
+            appendLittleEndian(body, entry.info.attempts);
+            appendFramed(contents, body);
+        } else if (entry.info.attempts > 0) {
+            body = recordBody(RecordKind::Attempt, pair.first);
+            appendLittleEndian(body, entry.info.attempts);
+            appendLittleEndian(body, entry.info.nextAttemptAtMillis);
+            appendFramed(contents, body);
+        }
+        if (entry.info.status == DeferredEntryStatus::InFlight ||
+            entry.info.status == DeferredEntryStatus::Interrupted) {
+            appendFramed(contents, recordBody(RecordKind::Claim, pair.first));
+        }
+    }
+
+    ErrorCode error = File::replace(_path, contents.data(), contents.size());
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    error = File::openForAppend(_path, _journal);
+    if (error == ErrorCode::None) {
+        _journalBytes = contents.size();
+    }
+    return error;
+}
+
+std::vector<DeferredEntryInfo> DeferredQueue::entries() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<DeferredEntryInfo> infos;
+    infos.reserve(_entries.size());
+    for (const auto &pair : _entries) {
+        infos.push_back(pair.second.info);
+    }
+    return infos;
+}
+
+std::size_t DeferredQueue::count() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _entries.size();
+}
+
+std::size_t DeferredQueue::pendingCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return static_cast<std::size_t>(std::count_if(_entries.begin(), _entries.end(), [](const auto &pair) {
+        return pair.second.info.status != DeferredEntryStatus::DeadLettered;
+    }));
+}
+
+std::size_t DeferredQueue::bytes() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _bytes;
+}
+
+std::int64_t DeferredQueue::nextAttemptAtMillis(const std::set<std::uint64_t> &held) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::int64_t earliest = -1;
+    for (const auto &pair : _entries) {
+        const DeferredEntryInfo &info = pair.second.info;
+        if (info.status == DeferredEntryStatus::Pending && held.count(pair.first) == 0 &&
+            (earliest < 0 || info.nextAttemptAtMillis < earliest)) {
+            earliest = info.nextAttemptAtMillis;
+        }
+    }
+    return earliest;
+}
+
+bool DeferredQueue::canAccept(std::size_t size) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return canAcceptLocked(size);
+}
+
+bool DeferredQueue::canAcceptLocked(std::size_t size) const {
+    return _entries.size() < _config.maxEntries && _bytes + size <= _config.maxBytes;
+}
+
+std::int64_t DeferredQueue::retryDelayMillis(std::uint32_t attempts) const {
+    std::int64_t delay = _config.baseRetryDelayMillis;
+    for (std::uint32_t i = 1; i < attempts && delay < _config.maxRetryDelayMillis; ++i) {
+        delay *= 2;
+    }
+    return std::min(delay, _config.maxRetryDelayMillis);
+}
+
+} // namespace cft
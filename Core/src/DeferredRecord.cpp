@@ -0,0 +1,225 @@
+//
+//  DeferredRecord.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/DeferredRecord.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+#include "cft/Compression.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::uint8_t kMagic[4] = {'C', 'F', 'D', 'R'};
+
+// Compressed fields carry their decompressed length first.
+constexpr std::size_t kCompressedPrefixSize = sizeof(std::uint32_t);
+
+// Upper bound on a decompressed field, so a corrupt length cannot force a huge allocation.
+constexpr std::size_t kMaxDecompressedSize = 16 * 1024 * 1024;
+
+} // namespace
+
+void DeferredRecordWriter::addInteger(DeferredField field, std::int64_t value) {
+    Field entry{field, 0, {}};
+    appendLittleEndian(entry.bytes, value);
+    _fields.push_back(std::move(entry));
+}
+
+void DeferredRecordWriter::addByte(DeferredField field, std::uint8_t value) {
+    _fields.push_back(Field{field, 0, {value}});
+}
+
+void DeferredRecordWriter::addBytes(DeferredField field, const std::uint8_t *data, std::size_t size, bool compress) {
+    if (compress && size > 0 && size <= kMaxDecompressedSize) {
+        std::vector<std::uint8_t> compressed;
+        appendLittleEndian(compressed, static_cast<std::uint32_t>(size));
+        compressBlock(data, size, compressed);
+        if (compressed.size() < size) {
+            _fields.push_back(Field{field, DeferredFieldFlagCompressed, std::move(compressed)});
+            return;
+        }
+    }
+    _fields.push_back(Field{field, 0, std::vector<std::uint8_t>(data, data + size)});
+}
+
+ErrorCode DeferredRecordWriter::finish(std::vector<std::uint8_t> &record) const {
+    std::vector<const Field *> sorted;
+    sorted.reserve(_fields.size());
+    std::size_t total = kDeferredRecordHeaderSize + _fields.size() * kDeferredRecordDirectoryEntrySize;
+    for (const Field &field : _fields) {
+        sorted.push_back(&field);
+        total += field.bytes.size();
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Field *a, const Field *b) { return a->tag < b->tag; });
+    for (std::size_t i = 1; i < sorted.size(); ++i) {
+        if (sorted[i - 1]->tag == sorted[i]->tag) {
+            return ErrorCode::InvalidArgument;
+        }
+    }
+    if (sorted.size() > std::numeric_limits<std::uint16_t>::max() || total > std::numeric_limits<std::uint32_t>::max()) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    record.clear();
+    record.reserve(total);
+    appendBytes(record, kMagic, sizeof(kMagic));
+    record.push_back(kDeferredRecordVersion);
+    record.push_back(0);
+    appendLittleEndian(record, static_cast<std::uint16_t>(sorted.size()));
+    appendLittleEndian(record, static_cast<std::uint32_t>(total));
+    appendLittleEndian(record, std::uint32_t{0});
+
+    std::size_t offset = kDeferredRecordHeaderSize + sorted.size() * kDeferredRecordDirectoryEntrySize;
+    for (const Field *field : sorted) {
+        appendLittleEndian(record, static_cast<std::uint16_t>(field->tag));
+        appendLittleEndian(record, field->flags);
+        appendLittleEndian(record, static_cast<std::uint32_t>(offset));
+        appendLittleEndian(record, static_cast<std::uint32_t>(field->bytes.size()));
+        offset += field->bytes.size();
+    }
+    for (const Field *field : sorted) {
+        appendBytes(record, field->bytes.data(), field->bytes.size());
+    }
+
+    storeLittleEndian(record.data() + 12, crc32(record.data() + kDeferredRecordHeaderSize, total - kDeferredRecordHeaderSize));
+    return ErrorCode::None;
+}
+
+bool DeferredRecordView::hasMagic(const std::uint8_t *data, std::size_t size) {
+    return size >= sizeof(kMagic) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+ErrorCode DeferredRecordView::open(const std::uint8_t *data, std::size_t size, DeferredRecordView &view) {
+    if (size < kDeferredRecordHeaderSize || !hasMagic(data, size) || data[4] != kDeferredRecordVersion) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::size_t fieldCount = loadLittleEndian<std::uint16_t>(data + 6);
+    const std::size_t total = loadLittleEndian<std::uint32_t>(data + 8);
+    const std::size_t dataStart = kDeferredRecordHeaderSize + fieldCount * kDeferredRecordDirectoryEntrySize;
+    if (total != size || dataStart > size) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    std::uint32_t previousTag = 0;
+    for (std::size_t i = 0; i < fieldCount; ++i) {
+        const std::uint8_t *entry = data + kDeferredRecordHeaderSize + i * kDeferredRecordDirectoryEntrySize;
+        const std::uint32_t tag = loadLittleEndian<std::uint16_t>(entry);
+        const std::size_t offset = loadLittleEndian<std::uint32_t>(entry + 4);
+        const std::size_t length = loadLittleEndian<std::uint32_t>(entry + 8);
+        if ((i > 0 && tag <= previousTag) || offset < dataStart || offset > size || length > size - offset) {
+            return ErrorCode::InvalidArgument;
+        }
+        previousTag = tag;
+    }
+
+    view._data = data;
+    view._size = size;
+    view._fieldCount = fieldCount;
+    return ErrorCode::None;
+}
+
+bool DeferredRecordView::verifyChecksum() const {
+    if (_data == nullptr) {
+        return false;
+    }
+    return crc32(_data + kDeferredRecordHeaderSize, _size - kDeferredRecordHeaderSize) ==
+           loadLittleEndian<std::uint32_t>(_data + 12);
+}
+
+std::uint8_t DeferredRecordView::version() const {
+    return _data == nullptr ? 0 : _data[4];
+}
+
+bool DeferredRecordView::find(DeferredField field, std::uint16_t &flags, ByteRange &range) const {
+    // The directory is sorted, but records have a handful of fields; a linear scan wins.
+    const auto tag = static_cast<std::uint16_t>(field);
+    for (std::size_t i = 0; i < _fieldCount; ++i) {
+        const std::uint8_t *entry = _data + kDeferredRecordHeaderSize + i * kDeferredRecordDirectoryEntrySize;
+        const std::uint16_t entryTag = loadLittleEndian<std::uint16_t>(entry);
+        if (entryTag < tag) {
+            continue;
+        }
+        if (entryTag > tag) {
+            return false;
+        }
+        flags = loadLittleEndian<std::uint16_t>(entry + 2);
+        range.data = _data + loadLittleEndian<std::uint32_t>(entry + 4);
+        range.size = loadLittleEndian<std::uint32_t>(entry + 8);
+        return true;
+    }
+    return false;
+}
+
+bool DeferredRecordView::has(DeferredField field) const {
+    std::uint16_t flags = 0;
+    ByteRange range;
+    return find(field, flags, range);
+}
+
+bool DeferredRecordView::isCompressed(DeferredField field) const {
+    std::uint16_t flags = 0;
+    ByteRange range;
+    return find(field, flags, range) && (flags & DeferredFieldFlagCompressed) != 0;
+}
+
+bool DeferredRecordView::raw(DeferredField field, ByteRange &range) const {
+    std::uint16_t flags = 0;
+    return find(field, flags, range);
+}
+
+bool DeferredRecordView::integer(DeferredField field, std::int64_t &value) const {
+    ByteRange range;
+    if (!bytes(field, range) || range.size != sizeof(std::int64_t)) {
+        return false;
+    }
+    value = loadLittleEndian<std::int64_t>(range.data);
+    return true;
+}
+
+bool DeferredRecordView::byte(DeferredField field, std::uint8_t &value) const {
+    ByteRange range;
+    if (!bytes(field, range) || range.size != 1) {
+        return false;
+    }
+    value = range.data[0];
+    return true;
+}
+
+bool DeferredRecordView::bytes(DeferredField field, ByteRange &range) const {
+    std::uint16_t flags = 0;
+    return find(field, flags, range) && (flags & DeferredFieldFlagCompressed) == 0;
+}
+
+ErrorCode DeferredRecordView::copyBytes(DeferredField field, std::vector<std::uint8_t> &out) const {
+    std::uint16_t flags = 0;
+    ByteRange range;
+    if (!find(field, flags, range)) {
+        return ErrorCode::NotFound;
+    }
+    if ((flags & DeferredFieldFlagCompressed) == 0) {
+        out.assign(range.data, range.data + range.size);
+        return ErrorCode::None;
+    }
+
+    if (range.size < kCompressedPrefixSize) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::size_t decompressedSize = loadLittleEndian<std::uint32_t>(range.data);
+    if (decompressedSize > kMaxDecompressedSize) {
+        return ErrorCode::InvalidArgument;
+    }
+    out.resize(decompressedSize);
+    return decompressBlock(range.data + kCompressedPrefixSize, range.size - kCompressedPrefixSize, out.data(), decompressedSize);
+}
+
+} // namespace cft
@@ -0,0 +1,323 @@
+//
+//  EventLog.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/EventLog.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "cft/Bytes.hpp"
+#include "cft/Clock.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::uint8_t kLogFormatVersion = 1;
+
+// Distinguishes logs whose addresses were reused, so a thread never writes to a dead log's ring.
+std::atomic<std::uint64_t> gNextLogId{1};
+
+std::size_t roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t rounded = 2;
+    while (rounded < value) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+// For counters with a single writer: avoids a locked read-modify-write on the write path.
+void bump(std::atomic<std::uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+struct EventLog::Ring {
+    Ring(std::size_t capacity, std::uint32_t index)
+        : records(new LogRecord[capacity]), mask(capacity - 1), index(index) {}
+
+    std::unique_ptr<LogRecord[]> records;
+    const std::size_t mask;
+    const std::uint32_t index;
+
+    // Written only by the owning thread.
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    std::array<std::uint32_t, kLogLevelCount> sampleCounters{};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> sampledOut{0};
+
+    // Written only by the drainer.
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+
+    // Cleared when the owning thread exits so another thread can take the ring over.
+    std::atomic<bool> owned{true};
+    // Set when the log is destroyed so threads forget the ring.
+    std::atomic<bool> retired{false};
+};
+
+struct EventLog::ThreadRings {
+    struct Entry {
+        std::uint64_t logId;
+        // Null when the log had no memory left for this thread.
+        std::shared_ptr<Ring> ring;
+    };
+
+    ~ThreadRings() {
+        for (const Entry &entry : entries) {
+            if (entry.ring) {
+                entry.ring->owned.store(false, std::memory_order_release);
+            }
+        }
+    }
+
+    std::vector<Entry> entries;
+};
+
+EventLog::EventLog(EventLogConfig config)
+    : _capacity(roundUpToPowerOfTwo(config.recordsPerThread)),
+      _maxRings(std::max<std::size_t>(1, config.memoryLimitBytes / (_capacity * sizeof(LogRecord)))),
+      _id(gNextLogId.fetch_add(1, std::memory_order_relaxed)),
+      _minimumLevel(config.minimumLevel),
+      _rings(new std::shared_ptr<Ring>[_maxRings]) {
+    for (auto &every : _sampleEvery) {
+        every.store(1, std::memory_order_relaxed);
+    }
+}
+
+EventLog::~EventLog() {
+    const std::size_t count = _ringCount.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+        _rings[i]->retired.store(true, std::memory_order_release);
+    }
+}
+
+EventLog::Ring *EventLog::threadRing() {
+    static thread_local ThreadRings threadRings;
+    for (const ThreadRings::Entry &entry : threadRings.entries) {
+        if (entry.logId == _id) {
+            return entry.ring.get();
+        }
+    }
+
+    // First record from this thread to this log.
+    auto &entries = threadRings.entries;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const ThreadRings::Entry &entry) {
+        return entry.ring && entry.ring->retired.load(std::memory_order_acquire);
+    }), entries.end());
+    entries.push_back({_id, claimRing()});
+    return entries.back().ring.get();
+}
+
+std::shared_ptr<EventLog::Ring> EventLog::claimRing() {
+    std::lock_guard<std::mutex> guard(_registerLock);
+    const std::size_t count = _ringCount.load(std::memory_order_relaxed);
+    // A ring left by an exited thread may still hold undrained records; they stay in order.
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!_rings[i]->owned.load(std::memory_order_acquire)) {
+            _rings[i]->owned.store(true, std::memory_order_relaxed);
+            return _rings[i];
+        }
+    }
+    if (count == _maxRings) {
+        return nullptr;
+    }
+    _rings[count] = std::make_shared<Ring>(_capacity, static_cast<std::uint32_t>(count));
+    _ringCount.store(count + 1, std::memory_order_release);
+    return _rings[count];
+}
+
+bool EventLog::write(LogRecord record) {
+    const auto level = static_cast<std::size_t>(record.level);
+    if (level >= kLogLevelCount || !isEnabled(record.level)) {
+        return false;
+    }
+    Ring *ring = threadRing();
+    if (ring == nullptr) {
+        _unattributedDrops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const std::uint32_t every = _sampleEvery[level].load(std::memory_order_relaxed);
+    if (every > 1 && ring->sampleCounters[level]++ % every != 0) {
+        bump(ring->sampledOut);
+        return false;
+    }
+
+    const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) > ring->mask) {
+        bump(ring->dropped);
+        return false;
+    }
+    if (record.timestamp == 0) {
+        record.timestamp = monotonicNanos();
+    }
+    record.thread = ring->index;
+    ring->records[head & ring->mask] = record;
+    ring->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool EventLog::write(LogLevel level, LogSubsystem subsystem, std::uint64_t transactionId, TransactionState state,
+                     ErrorCode error, std::int32_t detail) {
+    if (!isEnabled(level)) {
+        return false;
+    }
+    LogRecord record;
+    record.level = level;
+    record.subsystem = subsystem;
+    record.transactionId = transactionId;
+    record.state = state;
+    record.error = error;
+    record.detail = detail;
+    return write(record);
+}
+
+bool EventLog::write(LogLevel level, LogSubsystem subsystem, CardReaderEvent readerEvent, ErrorCode error,
+                     std::int32_t detail) {
+    if (!isEnabled(level)) {
+        return false;
+    }
+    LogRecord record;
+    record.level = level;
+    record.subsystem = subsystem;
+    record.readerEvent = readerEvent;
+    record.error = error;
+    record.detail = detail;
+    return write(record);
+}
+
+void EventLog::setSampleRate(LogLevel level, std::uint32_t every) {
+    const auto index = static_cast<std::size_t>(level);
+    if (index < kLogLevelCount) {
+        _sampleEvery[index].store(std::max<std::uint32_t>(every, 1), std::memory_order_relaxed);
+    }
+}
+
+std::size_t EventLog::drain(const SinkFunction &sink, std::size_t maxRecords) {
+    std::lock_guard<std::mutex> guard(_drainLock);
+    _scratch.clear();
+    const std::size_t count = _ringCount.load(std::memory_order_acquire);
+    for (std::size_t visited = 0; visited < count && _scratch.size() < maxRecords; ++visited) {
+        Ring &ring = *_rings[_nextRing % count];
+        _nextRing = (_nextRing + 1) % count;
+        const std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        const std::uint64_t available = ring.head.load(std::memory_order_acquire) - tail;
+        const std::uint64_t take = std::min<std::uint64_t>(available, maxRecords - _scratch.size());
+        for (std::uint64_t i = 0; i < take; ++i) {
+            _scratch.push_back(ring.records[(tail + i) & ring.mask]);
+        }
+        ring.tail.store(tail + take, std::memory_order_release);
+    }
+    if (_scratch.empty()) {
+        return 0;
+    }
+
+    // Each ring is already in order; stable so equal timestamps from one thread keep theirs.
+    std::stable_sort(_scratch.begin(), _scratch.end(), [](const LogRecord &a, const LogRecord &b) {
+        return a.timestamp < b.timestamp;
+    });
+    sink(_scratch.data(), _scratch.size());
+    _drained.fetch_add(_scratch.size(), std::memory_order_relaxed);
+    return _scratch.size();
+}
+
+EventLogStats EventLog::stats() const {
+    EventLogStats stats;
+    stats.drained = _drained.load(std::memory_order_relaxed);
+    stats.dropped = _unattributedDrops.load(std::memory_order_relaxed);
+    const std::size_t count = _ringCount.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; ++i) {
+        const Ring &ring = *_rings[i];
+        stats.written += ring.head.load(std::memory_order_relaxed);
+        stats.dropped += ring.dropped.load(std::memory_order_relaxed);
+        stats.sampledOut += ring.sampledOut.load(std::memory_order_relaxed);
+        stats.threads += ring.owned.load(std::memory_order_relaxed) ? 1 : 0;
+    }
+    stats.memoryBytes = count * _capacity * sizeof(LogRecord);
+    return stats;
+}
+
+const char *logLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+    }
+    return "unknown";
+}
+
+const char *logSubsystemName(LogSubsystem subsystem) {
+    switch (subsystem) {
+        case LogSubsystem::Session: return "session";
+        case LogSubsystem::Transaction: return "transaction";
+        case LogSubsystem::Reader: return "reader";
+        case LogSubsystem::Gateway: return "gateway";
+        case LogSubsystem::DeferredQueue: return "deferredQueue";
+        case LogSubsystem::RecordStore: return "recordStore";
+        case LogSubsystem::AccountCache: return "accountCache";
+    }
+    return "unknown";
+}
+
+std::size_t formatLogRecord(const LogRecord &record, Nanos origin, char *buffer, std::size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    const Nanos elapsed = record.timestamp > origin ? record.timestamp - origin : 0;
+    std::size_t length = 0;
+    auto append = [&](int written) {
+        if (written > 0) {
+            length = std::min(length + static_cast<std::size_t>(written), size - 1);
+        }
+    };
+
+    append(std::snprintf(buffer, size, "%llu.%06llu %s %s thread %u",
+                         static_cast<unsigned long long>(elapsed / 1000000000),
+                         static_cast<unsigned long long>(elapsed % 1000000000 / 1000),
+                         logLevelName(record.level), logSubsystemName(record.subsystem), record.thread));
+    if (record.transactionId != 0) {
+        append(std::snprintf(buffer + length, size - length, " transaction %llu",
+                             static_cast<unsigned long long>(record.transactionId)));
+    }
+    if (record.state != TransactionState::Unknown) {
+        append(std::snprintf(buffer + length, size - length, " state %s", transactionStateName(record.state)));
+    }
+    if (record.readerEvent != CardReaderEvent::Unknown) {
+        append(std::snprintf(buffer + length, size - length, " event %s", cardReaderEventName(record.readerEvent)));
+    }
+    if (record.error != ErrorCode::None) {
+        append(std::snprintf(buffer + length, size - length, " error %s", errorCodeName(record.error)));
+    }
+    if (record.detail != 0) {
+        append(std::snprintf(buffer + length, size - length, " detail %d", record.detail));
+    }
+    return length;
+}
+
+void encodeLogRecords(const LogRecord *records, std::size_t count, std::vector<std::uint8_t> &buffer) {
+    buffer.reserve(buffer.size() + 8 + count * sizeof(LogRecord));
+    const std::uint8_t header[4] = {'C', 'F', 'L', kLogFormatVersion};
+    appendBytes(buffer, header, sizeof(header));
+    appendLittleEndian(buffer, static_cast<std::uint32_t>(count));
+    for (std::size_t i = 0; i < count; ++i) {
+        const LogRecord &record = records[i];
+        appendLittleEndian(buffer, record.timestamp);
+        appendLittleEndian(buffer, record.transactionId);
+        appendLittleEndian(buffer, record.thread);
+        appendLittleEndian(buffer, static_cast<std::int32_t>(record.state));
+        appendLittleEndian(buffer, static_cast<std::int32_t>(record.readerEvent));
+        appendLittleEndian(buffer, static_cast<std::int32_t>(record.error));
+        appendLittleEndian(buffer, record.detail);
+        appendLittleEndian(buffer, static_cast<std::uint8_t>(record.level));
+        appendLittleEndian(buffer, static_cast<std::uint8_t>(record.subsystem));
+        appendLittleEndian(buffer, static_cast<std::uint16_t>(0));
+    }
+}
+
+} // namespace cft
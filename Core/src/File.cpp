@@ -0,0 +1,270 @@
+//
+//  File.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/File.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cft {
+
+namespace {
+
+ErrorCode writeFully(int descriptor, const std::uint8_t *data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t written = ::write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ErrorCode::IOFailure;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return ErrorCode::None;
+}
+
+ErrorCode syncDescriptor(int descriptor) {
+#if defined(__APPLE__)
+    // fsync on Darwin only reaches the drive cache; F_FULLFSYNC is needed to survive power loss.
+    if (::fcntl(descriptor, F_FULLFSYNC) == 0) {
+        return ErrorCode::None;
+    }
+#endif
+    return ::fsync(descriptor) == 0 ? ErrorCode::None : ErrorCode::IOFailure;
+}
+
+void syncParentDirectory(const std::string &path) {
+    // The rename itself is only durable once the directory entry is flushed.
+    const std::string::size_type slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+    const int descriptor = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor >= 0) {
+        ::fsync(descriptor);
+        ::close(descriptor);
+    }
+}
+
+ErrorCode mapFile(const File &file, std::size_t size, int protection, std::uint8_t *&data) {
+    if (!file.isOpen() || size == 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    void *address = ::mmap(nullptr, size, protection, MAP_SHARED, file.descriptor(), 0);
+    if (address == MAP_FAILED) {
+        return ErrorCode::IOFailure;
+    }
+    data = static_cast<std::uint8_t *>(address);
+    return ErrorCode::None;
+}
+
+} // namespace
+
+File::~File() {
+    close();
+}
+
+File::File(File &&other) noexcept : _descriptor(other._descriptor) {
+    other._descriptor = -1;
+}
+
+File &File::operator=(File &&other) noexcept {
+    if (this != &other) {
+        close();
+        _descriptor = other._descriptor;
+        other._descriptor = -1;
+    }
+    return *this;
+}
+
+ErrorCode File::openForAppend(const std::string &path, File &file) {
+    const int descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        return ErrorCode::IOFailure;
+    }
+    file = File();
+    file._descriptor = descriptor;
+    return ErrorCode::None;
+}
+
+ErrorCode File::openForUpdate(const std::string &path, File &file) {
+    const int descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        return ErrorCode::IOFailure;
+    }
+    file = File();
+    file._descriptor = descriptor;
+    return ErrorCode::None;
+}
+
+ErrorCode File::openForRead(const std::string &path, File &file) {
+    const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return errno == ENOENT ? ErrorCode::NotFound : ErrorCode::IOFailure;
+    }
+    file = File();
+    file._descriptor = descriptor;
+    return ErrorCode::None;
+}
+
+ErrorCode File::replace(const std::string &destination, const std::uint8_t *data, std::size_t size) {
+    const std::string temporary = destination + ".tmp";
+    const int descriptor = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        return ErrorCode::IOFailure;
+    }
+
+    ErrorCode error = writeFully(descriptor, data, size);
+    if (error == ErrorCode::None) {
+        error = syncDescriptor(descriptor);
+    }
+    ::close(descriptor);
+
+    if (error == ErrorCode::None && ::rename(temporary.c_str(), destination.c_str()) != 0) {
+        error = ErrorCode::IOFailure;
+    }
+    if (error != ErrorCode::None) {
+        ::unlink(temporary.c_str());
+    } else {
+        syncParentDirectory(destination);
+    }
+    return error;
+}
+
+ErrorCode File::readAll(std::vector<std::uint8_t> &contents) const {
+    std::uint64_t length = 0;
+    const ErrorCode error = size(length);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+
+    contents.resize(static_cast<std::size_t>(length));
+    std::size_t offset = 0;
+    while (offset < contents.size()) {
+        const ssize_t count = ::pread(_descriptor, contents.data() + offset, contents.size() - offset,
+                                      static_cast<off_t>(offset));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ErrorCode::IOFailure;
+        }
+        if (count == 0) {
+            break;
+        }
+        offset += static_cast<std::size_t>(count);
+    }
+    contents.resize(offset);
+    return ErrorCode::None;
+}
+
+ErrorCode File::append(const std::uint8_t *data, std::size_t size) {
+    if (_descriptor < 0) {
+        return ErrorCode::IOFailure;
+    }
+    return writeFully(_descriptor, data, size);
+}
+
+ErrorCode File::truncate(std::uint64_t size) {
+    return ::ftruncate(_descriptor, static_cast<off_t>(size)) == 0 ? ErrorCode::None : ErrorCode::IOFailure;
+}
+
+ErrorCode File::sync() {
+    return syncDescriptor(_descriptor);
+}
+
+ErrorCode File::size(std::uint64_t &size) const {
+    struct stat status;
+    if (::fstat(_descriptor, &status) != 0) {
+        return ErrorCode::IOFailure;
+    }
+    size = static_cast<std::uint64_t>(status.st_size);
+    return ErrorCode::None;
+}
+
+void File::close() {
+    if (_descriptor >= 0) {
+        ::close(_descriptor);
+        _descriptor = -1;
+    }
+}
+
+MappedRegion::~MappedRegion() {
+    unmap();
+}
+
+MappedRegion::MappedRegion(MappedRegion &&other) noexcept : _data(other._data), _size(other._size) {
+    other._data = nullptr;
+    other._size = 0;
+}
+
+MappedRegion &MappedRegion::operator=(MappedRegion &&other) noexcept {
+    if (this != &other) {
+        unmap();
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+    }
+    return *this;
+}
+
+ErrorCode MappedRegion::map(const File &file, std::size_t size, MappedRegion &region) {
+    std::uint8_t *data = nullptr;
+    const ErrorCode error = mapFile(file, size, PROT_READ | PROT_WRITE, data);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    region = MappedRegion();
+    region._data = data;
+    region._size = size;
+    return ErrorCode::None;
+}
+
+ErrorCode MappedRegion::mapReadOnly(const File &file, std::size_t size, MappedRegion &region) {
+    std::uint8_t *data = nullptr;
+    const ErrorCode error = mapFile(file, size, PROT_READ, data);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    region = MappedRegion();
+    region._data = data;
+    region._size = size;
+    return ErrorCode::None;
+}
+
+ErrorCode MappedRegion::sync() {
+    if (_data == nullptr) {
+        return ErrorCode::None;
+    }
+    return ::msync(_data, _size, MS_SYNC) == 0 ? ErrorCode::None : ErrorCode::IOFailure;
+}
+
+ErrorCode MappedRegion::sync(std::size_t offset, std::size_t length) {
+    if (_data == nullptr || offset >= _size) {
+        return ErrorCode::None;
+    }
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t start = offset / page * page;
+    const std::size_t end = std::min(offset + length, _size);
+    return ::msync(_data + start, end - start, MS_SYNC) == 0 ? ErrorCode::None : ErrorCode::IOFailure;
+}
+
+void MappedRegion::unmap() {
+    if (_data != nullptr) {
+        ::munmap(_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+}
+
+} // namespace cft
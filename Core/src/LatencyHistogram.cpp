@@ -0,0 +1,74 @@
+//
+//  LatencyHistogram.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cft {
+
+std::size_t LatencyHistogram::bucketIndex(Nanos value) {
+    if (value < kSubBucketCount) {
+        return static_cast<std::size_t>(value);
+    }
+    const std::size_t exponent = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+    const std::size_t shift = exponent - kSubBucketBits;
+    const std::size_t subBucket = static_cast<std::size_t>(value >> shift) & (kSubBucketCount - 1);
+    return kSubBucketCount + shift * kSubBucketCount + subBucket;
+}
+
+Nanos LatencyHistogram::bucketUpperBound(std::size_t index) {
+    if (index < kSubBucketCount) {
+        return static_cast<Nanos>(index);
+    }
+    const std::size_t shift = (index - kSubBucketCount) / kSubBucketCount;
+    const std::size_t subBucket = (index - kSubBucketCount) % kSubBucketCount;
+    const Nanos lower = static_cast<Nanos>(kSubBucketCount + subBucket) << shift;
+    return lower + ((Nanos(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(Nanos value) {
+    ++_buckets[bucketIndex(value)];
+    ++_count;
+    _sum += value;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+        _buckets[i] += other._buckets[i];
+    }
+    _count += other._count;
+    _sum += other._sum;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+}
+
+void LatencyHistogram::clear() {
+    *this = LatencyHistogram();
+}
+
+Nanos LatencyHistogram::percentile(double percentile) const {
+    if (_count == 0) {
+        return 0;
+    }
+    const double clamped = std::min(100.0, std::max(0.0, percentile));
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(clamped / 100.0 * static_cast<double>(_count))));
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+        seen += _buckets[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), _max);
+        }
+    }
+    return _max;
+}
+
+} // namespace cft
@@ -0,0 +1,256 @@
+//
+//  ReaderConnection.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/ReaderConnection.hpp"
+
+#include <algorithm>
+
+namespace cft {
+
+namespace {
+
+std::int64_t earliest(std::int64_t a, std::int64_t b) {
+    if (a < 0) {
+        return b;
+    }
+    return b < 0 ? a : std::min(a, b);
+}
+
+} // namespace
+
+void ReaderConnection::connect(const std::string &name, CardReaderModel model, std::int64_t nowMillis) {
+    _name = name;
+    _model = model;
+    _attempts = 0;
+    _readyTimerStartMillis = -1;
+    _disconnectPending = false;
+    startConnecting(nowMillis, false);
+}
+
+void ReaderConnection::disconnect() {
+    _state = ReaderLinkState::Idle;
+    _readyTimerStartMillis = -1;
+    _heartbeatOutstanding = false;
+    _disconnectPending = false;
+}
+
+void ReaderConnection::connected(const std::string &name, CardReaderModel model, std::int64_t nowMillis) {
+    if (name != _name) {
+        _name = name;
+        _readyTimerStartMillis = -1;
+    }
+    _model = model;
+    if (_readyTimerStartMillis >= 0 && nowMillis >= _readyTimerStartMillis) {
+        LatencyHistogram &histogram = (_reconnecting ? _reconnections : _firstConnections)[modelIndex(model)];
+        histogram.record(static_cast<Nanos>(nowMillis - _readyTimerStartMillis) * 1000000);
+    }
+    _readyTimerStartMillis = -1;
+    _state = ReaderLinkState::Ready;
+    _attempts = 0;
+    _missedHeartbeats = 0;
+    _heartbeatOutstanding = false;
+    _disconnectPending = false;
+    _nextHeartbeatAtMillis = nowMillis + _config.heartbeatIntervalMillis;
+    _lastActivityMillis = nowMillis;
+}
+
+void ReaderConnection::connectFailed(std::int64_t nowMillis) {
+    if (_state != ReaderLinkState::Connecting) {
+        return;
+    }
+    ++_attempts;
+    _state = ReaderLinkState::Waiting;
+    _retryAtMillis = nowMillis + retryDelayMillis(_attempts);
+}
+
+void ReaderConnection::disconnected(std::int64_t nowMillis) {
+    if (_state == ReaderLinkState::Ready) {
+        drop(nowMillis);
+    } else if (_state == ReaderLinkState::Connecting) {
+        connectFailed(nowMillis);
+    }
+}
+
+void ReaderConnection::heartbeatAnswered(bool present, std::int64_t nowMillis) {
+    if (_state != ReaderLinkState::Ready || !_heartbeatOutstanding) {
+        return;
+    }
+    _heartbeatOutstanding = false;
+    if (present) {
+        _missedHeartbeats = 0;
+        _nextHeartbeatAtMillis = nowMillis + _config.heartbeatIntervalMillis;
+    } else {
+        // The SDK may still think the reader is connected; disconnect it so selecting it again works.
+        drop(nowMillis);
+        _disconnectPending = true;
+    }
+}
+
+void ReaderConnection::activity(std::int64_t nowMillis) {
+    _lastActivityMillis = nowMillis;
+    _missedHeartbeats = 0;
+    if (_state == ReaderLinkState::Suspended) {
+        _attempts = 0;
+        _readyTimerStartMillis = -1;
+        startConnecting(nowMillis, true);
+    }
+}
+
+void ReaderConnection::setTransactionActive(bool active, std::int64_t nowMillis) {
+    if (active == _transactionActive) {
+        return;
+    }
+    _transactionActive = active;
+    _lastActivityMillis = nowMillis;
+    _missedHeartbeats = 0;
+    // A heartbeat already sent is no longer waited for; its answer is ignored.
+    _heartbeatOutstanding = false;
+    _nextHeartbeatAtMillis = nowMillis + _config.heartbeatIntervalMillis;
+    if (!active && _state == ReaderLinkState::Connecting && _connectIssued) {
+        _connectIssuedAtMillis = nowMillis;
+    }
+}
+
+ReaderLinkAction ReaderConnection::poll(std::int64_t nowMillis) {
+    if (_transactionActive) {
+        // Only reconnecting a reader that dropped goes ahead.
+        if (_state == ReaderLinkState::Waiting && nowMillis >= _retryAtMillis) {
+            startConnecting(nowMillis, _reconnecting);
+        }
+        if (_state == ReaderLinkState::Connecting && !_connectIssued) {
+            _connectIssued = true;
+            _connectIssuedAtMillis = nowMillis;
+            return ReaderLinkAction::Connect;
+        }
+        return ReaderLinkAction::None;
+    }
+    if (_disconnectPending) {
+        _disconnectPending = false;
+        return ReaderLinkAction::Disconnect;
+    }
+
+    switch (_state) {
+    case ReaderLinkState::Connecting:
+        if (!_connectIssued) {
+            _connectIssued = true;
+            _connectIssuedAtMillis = nowMillis;
+            return ReaderLinkAction::Connect;
+        }
+        if (nowMillis - _connectIssuedAtMillis >= _config.connectTimeoutMillis) {
+            connectFailed(nowMillis);
+            return ReaderLinkAction::Disconnect;
+        }
+        return ReaderLinkAction::None;
+
+    case ReaderLinkState::Waiting:
+        if (nowMillis < _retryAtMillis) {
+            return ReaderLinkAction::None;
+        }
+        startConnecting(nowMillis, _reconnecting);
+        _connectIssued = true;
+        _connectIssuedAtMillis = nowMillis;
+        return ReaderLinkAction::Connect;
+
+    case ReaderLinkState::Ready:
+        if (_config.idleDisconnectMillis > 0 && nowMillis - _lastActivityMillis >= _config.idleDisconnectMillis) {
+            _state = ReaderLinkState::Suspended;
+            _heartbeatOutstanding = false;
+            return ReaderLinkAction::Disconnect;
+        }
+        if (_heartbeatOutstanding && nowMillis >= _heartbeatDeadlineMillis) {
+            _heartbeatOutstanding = false;
+            if (++_missedHeartbeats >= std::max<std::uint32_t>(_config.maxMissedHeartbeats, 1)) {
+                drop(nowMillis);
+                return ReaderLinkAction::Disconnect;
+            }
+            _nextHeartbeatAtMillis = nowMillis;
+        }
+        if (_config.heartbeatIntervalMillis > 0 && !_heartbeatOutstanding && nowMillis >= _nextHeartbeatAtMillis) {
+            _heartbeatOutstanding = true;
+            _heartbeatDeadlineMillis = nowMillis + _config.heartbeatTimeoutMillis;
+            return ReaderLinkAction::Heartbeat;
+        }
+        return ReaderLinkAction::None;
+
+    case ReaderLinkState::Idle:
+    case ReaderLinkState::Suspended:
+        break;
+    }
+    return ReaderLinkAction::None;
+}
+
+std::int64_t ReaderConnection::nextDeadlineMillis() const {
+    if (_transactionActive) {
+        if (_state == ReaderLinkState::Waiting) {
+            return _retryAtMillis;
+        }
+        return _state == ReaderLinkState::Connecting && !_connectIssued ? 0 : -1;
+    }
+    if (_disconnectPending) {
+        return 0;
+    }
+    switch (_state) {
+    case ReaderLinkState::Connecting:
+        return _connectIssued ? _connectIssuedAtMillis + _config.connectTimeoutMillis : 0;
+    case ReaderLinkState::Waiting:
+        return _retryAtMillis;
+    case ReaderLinkState::Ready: {
+        std::int64_t next = _config.idleDisconnectMillis > 0 ? _lastActivityMillis + _config.idleDisconnectMillis : -1;
+        if (_heartbeatOutstanding) {
+            next = earliest(next, _heartbeatDeadlineMillis);
+        } else if (_config.heartbeatIntervalMillis > 0) {
+            next = earliest(next, _nextHeartbeatAtMillis);
+        }
+        return next;
+    }
+    case ReaderLinkState::Idle:
+    case ReaderLinkState::Suspended:
+        break;
+    }
+    return -1;
+}
+
+const LatencyHistogram &ReaderConnection::timeToReady(CardReaderModel model, bool reconnect) const {
+    return (reconnect ? _reconnections : _firstConnections)[modelIndex(model)];
+}
+
+void ReaderConnection::startConnecting(std::int64_t nowMillis, bool reconnect) {
+    _state = ReaderLinkState::Connecting;
+    _connectIssued = false;
+    _reconnecting = reconnect;
+    _heartbeatOutstanding = false;
+    if (_readyTimerStartMillis < 0) {
+        _readyTimerStartMillis = nowMillis;
+    }
+}
+
+// The first reconnect is immediate: most drops are a reader waking from sleep or a phone call
+// taking the radio, and the reader is back by the time it is selected again.
+void ReaderConnection::drop(std::int64_t nowMillis) {
+    _state = ReaderLinkState::Waiting;
+    _attempts = 0;
+    _retryAtMillis = nowMillis;
+    _reconnecting = true;
+    _readyTimerStartMillis = nowMillis;
+    _heartbeatOutstanding = false;
+    _missedHeartbeats = 0;
+}
+
+std::int64_t ReaderConnection::retryDelayMillis(std::uint32_t attempts) const {
+    std::int64_t delay = _config.baseRetryDelayMillis;
+    for (std::uint32_t i = 1; i < attempts && delay < _config.maxRetryDelayMillis; ++i) {
+        delay *= 2;
+    }
+    return std::min(delay, _config.maxRetryDelayMillis);
+}
+
+std::size_t ReaderConnection::modelIndex(CardReaderModel model) {
+    const std::size_t index = static_cast<std::size_t>(model);
+    return index < kCardReaderModelCount ? index : 0;
+}
+
+} // namespace cft
@@ -0,0 +1,401 @@
+//
+//  ReaderDiscovery.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/ReaderDiscovery.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+#include "cft/File.hpp"
+
+namespace cft {
+
+namespace {
+
+// Snapshot layout: magic, u32 version, u32 reader count, then per reader u32 name length,
+// i32 model, i64 lastUsedMillis, u32 connectCount, name; finally a CRC-32 of everything before it.
+constexpr char kSnapshotMagic[8] = {'C', 'F', 'T', 'R', 'E', 'A', 'D', 'R'};
+constexpr std::uint32_t kSnapshotVersion = 1;
+constexpr std::size_t kSnapshotHeaderSize = sizeof(kSnapshotMagic) + 8;
+constexpr std::size_t kSnapshotEntryHeaderSize = 20;
+
+// Scans also hear phones, watches and headphones; readings for names the SDK never lists stop
+// being kept past this many.
+constexpr std::size_t kMaxPendingSignals = 128;
+
+// CoreBluetooth reports 127 when it has no reading.
+constexpr int kMinSignal = -127;
+constexpr int kMaxSignal = 20;
+
+// Readings swing several dB between advertisements; each new one moves the smoothed value a quarter of the way.
+int smoothSignal(int previous, int reading) {
+    if (previous == kNoSignal) {
+        return reading;
+    }
+    const int sum = previous * 3 + reading;
+    return sum >= 0 ? (sum + 2) / 4 : -((-sum + 2) / 4);
+}
+
+int rankedSignalFor(int rankedSignal, int signal, int stepDb) {
+    if (rankedSignal == kNoSignal || signal == kNoSignal || std::abs(signal - rankedSignal) >= stepDb) {
+        return signal;
+    }
+    return rankedSignal;
+}
+
+// Indices into sequence of the longest strictly increasing subsequence.
+std::vector<std::size_t> longestIncreasing(const std::vector<std::size_t> &sequence) {
+    std::vector<std::size_t> tails;
+    std::vector<std::size_t> previous(sequence.size(), sequence.size());
+    for (std::size_t i = 0; i < sequence.size(); ++i) {
+        auto position = std::lower_bound(tails.begin(), tails.end(), sequence[i],
+                                         [&](std::size_t tail, std::size_t value) { return sequence[tail] < value; });
+        if (position != tails.begin()) {
+            previous[i] = *(position - 1);
+        }
+        if (position == tails.end()) {
+            tails.push_back(i);
+        } else {
+            *position = i;
+        }
+    }
+    std::vector<std::size_t> result(tails.size());
+    std::size_t at = tails.empty() ? sequence.size() : tails.back();
+    for (std::size_t i = tails.size(); i > 0; --i) {
+        result[i - 1] = at;
+        at = previous[at];
+    }
+    return result;
+}
+
+} // namespace
+
+void ReaderDiscovery::updateVisible(const std::vector<ReaderSighting> &visible, std::int64_t nowMillis,
+                                    std::vector<ReaderChange> &changes) {
+    std::unordered_map<std::string, const DiscoveredReader *> current;
+    current.reserve(_ranked.size());
+    for (const DiscoveredReader &reader : _ranked) {
+        current.emplace(reader.name, &reader);
+    }
+
+    std::vector<DiscoveredReader> next;
+    next.reserve(visible.size());
+    std::unordered_map<std::string, bool> seen;
+    seen.reserve(visible.size());
+    for (const ReaderSighting &sighting : visible) {
+        if (!seen.emplace(sighting.name, true).second) {
+            continue;
+        }
+        DiscoveredReader reader;
+        auto existing = current.find(sighting.name);
+        if (existing != current.end()) {
+            reader = *existing->second;
+        } else {
+            reader.name = sighting.name;
+            auto pending = _pendingSignals.find(sighting.name);
+            if (pending != _pendingSignals.end()) {
+                reader.signal = pending->second;
+                reader.rankedSignal = pending->second;
+                _pendingSignals.erase(pending);
+            }
+        }
+        reader.model = sighting.model;
+        reader.connected = sighting.connected;
+        next.push_back(std::move(reader));
+    }
+    rerank(std::move(next), nowMillis, changes);
+}
+
+void ReaderDiscovery::updateSignal(const std::string &name, int signal, std::int64_t nowMillis,
+                                   std::vector<ReaderChange> &changes) {
+    if (signal < kMinSignal || signal > kMaxSignal) {
+        return;
+    }
+    auto reader = std::find_if(_ranked.begin(), _ranked.end(),
+                               [&](const DiscoveredReader &candidate) { return candidate.name == name; });
+    if (reader == _ranked.end()) {
+        auto pending = _pendingSignals.find(name);
+        if (pending != _pendingSignals.end()) {
+            pending->second = smoothSignal(pending->second, signal);
+        } else if (_pendingSignals.size() < kMaxPendingSignals) {
+            _pendingSignals.emplace(name, signal);
+        }
+        return;
+    }
+
+    const int smoothed = smoothSignal(reader->signal, signal);
+    const int rankedSignal = rankedSignalFor(reader->rankedSignal, smoothed, _config.signalStepDb);
+    reader->signal = smoothed;
+    if (rankedSignal == reader->rankedSignal) {
+        return;
+    }
+    std::vector<DiscoveredReader> next = _ranked;
+    next[static_cast<std::size_t>(reader - _ranked.begin())].rankedSignal = rankedSignal;
+    rerank(std::move(next), nowMillis, changes);
+}
+
+void ReaderDiscovery::endScan(std::int64_t nowMillis, std::vector<ReaderChange> &changes) {
+    _pendingSignals.clear();
+    std::vector<DiscoveredReader> next;
+    for (const DiscoveredReader &reader : _ranked) {
+        if (reader.connected) {
+            next.push_back(reader);
+        }
+    }
+    rerank(std::move(next), nowMillis, changes);
+}
+
+void ReaderDiscovery::recordConnected(const std::string &name, CardReaderModel model, std::int64_t nowMillis,
+                                      std::vector<ReaderChange> &changes) {
+    KnownReader &known = _known[name];
+    known.name = name;
+    known.model = model;
+    known.lastUsedMillis = std::max(known.lastUsedMillis, nowMillis);
+    ++known.connectCount;
+    trimKnownReaders();
+
+    std::vector<DiscoveredReader> next = _ranked;
+    auto reader = std::find_if(next.begin(), next.end(),
+                               [&](const DiscoveredReader &candidate) { return candidate.name == name; });
+    if (reader == next.end()) {
+        next.emplace_back();
+        reader = next.end() - 1;
+        reader->name = name;
+    }
+    reader->model = model;
+    reader->connected = true;
+    rerank(std::move(next), nowMillis, changes);
+}
+
+void ReaderDiscovery::recordDisconnected(const std::string &name, std::int64_t nowMillis,
+                                         std::vector<ReaderChange> &changes) {
+    std::vector<DiscoveredReader> next = _ranked;
+    for (DiscoveredReader &reader : next) {
+        if (reader.name == name) {
+            reader.connected = false;
+        }
+    }
+    rerank(std::move(next), nowMillis, changes);
+}
+
+bool ReaderDiscovery::autoConnectCandidate(DiscoveredReader &reader) const {
+    const KnownReader *last = nullptr;
+    for (const auto &pair : _known) {
+        if (last == nullptr || pair.second.lastUsedMillis > last->lastUsedMillis) {
+            last = &pair.second;
+        }
+    }
+    if (last == nullptr) {
+        return false;
+    }
+    const DiscoveredReader *match = nullptr;
+    for (const DiscoveredReader &candidate : _ranked) {
+        if (candidate.connected) {
+            return false;
+        }
+        if (candidate.name == last->name) {
+            match = &candidate;
+        }
+    }
+    if (match == nullptr) {
+        return false;
+    }
+    reader = *match;
+    return true;
+}
+
+std::vector<KnownReader> ReaderDiscovery::knownReaders() const {
+    std::vector<KnownReader> readers;
+    readers.reserve(_known.size());
+    for (const auto &pair : _known) {
+        readers.push_back(pair.second);
+    }
+    std::sort(readers.begin(), readers.end(), [](const KnownReader &a, const KnownReader &b) {
+        return a.lastUsedMillis != b.lastUsedMillis ? a.lastUsedMillis > b.lastUsedMillis : a.name < b.name;
+    });
+    return readers;
+}
+
+void ReaderDiscovery::forget(const std::string &name, std::int64_t nowMillis, std::vector<ReaderChange> &changes) {
+    if (_known.erase(name) == 0) {
+        return;
+    }
+    rerank(_ranked, nowMillis, changes);
+}
+
+void ReaderDiscovery::trimKnownReaders() {
+    while (_known.size() > std::max<std::size_t>(_config.maxKnownReaders, 1)) {
+        auto oldest = _known.begin();
+        for (auto it = _known.begin(); it != _known.end(); ++it) {
+            if (it->second.lastUsedMillis < oldest->second.lastUsedMillis) {
+                oldest = it;
+            }
+        }
+        _known.erase(oldest);
+    }
+}
+
+// Sorts next into rank order, then reports the difference from _ranked. Readers that keep their
+// order relative to each other (the longest run of survivors already in order) are not reported as
+// moved, so one reader jumping ahead is one move rather than a shift of everything it passed.
+void ReaderDiscovery::rerank(std::vector<DiscoveredReader> next, std::int64_t nowMillis,
+                             std::vector<ReaderChange> &changes) {
+    for (DiscoveredReader &reader : next) {
+        auto known = _known.find(reader.name);
+        reader.lastUsedMillis = known != _known.end() ? known->second.lastUsedMillis : 0;
+    }
+
+    auto tier = [&](const DiscoveredReader &reader) {
+        if (reader.connected) {
+            return 0;
+        }
+        if (reader.lastUsedMillis > 0 && nowMillis - reader.lastUsedMillis <= _config.recentUseMillis) {
+            return 1;
+        }
+        return 2;
+    };
+    std::sort(next.begin(), next.end(), [&](const DiscoveredReader &a, const DiscoveredReader &b) {
+        const int tierA = tier(a);
+        const int tierB = tier(b);
+        if (tierA != tierB) {
+            return tierA < tierB;
+        }
+        if (tierA == 2 && a.rankedSignal != b.rankedSignal) {
+            return a.rankedSignal > b.rankedSignal;
+        }
+        return std::tie(b.lastUsedMillis, a.name) < std::tie(a.lastUsedMillis, b.name);
+    });
+
+    std::unordered_map<std::string, std::size_t> nextIndex;
+    nextIndex.reserve(next.size());
+    for (std::size_t i = 0; i < next.size(); ++i) {
+        nextIndex.emplace(next[i].name, i);
+    }
+
+    std::vector<std::size_t> survivorPrevious;
+    std::vector<std::size_t> survivorNext;
+    std::unordered_map<std::string, bool> previousNames;
+    previousNames.reserve(_ranked.size());
+    for (std::size_t i = 0; i < _ranked.size(); ++i) {
+        previousNames.emplace(_ranked[i].name, true);
+        auto found = nextIndex.find(_ranked[i].name);
+        if (found == nextIndex.end()) {
+            changes.push_back({ReaderChangeKind::Removed, _ranked[i].name, 0, i});
+        } else {
+            survivorPrevious.push_back(i);
+            survivorNext.push_back(found->second);
+        }
+    }
+
+    std::vector<bool> stays(survivorNext.size(), false);
+    for (std::size_t i : longestIncreasing(survivorNext)) {
+        stays[i] = true;
+    }
+    for (std::size_t i = 0; i < survivorNext.size(); ++i) {
+        const DiscoveredReader &before = _ranked[survivorPrevious[i]];
+        const DiscoveredReader &after = next[survivorNext[i]];
+        if (!stays[i]) {
+            changes.push_back({ReaderChangeKind::Moved, after.name, survivorNext[i], survivorPrevious[i]});
+        } else if (before.model != after.model || before.connected != after.connected ||
+                   before.rankedSignal != after.rankedSignal || before.lastUsedMillis != after.lastUsedMillis) {
+            changes.push_back({ReaderChangeKind::Updated, after.name, survivorNext[i], survivorPrevious[i]});
+        }
+    }
+
+    for (std::size_t i = 0; i < next.size(); ++i) {
+        if (previousNames.find(next[i].name) == previousNames.end()) {
+            changes.push_back({ReaderChangeKind::Added, next[i].name, i, 0});
+        }
+    }
+
+    _ranked = std::move(next);
+}
+
+ErrorCode ReaderDiscovery::save(const std::string &path) const {
+    std::vector<std::uint8_t> snapshot;
+    appendBytes(snapshot, kSnapshotMagic, sizeof(kSnapshotMagic));
+    appendLittleEndian<std::uint32_t>(snapshot, kSnapshotVersion);
+    appendLittleEndian<std::uint32_t>(snapshot, static_cast<std::uint32_t>(_known.size()));
+    for (const auto &pair : _known) {
+        const KnownReader &reader = pair.second;
+        appendLittleEndian<std::uint32_t>(snapshot, static_cast<std::uint32_t>(reader.name.size()));
+        appendLittleEndian<std::int32_t>(snapshot, static_cast<std::int32_t>(reader.model));
+        appendLittleEndian<std::int64_t>(snapshot, reader.lastUsedMillis);
+        appendLittleEndian<std::uint32_t>(snapshot, reader.connectCount);
+        appendBytes(snapshot, reader.name.data(), reader.name.size());
+    }
+    appendLittleEndian<std::uint32_t>(snapshot, crc32(snapshot.data(), snapshot.size()));
+    return File::replace(path, snapshot.data(), snapshot.size());
+}
+
+ErrorCode ReaderDiscovery::load(const std::string &path) {
+    File file;
+    ErrorCode error = File::openForRead(path, file);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::vector<std::uint8_t> snapshot;
+    if ((error = file.readAll(snapshot)) != ErrorCode::None) {
+        return error;
+    }
+
+    if (snapshot.size() < kSnapshotHeaderSize + 4 ||
+        std::memcmp(snapshot.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        loadLittleEndian<std::uint32_t>(snapshot.data() + sizeof(kSnapshotMagic)) != kSnapshotVersion) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::size_t bodyEnd = snapshot.size() - 4;
+    if (loadLittleEndian<std::uint32_t>(snapshot.data() + bodyEnd) != crc32(snapshot.data(), bodyEnd)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    // Parse everything before merging so a malformed snapshot changes nothing.
+    std::vector<KnownReader> loaded;
+    const std::uint32_t count = loadLittleEndian<std::uint32_t>(snapshot.data() + sizeof(kSnapshotMagic) + 4);
+    std::size_t offset = kSnapshotHeaderSize;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (bodyEnd - offset < kSnapshotEntryHeaderSize) {
+            return ErrorCode::InvalidArgument;
+        }
+        const std::size_t nameLength = loadLittleEndian<std::uint32_t>(snapshot.data() + offset);
+        const std::int32_t model = loadLittleEndian<std::int32_t>(snapshot.data() + offset + 4);
+        KnownReader reader;
+        reader.model = model >= 0 && static_cast<std::size_t>(model) < kCardReaderModelCount
+                           ? static_cast<CardReaderModel>(model)
+                           : CardReaderModel::Unknown;
+        reader.lastUsedMillis = loadLittleEndian<std::int64_t>(snapshot.data() + offset + 8);
+        reader.connectCount = loadLittleEndian<std::uint32_t>(snapshot.data() + offset + 16);
+        offset += kSnapshotEntryHeaderSize;
+        if (bodyEnd - offset < nameLength) {
+            return ErrorCode::InvalidArgument;
+        }
+        reader.name.assign(reinterpret_cast<const char *>(snapshot.data() + offset), nameLength);
+        offset += nameLength;
+        loaded.push_back(std::move(reader));
+    }
+    if (offset != bodyEnd) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    for (KnownReader &reader : loaded) {
+        auto existing = _known.find(reader.name);
+        if (existing != _known.end() && existing->second.lastUsedMillis >= reader.lastUsedMillis) {
+            continue;
+        }
+        _known[reader.name] = std::move(reader);
+    }
+    trimKnownReaders();
+    return ErrorCode::None;
+}
+
+} // namespace cft
@@ -0,0 +1,313 @@
+//
+//  ReaderEventBus.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/ReaderEventBus.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cft/Checksum.hpp"
+#include "cft/Clock.hpp"
+
+namespace cft {
+
+namespace {
+
+std::size_t roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t rounded = 2;
+    while (rounded < value) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+std::uint64_t coalescingKey(const ReaderEventMessage &message) {
+    return (static_cast<std::uint64_t>(message.reader) << 32) | static_cast<std::uint32_t>(message.event);
+}
+
+bool isKnownEvent(CardReaderEvent event) {
+    return static_cast<std::uint32_t>(event) < kCardReaderEventCount;
+}
+
+// Duplicates only matter within the window, so older entries are pruned once this many keys build up.
+constexpr std::size_t kLastSeenPruneSize = 1024;
+
+} // namespace
+
+// A slot is free for position p when its sequence is p, and filled when it is p + 1.
+struct ReaderEventBus::Cell {
+    std::atomic<std::uint64_t> sequence{0};
+    ReaderEventMessage message;
+};
+
+struct ReaderEventBus::Inbox {
+    Inbox(SubscriberId id, ReaderEventSubscription subscription) : id(id), subscription(subscription) {}
+
+    const SubscriberId id;
+    const ReaderEventSubscription subscription;
+
+    // Serializes drains so the scratch buffer and delivery order belong to one of them.
+    std::mutex drainLock;
+    std::vector<ReaderEventMessage> scratch;
+
+    // Everything below is guarded by lock.
+    std::mutex lock;
+    std::deque<ReaderEventMessage> pending;
+    // Position of pending.front() counted from the first event the inbox ever held.
+    std::uint64_t base = 0;
+    // Position of the undelivered event per coalescing key; stale once below base.
+    std::unordered_map<std::uint64_t, std::uint64_t> coalescible;
+    std::uint64_t missed = 0;
+    ReaderSubscriberStats stats;
+
+    // Called with lock held.
+    void offer(const ReaderEventMessage &message) {
+        const bool coalesces = (subscription.coalesced & readerEventBit(message.event)) != 0;
+        const std::uint64_t key = coalescingKey(message);
+        if (coalesces) {
+            const auto found = coalescible.find(key);
+            if (found != coalescible.end() && found->second >= base) {
+                // The newer event goes to the back, so delivery stays in publish order and a
+                // full inbox drops the stale state first.
+                const std::uint64_t position = found->second;
+                pending.erase(pending.begin() + static_cast<std::ptrdiff_t>(position - base));
+                for (auto &entry : coalescible) {
+                    entry.second -= entry.second > position ? 1 : 0;
+                }
+                ++stats.coalesced;
+                coalescible[key] = base + pending.size();
+                pending.push_back(message);
+                return;
+            }
+        }
+
+        if (pending.size() >= std::max<std::size_t>(subscription.capacity, 1)) {
+            ++missed;
+            ++stats.overflowed;
+            if (subscription.overflow == ReaderEventOverflow::DropNewest) {
+                return;
+            }
+            pending.pop_front();
+            ++base;
+        }
+        if (coalesces) {
+            if (coalescible.size() > std::max<std::size_t>(subscription.capacity, 16)) {
+                pruneCoalescible();
+            }
+            coalescible[key] = base + pending.size();
+        }
+        pending.push_back(message);
+    }
+
+    void pruneCoalescible() {
+        for (auto it = coalescible.begin(); it != coalescible.end();) {
+            it = it->second < base ? coalescible.erase(it) : std::next(it);
+        }
+    }
+};
+
+ReaderEventBus::ReaderEventBus(ReaderEventBusConfig config)
+    : _mask(roundUpToPowerOfTwo(config.capacity) - 1),
+      _duplicateWindowNanos(config.duplicateWindowNanos),
+      _cells(new Cell[_mask + 1]) {
+    for (std::size_t i = 0; i <= _mask; ++i) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+ReaderEventBus::~ReaderEventBus() = default;
+
+bool ReaderEventBus::publish(ReaderEventMessage message) {
+    std::uint64_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Cell *cell = nullptr;
+    for (;;) {
+        cell = &_cells[position & _mask];
+        const std::uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const auto lag = static_cast<std::int64_t>(sequence - position);
+        if (lag == 0) {
+            if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // The dispatcher has not freed this slot from the previous lap.
+            _rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (message.timestamp == 0) {
+        message.timestamp = monotonicNanos();
+    }
+    message.sequence = position;
+    cell->message = message;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool ReaderEventBus::publish(CardReaderEvent event, ReaderEventSource source, std::uint32_t reader,
+                             std::int32_t detail) {
+    ReaderEventMessage message;
+    message.event = event;
+    message.source = source;
+    message.reader = reader;
+    message.detail = detail;
+    return publish(message);
+}
+
+ReaderEventBus::SubscriberId ReaderEventBus::subscribe(ReaderEventSubscription subscription) {
+    std::lock_guard<std::mutex> guard(_subscribersLock);
+    const SubscriberId id = _nextSubscriber++;
+    _inboxes.push_back(std::make_shared<Inbox>(id, subscription));
+    return id;
+}
+
+void ReaderEventBus::unsubscribe(SubscriberId subscriber) {
+    std::lock_guard<std::mutex> guard(_subscribersLock);
+    _inboxes.erase(std::remove_if(_inboxes.begin(), _inboxes.end(), [&](const std::shared_ptr<Inbox> &inbox) {
+        return inbox->id == subscriber;
+    }), _inboxes.end());
+}
+
+std::shared_ptr<ReaderEventBus::Inbox> ReaderEventBus::findInbox(SubscriberId subscriber) const {
+    std::lock_guard<std::mutex> guard(_subscribersLock);
+    for (const std::shared_ptr<Inbox> &inbox : _inboxes) {
+        if (inbox->id == subscriber) {
+            return inbox;
+        }
+    }
+    return nullptr;
+}
+
+// Keeps the first report of an event; the second path's copy arrives within the window with the same detail.
+bool ReaderEventBus::isDuplicate(const ReaderEventMessage &message) {
+    if (_duplicateWindowNanos == 0) {
+        return false;
+    }
+    if (_lastSeen.size() >= kLastSeenPruneSize) {
+        for (auto it = _lastSeen.begin(); it != _lastSeen.end();) {
+            const bool expired = message.timestamp > it->second.timestamp &&
+                                 message.timestamp - it->second.timestamp > _duplicateWindowNanos;
+            it = expired ? _lastSeen.erase(it) : std::next(it);
+        }
+    }
+
+    LastSeen &last = _lastSeen[coalescingKey(message)];
+    // Publishers on different threads may stamp slightly out of queue order.
+    const Nanos apart = message.timestamp > last.timestamp ? message.timestamp - last.timestamp
+                                                           : last.timestamp - message.timestamp;
+    const bool duplicate = last.timestamp != 0 && last.source != message.source && last.detail == message.detail &&
+                           apart <= _duplicateWindowNanos;
+    if (!duplicate) {
+        last = LastSeen{message.timestamp, message.detail, message.source};
+    }
+    return duplicate;
+}
+
+std::size_t ReaderEventBus::dispatch(std::vector<SubscriberId> *woken, std::size_t maxEvents) {
+    std::lock_guard<std::mutex> guard(_dispatchLock);
+    _batch.clear();
+    std::size_t taken = 0;
+    std::uint64_t duplicates = 0;
+    for (; taken < maxEvents; ++taken) {
+        Cell &cell = _cells[_dequeuePosition & _mask];
+        if (cell.sequence.load(std::memory_order_acquire) != _dequeuePosition + 1) {
+            break;
+        }
+        const ReaderEventMessage message = cell.message;
+        cell.sequence.store(_dequeuePosition + _mask + 1, std::memory_order_release);
+        ++_dequeuePosition;
+
+        if (!isKnownEvent(message.event)) {
+            continue;
+        }
+        if (isDuplicate(message)) {
+            ++duplicates;
+            continue;
+        }
+        _batch.push_back(message);
+    }
+    if (taken == 0) {
+        return 0;
+    }
+    _dispatched.fetch_add(taken, std::memory_order_relaxed);
+    _duplicates.fetch_add(duplicates, std::memory_order_relaxed);
+
+    // Each inbox is locked once per dispatch rather than once per event.
+    std::lock_guard<std::mutex> subscribersGuard(_subscribersLock);
+    for (const std::shared_ptr<Inbox> &inbox : _inboxes) {
+        std::lock_guard<std::mutex> inboxGuard(inbox->lock);
+        const bool wasEmpty = inbox->pending.empty();
+        for (const ReaderEventMessage &message : _batch) {
+            if ((inbox->subscription.events & readerEventBit(message.event)) != 0) {
+                inbox->offer(message);
+            }
+        }
+        if (woken != nullptr && wasEmpty && !inbox->pending.empty()) {
+            woken->push_back(inbox->id);
+        }
+    }
+    return taken;
+}
+
+std::size_t ReaderEventBus::drain(SubscriberId subscriber, const SinkFunction &sink, std::size_t maxEvents) {
+    const std::shared_ptr<Inbox> inbox = findInbox(subscriber);
+    if (!inbox) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> drainGuard(inbox->drainLock);
+    std::uint64_t missed = 0;
+    inbox->scratch.clear();
+    {
+        std::lock_guard<std::mutex> guard(inbox->lock);
+        const std::size_t take = std::min(maxEvents, inbox->pending.size());
+        inbox->scratch.assign(inbox->pending.begin(), inbox->pending.begin() + static_cast<std::ptrdiff_t>(take));
+        inbox->pending.erase(inbox->pending.begin(), inbox->pending.begin() + static_cast<std::ptrdiff_t>(take));
+        inbox->base += take;
+        if (inbox->pending.empty()) {
+            inbox->coalescible.clear();
+        }
+        missed = inbox->missed;
+        inbox->missed = 0;
+        inbox->stats.delivered += take;
+    }
+    if (inbox->scratch.empty() && missed == 0) {
+        return 0;
+    }
+    sink(inbox->scratch.data(), inbox->scratch.size(), missed);
+    return inbox->scratch.size();
+}
+
+ReaderEventBusStats ReaderEventBus::stats() const {
+    ReaderEventBusStats stats;
+    stats.rejected = _rejected.load(std::memory_order_relaxed);
+    stats.published = _enqueuePosition.load(std::memory_order_relaxed);
+    stats.dispatched = _dispatched.load(std::memory_order_relaxed);
+    stats.duplicates = _duplicates.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(_subscribersLock);
+    stats.subscribers = _inboxes.size();
+    return stats;
+}
+
+ReaderSubscriberStats ReaderEventBus::subscriberStats(SubscriberId subscriber) const {
+    const std::shared_ptr<Inbox> inbox = findInbox(subscriber);
+    if (!inbox) {
+        return ReaderSubscriberStats();
+    }
+    std::lock_guard<std::mutex> guard(inbox->lock);
+    ReaderSubscriberStats stats = inbox->stats;
+    stats.pending = inbox->pending.size();
+    return stats;
+}
+
+std::uint32_t readerEventId(const char *name) {
+    return name == nullptr ? 0 : crc32(name, std::strlen(name));
+}
+
+} // namespace cft
@@ -0,0 +1,120 @@
+//
+//  ReaderLanes.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/ReaderLanes.hpp"
+
+#include <utility>
+
+namespace cft {
+
+ReaderLane::ReaderLane(LaneId id, std::string readerName, CardReaderModel model, ClockFunction clock)
+    : _id(id), _readerName(std::move(readerName)), _model(model), _clock(clock), _machine(this, clock) {}
+
+ErrorCode ReaderLane::begin() {
+    if (isBusy()) {
+        return ErrorCode::IllegalTransition;
+    }
+    _machine.reset();
+    _startedAt = _clock();
+    _busy.store(true, std::memory_order_release);
+    return _machine.transitionTo(TransactionState::PendingTransactionParameters);
+}
+
+ErrorCode ReaderLane::updateState(TransactionState state) {
+    if (!isBusy()) {
+        return ErrorCode::IllegalTransition;
+    }
+    return _machine.transitionTo(state);
+}
+
+void ReaderLane::recordReaderEvent(CardReaderEvent) {
+    ++_readerEvents;
+}
+
+void ReaderLane::abandon() {
+    _machine.reset();
+    _busy.store(false, std::memory_order_release);
+}
+
+void ReaderLane::stateMachineDidTransition(const TransactionStateMachine &machine, TransactionState from,
+                                           TransactionState to, Nanos timeInPrevious) {
+    // A machine driving the reader directly starts its transaction the way begin() does.
+    if (&machine != &_machine && from == TransactionState::Unknown && !isBusy()) {
+        _startedAt = _clock();
+        _busy.store(true, std::memory_order_release);
+    }
+    _states.stateMachineDidTransition(machine, from, to, timeInPrevious);
+    if (TransactionStateMachine::isTerminal(to) && isBusy()) {
+        const Nanos now = _clock();
+        _transactionTimes.record(now > _startedAt ? now - _startedAt : 0);
+        ++_transactions;
+        _busy.store(false, std::memory_order_release);
+    }
+}
+
+ReaderLanes::ReaderLanes(ReaderLanesConfig config)
+    : _config(config), _lanes(std::make_shared<const LaneMap>()) {}
+
+std::shared_ptr<const ReaderLanes::LaneMap> ReaderLanes::snapshot() const {
+    return std::atomic_load_explicit(&_lanes, std::memory_order_acquire);
+}
+
+ErrorCode ReaderLanes::open(const std::string &readerName, CardReaderModel model, std::shared_ptr<ReaderLane> &lane) {
+    std::lock_guard<std::mutex> guard(_writeLock);
+    const std::shared_ptr<const LaneMap> current = snapshot();
+    if (readerName.empty() || current->count(readerName) != 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    if (current->size() >= _config.maxLanes) {
+        return ErrorCode::CapacityExceeded;
+    }
+
+    auto next = std::make_shared<LaneMap>(*current);
+    lane = std::make_shared<ReaderLane>(_nextLane++, readerName, model, _config.clock);
+    next->emplace(readerName, lane);
+    std::atomic_store_explicit(&_lanes, std::shared_ptr<const LaneMap>(std::move(next)), std::memory_order_release);
+    return ErrorCode::None;
+}
+
+ErrorCode ReaderLanes::close(LaneId lane) {
+    std::lock_guard<std::mutex> guard(_writeLock);
+    const std::shared_ptr<const LaneMap> current = snapshot();
+    for (const auto &entry : *current) {
+        if (entry.second->id() != lane) {
+            continue;
+        }
+        if (entry.second->isBusy()) {
+            return ErrorCode::IllegalTransition;
+        }
+        auto next = std::make_shared<LaneMap>(*current);
+        next->erase(entry.first);
+        std::atomic_store_explicit(&_lanes, std::shared_ptr<const LaneMap>(std::move(next)), std::memory_order_release);
+        return ErrorCode::None;
+    }
+    return ErrorCode::NotFound;
+}
+
+std::shared_ptr<ReaderLane> ReaderLanes::find(const std::string &readerName) const {
+    const std::shared_ptr<const LaneMap> current = snapshot();
+    const auto found = current->find(readerName);
+    return found == current->end() ? nullptr : found->second;
+}
+
+std::shared_ptr<ReaderLane> ReaderLanes::lane(LaneId lane) const {
+    for (const auto &entry : *snapshot()) {
+        if (entry.second->id() == lane) {
+            return entry.second;
+        }
+    }
+    return nullptr;
+}
+
+std::size_t ReaderLanes::size() const {
+    return snapshot()->size();
+}
+
+} // namespace cft
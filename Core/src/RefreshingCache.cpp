@@ -0,0 +1,351 @@
+//
+//  RefreshingCache.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/RefreshingCache.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+#include "cft/File.hpp"
+
+namespace cft {
+
+namespace {
+
+// Snapshot layout: magic, u32 version, u32 entry count, then per entry u32 key length,
+// u32 value length, i64 fetchedAtMillis, key, value; finally a CRC-32 of everything before it.
+constexpr char kSnapshotMagic[8] = {'C', 'F', 'T', 'C', 'A', 'C', 'H', 'E'};
+constexpr std::uint32_t kSnapshotVersion = 1;
+constexpr std::size_t kSnapshotHeaderSize = sizeof(kSnapshotMagic) + 8;
+constexpr std::size_t kSnapshotEntryHeaderSize = 16;
+
+} // namespace
+
+RefreshingCache::RefreshingCache(RefreshingCacheConfig config, FetchFunction fetch)
+    : _config(config), _fetch(std::move(fetch)) {}
+
+CacheFreshness RefreshingCache::freshness(const Entry &entry, std::int64_t nowMillis) const {
+    if (!entry.hasValue) {
+        return CacheFreshness::Missing;
+    }
+    const std::int64_t age = nowMillis - entry.fetchedAtMillis;
+    if (age < _config.ttlMillis) {
+        return CacheFreshness::Fresh;
+    }
+    return age < _config.ttlMillis + _config.maxStaleMillis ? CacheFreshness::Stale : CacheFreshness::Expired;
+}
+
+bool RefreshingCache::needsBackgroundRefresh(const Entry &entry, std::int64_t nowMillis) const {
+    if (!entry.hasValue || entry.inFlight) {
+        return false;
+    }
+    if (entry.hasFailed && nowMillis - entry.failedAtMillis < _config.retryMillis) {
+        return false;
+    }
+    return nowMillis - entry.fetchedAtMillis >= _config.ttlMillis - _config.prefetchLeadMillis;
+}
+
+void RefreshingCache::get(const std::string &key, std::int64_t nowMillis, ValueFunction callback) {
+    std::unique_lock<std::mutex> lock(_lock);
+    Entry &entry = _entries[key];
+    const CacheFreshness state = freshness(entry, nowMillis);
+
+    if (state == CacheFreshness::Fresh || state == CacheFreshness::Stale) {
+        ++(state == CacheFreshness::Fresh ? _freshHits : _staleHits);
+        const bool startFetch = needsBackgroundRefresh(entry, nowMillis);
+        if (startFetch) {
+            entry.inFlight = true;
+            ++_fetches;
+        }
+        const std::string value = entry.value;
+        lock.unlock();
+
+        // Hand out the cached value before the refresh so the caller never waits on it.
+        if (callback) {
+            callback(ErrorCode::None, value, state);
+        }
+        if (startFetch) {
+            _fetch(key);
+        }
+        return;
+    }
+
+    entry.waiters.push_back(std::move(callback));
+    if (entry.inFlight) {
+        ++_coalesced;
+        return;
+    }
+    entry.inFlight = true;
+    ++_fetches;
+    lock.unlock();
+    _fetch(key);
+}
+
+CacheFreshness RefreshingCache::tryGet(const std::string &key, std::int64_t nowMillis, std::string &value) {
+    std::unique_lock<std::mutex> lock(_lock);
+    Entry &entry = _entries[key];
+    const CacheFreshness state = freshness(entry, nowMillis);
+
+    bool startFetch = false;
+    if (state == CacheFreshness::Fresh || state == CacheFreshness::Stale) {
+        ++(state == CacheFreshness::Fresh ? _freshHits : _staleHits);
+        value = entry.value;
+        startFetch = needsBackgroundRefresh(entry, nowMillis);
+    } else {
+        startFetch = !entry.inFlight;
+    }
+    if (!startFetch) {
+        return state;
+    }
+    entry.inFlight = true;
+    ++_fetches;
+    lock.unlock();
+    _fetch(key);
+    return state;
+}
+
+CacheFreshness RefreshingCache::peek(const std::string &key, std::int64_t nowMillis, std::string &value) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto it = _entries.find(key);
+    if (it == _entries.end() || !it->second.hasValue) {
+        return CacheFreshness::Missing;
+    }
+    value = it->second.value;
+    return freshness(it->second, nowMillis);
+}
+
+bool RefreshingCache::refresh(const std::string &key) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        Entry &entry = _entries[key];
+        if (entry.inFlight) {
+            return false;
+        }
+        entry.inFlight = true;
+        ++_fetches;
+    }
+    _fetch(key);
+    return true;
+}
+
+std::size_t RefreshingCache::prefetchDue(std::int64_t nowMillis) {
+    std::vector<std::string> keys;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (auto &pair : _entries) {
+            Entry &entry = pair.second;
+            if (freshness(entry, nowMillis) != CacheFreshness::Expired && needsBackgroundRefresh(entry, nowMillis)) {
+                entry.inFlight = true;
+                ++_fetches;
+                keys.push_back(pair.first);
+            }
+        }
+    }
+    for (const std::string &key : keys) {
+        _fetch(key);
+    }
+    return keys.size();
+}
+
+std::int64_t RefreshingCache::nextPrefetchMillis(std::int64_t nowMillis) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::int64_t next = std::numeric_limits<std::int64_t>::max();
+    for (const auto &pair : _entries) {
+        const Entry &entry = pair.second;
+        if (!entry.hasValue || entry.inFlight || freshness(entry, nowMillis) == CacheFreshness::Expired) {
+            continue;
+        }
+        std::int64_t due = entry.fetchedAtMillis + _config.ttlMillis - _config.prefetchLeadMillis;
+        if (entry.hasFailed) {
+            due = std::max(due, entry.failedAtMillis + _config.retryMillis);
+        }
+        next = std::min(next, due);
+    }
+    return next;
+}
+
+void RefreshingCache::complete(const std::string &key, ErrorCode error, const std::string &value, std::int64_t nowMillis) {
+    std::vector<ValueFunction> waiters;
+    std::string delivered;
+    CacheFreshness state = CacheFreshness::Missing;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        const auto it = _entries.find(key);
+        if (it == _entries.end() || !it->second.inFlight) {
+            return;
+        }
+        Entry &entry = it->second;
+        entry.inFlight = false;
+        waiters.swap(entry.waiters);
+
+        if (error == ErrorCode::None) {
+            entry.value = value;
+            entry.fetchedAtMillis = nowMillis;
+            entry.hasValue = true;
+            entry.hasFailed = false;
+            delivered = value;
+            state = CacheFreshness::Fresh;
+        } else {
+            entry.failedAtMillis = nowMillis;
+            entry.hasFailed = true;
+            // Waiters only queue for missing or expired keys, so there is nothing to fall back to.
+            state = freshness(entry, nowMillis);
+        }
+    }
+
+    for (ValueFunction &waiter : waiters) {
+        if (waiter) {
+            waiter(error, delivered, state);
+        }
+    }
+}
+
+void RefreshingCache::put(const std::string &key, const std::string &value, std::int64_t nowMillis) {
+    std::lock_guard<std::mutex> guard(_lock);
+    Entry &entry = _entries[key];
+    entry.value = value;
+    entry.fetchedAtMillis = nowMillis;
+    entry.hasValue = true;
+    entry.hasFailed = false;
+}
+
+void RefreshingCache::invalidate(const std::string &key) {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        return;
+    }
+    if (it->second.inFlight) {
+        it->second.hasValue = false;
+        it->second.value.clear();
+    } else {
+        _entries.erase(it);
+    }
+}
+
+ErrorCode RefreshingCache::save(const std::string &path) const {
+    std::vector<std::uint8_t> snapshot;
+    appendBytes(snapshot, kSnapshotMagic, sizeof(kSnapshotMagic));
+    appendLittleEndian<std::uint32_t>(snapshot, kSnapshotVersion);
+    appendLittleEndian<std::uint32_t>(snapshot, 0);
+
+    std::uint32_t count = 0;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (const auto &pair : _entries) {
+            const Entry &entry = pair.second;
+            if (!entry.hasValue) {
+                continue;
+            }
+            appendLittleEndian<std::uint32_t>(snapshot, static_cast<std::uint32_t>(pair.first.size()));
+            appendLittleEndian<std::uint32_t>(snapshot, static_cast<std::uint32_t>(entry.value.size()));
+            appendLittleEndian<std::int64_t>(snapshot, entry.fetchedAtMillis);
+            appendBytes(snapshot, pair.first.data(), pair.first.size());
+            appendBytes(snapshot, entry.value.data(), entry.value.size());
+            ++count;
+        }
+    }
+    storeLittleEndian<std::uint32_t>(snapshot.data() + sizeof(kSnapshotMagic) + 4, count);
+    appendLittleEndian<std::uint32_t>(snapshot, crc32(snapshot.data(), snapshot.size()));
+    return File::replace(path, snapshot.data(), snapshot.size());
+}
+
+ErrorCode RefreshingCache::load(const std::string &path) {
+    File file;
+    ErrorCode error = File::openForRead(path, file);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::vector<std::uint8_t> snapshot;
+    if ((error = file.readAll(snapshot)) != ErrorCode::None) {
+        return error;
+    }
+
+    if (snapshot.size() < kSnapshotHeaderSize + 4 ||
+        std::memcmp(snapshot.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        loadLittleEndian<std::uint32_t>(snapshot.data() + sizeof(kSnapshotMagic)) != kSnapshotVersion) {
+        return ErrorCode::InvalidArgument;
+    }
+    const std::size_t bodyEnd = snapshot.size() - 4;
+    if (loadLittleEndian<std::uint32_t>(snapshot.data() + bodyEnd) != crc32(snapshot.data(), bodyEnd)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    // Parse everything before touching the cache so a malformed snapshot changes nothing.
+    struct Loaded {
+        std::string key;
+        std::string value;
+        std::int64_t fetchedAtMillis;
+    };
+    std::vector<Loaded> loaded;
+    const std::uint32_t count = loadLittleEndian<std::uint32_t>(snapshot.data() + sizeof(kSnapshotMagic) + 4);
+    std::size_t offset = kSnapshotHeaderSize;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (bodyEnd - offset < kSnapshotEntryHeaderSize) {
+            return ErrorCode::InvalidArgument;
+        }
+        const std::size_t keyLength = loadLittleEndian<std::uint32_t>(snapshot.data() + offset);
+        const std::size_t valueLength = loadLittleEndian<std::uint32_t>(snapshot.data() + offset + 4);
+        const std::int64_t fetchedAtMillis = loadLittleEndian<std::int64_t>(snapshot.data() + offset + 8);
+        offset += kSnapshotEntryHeaderSize;
+        if (bodyEnd - offset < keyLength || bodyEnd - offset - keyLength < valueLength) {
+            return ErrorCode::InvalidArgument;
+        }
+        const char *bytes = reinterpret_cast<const char *>(snapshot.data() + offset);
+        loaded.push_back({std::string(bytes, keyLength), std::string(bytes + keyLength, valueLength), fetchedAtMillis});
+        offset += keyLength + valueLength;
+    }
+    if (offset != bodyEnd) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    for (Loaded &item : loaded) {
+        Entry &entry = _entries[item.key];
+        if (entry.hasValue && entry.fetchedAtMillis >= item.fetchedAtMillis) {
+            continue;
+        }
+        entry.value = std::move(item.value);
+        entry.fetchedAtMillis = item.fetchedAtMillis;
+        entry.hasValue = true;
+    }
+    return ErrorCode::None;
+}
+
+std::size_t RefreshingCache::size() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::size_t count = 0;
+    for (const auto &pair : _entries) {
+        count += pair.second.hasValue;
+    }
+    return count;
+}
+
+std::uint64_t RefreshingCache::fetchCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _fetches;
+}
+
+std::uint64_t RefreshingCache::coalescedCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _coalesced;
+}
+
+std::uint64_t RefreshingCache::freshHitCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _freshHits;
+}
+
+std::uint64_t RefreshingCache::staleHitCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _staleHits;
+}
+
+} // namespace cft
@@ -0,0 +1,146 @@
+//
+//  SettlementLedger.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/SettlementLedger.hpp"
+
+namespace cft {
+
+namespace {
+
+// Values the SDK does not know yet are counted as Unknown rather than dropped.
+std::size_t bucketIndex(std::uint8_t value, std::size_t count) {
+    return value < count ? value : 0;
+}
+
+void addToBucket(SettlementBucket &bucket, std::int64_t amountMinor, std::int64_t tipMinor, bool refund, int sign) {
+    if (refund) {
+        bucket.refundsMinor += sign * (amountMinor + tipMinor);
+        bucket.refundCount += sign;
+    } else {
+        bucket.salesMinor += sign * amountMinor;
+        bucket.tipsMinor += sign * tipMinor;
+        bucket.saleCount += sign;
+    }
+}
+
+} // namespace
+
+bool SettlementBucket::operator==(const SettlementBucket &other) const {
+    return salesMinor == other.salesMinor && refundsMinor == other.refundsMinor && tipsMinor == other.tipsMinor &&
+           saleCount == other.saleCount && refundCount == other.refundCount;
+}
+
+bool SettlementTotals::operator==(const SettlementTotals &other) const {
+    return batchNumber == other.batchNumber && total == other.total && byCardBrand == other.byCardBrand &&
+           byNetworkType == other.byNetworkType && byCardInputMethod == other.byCardInputMethod;
+}
+
+SettlementLedger::SettlementLedger(SettlementScheme scheme, std::uint64_t batchNumber) : _scheme(scheme) {
+    _totals.batchNumber = batchNumber;
+}
+
+bool SettlementLedger::isOpen(const StoredTransactionRecord &record) {
+    const ApiTransactionState state = record.state();
+    if (state != ApiTransactionState::Approved && state != ApiTransactionState::PendingVoid) {
+        return false;
+    }
+    const auto type = static_cast<TransactionType>(record.transactionType);
+    return type == TransactionType::Sale || type == TransactionType::Authorization || type == TransactionType::Refund;
+}
+
+ErrorCode SettlementLedger::apply(const StoredTransactionRecord &record) {
+    const std::string transactionId = StoredTransactionRecord::text(record.transactionId);
+    const auto existing = _open.find(transactionId);
+
+    if (!isOpen(record)) {
+        if (existing != _open.end()) {
+            add(_totals, existing->second, -1);
+            _open.erase(existing);
+        }
+        return ErrorCode::None;
+    }
+
+    if (record.amountMinor < 0 || record.tipMinor < 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    Contribution contribution;
+    contribution.amountMinor = record.amountMinor;
+    contribution.tipMinor = record.tipMinor;
+    contribution.refund = static_cast<TransactionType>(record.transactionType) == TransactionType::Refund;
+    contribution.pendingVoid = record.state() == ApiTransactionState::PendingVoid;
+    contribution.cardBrand = record.cardBrand;
+    contribution.networkType = record.networkType;
+    contribution.cardInputMethod = record.cardInputMethod;
+
+    // Every bucket is a subset of the batch total and all amounts are non-negative, so checking
+    // the total covers them all.
+    SettlementBucket total = _totals.total;
+    if (existing != _open.end()) {
+        addToBucket(total, existing->second.amountMinor, existing->second.tipMinor, existing->second.refund, -1);
+    }
+    std::int64_t refundMinor;
+    std::int64_t grossMinor;
+    if (__builtin_add_overflow(contribution.amountMinor, contribution.tipMinor, &refundMinor) ||
+        __builtin_add_overflow(total.salesMinor, contribution.amountMinor, &total.salesMinor) ||
+        __builtin_add_overflow(total.tipsMinor, contribution.tipMinor, &total.tipsMinor) ||
+        __builtin_add_overflow(total.refundsMinor, refundMinor, &total.refundsMinor) ||
+        __builtin_add_overflow(total.salesMinor, total.tipsMinor, &grossMinor)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    if (existing != _open.end()) {
+        add(_totals, existing->second, -1);
+        existing->second = contribution;
+    } else {
+        _open.emplace(transactionId, contribution);
+    }
+    add(_totals, contribution, 1);
+    return ErrorCode::None;
+}
+
+void SettlementLedger::remove(const std::string &transactionId) {
+    const auto existing = _open.find(transactionId);
+    if (existing != _open.end()) {
+        add(_totals, existing->second, -1);
+        _open.erase(existing);
+    }
+}
+
+ErrorCode SettlementLedger::closeBatch(SettlementTotals &closed, std::vector<std::string> &transactionIds) {
+    if (_scheme != SettlementScheme::BroadPosManual) {
+        return ErrorCode::IllegalTransition;
+    }
+    closed = _totals;
+    SettlementTotals next;
+    next.batchNumber = _totals.batchNumber + 1;
+    transactionIds.clear();
+    transactionIds.reserve(_open.size());
+    for (auto entry = _open.begin(); entry != _open.end();) {
+        if (entry->second.pendingVoid) {
+            add(closed, entry->second, -1);
+            add(next, entry->second, 1);
+            ++entry;
+        } else {
+            transactionIds.push_back(entry->first);
+            entry = _open.erase(entry);
+        }
+    }
+    _totals = next;
+    return ErrorCode::None;
+}
+
+void SettlementLedger::add(SettlementTotals &totals, const Contribution &contribution, int sign) {
+    const std::int64_t amount = contribution.amountMinor;
+    const std::int64_t tip = contribution.tipMinor;
+    addToBucket(totals.total, amount, tip, contribution.refund, sign);
+    addToBucket(totals.byCardBrand[bucketIndex(contribution.cardBrand, kCardBrandCount)], amount, tip, contribution.refund, sign);
+    addToBucket(totals.byNetworkType[bucketIndex(contribution.networkType, kNetworkTypeCount)], amount, tip, contribution.refund, sign);
+    addToBucket(totals.byCardInputMethod[bucketIndex(contribution.cardInputMethod, kCardInputMethodCount)], amount, tip,
+                contribution.refund, sign);
+}
+
+} // namespace cft
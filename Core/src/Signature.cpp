@@ -0,0 +1,232 @@
+//
+//  Signature.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/Signature.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::uint8_t kMagic[4] = {'C', 'F', 'S', 'G'};
+
+// Each point takes at least one byte for each of its three deltas.
+constexpr std::size_t kMinEncodedPointSize = 3;
+
+void appendVarint(std::vector<std::uint8_t> &out, std::uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+bool readVarint(const std::uint8_t *&cursor, const std::uint8_t *end, std::uint32_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 35 && cursor < end; shift += 7) {
+        const std::uint8_t byte = *cursor++;
+        value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return shift < 28 || byte < 0x10;
+        }
+    }
+    return false;
+}
+
+std::uint32_t zigzag(std::int32_t value) {
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+std::int32_t unzigzag(std::uint32_t value) {
+    return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+}
+
+// Darkens the pixels within radius of segment a-b, with a one pixel soft edge.
+void drawSegment(double ax, double ay, double bx, double by, double radius, std::uint32_t width, std::uint32_t height,
+                 std::vector<std::uint8_t> &pixels) {
+    const double reach = radius + 0.5;
+    const long left = std::max(0L, static_cast<long>(std::floor(std::min(ax, bx) - reach)));
+    const long top = std::max(0L, static_cast<long>(std::floor(std::min(ay, by) - reach)));
+    const long right = std::min(static_cast<long>(width) - 1, static_cast<long>(std::ceil(std::max(ax, bx) + reach)));
+    const long bottom = std::min(static_cast<long>(height) - 1, static_cast<long>(std::ceil(std::max(ay, by) + reach)));
+    const double dx = bx - ax;
+    const double dy = by - ay;
+    const double lengthSquared = dx * dx + dy * dy;
+
+    for (long y = top; y <= bottom; ++y) {
+        std::uint8_t *row = pixels.data() + static_cast<std::size_t>(y) * width;
+        for (long x = left; x <= right; ++x) {
+            const double px = x + 0.5 - ax;
+            const double py = y + 0.5 - ay;
+            const double t = lengthSquared > 0 ? std::min(1.0, std::max(0.0, (px * dx + py * dy) / lengthSquared)) : 0.0;
+            const double ex = px - t * dx;
+            const double ey = py - t * dy;
+            const double coverage = reach - std::sqrt(ex * ex + ey * ey);
+            if (coverage <= 0) {
+                continue;
+            }
+            const auto shade = static_cast<std::uint8_t>(std::lround(255.0 * (1.0 - std::min(1.0, coverage))));
+            row[x] = std::min(row[x], shade);
+        }
+    }
+}
+
+} // namespace
+
+void Signature::beginStroke() {
+    // A stroke that never got a point is reused rather than stored empty.
+    if (_strokeEnds.empty() || _strokeEnds.back() != currentStrokeStart()) {
+        _strokeEnds.push_back(_points.size());
+    }
+}
+
+std::size_t Signature::currentStrokeStart() const {
+    return _strokeEnds.size() > 1 ? _strokeEnds[_strokeEnds.size() - 2] : 0;
+}
+
+ErrorCode Signature::addPoint(const SignaturePoint &point) {
+    if (_strokeEnds.empty()) {
+        return ErrorCode::IllegalTransition;
+    }
+    if (point.x >= _width || point.y >= _height || (!_points.empty() && point.millis < _points.back().millis)) {
+        return ErrorCode::InvalidArgument;
+    }
+    if (_points.size() > currentStrokeStart() && _points.back().x == point.x && _points.back().y == point.y) {
+        return ErrorCode::None;
+    }
+    _points.push_back(point);
+    _strokeEnds.back() = _points.size();
+    return ErrorCode::None;
+}
+
+const SignaturePoint *Signature::strokePoints(std::size_t index, std::size_t &count) const {
+    const std::size_t start = index > 0 ? _strokeEnds[index - 1] : 0;
+    count = _strokeEnds[index] - start;
+    return _points.data() + start;
+}
+
+void Signature::encode(std::vector<std::uint8_t> &out) const {
+    out.clear();
+    out.reserve(kSignatureHeaderSize + 2 + _strokeEnds.size() * 2 + _points.size() * kMinEncodedPointSize);
+    appendBytes(out, kMagic, sizeof(kMagic));
+    out.push_back(kSignatureVersion);
+    out.push_back(0);
+    appendLittleEndian(out, _width);
+    appendLittleEndian(out, _height);
+    appendLittleEndian(out, std::uint16_t{0});
+    appendLittleEndian(out, std::uint32_t{0});
+
+    std::size_t strokes = 0;
+    for (std::size_t i = 0; i < _strokeEnds.size(); ++i) {
+        std::size_t count = 0;
+        strokePoints(i, count);
+        strokes += count > 0 ? 1 : 0;
+    }
+    appendVarint(out, static_cast<std::uint32_t>(strokes));
+
+    SignaturePoint previous;
+    for (std::size_t i = 0; i < _strokeEnds.size(); ++i) {
+        std::size_t count = 0;
+        const SignaturePoint *points = strokePoints(i, count);
+        if (count == 0) {
+            continue;
+        }
+        appendVarint(out, static_cast<std::uint32_t>(count));
+        for (std::size_t j = 0; j < count; ++j) {
+            appendVarint(out, zigzag(static_cast<std::int32_t>(points[j].x) - previous.x));
+            appendVarint(out, zigzag(static_cast<std::int32_t>(points[j].y) - previous.y));
+            appendVarint(out, points[j].millis - previous.millis);
+            previous = points[j];
+        }
+    }
+    storeLittleEndian(out.data() + 12, crc32(out.data() + kSignatureHeaderSize, out.size() - kSignatureHeaderSize));
+}
+
+ErrorCode Signature::decode(const std::uint8_t *data, std::size_t size, Signature &signature) {
+    if (size < kSignatureHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || data[4] != kSignatureVersion ||
+        loadLittleEndian<std::uint32_t>(data + 12) != crc32(data + kSignatureHeaderSize, size - kSignatureHeaderSize)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    Signature decoded(loadLittleEndian<std::uint16_t>(data + 6), loadLittleEndian<std::uint16_t>(data + 8));
+    const std::uint8_t *cursor = data + kSignatureHeaderSize;
+    const std::uint8_t *end = data + size;
+    std::uint32_t strokes = 0;
+    if (!readVarint(cursor, end, strokes) || strokes > static_cast<std::size_t>(end - cursor)) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    std::int64_t millis = 0;
+    for (std::uint32_t stroke = 0; stroke < strokes; ++stroke) {
+        std::uint32_t count = 0;
+        if (!readVarint(cursor, end, count) || count == 0 ||
+            count > static_cast<std::size_t>(end - cursor) / kMinEncodedPointSize) {
+            return ErrorCode::InvalidArgument;
+        }
+        decoded.beginStroke();
+        decoded._points.reserve(decoded._points.size() + count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t dx = 0;
+            std::uint32_t dy = 0;
+            std::uint32_t dMillis = 0;
+            if (!readVarint(cursor, end, dx) || !readVarint(cursor, end, dy) || !readVarint(cursor, end, dMillis)) {
+                return ErrorCode::InvalidArgument;
+            }
+            x += unzigzag(dx);
+            y += unzigzag(dy);
+            millis += dMillis;
+            if (x < 0 || y < 0 || millis > UINT32_MAX || x > UINT16_MAX || y > UINT16_MAX) {
+                return ErrorCode::InvalidArgument;
+            }
+            const SignaturePoint point{static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y),
+                                       static_cast<std::uint32_t>(millis)};
+            if (decoded.addPoint(point) != ErrorCode::None) {
+                return ErrorCode::InvalidArgument;
+            }
+        }
+    }
+    if (cursor != end) {
+        return ErrorCode::InvalidArgument;
+    }
+    signature = std::move(decoded);
+    return ErrorCode::None;
+}
+
+void Signature::render(std::uint32_t width, std::uint32_t height, double penWidth, std::vector<std::uint8_t> &pixels) const {
+    pixels.assign(static_cast<std::size_t>(width) * height, 255);
+    if (_width == 0 || _height == 0 || width == 0 || height == 0) {
+        return;
+    }
+    const double scaleX = static_cast<double>(width) / _width;
+    const double scaleY = static_cast<double>(height) / _height;
+    const double radius = std::max(0.5, penWidth / 2);
+    for (std::size_t i = 0; i < _strokeEnds.size(); ++i) {
+        std::size_t count = 0;
+        const SignaturePoint *points = strokePoints(i, count);
+        for (std::size_t j = 0; j < count; ++j) {
+            // A single tap still leaves a dot.
+            const SignaturePoint &from = points[j > 0 ? j - 1 : 0];
+            drawSegment((from.x + 0.5) * scaleX, (from.y + 0.5) * scaleY, (points[j].x + 0.5) * scaleX,
+                        (points[j].y + 0.5) * scaleY, radius, width, height, pixels);
+        }
+    }
+}
+
+bool Signature::operator==(const Signature &other) const {
+    return _width == other._width && _height == other._height && _points == other._points &&
+           _strokeEnds == other._strokeEnds;
+}
+
+} // namespace cft
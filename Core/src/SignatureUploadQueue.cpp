@@ -0,0 +1,267 @@
+//
+//  SignatureUploadQueue.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/SignatureUploadQueue.hpp"
+
+#include <cstring>
+
+#include "cft/Bytes.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::size_t kPayloadPrefixSize = 2;
+constexpr std::size_t kMaxTransactionIdLength = 255;
+
+bool parsePayload(const std::vector<std::uint8_t> &payload, SignatureUpload &upload) {
+    if (payload.size() < kPayloadPrefixSize || payload.size() < kPayloadPrefixSize + payload[1]) {
+        return false;
+    }
+    const auto format = static_cast<SignatureFormat>(payload[0]);
+    if (format != SignatureFormat::Strokes && format != SignatureFormat::Png) {
+        return false;
+    }
+    const std::size_t idLength = payload[1];
+    upload.format = format;
+    upload.transactionId.assign(reinterpret_cast<const char *>(payload.data() + kPayloadPrefixSize), idLength);
+    upload.data.assign(payload.begin() + static_cast<std::ptrdiff_t>(kPayloadPrefixSize + idLength), payload.end());
+    return !upload.transactionId.empty();
+}
+
+bool entryInfo(const DeferredQueue &queue, std::uint64_t entryId, DeferredEntryInfo &info) {
+    for (const DeferredEntryInfo &entry : queue.entries()) {
+        if (entry.entryId == entryId) {
+            info = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+ErrorCode SignatureUploadQueue::open(const std::string &path, const DeferredQueueConfig &config,
+                                     std::unique_ptr<SignatureUploadQueue> &queue) {
+    std::unique_ptr<DeferredQueue> journal;
+    ErrorCode code = DeferredQueue::open(path, config, journal);
+    if (code != ErrorCode::None) {
+        return code;
+    }
+    std::unique_ptr<SignatureUploadQueue> opened(new SignatureUploadQueue(std::move(journal)));
+    code = opened->load();
+    if (code == ErrorCode::None) {
+        queue = std::move(opened);
+    }
+    return code;
+}
+
+ErrorCode SignatureUploadQueue::load() {
+    // Entries come back in id order, so a later signature for the same transaction replaces an earlier one.
+    std::vector<std::uint64_t> dropped;
+    std::vector<std::uint64_t> interrupted;
+    for (const DeferredEntryInfo &info : _queue->entries()) {
+        if (info.status == DeferredEntryStatus::Interrupted) {
+            interrupted.push_back(info.entryId);
+        }
+        std::vector<std::uint8_t> payload;
+        SignatureUpload upload;
+        if (_queue->payload(info.entryId, payload) != ErrorCode::None || !parsePayload(payload, upload)) {
+            dropped.push_back(info.entryId);
+            continue;
+        }
+        auto existing = _byTransaction.find(upload.transactionId);
+        if (existing != _byTransaction.end()) {
+            dropped.push_back(existing->second);
+            _transactionByEntry.erase(existing->second);
+        }
+        _byTransaction[upload.transactionId] = info.entryId;
+        _transactionByEntry[info.entryId] = upload.transactionId;
+    }
+    for (std::uint64_t entryId : dropped) {
+        const ErrorCode code = _queue->remove(entryId);
+        if (code != ErrorCode::None) {
+            return code;
+        }
+    }
+    // An upload cut off by the restart is simply sent again; the server keeps the latest signature.
+    for (std::uint64_t entryId : interrupted) {
+        if (_transactionByEntry.count(entryId) == 0) {
+            continue;
+        }
+        const ErrorCode code = _queue->release(entryId);
+        if (code != ErrorCode::None) {
+            return code;
+        }
+    }
+    return ErrorCode::None;
+}
+
+bool SignatureUploadQueue::isSuperseded(const std::string &transactionId, std::uint64_t entryId) const {
+    auto latest = _byTransaction.find(transactionId);
+    return latest == _byTransaction.end() || latest->second != entryId;
+}
+
+// Latest entries of transactions whose replaced entry is still in the journal. Replaced entries
+// are removed unless they were in flight, so those are uploads that have not finished yet.
+std::set<std::uint64_t> SignatureUploadQueue::heldEntries() const {
+    std::set<std::uint64_t> held;
+    for (const auto &entry : _transactionByEntry) {
+        auto latest = _byTransaction.find(entry.second);
+        if (latest != _byTransaction.end() && latest->second != entry.first) {
+            held.insert(latest->second);
+        }
+    }
+    return held;
+}
+
+ErrorCode SignatureUploadQueue::enqueue(const std::string &transactionId, SignatureFormat format,
+                                        const std::uint8_t *data, std::size_t size, std::int64_t nowMillis,
+                                        std::uint64_t &entryId) {
+    if (transactionId.empty() || transactionId.size() > kMaxTransactionIdLength) {
+        return ErrorCode::InvalidArgument;
+    }
+    std::vector<std::uint8_t> payload;
+    payload.reserve(kPayloadPrefixSize + transactionId.size() + size);
+    payload.push_back(static_cast<std::uint8_t>(format));
+    payload.push_back(static_cast<std::uint8_t>(transactionId.size()));
+    appendBytes(payload, transactionId.data(), transactionId.size());
+    appendBytes(payload, data, size);
+
+    std::lock_guard<std::mutex> guard(_lock);
+    auto existing = _byTransaction.find(transactionId);
+    DeferredEntryInfo previous;
+    const bool replacing = existing != _byTransaction.end() && entryInfo(*_queue, existing->second, previous);
+    if (replacing && previous.status != DeferredEntryStatus::DeadLettered) {
+        std::vector<std::uint8_t> queued;
+        if (_queue->payload(previous.entryId, queued) == ErrorCode::None && queued == payload) {
+            entryId = previous.entryId;
+            return ErrorCode::None;
+        }
+    }
+
+    // The new signature is durable before the old one goes, so a crash in between loses neither.
+    std::uint64_t added = 0;
+    const ErrorCode code = _queue->enqueue(payload.data(), payload.size(), nowMillis, added);
+    if (code != ErrorCode::None) {
+        return code;
+    }
+    if (replacing && previous.status != DeferredEntryStatus::InFlight) {
+        _queue->remove(previous.entryId);
+        _transactionByEntry.erase(previous.entryId);
+    }
+    _byTransaction[transactionId] = added;
+    _transactionByEntry[added] = transactionId;
+    entryId = added;
+    return ErrorCode::None;
+}
+
+std::vector<SignatureUpload> SignatureUploadQueue::claimReady(std::int64_t nowMillis, std::size_t limit) {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<SignatureUpload> uploads;
+    for (std::uint64_t entryId : _queue->claimReady(nowMillis, limit, heldEntries())) {
+        std::vector<std::uint8_t> payload;
+        SignatureUpload upload;
+        if (_queue->payload(entryId, payload) != ErrorCode::None || !parsePayload(payload, upload)) {
+            bool willRetry = false;
+            _queue->fail(entryId, false, nowMillis, willRetry);
+            continue;
+        }
+        upload.entryId = entryId;
+        uploads.push_back(std::move(upload));
+    }
+    return uploads;
+}
+
+ErrorCode SignatureUploadQueue::complete(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    const ErrorCode code = _queue->complete(entryId);
+    if (code != ErrorCode::None) {
+        return code;
+    }
+    auto transaction = _transactionByEntry.find(entryId);
+    if (transaction != _transactionByEntry.end()) {
+        auto latest = _byTransaction.find(transaction->second);
+        if (latest != _byTransaction.end() && latest->second == entryId) {
+            _byTransaction.erase(latest);
+        }
+        _transactionByEntry.erase(transaction);
+    }
+    return ErrorCode::None;
+}
+
+ErrorCode SignatureUploadQueue::fail(std::uint64_t entryId, bool retryable, std::int64_t nowMillis, bool &willRetry) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto transaction = _transactionByEntry.find(entryId);
+    if (transaction != _transactionByEntry.end() && isSuperseded(transaction->second, entryId)) {
+        // A newer signature is queued for the transaction; retrying this one would only be overwritten.
+        willRetry = false;
+        _transactionByEntry.erase(transaction);
+        return _queue->remove(entryId);
+    }
+    return _queue->fail(entryId, retryable, nowMillis, willRetry);
+}
+
+ErrorCode SignatureUploadQueue::release(std::uint64_t entryId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto transaction = _transactionByEntry.find(entryId);
+    if (transaction != _transactionByEntry.end() && isSuperseded(transaction->second, entryId)) {
+        _transactionByEntry.erase(transaction);
+        return _queue->remove(entryId);
+    }
+    return _queue->release(entryId);
+}
+
+std::size_t SignatureUploadQueue::expedite(std::int64_t nowMillis) {
+    return _queue->expedite(nowMillis);
+}
+
+ErrorCode SignatureUploadQueue::remove(const std::string &transactionId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto latest = _byTransaction.find(transactionId);
+    if (latest == _byTransaction.end()) {
+        return ErrorCode::NotFound;
+    }
+    const ErrorCode code = _queue->remove(latest->second);
+    _transactionByEntry.erase(latest->second);
+    _byTransaction.erase(latest);
+    return code;
+}
+
+bool SignatureUploadQueue::find(const std::string &transactionId, DeferredEntryInfo &info) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto latest = _byTransaction.find(transactionId);
+    return latest != _byTransaction.end() && entryInfo(*_queue, latest->second, info);
+}
+
+std::vector<std::string> SignatureUploadQueue::deadLetteredTransactionIds() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<std::string> transactionIds;
+    for (const DeferredEntryInfo &info : _queue->entries()) {
+        auto transaction = _transactionByEntry.find(info.entryId);
+        if (info.status == DeferredEntryStatus::DeadLettered && transaction != _transactionByEntry.end()) {
+            transactionIds.push_back(transaction->second);
+        }
+    }
+    return transactionIds;
+}
+
+std::size_t SignatureUploadQueue::count() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _byTransaction.size();
+}
+
+std::size_t SignatureUploadQueue::pendingCount() const {
+    return _queue->pendingCount();
+}
+
+std::int64_t SignatureUploadQueue::nextAttemptAtMillis() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _queue->nextAttemptAtMillis(heldEntries());
+}
+
+} // namespace cft
@@ -0,0 +1,37 @@
+//
+//  StateLatencyRecorder.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/StateLatencyRecorder.hpp"
+
+namespace cft {
+
+void StateLatencyRecorder::stateMachineDidTransition(const TransactionStateMachine &,
+                                                     TransactionState from,
+                                                     TransactionState to,
+                                                     Nanos timeInPrevious) {
+    // Time spent before Begin is object construction, not a transaction state.
+    if (from != TransactionState::Unknown) {
+        _states[static_cast<std::size_t>(from)].record(timeInPrevious);
+    }
+    ++_entries[static_cast<std::size_t>(to)];
+}
+
+void StateLatencyRecorder::merge(const StateLatencyRecorder &other) {
+    for (std::size_t i = 0; i < kTransactionStateCount; ++i) {
+        _states[i].merge(other._states[i]);
+        _entries[i] += other._entries[i];
+    }
+}
+
+void StateLatencyRecorder::clear() {
+    for (auto &histogram : _states) {
+        histogram.clear();
+    }
+    _entries.fill(0);
+}
+
+} // namespace cft
@@ -0,0 +1,76 @@
+//
+//  TipAdjustmentBatch.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/TipAdjustmentBatch.hpp"
+
+#include <utility>
+
+namespace cft {
+
+TipAdjustmentBatch::TipAdjustmentBatch(TransactionRecordStore &store, std::vector<TipAdjustment> adjustments)
+    : _store(store) {
+    _items.resize(adjustments.size());
+    for (std::size_t i = 0; i < adjustments.size(); ++i) {
+        _items[i].adjustment = std::move(adjustments[i]);
+    }
+}
+
+bool TipAdjustmentBatch::isAdjustable(const StoredTransactionRecord &record) {
+    const auto type = static_cast<TransactionType>(record.transactionType);
+    return record.state() == ApiTransactionState::Approved &&
+           (type == TransactionType::Sale || type == TransactionType::Authorization);
+}
+
+std::size_t TipAdjustmentBatch::applyOptimistically(std::int64_t updatedAtMillis) {
+    std::size_t applied = 0;
+    for (Item &item : _items) {
+        if (item.state != TipAdjustmentState::Pending) {
+            continue;
+        }
+        StoredTransactionRecord record;
+        if (item.adjustment.tipMinor < 0) {
+            item.error = ErrorCode::InvalidArgument;
+        } else if (!_store.get(item.adjustment.transactionId, record)) {
+            item.error = ErrorCode::NotFound;
+        } else if (!isAdjustable(record)) {
+            item.error = ErrorCode::IllegalTransition;
+        } else {
+            item.previousTipMinor = record.tipMinor;
+            item.error = _store.compareAndSetTip(item.adjustment.transactionId, record.tipMinor, item.adjustment.tipMinor,
+                                                 updatedAtMillis);
+        }
+        if (item.error != ErrorCode::None) {
+            item.state = TipAdjustmentState::Rejected;
+            continue;
+        }
+        item.state = TipAdjustmentState::Applied;
+        ++_outstanding;
+        ++applied;
+    }
+    return applied;
+}
+
+ErrorCode TipAdjustmentBatch::complete(std::size_t index, ErrorCode outcome, std::int64_t updatedAtMillis) {
+    if (index >= _items.size() || _items[index].state != TipAdjustmentState::Applied) {
+        return ErrorCode::IllegalTransition;
+    }
+    Item &item = _items[index];
+    --_outstanding;
+    if (outcome == ErrorCode::None) {
+        item.state = TipAdjustmentState::Confirmed;
+        return ErrorCode::None;
+    }
+
+    item.state = TipAdjustmentState::Reverted;
+    item.error = outcome;
+    // IllegalTransition here means a newer tip was stored since; that one stands.
+    const ErrorCode restored = _store.compareAndSetTip(item.adjustment.transactionId, item.adjustment.tipMinor,
+                                                       item.previousTipMinor, updatedAtMillis);
+    return restored == ErrorCode::IllegalTransition ? ErrorCode::None : restored;
+}
+
+} // namespace cft
@@ -0,0 +1,236 @@
+//
+//  Tlv.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/Tlv.hpp"
+
+namespace cft {
+
+namespace {
+
+struct EmvTagInfo {
+    std::uint32_t number;
+    bool isText;
+};
+
+// Indexed by EmvTag.
+constexpr EmvTagInfo kEmvTags[kEmvTagCount] = {
+    {0x9F12, true},
+    {0x4F, false},
+    {0x50, true},
+    {0x9B, false},
+    {0x8A, true},
+    {0x9F26, false},
+    {0x9F36, false},
+    {0x5F34, false},
+    {0x9F0F, false},
+    {0x9F0E, false},
+    {0x9F0D, false},
+    {0x9F34, false},
+    {0x9F39, false},
+};
+
+int hexValue(char digit) {
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+constexpr unsigned TlvIterator::kMaxDepth;
+
+TlvIterator::TlvIterator(const std::uint8_t *data, std::size_t size, bool descend)
+    : _cursor(data), _descend(descend) {
+    _ends[0] = data + size;
+}
+
+bool TlvIterator::next(TlvElement &element) {
+    for (;;) {
+        while (_depth > 0 && _cursor >= _ends[_depth]) {
+            --_depth;
+        }
+        const std::uint8_t *end = _ends[_depth];
+        if (_cursor >= end) {
+            return false;
+        }
+        // EMV allows 00 and FF padding before, between and after elements.
+        if (*_cursor == 0x00 || *_cursor == 0xFF) {
+            ++_cursor;
+            continue;
+        }
+
+        const std::uint8_t *cursor = _cursor;
+        const std::uint8_t first = *cursor++;
+        std::uint32_t tag = first;
+        if ((first & 0x1F) == 0x1F) {
+            std::uint8_t byte = 0;
+            do {
+                if (cursor == end || tag > 0xFFFFFF) {
+                    break;
+                }
+                byte = *cursor++;
+                tag = (tag << 8) | byte;
+            } while ((byte & 0x80) != 0);
+            if ((byte & 0x80) != 0 || cursor == end) {
+                break;
+            }
+        }
+
+        if (cursor == end) {
+            break;
+        }
+        std::size_t length = *cursor++;
+        if ((length & 0x80) != 0) {
+            // Long form; the indefinite form (80) is not allowed in EMV.
+            const std::size_t count = length & 0x7F;
+            if (count == 0 || count > 4 || static_cast<std::size_t>(end - cursor) < count) {
+                break;
+            }
+            length = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                length = (length << 8) | *cursor++;
+            }
+        }
+        if (static_cast<std::size_t>(end - cursor) < length) {
+            break;
+        }
+
+        element.tag = tag;
+        element.value.data = cursor;
+        element.value.size = length;
+        element.constructed = (first & 0x20) != 0;
+        element.depth = _depth;
+        if (element.constructed && _descend && _depth < kMaxDepth) {
+            _ends[++_depth] = cursor + length;
+            _cursor = cursor;
+        } else {
+            _cursor = cursor + length;
+        }
+        return true;
+    }
+
+    _error = ErrorCode::InvalidArgument;
+    _depth = 0;
+    _cursor = _ends[0];
+    return false;
+}
+
+ErrorCode findTlv(const std::uint8_t *data, std::size_t size, std::uint32_t tag, TlvElement &element) {
+    TlvIterator iterator(data, size);
+    TlvElement candidate;
+    while (iterator.next(candidate)) {
+        if (candidate.tag == tag) {
+            element = candidate;
+            return ErrorCode::None;
+        }
+    }
+    return iterator.error() == ErrorCode::None ? ErrorCode::NotFound : iterator.error();
+}
+
+void appendTlv(std::vector<std::uint8_t> &buffer, std::uint32_t tag, const std::uint8_t *value, std::size_t size) {
+    bool started = false;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        const auto byte = static_cast<std::uint8_t>(tag >> shift);
+        if (started || byte != 0 || shift == 0) {
+            buffer.push_back(byte);
+            started = true;
+        }
+    }
+
+    if (size < 0x80) {
+        buffer.push_back(static_cast<std::uint8_t>(size));
+    } else {
+        std::size_t count = 1;
+        while (count < 4 && (size >> (8 * count)) != 0) {
+            ++count;
+        }
+        buffer.push_back(static_cast<std::uint8_t>(0x80 | count));
+        for (std::size_t i = count; i > 0; --i) {
+            buffer.push_back(static_cast<std::uint8_t>(size >> (8 * (i - 1))));
+        }
+    }
+    appendBytes(buffer, value, size);
+}
+
+void hexEncode(const std::uint8_t *data, std::size_t size, char *out) {
+    static const char kDigits[] = "0123456789ABCDEF";
+    for (std::size_t i = 0; i < size; ++i) {
+        out[2 * i] = kDigits[data[i] >> 4];
+        out[2 * i + 1] = kDigits[data[i] & 0x0F];
+    }
+}
+
+ErrorCode hexDecode(const char *text, std::size_t length, std::vector<std::uint8_t> &out) {
+    if (length % 2 != 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    out.clear();
+    out.reserve(length / 2);
+    for (std::size_t i = 0; i < length; i += 2) {
+        const int high = hexValue(text[i]);
+        const int low = hexValue(text[i + 1]);
+        if (high < 0 || low < 0) {
+            return ErrorCode::InvalidArgument;
+        }
+        out.push_back(static_cast<std::uint8_t>((high << 4) | low));
+    }
+    return ErrorCode::None;
+}
+
+std::uint32_t emvTagNumber(EmvTag tag) {
+    return kEmvTags[static_cast<std::size_t>(tag)].number;
+}
+
+bool emvTagIsText(EmvTag tag) {
+    return kEmvTags[static_cast<std::size_t>(tag)].isText;
+}
+
+bool EmvTags::find(EmvTag tag, ByteRange &value) {
+    if (!_resolved) {
+        resolve();
+    }
+    const auto index = static_cast<std::size_t>(tag);
+    if (index >= kEmvTagCount || !_present[index]) {
+        return false;
+    }
+    value = _values[index];
+    return true;
+}
+
+ErrorCode EmvTags::resolve() {
+    if (_resolved) {
+        return _error;
+    }
+    TlvIterator iterator(_data, _size);
+    TlvElement element;
+    std::size_t remaining = kEmvTagCount;
+    while (remaining > 0 && iterator.next(element)) {
+        if (element.constructed) {
+            continue;
+        }
+        for (std::size_t i = 0; i < kEmvTagCount; ++i) {
+            if (kEmvTags[i].number == element.tag && !_present[i]) {
+                _values[i] = element.value;
+                _present[i] = true;
+                --remaining;
+                break;
+            }
+        }
+    }
+    _error = iterator.error();
+    _resolved = true;
+    return _error;
+}
+
+} // namespace cft
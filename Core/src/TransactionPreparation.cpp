@@ -0,0 +1,88 @@
+//
+//  TransactionPreparation.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/TransactionPreparation.hpp"
+
+namespace cft {
+
+constexpr std::uint8_t TransactionPreparation::kAllSteps;
+
+TransactionPreparation::TransactionPreparation(std::uint8_t requiredSteps, Nanos timeToLive, ClockFunction clock)
+    : _clock(clock),
+      _required(static_cast<std::uint8_t>(requiredSteps & kAllSteps)),
+      _timeToLive(timeToLive),
+      _createdAt(clock()) {}
+
+ErrorCode TransactionPreparation::complete(PreparationStep step, ErrorCode error) {
+    const std::uint8_t bit = preparationStepBit(step);
+    if (static_cast<std::size_t>(step) >= kPreparationStepCount || (_finished & bit) != 0 ||
+        _state == PreparationState::Failed || _state == PreparationState::Canceled) {
+        return ErrorCode::IllegalTransition;
+    }
+
+    _finished |= bit;
+    if (error == ErrorCode::None) {
+        _warmed |= bit;
+    } else if ((_required & bit) != 0) {
+        _state = PreparationState::Failed;
+        _error = error;
+        return ErrorCode::None;
+    }
+
+    if (_finished == kAllSteps) {
+        _readyAt = _clock();
+        if (_state == PreparationState::Preparing) {
+            _state = PreparationState::Ready;
+        }
+    }
+    return ErrorCode::None;
+}
+
+ErrorCode TransactionPreparation::bind(std::int64_t amountMinor) {
+    if (amountMinor <= 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    const PreparationState current = state();
+    if (current != PreparationState::Preparing && current != PreparationState::Ready &&
+        current != PreparationState::Expired) {
+        return ErrorCode::IllegalTransition;
+    }
+    _amountMinor = amountMinor;
+    _state = PreparationState::Bound;
+    return ErrorCode::None;
+}
+
+void TransactionPreparation::cancel() {
+    if (_state != PreparationState::Failed) {
+        _state = PreparationState::Canceled;
+    }
+}
+
+PreparationState TransactionPreparation::state() const {
+    if (_state == PreparationState::Ready && _timeToLive > 0 && _clock() - _readyAt > _timeToLive) {
+        return PreparationState::Expired;
+    }
+    return _state;
+}
+
+bool TransactionPreparation::isReady() const {
+    return _finished == kAllSteps && _state != PreparationState::Failed && _state != PreparationState::Canceled;
+}
+
+const char *preparationStateName(PreparationState state) {
+    switch (state) {
+        case PreparationState::Preparing: return "preparing";
+        case PreparationState::Ready: return "ready";
+        case PreparationState::Bound: return "bound";
+        case PreparationState::Failed: return "failed";
+        case PreparationState::Expired: return "expired";
+        case PreparationState::Canceled: return "canceled";
+    }
+    return "unknown";
+}
+
+} // namespace cft
@@ -0,0 +1,478 @@
+//
+//  TransactionRecordStore.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/TransactionRecordStore.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cft/Bytes.hpp"
+#include "cft/Checksum.hpp"
+
+namespace cft {
+
+namespace {
+
+constexpr std::uint8_t kMagic[8] = {'C', 'F', 'T', 'R', 'E', 'C', 'S', '\0'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::size_t kHeaderSize = 64;
+constexpr std::size_t kSlotSize = sizeof(StoredTransactionRecord);
+constexpr std::uint32_t kInitialCapacity = 256;
+constexpr std::uint8_t kSlotOccupied = 1u << 0;
+// Settled by a batch closed on the device; the gateway has not reported it Settled yet.
+constexpr std::uint8_t kSettledLocally = 1u << 1;
+constexpr std::size_t kBatchNumberOffset = 32;
+
+std::uint32_t slotChecksum(const StoredTransactionRecord &record) {
+    const auto *bytes = reinterpret_cast<const std::uint8_t *>(&record);
+    return crc32(bytes + sizeof(record.checksum), kSlotSize - sizeof(record.checksum));
+}
+
+std::uint32_t lastFourKey(const StoredTransactionRecord &record) {
+    return loadLittleEndian<std::uint32_t>(reinterpret_cast<const std::uint8_t *>(record.lastFour));
+}
+
+std::uint32_t lastFourKey(const std::string &lastFour) {
+    StoredTransactionRecord record{};
+    StoredTransactionRecord::assign(record.lastFour, lastFour);
+    return lastFourKey(record);
+}
+
+// State to store for a report of state about current, and whether current stays settled locally.
+std::uint8_t reconciledState(const StoredTransactionRecord &current, std::uint8_t state, bool &settledLocally) {
+    settledLocally = (current.flags & kSettledLocally) != 0 &&
+                     state == static_cast<std::uint8_t>(ApiTransactionState::Approved);
+    return settledLocally ? current.apiTransactionState : state;
+}
+
+// Previous state to store when current is written with state. Writes that keep the state keep the
+// previous one too, so a later tip or result change does not hide an unread transition.
+std::uint8_t previousStateFor(const StoredTransactionRecord &current, std::uint8_t state) {
+    return state == current.apiTransactionState ? current.previousApiTransactionState : current.apiTransactionState;
+}
+
+template <typename Key>
+void eraseEntry(std::multimap<std::pair<Key, std::int64_t>, std::uint32_t> &index, const Key &key,
+                std::int64_t createdAt, std::uint32_t slotIndex) {
+    auto range = index.equal_range(std::make_pair(key, createdAt));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == slotIndex) {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+bool matches(const StoredTransactionRecord &record, const TransactionRecordQuery &query) {
+    if (record.createdAtMillis < query.createdFromMillis || record.createdAtMillis >= query.createdToMillis) {
+        return false;
+    }
+    if (query.matchState && record.state() != query.state) {
+        return false;
+    }
+    if (!query.lastFour.empty() && record.lastFourText() != query.lastFour) {
+        return false;
+    }
+    if (!query.referenceId.empty() && StoredTransactionRecord::text(record.referenceId) != query.referenceId) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string StoredTransactionRecord::lastFourText() const {
+    return text(lastFour);
+}
+
+TransactionRecordStore::TransactionRecordStore(const TransactionRecordStoreConfig &config) : _config(config) {}
+
+ErrorCode TransactionRecordStore::open(const std::string &path, const TransactionRecordStoreConfig &config,
+                                       std::unique_ptr<TransactionRecordStore> &store) {
+    if (config.maxRecords == 0) {
+        return ErrorCode::InvalidArgument;
+    }
+    std::unique_ptr<TransactionRecordStore> opened(new TransactionRecordStore(config));
+    const ErrorCode error = opened->load(path);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    store = std::move(opened);
+    return ErrorCode::None;
+}
+
+ErrorCode TransactionRecordStore::load(const std::string &path) {
+    ErrorCode error = File::openForUpdate(path, _file);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    std::uint64_t fileSize = 0;
+    if ((error = _file.size(fileSize)) != ErrorCode::None) {
+        return error;
+    }
+
+    if (fileSize == 0) {
+        std::uint8_t header[kHeaderSize] = {};
+        std::memcpy(header, kMagic, sizeof(kMagic));
+        storeLittleEndian(header + 8, kVersion);
+        storeLittleEndian(header + 12, static_cast<std::uint32_t>(kSlotSize));
+        storeLittleEndian(header + 16, kInitialCapacity);
+        fileSize = kHeaderSize + kInitialCapacity * kSlotSize;
+        if ((error = _file.append(header, sizeof(header))) != ErrorCode::None ||
+            (error = _file.truncate(fileSize)) != ErrorCode::None) {
+            return error;
+        }
+    }
+
+    if (fileSize < kHeaderSize) {
+        return ErrorCode::InvalidArgument;
+    }
+    if ((error = MappedRegion::map(_file, static_cast<std::size_t>(fileSize), _region)) != ErrorCode::None) {
+        return error;
+    }
+    const std::uint8_t *header = _region.data();
+    _capacity = loadLittleEndian<std::uint32_t>(header + 16);
+    if (std::memcmp(header, kMagic, sizeof(kMagic)) != 0 || loadLittleEndian<std::uint32_t>(header + 8) != kVersion ||
+        loadLittleEndian<std::uint32_t>(header + 12) != kSlotSize ||
+        kHeaderSize + static_cast<std::uint64_t>(_capacity) * kSlotSize > fileSize) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    // Walk backwards so the free list hands out low slots first.
+    for (std::uint32_t i = _capacity; i-- > 0;) {
+        StoredTransactionRecord *record = slot(i);
+        if ((record->flags & kSlotOccupied) == 0) {
+            _freeSlots.push_back(i);
+            continue;
+        }
+        const std::string transactionId = StoredTransactionRecord::text(record->transactionId);
+        if (record->checksum != slotChecksum(*record) || transactionId.empty()) {
+            std::memset(record, 0, kSlotSize);
+            _freeSlots.push_back(i);
+            continue;
+        }
+        // Of two slots for one transaction, the later write wins whichever slot it landed in.
+        const auto existing = _byTransactionId.find(transactionId);
+        if (existing != _byTransactionId.end()) {
+            StoredTransactionRecord *kept = slot(existing->second);
+            if (kept->changeSequence > record->changeSequence) {
+                std::memset(record, 0, kSlotSize);
+                _freeSlots.push_back(i);
+                continue;
+            }
+            unindex(existing->second, *kept);
+            std::memset(kept, 0, kSlotSize);
+            _freeSlots.push_back(existing->second);
+            existing->second = i;
+        } else {
+            _byTransactionId.emplace(transactionId, i);
+        }
+        index(i, *record);
+    }
+    // The header keeps the high-water mark, so removing the latest record cannot rewind cursors.
+    _sequence = loadLittleEndian<std::uint64_t>(header + 24);
+    if (!_bySequence.empty()) {
+        _sequence = std::max(_sequence, _bySequence.rbegin()->first);
+    }
+    return ErrorCode::None;
+}
+
+StoredTransactionRecord *TransactionRecordStore::slot(std::uint32_t index) const {
+    return reinterpret_cast<StoredTransactionRecord *>(_region.data() + kHeaderSize + static_cast<std::size_t>(index) * kSlotSize);
+}
+
+ErrorCode TransactionRecordStore::grow() {
+    const std::uint32_t capacity = std::max<std::uint32_t>(_capacity * 2, kInitialCapacity);
+    const std::uint64_t fileSize = kHeaderSize + static_cast<std::uint64_t>(capacity) * kSlotSize;
+
+    ErrorCode error = _file.truncate(fileSize);
+    if (error != ErrorCode::None) {
+        return error;
+    }
+    MappedRegion region;
+    if ((error = MappedRegion::map(_file, static_cast<std::size_t>(fileSize), region)) != ErrorCode::None) {
+        return error;
+    }
+    storeLittleEndian(region.data() + 16, capacity);
+    _region = std::move(region);
+
+    for (std::uint32_t i = capacity; i-- > _capacity;) {
+        _freeSlots.push_back(i);
+    }
+    _capacity = capacity;
+    return ErrorCode::None;
+}
+
+void TransactionRecordStore::index(std::uint32_t slotIndex, const StoredTransactionRecord &record) {
+    const std::int64_t createdAt = record.createdAtMillis;
+    _bySequence.emplace(record.changeSequence, slotIndex);
+    _byCreatedAt.emplace(std::make_pair(std::uint8_t{0}, createdAt), slotIndex);
+    _byState.emplace(std::make_pair(record.apiTransactionState, createdAt), slotIndex);
+    if (record.lastFour[0] != '\0') {
+        _byLastFour.emplace(std::make_pair(lastFourKey(record), createdAt), slotIndex);
+    }
+    if (record.referenceId[0] != '\0') {
+        _byReferenceId.emplace(std::make_pair(StoredTransactionRecord::text(record.referenceId), createdAt), slotIndex);
+    }
+}
+
+void TransactionRecordStore::unindex(std::uint32_t slotIndex, const StoredTransactionRecord &record) {
+    const std::int64_t createdAt = record.createdAtMillis;
+    _bySequence.erase(record.changeSequence);
+    eraseEntry(_byCreatedAt, std::uint8_t{0}, createdAt, slotIndex);
+    eraseEntry(_byState, record.apiTransactionState, createdAt, slotIndex);
+    if (record.lastFour[0] != '\0') {
+        eraseEntry(_byLastFour, lastFourKey(record), createdAt, slotIndex);
+    }
+    if (record.referenceId[0] != '\0') {
+        eraseEntry(_byReferenceId, StoredTransactionRecord::text(record.referenceId), createdAt, slotIndex);
+    }
+}
+
+ErrorCode TransactionRecordStore::writeSlot(std::uint32_t slotIndex, const StoredTransactionRecord &record) {
+    StoredTransactionRecord stored = record;
+    stored.flags = static_cast<std::uint8_t>(kSlotOccupied | (record.flags & kSettledLocally));
+    stored.changeSequence = ++_sequence;
+    storeLittleEndian(_region.data() + 24, _sequence);
+    stored.checksum = slotChecksum(stored);
+    std::memcpy(slot(slotIndex), &stored, kSlotSize);
+    if (_config.syncOnWrite) {
+        return _region.sync(kHeaderSize + static_cast<std::size_t>(slotIndex) * kSlotSize, kSlotSize);
+    }
+    return ErrorCode::None;
+}
+
+void TransactionRecordStore::removeSlot(std::uint32_t slotIndex) {
+    StoredTransactionRecord *record = slot(slotIndex);
+    unindex(slotIndex, *record);
+    _byTransactionId.erase(StoredTransactionRecord::text(record->transactionId));
+    std::memset(record, 0, kSlotSize);
+    _freeSlots.push_back(slotIndex);
+}
+
+ErrorCode TransactionRecordStore::put(const StoredTransactionRecord &record) {
+    const std::string transactionId = StoredTransactionRecord::text(record.transactionId);
+    if (transactionId.empty()) {
+        return ErrorCode::InvalidArgument;
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto existing = _byTransactionId.find(transactionId);
+    if (existing != _byTransactionId.end()) {
+        const std::uint32_t slotIndex = existing->second;
+        StoredTransactionRecord replacement = record;
+        bool settledLocally = false;
+        replacement.apiTransactionState = reconciledState(*slot(slotIndex), record.apiTransactionState, settledLocally);
+        replacement.flags = settledLocally ? kSettledLocally : 0;
+        replacement.previousApiTransactionState = previousStateFor(*slot(slotIndex), replacement.apiTransactionState);
+        unindex(slotIndex, *slot(slotIndex));
+        const ErrorCode error = writeSlot(slotIndex, replacement);
+        index(slotIndex, *slot(slotIndex));
+        return error;
+    }
+
+    if (_byTransactionId.size() >= _config.maxRecords) {
+        removeSlot(_byCreatedAt.begin()->second);
+    }
+    if (_freeSlots.empty()) {
+        const ErrorCode error = grow();
+        if (error != ErrorCode::None) {
+            return error;
+        }
+    }
+
+    const std::uint32_t slotIndex = _freeSlots.back();
+    _freeSlots.pop_back();
+    StoredTransactionRecord inserted = record;
+    inserted.flags = 0;
+    inserted.previousApiTransactionState = record.apiTransactionState;
+    const ErrorCode error = writeSlot(slotIndex, inserted);
+    _byTransactionId.emplace(transactionId, slotIndex);
+    index(slotIndex, *slot(slotIndex));
+    return error;
+}
+
+ErrorCode TransactionRecordStore::applyDelta(const TransactionRecordDelta &delta, bool &changed) {
+    changed = false;
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto found = _byTransactionId.find(delta.transactionId);
+    if (found == _byTransactionId.end()) {
+        return ErrorCode::NotFound;
+    }
+
+    const std::uint32_t slotIndex = found->second;
+    const StoredTransactionRecord &current = *slot(slotIndex);
+    bool settledLocally = false;
+    const std::uint8_t state = reconciledState(current, static_cast<std::uint8_t>(delta.state), settledLocally);
+    const auto result = static_cast<std::uint8_t>(delta.result);
+    const bool transactedAtChanged = delta.transactedAtMillis >= 0 && delta.transactedAtMillis != current.transactedAtMillis;
+    const bool flagsChanged = settledLocally != ((current.flags & kSettledLocally) != 0);
+    if (current.apiTransactionState == state && current.result == result && !transactedAtChanged && !flagsChanged) {
+        return ErrorCode::None;
+    }
+
+    StoredTransactionRecord patched = current;
+    patched.flags = settledLocally ? kSettledLocally : 0;
+    patched.previousApiTransactionState = previousStateFor(current, state);
+    patched.apiTransactionState = state;
+    patched.result = result;
+    if (transactedAtChanged) {
+        patched.transactedAtMillis = delta.transactedAtMillis;
+    }
+    patched.updatedAtMillis = delta.updatedAtMillis;
+
+    unindex(slotIndex, current);
+    const ErrorCode error = writeSlot(slotIndex, patched);
+    index(slotIndex, *slot(slotIndex));
+    changed = true;
+    return error;
+}
+
+ErrorCode TransactionRecordStore::settleLocally(const std::string &transactionId, std::int64_t updatedAtMillis) {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto found = _byTransactionId.find(transactionId);
+    if (found == _byTransactionId.end()) {
+        return ErrorCode::NotFound;
+    }
+
+    const std::uint32_t slotIndex = found->second;
+    const StoredTransactionRecord &current = *slot(slotIndex);
+    StoredTransactionRecord patched = current;
+    patched.flags = kSettledLocally;
+    patched.apiTransactionState = static_cast<std::uint8_t>(ApiTransactionState::Settled);
+    patched.previousApiTransactionState = previousStateFor(current, patched.apiTransactionState);
+    patched.updatedAtMillis = updatedAtMillis;
+
+    unindex(slotIndex, current);
+    const ErrorCode error = writeSlot(slotIndex, patched);
+    index(slotIndex, *slot(slotIndex));
+    return error;
+}
+
+std::uint64_t TransactionRecordStore::settlementBatchNumber() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return std::max<std::uint64_t>(loadLittleEndian<std::uint64_t>(_region.data() + kBatchNumberOffset), 1);
+}
+
+ErrorCode TransactionRecordStore::setSettlementBatchNumber(std::uint64_t batchNumber) {
+    std::lock_guard<std::mutex> guard(_lock);
+    storeLittleEndian(_region.data() + kBatchNumberOffset, batchNumber);
+    if (_config.syncOnWrite) {
+        return _region.sync(0, kHeaderSize);
+    }
+    return ErrorCode::None;
+}
+
+ErrorCode TransactionRecordStore::compareAndSetTip(const std::string &transactionId, std::int64_t expectedTipMinor,
+                                                   std::int64_t tipMinor, std::int64_t updatedAtMillis) {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto found = _byTransactionId.find(transactionId);
+    if (found == _byTransactionId.end()) {
+        return ErrorCode::NotFound;
+    }
+
+    const std::uint32_t slotIndex = found->second;
+    const StoredTransactionRecord &current = *slot(slotIndex);
+    if (current.tipMinor != expectedTipMinor) {
+        return ErrorCode::IllegalTransition;
+    }
+    if (tipMinor == expectedTipMinor) {
+        return ErrorCode::None;
+    }
+
+    // Only the tip changes, so the indexes stay as they are.
+    StoredTransactionRecord patched = current;
+    patched.tipMinor = tipMinor;
+    patched.updatedAtMillis = updatedAtMillis;
+    _bySequence.erase(current.changeSequence);
+    const ErrorCode error = writeSlot(slotIndex, patched);
+    _bySequence.emplace(slot(slotIndex)->changeSequence, slotIndex);
+    return error;
+}
+
+std::vector<StoredTransactionRecord> TransactionRecordStore::changesSince(std::uint64_t cursor, std::size_t limit,
+                                                                          std::uint64_t &nextCursor) const {
+    std::vector<StoredTransactionRecord> changes;
+    std::lock_guard<std::mutex> guard(_lock);
+    nextCursor = cursor;
+    for (auto it = _bySequence.upper_bound(cursor); it != _bySequence.end() && changes.size() < limit; ++it) {
+        changes.push_back(*slot(it->second));
+        nextCursor = it->first;
+    }
+    return changes;
+}
+
+std::uint64_t TransactionRecordStore::cursor() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _sequence;
+}
+
+bool TransactionRecordStore::get(const std::string &transactionId, StoredTransactionRecord &record) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto found = _byTransactionId.find(transactionId);
+    if (found == _byTransactionId.end()) {
+        return false;
+    }
+    record = *slot(found->second);
+    return true;
+}
+
+ErrorCode TransactionRecordStore::remove(const std::string &transactionId) {
+    std::lock_guard<std::mutex> guard(_lock);
+    const auto found = _byTransactionId.find(transactionId);
+    if (found == _byTransactionId.end()) {
+        return ErrorCode::NotFound;
+    }
+    removeSlot(found->second);
+    return ErrorCode::None;
+}
+
+std::vector<StoredTransactionRecord> TransactionRecordStore::query(const TransactionRecordQuery &query) const {
+    std::vector<StoredTransactionRecord> results;
+    if (query.limit == 0 || query.createdFromMillis >= query.createdToMillis) {
+        return results;
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+    // Walks one key of an index from newest to oldest within the time range.
+    auto scan = [&](const auto &index, const auto &key) {
+        auto first = index.lower_bound(std::make_pair(key, query.createdFromMillis));
+        auto it = index.lower_bound(std::make_pair(key, query.createdToMillis));
+        while (it != first && results.size() < query.limit) {
+            --it;
+            const StoredTransactionRecord *record = slot(it->second);
+            if (matches(*record, query)) {
+                results.push_back(*record);
+            }
+        }
+    };
+
+    if (!query.referenceId.empty()) {
+        scan(_byReferenceId, query.referenceId);
+    } else if (!query.lastFour.empty()) {
+        if (query.lastFour.size() <= sizeof(StoredTransactionRecord::lastFour)) {
+            scan(_byLastFour, lastFourKey(query.lastFour));
+        }
+    } else if (query.matchState) {
+        scan(_byState, static_cast<std::uint8_t>(query.state));
+    } else {
+        scan(_byCreatedAt, std::uint8_t{0});
+    }
+    return results;
+}
+
+std::size_t TransactionRecordStore::count() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _byTransactionId.size();
+}
+
+ErrorCode TransactionRecordStore::sync() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _region.sync();
+}
+
+} // namespace cft
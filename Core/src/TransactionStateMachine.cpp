@@ -0,0 +1,121 @@
+//
+//  TransactionStateMachine.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/TransactionStateMachine.hpp"
+
+namespace cft {
+
+namespace {
+
+using S = TransactionState;
+
+// kTransitions[state][event] is the state reached by applying event in state,
+// or Unknown when the event is illegal there.
+constexpr S kTransitions[kTransactionStateCount][kTransactionEventCount] = {
+    //                      Begin                           AttachParameters     ReceiveCardInput         SelectProcess  SelectDefer  SelectCancel Resume                   RequestCvm    AttachCvm     RequestAdjustment     AttachAdjustment Complete     Fail
+    /* Unknown */          {S::PendingTransactionParameters, S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Unknown,  S::Unknown,              S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Unknown},
+    /* PendingParams */    {S::Unknown,                      S::PendingCardInput, S::Unknown,              S::Unknown,    S::Unknown,  S::Completed, S::Unknown,             S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Completed},
+    /* PendingCardInput */ {S::Unknown,                      S::Unknown,          S::PendingProcessOption, S::Unknown,    S::Unknown,  S::Completed, S::Unknown,             S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Completed},
+    /* PendingProcess */   {S::Unknown,                      S::Unknown,          S::Unknown,              S::Processing, S::Deferred, S::Completed, S::Unknown,             S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Completed},
+    /* Processing */       {S::Unknown,                      S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Unknown,  S::Unknown,              S::PendingCvm, S::Unknown,  S::PendingAdjustment, S::Unknown,    S::Completed, S::Completed},
+    /* Completed */        {S::Unknown,                      S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Unknown,  S::Unknown,              S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Unknown},
+    /* Deferred */         {S::Unknown,                      S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Unknown,  S::PendingProcessOption, S::Unknown,   S::Unknown,   S::Unknown,           S::Unknown,    S::Unknown,   S::Unknown},
+    /* PendingCvm */       {S::Unknown,                      S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Completed, S::Unknown,             S::Unknown,   S::Processing, S::Unknown,          S::Unknown,    S::Unknown,   S::Completed},
+    /* PendingAdjust */    {S::Unknown,                      S::Unknown,          S::Unknown,              S::Unknown,    S::Unknown,  S::Completed, S::Unknown,             S::Unknown,   S::Unknown,   S::Unknown,           S::Processing, S::Unknown,   S::Completed},
+};
+
+} // namespace
+
+const char *transactionEventName(TransactionEvent event) {
+    switch (event) {
+        case TransactionEvent::Begin: return "begin";
+        case TransactionEvent::AttachParameters: return "attachParameters";
+        case TransactionEvent::ReceiveCardInput: return "receiveCardInput";
+        case TransactionEvent::SelectProcess: return "selectProcess";
+        case TransactionEvent::SelectDefer: return "selectDefer";
+        case TransactionEvent::SelectCancel: return "selectCancel";
+        case TransactionEvent::Resume: return "resume";
+        case TransactionEvent::RequestCvm: return "requestCvm";
+        case TransactionEvent::AttachCvm: return "attachCvm";
+        case TransactionEvent::RequestAdjustment: return "requestAdjustment";
+        case TransactionEvent::AttachAdjustment: return "attachAdjustment";
+        case TransactionEvent::Complete: return "complete";
+        case TransactionEvent::Fail: return "fail";
+    }
+    return "unknown";
+}
+
+TransactionState TransactionStateMachine::targetState(TransactionState state, TransactionEvent event) {
+    const auto stateIndex = static_cast<std::size_t>(state);
+    const auto eventIndex = static_cast<std::size_t>(event);
+    if (stateIndex >= kTransactionStateCount || eventIndex >= kTransactionEventCount) {
+        return TransactionState::Unknown;
+    }
+    return kTransitions[stateIndex][eventIndex];
+}
+
+bool TransactionStateMachine::isTerminal(TransactionState state) {
+    return state == TransactionState::Completed || state == TransactionState::Deferred;
+}
+
+TransactionStateMachine::TransactionStateMachine(Observer *observer, ClockFunction clock)
+    : _observer(observer),
+      _clock(clock),
+      _state(TransactionState::Unknown),
+      _result(TransactionResult::Unknown),
+      _enteredStateAt(clock()),
+      _transitionCount(0) {}
+
+ErrorCode TransactionStateMachine::apply(TransactionEvent event, TransactionResult result) {
+    const TransactionState target = targetState(_state, event);
+    if (target == TransactionState::Unknown) {
+        return ErrorCode::IllegalTransition;
+    }
+
+    switch (event) {
+        case TransactionEvent::SelectCancel: _result = TransactionResult::Canceled; break;
+        case TransactionEvent::Fail: _result = TransactionResult::Errored; break;
+        case TransactionEvent::Complete: _result = result; break;
+        default: break;
+    }
+
+    enter(target);
+    return ErrorCode::None;
+}
+
+ErrorCode TransactionStateMachine::transitionTo(TransactionState state) {
+    for (std::size_t event = 0; event < kTransactionEventCount; ++event) {
+        if (targetState(_state, static_cast<TransactionEvent>(event)) == state) {
+            enter(state);
+            return ErrorCode::None;
+        }
+    }
+    return ErrorCode::IllegalTransition;
+}
+
+void TransactionStateMachine::reset() {
+    _state = TransactionState::Unknown;
+    _result = TransactionResult::Unknown;
+    _enteredStateAt = _clock();
+    _transitionCount = 0;
+}
+
+void TransactionStateMachine::enter(TransactionState state) {
+    const Nanos now = _clock();
+    const TransactionState previous = _state;
+    const Nanos timeInPrevious = now - _enteredStateAt;
+
+    _state = state;
+    _enteredStateAt = now;
+    ++_transitionCount;
+
+    if (_observer != nullptr) {
+        _observer->stateMachineDidTransition(*this, previous, state, timeInPrevious);
+    }
+}
+
+} // namespace cft
@@ -0,0 +1,185 @@
+//
+//  TransactionTrace.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/TransactionTrace.hpp"
+
+#include "cft/TransactionStateMachine.hpp"
+
+namespace cft {
+
+namespace {
+
+bool isCardEvent(CardReaderEvent event) {
+    switch (event) {
+        case CardReaderEvent::CardSwiped:
+        case CardReaderEvent::CardSwipeErrored:
+        case CardReaderEvent::CardInserted:
+        case CardReaderEvent::CardInsertErrored:
+        case CardReaderEvent::CardTapped:
+        case CardReaderEvent::CardTapErrored:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+constexpr std::size_t TransactionTrace::kCapacity;
+
+void TransactionTrace::record(TraceEventKind kind, std::int32_t value, ErrorCode error) {
+    if (_size == kCapacity) {
+        ++_dropped;
+        return;
+    }
+    TraceEvent &event = _events[_size++];
+    event.at = _clock();
+    event.kind = kind;
+    event.value = value;
+    event.error = error;
+}
+
+void TransactionTrace::recordState(TransactionState state, ErrorCode error) {
+    record(TraceEventKind::State, static_cast<std::int32_t>(state), error);
+}
+
+void TransactionTrace::recordReaderEvent(CardReaderEvent event, ErrorCode error) {
+    record(TraceEventKind::ReaderEvent, static_cast<std::int32_t>(event), error);
+}
+
+void TransactionTrace::recordGatewayRequest(std::int32_t request) {
+    record(TraceEventKind::GatewayRequest, request, ErrorCode::None);
+}
+
+void TransactionTrace::recordGatewayResponse(std::int32_t request, ErrorCode error) {
+    record(TraceEventKind::GatewayResponse, request, error);
+}
+
+void TransactionTrace::reset() {
+    _size = 0;
+    _dropped = 0;
+}
+
+TraceBreakdown TransactionTrace::breakdown() const {
+    TraceBreakdown breakdown;
+    if (_size == 0) {
+        return breakdown;
+    }
+
+    TransactionState state = TransactionState::Unknown;
+    Nanos enteredAt = 0;
+    Nanos cardRequestedAt = 0;
+    Nanos cardEventAt = 0;
+    Nanos requestAt = 0;
+    bool requestOpen = false;
+    // Card event of the current attempt; breakdown.hasCardEvent stays set once any attempt had one.
+    bool attemptHasCardEvent = false;
+
+    for (std::size_t i = 0; i < _size; ++i) {
+        const TraceEvent &event = _events[i];
+        switch (event.kind) {
+            case TraceEventKind::State: {
+                const auto next = static_cast<TransactionState>(event.value);
+                const auto index = static_cast<std::size_t>(next);
+                if (index >= kTransactionStateCount || next == state) {
+                    break;
+                }
+                if (state != TransactionState::Unknown) {
+                    breakdown.inState[static_cast<std::size_t>(state)] += event.at - enteredAt;
+                }
+                if (state == TransactionState::PendingCardInput && attemptHasCardEvent) {
+                    breakdown.segments[static_cast<std::size_t>(TraceSegment::CardReading)] += event.at - cardEventAt;
+                }
+                if (next == TransactionState::PendingCardInput) {
+                    cardRequestedAt = event.at;
+                    // Re-entered on swipe fallback; presentation time adds up over the attempts.
+                    attemptHasCardEvent = false;
+                }
+                ++breakdown.entries[index];
+                state = next;
+                enteredAt = event.at;
+                break;
+            }
+            case TraceEventKind::ReaderEvent:
+                if (state == TransactionState::PendingCardInput && !attemptHasCardEvent &&
+                    isCardEvent(static_cast<CardReaderEvent>(event.value))) {
+                    attemptHasCardEvent = true;
+                    breakdown.hasCardEvent = true;
+                    cardEventAt = event.at;
+                    breakdown.segments[static_cast<std::size_t>(TraceSegment::CardPresentation)] +=
+                        event.at - cardRequestedAt;
+                }
+                break;
+            case TraceEventKind::GatewayRequest:
+                requestAt = event.at;
+                requestOpen = true;
+                break;
+            case TraceEventKind::GatewayResponse:
+                if (requestOpen) {
+                    breakdown.segments[static_cast<std::size_t>(TraceSegment::Gateway)] += event.at - requestAt;
+                    ++breakdown.gatewayRequests;
+                    requestOpen = false;
+                }
+                break;
+        }
+    }
+
+    breakdown.segments[static_cast<std::size_t>(TraceSegment::Total)] = _events[_size - 1].at - _events[0].at;
+    return breakdown;
+}
+
+void TraceAggregator::add(const TraceBreakdown &breakdown) {
+    for (std::size_t i = 0; i < kTransactionStateCount; ++i) {
+        if (breakdown.entries[i] > 0 && !TransactionStateMachine::isTerminal(static_cast<TransactionState>(i))) {
+            _states[i].record(breakdown.inState[i]);
+        }
+    }
+    _segments[static_cast<std::size_t>(TraceSegment::Total)].record(
+        breakdown.segments[static_cast<std::size_t>(TraceSegment::Total)]);
+    if (breakdown.hasCardEvent) {
+        for (TraceSegment segment : {TraceSegment::CardPresentation, TraceSegment::CardReading}) {
+            _segments[static_cast<std::size_t>(segment)].record(breakdown.segments[static_cast<std::size_t>(segment)]);
+        }
+    }
+    if (breakdown.gatewayRequests > 0) {
+        _segments[static_cast<std::size_t>(TraceSegment::Gateway)].record(
+            breakdown.segments[static_cast<std::size_t>(TraceSegment::Gateway)]);
+    }
+    ++_count;
+}
+
+void TraceAggregator::merge(const TraceAggregator &other) {
+    for (std::size_t i = 0; i < kTransactionStateCount; ++i) {
+        _states[i].merge(other._states[i]);
+    }
+    for (std::size_t i = 0; i < kTraceSegmentCount; ++i) {
+        _segments[i].merge(other._segments[i]);
+    }
+    _count += other._count;
+}
+
+void TraceAggregator::clear() {
+    for (auto &histogram : _states) {
+        histogram.clear();
+    }
+    for (auto &histogram : _segments) {
+        histogram.clear();
+    }
+    _count = 0;
+}
+
+const char *traceSegmentName(TraceSegment segment) {
+    switch (segment) {
+        case TraceSegment::Total: return "total";
+        case TraceSegment::CardPresentation: return "cardPresentation";
+        case TraceSegment::CardReading: return "cardReading";
+        case TraceSegment::Gateway: return "gateway";
+    }
+    return "unknown";
+}
+
+} // namespace cft
@@ -0,0 +1,107 @@
+//
+//  Types.cpp
+//  CardFlight
+//
+//  Copyright © 2019 CardFlight Inc. All rights reserved.
+//
+
+#include "cft/Error.hpp"
+#include "cft/Types.hpp"
+
+namespace cft {
+
+const char *transactionStateName(TransactionState state) {
+    switch (state) {
+        case TransactionState::Unknown: return "unknown";
+        case TransactionState::PendingTransactionParameters: return "pendingTransactionParameters";
+        case TransactionState::PendingCardInput: return "pendingCardInput";
+        case TransactionState::PendingProcessOption: return "pendingProcessOption";
+        case TransactionState::Processing: return "processing";
+        case TransactionState::Completed: return "completed";
+        case TransactionState::Deferred: return "deferred";
+        case TransactionState::PendingCvm: return "pendingCvm";
+        case TransactionState::PendingAdjustment: return "pendingAdjustment";
+    }
+    return "unknown";
+}
+
+const char *cardReaderEventName(CardReaderEvent event) {
+    switch (event) {
+        case CardReaderEvent::Unknown: return "unknown";
+        case CardReaderEvent::Disconnected: return "disconnected";
+        case CardReaderEvent::Connected: return "connected";
+        case CardReaderEvent::ConnectionErrored: return "connectionErrored";
+        case CardReaderEvent::CardSwiped: return "cardSwiped";
+        case CardReaderEvent::CardSwipeErrored: return "cardSwipeErrored";
+        case CardReaderEvent::CardInserted: return "cardInserted";
+        case CardReaderEvent::CardInsertErrored: return "cardInsertErrored";
+        case CardReaderEvent::CardRemoved: return "cardRemoved";
+        case CardReaderEvent::CardTapped: return "cardTapped";
+        case CardReaderEvent::CardTapErrored: return "cardTapErrored";
+        case CardReaderEvent::UpdateStarted: return "updateStarted";
+        case CardReaderEvent::UpdateCompleted: return "updateCompleted";
+        case CardReaderEvent::AudioRecordingPermissionNotGranted: return "audioRecordingPermissionNotGranted";
+        case CardReaderEvent::FatalError: return "fatalError";
+        case CardReaderEvent::Connecting: return "connecting";
+        case CardReaderEvent::BatteryStatusUpdated: return "batteryStatusUpdated";
+    }
+    return "unknown";
+}
+
+const char *cardInputMethodName(CardInputMethod method) {
+    switch (method) {
+        case CardInputMethod::Unknown: return "unknown";
+        case CardInputMethod::Key: return "key";
+        case CardInputMethod::Swipe: return "swipe";
+        case CardInputMethod::Dip: return "dip";
+        case CardInputMethod::Tap: return "tap";
+        case CardInputMethod::SwipeFallback: return "swipeFallback";
+        case CardInputMethod::QuickChip: return "quickChip";
+    }
+    return "unknown";
+}
+
+const char *cardReaderModelName(CardReaderModel model) {
+    switch (model) {
+        case CardReaderModel::Unknown: return "unknown";
+        case CardReaderModel::Shuttle: return "shuttle";
+        case CardReaderModel::BTMag: return "btMag";
+        case CardReaderModel::A100: return "A100";
+        case CardReaderModel::A200: return "A200";
+        case CardReaderModel::B550: return "B550";
+        case CardReaderModel::B500: return "B500";
+        case CardReaderModel::A250: return "A250";
+        case CardReaderModel::B200: return "B200";
+        case CardReaderModel::B250: return "B250";
+    }
+    return "unknown";
+}
+
+bool isFinalApiTransactionState(ApiTransactionState state) {
+    switch (state) {
+        case ApiTransactionState::Voided:
+        case ApiTransactionState::Declined:
+        case ApiTransactionState::Settled:
+        case ApiTransactionState::Canceled:
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char *errorCodeName(ErrorCode code) {
+    switch (code) {
+        case ErrorCode::None: return "none";
+        case ErrorCode::IllegalTransition: return "illegalTransition";
+        case ErrorCode::InvalidArgument: return "invalidArgument";
+        case ErrorCode::Declined: return "declined";
+        case ErrorCode::InteractionRequired: return "interactionRequired";
+        case ErrorCode::CapacityExceeded: return "capacityExceeded";
+        case ErrorCode::NotFound: return "notFound";
+        case ErrorCode::IOFailure: return "ioFailure";
+        case ErrorCode::External: return "external";
+    }
+    return "unknown";
+}
+
+} // namespace cft